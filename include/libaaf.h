@@ -31,6 +31,10 @@ extern "C" {
 #include <libaaf/AAFCore.h>
 #include <libaaf/AAFIface.h>
 #include <libaaf/AAFIEssenceFile.h>
+#include <libaaf/AAFIEnvelope.h>
+#include <libaaf/AAFIRender.h>
+#include <libaaf/AAFIPeaks.h>
+#include <libaaf/AAFILoudness.h>
 
 #include <libaaf/CFBDump.h>
 #include <libaaf/AAFDump.h>
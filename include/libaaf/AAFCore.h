@@ -416,6 +416,83 @@ typedef struct aafObject
 
 
 
+/**
+ * This structure holds the callbacks used by aaf_visit_file() to walk the AAF
+ * Objects Tree without keeping it in memory. Any callback can be NULL.
+ *
+ * Each Object is passed to on_object_begin() once all its properties were read,
+ * so aaf_get_propertyValue() can be used on it, except for strong references.
+ * Then on_property() is called for each of its properties. When a property is a
+ * strong reference, the referenced Object(s) are visited right after on_property()
+ * returns. Finally, on_object_end() is called and the Object is freed, so neither
+ * the Object nor its properties can be kept once a callback has returned.
+ *
+ * A callback returning a negative value stops the traversal. on_object_begin()
+ * returning a positive value skips the Object properties and references, and
+ * on_object_end() is not called for that Object.
+ */
+
+typedef struct aafVisitor
+{
+	int (*on_object_begin)( struct aafVisitor *visitor, aafObject *Obj );
+
+	/**
+	 * For strong references, Prop->val holds the raw UTF-16 reference name.
+	 */
+
+	int (*on_property)( struct aafVisitor *visitor, aafObject *Obj, aafProperty *Prop );
+
+	int (*on_object_end)( struct aafVisitor *visitor, aafObject *Obj );
+
+
+	/**
+	 * Depth of the current Object in the Tree, Root being 0. Set by aaf_visit_file().
+	 */
+
+	uint32_t depth;
+
+
+	/**
+	 * Free for caller use.
+	 */
+
+	void *user;
+
+} aafVisitor;
+
+
+
+
+/**
+ * Buffers holding the strings returned by aaf_get_ObjectPath() and the
+ * aaft_*ToText() functions. Each AAF_Data holds its own, so those functions
+ * can be called from distinct threads on distinct AAF_Data.
+ *
+ * A returned string stays valid until the next call to the same function
+ * with the same AAF_Data.
+ */
+
+typedef struct aafTextBuffers {
+
+	char ObjectPath[CFB_PATH_NAME_SZ];
+
+	char AUID[CFB_CLSID_TEXT_SZ];
+	char MobID[200];
+	char Timestamp[32];
+	char Version[16];
+	char ProductVersion[64];
+
+	char DataDef[1024];
+	char OperationDef[1024];
+	char ParameterDef[1024];
+	char PID[1024];
+	char ClassID[1024];
+	char IndirectValue[4096];
+
+} aafTextBuffers;
+
+
+
 
 /**
  * This structure is the main structure when using LibAAF.
@@ -620,6 +697,37 @@ typedef struct _aafData
 	aafObject  *TaggedValueDefinition;
 
 
+	/**
+	 * Set by aaf_probe(). When set, only the Header, Identification and
+	 * CompositionMob branches of the Object Tree are retrieved.
+	 */
+
+	int         probe;
+
+
+	/**
+	 * Number of threads used to retrieve the ContentStorage Mobs and EssenceData
+	 * branches of the Object Tree. 0 or 1 retrieves them sequentially. Ignored
+	 * when libAAF is built without LIBAAF_THREADS.
+	 */
+
+	int         threads;
+
+
+	/**
+	 * Text buffers used by aaf_get_ObjectPath() and the aaft_*ToText() functions.
+	 */
+
+	aafTextBuffers text;
+
+
+	/**
+	 * Set by aaf_visit_file() while the Header branch of the Object Tree is visited.
+	 */
+
+	aafVisitor *visitor;
+
+
 	struct aafLog *log;
 
 } AAF_Data;
@@ -744,6 +852,48 @@ AAF_Data * aaf_alloc( struct aafLog *log );
 int aaf_load_file( AAF_Data   *aafd,
                    const char *file );
 
+
+/**
+ * Loads an AAF file the same way aaf_load_file() does, but only retrieves the
+ * Header, the Identification and the CompositionMobs with their MobSlots and
+ * Segments. The MetaDictionary, the Dictionary, the EssenceData and any other
+ * Mob are left untouched, so only a small fraction of the file is read.
+ *
+ * AAF_Data.Header and AAF_Data.Identification are set the same way as with
+ * aaf_load_file(). AAF_Data.Mobs only holds the CompositionMobs.
+ *
+ * @param  aafd  Pointer to the AAF_Data structure.
+ * @param  file  Pointer to a null terminated string holding the filepath.
+ * @return       0 on success\n
+ *               1 on failure
+ */
+
+int aaf_probe( AAF_Data   *aafd,
+               const char *file );
+
+
+/**
+ * Walks through the AAF Objects Tree of a file, calling the aafVisitor callbacks
+ * for each Object and property, as they are read from the Compound File. Except
+ * for the MetaDictionary which is always loaded, Objects are freed right after they
+ * were visited, so memory usage only depends on the Tree depth.
+ *
+ * Only the Root Object and the Root::Header branch are visited. Since the Tree is
+ * never stored, AAF_Data.Header, AAF_Data.Identification and all the AAF_Data
+ * shortcuts are left unset.
+ *
+ * @param  aafd     Pointer to the AAF_Data structure.
+ * @param  file     Pointer to a null terminated string holding the filepath.
+ * @param  visitor  Pointer to the aafVisitor structure holding the callbacks.
+ * @return          0 on success\n
+ *                  1 if file could not be loaded\n
+ *                 -1 on error, or if a callback stopped the traversal.
+ */
+
+int aaf_visit_file( AAF_Data   *aafd,
+                    const char *file,
+                    aafVisitor *visitor );
+
 /**
  * @}
  */
@@ -778,11 +928,13 @@ void aaf_release( AAF_Data **aafd );
 /**
  * Retrieves, for a given Object, its path in the Compound File Binary Tree.
  *
- * @note It is the caller responsability to free the returned pointer.
+ * @note The returned string is held by Obj->aafd->text and must not be freed.
+ *       It is overwritten by the next call on an Object of the same AAF_Data.
  *
  * @param  Obj  Pointer to the aafObject.
  *
- * @return      Pointer to a null-terminated string holding the Object's path.
+ * @return      Pointer to a null-terminated string holding the Object's path,\n
+ *              NULL if Obj is NULL.
  */
 
 char * aaf_get_ObjectPath( aafObject *Obj );
@@ -0,0 +1,98 @@
+/*
+ * Copyright (C) 2017-2024 Adrien Gesta-Fline
+ *
+ * This file is part of libAAF.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __AAFIEnvelope_h__
+#define __AAFIEnvelope_h__
+
+/**
+ * @file LibAAF/AAFIface/AAFIEnvelope.h
+ * @brief Sample accurate evaluation of gain, pan and fade curves
+ *
+ * Gain and pan automation times are normalized to the length of the component
+ * they apply to (0 is its start, 1 is its end). These functions evaluate curves
+ * at every sample of a range, relative to the component start.
+ *
+ * Interpolations are evaluated as follows :
+ *  - Linear, or interpolation not set : straight line between points.
+ *  - Constant or None : value of a point is held up to the next one.
+ *  - Power : equal power (sine) shape.
+ *  - Log : exponential shape over 60 dB, slow start when rising and fast start
+ *    when falling, so both sound linear.
+ *  - BSpline : smoothstep between points.
+ *
+ * Values before the first point and after the last one are held.
+ *
+ * @ingroup AAFIface
+ * @addtogroup AAFIface
+ * @{
+ */
+
+#include <libaaf/AAFIface.h>
+
+
+
+/**
+ * Evaluates a gain or pan curve at count samples, starting at sample start of
+ * the component the gain applies to.
+ *
+ * Point times and values are converted once, on first evaluation, and kept with
+ * segment coefficients in aafiAudioGain.envelope until the gain is released. A
+ * gain can be evaluated from several threads at once when libAAF is built with
+ * LIBAAF_THREADS.
+ *
+ * A constant gain fills out with its single value, and a gain without any value
+ * with 1.
+ *
+ * @param  aafi       Pointer to the current AAF_Iface struct.
+ * @param  gain       Gain or pan to evaluate.
+ * @param  length     Length of the component the gain applies to.
+ * @param  editRate   Edit rate of length. If NULL, length is in samples.
+ * @param  sampleRate Sample rate of start, count and out.
+ * @param  start      First evaluated sample, from component start.
+ * @param  count      Number of evaluated samples.
+ * @param  out        Receives count values.
+ * @return            0 on success\n
+ *                   -1 on error
+ */
+int aafi_evalEnvelope( AAF_Iface *aafi, aafiAudioGain *gain, aafPosition_t length, aafRational_t *editRate, aafRational_t *sampleRate, aafPosition_t start, uint64_t count, float *out );
+
+/**
+ * Evaluates a transition curve at count samples, starting at sample start of
+ * the transition. The curve goes from aafiTransition.value_a[0] at transition
+ * start, to aafiTransition.value_a[1] at transition end, using the transition
+ * interpolation. This is the fade in curve : the fade out curve of a cross-fade
+ * is this one, reversed. A transition without curve fills out with 1.
+ *
+ * @param  aafi       Pointer to the current AAF_Iface struct.
+ * @param  trans      Transition to evaluate.
+ * @param  editRate   Edit rate of aafiTransition.len.
+ * @param  sampleRate Sample rate of start, count and out.
+ * @param  start      First evaluated sample, from transition start.
+ * @param  count      Number of evaluated samples.
+ * @param  out        Receives count values.
+ * @return            0 on success\n
+ *                   -1 on error
+ */
+int aafi_evalTransition( AAF_Iface *aafi, aafiTransition *trans, aafRational_t *editRate, aafRational_t *sampleRate, aafPosition_t start, uint64_t count, float *out );
+
+/**
+ * @}
+ */
+#endif // !__AAFIEnvelope_h__
@@ -34,6 +34,7 @@
  */
 
 #include <libaaf/AAFIface.h>
+#include <libaaf/sample.h>
 
 
 
@@ -42,18 +43,126 @@ char * aafi_locate_external_essence_file( AAF_Iface *aafi, const char *original_
 /**
  * Extract audio essence file.
  *
+ * Samples are converted on the fly when the "extract_sample_format" option is
+ * set, and dithered when the "extract_dither" option is set too. Channels are
+ * always extracted interleaved, "extract_split_channels" only applies to the
+ * batch functions below.
+ *
+ * When the "extract_samplerate" option is set, PCM samples of another rate are
+ * resampled (see laafResampler), keeping their sample size unless
+ * "extract_sample_format" is set. Memory use does not depend on essence length.
+ *
  * @param aafi XXXXXX
  */
 int aafi_extractAudioEssenceFile( AAF_Iface *aafi, aafiAudioEssenceFile *audioEssenceFile, enum aafiExtractFormat extractFormat, const char *outfilepath, uint64_t sampleOffset, uint64_t sampleLength, const char *forcedFileName, char **usable_file_path );
 
+/**
+ * Extract a batch of audio essence files. Essences are extracted largest first,
+ * using up to the number of threads set by the "threads" option when libAAF
+ * is built with LIBAAF_THREADS. Each thread reads the shared CFB through its
+ * own stream reader and chunk buffer. An essence listed more than once is
+ * extracted only once.
+ *
+ * When the "extract_split_channels" option is set, each channel of a PCM
+ * multichannel essence is written to its own mono wav file, named after the
+ * essence with a "_<channel>" suffix, in the same single pass over the stream.
+ * usable_file_path is then left unset.
+ *
+ * @param  aafi              Pointer to the current AAF_Iface struct.
+ * @param  audioEssenceFiles Array of embedded essences to extract.
+ * @param  count             Number of essences in audioEssenceFiles.
+ * @param  extractFormat     Output file format.
+ * @param  outfilepath       Directory where files are written.
+ * @return                   0 on success\n
+ *                          -1 if at least one essence could not be extracted
+ */
+int aafi_extractAudioEssenceFiles( AAF_Iface *aafi, aafiAudioEssenceFile **audioEssenceFiles, size_t count, enum aafiExtractFormat extractFormat, const char *outfilepath );
+
 int aafi_extractAudioClip( AAF_Iface *aafi, aafiAudioClip *audioClip, enum aafiExtractFormat extractFormat, const char *outfilepath );
 
+/**
+ * Extract a batch of audio clips. Clips are grouped by essence file and sorted
+ * by offset, so each embedded essence stream is read once, sequentially, no
+ * matter how many clips are cut from it. A clip using multiple essence files
+ * is extracted to one file per essence. Essence streams are processed largest
+ * first, on multiple threads as for aafi_extractAudioEssenceFiles().
+ *
+ * When the "extract_split_channels" option is set, a clip of a multichannel
+ * essence is written to one mono file per channel, or to a single mono file
+ * if its essence pointer selects a channel.
+ *
+ * When a clip is resampled, its essence offset and length are converted from
+ * clip edit rate straight to the output rate, so the clip is not shifted by the
+ * rounding of its offset to an essence sample.
+ *
+ * @param  aafi          Pointer to the current AAF_Iface struct.
+ * @param  audioClips    Array of clips to extract.
+ * @param  clipCount     Number of clips in audioClips.
+ * @param  extractFormat Output file format.
+ * @param  outfilepath   Directory where files are written.
+ * @return               0 on success\n
+ *                      -1 if at least one clip could not be extracted
+ */
+int aafi_extractAudioClips( AAF_Iface *aafi, aafiAudioClip **audioClips, size_t clipCount, enum aafiExtractFormat extractFormat, const char *outfilepath );
+
+/**
+ * Reads frameCount samples per channel of an essence, from sampleOffset, without
+ * extracting it. Embedded essences are read from their CFB stream, external ones
+ * from a read only mapping of the located file (usable_file_path), so only the
+ * sectors or pages holding the requested samples are read.
+ *
+ * Samples are written interleaved, at the essence sample size, little endian,
+ * for each channel selected by channelMask. Bit 0 of channelMask selects the
+ * first essence channel, bit 1 the second one and so on. If channelMask is 0,
+ * all channels are read.
+ *
+ * On first call, audio data is located and the extent index of the embedded
+ * stream is built, so that any later seek is a binary search over extents.
+ * Both are kept in aafiAudioEssenceFile.sampleReader until essences are released.
+ *
+ * @param  aafi             Pointer to the current AAF_Iface struct.
+ * @param  audioEssenceFile Essence to read.
+ * @param  sampleOffset     First sample to read.
+ * @param  frameCount       Number of samples per channel to read.
+ * @param  channelMask      Channels to read.
+ * @param  buf              Receives frameCount * selected channels * samplesize/8 bytes.
+ * @return                  Number of samples per channel read, less than frameCount
+ *                          past the end of audio data or on error.
+ */
+uint64_t aafi_readAudioSamples( AAF_Iface *aafi, aafiAudioEssenceFile *audioEssenceFile, uint64_t sampleOffset, uint64_t frameCount, uint64_t channelMask, void *buf );
+
+/**
+ * Gets the layout of audio data read by aafi_readAudioSamples(), as found in the
+ * essence data header. It may differ from the essence descriptor values.
+ *
+ * @param  aafi             Pointer to the current AAF_Iface struct.
+ * @param  audioEssenceFile Essence to read.
+ * @param  channels         If not NULL, receives the channel count.
+ * @param  samplesize       If not NULL, receives the sample size in bits.
+ * @param  frameCount       If not NULL, receives the number of samples per channel.
+ * @return                  0 on success\n
+ *                         -1 if audio data can't be read
+ */
+int aafi_getAudioSampleInfo( AAF_Iface *aafi, aafiAudioEssenceFile *audioEssenceFile, uint16_t *channels, uint16_t *samplesize, uint64_t *frameCount );
+
+/**
+ * Gets the sample format of audio data read by aafi_readAudioSamples(), out of
+ * the essence data header sample size and format tag.
+ *
+ * @param  aafi             Pointer to the current AAF_Iface struct.
+ * @param  audioEssenceFile Essence to read.
+ * @param  format           Receives the sample format.
+ * @return                  0 on success\n
+ *                         -1 if audio data can't be read, or is neither integer PCM nor 32 bits float
+ */
+int aafi_getAudioSampleFormat( AAF_Iface *aafi, aafiAudioEssenceFile *audioEssenceFile, enum laafSampleFormat *format );
+
+void aafi_freeSampleReader( aafiAudioEssenceFile *audioEssenceFile );
+
 int aafi_parse_audio_essence( AAF_Iface *aafi, aafiAudioEssenceFile *audioEssenceFile );
 
 int aafi_build_unique_audio_essence_name( AAF_Iface *aafi, aafiAudioEssenceFile *audioEssenceFile );
 
-aafiAudioEssencePointer * aafi_audioEssencePointer_exists_before( AAF_Iface *aafi, aafiAudioEssencePointer *audioEssencePointerList );
-
 /**
  * @}
  */
@@ -0,0 +1,116 @@
+/*
+ * Copyright (C) 2017-2024 Adrien Gesta-Fline
+ *
+ * This file is part of libAAF.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __AAFILoudness_h__
+#define __AAFILoudness_h__
+
+/**
+ * @file LibAAF/AAFIface/AAFILoudness.h
+ * @brief EBU R128 loudness and level measurement of essences and clips
+ *
+ * An essence is read once, and measured by steps of 100 ms : K-weighted energy
+ * (ITU-R BS.1770), sum of squares, sample peak and 4x oversampled true peak of
+ * every channel. Measures of any sample range of the essence, and so of every
+ * clip using it as is, are then computed from these steps, without reading audio
+ * data again. Ranges are rounded outward to whole steps. Clips with gain,
+ * automation or fades are rendered and measured by the same steps instead.
+ *
+ * Channel weights are 1.0, except for 6 channels, taken as L R C LFE Ls Rs :
+ * LFE is left out and surround channels are weighted 1.41.
+ *
+ * Levels of silence are -HUGE_VAL.
+ *
+ * @ingroup AAFIface
+ * @addtogroup AAFIface
+ * @{
+ */
+
+#include <libaaf/AAFIface.h>
+
+
+
+#define AAFI_LOUDNESS_MAX_CHANNELS 32
+
+typedef struct aafiLoudness {
+
+	double    integrated;      // LUFS, gated at -70 LUFS and -10 LU
+	double    shortTermMax;    // LUFS, highest 3 s loudness
+	double    momentaryMax;    // LUFS, highest 400 ms loudness
+	double    truePeak;        // dBTP
+	double    samplePeak;      // dBFS
+
+	uint32_t  channels;
+	double    rms[AAFI_LOUDNESS_MAX_CHANNELS];   // dBFS, of the first channels
+
+} aafiLoudness;
+
+
+
+/**
+ * Reads an essence once and measures it. Measures are kept in
+ * aafiAudioEssenceFile.loudness until essences are released.
+ *
+ * @param  aafi             Pointer to the current AAF_Iface struct.
+ * @param  audioEssenceFile Essence to measure. If NULL, every essence not measured
+ *                          yet is measured, each one on one of up to the number
+ *                          of threads set by the "threads" option when libAAF is
+ *                          built with LIBAAF_THREADS.
+ * @return                  0 on success\n
+ *                         -1 on error, or if any essence could not be measured
+ */
+int aafi_analyzeLoudness( AAF_Iface *aafi, aafiAudioEssenceFile *audioEssenceFile );
+
+/**
+ * Gets measures of a sample range of an essence, measuring the essence first if
+ * it was not yet.
+ *
+ * @param  aafi             Pointer to the current AAF_Iface struct.
+ * @param  audioEssenceFile Measured essence.
+ * @param  start            First sample of the range.
+ * @param  frameCount       Number of samples per channel of the range. If 0, range
+ *                          goes up to the essence end.
+ * @param  loudness         Receives measures of all essence channels.
+ * @return                  0 on success\n
+ *                         -1 on error, or if range is empty
+ */
+int aafi_getEssenceLoudness( AAF_Iface *aafi, aafiAudioEssenceFile *audioEssenceFile, uint64_t start, uint64_t frameCount, aafiLoudness *loudness );
+
+/**
+ * Gets measures of a clip, with clip gain, automation and fades applied. Track
+ * volume and clip mute are not. Clip channels come in essence pointer order.
+ *
+ * A clip with none of gain, automation or fades is measured from the essence
+ * range it plays, measuring its essences first if they were not yet. Any other
+ * clip is rendered with aafi_renderClip(), at aafi->Audio->samplerate.
+ *
+ * @param  aafi      Pointer to the current AAF_Iface struct.
+ * @param  audioClip Measured clip.
+ * @param  loudness  Receives measures of all clip channels.
+ * @return           0 on success\n
+ *                  -1 on error
+ */
+int aafi_getClipLoudness( AAF_Iface *aafi, aafiAudioClip *audioClip, aafiLoudness *loudness );
+
+void aafi_freeLoudness( aafiAudioEssenceFile *audioEssenceFile );
+
+/**
+ * @}
+ */
+#endif // !__AAFILoudness_h__
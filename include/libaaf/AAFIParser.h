@@ -92,6 +92,13 @@ typedef struct trace_dump {
 
 int aafi_retrieveData( AAF_Iface *aafi );
 
+/**
+ * Sets AAF_Iface composition name and length out of the top level CompositionMob,
+ * after AAF_Data was set by aaf_probe().
+ */
+
+int aafi_retrieveProbeData( AAF_Iface *aafi );
+
 
 
 /*
@@ -0,0 +1,135 @@
+/*
+ * Copyright (C) 2017-2024 Adrien Gesta-Fline
+ *
+ * This file is part of libAAF.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __AAFIPeaks_h__
+#define __AAFIPeaks_h__
+
+/**
+ * @file LibAAF/AAFIface/AAFIPeaks.h
+ * @brief Multi-resolution waveform peaks of audio essences
+ *
+ * Peaks of an essence are the lowest and highest sample values of every bin of
+ * samplesPerBin samples, for every channel, at AAFI_PEAK_LEVELS resolutions.
+ * Values are signed 16 bits, full scale being 32767. Lowest values are rounded
+ * down and highest values are rounded up, so peaks always enclose the waveform.
+ *
+ * Peaks of all essences of a file can be saved to a sidecar file, where they are
+ * keyed by SourceMob MobID and slot ID. Loading the sidecar maps it in memory,
+ * and peaks are read from the mapping without any copy.
+ *
+ * Sidecar file layout, all values little endian :
+ *  - header (32 bytes) : "LAAFPEAK", version, entry count, level count and
+ *    samples per bin of every level (uint32_t each).
+ *  - entries (64 bytes each) : SourceMob MobID (32 bytes), SourceMob slot ID,
+ *    channel count (uint32_t each), sample count per channel, data offset and
+ *    data size in bytes (uint64_t each).
+ *  - data of every entry, 8 bytes aligned : every level from the finest one,
+ *    as bins * channels * (lowest, highest) int16_t values.
+ *
+ * @ingroup AAFIface
+ * @addtogroup AAFIface
+ * @{
+ */
+
+#include <libaaf/AAFIface.h>
+
+
+
+#define AAFI_PEAK_LEVELS 3
+
+/**
+ * A resolution level of aafiPeaks. Bin B of channel C is at
+ * peaks[(B * channels + C) * 2] (lowest value) and
+ * peaks[(B * channels + C) * 2 + 1] (highest value).
+ */
+typedef struct aafiPeakLevel {
+
+	uint32_t        samplesPerBin;
+	uint64_t        binCount;     // last bin may hold less than samplesPerBin samples
+	const int16_t  *peaks;
+
+} aafiPeakLevel;
+
+typedef struct aafiPeaks {
+
+	uint32_t              channels;
+	uint64_t              frameCount;   // samples per channel
+
+	/* from finest (256 samples per bin) to coarsest (65536 samples per bin) */
+	aafiPeakLevel         levels[AAFI_PEAK_LEVELS];
+
+	int16_t              *data;         // when built, NULL if peaks were loaded
+	struct aafiPeakMap   *map;          // sidecar mapping, when loaded
+
+} aafiPeaks;
+
+
+
+/**
+ * Reads an essence once, from its embedded stream or located external file, and
+ * computes peaks at every level. Peaks are kept in aafiAudioEssenceFile.peaks,
+ * replacing any previous ones, until essences are released.
+ *
+ * @param  aafi             Pointer to the current AAF_Iface struct.
+ * @param  audioEssenceFile Essence to compute peaks of. If NULL, peaks are computed
+ *                          for every essence that has none yet.
+ * @return                  0 on success\n
+ *                         -1 on error, or if peaks of any essence could not be computed
+ */
+int aafi_buildPeaks( AAF_Iface *aafi, aafiAudioEssenceFile *audioEssenceFile );
+
+/**
+ * Writes peaks of every essence that has some to a sidecar file.
+ *
+ * @param  aafi     Pointer to the current AAF_Iface struct.
+ * @param  filepath Sidecar file path, overwritten if it exists.
+ * @return          0 on success\n
+ *                 -1 on error
+ */
+int aafi_writePeaks( AAF_Iface *aafi, const char *filepath );
+
+/**
+ * Maps a sidecar file, and sets peaks of every essence found in it by SourceMob
+ * MobID and slot ID, replacing any previous ones. Essence data is not accessed.
+ * The mapping is released once no essence uses it anymore.
+ *
+ * @param  aafi     Pointer to the current AAF_Iface struct.
+ * @param  filepath Sidecar file path.
+ * @return          Number of essences that got peaks from the sidecar,\n
+ *                 -1 if file could not be mapped or is not a valid sidecar
+ */
+int aafi_loadPeaks( AAF_Iface *aafi, const char *filepath );
+
+/**
+ * Returns the coarsest level having at most samplesPerPixel samples per bin, or
+ * the finest level if there is none.
+ *
+ * @param  peaks           Essence peaks.
+ * @param  samplesPerPixel Number of samples drawn in a pixel.
+ * @return                 Pointer to the level, or NULL if peaks is NULL.
+ */
+const aafiPeakLevel * aafi_getPeakLevel( aafiPeaks *peaks, uint64_t samplesPerPixel );
+
+void aafi_freePeaks( aafiAudioEssenceFile *audioEssenceFile );
+
+/**
+ * @}
+ */
+#endif // !__AAFIPeaks_h__
@@ -0,0 +1,219 @@
+/*
+ * Copyright (C) 2017-2024 Adrien Gesta-Fline
+ *
+ * This file is part of libAAF.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __AAFIRender_h__
+#define __AAFIRender_h__
+
+/**
+ * @file LibAAF/AAFIface/AAFIRender.h
+ * @brief Offline audio rendering of tracks and mix, and real-time playback
+ *
+ * Tracks are rendered by blocks, at aafi->Audio->samplerate, to float samples.
+ * Clips are read from embedded essence streams, or from mapped external essence
+ * files once located (aafiAudioEssenceFile.usable_file_path). Essences of another
+ * sample rate are resampled on the fly (see laafResampler). Clip gain, clip
+ * automation, fades and cross-fades are applied to every clip, then track volume.
+ * Memory use only depends on block size and channel counts, not on duration.
+ *
+ * @ingroup AAFIface
+ * @addtogroup AAFIface
+ * @{
+ */
+
+#include <libaaf/AAFIface.h>
+
+
+
+/**
+ * Called with every rendered block, in timeline order.
+ *
+ * @param  samples    Interleaved float samples, frameCount * channels values.
+ * @param  frameCount Number of samples per channel.
+ * @param  channels   Channel count.
+ * @param  user       User pointer given to the render function.
+ * @return            0 to continue rendering, any other value to stop.
+ */
+typedef int (*aafiRenderCallback)( const float *samples, uint64_t frameCount, unsigned int channels, void *user );
+
+/**
+ * Real-time playback of a set of tracks. A background thread renders tracks
+ * ahead of the playhead into one ring buffer per track, that the audio callback
+ * drains with aafi_readPlayback().
+ */
+typedef struct aafiPlayback aafiPlayback;
+
+/**
+ * Playback ring buffer of a single track.
+ */
+typedef struct aafiPlaybackTrack aafiPlaybackTrack;
+
+
+
+/**
+ * Renders a single track, with clip gain, automation, fades and track volume.
+ * Track mute, solo and pan are ignored.
+ *
+ * Output has as many channels as the track format, or as its widest clip if
+ * format is not set. Clip channel N goes to track channel N.
+ *
+ * @param  aafi       Pointer to the current AAF_Iface struct.
+ * @param  audioTrack Track to render.
+ * @param  start      Timeline position of the first rendered sample.
+ * @param  length     Rendered duration. If 0, renders up to the track end.
+ * @param  editRate   Edit rate of start and length. If NULL, start and length are
+ *                    in samples.
+ * @param  callback   Receives every rendered block.
+ * @param  user       User pointer passed to callback.
+ * @return            0 on success\n
+ *                   -1 on error, or if callback stopped rendering
+ */
+int aafi_renderTrack( AAF_Iface *aafi, aafiAudioTrack *audioTrack, aafPosition_t start, aafPosition_t length, aafRational_t *editRate, aafiRenderCallback callback, void *user );
+
+/**
+ * Renders a single clip from its start to its end, with clip gain, automation
+ * and fades, as aafi_renderTrack() renders it. Track volume is not applied, and
+ * clip mute is ignored.
+ *
+ * Output has as many channels as the clip, in essence pointer order.
+ *
+ * @param  aafi       Pointer to the current AAF_Iface struct.
+ * @param  audioClip  Clip to render.
+ * @param  callback   Receives every rendered block.
+ * @param  user       User pointer passed to callback.
+ * @return            0 on success\n
+ *                   -1 on error, or if callback stopped rendering
+ */
+int aafi_renderClip( AAF_Iface *aafi, aafiAudioClip *audioClip, aafiRenderCallback callback, void *user );
+
+/**
+ * Renders all audio tracks summed to a bus. Muted tracks are skipped, and when
+ * any track is soloed, only soloed tracks are rendered. Tracks are rendered on
+ * up to the number of threads set by the "threads" option when libAAF is built
+ * with LIBAAF_THREADS.
+ *
+ * A mono track is panned between the two first bus channels with an equal power
+ * law, from its pan (centered if not set). Other tracks go channel to channel,
+ * extra track channels being dropped. On a mono bus, track channels are averaged.
+ *
+ * @param  aafi       Pointer to the current AAF_Iface struct.
+ * @param  channels   Bus channel count.
+ * @param  start      Timeline position of the first rendered sample.
+ * @param  length     Rendered duration. If 0, renders up to the longest track end.
+ * @param  editRate   Edit rate of start and length. If NULL, start and length are
+ *                    in samples.
+ * @param  callback   Receives every rendered block.
+ * @param  user       User pointer passed to callback.
+ * @return            0 on success\n
+ *                   -1 on error, or if callback stopped rendering
+ */
+int aafi_renderMix( AAF_Iface *aafi, unsigned int channels, aafPosition_t start, aafPosition_t length, aafRational_t *editRate, aafiRenderCallback callback, void *user );
+
+
+
+/**
+ * Allocates a playback. Tracks are then added with aafi_addPlaybackTrack(), and
+ * read-ahead begins with aafi_startPlayback(). Playback is only available when
+ * libAAF is built with LIBAAF_THREADS.
+ *
+ * @param  aafi        Pointer to the current AAF_Iface struct.
+ * @param  ringFrames  Size of every track ring buffer, in samples per channel.
+ *                     Rounded up to a power of two, of at least twice the render
+ *                     block size (4096 samples).
+ * @return             Pointer to the new playback, or NULL on error.
+ */
+aafiPlayback * aafi_newPlayback( AAF_Iface *aafi, uint64_t ringFrames );
+
+/**
+ * Adds a track to a playback that was not started yet. Track is played the same
+ * way as aafi_renderTrack() renders it.
+ *
+ * @param  playback    Playback.
+ * @param  audioTrack  Track to play.
+ * @param  channels    If not NULL, receives the track channel count.
+ * @return             Pointer to the track ring buffer, or NULL on error. It is
+ *                     released with the playback.
+ */
+aafiPlaybackTrack * aafi_addPlaybackTrack( aafiPlayback *playback, aafiAudioTrack *audioTrack, unsigned int *channels );
+
+/**
+ * Starts the read-ahead thread, rendering all tracks from position.
+ *
+ * @param  playback    Playback.
+ * @param  position    Timeline position of the first played sample.
+ * @param  editRate    Edit rate of position. If NULL, position is in samples.
+ * @return             0 on success\n
+ *                    -1 on error
+ */
+int aafi_startPlayback( aafiPlayback *playback, aafPosition_t position, aafRational_t *editRate );
+
+/**
+ * Moves the playhead of every track. On a started playback, returns once the
+ * read-ahead thread dropped samples rendered before the seek : from then on,
+ * aafi_readPlayback() gets silence until samples from the new position are
+ * ready. A track is rendered from the new position once it was read after the
+ * seek. Must not be called from the audio callback.
+ *
+ * @param  playback    Playback.
+ * @param  position    New timeline position of the playhead.
+ * @param  editRate    Edit rate of position. If NULL, position is in samples.
+ * @return             0 on success\n
+ *                    -1 on error
+ */
+int aafi_seekPlayback( aafiPlayback *playback, aafPosition_t position, aafRational_t *editRate );
+
+/**
+ * Reads interleaved samples of a track. This is meant to be called from the
+ * audio callback : it does not lock, allocate nor wait. Samples not rendered yet
+ * are filled with silence, and the read is counted as an underrun.
+ *
+ * A track must be read by a single thread at a time.
+ *
+ * @param  track       Track ring buffer.
+ * @param  samples     Receives frameCount * channels samples.
+ * @param  frameCount  Number of samples per channel to read.
+ * @return             Number of samples per channel read from the ring buffer.
+ */
+uint64_t aafi_readPlayback( aafiPlaybackTrack *track, float *samples, uint64_t frameCount );
+
+/**
+ * @param  track       Track ring buffer.
+ * @return             Number of samples per channel ready to be read.
+ */
+uint64_t aafi_getPlaybackBuffered( aafiPlaybackTrack *track );
+
+/**
+ * @param  track       Track ring buffer.
+ * @return             Number of aafi_readPlayback() calls that were not fully
+ *                     served since playback was started, apart from the ones
+ *                     waiting for samples after a seek.
+ */
+uint64_t aafi_getPlaybackUnderruns( aafiPlaybackTrack *track );
+
+/**
+ * Stops the read-ahead thread and releases the playback with all its tracks.
+ *
+ * @param  playback    Pointer to the playback pointer, set to NULL.
+ */
+void aafi_releasePlayback( aafiPlayback **playback );
+
+/**
+ * @}
+ */
+#endif // !__AAFIRender_h__
@@ -52,7 +52,21 @@ enum aafiEssenceType {
 enum aafiExtractFormat {
 	AAFI_EXTRACT_DEFAULT = 0,
 	AAFI_EXTRACT_WAV,
-	AAFI_EXTRACT_BWAV
+	AAFI_EXTRACT_BWAV,
+	AAFI_EXTRACT_RF64 /* Broadcast RF64, also used by default above 4 GB */
+};
+
+
+/**
+ * Sample format of extracted audio files, set with the "extract_sample_format"
+ * option. Samples are converted while being extracted.
+ */
+enum aafiSampleFormat {
+	AAFI_SAMPLE_FORMAT_DEFAULT = 0, /* samples are extracted as they are stored */
+	AAFI_SAMPLE_FORMAT_S16,
+	AAFI_SAMPLE_FORMAT_S24,
+	AAFI_SAMPLE_FORMAT_S32,
+	AAFI_SAMPLE_FORMAT_F32
 };
 
 
@@ -283,6 +297,14 @@ typedef struct aafiAudioGain
 
 	aafRational_t  *value;
 
+
+	/**
+	 * Points and segment coefficients converted for evaluation, set on first
+	 * aafi_evalEnvelope() call.
+	 */
+
+	struct aafiEnvelope *envelope;
+
 } aafiAudioGain;
 
 
@@ -381,6 +403,7 @@ typedef struct aafiAudioEssenceFile
 	uint32_t       samplerate;
 	aafRational_t *samplerateRational; // eg. { 48000, 1 }
 	uint16_t       samplesize;
+	uint16_t       formatTag; // WAVE format tag, 0x0001 for integer PCM, 0x0003 for IEEE float (AIFC 'fl32'), 0 if compressed or unknown
 
 	/**
 	 * Audio essence file channel count. Might be different of #aafiAudioClip.channels
@@ -403,6 +426,22 @@ typedef struct aafiAudioEssenceFile
 	 */
 	aafiMetaData  *metadata;
 
+	/**
+	 * Audio data location and stream extent index, set on first
+	 * aafi_readAudioSamples() call.
+	 */
+	struct aafiSampleReader *sampleReader;
+
+	/**
+	 * Waveform peaks, set by aafi_buildPeaks() or aafi_loadPeaks().
+	 */
+	struct aafiPeaks *peaks;
+
+	/**
+	 * Loudness and level measures, set by aafi_analyzeLoudness().
+	 */
+	struct aafiLoudnessData *loudness;
+
 	void          *user;
 
 
@@ -412,6 +451,12 @@ typedef struct aafiAudioEssenceFile
 
 	struct aafiAudioEssenceFile *next;
 
+	/**
+	 * Pointer to the next essence sharing the same #aafiAudio.essenceIndex bucket
+	 */
+
+	struct aafiAudioEssenceFile *indexNext;
+
 } aafiAudioEssenceFile;
 
 
@@ -430,6 +475,12 @@ typedef struct aafiAudioEssencePointer
 	struct aafiAudioEssencePointer *next; // audioClip->essenceGroup
 	struct aafiAudioEssencePointer *aafiNext; // aafi->Audio->essenceGroup
 
+	/*
+	 * Set on the first pointer of a list interned in #aafiAudio.essencePointerIndex
+	 */
+	struct aafiAudioEssencePointer *indexNext;
+	uint32_t                        indexHash;
+
 	struct AAF_Iface               *aafi;
 
 } aafiAudioEssencePointer;
@@ -471,6 +522,12 @@ typedef struct aafiVideoEssence
 	// TODO peakEnveloppe
 	struct aafiVideoEssence *next;
 
+	/**
+	 * Pointer to the next essence sharing the same #aafiVideo.essenceIndex bucket
+	 */
+
+	struct aafiVideoEssence *indexNext;
+
 } aafiVideoEssence;
 
 
@@ -608,6 +665,18 @@ typedef struct aafiTimelineItem
 	 */
 	void                    *data;
 
+	/**
+	 * Track holding the item : aafiAudioTrack for AAFI_AUDIO_CLIP and AAFI_TRANS
+	 * items, aafiVideoTrack for AAFI_VIDEO_CLIP items. NULL if item is not on a track.
+	 */
+	void                    *track;
+
+	/**
+	 * Count of clip items on the track, from the first item up to this one
+	 * included. For a clip item, it is the clip index returned by aafi_get_clipIndex().
+	 */
+	int                      clipIndex;
+
 	struct aafiTimelineItem *next;
 	struct aafiTimelineItem *prev;
 
@@ -670,6 +739,52 @@ typedef enum aafiTrackFormat_e
 
 
 
+/**
+ * aafiRangeEntry is an item of an aafiRangeIndex, covering [start, end).
+ */
+typedef struct aafiRangeEntry
+{
+	aafPosition_t  start;
+	aafPosition_t  end;
+
+	/**
+	 * Greatest end of the entries below this one in the index implicit tree.
+	 */
+	aafPosition_t  maxEnd;
+
+	/**
+	 * aafiTimelineItem for track indexes, aafiMarker for markers index.
+	 */
+	void          *item;
+
+} aafiRangeEntry;
+
+
+
+/**
+ * aafiRangeIndex answers time-range queries on a track or on markers with
+ * aafi_queryRange(). Entries are sorted on start and form an implicit binary
+ * tree, where each entry is the root of the entries between its neighbours
+ * of upper level.
+ *
+ * Indexes are built by aafi_retrieveData(), and must be rebuilt with
+ * aafi_buildRangeIndexes() once tracks or markers have been modified.
+ */
+typedef struct aafiRangeIndex
+{
+	/**
+	 * Edit rate of entries positions. Points to track edit rate, or to the
+	 * first marker edit rate.
+	 */
+	aafRational_t  *editRate;
+
+	aafiRangeEntry *entries;
+	uint32_t        count;
+
+} aafiRangeIndex;
+
+
+
 /* forward declaration */
 struct aafiAudio;
 struct aafiVideo;
@@ -711,8 +826,15 @@ typedef struct aafiAudioTrack
 	 */
 
 	struct aafiTimelineItem *timelineItems;
+	struct aafiTimelineItem *lastTimelineItem;
 	int                      clipCount;
 
+	/**
+	 * Time-range index of timelineItems. See aafi_queryRange().
+	 */
+
+	aafiRangeIndex           rangeIndex;
+
 
 	/**
 	 * The edit rate of all the contained Clips, Transitions, also lengths and track->current_pos;
@@ -765,6 +887,13 @@ typedef struct aafiVideoTrack
 	 */
 
 	struct aafiTimelineItem *timelineItems;
+	struct aafiTimelineItem *lastTimelineItem;
+
+	/**
+	 * Time-range index of timelineItems. See aafi_queryRange().
+	 */
+
+	aafiRangeIndex           rangeIndex;
 
 
 	/**
@@ -816,6 +945,22 @@ typedef struct aafiAudio
 	aafiAudioEssenceFile    *essenceFiles;
 	aafiAudioEssencePointer *essencePointerList;
 
+	/**
+	 * Hash index of #aafiAudio.essenceFiles, keyed on (sourceMobID, sourceMobSlotID).
+	 */
+
+	aafiAudioEssenceFile   **essenceIndex;
+	uint32_t                 essenceIndexSize;
+
+	/**
+	 * Hash index of distinct essence pointer lists, keyed on their
+	 * (essenceFile, essenceChannel) sequence. See aafi_internAudioEssencePointer().
+	 */
+
+	aafiAudioEssencePointer **essencePointerIndex;
+	uint32_t                  essencePointerIndexSize;
+	uint32_t                  essencePointerIndexCount;
+
 	/**
 	 * Holds the Track list.
 	 */
@@ -840,7 +985,15 @@ typedef struct aafiVideo
 	 * Holds the Essence list.
 	 */
 
-	aafiVideoEssence *essenceFiles;
+	int                essenceCount;
+	aafiVideoEssence  *essenceFiles;
+
+	/**
+	 * Hash index of #aafiVideo.essenceFiles, keyed on (sourceMobID, sourceMobSlotID).
+	 */
+
+	aafiVideoEssence **essenceIndex;
+	uint32_t           essenceIndexSize;
 
 	/**
 	 * Holds the Track list.
@@ -873,6 +1026,35 @@ typedef struct aafiMarker {
 
 
 
+struct AAF_Iface;
+
+/**
+ * A top-level CompositionMob. See AAF_Iface.Compositions.
+ */
+
+typedef struct aafiComposition {
+
+	/**
+	 * The top-level CompositionMob.
+	 */
+
+	aafObject        *Mob;
+
+	/**
+	 * Holds the composition tracks, markers, timecode, name, length and metadata.
+	 * This is the main AAF_Iface for the first composition. Other compositions get
+	 * their own AAF_Iface, which shares the essences of the main one (see
+	 * AAF_Iface.parent).
+	 */
+
+	struct AAF_Iface *aafi;
+
+	struct aafiComposition *next;
+
+} aafiComposition;
+
+
+
 typedef struct aafiContext
 {
 	/* Clip */
@@ -924,6 +1106,11 @@ typedef struct aafiContext
 		char            *dump_class_raw_properties;
 		char            *media_location;
 		int              mobid_essence_filename;
+		int              threads;
+		int              extract_sample_format; // enum aafiSampleFormat
+		int              extract_dither;        // TPDF dither when converting to a lower resolution
+		int              extract_split_channels; // one mono file per channel of multichannel essences
+		int              extract_samplerate;    // resample extracted PCM to this rate, -1 for composition rate, 0 to keep essence rate
 
 		/* vendor specific */
 		int              protools;
@@ -954,6 +1141,11 @@ typedef struct AAF_Iface
 
 	aafiMarker       *Markers;
 
+	/**
+	 * Time-range index of Markers. See aafi_queryRange().
+	 */
+	aafiRangeIndex    markersRangeIndex;
+
 
 	char             *compositionName;
 
@@ -970,6 +1162,21 @@ typedef struct AAF_Iface
 	aafiMetaData     *metadata;
 
 
+	/**
+	 * Every top-level CompositionMob in file, in file order. The first one is the
+	 * main composition, retrieved into this AAF_Iface.
+	 */
+	aafiComposition  *Compositions;
+
+	int               compositionCount;
+
+	/**
+	 * Only set on the AAF_Iface of a composition other than the main one. Points
+	 * to the main AAF_Iface, which owns aafd, log and essences.
+	 */
+	struct AAF_Iface *parent;
+
+
 	struct aafLog       *log;
 
 } AAF_Iface;
@@ -1081,6 +1288,18 @@ typedef struct AAF_Iface
 	      marker = marker->next )            \
 
 
+/**
+ * Loops through each top-level composition in AAF file.
+ *
+ * @param aafi         Pointer to the current AAF_Iface struct.
+ * @param composition  NULL pointer to an aafiComposition struct.
+ */
+#define AAFI_foreachComposition( aafi, composition ) \
+	for ( composition = aafi->Compositions;            \
+	      composition != NULL;                         \
+	      composition = composition->next )            \
+
+
 #define AAFI_foreachMetadata( metadataList, metadata ) \
 	for ( metadata = metadataList;                       \
 	      metadata != NULL;                              \
@@ -1101,6 +1320,19 @@ int aafi_set_option_str( AAF_Iface *aafi, const char *optname, const char *val )
 
 int aafi_load_file( AAF_Iface *aafi, const char *file );
 
+/**
+ * Fast alternative to aafi_load_file(), which only retrieves the AAF Header and
+ * Identification, and the top level CompositionMob name and length (compositionName,
+ * compositionLength and compositionLength_editRate). No essence, track, clip or
+ * timecode is retrieved. See aaf_probe().
+ *
+ * compositionLength is read from the MobSlot Segments rather than summed from
+ * the clips, but is the same as the one set by aafi_load_file(), which is
+ * checked against the test/aaf corpus.
+ */
+
+int aafi_probe( AAF_Iface *aafi, const char *file );
+
 void aafi_release( AAF_Iface **aafi );
 
 
@@ -1124,6 +1356,16 @@ aafPosition_t aafi_getClipLength( AAF_Iface *aafi, aafiAudioClip *audioClip, aaf
 
 int aafi_removeTimelineItem( AAF_Iface *aafi, aafiTimelineItem *timelineItem );
 
+void aafi_unlinkTimelineItem( aafiTimelineItem *timelineItem );
+
+void aafi_updateTimelineItemIndexes( aafiTimelineItem *timelineItem );
+
+int aafi_buildRangeIndexes( AAF_Iface *aafi );
+
+int aafi_queryRange( aafiRangeIndex *rangeIndex, aafPosition_t start, aafPosition_t end, aafRational_t *editRate, int (*callback)(void *item, void *user), void *user );
+
+void aafi_freeRangeIndex( aafiRangeIndex *rangeIndex );
+
 int aafi_getAudioEssencePointerChannelCount( aafiAudioEssencePointer *essencePointerList );
 
 int aafi_applyGainOffset( AAF_Iface *aafi, aafiAudioGain **gain, aafiAudioGain *offset );
@@ -1148,11 +1390,22 @@ aafiMarker * aafi_newMarker( AAF_Iface *aafi, aafRational_t *editRate, aafPositi
 aafiMetaData * aafi_newMetadata( AAF_Iface *aafi, aafiMetaData **CommentList );
 
 
+aafiComposition * aafi_newComposition( AAF_Iface *aafi, aafObject *CompositionMob );
+
+int aafi_mergeCompositionEssences( AAF_Iface *aafi, AAF_Iface *compositionAafi );
+
+
 aafiAudioEssencePointer * aafi_newAudioEssencePointer( AAF_Iface *aafi, aafiAudioEssencePointer **list, aafiAudioEssenceFile *audioEssenceFile, uint32_t *essenceChannelNum );
 
-aafiAudioEssenceFile * aafi_newAudioEssence( AAF_Iface *aafi );
+aafiAudioEssencePointer * aafi_internAudioEssencePointer( AAF_Iface *aafi, aafiAudioEssencePointer *essencePointerList );
 
-aafiVideoEssence * aafi_newVideoEssence( AAF_Iface *aafi );
+aafiAudioEssenceFile * aafi_newAudioEssence( AAF_Iface *aafi, aafMobID_t *sourceMobID, uint32_t sourceMobSlotID );
+
+aafiVideoEssence * aafi_newVideoEssence( AAF_Iface *aafi, aafMobID_t *sourceMobID, uint32_t sourceMobSlotID );
+
+aafiAudioEssenceFile * aafi_getAudioEssence( AAF_Iface *aafi, aafMobID_t *sourceMobID, uint32_t sourceMobSlotID );
+
+aafiVideoEssence * aafi_getVideoEssence( AAF_Iface *aafi, aafMobID_t *sourceMobID, uint32_t sourceMobSlotID );
 
 
 aafiAudioGain * aafi_newAudioGain( AAF_Iface *aafi, enum aafiAudioGain_e type, enum aafiInterpolation_e interpol, aafRational_t *singleValue );
@@ -1176,6 +1429,8 @@ void aafi_freeTransition( aafiTransition *trans );
 
 void aafi_freeMarkers( aafiMarker **aafi );
 
+void aafi_freeCompositions( AAF_Iface *aafi );
+
 void aafi_freeMetadata( aafiMetaData **CommentList );
 
 
@@ -27,17 +27,17 @@
 
 
 
-#define AUIDToText( auid ) \
-	cfb_CLSIDToText( (const cfbCLSID_t*)auid )
+#define AUIDToText( aafd, auid ) \
+	cfb_CLSIDToText( (const cfbCLSID_t*)auid, (aafd)->text.AUID, sizeof((aafd)->text.AUID) )
 
 
-const char * aaft_MobIDToText( aafMobID_t *mobid );
+const char * aaft_MobIDToText( AAF_Data *aafd, aafMobID_t *mobid );
 
-const char * aaft_TimestampToText( aafTimeStamp_t *ts );
+const char * aaft_TimestampToText( AAF_Data *aafd, aafTimeStamp_t *ts );
 
-const char * aaft_VersionToText( aafVersionType_t *vers );
+const char * aaft_VersionToText( AAF_Data *aafd, aafVersionType_t *vers );
 
-const char * aaft_ProductVersionToText( aafProductVersion_t *vers );
+const char * aaft_ProductVersionToText( AAF_Data *aafd, aafProductVersion_t *vers );
 
 const char * aaft_FileKindToText( const aafUID_t *auid );
 
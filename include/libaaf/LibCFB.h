@@ -312,6 +312,14 @@ typedef enum cfbByteOrder_e {
 #define CFB_PATH_NAME_SZ	CFB_NODE_NAME_SZ * 64
 
 
+/**
+ * The length of a char array able to hold a CLSID printed by cfb_CLSIDToText(),
+ * including the NULL terminating char.
+ */
+
+#define CFB_CLSID_TEXT_SZ	96
+
+
 
 /**
  * This is the header of the Compound File. It corresponds to the first 512 bytes of the
@@ -726,6 +734,87 @@ typedef struct CFB_Data
 
 
 
+/**
+ * Run of (mini-)sectors stored one after the other, holding a part of a stream.
+ */
+
+typedef struct cfbStreamExtent
+{
+	/**
+	 * Stream offset of the first byte of the extent.
+	 */
+
+	uint64_t       offset;
+
+	cfbSectorID_t  sectID;
+
+	uint32_t       count;
+
+} cfbStreamExtent;
+
+
+
+/**
+ * Extents of a stream, in stream order. See cfb_indexStream().
+ */
+
+typedef struct cfbStreamIndex
+{
+	cfbStreamExtent *extents;
+
+	uint32_t         count;
+
+} cfbStreamIndex;
+
+
+
+/**
+ * Reads a stream Node by chunks, without loading the whole stream in memory.
+ * See cfb_openStream().
+ */
+
+typedef struct cfbStreamReader
+{
+	CFB_Data      *cfbd;
+
+	cfbNode       *node;
+
+	/**
+	 * Stream length, in bytes.
+	 */
+
+	uint64_t       stream_len;
+
+	/**
+	 * Stream position of the next byte to be read.
+	 */
+
+	uint64_t       pos;
+
+	/**
+	 * (Mini-)sector holding the byte at pos.
+	 */
+
+	cfbSectorID_t  sectID;
+
+	/**
+	 * Set when the stream is stored in the mini-stream.
+	 */
+
+	int            isMini;
+
+	/**
+	 * Optional extent index of the stream, set by caller after cfb_openStream().
+	 * cfb_seekStream() then looks up the extent holding the offset, instead of
+	 * walking the (mini-)sector chain.
+	 */
+
+	const cfbStreamIndex *index;
+
+} cfbStreamReader;
+
+
+
 
 
 
@@ -834,7 +923,7 @@ typedef struct CFB_Data
  */
 
 
-const char * cfb_CLSIDToText( const cfbCLSID_t *clsid );
+const char * cfb_CLSIDToText( const cfbCLSID_t *clsid, char *buf, size_t bufsz );
 
 char * cfb_w16toUTF8( const uint16_t *w16buf, size_t w16blen );
 
@@ -884,6 +973,16 @@ uint64_t cfb_getStream( CFB_Data*cfbd, cfbNode*node, unsigned char **stream, uin
 
 int cfb__foreachSectorInStream( CFB_Data *cfbd, cfbNode *node, unsigned char **buf, size_t *bytesRead, cfbSectorID_t *sectID );
 
+int cfb_openStream( CFB_Data *cfbd, cfbNode *node, cfbStreamReader *reader );
+
+int cfb_seekStream( cfbStreamReader *reader, uint64_t offset );
+
+uint64_t cfb_readStream( cfbStreamReader *reader, unsigned char *buf, uint64_t len );
+
+cfbStreamIndex * cfb_indexStream( CFB_Data *cfbd, cfbNode *node );
+
+void cfb_freeStreamIndex( cfbStreamIndex *index );
+
 #define CFB_foreachSectorInStream( cfbd, node, buf, bytesRead, sectID ) \
 	while ( cfb__foreachSectorInStream( cfbd, node, buf, bytesRead, sectID ) )
 
@@ -63,17 +63,49 @@ struct aafLog {
 	size_t            _msg_size;
 	size_t            _msg_pos;
 
-	char             *_previous_msg;
-	size_t            _previous_pos;
+	char             *_write_msg;
+	size_t            _write_msg_size;
 
 	int               _tmp_msg_pos;
 
+	void             *_lock;    // pthread_mutex_t, when built with LIBAAF_THREADS
+
 	void             *user;
 };
 
 
+/*
+ * Least severe message type compiled into the library. Calls of a lower
+ * severity are stripped at compile time, along with their arguments. For
+ * instance, -DLIBAAF_MIN_LOG_LEVEL=VERB_WARNING removes every debug() call.
+ * VERB_SUCCESS messages are always kept.
+ */
+#ifndef LIBAAF_MIN_LOG_LEVEL
+	#define LIBAAF_MIN_LOG_LEVEL VERB_DEBUG
+#endif
+
+
+#define AAF_LOG_ENABLED( log, type ) \
+	( ( (type) == VERB_SUCCESS || (type) <= LIBAAF_MIN_LOG_LEVEL ) && \
+	  (log) && (log)->log_callback && \
+	  ( (type) == VERB_SUCCESS || ( (log)->verb != VERB_QUIET && (type) <= (log)->verb ) ) )
+
+
+/*
+ * Verbosity is checked before laaf_write_log() is called, so that message
+ * arguments (aaft_*ToText(), aaf_get_ObjectPath()...) are only evaluated
+ * when the message is to be logged. The lock of the log is held while
+ * arguments are evaluated, since they can be built into text buffers shared by
+ * the threads writing to that log.
+ */
 #define AAF_LOG( log, ctxdata, lib, type, ... ) \
-	laaf_write_log( log, ctxdata, lib, type, __FILENAME__, __func__, __LINE__, __VA_ARGS__ )
+	do { \
+		if ( AAF_LOG_ENABLED( log, type ) ) { \
+			laaf_lock_log( log ); \
+			laaf_write_log( log, ctxdata, lib, type, __FILENAME__, __func__, __LINE__, __VA_ARGS__ ); \
+			laaf_unlock_log( log ); \
+		} \
+	} while ( 0 )
 
 
 #define LOG_BUFFER_WRITE( log, ... )\
@@ -90,9 +122,20 @@ struct aafLog * laaf_new_log( void );
 
 void laaf_free_log( struct aafLog *log );
 
+/*
+ * Lock serializing writes to a log when libAAF is built with LIBAAF_THREADS.
+ * Each log has its own lock, so threads writing to different logs do not wait
+ * for each other. Recursive, no-op otherwise.
+ */
+void laaf_lock_log( struct aafLog *log );
+
+void laaf_unlock_log( struct aafLog *log );
+
 void laaf_log_callback( struct aafLog *log, void *ctxdata, int lib, int type, const char *srcfile, const char *srcfunc, int lineno, const char *msg, void *user );
 
 void laaf_write_log( struct aafLog *log, void *ctxdata, enum log_source_id lib, enum verbosityLevel_e type, const char *srcfile, const char *srcfunc, int srcline, const char *format, ... );
 
+void laaf_vwrite_log( struct aafLog *log, void *ctxdata, enum log_source_id lib, enum verbosityLevel_e type, const char *srcfile, const char *srcfunc, int srcline, const char *format, va_list args );
+
 
 #endif // !laaf_log_h__
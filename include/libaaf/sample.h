@@ -0,0 +1,217 @@
+/*
+ * Copyright (C) 2017-2024 Adrien Gesta-Fline
+ *
+ * This file is part of libAAF.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __sample_h__
+#define __sample_h__
+
+/**
+ * @file LibAAF/common/sample.h
+ * @brief Audio sample buffer processing
+ *
+ * Block based helpers working on whole PCM buffers. When libAAF is compiled
+ * for a target providing SSE2, SSSE3, AVX2 or NEON (ie. -march=native), the
+ * matching vector path is built. A portable scalar path is always available.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+
+/**
+ * Reverses the byte order of every sample of buf, in place. Used to convert
+ * big endian AIFC samples to little endian WAVE samples, and back.
+ *
+ * @param buf        Interleaved PCM samples.
+ * @param len        Size of buf in bytes. A trailing partial sample is left
+ *                   untouched.
+ * @param samplesize Sample size in bytes. Only 2, 3 and 4 are swapped, any
+ *                   other size leaves buf untouched.
+ */
+void laaf_sample_swap_bytes( unsigned char *buf, size_t len, unsigned int samplesize );
+
+/**
+ * Same as laaf_sample_swap_bytes(), always using the portable scalar path.
+ */
+void laaf_sample_swap_bytes_scalar( unsigned char *buf, size_t len, unsigned int samplesize );
+
+
+
+/**
+ * Sample formats handled by laaf_sample_convert(). Integer samples are signed
+ * little endian, float samples are IEEE float32 in the [-1.0, 1.0] range.
+ */
+enum laafSampleFormat {
+	LAAF_SAMPLE_S16 = 0,
+	LAAF_SAMPLE_S24,
+	LAAF_SAMPLE_S32,
+	LAAF_SAMPLE_F32
+};
+
+/**
+ * TPDF dither generator. Holds one xorshift32 generator per vector lane, so
+ * the vector and scalar paths produce the exact same samples.
+ */
+struct laafSampleDither {
+	uint32_t state[4];
+};
+
+/**
+ * Returns the size in bytes of a single sample of the given format.
+ */
+unsigned int laaf_sample_format_size( enum laafSampleFormat format );
+
+/**
+ * Seeds a dither generator. The same seed always gives the same noise.
+ */
+void laaf_sample_dither_init( struct laafSampleDither *dither, uint32_t seed );
+
+/**
+ * Converts count samples from srcFormat to dstFormat. Float samples out of
+ * range are clipped when converted to integer.
+ *
+ * @param dst       Converted samples, count * laaf_sample_format_size(dstFormat)
+ *                  bytes. Shall not overlap src.
+ * @param dstFormat Format of dst samples.
+ * @param src       Samples to convert, count * laaf_sample_format_size(srcFormat)
+ *                  bytes.
+ * @param srcFormat Format of src samples.
+ * @param count     Number of samples, all channels included.
+ * @param dither    TPDF dither generator, or NULL. Dither is only applied when
+ *                  samples are quantized to a lower resolution : float to
+ *                  integer, or integer to a smaller integer.
+ */
+void laaf_sample_convert( unsigned char *dst, enum laafSampleFormat dstFormat, const unsigned char *src, enum laafSampleFormat srcFormat, size_t count, struct laafSampleDither *dither );
+
+/**
+ * Same as laaf_sample_convert(), always using the portable scalar path.
+ */
+void laaf_sample_convert_scalar( unsigned char *dst, enum laafSampleFormat dstFormat, const unsigned char *src, enum laafSampleFormat srcFormat, size_t count, struct laafSampleDither *dither );
+
+
+
+/**
+ * Splits interleaved samples into one buffer per channel.
+ *
+ * @param dst        Array of channels buffers, frames * samplesize bytes each.
+ *                   A NULL buffer skips its channel.
+ * @param src        Interleaved samples, frames * channels * samplesize bytes.
+ * @param frames     Number of samples per channel.
+ * @param channels   Channel count.
+ * @param samplesize Sample size in bytes, from 1 to 4.
+ */
+void laaf_sample_deinterleave( unsigned char **dst, const unsigned char *src, size_t frames, unsigned int channels, unsigned int samplesize );
+
+/**
+ * Same as laaf_sample_deinterleave(), always using the portable scalar path.
+ */
+void laaf_sample_deinterleave_scalar( unsigned char **dst, const unsigned char *src, size_t frames, unsigned int channels, unsigned int samplesize );
+
+
+
+/**
+ * Adds src float samples to dst, each one multiplied by the matching gain
+ * value : dst[i] += src[i] * gain[i]. Used to sum gain enveloped channels.
+ */
+void laaf_sample_mix( float *dst, const float *src, const float *gain, size_t count );
+
+/**
+ * Same as laaf_sample_mix(), with a constant gain : dst[i] += src[i] * gain.
+ */
+void laaf_sample_mix_gain( float *dst, const float *src, float gain, size_t count );
+
+
+/**
+ * Finds the lowest and highest values of count float samples. Both are set to
+ * 0 if count is 0.
+ */
+void laaf_sample_minmax( const float *src, size_t count, float *min, float *max );
+
+
+
+/**
+ * Polyphase windowed sinc resampler, converting float samples between two
+ * sample rates of rational ratio upsample / downsample. It holds no stream
+ * state : output samples are addressed by position, so any range of them is
+ * computed from the input samples around it, and consecutive ranges join
+ * seamlessly.
+ *
+ * Positions count 1/upsample of input sample. Output sample n of a stream is
+ * at position n * downsample, that is at input sample n * downsample / upsample.
+ * When upsample is too large, positions are rounded to the nearest of phases
+ * computed fractions of input sample.
+ */
+struct laafResampler {
+	uint64_t  upsample;
+	uint64_t  downsample;
+	uint32_t  phases;
+	uint32_t  taps;    // input samples per output sample
+	float    *coefs;   // phases * taps
+};
+
+/**
+ * Sets a resampler from srcRateNum/srcRateDen to dstRateNum/dstRateDen. All
+ * values must be positive.
+ *
+ * @return 0 on success\n
+ *        -1 if rates are invalid, their ratio can't be handled or memory could
+ *           not be allocated
+ */
+int laaf_resampler_init( struct laafResampler *rs, uint64_t srcRateNum, uint64_t srcRateDen, uint64_t dstRateNum, uint64_t dstRateDen );
+
+void laaf_resampler_free( struct laafResampler *rs );
+
+/**
+ * Gets the input samples needed to compute count output samples from position
+ * pos. Input samples before the stream start or after its end shall be zero.
+ *
+ * @param first  Receives the index of the first input sample, which may be
+ *               negative.
+ * @param frames Receives the number of input samples.
+ */
+void laaf_resampler_span( const struct laafResampler *rs, uint64_t pos, size_t count, int64_t *first, size_t *frames );
+
+/**
+ * Computes count output samples from position pos.
+ *
+ * @param dst       Output samples, every dstStride floats.
+ * @param dstStride 1 for a single channel buffer, the channel count to write
+ *                  into an interleaved buffer.
+ * @param src       Input samples of a single channel, from the first one given by
+ *                  laaf_resampler_span().
+ */
+void laaf_resampler_process( const struct laafResampler *rs, float *dst, size_t dstStride, const float *src, uint64_t pos, size_t count );
+
+/**
+ * Same as laaf_resampler_process(), always using the portable scalar path.
+ */
+void laaf_resampler_process_scalar( const struct laafResampler *rs, float *dst, size_t dstStride, const float *src, uint64_t pos, size_t count );
+
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // ! __sample_h__
@@ -93,6 +93,14 @@ int laaf_util_file_exists( const char *filepath );
 
 FILE * laaf_util_fopen_utf8( const char *filepath, const char *mode );
 
+/*
+ * Maps a whole file in memory, read only. Returns NULL on failure, size being
+ * set to file size on success. Mapping is released with laaf_util_unmap_file().
+ */
+void * laaf_util_map_file( const char *filepath, uint64_t *size );
+
+void laaf_util_unmap_file( void *data, uint64_t size );
+
 char * laaf_util_clean_filename( char *filename );
 
 int laaf_util_is_fileext( const char *filepath, const char *ext );
@@ -23,6 +23,10 @@
 #include <string.h>
 #include <errno.h>
 
+#ifdef LIBAAF_THREADS
+#include <pthread.h>
+#endif
+
 #include <libaaf/AAFTypes.h>
 #include <libaaf/AAFCore.h>
 #include <libaaf/AAFToText.h>
@@ -417,6 +421,143 @@ static aafByte_t * getStrongRefVectorList( AAF_Data *aafd, cfbNode *Node, aafObj
 
 
 
+/**
+ * Tells if a strong reference property has to be followed when AAF_Data.probe
+ * is set. Only the references leading to the Header, the Identification and
+ * the CompositionMobs' MobSlots and Segments are followed.
+ *
+ * @param  pid Property ID of the strong reference.
+ * @return     1 if the reference should be followed,\n
+ *             0 otherwise.
+ */
+
+static int probeFollowsReference( aafPID_t pid );
+
+
+
+/**
+ * Calls the AAF_Data.visitor callbacks for an Object which properties were already
+ * retrieved, then visits the Objects referenced by its strong reference properties.
+ *
+ * @param  aafd Pointer to the AAF_Data structure.
+ * @param  Obj  Pointer to the aafObject to visit.
+ *
+ * @return       0 on success\n
+ *              -1 on error, or if a callback stopped the traversal.
+ */
+
+static int visitObject( AAF_Data *aafd, aafObject *Obj );
+
+
+
+/**
+ * Retrieves the properties of an Object referenced by a strong reference, visits it
+ * with visitObject(), and frees it. This function is called by retrieveStrongReference(),
+ * retrieveStrongReferenceSet() and retrieveStrongReferenceVector() when AAF_Data.visitor
+ * is set.
+ *
+ * @param  aafd Pointer to the AAF_Data structure.
+ * @param  Obj  Pointer to the aafObject to visit, allocated by newObject().
+ *
+ * @return       0 on success\n
+ *              -1 on error, or if a callback stopped the traversal.
+ */
+
+static int visitChildObject( AAF_Data *aafd, aafObject *Obj );
+
+
+
+/**
+ * Frees an Object that was not added to the AAF_Data.Objects list, because it was
+ * allocated while AAF_Data.visitor was set.
+ *
+ * @param  Obj  Pointer to the aafObject to free.
+ */
+
+static void releaseVisitedObject( aafObject *Obj );
+
+
+
+#ifdef LIBAAF_THREADS
+
+/**
+ * A single StrongReferenceSet entry retrieved by a worker thread. The Objects
+ * allocated by the task are collected in Objects, and are merged back into the
+ * AAF_Data.Objects list once every task has completed.
+ */
+
+typedef struct aafRetrieveTask {
+
+	cfbNode                 *Node;
+	aafClass                *Class;
+	aafObject               *Parent;
+
+	aafStrongRefSetHeader_t *Header;
+	aafStrongRefSetEntry_t  *Entry;
+
+	aafObject               *Obj;
+	aafObject               *Objects;
+
+	int                      rc;
+
+} aafRetrieveTask;
+
+
+
+/**
+ * Shared state of the retrieveStrongReferenceSetParallel() workers, which pull
+ * the next task to run from the tasks array. Each worker runs its tasks against
+ * its own copy of aafd, so that AAF_Data.Objects and AAF_Data.text are never
+ * shared between threads.
+ */
+
+typedef struct aafRetrievePool {
+
+	AAF_Data        *aafd;
+
+	aafRetrieveTask *tasks;
+	uint32_t         count;
+	uint32_t         next;
+
+	pthread_mutex_t  mutex;
+
+} aafRetrievePool;
+
+
+
+/**
+ * Retrieves StrongReferenceSet Objects using AAF_Data.threads threads. This function
+ * is called by retrieveStrongReferenceSet() for the ContentStorage Mobs and EssenceData
+ * sets, which hold most of the file Objects. The resulting Prop->val and AAF_Data.Objects
+ * lists are in the same order as the ones built by retrieveStrongReferenceSet().
+ *
+ * @param aafd    Pointer to the AAF_Data structure.
+ * @param Prop    Pointer to the property holding the SF_STRONG_OBJECT_REFERENCE_SET.
+ * @param Parent  Pointer to the parent Object which holds the Prop property.
+ * @param Header  Pointer to the StrongReferenceSet's aafStrongRefSetHeader_t stream.
+ * @param refName Pointer to a null terminated string holding the reference name.
+ *
+ * @return         0 on success\n
+ *                -1 on error
+ */
+
+static int retrieveStrongReferenceSetParallel( AAF_Data *aafd, aafProperty *Prop, aafObject *Parent, aafStrongRefSetHeader_t *Header, const char *refName );
+
+
+
+/**
+ * Thread function running the aafRetrievePool tasks until none is left.
+ *
+ * @param  arg Pointer to the aafRetrievePool structure.
+ * @return     NULL
+ */
+
+static void * retrieveTaskWorker( void *arg );
+
+#endif
+
+
+
 AAF_Data *aaf_alloc( struct aafLog *log )
 {
 	AAF_Data *aafd = calloc( 1, sizeof(AAF_Data) );
@@ -503,6 +644,48 @@ int aaf_load_file( AAF_Data *aafd, const char *file )
 
 
 
+int aaf_probe( AAF_Data *aafd, const char *file )
+{
+	if ( !aafd || !file )
+		return 1;
+
+	aafd->probe = 1;
+
+	return aaf_load_file( aafd, file );
+}
+
+
+
+int aaf_visit_file( AAF_Data *aafd, const char *file, aafVisitor *visitor )
+{
+	if ( !aafd || !file || !visitor )
+		return 1;
+
+	aafd->Objects = NULL;
+	aafd->Classes = NULL;
+
+
+	if ( cfb_load_file( &aafd->cfbd, file ) < 0 ) {
+		return 1;
+	}
+
+	if ( aafclass_setDefaultClasses( aafd ) < 0 ) {
+		return -1;
+	}
+
+	visitor->depth = 0;
+
+	aafd->visitor = visitor;
+
+	int rc = retrieveObjectTree( aafd );
+
+	aafd->visitor = NULL;
+
+	return ( rc < 0 ) ? -1 : 0;
+}
+
+
+
 void aaf_release( AAF_Data **aafd )
 {
 	if ( !aafd || !(*aafd) )
@@ -587,7 +770,11 @@ void aaf_release( AAF_Data **aafd )
 
 char * aaf_get_ObjectPath( aafObject *Obj )
 {
-	static char path[CFB_PATH_NAME_SZ];
+	if ( !Obj ) {
+		return NULL;
+	}
+
+	char *path = Obj->aafd->text.ObjectPath;
 
 	uint32_t offset = CFB_PATH_NAME_SZ;
 	path[--offset] = '\0';
@@ -656,7 +843,10 @@ aafObject * aaf_get_ObjectByWeakRef( aafObject *list, aafWeakRef_t *ref )
 	{
 		for (; list != NULL; list = list->next ) {
 
-			if ( memcmp( list->Entry->_identification, ref->_identification, ref->_identificationSize ) == 0 ) {
+			/* never compare beyond the Entry identification, as set by setObjectStrongRefSet() */
+			size_t identificationSize = ( ref->_identificationSize < list->Header->_identificationSize ) ? ref->_identificationSize : list->Header->_identificationSize;
+
+			if ( memcmp( list->Entry->_identification, ref->_identification, identificationSize ) == 0 ) {
 
 				if ( list->Header->_identificationSize != ref->_identificationSize ) {
 					/* TODO : is it possible ? is it an error ? */
@@ -1368,9 +1558,15 @@ static void setObjectShortcuts( AAF_Data *aafd )
 
 	aafd->Identification.obj      = aaf_get_propertyValue( aafd->Header.obj, PID_Header_IdentificationList, &AAFTypeID_IdentificationStrongReferenceVector         );
 	aafd->Content                 = aaf_get_propertyValue( aafd->Header.obj, PID_Header_Content,            &AAFTypeID_ContentStorageStrongReference               );
+	aafd->Mobs                    = aaf_get_propertyValue( aafd->Content,    PID_ContentStorage_Mobs,        &AAFTypeID_MobStrongReferenceSet                      );
+
+	if ( aafd->probe ) {
+		/* Dictionary and EssenceData were not retrieved */
+		return;
+	}
+
 	aafd->Dictionary              = aaf_get_propertyValue( aafd->Header.obj, PID_Header_Dictionary,         &AAFTypeID_DictionaryStrongReference                   );
 
-	aafd->Mobs                    = aaf_get_propertyValue( aafd->Content,    PID_ContentStorage_Mobs,        &AAFTypeID_MobStrongReferenceSet                      );
 	aafd->EssenceData             = aaf_get_propertyValue( aafd->Content,    PID_ContentStorage_EssenceData, &AAFTypeID_EssenceDataStrongReferenceSet              );
 
 	aafd->OperationDefinition     = aaf_get_propertyValue( aafd->Dictionary, PID_Dictionary_OperationDefinitions,     &AAFTypeID_OperationDefinitionStrongReferenceSet     );
@@ -1392,6 +1588,15 @@ static int retrieveObjectTree( AAF_Data *aafd )
 	int rc = 0;
 	aafByte_t *propStream = NULL;
 
+	/*
+	 * The Root Object and the MetaDictionary are always kept in memory, so
+	 * the visitor is only enabled once we reach Root::Header.
+	 */
+
+	aafVisitor *visitor = aafd->visitor;
+
+	aafd->visitor = NULL;
+
 	cfbNode *Node = &aafd->cfbd->nodes[0];
 
 	aafClass *Class = aafclass_getClassByID( aafd, (aafUID_t*)&Node->_clsId );
@@ -1448,6 +1653,14 @@ static int retrieveObjectTree( AAF_Data *aafd )
 		}
 	}
 
+	if ( aafd->probe ) {
+		/*
+		 * Probing only relies on standard classes and properties,
+		 * so the MetaDictionary is skipped.
+		 */
+		goto header;
+	}
+
 	PDef = aafclass_getPropertyDefinitionByID( aafd->Root->Class, PID_Root_MetaDictionary );
 
 	/* Start recursive parsing of /Root/Header/{*} */
@@ -1487,8 +1700,12 @@ static int retrieveObjectTree( AAF_Data *aafd )
 	}
 
 
+header:
+
 	PDef = aafclass_getPropertyDefinitionByID( aafd->Root->Class, PID_Root_Header );
 
+	aafd->visitor = visitor;
+
 	/* Starts recursive parsing of /Root/Header/{*} */
 
 	rc = retrieveProperty( aafd, aafd->Root, PDef, &AAFHeaderProp, AAFHeaderVal, Header._byteOrder );
@@ -1498,6 +1715,30 @@ static int retrieveObjectTree( AAF_Data *aafd )
 		goto err;
 	}
 
+	if ( visitor ) {
+
+		rc = visitObject( aafd, aafd->Root );
+
+		/*
+		 * Root::Header value still holds the reference name if the Root Object
+		 * was skipped by on_object_begin().
+		 */
+
+		aafProperty *HeaderProp = aaf_get_property( aafd->Root, PID_Root_Header );
+
+		if ( HeaderProp ) {
+			free( HeaderProp->val );
+			HeaderProp->val = NULL;
+		}
+
+		if ( rc < 0 ) {
+			goto err;
+		}
+
+		rc = 0;
+		goto end;
+	}
+
 
 	setObjectShortcuts( aafd );
 
@@ -1675,6 +1916,18 @@ static aafClass * retrieveMetaDictionaryClass( AAF_Data *aafd, aafObject *Target
 		}
 
 
+		aafProperty *TypeProp = aaf_get_property( Prop, PID_PropertyDefinition_Type );
+
+		if ( TypeProp && TypeProp->sf != SF_WEAK_OBJECT_REFERENCE && TypeProp->len == sizeof(aafUID_t) ) {
+			/*
+			 * Some files store the Type AUID itself, rather than a weak reference
+			 * to the TypeDefinition.
+			 */
+			memcpy( &PDef->type, TypeProp->val, sizeof(aafUID_t) );
+			continue;
+		}
+
+
 		aafWeakRef_t *WeakRefToType = aaf_get_propertyValue( Prop, PID_PropertyDefinition_Type, &AAFTypeID_PropertyDefinitionWeakReference );
 
 		if ( !WeakRefToType ) {
@@ -1741,6 +1994,12 @@ static aafObject * newObject( AAF_Data *aafd, cfbNode *Node, aafClass *Class, aa
 
 	Obj->next       = NULL;
 	Obj->prev       = NULL;
+
+	if ( aafd->visitor ) {
+		/* visited Objects are freed by releaseVisitedObject() */
+		return Obj;
+	}
+
 	Obj->nextObj    = aafd->Objects;
 	aafd->Objects   = Obj;
 
@@ -1879,6 +2138,17 @@ static int retrieveStrongReference( AAF_Data *aafd, aafProperty *Prop, aafObject
 	}
 
 
+	if ( aafd->visitor ) {
+
+		aafObject *Obj = newObject( aafd, Node, Class, Parent );
+
+		if ( !Obj ) {
+			return -1;
+		}
+
+		return visitChildObject( aafd, Obj );
+	}
+
 	Prop->val = newObject( aafd, Node, Class, Parent );
 
 	if ( !Prop->val ) {
@@ -1936,6 +2206,15 @@ static int retrieveStrongReferenceSet( AAF_Data *aafd, aafProperty *Prop, aafObj
 	uint32_t i = 0;
 	int rc = 0;
 
+#ifdef LIBAAF_THREADS
+	if ( aafd->threads > 1 && !aafd->visitor && !aafd->probe &&
+	    ( Prop->pid == PID_ContentStorage_Mobs || Prop->pid == PID_ContentStorage_EssenceData ) )
+	{
+		rc = retrieveStrongReferenceSetParallel( aafd, Prop, Parent, Header, refName );
+		goto end;
+	}
+#endif
+
 	foreachStrongRefSetEntry( Header, (*Entry), i ) {
 
 		Node = getStrongRefEntryNode( aafd, Parent, refName, Entry->_localKey );
@@ -1946,6 +2225,13 @@ static int retrieveStrongReferenceSet( AAF_Data *aafd, aafProperty *Prop, aafObj
 
 		aafClass *Class = aafclass_getClassByID( aafd, (aafUID_t*)&Node->_clsId );
 
+		if ( aafd->probe && Prop->pid == PID_ContentStorage_Mobs &&
+		     !aafUIDCmp( (aafUID_t*)&Node->_clsId, &AAFClassID_CompositionMob ) )
+		{
+			/* only the CompositionMobs are needed when probing */
+			continue;
+		}
+
 		if ( !Class ) {
 			error( "Could not retrieve Class %s.",
 				aaft_ClassIDToText( aafd, (aafUID_t*)&Node->_clsId ) );
@@ -1960,6 +2246,17 @@ static int retrieveStrongReferenceSet( AAF_Data *aafd, aafProperty *Prop, aafObj
 
 		rc = setObjectStrongRefSet( Obj, Header, Entry );
 
+		if ( aafd->visitor ) {
+
+			rc = ( rc < 0 ) ? rc : visitChildObject( aafd, Obj );
+
+			if ( rc < 0 ) {
+				goto err;
+			}
+
+			continue;
+		}
+
 		if ( rc < 0 ) {
 			goto err;
 		}
@@ -2047,6 +2344,17 @@ static int retrieveStrongReferenceVector( AAF_Data *aafd, aafProperty *Prop, aaf
 
 		rc = setObjectStrongRefVector( Obj, &Header, &Entry );
 
+		if ( aafd->visitor ) {
+
+			rc = ( rc < 0 ) ? rc : visitChildObject( aafd, Obj );
+
+			if ( rc < 0 ) {
+				goto err;
+			}
+
+			continue;
+		}
+
 		if ( rc < 0 ) {
 			goto err;
 		}
@@ -2098,6 +2406,15 @@ static int retrieveProperty( AAF_Data *aafd, aafObject *Obj, aafPropertyDef *Def
 {
 	(void)bo; // TODO: ByteOrder support ?
 
+	if ( aafd->probe &&
+	     ( p->_storedForm == SF_STRONG_OBJECT_REFERENCE ||
+	       p->_storedForm == SF_STRONG_OBJECT_REFERENCE_SET ||
+	       p->_storedForm == SF_STRONG_OBJECT_REFERENCE_VECTOR ) &&
+	     !probeFollowsReference( Def->pid ) )
+	{
+		return 0;
+	}
+
 	aafProperty *Prop = newProperty( aafd, Def );
 
 	if ( !Prop ) {
@@ -2127,6 +2444,11 @@ static int retrieveProperty( AAF_Data *aafd, aafObject *Obj, aafPropertyDef *Def
 	Prop->next = Obj->Properties;
 	Obj->Properties = Prop;
 
+	if ( aafd->visitor ) {
+		/* references are followed by visitObject(), after on_property() */
+		return 0;
+	}
+
 	switch ( p->_storedForm )
 	{
 		case SF_STRONG_OBJECT_REFERENCE:
@@ -2176,6 +2498,11 @@ static int retrieveObjectProperties( AAF_Data *aafd, aafObject *Obj )
 
 		PDef = aafclass_getPropertyDefinitionByID( Obj->Class, Prop._pid );
 
+		if ( !PDef && aafd->probe ) {
+			/* MetaDictionary was not retrieved, so custom properties are unknown */
+			continue;
+		}
+
 		if ( !PDef ) {
 			warning( "Unknown property 0x%04x (%s) of object %s",
 				Prop._pid,
@@ -2361,3 +2688,336 @@ static aafByte_t * getStrongRefVectorList( AAF_Data *aafd, cfbNode *Node, aafObj
 
 	return stream;
 }
+
+
+
+static int probeFollowsReference( aafPID_t pid )
+{
+	switch ( pid )
+	{
+		case PID_Root_Header:
+		case PID_Header_IdentificationList:
+		case PID_Header_Content:
+		case PID_ContentStorage_Mobs:
+		case PID_Mob_Slots:
+		case PID_MobSlot_Segment:
+			return 1;
+
+		default:
+			return 0;
+	}
+}
+
+
+
+static int visitObject( AAF_Data *aafd, aafObject *Obj )
+{
+	aafVisitor  *visitor = aafd->visitor;
+	aafProperty *Prop    = NULL;
+
+	int rc = 0;
+
+	if ( visitor->on_object_begin ) {
+
+		rc = visitor->on_object_begin( visitor, Obj );
+
+		if ( rc != 0 ) {
+			return ( rc < 0 ) ? -1 : 0;
+		}
+	}
+
+	visitor->depth++;
+
+	for ( Prop = Obj->Properties; Prop != NULL; Prop = Prop->next ) {
+
+		if ( Obj == aafd->Root && Prop->pid == PID_Root_MetaDictionary ) {
+			/* MetaDictionary is already retrieved and is not visited */
+			continue;
+		}
+
+		if ( visitor->on_property && visitor->on_property( visitor, Obj, Prop ) < 0 ) {
+			rc = -1;
+			break;
+		}
+
+		switch ( Prop->sf )
+		{
+			case SF_STRONG_OBJECT_REFERENCE:
+				rc = retrieveStrongReference( aafd, Prop, Obj );
+				break;
+
+			case SF_STRONG_OBJECT_REFERENCE_SET:
+				rc = retrieveStrongReferenceSet( aafd, Prop, Obj );
+				break;
+
+			case SF_STRONG_OBJECT_REFERENCE_VECTOR:
+				rc = retrieveStrongReferenceVector( aafd, Prop, Obj );
+				break;
+
+			default: break;
+		}
+
+		if ( rc < 0 ) {
+			break;
+		}
+	}
+
+	visitor->depth--;
+
+	if ( rc < 0 ) {
+		return -1;
+	}
+
+	if ( visitor->on_object_end && visitor->on_object_end( visitor, Obj ) < 0 ) {
+		return -1;
+	}
+
+	return 0;
+}
+
+
+
+static int visitChildObject( AAF_Data *aafd, aafObject *Obj )
+{
+	int rc = retrieveObjectProperties( aafd, Obj );
+
+	if ( rc == 0 ) {
+		rc = visitObject( aafd, Obj );
+	}
+
+	releaseVisitedObject( Obj );
+
+	return rc;
+}
+
+
+
+static void releaseVisitedObject( aafObject *Obj )
+{
+	aafProperty *Prop    = NULL;
+	aafProperty *tmpProp = NULL;
+
+	for ( Prop = Obj->Properties; Prop != NULL; Prop = tmpProp ) {
+
+		tmpProp = Prop->next;
+
+		/* strong reference values were never resolved to Objects */
+		free( Prop->val );
+		free( Prop );
+	}
+
+	free( Obj->Header );
+	free( Obj->Entry );
+	free( Obj->Name );
+	free( Obj );
+}
+
+
+
+#ifdef LIBAAF_THREADS
+
+static int retrieveStrongReferenceSetParallel( AAF_Data *aafd, aafProperty *Prop, aafObject *Parent, aafStrongRefSetHeader_t *Header, const char *refName )
+{
+	aafRetrievePool pool;
+	pthread_t *threads = NULL;
+
+	uint32_t threadCount = 0;
+	uint32_t entrySize = sizeof(aafStrongRefSetEntry_t) + Header->_identificationSize;
+	uint32_t i = 0;
+
+	int rc = 0;
+
+	memset( &pool, 0x00, sizeof(aafRetrievePool) );
+
+	pool.aafd = aafd;
+
+
+	pool.tasks = calloc( Header->_entryCount, sizeof(aafRetrieveTask) );
+
+	if ( !pool.tasks ) {
+		error( "Out of memory" );
+		return -1;
+	}
+
+
+	/*
+	 * Entry Nodes and Classes are resolved sequentially, so tasks only have
+	 * to retrieve the Objects.
+	 */
+
+	for ( i = 0; i < Header->_entryCount; i++ ) {
+
+		const char *entryData = ((char*)Header) + sizeof(aafStrongRefSetHeader_t) + entrySize * i;
+
+		aafStrongRefSetEntry_t Entry;
+
+		memcpy( &Entry, entryData, sizeof(aafStrongRefSetEntry_t) );
+
+		aafRetrieveTask *task = &pool.tasks[pool.count];
+
+		task->Node = getStrongRefEntryNode( aafd, Parent, refName, Entry._localKey );
+
+		if ( !task->Node ) {
+			continue;
+		}
+
+		task->Class = aafclass_getClassByID( aafd, (aafUID_t*)&task->Node->_clsId );
+
+		if ( !task->Class ) {
+			error( "Could not retrieve Class %s.",
+				aaft_ClassIDToText( aafd, (aafUID_t*)&task->Node->_clsId ) );
+			continue;
+		}
+
+		task->Entry = malloc( entrySize );
+
+		if ( !task->Entry ) {
+			error( "Out of memory" );
+			rc = -1;
+			goto end;
+		}
+
+		memcpy( task->Entry, entryData, entrySize );
+
+		task->Parent = Parent;
+		task->Header = Header;
+
+		pool.count++;
+	}
+
+
+	threadCount = ( (uint32_t)aafd->threads < pool.count ) ? (uint32_t)aafd->threads : pool.count;
+
+	if ( threadCount > 1 ) {
+
+		threads = calloc( threadCount - 1, sizeof(pthread_t) );
+
+		if ( !threads ) {
+			error( "Out of memory" );
+			rc = -1;
+			goto end;
+		}
+	}
+
+	pthread_mutex_init( &pool.mutex, NULL );
+
+
+	uint32_t started = 0;
+
+	for ( started = 0; started + 1 < threadCount; started++ ) {
+
+		int err = pthread_create( &threads[started], NULL, retrieveTaskWorker, &pool );
+
+		if ( err != 0 ) {
+			warning( "Could not start thread : %s. Continuing with %u threads.", strerror(err), started+1 );
+			break;
+		}
+	}
+
+	retrieveTaskWorker( &pool );
+
+	for ( i = 0; i < started; i++ ) {
+		pthread_join( threads[i], NULL );
+	}
+
+	pthread_mutex_destroy( &pool.mutex );
+
+
+	/*
+	 * Merges tasks Objects in entry order, the same way newObject() and
+	 * retrieveStrongReferenceSet() would have sequentially.
+	 */
+
+	for ( i = 0; i < pool.count; i++ ) {
+
+		aafRetrieveTask *task = &pool.tasks[i];
+		aafObject *Obj  = NULL;
+		aafObject *last = NULL;
+
+		for ( Obj = task->Objects; Obj != NULL; Obj = Obj->nextObj ) {
+			Obj->aafd = aafd;
+			last = Obj;
+		}
+
+		if ( last ) {
+			last->nextObj = aafd->Objects;
+			aafd->Objects = task->Objects;
+		}
+
+		if ( task->rc < 0 || !task->Obj ) {
+			rc = -1;
+			continue;
+		}
+
+		task->Obj->next = Prop->val;
+		Prop->val = task->Obj;
+	}
+
+end:
+
+	for ( i = 0; i < pool.count; i++ ) {
+		free( pool.tasks[i].Entry );
+	}
+
+	free( pool.tasks );
+	free( threads );
+
+	return rc;
+}
+
+
+
+static void * retrieveTaskWorker( void *arg )
+{
+	aafRetrievePool *pool = arg;
+
+	AAF_Data *aafd = pool->aafd;
+
+	AAF_Data *workerData = malloc( sizeof(AAF_Data) );
+
+	if ( !workerData ) {
+		error( "Out of memory" );
+		return NULL;
+	}
+
+	memcpy( workerData, aafd, sizeof(AAF_Data) );
+
+	while ( 1 ) {
+
+		pthread_mutex_lock( &pool->mutex );
+
+		uint32_t index = pool->next++;
+
+		pthread_mutex_unlock( &pool->mutex );
+
+		if ( index >= pool->count ) {
+			break;
+		}
+
+		aafRetrieveTask *task = &pool->tasks[index];
+
+		workerData->Objects = NULL;
+
+		task->Obj = newObject( workerData, task->Node, task->Class, task->Parent );
+
+		if ( task->Obj ) {
+
+			task->rc = setObjectStrongRefSet( task->Obj, task->Header, task->Entry );
+
+			if ( task->rc == 0 ) {
+				task->rc = retrieveObjectProperties( workerData, task->Obj );
+			}
+		}
+		else {
+			task->rc = -1;
+		}
+
+		task->Objects = workerData->Objects;
+	}
+
+	free( workerData );
+
+	return NULL;
+}
+
+#endif
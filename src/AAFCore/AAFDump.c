@@ -39,8 +39,8 @@ void aaf_dump_Header( AAF_Data *aafd, const char *padding )
 	struct aafLog *log = aafd->log;
 
 	LOG_BUFFER_WRITE( log, "%sByteOrder            : %s%s (0x%04x)%s\n", padding, ANSI_COLOR_DARKGREY(log), aaft_ByteOrderToText( aafd->Header.ByteOrder ), aafd->Header.ByteOrder, ANSI_COLOR_RESET(log) );
-	LOG_BUFFER_WRITE( log, "%sLastModified         : %s%s%s\n", padding, ANSI_COLOR_DARKGREY(log), aaft_TimestampToText( aafd->Header.LastModified ), ANSI_COLOR_RESET(log) );
-	LOG_BUFFER_WRITE( log, "%sAAF ObjSpec Version  : %s%s%s\n", padding, ANSI_COLOR_DARKGREY(log), aaft_VersionToText( aafd->Header.Version ), ANSI_COLOR_RESET(log) );
+	LOG_BUFFER_WRITE( log, "%sLastModified         : %s%s%s\n", padding, ANSI_COLOR_DARKGREY(log), aaft_TimestampToText( aafd, aafd->Header.LastModified ), ANSI_COLOR_RESET(log) );
+	LOG_BUFFER_WRITE( log, "%sAAF ObjSpec Version  : %s%s%s\n", padding, ANSI_COLOR_DARKGREY(log), aaft_VersionToText( aafd, aafd->Header.Version ), ANSI_COLOR_RESET(log) );
 	LOG_BUFFER_WRITE( log, "%sObjectModel Version  : %s%u%s\n", padding, ANSI_COLOR_DARKGREY(log), aafd->Header.ObjectModelVersion, ANSI_COLOR_RESET(log) );
 	LOG_BUFFER_WRITE( log, "%sOperational Pattern  : %s%s%s\n", padding, ANSI_COLOR_DARKGREY(log), aaft_OPDefToText( aafd->Header.OperationalPattern ), ANSI_COLOR_RESET(log) );
 
@@ -57,13 +57,13 @@ void aaf_dump_Identification( AAF_Data *aafd, const char *padding )
 
 	LOG_BUFFER_WRITE( log, "%sCompanyName          : %s%s%s\n", padding, ANSI_COLOR_DARKGREY(log), ( aafd->Identification.CompanyName ) ? aafd->Identification.CompanyName : "n/a", ANSI_COLOR_RESET(log) );
 	LOG_BUFFER_WRITE( log, "%sProductName          : %s%s%s\n", padding, ANSI_COLOR_DARKGREY(log), ( aafd->Identification.ProductName ) ? aafd->Identification.ProductName : "n/a", ANSI_COLOR_RESET(log) );
-	LOG_BUFFER_WRITE( log, "%sProductVersion       : %s%s%s\n", padding, ANSI_COLOR_DARKGREY(log), aaft_ProductVersionToText( aafd->Identification.ProductVersion ), ANSI_COLOR_RESET(log) );
+	LOG_BUFFER_WRITE( log, "%sProductVersion       : %s%s%s\n", padding, ANSI_COLOR_DARKGREY(log), aaft_ProductVersionToText( aafd, aafd->Identification.ProductVersion ), ANSI_COLOR_RESET(log) );
 	LOG_BUFFER_WRITE( log, "%sProductVersionString : %s%s%s\n", padding, ANSI_COLOR_DARKGREY(log), ( aafd->Identification.ProductVersionString ) ? aafd->Identification.ProductVersionString : "n/a", ANSI_COLOR_RESET(log) );
-	LOG_BUFFER_WRITE( log, "%sProductID            : %s%s%s\n", padding, ANSI_COLOR_DARKGREY(log), AUIDToText( aafd->Identification.ProductID ), ANSI_COLOR_RESET(log) );
-	LOG_BUFFER_WRITE( log, "%sDate                 : %s%s%s\n", padding, ANSI_COLOR_DARKGREY(log), aaft_TimestampToText( aafd->Identification.Date ), ANSI_COLOR_RESET(log) );
-	LOG_BUFFER_WRITE( log, "%sToolkitVersion       : %s%s%s\n", padding, ANSI_COLOR_DARKGREY(log), aaft_ProductVersionToText( aafd->Identification.ToolkitVersion ), ANSI_COLOR_RESET(log) );
+	LOG_BUFFER_WRITE( log, "%sProductID            : %s%s%s\n", padding, ANSI_COLOR_DARKGREY(log), AUIDToText( aafd, aafd->Identification.ProductID ), ANSI_COLOR_RESET(log) );
+	LOG_BUFFER_WRITE( log, "%sDate                 : %s%s%s\n", padding, ANSI_COLOR_DARKGREY(log), aaft_TimestampToText( aafd, aafd->Identification.Date ), ANSI_COLOR_RESET(log) );
+	LOG_BUFFER_WRITE( log, "%sToolkitVersion       : %s%s%s\n", padding, ANSI_COLOR_DARKGREY(log), aaft_ProductVersionToText( aafd, aafd->Identification.ToolkitVersion ), ANSI_COLOR_RESET(log) );
 	LOG_BUFFER_WRITE( log, "%sPlatform             : %s%s%s\n", padding, ANSI_COLOR_DARKGREY(log), ( aafd->Identification.Platform ) ? aafd->Identification.Platform : "n/a", ANSI_COLOR_RESET(log) );
-	LOG_BUFFER_WRITE( log, "%sGenerationAUID       : %s%s%s\n", padding, ANSI_COLOR_DARKGREY(log), AUIDToText( aafd->Identification.GenerationAUID ), ANSI_COLOR_RESET(log) );
+	LOG_BUFFER_WRITE( log, "%sGenerationAUID       : %s%s%s\n", padding, ANSI_COLOR_DARKGREY(log), AUIDToText( aafd, aafd->Identification.GenerationAUID ), ANSI_COLOR_RESET(log) );
 
 	LOG_BUFFER_WRITE( log, "\n\n" );
 
@@ -54,10 +54,10 @@
 
 
 
-const char * aaft_MobIDToText( aafMobID_t *mobid )
+const char * aaft_MobIDToText( AAF_Data *aafd, aafMobID_t *mobid )
 {
-	size_t strsz = 200;
-	static char str[200];
+	size_t strsz = sizeof(aafd->text.MobID);
+	char  *str   = aafd->text.MobID;
 
 	size_t i = 0;
 	uint32_t offset = 0;
@@ -104,7 +104,7 @@ const char * aaft_MobIDToText( aafMobID_t *mobid )
 
 	memcpy( &material, ((unsigned char*)mobid)+i, sizeof(aafUID_t) );
 
-	rc = snprintf( str+offset, strsz-offset, "%s", AUIDToText(&material) );
+	rc = snprintf( str+offset, strsz-offset, "%s", AUIDToText( aafd, &material ) );
 
 	assert( rc >= 0 && (size_t)rc < strsz-offset );
 
@@ -113,9 +113,9 @@ const char * aaft_MobIDToText( aafMobID_t *mobid )
 
 
 
-const char * aaft_TimestampToText( aafTimeStamp_t *ts )
+const char * aaft_TimestampToText( AAF_Data *aafd, aafTimeStamp_t *ts )
 {
-	static char str[32];
+	char *str = aafd->text.Timestamp;
 
 	if ( ts == NULL ) {
 		str[0] = 'n';
@@ -124,7 +124,7 @@ const char * aaft_TimestampToText( aafTimeStamp_t *ts )
 		str[3] = '\0';
 	}
 	else {
-		int rc = snprintf( str, sizeof(str), "%04i-%02u-%02u %02u:%02u:%02u.%02u",
+		int rc = snprintf( str, sizeof(aafd->text.Timestamp), "%04i-%02u-%02u %02u:%02u:%02u.%02u",
 			ts->date.year,
 			ts->date.month,
 			ts->date.day,
@@ -133,7 +133,7 @@ const char * aaft_TimestampToText( aafTimeStamp_t *ts )
 			ts->time.second,
 			ts->time.fraction );
 
-		assert( rc > 0 && (size_t)rc < sizeof(str) );
+		assert( rc > 0 && (size_t)rc < sizeof(aafd->text.Timestamp) );
 	}
 
 	return str;
@@ -141,9 +141,9 @@ const char * aaft_TimestampToText( aafTimeStamp_t *ts )
 
 
 
-const char * aaft_VersionToText( aafVersionType_t *vers )
+const char * aaft_VersionToText( AAF_Data *aafd, aafVersionType_t *vers )
 {
-	static char str[16];
+	char *str = aafd->text.Version;
 
 	if ( vers == NULL ) {
 		str[0] = 'n';
@@ -152,11 +152,11 @@ const char * aaft_VersionToText( aafVersionType_t *vers )
 		str[3] = '\0';
 	}
 	else {
-		int rc = snprintf( str, sizeof(str), "%i.%i",
+		int rc = snprintf( str, sizeof(aafd->text.Version), "%i.%i",
 			vers->major,
 			vers->minor );
 
-		assert( rc > 0 && (size_t)rc < sizeof(str) );
+		assert( rc > 0 && (size_t)rc < sizeof(aafd->text.Version) );
 	}
 
 	return str;
@@ -164,9 +164,9 @@ const char * aaft_VersionToText( aafVersionType_t *vers )
 
 
 
-const char * aaft_ProductVersionToText( aafProductVersion_t *vers )
+const char * aaft_ProductVersionToText( AAF_Data *aafd, aafProductVersion_t *vers )
 {
-	static char str[64];
+	char *str = aafd->text.ProductVersion;
 
 	if ( vers == NULL ) {
 		str[0] = 'n';
@@ -175,7 +175,7 @@ const char * aaft_ProductVersionToText( aafProductVersion_t *vers )
 		str[3] = '\0';
 	}
 	else {
-		int rc = snprintf( str, sizeof(str), "%u.%u.%u.%u %s (%i)",
+		int rc = snprintf( str, sizeof(aafd->text.ProductVersion), "%u.%u.%u.%u %s (%i)",
 			vers->major,
 			vers->minor,
 			vers->tertiary,
@@ -183,7 +183,7 @@ const char * aaft_ProductVersionToText( aafProductVersion_t *vers )
 			aaft_ProductReleaseTypeToText( vers->type ),
 			vers->type );
 
-		assert( rc > 0 && (size_t)rc < sizeof(str) );
+		assert( rc > 0 && (size_t)rc < sizeof(aafd->text.ProductVersion) );
 	}
 
 	return str;
@@ -697,7 +697,7 @@ const char * aaft_DataDefToText( AAF_Data *aafd, const aafUID_t *auid )
 	if ( aafUIDCmp( auid, &AAFDataDef_Unknown             ) ) return "AAFDataDef_Unknown";
 
 
-	static char TEXTDataDef[1024];
+	char *TEXTDataDef = aafd->text.DataDef;
 
 	aafObject *DataDefinitions = aaf_get_propertyValue( aafd->Dictionary, PID_Dictionary_DataDefinitions, &AAFTypeID_DataDefinitionStrongReferenceSet );
 	aafObject *DataDefinition  = NULL;
@@ -715,9 +715,9 @@ const char * aaft_DataDefToText( AAF_Data *aafd, const aafUID_t *auid )
 				return NULL;
 			}
 
-			int rc = snprintf( TEXTDataDef, sizeof(TEXTDataDef), "%s", name );
+			int rc = snprintf( TEXTDataDef, sizeof(aafd->text.DataDef), "%s", name );
 
-			assert( rc >= 0 && (size_t)rc < sizeof(TEXTDataDef) );
+			assert( rc >= 0 && (size_t)rc < sizeof(aafd->text.DataDef) );
 
 			free( name );
 
@@ -770,7 +770,7 @@ const char * aaft_OperationDefToText( AAF_Data *aafd, const aafUID_t *auid )
 	if ( aafUIDCmp( auid, &AAFOperationDef_AudioChannelCombiner          ) ) return "AAFOperationDef_AudioChannelCombiner";
 
 
-	static char TEXTOperationDef[1024];
+	char *TEXTOperationDef = aafd->text.OperationDef;
 
 	aafObject *OperationDefinitions = aaf_get_propertyValue( aafd->Dictionary, PID_Dictionary_OperationDefinitions, &AAFTypeID_OperationDefinitionStrongReferenceSet );
 	aafObject *OperationDefinition  = NULL;
@@ -788,9 +788,9 @@ const char * aaft_OperationDefToText( AAF_Data *aafd, const aafUID_t *auid )
 				return NULL;
 			}
 
-			int rc = snprintf( TEXTOperationDef, sizeof(TEXTOperationDef), "%s", name );
+			int rc = snprintf( TEXTOperationDef, sizeof(aafd->text.OperationDef), "%s", name );
 
-			assert( rc >= 0 && (size_t)rc < sizeof(TEXTOperationDef) );
+			assert( rc >= 0 && (size_t)rc < sizeof(aafd->text.OperationDef) );
 
 			free( name );
 
@@ -896,7 +896,7 @@ const char * aaft_ParameterToText( AAF_Data *aafd, const aafUID_t *auid )
 	/* NOTE: Seen in Avid MC and PT files : PanVol_IsTrimGainEffect */
 
 
-	static char TEXTParameterDef[1024];
+	char *TEXTParameterDef = aafd->text.ParameterDef;
 
 	aafObject *ParameterDefinitions = aaf_get_propertyValue( aafd->Dictionary, PID_Dictionary_ParameterDefinitions, &AAFTypeID_ParameterDefinitionStrongReferenceSet );
 	aafObject *ParameterDefinition  = NULL;
@@ -914,9 +914,9 @@ const char * aaft_ParameterToText( AAF_Data *aafd, const aafUID_t *auid )
 				return NULL;
 			}
 
-			int rc = snprintf( TEXTParameterDef, sizeof(TEXTParameterDef), "%s", name );
+			int rc = snprintf( TEXTParameterDef, sizeof(aafd->text.ParameterDef), "%s", name );
 
-			assert( rc >= 0 && (size_t)rc < sizeof(TEXTParameterDef) );
+			assert( rc >= 0 && (size_t)rc < sizeof(aafd->text.ParameterDef) );
 
 			free( name );
 
@@ -1330,7 +1330,7 @@ const char * aaft_PIDToText( AAF_Data *aafd, aafPID_t pid )
 	}
 
 
-	static char PIDText[1024];
+	char *PIDText = aafd->text.PID;
 
 	aafClass *Class = NULL;
 
@@ -1342,12 +1342,12 @@ const char * aaft_PIDToText( AAF_Data *aafd, aafPID_t pid )
 
 			if ( PDef->pid == pid ) {
 
-				int rc = snprintf( PIDText, sizeof(PIDText), "%s%s%s",
+				int rc = snprintf( PIDText, sizeof(aafd->text.PID), "%s%s%s",
 					(PDef->meta) ? ANSI_COLOR_MAGENTA(aafd->log) : "",
 					 PDef->name,
 					(PDef->meta) ? ANSI_COLOR_RESET(aafd->log) : "" );
 
-				assert( rc >= 0 && (size_t)rc < sizeof(PIDText) );
+				assert( rc >= 0 && (size_t)rc < sizeof(aafd->text.PID) );
 
 				return PIDText;
 			}
@@ -1471,7 +1471,7 @@ const char * aaft_ClassIDToText( AAF_Data *aafd, const aafUID_t *auid )
 	if ( aafUIDCmp( auid, &AAFClassID_DescriptiveFramework                ) ) return "AAFClassID_DescriptiveFramework";
 
 
-	static char ClassIDText[1024];
+	char *ClassIDText = aafd->text.ClassID;
 
 	ClassIDText[0] = '\0';
 
@@ -1481,12 +1481,12 @@ const char * aaft_ClassIDToText( AAF_Data *aafd, const aafUID_t *auid )
 
 		if ( aafUIDCmp( Class->ID, auid ) ) {
 
-			int rc = snprintf( ClassIDText, sizeof(ClassIDText), "%s%s%s",
+			int rc = snprintf( ClassIDText, sizeof(aafd->text.ClassID), "%s%s%s",
 				(Class->meta) ? ANSI_COLOR_MAGENTA(aafd->log) : "",
 				 Class->name,
 				(Class->meta) ? ANSI_COLOR_RESET(aafd->log) : "" );
 
-			assert( rc >= 0 && (size_t)rc < sizeof(ClassIDText) );
+			assert( rc >= 0 && (size_t)rc < sizeof(aafd->text.ClassID) );
 
 			return ClassIDText;
 		}
@@ -1500,9 +1500,9 @@ const char * aaft_ClassIDToText( AAF_Data *aafd, const aafUID_t *auid )
 
 const char * aaft_IndirectValueToText( AAF_Data *aafd, aafIndirect_t *Indirect )
 {
-	static char buf[4096];
+	char *buf = aafd->text.IndirectValue;
 
-	memset( buf, 0x00, sizeof(buf) );
+	memset( buf, 0x00, sizeof(aafd->text.IndirectValue) );
 
 	void *indirectValue = aaf_get_indirectValue( aafd, Indirect, NULL );
 
@@ -1512,17 +1512,17 @@ const char * aaft_IndirectValueToText( AAF_Data *aafd, aafIndirect_t *Indirect )
 
 	int rc = 0;
 
-	if (      aafUIDCmp( &Indirect->TypeDef, &AAFTypeID_Boolean  ) ) { rc = snprintf( buf, sizeof(buf), "%c",      *(uint8_t*)indirectValue );  }
-	else if ( aafUIDCmp( &Indirect->TypeDef, &AAFTypeID_Rational ) ) { rc = snprintf( buf, sizeof(buf), "%i/%i",   ((aafRational_t*)indirectValue)->numerator, ((aafRational_t*)indirectValue)->denominator ); }
+	if (      aafUIDCmp( &Indirect->TypeDef, &AAFTypeID_Boolean  ) ) { rc = snprintf( buf, sizeof(aafd->text.IndirectValue), "%c",      *(uint8_t*)indirectValue );  }
+	else if ( aafUIDCmp( &Indirect->TypeDef, &AAFTypeID_Rational ) ) { rc = snprintf( buf, sizeof(aafd->text.IndirectValue), "%i/%i",   ((aafRational_t*)indirectValue)->numerator, ((aafRational_t*)indirectValue)->denominator ); }
 
-	else if ( aafUIDCmp( &Indirect->TypeDef, &AAFTypeID_Int8     ) ) { rc = snprintf( buf, sizeof(buf), "%c",      *(int8_t*)indirectValue );  }
-	else if ( aafUIDCmp( &Indirect->TypeDef, &AAFTypeID_Int16    ) ) { rc = snprintf( buf, sizeof(buf), "%i",      *(int16_t*)indirectValue );  }
-	else if ( aafUIDCmp( &Indirect->TypeDef, &AAFTypeID_Int32    ) ) { rc = snprintf( buf, sizeof(buf), "%i",      *(int32_t*)indirectValue );  }
-	else if ( aafUIDCmp( &Indirect->TypeDef, &AAFTypeID_Int64    ) ) { rc = snprintf( buf, sizeof(buf), "%"PRIi64, *(int64_t*)indirectValue );  }
+	else if ( aafUIDCmp( &Indirect->TypeDef, &AAFTypeID_Int8     ) ) { rc = snprintf( buf, sizeof(aafd->text.IndirectValue), "%c",      *(int8_t*)indirectValue );  }
+	else if ( aafUIDCmp( &Indirect->TypeDef, &AAFTypeID_Int16    ) ) { rc = snprintf( buf, sizeof(aafd->text.IndirectValue), "%i",      *(int16_t*)indirectValue );  }
+	else if ( aafUIDCmp( &Indirect->TypeDef, &AAFTypeID_Int32    ) ) { rc = snprintf( buf, sizeof(aafd->text.IndirectValue), "%i",      *(int32_t*)indirectValue );  }
+	else if ( aafUIDCmp( &Indirect->TypeDef, &AAFTypeID_Int64    ) ) { rc = snprintf( buf, sizeof(aafd->text.IndirectValue), "%"PRIi64, *(int64_t*)indirectValue );  }
 
-	else if ( aafUIDCmp( &Indirect->TypeDef, &AAFTypeID_UInt16   ) ) { rc = snprintf( buf, sizeof(buf), "%u",      *(uint16_t*)indirectValue ); }
-	else if ( aafUIDCmp( &Indirect->TypeDef, &AAFTypeID_UInt32   ) ) { rc = snprintf( buf, sizeof(buf), "%u",      *(uint32_t*)indirectValue ); }
-	else if ( aafUIDCmp( &Indirect->TypeDef, &AAFTypeID_UInt64   ) ) { rc = snprintf( buf, sizeof(buf), "%"PRIu64, *(uint64_t*)indirectValue ); }
+	else if ( aafUIDCmp( &Indirect->TypeDef, &AAFTypeID_UInt16   ) ) { rc = snprintf( buf, sizeof(aafd->text.IndirectValue), "%u",      *(uint16_t*)indirectValue ); }
+	else if ( aafUIDCmp( &Indirect->TypeDef, &AAFTypeID_UInt32   ) ) { rc = snprintf( buf, sizeof(aafd->text.IndirectValue), "%u",      *(uint32_t*)indirectValue ); }
+	else if ( aafUIDCmp( &Indirect->TypeDef, &AAFTypeID_UInt64   ) ) { rc = snprintf( buf, sizeof(aafd->text.IndirectValue), "%"PRIu64, *(uint64_t*)indirectValue ); }
 
 	else if ( aafUIDCmp( &Indirect->TypeDef, &AAFTypeID_String   ) ) {
 
@@ -1533,7 +1533,7 @@ const char * aaft_IndirectValueToText( AAF_Data *aafd, aafIndirect_t *Indirect )
 			return NULL;
 		}
 
-		rc = snprintf( buf, sizeof(buf), "%s", str );
+		rc = snprintf( buf, sizeof(aafd->text.IndirectValue), "%s", str );
 
 		free( str );
 	}
@@ -1542,7 +1542,7 @@ const char * aaft_IndirectValueToText( AAF_Data *aafd, aafIndirect_t *Indirect )
 		return NULL;
 	}
 
-	assert( rc >= 0 && (size_t)rc < sizeof(buf) );
+	assert( rc >= 0 && (size_t)rc < sizeof(aafd->text.IndirectValue) );
 
 	return buf;
 }
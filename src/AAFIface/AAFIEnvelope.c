@@ -0,0 +1,586 @@
+/*
+ * Copyright (C) 2017-2024 Adrien Gesta-Fline
+ *
+ * This file is part of libAAF.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#if defined(__SSE2__)
+	#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+	#include <arm_neon.h>
+#endif
+
+#include <libaaf/AAFIface.h>
+#include <libaaf/AAFIEnvelope.h>
+#include <libaaf/log.h>
+
+
+#define debug( ... ) \
+	AAF_LOG( aafi->log, aafi, LOG_SRC_ID_AAF_IFACE, VERB_DEBUG, __VA_ARGS__ )
+
+#define warning( ... ) \
+	AAF_LOG( aafi->log, aafi, LOG_SRC_ID_AAF_IFACE, VERB_WARNING, __VA_ARGS__ )
+
+#define error( ... ) \
+	AAF_LOG( aafi->log, aafi, LOG_SRC_ID_AAF_IFACE, VERB_ERROR, __VA_ARGS__ )
+
+
+
+/*
+ * Segment samples are computed by chunks of this many samples, each one from
+ * a double precision start position, so float positions never drift.
+ */
+#define ENVELOPE_CHUNK 4096
+
+/*
+ * Envelope of a gain is compiled on first evaluation, and can be evaluated by
+ * several threads at once (clip loudness and playback). Each thread compiles
+ * its own, the first one published is kept and the others are freed.
+ */
+#ifdef LIBAAF_THREADS
+#define ENVELOPE_LOAD( ptr ) \
+	__atomic_load_n( ptr, __ATOMIC_ACQUIRE )
+
+#define ENVELOPE_PUBLISH( ptr, expected, env ) \
+	__atomic_compare_exchange_n( ptr, expected, env, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE )
+#else
+#define ENVELOPE_LOAD( ptr ) \
+	(*(ptr))
+
+#define ENVELOPE_PUBLISH( ptr, expected, env ) \
+	(*(ptr) = (env), 1)
+#endif
+
+#define ENVELOPE_HALF_PI   1.57079632679489661923f
+#define ENVELOPE_LOG2_1000 9.96578428466208704362f
+
+
+/*
+ * Taylor coefficients of sin(t) up to t^11, accurate to float precision
+ * for t in [0, pi/2].
+ */
+#define SIN_C3  -1.6666666666666666e-01f
+#define SIN_C5   8.3333333333333333e-03f
+#define SIN_C7  -1.9841269841269841e-04f
+#define SIN_C9   2.7557319223985891e-06f
+#define SIN_C11 -2.5052108385441719e-08f
+
+/*
+ * Taylor coefficients of 2^f up to f^7, accurate to 1.5e-6 for f in [0, 1).
+ */
+#define EXP2_C1  6.9314718055994531e-01f
+#define EXP2_C2  2.4022650695910071e-01f
+#define EXP2_C3  5.5504108664821580e-02f
+#define EXP2_C4  9.6181291076284772e-03f
+#define EXP2_C5  1.3333558146428443e-03f
+#define EXP2_C6  1.5403530393381608e-04f
+#define EXP2_C7  1.5252733804059840e-05f
+
+
+/*
+ * Curve points, converted once from aafiAudioGain rationals. Segment k goes
+ * from point k to point k+1. Arrays are allocated with the struct, right
+ * after it, so the whole envelope is released with a single free().
+ */
+struct aafiEnvelope {
+
+	uint32_t      interpol;
+	unsigned int  count;
+
+	double       *time;
+	double       *value;
+
+	double       *scale;  // 1 / segment duration, 0 if both points share time
+	double       *delta;  // value change over segment
+};
+
+/*
+ * Shapes of a segment, from 0 at x = 0 to 1 at x = 1.
+ */
+enum envelopeShape {
+	ENVELOPE_LINEAR = 0,
+	ENVELOPE_SINE,
+	ENVELOPE_EXP,
+	ENVELOPE_SMOOTH,
+};
+
+
+static struct aafiEnvelope * envelope_compile( AAF_Iface *aafi, aafiAudioGain *gain );
+static void envelope_eval( const struct aafiEnvelope *env, double length, aafPosition_t start, size_t count, float *out );
+static size_t envelope_firstSampleAt( double time, double length, aafPosition_t start, size_t from, size_t count );
+static void envelope_segment( const struct aafiEnvelope *env, unsigned int k, double u0, double du, float *out, size_t count );
+static void envelope_fill( float *out, size_t count, enum envelopeShape shape, double x0, double dx, float a, float b );
+static void envelope_hold( float *out, size_t count, float value );
+static float envelope_shape( enum envelopeShape shape, float x );
+
+#if defined(__SSE2__)
+static __m128 envelope_shape_sse2( enum envelopeShape shape, __m128 x );
+#elif defined(__ARM_NEON)
+static float32x4_t envelope_shape_neon( enum envelopeShape shape, float32x4_t x );
+#endif
+
+
+
+int aafi_evalEnvelope( AAF_Iface *aafi, aafiAudioGain *gain, aafPosition_t length, aafRational_t *editRate, aafRational_t *sampleRate, aafPosition_t start, uint64_t count, float *out )
+{
+	if ( !aafi || !gain || !out ) {
+		return -1;
+	}
+
+	if ( !gain->value || gain->pts_cnt == 0 ) {
+		envelope_hold( out, (size_t)count, 1.0f );
+		return 0;
+	}
+
+	if ( !( gain->flags & AAFI_AUDIO_GAIN_VARIABLE ) || !gain->time || gain->pts_cnt < 2 ) {
+		envelope_hold( out, (size_t)count, (float)aafRationalToDouble( gain->value[0] ) );
+		return 0;
+	}
+
+	struct aafiEnvelope *env = ENVELOPE_LOAD( &gain->envelope );
+
+	if ( !env ) {
+
+		struct aafiEnvelope *published = NULL;
+
+		env = envelope_compile( aafi, gain );
+
+		if ( !env ) {
+			return -1;
+		}
+
+		if ( !ENVELOPE_PUBLISH( &gain->envelope, &published, env ) ) {
+			free( env );
+			env = published;
+		}
+	}
+
+	aafPosition_t samples = aafi_convertUnit( length, editRate, sampleRate );
+
+	if ( samples <= 0 ) {
+		envelope_hold( out, (size_t)count, (float)env->value[0] );
+		return 0;
+	}
+
+	envelope_eval( env, (double)samples, start, (size_t)count, out );
+
+	return 0;
+}
+
+
+
+int aafi_evalTransition( AAF_Iface *aafi, aafiTransition *trans, aafRational_t *editRate, aafRational_t *sampleRate, aafPosition_t start, uint64_t count, float *out )
+{
+	if ( !aafi || !trans || !out ) {
+		return -1;
+	}
+
+	if ( !trans->value_a ) {
+		envelope_hold( out, (size_t)count, 1.0f );
+		return 0;
+	}
+
+	/* transition curves always have two points, at time 0 and time 1 */
+
+	double time[2]  = { 0.0, 1.0 };
+	double value[2] = { aafRationalToDouble( trans->value_a[0] ), aafRationalToDouble( trans->value_a[1] ) };
+	double scale[1] = { 1.0 };
+	double delta[1] = { value[1] - value[0] };
+
+	struct aafiEnvelope env;
+
+	env.interpol = trans->flags & AAFI_INTERPOL_MASK;
+	env.count    = 2;
+	env.time     = time;
+	env.value    = value;
+	env.scale    = scale;
+	env.delta    = delta;
+
+	aafPosition_t samples = aafi_convertUnit( trans->len, editRate, sampleRate );
+
+	if ( samples <= 0 ) {
+		envelope_hold( out, (size_t)count, (float)value[1] );
+		return 0;
+	}
+
+	envelope_eval( &env, (double)samples, start, (size_t)count, out );
+
+	return 0;
+}
+
+
+
+static struct aafiEnvelope * envelope_compile( AAF_Iface *aafi, aafiAudioGain *gain )
+{
+	unsigned int count = gain->pts_cnt;
+
+	struct aafiEnvelope *env = malloc( sizeof(struct aafiEnvelope) + 4 * (size_t)count * sizeof(double) );
+
+	if ( !env ) {
+		error( "Out of memory" );
+		return NULL;
+	}
+
+	env->interpol = gain->flags & AAFI_INTERPOL_MASK;
+	env->count    = count;
+	env->time     = (double*)(env + 1);
+	env->value    = env->time  + count;
+	env->scale    = env->value + count;
+	env->delta    = env->scale + count;
+
+	for ( unsigned int i = 0; i < count; i++ ) {
+		env->time[i]  = aafRationalToDouble( gain->time[i] );
+		env->value[i] = aafRationalToDouble( gain->value[i] );
+	}
+
+	for ( unsigned int k = 0; k + 1 < count; k++ ) {
+		env->scale[k] = ( env->time[k+1] > env->time[k] ) ? 1.0 / (env->time[k+1] - env->time[k]) : 0.0;
+		env->delta[k] = env->value[k+1] - env->value[k];
+	}
+
+	env->scale[count-1] = 0.0;
+	env->delta[count-1] = 0.0;
+
+	debug( "Compiled %u points gain envelope", count );
+
+	return env;
+}
+
+
+
+/*
+ * Fills out with the envelope at samples start to start+count, over a component
+ * of length samples. Each segment is filled at once.
+ */
+
+static void envelope_eval( const struct aafiEnvelope *env, double length, aafPosition_t start, size_t count, float *out )
+{
+	const double *time = env->time;
+	unsigned int last = env->count - 1;
+
+	size_t i = 0;
+
+	while ( i < count ) {
+
+		double pos = (double)(start + (aafPosition_t)i) / length;
+
+		if ( pos >= time[last] ) {
+			envelope_hold( out + i, count - i, (float)env->value[last] );
+			break;
+		}
+
+		if ( pos < time[0] ) {
+			size_t end = envelope_firstSampleAt( time[0], length, start, i, count );
+			envelope_hold( out + i, end - i, (float)env->value[0] );
+			i = end;
+			continue;
+		}
+
+		/* segment [k, k+1] holding pos, with time[k] <= pos < time[k+1] */
+
+		unsigned int lo = 0;
+		unsigned int hi = last;
+
+		while ( hi - lo > 1 ) {
+
+			unsigned int mid = lo + (hi - lo) / 2;
+
+			if ( time[mid] <= pos ) {
+				lo = mid;
+			} else {
+				hi = mid;
+			}
+		}
+
+		size_t end = envelope_firstSampleAt( time[lo+1], length, start, i, count );
+
+		envelope_segment( env, lo, (pos - time[lo]) * env->scale[lo], env->scale[lo] / length, out + i, end - i );
+
+		i = end;
+	}
+}
+
+
+
+/*
+ * First sample index, from from to count, at or after normalized time.
+ * Always moves forward by at least one sample.
+ */
+
+static size_t envelope_firstSampleAt( double time, double length, aafPosition_t start, size_t from, size_t count )
+{
+	double index = ceil( time * length ) - (double)start;
+
+	if ( index <= (double)from ) {
+		return from + 1;
+	}
+
+	if ( index >= (double)count ) {
+		return count;
+	}
+
+	return (size_t)index;
+}
+
+
+
+/*
+ * Fills out with segment k, u0 being the position of the first sample within
+ * the segment (0 to 1) and du the distance between samples. Falling sine and
+ * exponential shapes are the rising ones, mirrored.
+ */
+
+static void envelope_segment( const struct aafiEnvelope *env, unsigned int k, double u0, double du, float *out, size_t count )
+{
+	float v0 = (float)env->value[k];
+	float v1 = (float)env->value[k+1];
+	float d  = (float)env->delta[k];
+
+	switch ( env->interpol ) {
+
+		case AAFI_INTERPOL_NONE:
+		case AAFI_INTERPOL_CONSTANT:
+			envelope_hold( out, count, v0 );
+			break;
+
+		case AAFI_INTERPOL_POWER:
+			if ( d >= 0 ) {
+				envelope_fill( out, count, ENVELOPE_SINE, u0, du, v0, d );
+			} else {
+				envelope_fill( out, count, ENVELOPE_SINE, 1.0 - u0, -du, v1, -d );
+			}
+			break;
+
+		case AAFI_INTERPOL_LOG:
+			if ( d >= 0 ) {
+				envelope_fill( out, count, ENVELOPE_EXP, u0, du, v0, d );
+			} else {
+				envelope_fill( out, count, ENVELOPE_EXP, 1.0 - u0, -du, v1, -d );
+			}
+			break;
+
+		case AAFI_INTERPOL_BSPLINE:
+			envelope_fill( out, count, ENVELOPE_SMOOTH, u0, du, v0, d );
+			break;
+
+		default:
+			envelope_fill( out, count, ENVELOPE_LINEAR, u0, du, v0, d );
+			break;
+	}
+}
+
+
+
+/*
+ * out[i] = a + b * shape(x0 + dx * i), with x clamped to [0, 1].
+ */
+
+static void envelope_fill( float *out, size_t count, enum envelopeShape shape, double x0, double dx, float a, float b )
+{
+	for ( size_t chunk = 0; chunk < count; chunk += ENVELOPE_CHUNK ) {
+
+		size_t n = ( count - chunk < ENVELOPE_CHUNK ) ? count - chunk : ENVELOPE_CHUNK;
+
+		float *dst = out + chunk;
+		float  cx0 = (float)(x0 + dx * (double)chunk);
+		float  cdx = (float)dx;
+
+		size_t i = 0;
+
+#if defined(__SSE2__)
+		const __m128 zero = _mm_setzero_ps();
+		const __m128 one  = _mm_set1_ps( 1.0f );
+		const __m128 va   = _mm_set1_ps( a );
+		const __m128 vb   = _mm_set1_ps( b );
+		const __m128 vx0  = _mm_set1_ps( cx0 );
+		const __m128 vdx  = _mm_set1_ps( cdx );
+		const __m128 four = _mm_set1_ps( 4.0f );
+
+		__m128 idx = _mm_setr_ps( 0.0f, 1.0f, 2.0f, 3.0f );
+
+		for ( ; i + 4 <= n; i += 4 ) {
+			__m128 x = _mm_add_ps( vx0, _mm_mul_ps( vdx, idx ) );
+			x = _mm_min_ps( _mm_max_ps( x, zero ), one );
+			_mm_storeu_ps( dst+i, _mm_add_ps( va, _mm_mul_ps( vb, envelope_shape_sse2( shape, x ) ) ) );
+			idx = _mm_add_ps( idx, four );
+		}
+#elif defined(__ARM_NEON)
+		const float32x4_t zero = vdupq_n_f32( 0.0f );
+		const float32x4_t one  = vdupq_n_f32( 1.0f );
+		const float32x4_t va   = vdupq_n_f32( a );
+		const float32x4_t vb   = vdupq_n_f32( b );
+		const float32x4_t vx0  = vdupq_n_f32( cx0 );
+		const float32x4_t vdx  = vdupq_n_f32( cdx );
+		const float32x4_t four = vdupq_n_f32( 4.0f );
+
+		static const float first[4] = { 0.0f, 1.0f, 2.0f, 3.0f };
+
+		float32x4_t idx = vld1q_f32( first );
+
+		for ( ; i + 4 <= n; i += 4 ) {
+			float32x4_t x = vaddq_f32( vx0, vmulq_f32( vdx, idx ) );
+			x = vminq_f32( vmaxq_f32( x, zero ), one );
+			vst1q_f32( dst+i, vaddq_f32( va, vmulq_f32( vb, envelope_shape_neon( shape, x ) ) ) );
+			idx = vaddq_f32( idx, four );
+		}
+#endif
+
+		for ( ; i < n; i++ ) {
+			float x = cx0 + cdx * (float)i;
+			x = ( x < 0.0f ) ? 0.0f : ( x > 1.0f ) ? 1.0f : x;
+			dst[i] = a + b * envelope_shape( shape, x );
+		}
+	}
+}
+
+
+
+static void envelope_hold( float *out, size_t count, float value )
+{
+	for ( size_t i = 0; i < count; i++ ) {
+		out[i] = value;
+	}
+}
+
+
+
+/*
+ * Scalar shapes, using the same approximations as the vector ones :
+ *  - sine : sin(x * pi/2)
+ *  - exp : (1000^x - 1) / 999, that is 2^(x * log2(1000)), 60 dB over the segment
+ *  - smooth : x^2 * (3 - 2x)
+ */
+
+static float envelope_shape( enum envelopeShape shape, float x )
+{
+	switch ( shape ) {
+
+		case ENVELOPE_SINE: {
+			float t  = x * ENVELOPE_HALF_PI;
+			float t2 = t * t;
+			return t * (1.0f + t2 * (SIN_C3 + t2 * (SIN_C5 + t2 * (SIN_C7 + t2 * (SIN_C9 + t2 * SIN_C11)))));
+		}
+
+		case ENVELOPE_EXP: {
+			float y = x * ENVELOPE_LOG2_1000;
+			int   n = (int)y;
+			float f = y - (float)n;
+			float p = 1.0f + f * (EXP2_C1 + f * (EXP2_C2 + f * (EXP2_C3 + f * (EXP2_C4 + f * (EXP2_C5 + f * (EXP2_C6 + f * EXP2_C7))))));
+			return (ldexpf( p, n ) - 1.0f) * (1.0f / 999.0f);
+		}
+
+		case ENVELOPE_SMOOTH:
+			return x * x * (3.0f - 2.0f * x);
+
+		default:
+			return x;
+	}
+}
+
+
+
+#if defined(__SSE2__)
+
+static __m128 envelope_shape_sse2( enum envelopeShape shape, __m128 x )
+{
+	switch ( shape ) {
+
+		case ENVELOPE_SINE: {
+			__m128 t  = _mm_mul_ps( x, _mm_set1_ps( ENVELOPE_HALF_PI ) );
+			__m128 t2 = _mm_mul_ps( t, t );
+			__m128 p  = _mm_set1_ps( SIN_C11 );
+			p = _mm_add_ps( _mm_mul_ps( p, t2 ), _mm_set1_ps( SIN_C9 ) );
+			p = _mm_add_ps( _mm_mul_ps( p, t2 ), _mm_set1_ps( SIN_C7 ) );
+			p = _mm_add_ps( _mm_mul_ps( p, t2 ), _mm_set1_ps( SIN_C5 ) );
+			p = _mm_add_ps( _mm_mul_ps( p, t2 ), _mm_set1_ps( SIN_C3 ) );
+			p = _mm_add_ps( _mm_mul_ps( p, t2 ), _mm_set1_ps( 1.0f ) );
+			return _mm_mul_ps( p, t );
+		}
+
+		case ENVELOPE_EXP: {
+			__m128  y = _mm_mul_ps( x, _mm_set1_ps( ENVELOPE_LOG2_1000 ) );
+			__m128i n = _mm_cvttps_epi32( y );
+			__m128  f = _mm_sub_ps( y, _mm_cvtepi32_ps( n ) );
+			__m128  p = _mm_set1_ps( EXP2_C7 );
+			p = _mm_add_ps( _mm_mul_ps( p, f ), _mm_set1_ps( EXP2_C6 ) );
+			p = _mm_add_ps( _mm_mul_ps( p, f ), _mm_set1_ps( EXP2_C5 ) );
+			p = _mm_add_ps( _mm_mul_ps( p, f ), _mm_set1_ps( EXP2_C4 ) );
+			p = _mm_add_ps( _mm_mul_ps( p, f ), _mm_set1_ps( EXP2_C3 ) );
+			p = _mm_add_ps( _mm_mul_ps( p, f ), _mm_set1_ps( EXP2_C2 ) );
+			p = _mm_add_ps( _mm_mul_ps( p, f ), _mm_set1_ps( EXP2_C1 ) );
+			p = _mm_add_ps( _mm_mul_ps( p, f ), _mm_set1_ps( 1.0f ) );
+			/* 2^n, built from its exponent bits */
+			__m128 scale = _mm_castsi128_ps( _mm_slli_epi32( _mm_add_epi32( n, _mm_set1_epi32( 127 ) ), 23 ) );
+			return _mm_mul_ps( _mm_sub_ps( _mm_mul_ps( p, scale ), _mm_set1_ps( 1.0f ) ), _mm_set1_ps( 1.0f / 999.0f ) );
+		}
+
+		case ENVELOPE_SMOOTH:
+			return _mm_mul_ps( _mm_mul_ps( x, x ), _mm_sub_ps( _mm_set1_ps( 3.0f ), _mm_add_ps( x, x ) ) );
+
+		default:
+			return x;
+	}
+}
+
+#elif defined(__ARM_NEON)
+
+static float32x4_t envelope_shape_neon( enum envelopeShape shape, float32x4_t x )
+{
+	switch ( shape ) {
+
+		case ENVELOPE_SINE: {
+			float32x4_t t  = vmulq_n_f32( x, ENVELOPE_HALF_PI );
+			float32x4_t t2 = vmulq_f32( t, t );
+			float32x4_t p  = vdupq_n_f32( SIN_C11 );
+			p = vmlaq_f32( vdupq_n_f32( SIN_C9 ), p, t2 );
+			p = vmlaq_f32( vdupq_n_f32( SIN_C7 ), p, t2 );
+			p = vmlaq_f32( vdupq_n_f32( SIN_C5 ), p, t2 );
+			p = vmlaq_f32( vdupq_n_f32( SIN_C3 ), p, t2 );
+			p = vmlaq_f32( vdupq_n_f32( 1.0f ),   p, t2 );
+			return vmulq_f32( p, t );
+		}
+
+		case ENVELOPE_EXP: {
+			float32x4_t y = vmulq_n_f32( x, ENVELOPE_LOG2_1000 );
+			int32x4_t   n = vcvtq_s32_f32( y );
+			float32x4_t f = vsubq_f32( y, vcvtq_f32_s32( n ) );
+			float32x4_t p = vdupq_n_f32( EXP2_C7 );
+			p = vmlaq_f32( vdupq_n_f32( EXP2_C6 ), p, f );
+			p = vmlaq_f32( vdupq_n_f32( EXP2_C5 ), p, f );
+			p = vmlaq_f32( vdupq_n_f32( EXP2_C4 ), p, f );
+			p = vmlaq_f32( vdupq_n_f32( EXP2_C3 ), p, f );
+			p = vmlaq_f32( vdupq_n_f32( EXP2_C2 ), p, f );
+			p = vmlaq_f32( vdupq_n_f32( EXP2_C1 ), p, f );
+			p = vmlaq_f32( vdupq_n_f32( 1.0f ),    p, f );
+			/* 2^n, built from its exponent bits */
+			float32x4_t scale = vreinterpretq_f32_s32( vshlq_n_s32( vaddq_s32( n, vdupq_n_s32( 127 ) ), 23 ) );
+			return vmulq_n_f32( vsubq_f32( vmulq_f32( p, scale ), vdupq_n_f32( 1.0f ) ), 1.0f / 999.0f );
+		}
+
+		case ENVELOPE_SMOOTH:
+			return vmulq_f32( vmulq_f32( x, x ), vsubq_f32( vdupq_n_f32( 3.0f ), vaddq_f32( x, x ) ) );
+
+		default:
+			return x;
+	}
+}
+
+#endif
@@ -19,6 +19,7 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
 #include <stdarg.h>
@@ -31,11 +32,16 @@
 #include <libaaf/log.h>
 
 #include <libaaf/utils.h>
+#include <libaaf/sample.h>
 #include <libaaf/MediaComposer.h>
 
 #include "RIFFParser.h"
 #include "URIParser.h"
 
+#ifdef LIBAAF_THREADS
+#include <pthread.h>
+#endif
+
 
 #define debug( ... ) \
 	AAF_LOG( aafi->log, aafi, LOG_SRC_ID_AAF_IFACE, VERB_DEBUG, __VA_ARGS__ )
@@ -51,6 +57,137 @@
 
 
 
+/*
+ * Embedded essences are extracted by chunks of at most this size, so memory use
+ * does not depend on essence size.
+ */
+#define EXTRACT_CHUNK_SIZE (4*1024*1024)
+
+/*
+ * aafi_readAudioSamples() reads embedded samples by chunks of at most this size
+ * when only some channels are selected.
+ */
+#define SAMPLE_READ_CHUNK_SIZE (256*1024)
+
+/*
+ * Resampled essences are extracted by blocks of this many output samples per
+ * channel.
+ */
+#define EXTRACT_RESAMPLE_FRAMES 16384
+
+
+/*
+ * A file written by extract_stream() from a byte range of an embedded essence
+ * stream, either a whole essence or a clip.
+ */
+struct extractOutput {
+
+	aafiAudioEssenceFile *audioEssenceFile;
+
+	char     *name;           // forced file name, essence unique_name if NULL
+	size_t    index;          // request order
+
+	uint64_t  offset;         // first byte of the range in the essence stream
+	uint64_t  length;         // range length in bytes
+	uint64_t  data_length;    // audio data length in bytes, once samples are converted
+
+	int       write_header;
+	int       extracting_clip;
+	int       isClip;
+
+	int                    convert;   // samples are converted from srcFormat to dstFormat
+	enum laafSampleFormat  srcFormat;
+	enum laafSampleFormat  dstFormat;
+
+	unsigned int  channel;    // 1-based essence channel written as a mono file, 0 for all channels interleaved
+
+	uint32_t  samplerate;     // output sample rate when samples are resampled, 0 otherwise
+	uint64_t  position;       // when resampled, first output sample, from essence start
+	uint64_t  frames;         // when resampled, output samples per channel
+
+	char     *filepath;
+	FILE     *fp;
+	uint64_t  written;
+
+	int       rc;
+};
+
+/*
+ * Outputs sharing the same essence stream, extracted in a single pass.
+ */
+struct extractGroup {
+	struct extractOutput **outputs; // sorted by offset
+	size_t                 count;
+	size_t                 index;   // lowest request order of the group outputs
+	uint64_t               bytes;   // sum of output lengths
+};
+
+/*
+ * Chunk buffer, allocated once per extraction worker and grown as needed.
+ */
+struct extractBuffer {
+	unsigned char *data;
+	uint64_t       size;
+};
+
+/*
+ * Shared state of the extraction workers. Groups are taken in order, largest
+ * first, so the longest extractions do not end up running alone at the end.
+ */
+struct extractPool {
+	AAF_Iface              *aafi;
+	struct extractGroup    *groups;
+	size_t                  count;
+	size_t                  next;
+	enum aafiExtractFormat  extractFormat;
+	const char             *outpath;
+#ifdef LIBAAF_THREADS
+	pthread_mutex_t         mutex;
+#endif
+};
+
+
+/*
+ * Audio data location of an essence, for aafi_readAudioSamples(). Embedded
+ * essences keep the extent index of their stream, external ones a read only
+ * mapping of their file.
+ */
+struct aafiSampleReader {
+	cfbStreamIndex *index;
+	unsigned char  *map;
+	uint64_t        mapSize;
+
+	uint64_t        dataOffset;   // first byte of audio data, in stream or file
+	uint64_t        frameCount;   // audio data length, in samples per channel
+	uint16_t        samplesize;   // in bytes
+	uint16_t        channels;
+	uint16_t        formatTag;    // RIFF_WAVE_FORMAT_*
+	int             swap;         // samples are big endian
+};
+
+#ifdef LIBAAF_THREADS
+/* sample readers are set on first read, which might come from any thread */
+static pthread_mutex_t sampleReaderMutex = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+
+static int extract_sampleFormats( AAF_Iface *aafi, struct extractOutput *out );
+static uint32_t extract_resampling( AAF_Iface *aafi, struct extractOutput *out );
+static unsigned int extract_splitChannels( AAF_Iface *aafi, aafiAudioEssenceFile *audioEssenceFile, int verbose );
+static int extract_setRange( AAF_Iface *aafi, struct extractOutput *out, enum aafiExtractFormat extractFormat, uint64_t sampleOffset, uint64_t sampleLength );
+static int extract_openOutput( AAF_Iface *aafi, struct extractOutput *out, enum aafiExtractFormat extractFormat, const char *outpath );
+static void extract_closeOutput( AAF_Iface *aafi, struct extractOutput *out );
+static int extract_stream( AAF_Iface *aafi, cfbStreamReader *reader, struct extractOutput **outputs, size_t count, struct extractBuffer *buffer, enum aafiExtractFormat extractFormat, const char *outpath );
+static int extract_resampled( AAF_Iface *aafi, struct extractOutput *out, struct extractBuffer *buffer, enum aafiExtractFormat extractFormat, const char *outpath );
+static int extract_groups( AAF_Iface *aafi, struct extractGroup *groups, size_t count, enum aafiExtractFormat extractFormat, const char *outpath );
+static void extract_group( AAF_Iface *aafi, struct extractGroup *group, struct extractBuffer *buffer, enum aafiExtractFormat extractFormat, const char *outpath );
+static void * extractGroupWorker( void *arg );
+static int extractOutputCmp( const void *a, const void *b );
+static int extractGroupCmp( const void *a, const void *b );
+static struct aafiSampleReader * sampleReader_get( AAF_Iface *aafi, aafiAudioEssenceFile *audioEssenceFile );
+static struct aafiSampleReader * sampleReader_open( AAF_Iface *aafi, aafiAudioEssenceFile *audioEssenceFile );
+static void sampleReader_free( struct aafiSampleReader *sr );
+static void sampleReader_select( unsigned char *dst, const unsigned char *src, uint64_t frames, uint16_t channels, uint16_t samplesize, uint64_t channelMask );
 static int set_audioEssenceWithRIFF( AAF_Iface *aafi, const char *filename, aafiAudioEssenceFile *audioEssenceFile, struct RIFFAudioFile *RIFFAudioFile, int isExternalFile );
 static size_t embeddedAudioDataReaderCallback( unsigned char *buf, size_t offset, size_t reqLen, void *user1, void *user2, void *user3 );
 static size_t externalAudioDataReaderCallback( unsigned char *buf, size_t offset, size_t reqLen, void *user1, void *user2, void *user3 );
@@ -383,17 +520,15 @@ end:
 
 int aafi_extractAudioEssenceFile( AAF_Iface *aafi, aafiAudioEssenceFile *audioEssenceFile, enum aafiExtractFormat extractFormat, const char *outpath, uint64_t sampleOffset, uint64_t sampleLength, const char *forcedFileName, char **usable_file_path )
 {
-	int   rc       = 0;
-	int   tmp      = 0;
-	FILE *fp       = NULL;
-	char *filename = NULL;
-	char *filepath = NULL;
+	int rc = 0;
+
+	cfbStreamReader reader;
 
-	int    write_header = 0;
-	int extracting_clip = 0;
+	struct extractOutput  out;
+	struct extractOutput *outp = &out;
+	struct extractBuffer  buffer = { NULL, 0 };
 
-	unsigned char *data   = NULL;
-	uint64_t       datasz = 0;
+	memset( &out, 0x00, sizeof(out) );
 
 
 	if ( audioEssenceFile->is_embedded == 0 ) {
@@ -412,253 +547,182 @@ int aafi_extractAudioEssenceFile( AAF_Iface *aafi, aafiAudioEssenceFile *audioEs
 		audioEssenceFile->usable_file_path = NULL;
 	}
 
-	uint64_t pcmByteOffset = sampleOffset * audioEssenceFile->channels * (audioEssenceFile->samplesize/8);
-	uint64_t pcmByteLength = sampleLength * audioEssenceFile->channels * (audioEssenceFile->samplesize/8);
-
-
-	/* Retrieve stream from CFB */
-
-	cfb_getStream( aafi->aafd->cfbd, audioEssenceFile->node, &data, &datasz );
-
-	if ( data == NULL ) {
-		error( "Could not retrieve audio essence stream from CFB" );
-		goto err;
-	}
-
-
-	/* Calculate offset and length */
-
-	debug( "Requesting extract of essence \"%s\"", audioEssenceFile->name );
-	debug( " -    ReqSampleOffset: %"PRIu64" samples (%"PRIu64" bytes)", sampleOffset, pcmByteOffset );
-	debug( " -    ReqSampleLength: %"PRIu64" samples (%"PRIu64" bytes)", sampleLength, pcmByteLength );
-	debug( " -   FileHeaderOffset: %"PRIu64" bytes (0x%04"PRIx64")",
-		audioEssenceFile->pcm_audio_start_offset,
-		audioEssenceFile->pcm_audio_start_offset );
-	debug( " - EssenceTotalLength: %"PRIu64" bytes", datasz );
+	if ( forcedFileName ) {
 
-	uint64_t sourceFileOffset = 0;
+		out.name = laaf_util_c99strdup( forcedFileName );
 
-	if ( pcmByteOffset ||
-	     pcmByteLength ||
-	     extractFormat != AAFI_EXTRACT_DEFAULT )
-	{
-		if ( audioEssenceFile->type != AAFI_ESSENCE_TYPE_PCM ) {
-			sourceFileOffset += audioEssenceFile->pcm_audio_start_offset;
+		if ( !out.name ) {
+			error( "Could not duplicate filename : %s", forcedFileName );
+			goto err;
 		}
-		write_header = 1;
 	}
 
-	if ( pcmByteOffset || pcmByteLength ) {
-		extracting_clip = 1;
-	}
-
-	sourceFileOffset += pcmByteOffset;
+	out.audioEssenceFile = audioEssenceFile;
 
-
-	if ( (datasz - audioEssenceFile->pcm_audio_start_offset) < (pcmByteLength + sourceFileOffset) ) {
-		error( "Requested audio range (%"PRIi64" bytes) is bigger than source audio size (%"PRIu64" bytes)",
-			(pcmByteLength + sourceFileOffset),
-			datasz - audioEssenceFile->pcm_audio_start_offset );
+	if ( extract_setRange( aafi, &out, extractFormat, sampleOffset, sampleLength ) < 0 ) {
 		goto err;
 	}
 
-	datasz = (pcmByteLength) ? pcmByteLength : (datasz-sourceFileOffset);
+	if ( cfb_openStream( aafi->aafd->cfbd, audioEssenceFile->node, &reader ) < 0 ) {
+		error( "Could not retrieve audio essence stream from CFB" );
+		goto err;
+	}
 
-	if ( datasz >= (uint32_t)-1 ) {
-		error( "Audio essence is bigger than maximum wav file size (2^32 bytes) : %"PRIu64" bytes", datasz );
+	if ( extract_stream( aafi, &reader, &outp, 1, &buffer, extractFormat, outpath ) < 0 ) {
 		goto err;
 	}
 
-	debug( " -  Calculated Offset: %"PRIu64" bytes", sourceFileOffset );
-	debug( " -  Calculated Length: %"PRIu64" bytes", datasz );
+	if ( usable_file_path ) {
+		*usable_file_path = laaf_util_c99strdup( out.filepath );
 
-	if ( audioEssenceFile->type != AAFI_ESSENCE_TYPE_PCM ) {
-		if ( !write_header ) {
-			debug( "Writting exact copy of embedded file." );
-		} else {
-			debug( "Rewriting file header." );
+		if ( !(*usable_file_path) ) {
+			error( "Could not duplicate usable filepath : %s", out.filepath );
+			goto err;
 		}
 	}
 
+	rc = 0;
+	goto end;
 
-	/* Build file path */
-	const char *name = NULL;
+err:
+	rc = -1;
 
-	if ( forcedFileName ) {
-		name = forcedFileName;
-	} else {
-		name = audioEssenceFile->unique_name;
-	}
+end:
+	free( out.name );
+	free( out.filepath );
+	free( buffer.data );
 
-	const char *fileext = NULL;
+	return rc;
+}
 
-	if ( write_header ||
-	     audioEssenceFile->type == AAFI_ESSENCE_TYPE_WAVE ||
-	     audioEssenceFile->type == AAFI_ESSENCE_TYPE_PCM )
-	{
-		if ( !laaf_util_is_fileext( name, "wav"  ) &&
-		     !laaf_util_is_fileext( name, "wave" ) )
-		{
-			fileext = "wav";
-		}
-	}
-	else if ( !write_header &&
-	           audioEssenceFile->type == AAFI_ESSENCE_TYPE_AIFC )
-	{
-		if ( !laaf_util_is_fileext( name, "aif"  ) &&
-		     !laaf_util_is_fileext( name, "aiff" ) &&
-		     !laaf_util_is_fileext( name, "aifc" ) )
-		{
-			fileext = "aif";
-		}
-	}
 
 
-	if ( fileext ) {
-		if ( laaf_util_snprintf_realloc( &filename, NULL, 0, "%s.%s", name, fileext ) < 0 ) {
-			error( "Could not concat filename + fileext" );
-			goto err;
-		}
-	}
-	else {
-		filename = laaf_util_c99strdup( name );
+int aafi_extractAudioEssenceFiles( AAF_Iface *aafi, aafiAudioEssenceFile **audioEssenceFiles, size_t count, enum aafiExtractFormat extractFormat, const char *outpath )
+{
+	int rc = 0;
 
-		if ( !filename ) {
-			error( "Could not duplicate filename : %s", name );
-			goto err;
-		}
-	}
+	size_t outputCount = 0;
+	size_t groupCount  = 0;
 
+	struct extractOutput   *outputs = NULL;
+	struct extractOutput  **sorted  = NULL;
+	struct extractGroup    *groups  = NULL;
 
-	filepath = laaf_util_build_path( DIR_SEP_STR, outpath, laaf_util_clean_filename(filename), NULL );
 
-	if ( !filepath ) {
-		error( "Could not build filepath." );
-		goto err;
+	if ( !outpath ) {
+		error( "Missing output path" );
+		return -1;
+	}
+
+	if ( !count ) {
+		return 0;
 	}
 
+	for ( size_t i = 0; i < count; i++ ) {
+		unsigned int split = extract_splitChannels( aafi, audioEssenceFiles[i], 0 );
+		outputCount += ( split ) ? split : 1;
+	}
 
-	fp = fopen( filepath, "wb" );
+	outputs = calloc( outputCount, sizeof(struct extractOutput) );
+	sorted  = calloc( outputCount, sizeof(struct extractOutput*) );
+	groups  = calloc( count, sizeof(struct extractGroup) );
 
-	if ( !fp ) {
-		error( "Could not open '%s' for writing : %s", filepath, strerror(errno) );
+	if ( !outputs || !sorted || !groups ) {
+		error( "Out of memory" );
 		goto err;
 	}
 
 
-	if ( write_header ||
-	     audioEssenceFile->type == AAFI_ESSENCE_TYPE_PCM )
-	{
-		struct wavFmtChunk wavFmt;
-		wavFmt.channels = audioEssenceFile->channels;
-		wavFmt.samples_per_sec = audioEssenceFile->samplerate;
-		wavFmt.bits_per_sample = audioEssenceFile->samplesize;
-
-		struct wavBextChunk wavBext;
-		memset( &wavBext, 0x00, sizeof(wavBext) );
+	/* One output per essence, or per essence channel, all of an essence making a group */
 
-		memcpy( wavBext.umid, audioEssenceFile->sourceMobID, sizeof(aafMobID_t) );
+	size_t n = 0;
 
-		tmp = snprintf( wavBext.originator, sizeof(((struct wavBextChunk *)0)->originator), "%s %s", aafi->aafd->Identification.ProductName, (mediaComposer_AAF(aafi)) ? "" : aafi->aafd->Identification.ProductVersionString );
+	for ( size_t i = 0; i < count; i++ ) {
 
-		assert( tmp > 0 && (size_t)tmp < sizeof(((struct wavBextChunk *)0)->originator) );
+		aafiAudioEssenceFile *audioEssenceFile = audioEssenceFiles[i];
 
-		tmp = snprintf( wavBext.originator_reference, sizeof(((struct wavBextChunk *)0)->originator_reference), "libAAF %s", LIBAAF_VERSION );
+		/*
+		 * An essence listed twice would make two groups writing the same file and
+		 * setting the same usable_file_path, possibly from two threads at once.
+		 */
+		size_t prev = 0;
 
-		assert( tmp > 0 && (size_t)tmp < sizeof(((struct wavBextChunk *)0)->originator_reference) );
+		while ( prev < i && audioEssenceFiles[prev] != audioEssenceFile ) {
+			prev++;
+		}
 
-		tmp = snprintf( wavBext.description, sizeof(((struct wavBextChunk *)0)->description), "%s\n%s.aaf", audioEssenceFile->name, aafi->compositionName );
+		if ( prev < i ) {
+			debug( "Skipping essence \"%s\" listed more than once", audioEssenceFile->unique_name );
+			continue;
+		}
 
-		assert( tmp > 0 && (size_t)tmp < sizeof(((struct wavBextChunk *)0)->description) );
+		unsigned int split = extract_splitChannels( aafi, audioEssenceFile, 1 );
+		unsigned int outs  = ( split ) ? split : 1;
 
-		memcpy( wavBext.origination_date, audioEssenceFile->originationDate, sizeof(((struct wavBextChunk *)0)->origination_date) );
-		memcpy( wavBext.origination_time, audioEssenceFile->originationTime, sizeof(((struct wavBextChunk *)0)->origination_time) );
+		struct extractGroup *group = &groups[groupCount++];
 
-		wavBext.time_reference = aafi_convertUnitUint64( audioEssenceFile->sourceMobSlotOrigin, audioEssenceFile->sourceMobSlotEditRate, audioEssenceFile->samplerateRational );
+		group->outputs = &sorted[n];
+		group->count = outs;
+		group->index = i;
 
-		if ( laaf_riff_writeWavFileHeader( fp, &wavFmt, (extractFormat != AAFI_EXTRACT_WAV) ? &wavBext : NULL, (uint32_t)datasz, aafi->log ) < 0 ) {
-			error( "Could not write wav audio header : %s", filepath );
-			goto err;
+		if ( audioEssenceFile->usable_file_path ) {
+			debug( "usable_file_path was already set" );
+			free( audioEssenceFile->usable_file_path );
+			audioEssenceFile->usable_file_path = NULL;
 		}
-	}
-
 
-	uint64_t writtenBytes = 0;
+		for ( unsigned int c = 0; c < outs; c++ ) {
 
-	if ( write_header && audioEssenceFile->type == AAFI_ESSENCE_TYPE_AIFC && audioEssenceFile->samplesize > 8 ) {
+			struct extractOutput *out = &outputs[n];
 
-		unsigned char sample[4];
-		uint16_t samplesize = (audioEssenceFile->samplesize>>3);
+			sorted[n++] = out;
 
-		for ( uint64_t i = 0; i < datasz; i += samplesize ) {
+			out->index = i;
+			out->audioEssenceFile = audioEssenceFile;
+			out->channel = ( split ) ? c+1 : 0;
 
-			if ( samplesize == 2 ) {
-		 		sample[0] = *(unsigned char*)(data+pcmByteOffset+i+1);
-				sample[1] = *(unsigned char*)(data+pcmByteOffset+i);
-			}
-			else if ( samplesize == 3 ) {
-				sample[0] = *(unsigned char*)(data+pcmByteOffset+i+2);
-				sample[1] = *(unsigned char*)(data+pcmByteOffset+i+1);
-				sample[2] = *(unsigned char*)(data+pcmByteOffset+i);
-			}
-			else if ( samplesize == 4 ) {
-				sample[0] = *(unsigned char*)(data+pcmByteOffset+i+3);
-				sample[1] = *(unsigned char*)(data+pcmByteOffset+i+2);
-				sample[2] = *(unsigned char*)(data+pcmByteOffset+i+1);
-				sample[3] = *(unsigned char*)(data+pcmByteOffset+i);
+			if ( audioEssenceFile->is_embedded == 0 ) {
+				error( "Audio essence is not embedded : nothing to extract" );
+				out->rc = -1;
+				continue;
 			}
 
-			writtenBytes += fwrite( sample, samplesize, 1, fp );
-		}
-
-		writtenBytes *= samplesize;
-	}
-	else {
-		writtenBytes = fwrite( data+sourceFileOffset, sizeof(unsigned char), datasz, fp );
-	}
-
-	if ( writtenBytes < datasz ) {
-		error( "Could not write audio file (%"PRIu64" bytes written out of %"PRIu64" bytes) : %s", writtenBytes, datasz, filepath );
-		goto err;
-	}
+			if ( out->channel && laaf_util_snprintf_realloc( &out->name, NULL, 0, "%s_%u", audioEssenceFile->unique_name, out->channel ) < 0 ) {
+				error( "Could not build channel file name" );
+				out->rc = -1;
+				continue;
+			}
 
-	if ( !extracting_clip ) {
-		/*
-		 * Set audioEssenceFile->usable_file_path only if we axtract essence, not if we
-		 * extract clip (subset of an essence), as a single essence can have multiple
-		 * clips using it. Otherwise, we would reset audioEssenceFile->usable_file_path
-		 * as many times as there are clips using the same essence.
-		 */
-		audioEssenceFile->usable_file_path = laaf_util_c99strdup( filepath );
+			if ( extract_setRange( aafi, out, extractFormat, 0, 0 ) < 0 ) {
+				out->rc = -1;
+				continue;
+			}
 
-		if ( !audioEssenceFile->usable_file_path ) {
-			error( "Could not duplicate usable filepath : %s", filepath );
-			goto err;
+			/* all channels come from a single pass over the stream */
+			if ( c == 0 ) {
+				group->bytes = out->length;
+			}
 		}
 	}
 
-	if ( usable_file_path ) {
-		*usable_file_path = laaf_util_c99strdup( filepath );
-
-		if ( !(*usable_file_path) ) {
-			error( "Could not duplicate usable filepath : %s", filepath );
-			goto err;
-		}
-	}
+	rc = extract_groups( aafi, groups, groupCount, extractFormat, outpath );
 
-	rc = 0;
 	goto end;
 
 err:
 	rc = -1;
 
 end:
-	free( filename );
-	free( filepath );
-	free( data );
+	if ( outputs ) {
+		for ( size_t i = 0; i < outputCount; i++ ) {
+			free( outputs[i].name );
+			free( outputs[i].filepath );
+		}
+	}
 
-	if ( fp )
-		fclose( fp );
+	free( outputs );
+	free( sorted );
+	free( groups );
 
 	return rc;
 }
@@ -667,87 +731,1602 @@ end:
 
 int aafi_extractAudioClip( AAF_Iface *aafi, aafiAudioClip *audioClip, enum aafiExtractFormat extractFormat, const char *outpath )
 {
-	int rc = 0;
-
-	for ( aafiAudioEssencePointer *audioEssencePtr = audioClip->essencePointerList; audioEssencePtr; audioEssencePtr = audioEssencePtr->next ) {
+	return aafi_extractAudioClips( aafi, &audioClip, 1, extractFormat, outpath );
+}
 
-		aafiAudioEssenceFile *audioEssenceFile = audioClip->essencePointerList->essenceFile;
 
-		uint64_t sampleOffset = aafi_convertUnitUint64( audioClip->essence_offset, audioClip->track->edit_rate, audioEssenceFile->samplerateRational );
-		uint64_t sampleLength = aafi_convertUnitUint64( audioClip->len,            audioClip->track->edit_rate, audioEssenceFile->samplerateRational );
 
-		char *name = NULL;
-		char *usable_file_path = NULL;
+int aafi_extractAudioClips( AAF_Iface *aafi, aafiAudioClip **audioClips, size_t clipCount, enum aafiExtractFormat extractFormat, const char *outpath )
+{
+	int rc = 0;
 
-		laaf_util_snprintf_realloc( &name, NULL, 0, "%i_%i_%s", audioClip->track->number, aafi_get_clipIndex(audioClip), audioClip->essencePointerList->essenceFile->unique_name );
+	size_t outputCount = 0;
+	size_t groupCount  = 0;
 
-		if ( (rc += aafi_extractAudioEssenceFile( aafi, audioEssenceFile, extractFormat, outpath, sampleOffset, sampleLength, name, &usable_file_path )) == 0 ) {
-			success( "Audio clip file extracted to %s\"%s\"%s",
-				ANSI_COLOR_DARKGREY(aafi->log),
-				usable_file_path,
-				ANSI_COLOR_RESET(aafi->log) );
-		}
-		else {
-			error( "Audio clip file extraction failed : %s\"%s\"%s", ANSI_COLOR_DARKGREY(aafi->log), name, ANSI_COLOR_RESET(aafi->log) );
-		}
+	struct extractOutput   *outputs = NULL;
+	struct extractOutput  **sorted  = NULL;
+	struct extractGroup    *groups  = NULL;
 
-		free( usable_file_path );
-		free( name );
 
-		usable_file_path = NULL;
-		name = NULL;
+	if ( !outpath ) {
+		error( "Missing output path" );
+		return -1;
 	}
 
-	return rc;
-}
+	for ( size_t i = 0; i < clipCount; i++ ) {
 
+		aafiAudioEssencePointer *audioEssencePtr = NULL;
 
-
-static int set_audioEssenceWithRIFF( AAF_Iface *aafi, const char *filename, aafiAudioEssenceFile *audioEssenceFile, struct RIFFAudioFile *RIFFAudioFile, int isExternalFile )
-{
-	if ( RIFFAudioFile->sampleCount >= INT64_MAX ) {
-		error( "%s : summary sample count is bigger than INT64_MAX (%"PRIu64")", audioEssenceFile->usable_file_path, RIFFAudioFile->sampleCount );
-		return -1;
+		AAFI_foreachEssencePointer( audioClips[i]->essencePointerList, audioEssencePtr ) {
+			unsigned int split = extract_splitChannels( aafi, audioEssencePtr->essenceFile, 0 );
+			outputCount += ( split && !audioEssencePtr->essenceChannel ) ? split : 1;
+		}
 	}
 
-	if ( RIFFAudioFile->sampleRate >= INT_MAX ) {
-		error( "%s : summary sample rate is bigger than INT_MAX (%li)", audioEssenceFile->usable_file_path, RIFFAudioFile->sampleRate );
-		return -1;
+	if ( !outputCount ) {
+		return 0;
 	}
 
-	if ( audioEssenceFile->channels > 0 && audioEssenceFile->channels != RIFFAudioFile->channels ) {
-		warning( "%s : summary channel count (%i) mismatch %s (%i)", filename, audioEssenceFile->channels, ((isExternalFile) ? "located file" : "previously retrieved data"), RIFFAudioFile->channels );
-	}
+	outputs = calloc( outputCount, sizeof(struct extractOutput) );
+	sorted  = calloc( outputCount, sizeof(struct extractOutput*) );
+	groups  = calloc( outputCount, sizeof(struct extractGroup) );
 
-	if ( audioEssenceFile->samplerate > 0 && audioEssenceFile->samplerate != RIFFAudioFile->sampleRate ) {
-		warning( "%s : summary samplerate (%i) mismatch %s (%i)", filename, audioEssenceFile->samplerate, ((isExternalFile) ? "located file" : "previously retrieved data"), RIFFAudioFile->sampleRate );
+	if ( !outputs || !sorted || !groups ) {
+		error( "Out of memory" );
+		goto err;
 	}
 
-	if ( audioEssenceFile->samplesize > 0 && audioEssenceFile->samplesize != RIFFAudioFile->sampleSize ) {
-		warning( "%s : summary samplesize (%i) mismatch %s (%i)", filename , audioEssenceFile->samplesize, ((isExternalFile) ? "located file" : "previously retrieved data"), RIFFAudioFile->sampleSize );
-	}
 
-	if ( audioEssenceFile->length > 0 && (uint64_t)audioEssenceFile->length != RIFFAudioFile->sampleCount ) {
-		warning( "%s : summary samplecount (%"PRIi64") mismatch %s (%"PRIi64")", filename , audioEssenceFile->length, ((isExternalFile) ? "located file" : "previously retrieved data"), RIFFAudioFile->sampleCount );
-	}
+	/*
+	 * One output per clip essence pointer, each one cutting a range of its essence
+	 * stream. When splitting channels, one output per channel the pointer uses.
+	 */
 
-	audioEssenceFile->channels   = RIFFAudioFile->channels;
-	audioEssenceFile->samplerate = RIFFAudioFile->sampleRate;
-	audioEssenceFile->samplesize = RIFFAudioFile->sampleSize;
+	size_t n = 0;
 
-	audioEssenceFile->length = (aafPosition_t)RIFFAudioFile->sampleCount;
-	audioEssenceFile->pcm_audio_start_offset = (uint64_t)RIFFAudioFile->pcm_audio_start_offset;
-	audioEssenceFile->samplerateRational->numerator = (int32_t)audioEssenceFile->samplerate;
+	for ( size_t i = 0; i < clipCount; i++ ) {
 
-	audioEssenceFile->samplerateRational->denominator = 1;
+		aafiAudioClip *audioClip = audioClips[i];
+		aafiAudioEssencePointer *audioEssencePtr = NULL;
 
+		AAFI_foreachEssencePointer( audioClip->essencePointerList, audioEssencePtr ) {
 
-	return 0;
-}
+			aafiAudioEssenceFile *audioEssenceFile = audioEssencePtr->essenceFile;
 
+			unsigned int split = extract_splitChannels( aafi, audioEssenceFile, 1 );
+			unsigned int outs  = ( split && !audioEssencePtr->essenceChannel ) ? split : 1;
 
+			for ( unsigned int c = 0; c < outs; c++ ) {
 
-int aafi_parse_audio_essence( AAF_Iface *aafi, aafiAudioEssenceFile *audioEssenceFile )
+				struct extractOutput *out = &outputs[n];
+
+				sorted[n] = out;
+
+				out->index = n++;
+				out->audioEssenceFile = audioEssenceFile;
+				out->isClip = 1;
+
+				if ( split ) {
+					out->channel = ( audioEssencePtr->essenceChannel ) ? audioEssencePtr->essenceChannel : c+1;
+				}
+
+				if ( out->channel > split ) {
+					error( "Clip essence pointer channel %u is out of essence \"%s\" channels", out->channel, audioEssenceFile->unique_name );
+					out->rc = -1;
+					continue;
+				}
+
+				int tmp = ( out->channel )
+					? laaf_util_snprintf_realloc( &out->name, NULL, 0, "%i_%i_%s_%u", audioClip->track->number, aafi_get_clipIndex(audioClip), audioEssenceFile->unique_name, out->channel )
+					: laaf_util_snprintf_realloc( &out->name, NULL, 0, "%i_%i_%s", audioClip->track->number, aafi_get_clipIndex(audioClip), audioEssenceFile->unique_name );
+
+				if ( tmp < 0 ) {
+					error( "Could not build clip file name" );
+					out->rc = -1;
+					continue;
+				}
+
+				if ( audioEssenceFile->is_embedded == 0 ) {
+					error( "Audio essence is not embedded : nothing to extract" );
+					out->rc = -1;
+					continue;
+				}
+
+				uint64_t sampleOffset = aafi_convertUnitUint64( audioClip->essence_offset, audioClip->track->edit_rate, audioEssenceFile->samplerateRational );
+				uint64_t sampleLength = aafi_convertUnitUint64( audioClip->len,            audioClip->track->edit_rate, audioEssenceFile->samplerateRational );
+
+				if ( sampleLength == 0 ) {
+					error( "Audio clip has no length" );
+					out->rc = -1;
+					continue;
+				}
+
+				if ( extract_setRange( aafi, out, extractFormat, sampleOffset, sampleLength ) < 0 ) {
+					out->rc = -1;
+					continue;
+				}
+
+				if ( out->samplerate ) {
+					/* clip range goes straight from edit rate to output rate, without rounding to essence samples */
+					aafRational_t rate = { (int32_t)out->samplerate, 1 };
+
+					out->position = aafi_convertUnitUint64( audioClip->essence_offset, audioClip->track->edit_rate, &rate );
+					out->frames = aafi_convertUnitUint64( audioClip->len, audioClip->track->edit_rate, &rate );
+					out->data_length = out->frames * ( ( out->channel ) ? 1 : audioEssenceFile->channels ) * laaf_sample_format_size( out->dstFormat );
+				}
+			}
+		}
+	}
+
+
+	/*
+	 * Ranges are grouped by essence and sorted by offset, so each essence stream
+	 * is read only once, sequentially.
+	 */
+
+	qsort( sorted, outputCount, sizeof(struct extractOutput*), extractOutputCmp );
+
+	for ( size_t i = 0; i < outputCount; i++ ) {
+
+		if ( i == 0 || sorted[i]->audioEssenceFile != sorted[i-1]->audioEssenceFile ) {
+			groups[groupCount].outputs = &sorted[i];
+			groups[groupCount].index = sorted[i]->index;
+			groupCount++;
+		}
+
+		struct extractGroup *group = &groups[groupCount-1];
+
+		group->count++;
+		group->bytes += sorted[i]->length;
+
+		if ( sorted[i]->index < group->index ) {
+			group->index = sorted[i]->index;
+		}
+	}
+
+	rc = extract_groups( aafi, groups, groupCount, extractFormat, outpath );
+
+	goto end;
+
+err:
+	rc = -1;
+
+end:
+	if ( outputs ) {
+		for ( size_t i = 0; i < outputCount; i++ ) {
+			free( outputs[i].name );
+			free( outputs[i].filepath );
+		}
+	}
+
+	free( outputs );
+	free( sorted );
+	free( groups );
+
+	return rc;
+}
+
+
+
+uint64_t aafi_readAudioSamples( AAF_Iface *aafi, aafiAudioEssenceFile *audioEssenceFile, uint64_t sampleOffset, uint64_t frameCount, uint64_t channelMask, void *buf )
+{
+	if ( !aafi || !audioEssenceFile || !buf ) {
+		return 0;
+	}
+
+	struct aafiSampleReader *sr = sampleReader_get( aafi, audioEssenceFile );
+
+	if ( !sr || sampleOffset >= sr->frameCount ) {
+		return 0;
+	}
+
+	if ( frameCount > sr->frameCount - sampleOffset ) {
+		frameCount = sr->frameCount - sampleOffset;
+	}
+
+
+	/* channels past the 64th can only be read with all others */
+
+	uint64_t allChannels = ( sr->channels >= 64 ) ? UINT64_MAX : ((uint64_t)1 << sr->channels) - 1;
+
+	int readAll = ( channelMask == 0 || ( sr->channels <= 64 && (channelMask & allChannels) == allChannels ) );
+
+	unsigned int selected = sr->channels;
+
+	if ( !readAll ) {
+
+		channelMask &= allChannels;
+		selected = 0;
+
+		for ( uint16_t c = 0; c < sr->channels && c < 64; c++ ) {
+			selected += (unsigned int)((channelMask >> c) & 1);
+		}
+
+		if ( selected == 0 ) {
+			error( "No channel of essence \"%s\" selected by channel mask", audioEssenceFile->unique_name );
+			return 0;
+		}
+	}
+
+	unsigned char *out = buf;
+
+	uint64_t frameSize    = (uint64_t)sr->samplesize * sr->channels;
+	uint64_t outFrameSize = (uint64_t)sr->samplesize * selected;
+	uint64_t offset       = sr->dataOffset + sampleOffset * frameSize;
+
+	uint64_t done = 0;
+
+
+	if ( sr->map ) {
+
+		if ( readAll ) {
+			memcpy( out, sr->map + offset, frameCount * frameSize );
+		}
+		else {
+			sampleReader_select( out, sr->map + offset, frameCount, sr->channels, sr->samplesize, channelMask );
+		}
+
+		done = frameCount;
+	}
+	else {
+
+		cfbStreamReader reader;
+
+		if ( cfb_openStream( aafi->aafd->cfbd, audioEssenceFile->node, &reader ) < 0 ) {
+			error( "Could not open stream of essence \"%s\"", audioEssenceFile->unique_name );
+			return 0;
+		}
+
+		reader.index = sr->index;
+
+		if ( cfb_seekStream( &reader, offset ) < 0 ) {
+			error( "Could not seek to %"PRIu64" in stream of essence \"%s\"", offset, audioEssenceFile->unique_name );
+			return 0;
+		}
+
+		if ( readAll ) {
+			done = cfb_readStream( &reader, out, frameCount * frameSize ) / frameSize;
+		}
+		else {
+
+			uint64_t chunkFrames = ( frameSize < SAMPLE_READ_CHUNK_SIZE ) ? SAMPLE_READ_CHUNK_SIZE / frameSize : 1;
+
+			if ( chunkFrames > frameCount ) {
+				chunkFrames = frameCount;
+			}
+
+			unsigned char *chunk = malloc( chunkFrames * frameSize );
+
+			if ( !chunk ) {
+				error( "Out of memory" );
+				return 0;
+			}
+
+			while ( done < frameCount ) {
+
+				uint64_t frames = ( frameCount - done < chunkFrames ) ? frameCount - done : chunkFrames;
+				uint64_t read = cfb_readStream( &reader, chunk, frames * frameSize ) / frameSize;
+
+				sampleReader_select( out + done * outFrameSize, chunk, read, sr->channels, sr->samplesize, channelMask );
+
+				done += read;
+
+				if ( read < frames ) {
+					break;
+				}
+			}
+
+			free( chunk );
+		}
+
+		if ( done < frameCount ) {
+			error( "Could only read %"PRIu64" of %"PRIu64" samples from stream of essence \"%s\"", done, frameCount, audioEssenceFile->unique_name );
+		}
+	}
+
+	if ( sr->swap ) {
+		laaf_sample_swap_bytes( out, done * outFrameSize, sr->samplesize );
+	}
+
+	return done;
+}
+
+
+
+int aafi_getAudioSampleInfo( AAF_Iface *aafi, aafiAudioEssenceFile *audioEssenceFile, uint16_t *channels, uint16_t *samplesize, uint64_t *frameCount )
+{
+	if ( !aafi || !audioEssenceFile ) {
+		return -1;
+	}
+
+	struct aafiSampleReader *sr = sampleReader_get( aafi, audioEssenceFile );
+
+	if ( !sr ) {
+		return -1;
+	}
+
+	if ( channels ) {
+		*channels = sr->channels;
+	}
+
+	if ( samplesize ) {
+		*samplesize = (uint16_t)(sr->samplesize * 8);
+	}
+
+	if ( frameCount ) {
+		*frameCount = sr->frameCount;
+	}
+
+	return 0;
+}
+
+
+
+int aafi_getAudioSampleFormat( AAF_Iface *aafi, aafiAudioEssenceFile *audioEssenceFile, enum laafSampleFormat *format )
+{
+	if ( !aafi || !audioEssenceFile || !format ) {
+		return -1;
+	}
+
+	struct aafiSampleReader *sr = sampleReader_get( aafi, audioEssenceFile );
+
+	if ( !sr ) {
+		return -1;
+	}
+
+	return laaf_riff_sampleFormat( sr->formatTag, (uint16_t)(sr->samplesize * 8), format );
+}
+
+
+
+void aafi_freeSampleReader( aafiAudioEssenceFile *audioEssenceFile )
+{
+	if ( !audioEssenceFile ) {
+		return;
+	}
+
+	sampleReader_free( audioEssenceFile->sampleReader );
+
+	audioEssenceFile->sampleReader = NULL;
+}
+
+
+
+/*
+ * Sets the output sample formats from the "extract_sample_format" option.
+ * Returns 1 if a sample format applies to the essence, which is then always
+ * written as a WAVE file, 0 if samples are extracted as stored. Samples are
+ * only converted if stored and requested formats differ.
+ */
+
+static int extract_sampleFormats( AAF_Iface *aafi, struct extractOutput *out )
+{
+	aafiAudioEssenceFile *audioEssenceFile = out->audioEssenceFile;
+
+	out->convert = 0;
+
+	switch ( aafi->ctx.options.extract_sample_format ) {
+		case AAFI_SAMPLE_FORMAT_S16: out->dstFormat = LAAF_SAMPLE_S16; break;
+		case AAFI_SAMPLE_FORMAT_S24: out->dstFormat = LAAF_SAMPLE_S24; break;
+		case AAFI_SAMPLE_FORMAT_S32: out->dstFormat = LAAF_SAMPLE_S32; break;
+		case AAFI_SAMPLE_FORMAT_F32: out->dstFormat = LAAF_SAMPLE_F32; break;
+		default: return 0;
+	}
+
+	if ( audioEssenceFile->type == AAFI_ESSENCE_TYPE_UNK ) {
+		warning( "Essence \"%s\" is not PCM : extracting samples as they are stored", audioEssenceFile->unique_name );
+		return 0;
+	}
+
+	if ( laaf_riff_sampleFormat( audioEssenceFile->formatTag, audioEssenceFile->samplesize, &out->srcFormat ) < 0 ) {
+		warning( "Can't convert %u bits samples of format 0x%04x of essence \"%s\" : extracting samples as they are stored", audioEssenceFile->samplesize, audioEssenceFile->formatTag, audioEssenceFile->unique_name );
+		return 0;
+	}
+
+	out->convert = ( out->srcFormat != out->dstFormat );
+
+	return 1;
+}
+
+
+
+/*
+ * Returns the sample rate essence samples are resampled to when the
+ * "extract_samplerate" option is set and differs from essence rate, 0 if they
+ * are extracted as they are. Resampled samples keep the essence sample size,
+ * unless "extract_sample_format" is set.
+ */
+
+static uint32_t extract_resampling( AAF_Iface *aafi, struct extractOutput *out )
+{
+	aafiAudioEssenceFile *audioEssenceFile = out->audioEssenceFile;
+
+	uint32_t samplerate = 0;
+
+	if ( aafi->ctx.options.extract_samplerate > 0 ) {
+		samplerate = (uint32_t)aafi->ctx.options.extract_samplerate;
+	}
+	else if ( aafi->ctx.options.extract_samplerate == -1 && aafi->Audio ) {
+		samplerate = aafi->Audio->samplerate;
+	}
+
+	if ( samplerate == 0 ) {
+		return 0;
+	}
+
+	aafRational_t *rate = audioEssenceFile->samplerateRational;
+
+	if ( rate && rate->denominator > 0 && (uint64_t)rate->numerator == (uint64_t)samplerate * (uint64_t)rate->denominator ) {
+		return 0;
+	}
+
+	if ( !rate || rate->numerator <= 0 || rate->denominator <= 0 ) {
+		warning( "Essence \"%s\" has no sample rate : extracting samples at their rate", audioEssenceFile->unique_name );
+		return 0;
+	}
+
+	if ( audioEssenceFile->type == AAFI_ESSENCE_TYPE_UNK ) {
+		warning( "Essence \"%s\" is not PCM : extracting samples at their rate", audioEssenceFile->unique_name );
+		return 0;
+	}
+
+	if ( laaf_riff_sampleFormat( audioEssenceFile->formatTag, audioEssenceFile->samplesize, &out->srcFormat ) < 0 ) {
+		warning( "Can't resample %u bits samples of format 0x%04x of essence \"%s\" : extracting samples at their rate", audioEssenceFile->samplesize, audioEssenceFile->formatTag, audioEssenceFile->unique_name );
+		return 0;
+	}
+
+	if ( aafi->ctx.options.extract_sample_format == AAFI_SAMPLE_FORMAT_DEFAULT ) {
+		out->dstFormat = out->srcFormat;
+	}
+
+	/* samples always go through float, and are written back from it */
+	out->convert = 1;
+
+	return samplerate;
+}
+
+
+
+/*
+ * Returns the number of mono files a multichannel essence is split into when
+ * the "extract_split_channels" option is set, 0 if the essence is extracted
+ * with its channels interleaved.
+ */
+
+static unsigned int extract_splitChannels( AAF_Iface *aafi, aafiAudioEssenceFile *audioEssenceFile, int verbose )
+{
+	if ( !aafi->ctx.options.extract_split_channels ||
+	     !audioEssenceFile->is_embedded ||
+	      audioEssenceFile->channels < 2 )
+	{
+		return 0;
+	}
+
+	if ( audioEssenceFile->type == AAFI_ESSENCE_TYPE_UNK ) {
+		if ( verbose ) {
+			warning( "Essence \"%s\" is not PCM : extracting channels interleaved", audioEssenceFile->unique_name );
+		}
+		return 0;
+	}
+
+	if ( audioEssenceFile->samplesize == 0 || audioEssenceFile->samplesize > 32 || audioEssenceFile->samplesize % 8 ) {
+		if ( verbose ) {
+			warning( "Can't split %u bits samples of essence \"%s\" : extracting channels interleaved", audioEssenceFile->samplesize, audioEssenceFile->unique_name );
+		}
+		return 0;
+	}
+
+	return audioEssenceFile->channels;
+}
+
+
+
+static int extract_setRange( AAF_Iface *aafi, struct extractOutput *out, enum aafiExtractFormat extractFormat, uint64_t sampleOffset, uint64_t sampleLength )
+{
+	aafiAudioEssenceFile *audioEssenceFile = out->audioEssenceFile;
+
+	uint64_t pcmByteOffset = sampleOffset * audioEssenceFile->channels * (audioEssenceFile->samplesize/8);
+	uint64_t pcmByteLength = sampleLength * audioEssenceFile->channels * (audioEssenceFile->samplesize/8);
+
+	uint64_t datasz = CFB_getNodeStreamLen( aafi->aafd->cfbd, audioEssenceFile->node );
+
+	if ( datasz == 0 ) {
+		error( "Could not retrieve audio essence stream from CFB" );
+		return -1;
+	}
+
+
+	/* Calculate offset and length */
+
+	debug( "Requesting extract of essence \"%s\"", audioEssenceFile->name );
+	debug( " -    ReqSampleOffset: %"PRIu64" samples (%"PRIu64" bytes)", sampleOffset, pcmByteOffset );
+	debug( " -    ReqSampleLength: %"PRIu64" samples (%"PRIu64" bytes)", sampleLength, pcmByteLength );
+	debug( " -   FileHeaderOffset: %"PRIu64" bytes (0x%04"PRIx64")",
+		audioEssenceFile->pcm_audio_start_offset,
+		audioEssenceFile->pcm_audio_start_offset );
+	debug( " - EssenceTotalLength: %"PRIu64" bytes", datasz );
+
+	uint64_t sourceFileOffset = 0;
+
+	int sampleFormat = extract_sampleFormats( aafi, out );
+
+	out->samplerate = extract_resampling( aafi, out );
+
+	if ( pcmByteOffset ||
+	     pcmByteLength ||
+	     extractFormat != AAFI_EXTRACT_DEFAULT ||
+	     sampleFormat ||
+	     out->samplerate ||
+	     out->channel )
+	{
+		if ( audioEssenceFile->type != AAFI_ESSENCE_TYPE_PCM ) {
+			sourceFileOffset += audioEssenceFile->pcm_audio_start_offset;
+		}
+		out->write_header = 1;
+	}
+
+	if ( pcmByteOffset || pcmByteLength ) {
+		out->extracting_clip = 1;
+	}
+
+	sourceFileOffset += pcmByteOffset;
+
+
+	if ( (datasz - audioEssenceFile->pcm_audio_start_offset) < (pcmByteLength + sourceFileOffset) ) {
+		error( "Requested audio range (%"PRIi64" bytes) is bigger than source audio size (%"PRIu64" bytes)",
+			(pcmByteLength + sourceFileOffset),
+			datasz - audioEssenceFile->pcm_audio_start_offset );
+		return -1;
+	}
+
+	datasz = (pcmByteLength) ? pcmByteLength : (datasz-sourceFileOffset);
+
+	out->data_length = datasz;
+
+	if ( out->convert ) {
+		out->data_length = datasz / laaf_sample_format_size( out->srcFormat ) * laaf_sample_format_size( out->dstFormat );
+	}
+
+	if ( out->channel ) {
+		uint64_t samplesize = ( out->convert ) ? laaf_sample_format_size( out->dstFormat ) : (audioEssenceFile->samplesize/8);
+		out->data_length = datasz / ( (audioEssenceFile->samplesize/8) * audioEssenceFile->channels ) * samplesize;
+	}
+
+	if ( out->samplerate ) {
+		/*
+		 * Resampled samples are computed from the samples around them, read by
+		 * extract_resampled() rather than cut from the byte range.
+		 */
+		aafRational_t rate = { (int32_t)out->samplerate, 1 };
+
+		uint64_t frameSize = (uint64_t)(audioEssenceFile->samplesize/8) * audioEssenceFile->channels;
+
+		out->position = aafi_convertUnitUint64( (aafPosition_t)sampleOffset, audioEssenceFile->samplerateRational, &rate );
+		out->frames = aafi_convertUnitUint64( (aafPosition_t)(datasz / frameSize), audioEssenceFile->samplerateRational, &rate );
+		out->data_length = out->frames * ( ( out->channel ) ? 1 : audioEssenceFile->channels ) * laaf_sample_format_size( out->dstFormat );
+
+		debug( " -    Resampled to %u Hz: %"PRIu64" samples from sample %"PRIu64, out->samplerate, out->frames, out->position );
+	}
+
+	if ( out->data_length >= (uint32_t)-1 && ( out->write_header || audioEssenceFile->type == AAFI_ESSENCE_TYPE_PCM ) ) {
+		debug( "Audio data is bigger than maximum wav file size (2^32 bytes) : %"PRIu64" bytes. Writing RF64 file.", out->data_length );
+	}
+
+	debug( " -  Calculated Offset: %"PRIu64" bytes", sourceFileOffset );
+	debug( " -  Calculated Length: %"PRIu64" bytes", datasz );
+
+	if ( out->convert || out->channel ) {
+		debug( " -   Converted Length: %"PRIu64" bytes", out->data_length );
+	}
+
+	if ( audioEssenceFile->type != AAFI_ESSENCE_TYPE_PCM ) {
+		if ( !out->write_header ) {
+			debug( "Writting exact copy of embedded file." );
+		} else {
+			debug( "Rewriting file header." );
+		}
+	}
+
+	out->offset = sourceFileOffset;
+	out->length = datasz;
+
+	return 0;
+}
+
+
+
+static int extract_openOutput( AAF_Iface *aafi, struct extractOutput *out, enum aafiExtractFormat extractFormat, const char *outpath )
+{
+	int   tmp      = 0;
+	char *filename = NULL;
+
+	aafiAudioEssenceFile *audioEssenceFile = out->audioEssenceFile;
+
+
+	/* Build file path */
+	const char *name = NULL;
+
+	if ( out->name ) {
+		name = out->name;
+	} else {
+		name = audioEssenceFile->unique_name;
+	}
+
+	const char *fileext = NULL;
+
+	if ( out->write_header ||
+	     audioEssenceFile->type == AAFI_ESSENCE_TYPE_WAVE ||
+	     audioEssenceFile->type == AAFI_ESSENCE_TYPE_PCM )
+	{
+		if ( !laaf_util_is_fileext( name, "wav"  ) &&
+		     !laaf_util_is_fileext( name, "wave" ) )
+		{
+			fileext = "wav";
+		}
+	}
+	else if ( !out->write_header &&
+	           audioEssenceFile->type == AAFI_ESSENCE_TYPE_AIFC )
+	{
+		if ( !laaf_util_is_fileext( name, "aif"  ) &&
+		     !laaf_util_is_fileext( name, "aiff" ) &&
+		     !laaf_util_is_fileext( name, "aifc" ) )
+		{
+			fileext = "aif";
+		}
+	}
+
+
+	if ( fileext ) {
+		if ( laaf_util_snprintf_realloc( &filename, NULL, 0, "%s.%s", name, fileext ) < 0 ) {
+			error( "Could not concat filename + fileext" );
+			goto err;
+		}
+	}
+	else {
+		filename = laaf_util_c99strdup( name );
+
+		if ( !filename ) {
+			error( "Could not duplicate filename : %s", name );
+			goto err;
+		}
+	}
+
+
+	out->filepath = laaf_util_build_path( DIR_SEP_STR, outpath, laaf_util_clean_filename(filename), NULL );
+
+	if ( !out->filepath ) {
+		error( "Could not build filepath." );
+		goto err;
+	}
+
+
+	out->fp = fopen( out->filepath, "wb" );
+
+	if ( !out->fp ) {
+		error( "Could not open '%s' for writing : %s", out->filepath, strerror(errno) );
+		goto err;
+	}
+
+
+	if ( out->write_header ||
+	     audioEssenceFile->type == AAFI_ESSENCE_TYPE_PCM )
+	{
+		struct wavFmtChunk wavFmt;
+		wavFmt.format_tag = ( audioEssenceFile->formatTag == RIFF_WAVE_FORMAT_IEEE_FLOAT ) ? RIFF_WAVE_FORMAT_IEEE_FLOAT : RIFF_WAVE_FORMAT_PCM;
+		wavFmt.channels = ( out->channel ) ? 1 : audioEssenceFile->channels;
+		wavFmt.samples_per_sec = ( out->samplerate ) ? out->samplerate : audioEssenceFile->samplerate;
+		wavFmt.bits_per_sample = audioEssenceFile->samplesize;
+
+		if ( out->convert ) {
+			wavFmt.format_tag = ( out->dstFormat == LAAF_SAMPLE_F32 ) ? RIFF_WAVE_FORMAT_IEEE_FLOAT : RIFF_WAVE_FORMAT_PCM;
+			wavFmt.bits_per_sample = (uint16_t)(laaf_sample_format_size( out->dstFormat ) * 8);
+		}
+
+		struct wavBextChunk wavBext;
+		memset( &wavBext, 0x00, sizeof(wavBext) );
+
+		memcpy( wavBext.umid, audioEssenceFile->sourceMobID, sizeof(aafMobID_t) );
+
+		tmp = snprintf( wavBext.originator, sizeof(((struct wavBextChunk *)0)->originator), "%s %s", aafi->aafd->Identification.ProductName, (mediaComposer_AAF(aafi)) ? "" : aafi->aafd->Identification.ProductVersionString );
+
+		assert( tmp > 0 && (size_t)tmp < sizeof(((struct wavBextChunk *)0)->originator) );
+
+		tmp = snprintf( wavBext.originator_reference, sizeof(((struct wavBextChunk *)0)->originator_reference), "libAAF %s", LIBAAF_VERSION );
+
+		assert( tmp > 0 && (size_t)tmp < sizeof(((struct wavBextChunk *)0)->originator_reference) );
+
+		tmp = snprintf( wavBext.description, sizeof(((struct wavBextChunk *)0)->description), "%s\n%s.aaf", audioEssenceFile->name, aafi->compositionName );
+
+		assert( tmp > 0 && (size_t)tmp < sizeof(((struct wavBextChunk *)0)->description) );
+
+		memcpy( wavBext.origination_date, audioEssenceFile->originationDate, sizeof(((struct wavBextChunk *)0)->origination_date) );
+		memcpy( wavBext.origination_time, audioEssenceFile->originationTime, sizeof(((struct wavBextChunk *)0)->origination_time) );
+
+		if ( out->samplerate ) {
+			aafRational_t rate = { (int32_t)out->samplerate, 1 };
+			wavBext.time_reference = aafi_convertUnitUint64( audioEssenceFile->sourceMobSlotOrigin, audioEssenceFile->sourceMobSlotEditRate, &rate );
+		}
+		else {
+			wavBext.time_reference = aafi_convertUnitUint64( audioEssenceFile->sourceMobSlotOrigin, audioEssenceFile->sourceMobSlotEditRate, audioEssenceFile->samplerateRational );
+		}
+
+		if ( laaf_riff_writeWavFileHeader( out->fp, &wavFmt, (extractFormat != AAFI_EXTRACT_WAV) ? &wavBext : NULL, out->data_length, (extractFormat == AAFI_EXTRACT_RF64), aafi->log ) < 0 ) {
+			error( "Could not write wav audio header : %s", out->filepath );
+			goto err;
+		}
+	}
+
+	free( filename );
+
+	return 0;
+
+err:
+	free( filename );
+
+	out->rc = -1;
+
+	return -1;
+}
+
+
+
+static void extract_closeOutput( AAF_Iface *aafi, struct extractOutput *out )
+{
+	aafiAudioEssenceFile *audioEssenceFile = out->audioEssenceFile;
+
+	if ( out->fp ) {
+		fclose( out->fp );
+		out->fp = NULL;
+	}
+
+	if ( out->rc < 0 ) {
+		return;
+	}
+
+	if ( out->written < out->data_length ) {
+		error( "Could not write audio file (%"PRIu64" bytes written out of %"PRIu64" bytes) : %s", out->written, out->data_length, out->filepath );
+		out->rc = -1;
+		return;
+	}
+
+	if ( !out->extracting_clip && !out->channel ) {
+		/*
+		 * Set audioEssenceFile->usable_file_path only if we axtract essence, not if we
+		 * extract clip (subset of an essence), as a single essence can have multiple
+		 * clips using it. Otherwise, we would reset audioEssenceFile->usable_file_path
+		 * as many times as there are clips using the same essence. A single channel
+		 * file is not usable as the essence either.
+		 */
+		audioEssenceFile->usable_file_path = laaf_util_c99strdup( out->filepath );
+
+		if ( !audioEssenceFile->usable_file_path ) {
+			error( "Could not duplicate usable filepath : %s", out->filepath );
+			out->rc = -1;
+		}
+	}
+}
+
+
+
+static int extract_stream( AAF_Iface *aafi, cfbStreamReader *reader, struct extractOutput **outputs, size_t count, struct extractBuffer *buffer, enum aafiExtractFormat extractFormat, const char *outpath )
+{
+	int rc = 0;
+
+	uint64_t pos   = 0;
+	size_t   first = 0;
+	size_t   next  = 0;
+
+	unsigned char  *chunk = NULL;
+	unsigned char  *converted = NULL;
+	unsigned char  *planeData = NULL;
+	unsigned char **planes = NULL;
+
+	struct laafSampleDither dither;
+
+	aafiAudioEssenceFile *audioEssenceFile = outputs[0]->audioEssenceFile;
+
+	if ( outputs[0]->samplerate ) {
+		/* all outputs of an essence are resampled, or none of them */
+		for ( size_t i = 0; i < count; i++ ) {
+			if ( outputs[i]->rc == 0 ) {
+				extract_resampled( aafi, outputs[i], buffer, extractFormat, outpath );
+			}
+			if ( outputs[i]->rc < 0 ) {
+				rc = -1;
+			}
+		}
+
+		return rc;
+	}
+
+	/*
+	 * Stream is sliced, transformed and written one chunk at a time. Chunk size
+	 * is a multiple of the sample size, so a sample is never split across chunks.
+	 * All outputs of a pass are cut from the same essence and share the same
+	 * header mode and sample formats, so a chunk is swapped and converted once
+	 * for all of them. When channels are split, chunk size is a multiple of the
+	 * frame size and a chunk is de-interleaved once too, only the channels of
+	 * open outputs being copied.
+	 */
+
+	uint16_t samplesize = (audioEssenceFile->samplesize>>3);
+	int swap = ( outputs[0]->write_header && audioEssenceFile->type == AAFI_ESSENCE_TYPE_AIFC && samplesize > 1 );
+
+	int convert = outputs[0]->convert;
+	enum laafSampleFormat srcFormat = outputs[0]->srcFormat;
+	enum laafSampleFormat dstFormat = outputs[0]->dstFormat;
+
+	int split = ( outputs[0]->channel != 0 );
+	unsigned int channels = audioEssenceFile->channels;
+
+	uint64_t chunkSize = EXTRACT_CHUNK_SIZE;
+	uint64_t convertedSize = 0;
+	uint64_t planeSize = 0;
+	uint64_t maxLength = 0;
+
+	if ( split ) {
+		chunkSize -= chunkSize % ((uint64_t)samplesize * channels);
+	}
+	else if ( swap || convert ) {
+		chunkSize -= chunkSize % samplesize;
+	}
+
+	for ( size_t i = 0; i < count; i++ ) {
+		if ( outputs[i]->rc == 0 && outputs[i]->length > maxLength ) {
+			maxLength = outputs[i]->length;
+		}
+	}
+
+	if ( chunkSize > maxLength ) {
+		chunkSize = maxLength;
+	}
+
+	if ( convert ) {
+		convertedSize = chunkSize / samplesize * laaf_sample_format_size( dstFormat );
+
+		/* dither noise only depends on the essence, not on the extraction order */
+		laaf_sample_dither_init( &dither, audioEssenceFile->node->_sectStart );
+	}
+
+	if ( split ) {
+		planeSize = chunkSize / ((uint64_t)samplesize * channels) * ( ( convert ) ? laaf_sample_format_size( dstFormat ) : samplesize );
+
+		planes = calloc( channels, sizeof(unsigned char*) );
+
+		if ( !planes ) {
+			error( "Out of memory" );
+			goto err;
+		}
+	}
+
+	uint64_t bufferSize = chunkSize + convertedSize + planeSize * channels;
+
+	if ( !buffer->data || buffer->size < bufferSize ) {
+
+		unsigned char *data = realloc( buffer->data, (bufferSize) ? bufferSize : 1 );
+
+		if ( !data ) {
+			error( "Out of memory" );
+			goto err;
+		}
+
+		buffer->data = data;
+		buffer->size = bufferSize;
+	}
+
+	chunk = buffer->data;
+	converted = buffer->data + chunkSize;
+	planeData = buffer->data + chunkSize + convertedSize;
+
+
+	/*
+	 * Outputs are sorted by offset. [first, next) holds the outputs already
+	 * opened, an output being done once its file is closed. A chunk never
+	 * crosses an output start or end, so every open output takes it whole.
+	 */
+
+	while ( first < count ) {
+
+		if ( first == next ) {
+
+			pos = outputs[next]->offset;
+
+			if ( cfb_seekStream( reader, pos ) < 0 ) {
+				error( "Could not seek to offset %"PRIu64" of audio essence stream", pos );
+				goto err;
+			}
+		}
+
+		while ( next < count && outputs[next]->offset <= pos ) {
+			if ( outputs[next]->rc == 0 ) {
+				extract_openOutput( aafi, outputs[next], extractFormat, outpath );
+			}
+			next++;
+		}
+
+		while ( first < next && outputs[first]->fp == NULL ) {
+			first++;
+		}
+
+		if ( first == next ) {
+			continue;
+		}
+
+
+		uint64_t end = pos + chunkSize;
+
+		for ( size_t i = first; i < next; i++ ) {
+			if ( outputs[i]->fp && outputs[i]->offset + outputs[i]->length < end ) {
+				end = outputs[i]->offset + outputs[i]->length;
+			}
+		}
+
+		if ( next < count && outputs[next]->offset < end ) {
+			end = outputs[next]->offset;
+		}
+
+		uint64_t len = end - pos;
+
+		if ( cfb_readStream( reader, chunk, len ) != len ) {
+			error( "Could not read audio essence stream at offset %"PRIu64, pos );
+			goto err;
+		}
+
+		if ( swap ) {
+			/* big endian AIFC samples to little endian WAVE samples */
+			laaf_sample_swap_bytes( chunk, len, samplesize );
+		}
+
+		unsigned char *data = chunk;
+		uint64_t datalen = len;
+
+		if ( convert ) {
+			laaf_sample_convert( converted, dstFormat, chunk, srcFormat, (size_t)(len / samplesize), ( aafi->ctx.options.extract_dither ) ? &dither : NULL );
+
+			data = converted;
+			datalen = len / samplesize * laaf_sample_format_size( dstFormat );
+		}
+
+		if ( split ) {
+			unsigned int planeSampleSize = ( convert ) ? laaf_sample_format_size( dstFormat ) : samplesize;
+
+			memset( planes, 0x00, channels * sizeof(unsigned char*) );
+
+			for ( size_t i = first; i < next; i++ ) {
+				if ( outputs[i]->fp ) {
+					planes[outputs[i]->channel-1] = planeData + (outputs[i]->channel-1) * planeSize;
+				}
+			}
+
+			size_t frames = (size_t)(datalen / ((uint64_t)planeSampleSize * channels));
+
+			laaf_sample_deinterleave( planes, data, frames, channels, planeSampleSize );
+
+			datalen = (uint64_t)frames * planeSampleSize;
+		}
+
+		for ( size_t i = first; i < next; i++ ) {
+
+			struct extractOutput *out = outputs[i];
+
+			if ( !out->fp ) {
+				continue;
+			}
+
+			if ( split ) {
+				data = planes[out->channel-1];
+			}
+
+			uint64_t written = fwrite( data, sizeof(unsigned char), datalen, out->fp );
+
+			out->written += written;
+
+			if ( written < datalen || out->offset + out->length == end ) {
+				extract_closeOutput( aafi, out );
+			}
+		}
+
+		pos = end;
+	}
+
+	goto end;
+
+err:
+	rc = -1;
+
+	for ( size_t i = 0; i < count; i++ ) {
+		if ( outputs[i]->fp ) {
+			outputs[i]->rc = -1;
+			extract_closeOutput( aafi, outputs[i] );
+		}
+		else if ( i >= next ) {
+			outputs[i]->rc = -1;
+		}
+	}
+
+end:
+	free( planes );
+
+	for ( size_t i = 0; i < count; i++ ) {
+		if ( outputs[i]->rc < 0 ) {
+			rc = -1;
+		}
+	}
+
+	return rc;
+}
+
+
+
+/*
+ * Writes an output resampled to out->samplerate. Input samples around every
+ * block of output samples are read with aafi_readAudioSamples(), converted to
+ * float and resampled one channel at a time, then converted to the output
+ * format. Memory use only depends on the block size and the resampling ratio.
+ */
+
+static int extract_resampled( AAF_Iface *aafi, struct extractOutput *out, struct extractBuffer *buffer, enum aafiExtractFormat extractFormat, const char *outpath )
+{
+	aafiAudioEssenceFile *audioEssenceFile = out->audioEssenceFile;
+
+	struct laafResampler resampler;
+	struct laafSampleDither dither;
+
+	unsigned char **planes = NULL;
+
+	uint16_t channels   = 0;
+	uint16_t samplesize = 0;
+	uint64_t frameCount = 0;
+
+	memset( &resampler, 0x00, sizeof(struct laafResampler) );
+
+	if ( aafi_getAudioSampleInfo( aafi, audioEssenceFile, &channels, &samplesize, &frameCount ) < 0 ) {
+		error( "Could not locate audio data of essence \"%s\"", audioEssenceFile->unique_name );
+		goto err;
+	}
+
+	if ( samplesize != audioEssenceFile->samplesize || channels != audioEssenceFile->channels || out->channel > 64 ) {
+		error( "Audio data of essence \"%s\" does not match its descriptor", audioEssenceFile->unique_name );
+		goto err;
+	}
+
+	if ( laaf_resampler_init( &resampler, (uint64_t)audioEssenceFile->samplerateRational->numerator, (uint64_t)audioEssenceFile->samplerateRational->denominator, out->samplerate, 1 ) < 0 ) {
+		error( "Can't resample essence \"%s\" to %u Hz", audioEssenceFile->unique_name, out->samplerate );
+		goto err;
+	}
+
+
+	/*
+	 * When channels are split, only the output channel is read. Buffer sizes are
+	 * rounded to 16 bytes, so float buffers stay aligned after 24 bits ones.
+	 */
+
+	unsigned int readChannels = ( out->channel ) ? 1 : channels;
+	unsigned int srcSize = laaf_sample_format_size( out->srcFormat );
+	unsigned int dstSize = laaf_sample_format_size( out->dstFormat );
+
+	uint64_t channelMask = ( out->channel ) ? ((uint64_t)1 << (out->channel-1)) : 0;
+
+	size_t maxSpan = (size_t)( (uint64_t)(EXTRACT_RESAMPLE_FRAMES-1) * resampler.downsample / resampler.upsample ) + resampler.taps + 3;
+
+	size_t rawSize       = ( maxSpan * readChannels * srcSize + 15 ) & ~(size_t)15;
+	size_t decodedSize   = maxSpan * readChannels * sizeof(float);
+	size_t planeSize     = maxSpan * sizeof(float);
+	size_t resampledSize = (size_t)EXTRACT_RESAMPLE_FRAMES * readChannels * sizeof(float);
+	size_t convertedSize = (size_t)EXTRACT_RESAMPLE_FRAMES * readChannels * dstSize;
+
+	uint64_t bufferSize = rawSize + decodedSize + planeSize * readChannels + resampledSize + convertedSize;
+
+	if ( !buffer->data || buffer->size < bufferSize ) {
+
+		unsigned char *data = realloc( buffer->data, bufferSize );
+
+		if ( !data ) {
+			error( "Out of memory" );
+			goto err;
+		}
+
+		buffer->data = data;
+		buffer->size = bufferSize;
+	}
+
+	planes = calloc( readChannels, sizeof(unsigned char*) );
+
+	if ( !planes ) {
+		error( "Out of memory" );
+		goto err;
+	}
+
+	unsigned char *raw = buffer->data;
+	float *decoded     = (float*)(void*)(buffer->data + rawSize);
+	float *planeData   = (float*)(void*)(buffer->data + rawSize + decodedSize);
+	float *resampled   = (float*)(void*)(buffer->data + rawSize + decodedSize + planeSize * readChannels);
+	unsigned char *converted = buffer->data + rawSize + decodedSize + planeSize * readChannels + resampledSize;
+
+	/* dither noise only depends on the essence, not on the extraction order */
+	laaf_sample_dither_init( &dither, audioEssenceFile->node->_sectStart );
+
+	if ( extract_openOutput( aafi, out, extractFormat, outpath ) < 0 ) {
+		goto err;
+	}
+
+
+	for ( uint64_t done = 0; done < out->frames; ) {
+
+		size_t count = (size_t)( ( out->frames - done < EXTRACT_RESAMPLE_FRAMES ) ? out->frames - done : EXTRACT_RESAMPLE_FRAMES );
+
+		uint64_t pos = ( out->position + done ) * resampler.downsample;
+
+		int64_t first = 0;
+		size_t  span  = 0;
+
+		laaf_resampler_span( &resampler, pos, count, &first, &span );
+
+		/* input samples out of the essence are silence */
+		memset( planeData, 0x00, planeSize * readChannels );
+
+		uint64_t readFirst = ( first < 0 ) ? 0 : (uint64_t)first;
+		size_t   lead      = (size_t)( readFirst - (uint64_t)first );
+		size_t   readCount = 0;
+
+		if ( span > lead && readFirst < frameCount ) {
+			readCount = ( frameCount - readFirst < span - lead ) ? (size_t)(frameCount - readFirst) : span - lead;
+		}
+
+		if ( readCount ) {
+
+			if ( aafi_readAudioSamples( aafi, audioEssenceFile, readFirst, readCount, channelMask, raw ) != readCount ) {
+				error( "Could not read audio data of essence \"%s\" at sample %"PRIu64, audioEssenceFile->unique_name, readFirst );
+				goto err;
+			}
+
+			laaf_sample_convert( (unsigned char*)decoded, LAAF_SAMPLE_F32, raw, out->srcFormat, readCount * readChannels, NULL );
+
+			for ( unsigned int c = 0; c < readChannels; c++ ) {
+				planes[c] = (unsigned char*)(planeData + c * maxSpan + lead);
+			}
+
+			laaf_sample_deinterleave( planes, (unsigned char*)decoded, readCount, readChannels, sizeof(float) );
+		}
+
+		for ( unsigned int c = 0; c < readChannels; c++ ) {
+			laaf_resampler_process( &resampler, resampled + c, readChannels, planeData + c * maxSpan, pos, count );
+		}
+
+		laaf_sample_convert( converted, out->dstFormat, (unsigned char*)resampled, LAAF_SAMPLE_F32, count * readChannels, ( aafi->ctx.options.extract_dither ) ? &dither : NULL );
+
+		uint64_t datalen = (uint64_t)count * readChannels * dstSize;
+		uint64_t written = fwrite( converted, sizeof(unsigned char), datalen, out->fp );
+
+		out->written += written;
+
+		if ( written < datalen ) {
+			break;
+		}
+
+		done += count;
+	}
+
+	extract_closeOutput( aafi, out );
+
+	free( planes );
+	laaf_resampler_free( &resampler );
+
+	return out->rc;
+
+err:
+	out->rc = -1;
+
+	extract_closeOutput( aafi, out );
+
+	free( planes );
+	laaf_resampler_free( &resampler );
+
+	return -1;
+}
+
+
+
+static int extract_groups( AAF_Iface *aafi, struct extractGroup *groups, size_t count, enum aafiExtractFormat extractFormat, const char *outpath )
+{
+	int rc = 0;
+
+	struct extractPool pool;
+
+	memset( &pool, 0x00, sizeof(struct extractPool) );
+
+	pool.aafi = aafi;
+	pool.groups = groups;
+	pool.count = count;
+	pool.extractFormat = extractFormat;
+	pool.outpath = outpath;
+
+	qsort( groups, count, sizeof(struct extractGroup), extractGroupCmp );
+
+#ifdef LIBAAF_THREADS
+
+	size_t threadCount = ( aafi->ctx.options.threads > 1 ) ? (size_t)aafi->ctx.options.threads : 1;
+
+	if ( threadCount > count ) {
+		threadCount = count;
+	}
+
+	pthread_t *threads = NULL;
+	size_t     started = 0;
+
+	if ( threadCount > 1 ) {
+
+		threads = calloc( threadCount - 1, sizeof(pthread_t) );
+
+		if ( !threads ) {
+			warning( "Out of memory. Extracting with a single thread." );
+			threadCount = 1;
+		}
+	}
+
+	pthread_mutex_init( &pool.mutex, NULL );
+
+	for ( started = 0; started + 1 < threadCount; started++ ) {
+
+		int err = pthread_create( &threads[started], NULL, extractGroupWorker, &pool );
+
+		if ( err != 0 ) {
+			warning( "Could not start thread : %s. Continuing with %"PRIu64" threads.", strerror(err), (uint64_t)(started+1) );
+			break;
+		}
+	}
+
+	extractGroupWorker( &pool );
+
+	for ( size_t i = 0; i < started; i++ ) {
+		pthread_join( threads[i], NULL );
+	}
+
+	pthread_mutex_destroy( &pool.mutex );
+
+	free( threads );
+
+#else
+
+	extractGroupWorker( &pool );
+
+#endif
+
+	for ( size_t g = 0; g < count; g++ ) {
+		for ( size_t i = 0; i < groups[g].count; i++ ) {
+			if ( groups[g].outputs[i]->rc < 0 ) {
+				rc = -1;
+			}
+		}
+	}
+
+	return rc;
+}
+
+
+
+static void extract_group( AAF_Iface *aafi, struct extractGroup *group, struct extractBuffer *buffer, enum aafiExtractFormat extractFormat, const char *outpath )
+{
+	aafiAudioEssenceFile *audioEssenceFile = group->outputs[0]->audioEssenceFile;
+
+	cfbStreamReader reader;
+
+	if ( audioEssenceFile->is_embedded &&
+	     cfb_openStream( aafi->aafd->cfbd, audioEssenceFile->node, &reader ) == 0 )
+	{
+		extract_stream( aafi, &reader, group->outputs, group->count, buffer, extractFormat, outpath );
+	}
+
+	for ( size_t i = 0; i < group->count; i++ ) {
+
+		struct extractOutput *out = group->outputs[i];
+
+		if ( out->rc == 0 && out->filepath ) {
+			success( "Audio %s file extracted to %s\"%s\"%s",
+				(out->isClip) ? "clip" : "essence",
+				ANSI_COLOR_DARKGREY(aafi->log),
+				out->filepath,
+				ANSI_COLOR_RESET(aafi->log) );
+		}
+		else {
+			out->rc = -1;
+
+			error( "Audio %s file extraction failed : %s\"%s\"%s",
+				(out->isClip) ? "clip" : "essence",
+				ANSI_COLOR_DARKGREY(aafi->log),
+				(out->name) ? out->name : audioEssenceFile->unique_name,
+				ANSI_COLOR_RESET(aafi->log) );
+		}
+	}
+}
+
+
+
+static void * extractGroupWorker( void *arg )
+{
+	struct extractPool *pool = arg;
+	struct extractBuffer buffer = { NULL, 0 };
+
+	while ( 1 ) {
+
+#ifdef LIBAAF_THREADS
+		pthread_mutex_lock( &pool->mutex );
+#endif
+
+		size_t index = pool->next++;
+
+#ifdef LIBAAF_THREADS
+		pthread_mutex_unlock( &pool->mutex );
+#endif
+
+		if ( index >= pool->count ) {
+			break;
+		}
+
+		extract_group( pool->aafi, &pool->groups[index], &buffer, pool->extractFormat, pool->outpath );
+	}
+
+	free( buffer.data );
+
+	return NULL;
+}
+
+
+
+static int extractOutputCmp( const void *a, const void *b )
+{
+	const struct extractOutput *outA = *(struct extractOutput * const *)a;
+	const struct extractOutput *outB = *(struct extractOutput * const *)b;
+
+	uintptr_t essenceA = (uintptr_t)outA->audioEssenceFile;
+	uintptr_t essenceB = (uintptr_t)outB->audioEssenceFile;
+
+	if ( essenceA != essenceB ) {
+		return ( essenceA < essenceB ) ? -1 : 1;
+	}
+
+	if ( outA->offset != outB->offset ) {
+		return ( outA->offset < outB->offset ) ? -1 : 1;
+	}
+
+	return ( outA->index < outB->index ) ? -1 : ( outA->index > outB->index );
+}
+
+
+
+static int extractGroupCmp( const void *a, const void *b )
+{
+	const struct extractGroup *groupA = a;
+	const struct extractGroup *groupB = b;
+
+	if ( groupA->bytes != groupB->bytes ) {
+		return ( groupA->bytes > groupB->bytes ) ? -1 : 1;
+	}
+
+	return ( groupA->index < groupB->index ) ? -1 : ( groupA->index > groupB->index );
+}
+
+
+
+/*
+ * Returns the sample reader of an essence, set up on first call.
+ */
+
+static struct aafiSampleReader * sampleReader_get( AAF_Iface *aafi, aafiAudioEssenceFile *audioEssenceFile )
+{
+#ifdef LIBAAF_THREADS
+	pthread_mutex_lock( &sampleReaderMutex );
+#endif
+
+	if ( !audioEssenceFile->sampleReader ) {
+		audioEssenceFile->sampleReader = sampleReader_open( aafi, audioEssenceFile );
+	}
+
+	struct aafiSampleReader *sr = audioEssenceFile->sampleReader;
+
+#ifdef LIBAAF_THREADS
+	pthread_mutex_unlock( &sampleReaderMutex );
+#endif
+
+	return sr;
+}
+
+
+
+static struct aafiSampleReader * sampleReader_open( AAF_Iface *aafi, aafiAudioEssenceFile *audioEssenceFile )
+{
+	FILE *fp = NULL;
+	uint64_t dataLength = 0;
+
+	uint16_t samplesize = audioEssenceFile->samplesize;
+	uint16_t channels   = audioEssenceFile->channels;
+	uint16_t formatTag  = audioEssenceFile->formatTag;
+
+	if ( audioEssenceFile->type == AAFI_ESSENCE_TYPE_UNK ) {
+		error( "Essence \"%s\" is not PCM", audioEssenceFile->unique_name );
+		return NULL;
+	}
+
+	struct aafiSampleReader *sr = calloc( 1, sizeof(struct aafiSampleReader) );
+
+	if ( !sr ) {
+		error( "Out of memory" );
+		return NULL;
+	}
+
+	if ( audioEssenceFile->is_embedded ) {
+
+		sr->index = cfb_indexStream( aafi->aafd->cfbd, audioEssenceFile->node );
+
+		if ( !sr->index ) {
+			error( "Could not index stream of essence \"%s\"", audioEssenceFile->unique_name );
+			goto err;
+		}
+
+		uint64_t streamLength = CFB_getNodeStreamLen( aafi->aafd->cfbd, audioEssenceFile->node );
+
+		sr->dataOffset = ( audioEssenceFile->type != AAFI_ESSENCE_TYPE_PCM ) ? audioEssenceFile->pcm_audio_start_offset : 0;
+		sr->swap = ( audioEssenceFile->type == AAFI_ESSENCE_TYPE_AIFC );
+
+		dataLength = ( streamLength > sr->dataOffset ) ? streamLength - sr->dataOffset : 0;
+	}
+	else {
+
+		if ( !audioEssenceFile->usable_file_path ) {
+			error( "External essence \"%s\" was not located", audioEssenceFile->unique_name );
+			goto err;
+		}
+
+		/*
+		 * Header is parsed again, since essence properties might come from the
+		 * AAF summary, which does not locate audio data in file.
+		 */
+
+		struct RIFFAudioFile RIFFAudioFile;
+
+		fp = laaf_util_fopen_utf8( audioEssenceFile->usable_file_path, "rb" );
+
+		if ( !fp ||
+		     laaf_riff_parseAudioFile( &RIFFAudioFile, RIFF_PARSE_AAF_SUMMARY, &externalAudioDataReaderCallback, fp, audioEssenceFile->usable_file_path, aafi, aafi->log ) < 0 ||
+		     RIFFAudioFile.pcm_audio_start_offset == 0 )
+		{
+			error( "Could not parse external essence file : %s", audioEssenceFile->usable_file_path );
+			goto err;
+		}
+
+		fclose( fp );
+		fp = NULL;
+
+		sr->map = laaf_util_map_file( audioEssenceFile->usable_file_path, &sr->mapSize );
+
+		if ( !sr->map ) {
+			error( "Could not map external essence file : %s", audioEssenceFile->usable_file_path );
+			goto err;
+		}
+
+		samplesize = RIFFAudioFile.sampleSize;
+		channels   = RIFFAudioFile.channels;
+		formatTag  = RIFFAudioFile.formatTag;
+
+		sr->dataOffset = RIFFAudioFile.pcm_audio_start_offset;
+		sr->swap = ( sr->mapSize >= 4 && memcmp( sr->map, "FORM", 4 ) == 0 );
+
+		dataLength = ( sr->mapSize > sr->dataOffset ) ? sr->mapSize - sr->dataOffset : 0;
+
+		if ( RIFFAudioFile.sampleCount * channels * (samplesize/8) < dataLength ) {
+			dataLength = RIFFAudioFile.sampleCount * channels * (samplesize/8);
+		}
+	}
+
+	if ( samplesize == 0 || samplesize % 8 || channels == 0 ) {
+		error( "Can't read %u bits samples of %u channels from essence \"%s\"", samplesize, channels, audioEssenceFile->unique_name );
+		goto err;
+	}
+
+	sr->samplesize = samplesize / 8;
+	sr->channels   = channels;
+	sr->formatTag  = formatTag;
+	sr->frameCount = dataLength / ((uint64_t)sr->samplesize * sr->channels);
+
+	debug( "Essence \"%s\" audio data located at %"PRIu64", %"PRIu64" samples", audioEssenceFile->unique_name, sr->dataOffset, sr->frameCount );
+
+	return sr;
+
+err:
+	if ( fp ) {
+		fclose( fp );
+	}
+
+	sampleReader_free( sr );
+
+	return NULL;
+}
+
+
+
+static void sampleReader_free( struct aafiSampleReader *sr )
+{
+	if ( !sr ) {
+		return;
+	}
+
+	cfb_freeStreamIndex( sr->index );
+	laaf_util_unmap_file( sr->map, sr->mapSize );
+
+	free( sr );
+}
+
+
+
+/*
+ * Copies the channels selected by channelMask, from interleaved frames of all
+ * channels.
+ */
+
+static void sampleReader_select( unsigned char *dst, const unsigned char *src, uint64_t frames, uint16_t channels, uint16_t samplesize, uint64_t channelMask )
+{
+	for ( uint64_t i = 0; i < frames; i++ ) {
+
+		for ( uint16_t c = 0; c < channels && c < 64; c++ ) {
+
+			if ( (channelMask >> c) & 1 ) {
+				memcpy( dst, src + (uint64_t)c * samplesize, samplesize );
+				dst += samplesize;
+			}
+		}
+
+		src += (uint64_t)channels * samplesize;
+	}
+}
+
+
+
+static int set_audioEssenceWithRIFF( AAF_Iface *aafi, const char *filename, aafiAudioEssenceFile *audioEssenceFile, struct RIFFAudioFile *RIFFAudioFile, int isExternalFile )
+{
+	if ( RIFFAudioFile->sampleCount >= INT64_MAX ) {
+		error( "%s : summary sample count is bigger than INT64_MAX (%"PRIu64")", audioEssenceFile->usable_file_path, RIFFAudioFile->sampleCount );
+		return -1;
+	}
+
+	if ( RIFFAudioFile->sampleRate >= INT_MAX ) {
+		error( "%s : summary sample rate is bigger than INT_MAX (%li)", audioEssenceFile->usable_file_path, RIFFAudioFile->sampleRate );
+		return -1;
+	}
+
+	if ( audioEssenceFile->channels > 0 && audioEssenceFile->channels != RIFFAudioFile->channels ) {
+		warning( "%s : summary channel count (%i) mismatch %s (%i)", filename, audioEssenceFile->channels, ((isExternalFile) ? "located file" : "previously retrieved data"), RIFFAudioFile->channels );
+	}
+
+	if ( audioEssenceFile->samplerate > 0 && audioEssenceFile->samplerate != RIFFAudioFile->sampleRate ) {
+		warning( "%s : summary samplerate (%i) mismatch %s (%i)", filename, audioEssenceFile->samplerate, ((isExternalFile) ? "located file" : "previously retrieved data"), RIFFAudioFile->sampleRate );
+	}
+
+	if ( audioEssenceFile->samplesize > 0 && audioEssenceFile->samplesize != RIFFAudioFile->sampleSize ) {
+		warning( "%s : summary samplesize (%i) mismatch %s (%i)", filename , audioEssenceFile->samplesize, ((isExternalFile) ? "located file" : "previously retrieved data"), RIFFAudioFile->sampleSize );
+	}
+
+	if ( audioEssenceFile->length > 0 && (uint64_t)audioEssenceFile->length != RIFFAudioFile->sampleCount ) {
+		warning( "%s : summary samplecount (%"PRIi64") mismatch %s (%"PRIi64")", filename , audioEssenceFile->length, ((isExternalFile) ? "located file" : "previously retrieved data"), RIFFAudioFile->sampleCount );
+	}
+
+	audioEssenceFile->channels   = RIFFAudioFile->channels;
+	audioEssenceFile->samplerate = RIFFAudioFile->sampleRate;
+	audioEssenceFile->samplesize = RIFFAudioFile->sampleSize;
+	audioEssenceFile->formatTag  = RIFFAudioFile->formatTag;
+
+	audioEssenceFile->length = (aafPosition_t)RIFFAudioFile->sampleCount;
+	audioEssenceFile->pcm_audio_start_offset = (uint64_t)RIFFAudioFile->pcm_audio_start_offset;
+	audioEssenceFile->samplerateRational->numerator = (int32_t)audioEssenceFile->samplerate;
+
+	audioEssenceFile->samplerateRational->denominator = 1;
+
+
+	return 0;
+}
+
+
+
+int aafi_parse_audio_essence( AAF_Iface *aafi, aafiAudioEssenceFile *audioEssenceFile )
 {
 	int rc = 0;
 	uint64_t dataStreamSize = 0;
@@ -965,43 +2544,3 @@ static size_t externalAudioDataReaderCallback( unsigned char *buf, size_t offset
 
 	return byteRead;
 }
-
-
-
-aafiAudioEssencePointer * aafi_audioEssencePointer_exists_before( AAF_Iface *aafi, aafiAudioEssencePointer *audioEssencePointerList )
-{
-	aafiAudioTrack *at = NULL;
-	aafiTimelineItem *ai = NULL;
-	aafiAudioClip *ac = NULL;
-
-	aafiAudioEssencePointer *aep1 = NULL;
-	aafiAudioEssencePointer *aep2 = NULL;
-
-	AAFI_foreachAudioTrack( aafi, at ) {
-		AAFI_foreachTrackItem( at, ai ) {
-
-			if ( ai->type != AAFI_AUDIO_CLIP ) {
-				continue;
-			}
-
-			ac = (aafiAudioClip*)ai->data;
-			aep1 = audioEssencePointerList;
-
-			int found = 1;
-
-			AAFI_foreachEssencePointer( ac->essencePointerList, aep2 ) {
-				if ( !aep1 || aep1->essenceFile != aep2->essenceFile || aep1->essenceChannel != aep2->essenceChannel ) {
-					found = 0;
-					break;
-				}
-				aep1 = aep1->next;
-			}
-
-			if ( found && aep1 == NULL ) {
-				return ac->essencePointerList;
-			}
-		}
-	}
-
-	return NULL;
-}
@@ -0,0 +1,1416 @@
+/*
+ * Copyright (C) 2017-2024 Adrien Gesta-Fline
+ *
+ * This file is part of libAAF.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#if defined(__SSE2__)
+	#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+	#include <arm_neon.h>
+#endif
+
+#include <libaaf/AAFIface.h>
+#include <libaaf/AAFIEssenceFile.h>
+#include <libaaf/AAFILoudness.h>
+#include <libaaf/AAFIRender.h>
+#include <libaaf/log.h>
+
+#include <libaaf/utils.h>
+#include <libaaf/sample.h>
+
+#ifdef LIBAAF_THREADS
+#include <pthread.h>
+#endif
+
+
+#define debug( ... ) \
+	AAF_LOG( aafi->log, aafi, LOG_SRC_ID_AAF_IFACE, VERB_DEBUG, __VA_ARGS__ )
+
+#define warning( ... ) \
+	AAF_LOG( aafi->log, aafi, LOG_SRC_ID_AAF_IFACE, VERB_WARNING, __VA_ARGS__ )
+
+#define error( ... ) \
+	AAF_LOG( aafi->log, aafi, LOG_SRC_ID_AAF_IFACE, VERB_ERROR, __VA_ARGS__ )
+
+
+
+#define LOUDNESS_PI 3.14159265358979323846
+
+/* essences are read by chunks of this many 100 ms steps */
+#define LOUDNESS_CHUNK_STEPS 10
+
+/* momentary (400 ms) and short-term (3 s) windows, in steps, both sliding by one step */
+#define LOUDNESS_BLOCK_STEPS     4
+#define LOUDNESS_SHORTTERM_STEPS 30
+
+#define LOUDNESS_ABSOLUTE_GATE -70.0
+#define LOUDNESS_RELATIVE_GATE -10.0
+
+/*
+ * True peak interpolation filter : 4 phases of LOUDNESS_TP_TAPS taps. Each
+ * interpolated sample needs the LOUDNESS_TP_TAPS-1 previous input samples.
+ */
+#define LOUDNESS_TP_PHASES  4
+#define LOUDNESS_TP_TAPS    12
+#define LOUDNESS_TP_HISTORY ( LOUDNESS_TP_TAPS - 1 )
+
+
+/*
+ * Measures of an essence, by steps of 100 ms. Values of step S, channel C are
+ * at [S * channels + C]. Last step may hold less than stepFrames samples.
+ */
+struct aafiLoudnessData {
+
+	uint32_t    channels;
+	uint64_t    frameCount;
+
+	uint32_t    stepFrames;
+	uint64_t    stepCount;
+
+	double     *energy;      // sums of squares of K-weighted samples
+	double     *squares;     // sums of squares of samples
+	float      *peak;        // highest absolute sample value
+	float      *truePeak;    // highest absolute interpolated value
+};
+
+/*
+ * K-weighting (ITU-R BS.1770) : a high shelf pre-filter followed by the RLB high
+ * pass filter. Both are biquads { b0, b1, b2, a1, a2 }.
+ */
+struct kweighting {
+	double  pre[5];
+	double  rlb[5];
+};
+
+/*
+ * An essence channel contributing to a measure, from step firstStep.
+ */
+struct loudnessSource {
+	const struct aafiLoudnessData *data;
+	uint32_t    channel;
+	uint64_t    firstStep;
+	double      weight;
+};
+
+/*
+ * Measure in progress of a signal, fed by chunks of up to chunkFrames samples
+ * per channel, written to planes. Every plane is preceded by the last
+ * LOUDNESS_TP_HISTORY samples of the previous chunk.
+ */
+struct loudnessAnalysis {
+
+	struct aafiLoudnessData *data;
+
+	struct kweighting        kw;
+	float                    tpCoefs[LOUDNESS_TP_TAPS][LOUDNESS_TP_PHASES];
+
+	float                   *planeData;
+	unsigned char          **planes;
+	size_t                   planeSize;
+	size_t                   chunkFrames;
+
+	double                  *state;      // K-weighting filters state, 4 per channel
+	uint64_t                 pos;        // samples per channel measured so far
+};
+
+/*
+ * Essences to measure, shared between the calling thread and the workers.
+ */
+struct loudnessPool {
+
+	AAF_Iface               *aafi;
+
+	aafiAudioEssenceFile   **essences;
+	size_t                   count;
+
+	size_t                   next;
+	int                      rc;
+
+#ifdef LIBAAF_THREADS
+	pthread_mutex_t          mutex;
+#endif
+};
+
+
+static struct aafiLoudnessData * loudness_analyze( AAF_Iface *aafi, aafiAudioEssenceFile *audioEssenceFile );
+static int loudness_initAnalysis( AAF_Iface *aafi, struct loudnessAnalysis *an, uint32_t channels, double samplerate, uint64_t frameCount );
+static void loudness_analyzeChunk( struct loudnessAnalysis *an, size_t frames );
+static void loudness_releaseAnalysis( struct loudnessAnalysis *an );
+static int loudness_renderCallback( const float *samples, uint64_t frameCount, unsigned int channels, void *user );
+static int loudness_clipHasEnvelope( aafiAudioClip *audioClip );
+static int loudness_measureRenderedClip( AAF_Iface *aafi, aafiAudioClip *audioClip, aafiLoudness *loudness );
+static void loudness_runPool( struct loudnessPool *pool );
+static void loudness_setKWeighting( struct kweighting *kw, double samplerate );
+static void loudness_setTruePeakFilter( float coefs[LOUDNESS_TP_TAPS][LOUDNESS_TP_PHASES] );
+static void loudness_filter( const struct kweighting *kw, double *state, const float *src, size_t frames, double *energy, double *squares );
+static void loudness_filterPair( const struct kweighting *kw, double *state, const float *src0, const float *src1, size_t frames, double *energy, double *squares );
+static float loudness_truePeak( float coefs[LOUDNESS_TP_TAPS][LOUDNESS_TP_PHASES], const float *src, size_t frames );
+static void loudness_flushState( double *state, size_t count );
+static uint64_t loudness_stepFrames( const struct aafiLoudnessData *data, uint64_t step );
+static double loudness_channelWeight( uint32_t channel, uint32_t channels );
+static double loudness_lufs( double power );
+static double loudness_db( double value );
+static int loudness_measure( AAF_Iface *aafi, struct loudnessSource *sources, uint32_t count, uint64_t stepCount, aafiLoudness *loudness );
+
+#ifdef LIBAAF_THREADS
+static void * loudnessWorker( void *arg );
+#endif
+
+
+
+int aafi_analyzeLoudness( AAF_Iface *aafi, aafiAudioEssenceFile *audioEssenceFile )
+{
+	struct loudnessPool pool;
+
+
+	if ( !aafi ) {
+		return -1;
+	}
+
+	if ( audioEssenceFile ) {
+
+		struct aafiLoudnessData *data = loudness_analyze( aafi, audioEssenceFile );
+
+		if ( !data ) {
+			return -1;
+		}
+
+		aafi_freeLoudness( audioEssenceFile );
+
+		audioEssenceFile->loudness = data;
+
+		return 0;
+	}
+
+	memset( &pool, 0x00, sizeof(struct loudnessPool) );
+
+	pool.aafi = aafi;
+
+	AAFI_foreachAudioEssenceFile( aafi, audioEssenceFile ) {
+		if ( !audioEssenceFile->loudness ) {
+			pool.count++;
+		}
+	}
+
+	if ( pool.count == 0 ) {
+		return 0;
+	}
+
+	pool.essences = malloc( pool.count * sizeof(aafiAudioEssenceFile*) );
+
+	if ( !pool.essences ) {
+		error( "Out of memory" );
+		return -1;
+	}
+
+	pool.count = 0;
+
+	AAFI_foreachAudioEssenceFile( aafi, audioEssenceFile ) {
+		if ( !audioEssenceFile->loudness ) {
+			pool.essences[pool.count++] = audioEssenceFile;
+		}
+	}
+
+
+#ifdef LIBAAF_THREADS
+
+	size_t threadCount = ( aafi->ctx.options.threads > 1 ) ? (size_t)aafi->ctx.options.threads : 1;
+
+	if ( threadCount > pool.count ) {
+		threadCount = pool.count;
+	}
+
+	pthread_t *threads = NULL;
+	size_t started = 0;
+
+	if ( threadCount > 1 ) {
+
+		threads = calloc( threadCount - 1, sizeof(pthread_t) );
+
+		if ( !threads ) {
+			warning( "Out of memory. Measuring loudness with a single thread." );
+			threadCount = 1;
+		}
+	}
+
+	pthread_mutex_init( &pool.mutex, NULL );
+
+	for ( started = 0; started + 1 < threadCount; started++ ) {
+
+		int err = pthread_create( &threads[started], NULL, loudnessWorker, &pool );
+
+		if ( err != 0 ) {
+			warning( "Could not start thread : %s. Continuing with %"PRIu64" threads.", strerror(err), (uint64_t)(started+1) );
+			break;
+		}
+	}
+
+#endif
+
+	loudness_runPool( &pool );
+
+#ifdef LIBAAF_THREADS
+
+	for ( size_t i = 0; i < started; i++ ) {
+		pthread_join( threads[i], NULL );
+	}
+
+	pthread_mutex_destroy( &pool.mutex );
+
+	free( threads );
+
+#endif
+
+	free( pool.essences );
+
+	return pool.rc;
+}
+
+
+
+int aafi_getEssenceLoudness( AAF_Iface *aafi, aafiAudioEssenceFile *audioEssenceFile, uint64_t start, uint64_t frameCount, aafiLoudness *loudness )
+{
+	if ( !aafi || !audioEssenceFile || !loudness ) {
+		return -1;
+	}
+
+	if ( !audioEssenceFile->loudness && aafi_analyzeLoudness( aafi, audioEssenceFile ) < 0 ) {
+		return -1;
+	}
+
+	const struct aafiLoudnessData *data = audioEssenceFile->loudness;
+
+	if ( start >= data->frameCount ) {
+		error( "Can't measure essence \"%s\" from sample %"PRIu64" : essence is %"PRIu64" samples long", audioEssenceFile->unique_name, start, data->frameCount );
+		return -1;
+	}
+
+	uint64_t end = ( frameCount == 0 || frameCount > data->frameCount - start ) ? data->frameCount : start + frameCount;
+
+	uint64_t firstStep = start / data->stepFrames;
+	uint64_t endStep   = ( end + data->stepFrames - 1 ) / data->stepFrames;
+
+	struct loudnessSource *sources = malloc( data->channels * sizeof(struct loudnessSource) );
+
+	if ( !sources ) {
+		error( "Out of memory" );
+		return -1;
+	}
+
+	for ( uint32_t c = 0; c < data->channels; c++ ) {
+		sources[c].data      = data;
+		sources[c].channel   = c;
+		sources[c].firstStep = firstStep;
+		sources[c].weight    = loudness_channelWeight( c, data->channels );
+	}
+
+	int rc = loudness_measure( aafi, sources, data->channels, endStep - firstStep, loudness );
+
+	free( sources );
+
+	return rc;
+}
+
+
+
+int aafi_getClipLoudness( AAF_Iface *aafi, aafiAudioClip *audioClip, aafiLoudness *loudness )
+{
+	int rc = 0;
+
+	struct loudnessSource *sources = NULL;
+
+	aafiAudioEssencePointer *audioEssencePtr = NULL;
+
+
+	if ( !aafi || !audioClip || !loudness ) {
+		return -1;
+	}
+
+	if ( !audioClip->track || !audioClip->essencePointerList ) {
+		error( "Can't measure a clip that has no track or no essence" );
+		return -1;
+	}
+
+	if ( loudness_clipHasEnvelope( audioClip ) ) {
+		return loudness_measureRenderedClip( aafi, audioClip, loudness );
+	}
+
+	aafRational_t *editRate = audioClip->track->edit_rate;
+
+	uint32_t channels = 0;
+
+	AAFI_foreachEssencePointer( audioClip->essencePointerList, audioEssencePtr ) {
+
+		aafiAudioEssenceFile *audioEssenceFile = audioEssencePtr->essenceFile;
+
+		if ( !audioEssenceFile->loudness && aafi_analyzeLoudness( aafi, audioEssenceFile ) < 0 ) {
+			return -1;
+		}
+
+		channels += ( audioEssencePtr->essenceChannel ) ? 1 : audioEssenceFile->loudness->channels;
+	}
+
+	sources = malloc( channels * sizeof(struct loudnessSource) );
+
+	if ( !sources ) {
+		error( "Out of memory" );
+		goto err;
+	}
+
+
+	/*
+	 * Every essence is measured over the clip range. As essences of a clip share a
+	 * sample rate, they have the same number of steps, unless one is shorter.
+	 */
+
+	uint64_t stepCount = UINT64_MAX;
+	uint32_t count = 0;
+
+	AAFI_foreachEssencePointer( audioClip->essencePointerList, audioEssencePtr ) {
+
+		aafiAudioEssenceFile *audioEssenceFile = audioEssencePtr->essenceFile;
+
+		const struct aafiLoudnessData *data = audioEssenceFile->loudness;
+
+		uint64_t start = aafi_convertUnitUint64( audioClip->essence_offset, editRate, audioEssenceFile->samplerateRational );
+		uint64_t end   = start + aafi_convertUnitUint64( audioClip->len, editRate, audioEssenceFile->samplerateRational );
+
+		if ( start >= data->frameCount ) {
+			error( "Can't measure clip : it starts after the end of essence \"%s\"", audioEssenceFile->unique_name );
+			goto err;
+		}
+
+		if ( end > data->frameCount ) {
+			end = data->frameCount;
+		}
+
+		uint64_t firstStep = start / data->stepFrames;
+		uint64_t endStep   = ( end + data->stepFrames - 1 ) / data->stepFrames;
+
+		if ( endStep - firstStep < stepCount ) {
+			stepCount = endStep - firstStep;
+		}
+
+		uint32_t first = ( audioEssencePtr->essenceChannel ) ? audioEssencePtr->essenceChannel - 1 : 0;
+		uint32_t last  = ( audioEssencePtr->essenceChannel ) ? audioEssencePtr->essenceChannel : data->channels;
+
+		if ( last > data->channels ) {
+			error( "Can't measure clip : essence \"%s\" has no channel %u", audioEssenceFile->unique_name, last );
+			goto err;
+		}
+
+		for ( uint32_t c = first; c < last; c++ ) {
+			sources[count].data      = data;
+			sources[count].channel   = c;
+			sources[count].firstStep = firstStep;
+			sources[count].weight    = loudness_channelWeight( count, channels );
+			count++;
+		}
+	}
+
+	rc = loudness_measure( aafi, sources, count, stepCount, loudness );
+
+	goto end;
+
+err:
+	rc = -1;
+
+end:
+	free( sources );
+
+	return rc;
+}
+
+
+
+void aafi_freeLoudness( aafiAudioEssenceFile *audioEssenceFile )
+{
+	if ( !audioEssenceFile ) {
+		return;
+	}
+
+	free( audioEssenceFile->loudness );
+
+	audioEssenceFile->loudness = NULL;
+}
+
+
+
+static struct aafiLoudnessData * loudness_analyze( AAF_Iface *aafi, aafiAudioEssenceFile *audioEssenceFile )
+{
+	struct loudnessAnalysis an;
+
+	unsigned char *raw = NULL;
+	float *samples = NULL;
+
+	uint16_t channels = 0;
+	uint16_t samplesize = 0;
+	uint64_t frameCount = 0;
+
+	enum laafSampleFormat format;
+
+	memset( &an, 0x00, sizeof(struct loudnessAnalysis) );
+
+
+	if ( aafi_getAudioSampleInfo( aafi, audioEssenceFile, &channels, &samplesize, &frameCount ) < 0 ) {
+		error( "Can't measure essence \"%s\" : audio data can't be read", audioEssenceFile->unique_name );
+		return NULL;
+	}
+
+	if ( aafi_getAudioSampleFormat( aafi, audioEssenceFile, &format ) < 0 ) {
+		error( "Can't measure %u bits samples of essence \"%s\"", samplesize, audioEssenceFile->unique_name );
+		return NULL;
+	}
+
+	double samplerate = ( audioEssenceFile->samplerateRational ) ? aafRationalToDouble( *audioEssenceFile->samplerateRational ) : 0;
+
+	if ( samplerate < 10 ) {
+		error( "Can't measure essence \"%s\" : invalid sample rate", audioEssenceFile->unique_name );
+		return NULL;
+	}
+
+	if ( frameCount == 0 ) {
+		error( "Can't measure essence \"%s\" : no audio data", audioEssenceFile->unique_name );
+		return NULL;
+	}
+
+	if ( loudness_initAnalysis( aafi, &an, channels, samplerate, frameCount ) < 0 ) {
+		goto err;
+	}
+
+	raw     = malloc( an.chunkFrames * channels * (samplesize/8) );
+	samples = malloc( an.chunkFrames * channels * sizeof(float) );
+
+	if ( !raw || !samples ) {
+		error( "Out of memory" );
+		goto err;
+	}
+
+
+	for ( uint64_t pos = 0; pos < frameCount; pos += an.chunkFrames ) {
+
+		size_t frames = ( frameCount - pos < an.chunkFrames ) ? (size_t)(frameCount - pos) : an.chunkFrames;
+
+		if ( aafi_readAudioSamples( aafi, audioEssenceFile, pos, frames, 0, raw ) != frames ) {
+			error( "Could not read essence \"%s\" at sample %"PRIu64, audioEssenceFile->unique_name, pos );
+			goto err;
+		}
+
+		if ( channels > 1 ) {
+			laaf_sample_convert( (unsigned char*)samples, LAAF_SAMPLE_F32, raw, format, frames * channels, NULL );
+			laaf_sample_deinterleave( an.planes, (unsigned char*)samples, frames, channels, sizeof(float) );
+		}
+		else {
+			laaf_sample_convert( an.planes[0], LAAF_SAMPLE_F32, raw, format, frames, NULL );
+		}
+
+		loudness_analyzeChunk( &an, frames );
+	}
+
+	debug( "Measured essence \"%s\" : %"PRIu64" samples, %u channels", audioEssenceFile->unique_name, frameCount, channels );
+
+	goto end;
+
+err:
+	free( an.data );
+	an.data = NULL;
+
+end:
+	free( raw );
+	free( samples );
+
+	loudness_releaseAnalysis( &an );
+
+	return an.data;
+}
+
+
+
+/*
+ * Allocates the steps of frameCount samples per channel to measure, and the
+ * planes chunks are written to.
+ */
+
+static int loudness_initAnalysis( AAF_Iface *aafi, struct loudnessAnalysis *an, uint32_t channels, double samplerate, uint64_t frameCount )
+{
+	uint32_t stepFrames = (uint32_t)( samplerate / 10 + 0.5 );
+	uint64_t stepCount  = ( frameCount + stepFrames - 1 ) / stepFrames;
+	size_t   values     = (size_t)stepCount * channels;
+
+	an->chunkFrames = (size_t)stepFrames * LOUDNESS_CHUNK_STEPS;
+	an->planeSize   = LOUDNESS_TP_HISTORY + an->chunkFrames;
+
+	/* doubles first, so every array is aligned. Steps are zeroed, as chunks add to them */
+
+	an->data      = calloc( 1, sizeof(struct aafiLoudnessData) + values * ( 2 * sizeof(double) + 2 * sizeof(float) ) );
+	an->planeData = calloc( an->planeSize * channels, sizeof(float) );
+	an->planes    = malloc( channels * sizeof(unsigned char*) );
+	an->state     = calloc( (size_t)channels * 4, sizeof(double) );
+
+	if ( !an->data || !an->planeData || !an->planes || !an->state ) {
+		error( "Out of memory" );
+		return -1;
+	}
+
+	struct aafiLoudnessData *data = an->data;
+
+	data->channels   = channels;
+	data->frameCount = frameCount;
+	data->stepFrames = stepFrames;
+	data->stepCount  = stepCount;
+	data->energy     = (double*)(void*)( data + 1 );
+	data->squares    = data->energy + values;
+	data->peak       = (float*)(void*)( data->squares + values );
+	data->truePeak   = data->peak + values;
+
+	for ( unsigned int c = 0; c < channels; c++ ) {
+		an->planes[c] = (unsigned char*)( an->planeData + (size_t)c * an->planeSize + LOUDNESS_TP_HISTORY );
+	}
+
+	loudness_setKWeighting( &an->kw, samplerate );
+	loudness_setTruePeakFilter( an->tpCoefs );
+
+	return 0;
+}
+
+
+
+/*
+ * Measures the next frames samples of every plane, up to chunkFrames. A chunk
+ * does not have to start on a step : a step spanning two chunks adds up both
+ * parts.
+ */
+
+static void loudness_analyzeChunk( struct loudnessAnalysis *an, size_t frames )
+{
+	struct aafiLoudnessData *data = an->data;
+
+	uint32_t channels   = data->channels;
+	uint32_t stepFrames = data->stepFrames;
+	size_t   planeSize  = an->planeSize;
+
+	for ( size_t i = 0; i < frames; ) {
+
+		uint64_t step = ( an->pos + i ) / stepFrames;
+		size_t   n    = stepFrames - (size_t)( ( an->pos + i ) % stepFrames );
+
+		n = ( frames - i < n ) ? frames - i : n;
+
+		double *energy  = data->energy  + step * channels;
+		double *squares = data->squares + step * channels;
+
+		unsigned int c = 0;
+
+		for ( ; c + 1 < channels; c += 2 ) {
+			const float *plane = an->planeData + (size_t)c * planeSize + LOUDNESS_TP_HISTORY;
+			loudness_filterPair( &an->kw, an->state + c * 4, plane + i, plane + planeSize + i, n, energy + c, squares + c );
+		}
+
+		for ( ; c < channels; c++ ) {
+			const float *plane = an->planeData + (size_t)c * planeSize + LOUDNESS_TP_HISTORY;
+			loudness_filter( &an->kw, an->state + c * 4, plane + i, n, energy + c, squares + c );
+		}
+
+		for ( c = 0; c < channels; c++ ) {
+
+			const float *plane = an->planeData + (size_t)c * planeSize;
+
+			float min = 0.0f;
+			float max = 0.0f;
+
+			laaf_sample_minmax( plane + LOUDNESS_TP_HISTORY + i, n, &min, &max );
+
+			float peak = ( -min > max ) ? -min : max;
+			float truePeak = loudness_truePeak( an->tpCoefs, plane + i, n );
+
+			truePeak = ( truePeak > peak ) ? truePeak : peak;
+
+			size_t v = (size_t)( step * channels + c );
+
+			data->peak[v]     = ( peak > data->peak[v] ) ? peak : data->peak[v];
+			data->truePeak[v] = ( truePeak > data->truePeak[v] ) ? truePeak : data->truePeak[v];
+		}
+
+		loudness_flushState( an->state, (size_t)channels * 4 );
+
+		i += n;
+	}
+
+	an->pos += frames;
+
+	/* last samples of the chunk are the history of the next one */
+
+	for ( unsigned int c = 0; c < channels; c++ ) {
+		float *plane = an->planeData + (size_t)c * planeSize;
+		memmove( plane, plane + frames, LOUDNESS_TP_HISTORY * sizeof(float) );
+	}
+}
+
+
+
+static void loudness_releaseAnalysis( struct loudnessAnalysis *an )
+{
+	free( an->planeData );
+	free( an->planes );
+	free( an->state );
+
+	an->planeData = NULL;
+	an->planes    = NULL;
+	an->state     = NULL;
+}
+
+
+
+/*
+ * Measures a rendered clip, block after block.
+ */
+
+static int loudness_renderCallback( const float *samples, uint64_t frameCount, unsigned int channels, void *user )
+{
+	struct loudnessAnalysis *an = user;
+
+	if ( channels != an->data->channels ) {
+		return 1;
+	}
+
+	while ( frameCount > 0 && an->pos < an->data->frameCount ) {
+
+		size_t frames = ( frameCount < an->chunkFrames ) ? (size_t)frameCount : an->chunkFrames;
+
+		if ( frames > an->data->frameCount - an->pos ) {
+			frames = (size_t)( an->data->frameCount - an->pos );
+		}
+
+		laaf_sample_deinterleave( an->planes, (const unsigned char*)samples, frames, channels, sizeof(float) );
+
+		loudness_analyzeChunk( an, frames );
+
+		samples    += frames * channels;
+		frameCount -= frames;
+	}
+
+	return 0;
+}
+
+
+
+/*
+ * Clip gain, clip automation and fades only apply to rendered clips. A clip
+ * without any of them is measured from the analysis of its essences instead.
+ */
+
+static int loudness_clipHasEnvelope( aafiAudioClip *audioClip )
+{
+	if ( audioClip->gain || audioClip->automation ) {
+		return 1;
+	}
+
+	if ( !audioClip->timelineItem ) {
+		return 0;
+	}
+
+	aafiTimelineItem *prev = audioClip->timelineItem->prev;
+	aafiTimelineItem *next = audioClip->timelineItem->next;
+
+	if ( prev && prev->type == AAFI_TRANS && ( ((aafiTransition*)prev->data)->flags & ( AAFI_TRANS_FADE_IN | AAFI_TRANS_XFADE ) ) ) {
+		return 1;
+	}
+
+	if ( next && next->type == AAFI_TRANS && ( ((aafiTransition*)next->data)->flags & ( AAFI_TRANS_FADE_OUT | AAFI_TRANS_XFADE ) ) ) {
+		return 1;
+	}
+
+	return 0;
+}
+
+
+
+/*
+ * Renders a clip the way aafi_renderClip() does, at the composition sample
+ * rate, and measures it.
+ */
+
+static int loudness_measureRenderedClip( AAF_Iface *aafi, aafiAudioClip *audioClip, aafiLoudness *loudness )
+{
+	int rc = 0;
+
+	struct loudnessAnalysis an;
+	struct loudnessSource *sources = NULL;
+
+	memset( &an, 0x00, sizeof(struct loudnessAnalysis) );
+
+
+	aafRational_t *samplerate = aafi->Audio->samplerateRational;
+	aafRational_t *editRate   = audioClip->track->edit_rate;
+
+	if ( !samplerate || samplerate->numerator <= 0 || samplerate->denominator <= 0 || aafRationalToDouble( *samplerate ) < 10 ) {
+		error( "Can't measure clip : unknown composition sample rate" );
+		return -1;
+	}
+
+	int channels = aafi_getAudioEssencePointerChannelCount( audioClip->essencePointerList );
+
+	aafPosition_t frameCount = aafi_convertUnit( audioClip->pos + audioClip->len, editRate, samplerate ) -
+	                           aafi_convertUnit( audioClip->pos, editRate, samplerate );
+
+	if ( channels <= 0 || frameCount <= 0 ) {
+		error( "Can't measure an empty clip" );
+		return -1;
+	}
+
+	if ( loudness_initAnalysis( aafi, &an, (uint32_t)channels, aafRationalToDouble( *samplerate ), (uint64_t)frameCount ) < 0 ) {
+		goto err;
+	}
+
+	if ( aafi_renderClip( aafi, audioClip, loudness_renderCallback, &an ) < 0 || an.pos != an.data->frameCount ) {
+		error( "Can't measure clip : it could not be rendered" );
+		goto err;
+	}
+
+	sources = malloc( (size_t)channels * sizeof(struct loudnessSource) );
+
+	if ( !sources ) {
+		error( "Out of memory" );
+		goto err;
+	}
+
+	for ( uint32_t c = 0; c < (uint32_t)channels; c++ ) {
+		sources[c].data      = an.data;
+		sources[c].channel   = c;
+		sources[c].firstStep = 0;
+		sources[c].weight    = loudness_channelWeight( c, (uint32_t)channels );
+	}
+
+	rc = loudness_measure( aafi, sources, (uint32_t)channels, an.data->stepCount, loudness );
+
+	goto end;
+
+err:
+	rc = -1;
+
+end:
+	loudness_releaseAnalysis( &an );
+	free( an.data );
+	free( sources );
+
+	return rc;
+}
+
+
+
+static void loudness_runPool( struct loudnessPool *pool )
+{
+	for (;;) {
+
+#ifdef LIBAAF_THREADS
+		pthread_mutex_lock( &pool->mutex );
+#endif
+
+		size_t i = pool->next;
+
+		if ( i < pool->count ) {
+			pool->next++;
+		}
+
+#ifdef LIBAAF_THREADS
+		pthread_mutex_unlock( &pool->mutex );
+#endif
+
+		if ( i >= pool->count ) {
+			break;
+		}
+
+		/* every essence is only measured by one thread, and nothing reads its loudness meanwhile */
+
+		pool->essences[i]->loudness = loudness_analyze( pool->aafi, pool->essences[i] );
+
+		if ( !pool->essences[i]->loudness ) {
+
+#ifdef LIBAAF_THREADS
+			pthread_mutex_lock( &pool->mutex );
+#endif
+
+			pool->rc = -1;
+
+#ifdef LIBAAF_THREADS
+			pthread_mutex_unlock( &pool->mutex );
+#endif
+		}
+	}
+}
+
+
+
+#ifdef LIBAAF_THREADS
+
+static void * loudnessWorker( void *arg )
+{
+	loudness_runPool( arg );
+
+	return NULL;
+}
+
+#endif
+
+
+
+/*
+ * Coefficients of ITU-R BS.1770 filters, computed for any sample rate from
+ * their analog prototypes. At 48 kHz, they match the ones given by BS.1770.
+ */
+
+static void loudness_setKWeighting( struct kweighting *kw, double samplerate )
+{
+	double f0 = 1681.974450955533;
+	double G  = 3.999843853973347;
+	double Q  = 0.7071752369554196;
+
+	double K  = tan( LOUDNESS_PI * f0 / samplerate );
+	double Vh = pow( 10.0, G / 20.0 );
+	double Vb = pow( Vh, 0.4996667741545416 );
+	double a0 = 1.0 + K / Q + K * K;
+
+	kw->pre[0] = ( Vh + Vb * K / Q + K * K ) / a0;
+	kw->pre[1] = 2.0 * ( K * K - Vh ) / a0;
+	kw->pre[2] = ( Vh - Vb * K / Q + K * K ) / a0;
+	kw->pre[3] = 2.0 * ( K * K - 1.0 ) / a0;
+	kw->pre[4] = ( 1.0 - K / Q + K * K ) / a0;
+
+	f0 = 38.13547087602444;
+	Q  = 0.5003270373238773;
+	K  = tan( LOUDNESS_PI * f0 / samplerate );
+	a0 = 1.0 + K / Q + K * K;
+
+	kw->rlb[0] =  1.0;
+	kw->rlb[1] = -2.0;
+	kw->rlb[2] =  1.0;
+	kw->rlb[3] = 2.0 * ( K * K - 1.0 ) / a0;
+	kw->rlb[4] = ( 1.0 - K / Q + K * K ) / a0;
+}
+
+
+
+/*
+ * Blackman windowed sinc, cut at the input Nyquist frequency. Phases interpolate
+ * at 1/8, 3/8, 5/8 and 7/8 of a sample period, and each is normalized to a unity
+ * gain. coefs[j][p] applies to the j-th of the last LOUDNESS_TP_TAPS input samples,
+ * for phase p, so that all phases are computed at once.
+ */
+
+static void loudness_setTruePeakFilter( float coefs[LOUDNESS_TP_TAPS][LOUDNESS_TP_PHASES] )
+{
+	const int length = LOUDNESS_TP_TAPS * LOUDNESS_TP_PHASES;
+
+	double h[LOUDNESS_TP_TAPS * LOUDNESS_TP_PHASES];
+	double sum[LOUDNESS_TP_PHASES] = { 0 };
+
+	for ( int n = 0; n < length; n++ ) {
+
+		double t = ( n - ( length - 1 ) / 2.0 ) / LOUDNESS_TP_PHASES;
+		double w = 2.0 * LOUDNESS_PI * n / ( length - 1 );
+
+		h[n]  = sin( LOUDNESS_PI * t ) / ( LOUDNESS_PI * t );
+		h[n] *= 0.42 - 0.5 * cos( w ) + 0.08 * cos( 2.0 * w );
+
+		sum[n % LOUDNESS_TP_PHASES] += h[n];
+	}
+
+	for ( int j = 0; j < LOUDNESS_TP_TAPS; j++ ) {
+		for ( int p = 0; p < LOUDNESS_TP_PHASES; p++ ) {
+			int n = p + LOUDNESS_TP_PHASES * ( LOUDNESS_TP_TAPS - 1 - j );
+			coefs[j][p] = (float)( h[n] / sum[p] );
+		}
+	}
+}
+
+
+
+/*
+ * Filters samples of a channel through K-weighting, adding the sums of squares
+ * of filtered and unfiltered samples to energy and squares. state holds the
+ * transposed direct form II state of both biquads.
+ */
+
+static void loudness_filter( const struct kweighting *kw, double *state, const float *src, size_t frames, double *energy, double *squares )
+{
+	double z0 = state[0];
+	double z1 = state[1];
+	double z2 = state[2];
+	double z3 = state[3];
+
+	double e = 0;
+	double s = 0;
+
+	for ( size_t i = 0; i < frames; i++ ) {
+
+		double x = src[i];
+		double y = kw->pre[0] * x + z0;
+
+		z0 = kw->pre[1] * x - kw->pre[3] * y + z1;
+		z1 = kw->pre[2] * x - kw->pre[4] * y;
+
+		double k = kw->rlb[0] * y + z2;
+
+		z2 = kw->rlb[1] * y - kw->rlb[3] * k + z3;
+		z3 = kw->rlb[2] * y - kw->rlb[4] * k;
+
+		e += k * k;
+		s += x * x;
+	}
+
+	state[0] = z0;
+	state[1] = z1;
+	state[2] = z2;
+	state[3] = z3;
+
+	*energy  += e;
+	*squares += s;
+}
+
+
+
+/*
+ * Same as loudness_filter(), for two channels at once. state, energy and squares
+ * are those of the first channel, followed by those of the second one.
+ */
+
+static void loudness_filterPair( const struct kweighting *kw, double *state, const float *src0, const float *src1, size_t frames, double *energy, double *squares )
+{
+#if defined(__SSE2__)
+
+	__m128d pb0 = _mm_set1_pd( kw->pre[0] );
+	__m128d pb1 = _mm_set1_pd( kw->pre[1] );
+	__m128d pb2 = _mm_set1_pd( kw->pre[2] );
+	__m128d pa1 = _mm_set1_pd( kw->pre[3] );
+	__m128d pa2 = _mm_set1_pd( kw->pre[4] );
+	__m128d rb0 = _mm_set1_pd( kw->rlb[0] );
+	__m128d rb1 = _mm_set1_pd( kw->rlb[1] );
+	__m128d rb2 = _mm_set1_pd( kw->rlb[2] );
+	__m128d ra1 = _mm_set1_pd( kw->rlb[3] );
+	__m128d ra2 = _mm_set1_pd( kw->rlb[4] );
+
+	__m128d z0 = _mm_set_pd( state[4], state[0] );
+	__m128d z1 = _mm_set_pd( state[5], state[1] );
+	__m128d z2 = _mm_set_pd( state[6], state[2] );
+	__m128d z3 = _mm_set_pd( state[7], state[3] );
+
+	__m128d e = _mm_setzero_pd();
+	__m128d s = _mm_setzero_pd();
+
+	for ( size_t i = 0; i < frames; i++ ) {
+
+		__m128d x = _mm_set_pd( src1[i], src0[i] );
+		__m128d y = _mm_add_pd( _mm_mul_pd( pb0, x ), z0 );
+
+		z0 = _mm_add_pd( _mm_sub_pd( _mm_mul_pd( pb1, x ), _mm_mul_pd( pa1, y ) ), z1 );
+		z1 = _mm_sub_pd( _mm_mul_pd( pb2, x ), _mm_mul_pd( pa2, y ) );
+
+		__m128d k = _mm_add_pd( _mm_mul_pd( rb0, y ), z2 );
+
+		z2 = _mm_add_pd( _mm_sub_pd( _mm_mul_pd( rb1, y ), _mm_mul_pd( ra1, k ) ), z3 );
+		z3 = _mm_sub_pd( _mm_mul_pd( rb2, y ), _mm_mul_pd( ra2, k ) );
+
+		e = _mm_add_pd( e, _mm_mul_pd( k, k ) );
+		s = _mm_add_pd( s, _mm_mul_pd( x, x ) );
+	}
+
+	double lanes[2];
+
+	_mm_storeu_pd( lanes, z0 ); state[0] = lanes[0]; state[4] = lanes[1];
+	_mm_storeu_pd( lanes, z1 ); state[1] = lanes[0]; state[5] = lanes[1];
+	_mm_storeu_pd( lanes, z2 ); state[2] = lanes[0]; state[6] = lanes[1];
+	_mm_storeu_pd( lanes, z3 ); state[3] = lanes[0]; state[7] = lanes[1];
+
+	_mm_storeu_pd( energy,  _mm_add_pd( _mm_loadu_pd( energy ), e ) );
+	_mm_storeu_pd( squares, _mm_add_pd( _mm_loadu_pd( squares ), s ) );
+
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+
+	float64x2_t pb0 = vdupq_n_f64( kw->pre[0] );
+	float64x2_t pb1 = vdupq_n_f64( kw->pre[1] );
+	float64x2_t pb2 = vdupq_n_f64( kw->pre[2] );
+	float64x2_t pa1 = vdupq_n_f64( kw->pre[3] );
+	float64x2_t pa2 = vdupq_n_f64( kw->pre[4] );
+	float64x2_t rb0 = vdupq_n_f64( kw->rlb[0] );
+	float64x2_t rb1 = vdupq_n_f64( kw->rlb[1] );
+	float64x2_t rb2 = vdupq_n_f64( kw->rlb[2] );
+	float64x2_t ra1 = vdupq_n_f64( kw->rlb[3] );
+	float64x2_t ra2 = vdupq_n_f64( kw->rlb[4] );
+
+	double lanes[2];
+
+	lanes[0] = state[0]; lanes[1] = state[4]; float64x2_t z0 = vld1q_f64( lanes );
+	lanes[0] = state[1]; lanes[1] = state[5]; float64x2_t z1 = vld1q_f64( lanes );
+	lanes[0] = state[2]; lanes[1] = state[6]; float64x2_t z2 = vld1q_f64( lanes );
+	lanes[0] = state[3]; lanes[1] = state[7]; float64x2_t z3 = vld1q_f64( lanes );
+
+	float64x2_t e = vdupq_n_f64( 0 );
+	float64x2_t s = vdupq_n_f64( 0 );
+
+	for ( size_t i = 0; i < frames; i++ ) {
+
+		lanes[0] = src0[i];
+		lanes[1] = src1[i];
+
+		float64x2_t x = vld1q_f64( lanes );
+		float64x2_t y = vaddq_f64( vmulq_f64( pb0, x ), z0 );
+
+		z0 = vaddq_f64( vsubq_f64( vmulq_f64( pb1, x ), vmulq_f64( pa1, y ) ), z1 );
+		z1 = vsubq_f64( vmulq_f64( pb2, x ), vmulq_f64( pa2, y ) );
+
+		float64x2_t k = vaddq_f64( vmulq_f64( rb0, y ), z2 );
+
+		z2 = vaddq_f64( vsubq_f64( vmulq_f64( rb1, y ), vmulq_f64( ra1, k ) ), z3 );
+		z3 = vsubq_f64( vmulq_f64( rb2, y ), vmulq_f64( ra2, k ) );
+
+		e = vaddq_f64( e, vmulq_f64( k, k ) );
+		s = vaddq_f64( s, vmulq_f64( x, x ) );
+	}
+
+	vst1q_f64( lanes, z0 ); state[0] = lanes[0]; state[4] = lanes[1];
+	vst1q_f64( lanes, z1 ); state[1] = lanes[0]; state[5] = lanes[1];
+	vst1q_f64( lanes, z2 ); state[2] = lanes[0]; state[6] = lanes[1];
+	vst1q_f64( lanes, z3 ); state[3] = lanes[0]; state[7] = lanes[1];
+
+	vst1q_f64( energy,  vaddq_f64( vld1q_f64( energy ), e ) );
+	vst1q_f64( squares, vaddq_f64( vld1q_f64( squares ), s ) );
+
+#else
+
+	loudness_filter( kw, state,     src0, frames, energy,     squares );
+	loudness_filter( kw, state + 4, src1, frames, energy + 1, squares + 1 );
+
+#endif
+}
+
+
+
+/*
+ * Returns the highest absolute value of the 4x interpolated signal, between
+ * src[LOUDNESS_TP_HISTORY - 1] and src[LOUDNESS_TP_HISTORY + frames - 1].
+ */
+
+static float loudness_truePeak( float coefs[LOUDNESS_TP_TAPS][LOUDNESS_TP_PHASES], const float *src, size_t frames )
+{
+	float peak = 0.0f;
+
+#if defined(__SSE2__)
+
+	__m128 c[LOUDNESS_TP_TAPS];
+
+	for ( int j = 0; j < LOUDNESS_TP_TAPS; j++ ) {
+		c[j] = _mm_loadu_ps( coefs[j] );
+	}
+
+	__m128 sign = _mm_set1_ps( -0.0f );
+	__m128 max  = _mm_setzero_ps();
+
+	for ( size_t i = 0; i < frames; i++ ) {
+
+		__m128 acc = _mm_mul_ps( _mm_set1_ps( src[i] ), c[0] );
+
+		for ( int j = 1; j < LOUDNESS_TP_TAPS; j++ ) {
+			acc = _mm_add_ps( acc, _mm_mul_ps( _mm_set1_ps( src[i + (size_t)j] ), c[j] ) );
+		}
+
+		max = _mm_max_ps( max, _mm_andnot_ps( sign, acc ) );
+	}
+
+	float lanes[4];
+
+	_mm_storeu_ps( lanes, max );
+
+	for ( int p = 0; p < 4; p++ ) {
+		peak = ( lanes[p] > peak ) ? lanes[p] : peak;
+	}
+
+#elif defined(__ARM_NEON)
+
+	float32x4_t c[LOUDNESS_TP_TAPS];
+
+	for ( int j = 0; j < LOUDNESS_TP_TAPS; j++ ) {
+		c[j] = vld1q_f32( coefs[j] );
+	}
+
+	float32x4_t max = vdupq_n_f32( 0.0f );
+
+	for ( size_t i = 0; i < frames; i++ ) {
+
+		float32x4_t acc = vmulq_n_f32( c[0], src[i] );
+
+		for ( int j = 1; j < LOUDNESS_TP_TAPS; j++ ) {
+			acc = vmlaq_n_f32( acc, c[j], src[i + (size_t)j] );
+		}
+
+		max = vmaxq_f32( max, vabsq_f32( acc ) );
+	}
+
+	float lanes[4];
+
+	vst1q_f32( lanes, max );
+
+	for ( int p = 0; p < 4; p++ ) {
+		peak = ( lanes[p] > peak ) ? lanes[p] : peak;
+	}
+
+#else
+
+	for ( size_t i = 0; i < frames; i++ ) {
+		for ( int p = 0; p < LOUDNESS_TP_PHASES; p++ ) {
+
+			float acc = 0.0f;
+
+			for ( int j = 0; j < LOUDNESS_TP_TAPS; j++ ) {
+				acc += src[i + (size_t)j] * coefs[j][p];
+			}
+
+			acc  = ( acc < 0.0f ) ? -acc : acc;
+			peak = ( acc > peak ) ? acc : peak;
+		}
+	}
+
+#endif
+
+	return peak;
+}
+
+
+
+/*
+ * Filter states decaying after a signal would end up as denormal numbers, which
+ * are very slow to compute with. They are set to zero long before, at about
+ * -300 dB.
+ */
+
+static void loudness_flushState( double *state, size_t count )
+{
+	for ( size_t i = 0; i < count; i++ ) {
+		if ( fabs( state[i] ) < 1e-15 ) {
+			state[i] = 0;
+		}
+	}
+}
+
+
+
+static uint64_t loudness_stepFrames( const struct aafiLoudnessData *data, uint64_t step )
+{
+	uint64_t pos = step * data->stepFrames;
+
+	return ( data->frameCount - pos < data->stepFrames ) ? data->frameCount - pos : data->stepFrames;
+}
+
+
+
+/*
+ * ITU-R BS.1770 channel weights. 6 channels are taken as L R C LFE Ls Rs.
+ */
+
+static double loudness_channelWeight( uint32_t channel, uint32_t channels )
+{
+	if ( channels == 6 ) {
+		if ( channel == 3 ) {
+			return 0.0;
+		}
+		if ( channel >= 4 ) {
+			return 1.41;
+		}
+	}
+
+	return 1.0;
+}
+
+
+
+static double loudness_lufs( double power )
+{
+	return ( power > 0 ) ? -0.691 + 10.0 * log10( power ) : -HUGE_VAL;
+}
+
+
+
+static double loudness_db( double value )
+{
+	return ( value > 0 ) ? 20.0 * log10( value ) : -HUGE_VAL;
+}
+
+
+
+/*
+ * Computes measures over stepCount steps of every source, from their own first
+ * step. Windows shorter than the range are measured as a single window.
+ */
+
+static int loudness_measure( AAF_Iface *aafi, struct loudnessSource *sources, uint32_t count, uint64_t stepCount, aafiLoudness *loudness )
+{
+	if ( count == 0 || stepCount == 0 ) {
+		error( "Can't measure an empty range" );
+		return -1;
+	}
+
+	double *power  = malloc( (size_t)stepCount * sizeof(double) );
+	double *frames = malloc( (size_t)stepCount * sizeof(double) );
+
+	uint64_t blockSteps = ( stepCount < LOUDNESS_BLOCK_STEPS ) ? stepCount : LOUDNESS_BLOCK_STEPS;
+	uint64_t blockCount = stepCount - blockSteps + 1;
+
+	double *blocks = malloc( (size_t)blockCount * sizeof(double) );
+
+	if ( !power || !frames || !blocks ) {
+		error( "Out of memory" );
+		free( power );
+		free( frames );
+		free( blocks );
+		return -1;
+	}
+
+	memset( loudness, 0x00, sizeof(aafiLoudness) );
+
+	loudness->channels = count;
+
+
+	/* weighted energy of every step, levels of every channel */
+
+	double peak = 0;
+	double truePeak = 0;
+
+	for ( uint64_t r = 0; r < stepCount; r++ ) {
+		power[r]  = 0;
+		frames[r] = (double)loudness_stepFrames( sources[0].data, sources[0].firstStep + r );
+	}
+
+	for ( uint32_t k = 0; k < count; k++ ) {
+
+		const struct aafiLoudnessData *data = sources[k].data;
+
+		double squares = 0;
+		uint64_t sampleCount = 0;
+
+		for ( uint64_t r = 0; r < stepCount; r++ ) {
+
+			uint64_t step = sources[k].firstStep + r;
+			size_t   i    = (size_t)( step * data->channels + sources[k].channel );
+
+			power[r]    += sources[k].weight * data->energy[i];
+			squares     += data->squares[i];
+			sampleCount += loudness_stepFrames( data, step );
+
+			peak     = ( data->peak[i] > peak ) ? data->peak[i] : peak;
+			truePeak = ( data->truePeak[i] > truePeak ) ? data->truePeak[i] : truePeak;
+		}
+
+		if ( k < AAFI_LOUDNESS_MAX_CHANNELS ) {
+			loudness->rms[k] = ( squares > 0 ) ? 10.0 * log10( squares / (double)sampleCount ) : -HUGE_VAL;
+		}
+	}
+
+	loudness->samplePeak = loudness_db( peak );
+	loudness->truePeak   = loudness_db( truePeak );
+
+
+	/* momentary blocks, gated for integrated loudness */
+
+	loudness->momentaryMax = -HUGE_VAL;
+
+	for ( uint64_t b = 0; b < blockCount; b++ ) {
+
+		double e = 0;
+		double n = 0;
+
+		for ( uint64_t r = b; r < b + blockSteps; r++ ) {
+			e += power[r];
+			n += frames[r];
+		}
+
+		blocks[b] = e / n;
+
+		if ( loudness_lufs( blocks[b] ) > loudness->momentaryMax ) {
+			loudness->momentaryMax = loudness_lufs( blocks[b] );
+		}
+	}
+
+	double gated = 0;
+	uint64_t gatedCount = 0;
+
+	for ( uint64_t b = 0; b < blockCount; b++ ) {
+		if ( loudness_lufs( blocks[b] ) > LOUDNESS_ABSOLUTE_GATE ) {
+			gated += blocks[b];
+			gatedCount++;
+		}
+	}
+
+	loudness->integrated = -HUGE_VAL;
+
+	if ( gatedCount > 0 ) {
+
+		double relativeGate = loudness_lufs( gated / (double)gatedCount ) + LOUDNESS_RELATIVE_GATE;
+
+		gated = 0;
+		gatedCount = 0;
+
+		for ( uint64_t b = 0; b < blockCount; b++ ) {
+
+			double lufs = loudness_lufs( blocks[b] );
+
+			if ( lufs > LOUDNESS_ABSOLUTE_GATE && lufs > relativeGate ) {
+				gated += blocks[b];
+				gatedCount++;
+			}
+		}
+
+		if ( gatedCount > 0 ) {
+			loudness->integrated = loudness_lufs( gated / (double)gatedCount );
+		}
+	}
+
+
+	/* short-term windows, as a running sum over steps */
+
+	uint64_t windowSteps = ( stepCount < LOUDNESS_SHORTTERM_STEPS ) ? stepCount : LOUDNESS_SHORTTERM_STEPS;
+
+	double e = 0;
+	double n = 0;
+
+	loudness->shortTermMax = -HUGE_VAL;
+
+	for ( uint64_t r = 0; r < stepCount; r++ ) {
+
+		e += power[r];
+		n += frames[r];
+
+		if ( r >= windowSteps ) {
+			e -= power[r - windowSteps];
+			n -= frames[r - windowSteps];
+		}
+
+		if ( r + 1 >= windowSteps && loudness_lufs( e / n ) > loudness->shortTermMax ) {
+			loudness->shortTermMax = loudness_lufs( e / n );
+		}
+	}
+
+	free( power );
+	free( frames );
+	free( blocks );
+
+	return 0;
+}
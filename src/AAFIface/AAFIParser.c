@@ -44,6 +44,10 @@
 #include <limits.h>
 #include <assert.h>
 
+#ifdef LIBAAF_THREADS
+#include <pthread.h>
+#endif
+
 #include  <libaaf/AAFDefs/AAFClassDefUIDs.h>
 #include  <libaaf/AAFDefs/AAFPropertyIDs.h>
 #include  <libaaf/AAFDefs/AAFDataDefs.h>
@@ -67,6 +71,8 @@
 #include <libaaf/utils.h>
 #include <libaaf/log.h>
 
+#include "RIFFParser.h"
+
 
 
 #define debug( ... ) \
@@ -147,6 +153,37 @@ static int parse_EssenceData( AAF_Iface *aafi, aafObject *EssenceData, td *__ptd
 static int retrieve_UserComments( AAF_Iface *aafi, aafObject *UserComments, aafiMetaData **metadataList );
 static int retrieve_ControlPoints( AAF_Iface *aafi, aafObject *Points, aafRational_t *times[], aafRational_t *values[] );
 
+static int retrieve_Composition( AAF_Iface *aafi, aafObject *CompositionMob );
+static int set_default_Timecode( AAF_Iface *aafi );
+static void composition_post_processing( AAF_Iface *aafi, AAF_Iface *compositionAafi );
+
+
+
+#ifdef LIBAAF_THREADS
+
+/*
+ * Shared state of the threads parsing compositions other than the main one.
+ * Each composition is parsed into its own AAF_Iface. Essences already known
+ * to the main AAF_Iface are looked up from its index, which is read-only
+ * until every thread has completed. New essences are created into the
+ * composition AAF_Iface, then merged by aafi_mergeCompositionEssences().
+ */
+
+typedef struct aafiCompositionPool {
+
+	aafiComposition **compositions;
+	uint32_t          count;
+	uint32_t          next;
+
+	pthread_mutex_t   mutex;
+
+} aafiCompositionPool;
+
+static int retrieve_CompositionsParallel( AAF_Iface *aafi, aafiComposition **compositions, uint32_t count );
+static void * retrieveCompositionWorker( void *arg );
+
+#endif
+
 
 
 
@@ -938,7 +975,7 @@ static int parse_SourceClip( AAF_Iface *aafi, aafObject *SourceClip, td *__ptd )
 		targetMob = aaf_get_MobByID( aafi->aafd->Mobs, sourceID );
 
 		if ( !targetMob ) {
-			TRACE_OBJ_ERROR( aafi, SourceClip, &__td, "Could not retrieve target Mob by ID : %s", aaft_MobIDToText(sourceID) );
+			TRACE_OBJ_ERROR( aafi, SourceClip, &__td, "Could not retrieve target Mob by ID : %s", aaft_MobIDToText( aafi->aafd, sourceID ) );
 			return -1;
 		}
 
@@ -1227,6 +1264,28 @@ static int parse_SourceClip( AAF_Iface *aafi, aafObject *SourceClip, td *__ptd )
 				return -1;
 			}
 
+			/*
+			 * The Length of a speed controlled clip is a count of source frames. The
+			 * length it takes on the track is the one of its VideoSpeedControl
+			 * OperationGroup.
+			 */
+
+			aafLength_t trackLength = *length;
+
+			aafObject *OpGroup = aaf_get_ObjectAncestor( SourceClip, &AAFClassID_OperationGroup );
+
+			if ( OpGroup && aaf_get_ObjectAncestor( OpGroup, &AAFClassID_Mob ) == ParentMob ) {
+
+				aafWeakRef_t *OperationDefWeakRef = aaf_get_propertyValue( OpGroup, PID_OperationGroup_Operation, &AAFTypeID_OperationDefinitionWeakReference );
+				aafLength_t  *opGroupLength       = aaf_get_propertyValue( OpGroup, PID_Component_Length, &AAFTypeID_LengthType );
+
+				if ( OperationDefWeakRef && opGroupLength &&
+				     aafUIDCmp( aaf_get_OperationIdentificationByWeakRef( aafi->aafd, OperationDefWeakRef ), &AAFOperationDef_VideoSpeedControl ) )
+				{
+					trackLength = *opGroupLength;
+				}
+			}
+
 			/* Add the new clip */
 
 			aafiVideoClip *videoClip = aafi_newVideoClip( aafi, aafi->Video->Tracks );
@@ -1234,10 +1293,10 @@ static int parse_SourceClip( AAF_Iface *aafi, aafObject *SourceClip, td *__ptd )
 			aafiTimelineItem *timelineItem = videoClip->timelineItem;
 
 			timelineItem->pos = aafi->Video->Tracks->current_pos;
-			timelineItem->len = *length;
+			timelineItem->len = trackLength;
 
 			videoClip->pos = aafi->Video->Tracks->current_pos;
-			videoClip->len = *length;
+			videoClip->len = trackLength;
 			videoClip->essence_offset = *startTime;
 
 			aafi->Video->Tracks->current_pos += videoClip->len;
@@ -1305,21 +1364,24 @@ static int parse_SourceClip( AAF_Iface *aafi, aafObject *SourceClip, td *__ptd )
 			 * Check if this Essence has already been retrieved
 			 */
 
-			aafiAudioEssenceFile *audioEssenceFile = NULL;
+			aafiAudioEssenceFile *audioEssenceFile = aafi_getAudioEssence( aafi, sourceID, *SourceMobSlotID );
 
-			AAFI_foreachAudioEssenceFile( aafi, audioEssenceFile ) {
-				if ( aafMobIDCmp( audioEssenceFile->sourceMobID, sourceID ) && audioEssenceFile->sourceMobSlotID == (unsigned)*SourceMobSlotID ) {
-					__td.eob = 1;
-					TRACE_OBJ_INFO( aafi, SourceClip, &__td, "Essence already parsed: Linking with %s", audioEssenceFile->name );
-					aafi->ctx.current_clip->essencePointerList = aafi_newAudioEssencePointer( aafi, &aafi->ctx.current_clip->essencePointerList, audioEssenceFile, essenceChannelNum );
-					return 0;
-				}
+			if ( audioEssenceFile ) {
+				__td.eob = 1;
+				TRACE_OBJ_INFO( aafi, SourceClip, &__td, "Essence already parsed: Linking with %s", audioEssenceFile->name );
+				aafi->ctx.current_clip->essencePointerList = aafi_newAudioEssencePointer( aafi, &aafi->ctx.current_clip->essencePointerList, audioEssenceFile, essenceChannelNum );
+				return 0;
 			}
 
 
 			/* new Essence, carry on. */
 
-			audioEssenceFile = aafi_newAudioEssence( aafi );
+			audioEssenceFile = aafi_newAudioEssence( aafi, sourceID, *SourceMobSlotID );
+
+			if ( !audioEssenceFile ) {
+				TRACE_OBJ_ERROR( aafi, SourceClip, &__td, "Could not create new audio essence" );
+				return -1;
+			}
 
 			audioEssenceFile->masterMobSlotID = *masterMobSlotID;
 			audioEssenceFile->masterMobID = masterMobID;
@@ -1329,14 +1391,11 @@ static int parse_SourceClip( AAF_Iface *aafi, aafObject *SourceClip, td *__ptd )
 				debug( "Missing parent Mob::Name (essence file name)" );
 			}
 
-			audioEssenceFile->sourceMobSlotID = *SourceMobSlotID;
-			audioEssenceFile->sourceMobID = sourceID;
-
 
 			aafObject *SourceMob = aaf_get_MobByID( aafi->aafd->Mobs, audioEssenceFile->sourceMobID );
 
 			if ( !SourceMob ) {
-				TRACE_OBJ_ERROR( aafi, SourceClip, &__td, "Could not retrieve SourceMob by ID : %s", aaft_MobIDToText(audioEssenceFile->sourceMobID) );
+				TRACE_OBJ_ERROR( aafi, SourceClip, &__td, "Could not retrieve SourceMob by ID : %s", aaft_MobIDToText( aafi->aafd, audioEssenceFile->sourceMobID ) );
 				return -1;
 			}
 
@@ -1391,21 +1450,24 @@ static int parse_SourceClip( AAF_Iface *aafi, aafObject *SourceClip, td *__ptd )
 			 * Check if this Essence has already been retrieved
 			 */
 
-			aafiVideoEssence *videoEssenceFile = NULL;
+			aafiVideoEssence *videoEssenceFile = aafi_getVideoEssence( aafi, sourceID, *SourceMobSlotID );
 
-			AAFI_foreachVideoEssence( aafi, videoEssenceFile ) {
-				if ( aafMobIDCmp( videoEssenceFile->sourceMobID, sourceID ) && videoEssenceFile->sourceMobSlotID == (unsigned)*SourceMobSlotID ) {
-					__td.eob = 1;
-					TRACE_OBJ_INFO( aafi, SourceClip, &__td, "Essence already parsed: Linking with %s", videoEssenceFile->name );
-					aafi->ctx.current_video_clip->Essence = videoEssenceFile;
-					return 0;
-				}
+			if ( videoEssenceFile ) {
+				__td.eob = 1;
+				TRACE_OBJ_INFO( aafi, SourceClip, &__td, "Essence already parsed: Linking with %s", videoEssenceFile->name );
+				aafi->ctx.current_video_clip->Essence = videoEssenceFile;
+				return 0;
 			}
 
 
 			/* new Essence, carry on. */
 
-			videoEssenceFile = aafi_newVideoEssence( aafi );
+			videoEssenceFile = aafi_newVideoEssence( aafi, sourceID, *SourceMobSlotID );
+
+			if ( !videoEssenceFile ) {
+				TRACE_OBJ_ERROR( aafi, SourceClip, &__td, "Could not create new video essence" );
+				return -1;
+			}
 
 			aafi->ctx.current_video_clip->Essence = videoEssenceFile;
 
@@ -1417,9 +1479,6 @@ static int parse_SourceClip( AAF_Iface *aafi, aafObject *SourceClip, td *__ptd )
 				debug( "Missing parent Mob::Name (essence file name)" );
 			}
 
-			videoEssenceFile->sourceMobSlotID = *SourceMobSlotID;
-			videoEssenceFile->sourceMobID = sourceID;
-
 
 			TRACE_OBJ( aafi, SourceClip, &__td );
 
@@ -1427,7 +1486,7 @@ static int parse_SourceClip( AAF_Iface *aafi, aafObject *SourceClip, td *__ptd )
 			aafObject *SourceMob = aaf_get_MobByID( aafi->aafd->Mobs, videoEssenceFile->sourceMobID );
 
 			if ( !SourceMob ) {
-				TRACE_OBJ_ERROR( aafi, SourceClip, &__td, "Could not retrieve SourceMob by ID : %s", aaft_MobIDToText(videoEssenceFile->sourceMobID) );
+				TRACE_OBJ_ERROR( aafi, SourceClip, &__td, "Could not retrieve SourceMob by ID : %s", aaft_MobIDToText( aafi->aafd, videoEssenceFile->sourceMobID ) );
 				return -1;
 			}
 
@@ -1583,6 +1642,7 @@ static int parse_DescriptiveMarker( AAF_Iface *aafi, aafObject *DescriptiveMarke
 		name = aaf_get_propertyValue( DescriptiveMarker, aaf_get_PropertyIDByName( aafi->aafd, "CommentMarkerUSer" ), &AAFTypeID_String );
 	}
 
+	uint16_t color[3];
 	uint16_t *RGBColor = NULL;
 	aafProperty *RGBColorProp = aaf_get_property( DescriptiveMarker, aaf_get_PropertyIDByName( aafi->aafd, "CommentMarkerColor" ) );
 
@@ -1592,12 +1652,18 @@ static int parse_DescriptiveMarker( AAF_Iface *aafi, aafObject *DescriptiveMarke
 			error( "CommentMarkerColor has wrong size: %u", RGBColorProp->len );
 		}
 		else {
-			RGBColor = RGBColorProp->val;
+			/*
+			 * Property value is left untouched, since Objects are shared by
+			 * threads parsing compositions.
+			 */
+			memcpy( color, RGBColorProp->val, sizeof(color) );
 
 			/* big endian to little endian */
-			RGBColor[0] = (RGBColor[0]>>8) | (RGBColor[0]<<8);
-			RGBColor[1] = (RGBColor[1]>>8) | (RGBColor[1]<<8);
-			RGBColor[2] = (RGBColor[2]>>8) | (RGBColor[2]<<8);
+			color[0] = (uint16_t)((color[0]>>8) | (color[0]<<8));
+			color[1] = (uint16_t)((color[1]>>8) | (color[1]<<8));
+			color[2] = (uint16_t)((color[2]>>8) | (color[2]<<8));
+
+			RGBColor = color;
 		}
 	}
 
@@ -2734,6 +2800,9 @@ static int parse_PCMDescriptor( AAF_Iface *aafi, aafObject *PCMDescriptor, td *_
 
 	audioEssenceFile->type = AAFI_ESSENCE_TYPE_PCM;
 
+	/* PCMDescriptor essence data is raw integer PCM, without any header */
+	audioEssenceFile->formatTag = RIFF_WAVE_FORMAT_PCM;
+
 
 
 	/* Duration of the essence in sample units (not edit units !) */
@@ -3086,15 +3155,25 @@ static int parse_EssenceData( AAF_Iface *aafi, aafObject *EssenceData, td *__ptd
 		goto err;
 	}
 
+	/*
+	 * EssenceData path is built into the AAF_Data text buffer shared by threads
+	 * parsing compositions, which is guarded by the log lock.
+	 */
+	laaf_lock_log( aafi->log );
+
 	char *path = aaf_get_ObjectPath( EssenceData );
 
+	if ( path ) {
+		dataPath = laaf_util_build_path( AAF_DIR_SEP_STR, path, streamName, NULL );
+	}
+
+	laaf_unlock_log( aafi->log );
+
 	if ( !path ) {
 		TRACE_OBJ_ERROR( aafi, EssenceData, &__td, "Could not retrieve EssenceData node path" );
 		goto err;
 	}
 
-	dataPath = laaf_util_build_path( AAF_DIR_SEP_STR, path, streamName, NULL );
-
 	if ( !dataPath ) {
 		TRACE_OBJ_ERROR( aafi, EssenceData, &__td, "Could not build Data stream path" );
 		goto err;
@@ -3290,7 +3369,8 @@ static int retrieve_ControlPoints( AAF_Iface *aafi, aafObject *Points, aafRation
 int aafi_retrieveData( AAF_Iface *aafi )
 {
 	/* this __td is only here for debug/error, normal trace is printed from parse_Mob() */
-	static td __td;
+	td __td;
+	memset( &__td, 0x00, sizeof(td) );
 	__td.fn = __LINE__;
 	__td.pfn = 0;
 	__td.lv = 0;
@@ -3333,7 +3413,22 @@ int aafi_retrieveData( AAF_Iface *aafi )
 		}
 
 		if ( compositionMobParsed ) {
-			TRACE_OBJ_ERROR( aafi, Mob, &__td, "Multiple top level CompositionMob not supported yet" );
+
+			if ( !aafUIDCmp( UsageCode, &AAFUsage_TopLevel ) ) {
+				TRACE_OBJ_ERROR( aafi, Mob, &__td, "Multiple top level CompositionMob not supported yet" );
+				continue;
+			}
+
+			/* parsed later, into its own AAF_Iface */
+			if ( !aafi_newComposition( aafi, Mob ) ) {
+				TRACE_OBJ_ERROR( aafi, Mob, &__td, "Could not create new composition" );
+			}
+
+			continue;
+		}
+
+		if ( aafUIDCmp( UsageCode, &AAFUsage_TopLevel ) && !aafi_newComposition( aafi, Mob ) ) {
+			TRACE_OBJ_ERROR( aafi, Mob, &__td, "Could not create new composition" );
 			continue;
 		}
 
@@ -3353,24 +3448,70 @@ int aafi_retrieveData( AAF_Iface *aafi )
 	free(__td.ll);
 
 
+	if ( !aafi->Compositions && aafi->ctx.TopLevelCompositionMob ) {
+		/* no AAFUsage_TopLevel CompositionMob, but a composition was parsed anyway */
+		aafi_newComposition( aafi, aafi->ctx.TopLevelCompositionMob );
+	}
 
-	if ( aafi->Timecode == NULL ) {
-		/* TODO, shouldn't we leave aafi->Timecode as NULL ? */
-		warning( "No timecode found in file. Setting to 00:00:00:00 @ 25fps" );
 
-		aafiTimecode *tc = calloc( 1, sizeof(aafiTimecode) );
+	if ( set_default_Timecode( aafi ) < 0 ) {
+		return -1;
+	}
+
+
+
+	/*
+	 * Other compositions are retrieved into their own AAF_Iface, concurrently
+	 * when possible. Essences they share with the main composition are already
+	 * indexed, so they are looked up from the main AAF_Iface.
+	 */
 
-		if ( !tc ) {
+	if ( aafi->compositionCount > 1 ) {
+
+		aafiComposition **compositions = calloc( (size_t)aafi->compositionCount - 1, sizeof(aafiComposition*) );
+
+		if ( !compositions ) {
 			error( "Out of memory" );
 			return -1;
 		}
 
-		tc->start      = 0;
-		tc->fps        = 25;
-		tc->drop       = 0;
-		tc->edit_rate  = &AAFI_DEFAULT_TC_EDIT_RATE;
+		uint32_t count = 0;
+		aafiComposition *composition = NULL;
+
+		AAFI_foreachComposition( aafi, composition ) {
+			if ( composition->aafi != aafi ) {
+				compositions[count++] = composition;
+			}
+		}
+
+		int parallel = ( count > 1 &&
+		                 aafi->ctx.options.threads > 1 &&
+		                 !aafi->ctx.options.trace &&
+		                 !aafi->ctx.options.dump_meta &&
+		                 !aafi->ctx.options.dump_tagged_value &&
+		                 !aafi->ctx.options.dump_class_aaf_properties &&
+		                 !aafi->ctx.options.dump_class_raw_properties );
+
+#ifdef LIBAAF_THREADS
+		if ( parallel && retrieve_CompositionsParallel( aafi, compositions, count ) < 0 ) {
+			parallel = 0;
+		}
+#else
+		parallel = 0;
+#endif
+
+		for ( uint32_t c = 0; c < count; c++ ) {
+
+			if ( !parallel ) {
+				retrieve_Composition( compositions[c]->aafi, compositions[c]->Mob );
+			}
 
-		aafi->Timecode = tc;
+			if ( aafi_mergeCompositionEssences( aafi, compositions[c]->aafi ) < 0 ) {
+				error( "Could not merge essences of composition %u", c+2 );
+			}
+		}
+
+		free( compositions );
 	}
 
 
@@ -3538,21 +3679,168 @@ int aafi_retrieveData( AAF_Iface *aafi )
 	free( commonPathPart );
 
 
+	aafiComposition *composition = NULL;
+
+	AAFI_foreachComposition( aafi, composition ) {
+		composition_post_processing( aafi, composition->aafi );
+	}
+
+	if ( !aafi->Compositions ) {
+		composition_post_processing( aafi, aafi );
+	}
+
+	return 0;
+}
+
+
+
+static int retrieve_Composition( AAF_Iface *aafi, aafObject *CompositionMob )
+{
+	td __td;
+	memset( &__td, 0x00, sizeof(td) );
+	__td.fn = __LINE__;
+	__td.pfn = 0;
+	__td.lv = 0;
+	__td.ll = calloc( 1024, sizeof(int) );
+	if ( !__td.ll ) {
+		error( "Out of memory" );
+		return -1;
+	}
+	__td.ll[0] = 0;
+
+	RESET_CONTEXT( aafi->ctx );
+
+	parse_Mob( aafi, CompositionMob, &__td );
+
+	free( __td.ll );
+
+	return set_default_Timecode( aafi );
+}
+
+
+
+static int set_default_Timecode( AAF_Iface *aafi )
+{
+	if ( aafi->Timecode != NULL ) {
+		return 0;
+	}
+
+	/* TODO, shouldn't we leave aafi->Timecode as NULL ? */
+	warning( "No timecode found in file. Setting to 00:00:00:00 @ 25fps" );
+
+	aafiTimecode *tc = calloc( 1, sizeof(aafiTimecode) );
+
+	if ( !tc ) {
+		error( "Out of memory" );
+		return -1;
+	}
+
+	tc->start      = 0;
+	tc->fps        = 25;
+	tc->drop       = 0;
+	tc->edit_rate  = &AAFI_DEFAULT_TC_EDIT_RATE;
+
+	aafi->Timecode = tc;
+
+	return 0;
+}
+
+
+
+#ifdef LIBAAF_THREADS
+
+static int retrieve_CompositionsParallel( AAF_Iface *aafi, aafiComposition **compositions, uint32_t count )
+{
+	aafiCompositionPool pool;
+	pthread_t *threads = NULL;
+
+	uint32_t threadCount = ( (uint32_t)aafi->ctx.options.threads < count ) ? (uint32_t)aafi->ctx.options.threads : count;
+
+	memset( &pool, 0x00, sizeof(aafiCompositionPool) );
+
+	pool.compositions = compositions;
+	pool.count = count;
+
+	threads = calloc( threadCount - 1, sizeof(pthread_t) );
+
+	if ( !threads ) {
+		error( "Out of memory" );
+		return -1;
+	}
+
+	pthread_mutex_init( &pool.mutex, NULL );
+
+
+	uint32_t started = 0;
+
+	for ( started = 0; started + 1 < threadCount; started++ ) {
+
+		int err = pthread_create( &threads[started], NULL, retrieveCompositionWorker, &pool );
+
+		if ( err != 0 ) {
+			warning( "Could not start thread : %s. Continuing with %u threads.", strerror(err), started+1 );
+			break;
+		}
+	}
+
+	retrieveCompositionWorker( &pool );
+
+	for ( uint32_t i = 0; i < started; i++ ) {
+		pthread_join( threads[i], NULL );
+	}
+
+	pthread_mutex_destroy( &pool.mutex );
+
+	free( threads );
+
+	return 0;
+}
+
+
+
+static void * retrieveCompositionWorker( void *arg )
+{
+	aafiCompositionPool *pool = arg;
+
+	while ( 1 ) {
+
+		pthread_mutex_lock( &pool->mutex );
+
+		uint32_t index = pool->next++;
+
+		pthread_mutex_unlock( &pool->mutex );
+
+		if ( index >= pool->count ) {
+			break;
+		}
+
+		retrieve_Composition( pool->compositions[index]->aafi, pool->compositions[index]->Mob );
+	}
+
+	return NULL;
+}
+
+#endif
+
+
+
+static void composition_post_processing( AAF_Iface *aafi, AAF_Iface *compositionAafi )
+{
 	aafPosition_t trackEnd = 0;
 	aafiAudioTrack *audioTrack = NULL;
 
-	AAFI_foreachAudioTrack( aafi, audioTrack ) {
+	AAFI_foreachAudioTrack( compositionAafi, audioTrack ) {
 
-		if ( aafi->compositionLength_editRate ) {
-			trackEnd = aafi_convertUnit( audioTrack->current_pos, audioTrack->edit_rate, aafi->compositionLength_editRate );
+		if ( compositionAafi->compositionLength_editRate ) {
+			trackEnd = aafi_convertUnit( audioTrack->current_pos, audioTrack->edit_rate, compositionAafi->compositionLength_editRate );
 		} else {
 			trackEnd = audioTrack->current_pos;
 		}
 
-		if ( trackEnd > aafi->compositionLength ) {
+		if ( trackEnd > compositionAafi->compositionLength ) {
 			debug( "Setting compositionLength with audio track \"%s\" (%u) : %"PRIi64, audioTrack->name, audioTrack->number, audioTrack->current_pos );
-			aafi->compositionLength = audioTrack->current_pos;
-			aafi->compositionLength_editRate = audioTrack->edit_rate;
+			compositionAafi->compositionLength = audioTrack->current_pos;
+			compositionAafi->compositionLength_editRate = audioTrack->edit_rate;
 		}
 
 		aafiTimelineItem *audioItem  = NULL;
@@ -3565,6 +3853,12 @@ int aafi_retrieveData( AAF_Iface *aafi )
 			}
 
 			audioClip = (aafiAudioClip*)audioItem->data;
+
+			if ( !audioClip->essencePointerList ) {
+				/* SourceClip parsing failed before any essence was linked to the clip */
+				continue;
+			}
+
 			audioClip->channels = aafi_getAudioEssencePointerChannelCount( audioClip->essencePointerList );
 
 			/*
@@ -3572,7 +3866,7 @@ int aafi_retrieveData( AAF_Iface *aafi )
 			 * to avoid duplication and allow to detect when multiple clips are using
 			 * the same essence.
 			 */
-			aafiAudioEssencePointer *prev = aafi_audioEssencePointer_exists_before( aafi, audioClip->essencePointerList );
+			aafiAudioEssencePointer *prev = aafi_internAudioEssencePointer( aafi, audioClip->essencePointerList );
 
 			if ( prev ) {
 				audioClip->essencePointerList = prev;
@@ -3583,27 +3877,97 @@ int aafi_retrieveData( AAF_Iface *aafi )
 
 	aafiVideoTrack *videoTrack = NULL;
 
-	AAFI_foreachVideoTrack( aafi, videoTrack ) {
+	AAFI_foreachVideoTrack( compositionAafi, videoTrack ) {
 
-		if ( aafi->compositionLength_editRate ) {
-			trackEnd = aafi_convertUnit( videoTrack->current_pos, videoTrack->edit_rate, aafi->compositionLength_editRate );
+		if ( compositionAafi->compositionLength_editRate ) {
+			trackEnd = aafi_convertUnit( videoTrack->current_pos, videoTrack->edit_rate, compositionAafi->compositionLength_editRate );
 		} else {
 			trackEnd = videoTrack->current_pos;
 		}
 
-		if ( trackEnd > aafi->compositionLength ) {
+		if ( trackEnd > compositionAafi->compositionLength ) {
 			debug( "Setting compositionLength with video track \"%s\" (%u) : %"PRIi64, videoTrack->name, videoTrack->number, videoTrack->current_pos );
-			aafi->compositionLength = videoTrack->current_pos;
-			aafi->compositionLength_editRate = videoTrack->edit_rate;
+			compositionAafi->compositionLength = videoTrack->current_pos;
+			compositionAafi->compositionLength_editRate = videoTrack->edit_rate;
 		}
 	}
 
-	aafi->compositionStart = aafi->Timecode->start;
-	aafi->compositionStart_editRate = aafi->Timecode->edit_rate;
+	compositionAafi->compositionStart = compositionAafi->Timecode->start;
+	compositionAafi->compositionStart_editRate = compositionAafi->Timecode->edit_rate;
+
+
+	if ( protools_AAF( compositionAafi ) ) {
+		protools_post_processing( compositionAafi );
+	}
+
+	if ( aafi_buildRangeIndexes( compositionAafi ) < 0 ) {
+		warning( "Could not build time-range indexes" );
+	}
+}
+
+
+
+int aafi_retrieveProbeData( AAF_Iface *aafi )
+{
+	aafObject *Mob = NULL;
+
+	/* aaf_probe() only retrieved CompositionMobs */
+	AAF_foreach_ObjectInSet( &Mob, aafi->aafd->Mobs, &AAFClassID_CompositionMob ) {
+
+		aafUID_t *UsageCode = aaf_get_propertyValue( Mob, PID_Mob_UsageCode, &AAFTypeID_UsageType );
+
+		if ( !aafUIDCmp( UsageCode, &AAFUsage_TopLevel ) && (aafUIDCmp( aafi->aafd->Header.OperationalPattern, &AAFOPDef_EditProtocol ) || UsageCode) ) {
+			continue;
+		}
+
+		if ( aafi->ctx.TopLevelCompositionMob ) {
+			warning( "Multiple top level CompositionMob not supported yet" );
+			continue;
+		}
+
+		aafi->ctx.TopLevelCompositionMob = Mob;
+		aafi->compositionName = aaf_get_propertyValue( Mob, PID_Mob_Name, &AAFTypeID_String );
 
+		aafObject *MobSlots = aaf_get_propertyValue( Mob, PID_Mob_Slots, &AAFTypeID_MobSlotStrongReferenceVector );
+		aafObject *MobSlot  = NULL;
 
-	if ( protools_AAF( aafi ) ) {
-		protools_post_processing( aafi );
+		/*
+		 * Sequence components are not retrieved by aaf_probe(), so the composition
+		 * length is the length of the longest TimelineMobSlot Segment, skipping the
+		 * timecode which usually runs way past the end of the composition.
+		 */
+
+		AAF_foreach_ObjectInSet( &MobSlot, MobSlots, &AAFClassID_TimelineMobSlot ) {
+
+			aafObject     *Segment  = aaf_get_propertyValue( MobSlot, PID_MobSlot_Segment, &AAFTypeID_SegmentStrongReference );
+			aafRational_t *editRate = aaf_get_propertyValue( MobSlot, PID_TimelineMobSlot_EditRate, &AAFTypeID_Rational );
+
+			if ( !Segment || !editRate || aafUIDCmp( Segment->Class->ID, &AAFClassID_Timecode ) ) {
+				continue;
+			}
+
+			aafLength_t *length = aaf_get_propertyValue( Segment, PID_Component_Length, &AAFTypeID_LengthType );
+
+			if ( !length ) {
+				continue;
+			}
+
+			aafPosition_t slotEnd = *length;
+
+			if ( aafi->compositionLength_editRate ) {
+				slotEnd = aafi_convertUnit( *length, editRate, aafi->compositionLength_editRate );
+			}
+
+			if ( !aafi->compositionLength_editRate || slotEnd > aafi->compositionLength ) {
+				aafi->compositionLength = *length;
+				aafi->compositionLength_editRate = editRate;
+			}
+		}
+	}
+
+	if ( !aafi->ctx.TopLevelCompositionMob ) {
+		error( "Could not retrieve top level CompositionMob" );
+		return -1;
 	}
 
 	return 0;
@@ -3636,23 +4000,12 @@ void aafi_dump_obj( AAF_Iface *aafi, aafObject *Obj, struct trace_dump *__td, in
 		}
 
 
-		char *buf = NULL;
-
 		va_start( args, fmt );
 
-		int rc = laaf_util_vsnprintf_realloc( &buf, NULL, 0, fmt, args );
+		laaf_vwrite_log( aafi->log, aafi, LOG_SRC_ID_AAF_IFACE, VERB_ERROR, __FILENAME__, func, line, fmt, args );
 
 		va_end( args );
 
-		if ( rc < 0 ) {
-			LOG_BUFFER_WRITE( log, "laaf_util_vsnprintf_realloc() error" );
-			return;
-		}
-
-		laaf_write_log( aafi->log, aafi, LOG_SRC_ID_AAF_IFACE, VERB_ERROR, __FILENAME__, func, line, buf );
-
-		free( buf );
-
 		return;
 	}
 
@@ -3741,7 +4094,7 @@ void aafi_dump_obj( AAF_Iface *aafi, aafObject *Obj, struct trace_dump *__td, in
 
 			LOG_BUFFER_WRITE( log, " MobID: %s%s%s",
 				ANSI_COLOR_DARKGREY(log),
-				(mobID) ? aaft_MobIDToText( mobID ) : "none",
+				(mobID) ? aaft_MobIDToText( aafi->aafd, mobID ) : "none",
 				ANSI_COLOR_RESET(log) );
 		}
 		else if ( aafUIDCmp( Obj->Class->ID, &AAFClassID_TimelineMobSlot ) )
@@ -0,0 +1,652 @@
+/*
+ * Copyright (C) 2017-2024 Adrien Gesta-Fline
+ *
+ * This file is part of libAAF.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+
+#include <libaaf/AAFIface.h>
+#include <libaaf/AAFIEssenceFile.h>
+#include <libaaf/AAFIPeaks.h>
+#include <libaaf/log.h>
+
+#include <libaaf/utils.h>
+#include <libaaf/sample.h>
+
+
+#define debug( ... ) \
+	AAF_LOG( aafi->log, aafi, LOG_SRC_ID_AAF_IFACE, VERB_DEBUG, __VA_ARGS__ )
+
+#define warning( ... ) \
+	AAF_LOG( aafi->log, aafi, LOG_SRC_ID_AAF_IFACE, VERB_WARNING, __VA_ARGS__ )
+
+#define error( ... ) \
+	AAF_LOG( aafi->log, aafi, LOG_SRC_ID_AAF_IFACE, VERB_ERROR, __VA_ARGS__ )
+
+
+
+/*
+ * Essences are read by chunks of this many samples per channel. It is a
+ * multiple of the finest bin size, so a bin never spans two chunks.
+ */
+#define PEAKS_CHUNK_FRAMES 16384
+
+/* each level bin covers this many bins of the previous level */
+#define PEAKS_LEVEL_RATIO 16
+
+#define PEAKS_FILE_MAGIC   "LAAFPEAK"
+#define PEAKS_FILE_VERSION 1
+
+
+static const uint32_t peaksSamplesPerBin[AAFI_PEAK_LEVELS] = { 256, 4096, 65536 };
+
+
+/*
+ * Sidecar header and entries, as stored in file. Both have no padding.
+ */
+struct peakFileHeader {
+	char        magic[8];
+	uint32_t    version;
+	uint32_t    entryCount;
+	uint32_t    levelCount;
+	uint32_t    samplesPerBin[AAFI_PEAK_LEVELS];
+};
+
+struct peakFileEntry {
+	aafMobID_t  mobID;
+	uint32_t    slotID;
+	uint32_t    channels;
+	uint64_t    frameCount;
+	uint64_t    dataOffset;
+	uint64_t    dataSize;
+};
+
+/*
+ * A mapped sidecar, shared by the peaks of every essence loaded from it.
+ */
+struct aafiPeakMap {
+	unsigned char  *data;
+	uint64_t        size;
+	uint32_t        refs;
+};
+
+
+static uint64_t peaks_dataSize( uint32_t channels, uint64_t frameCount );
+static void peaks_setLevels( aafiPeaks *peaks, const int16_t *data );
+static aafiPeaks * peaks_build( AAF_Iface *aafi, aafiAudioEssenceFile *audioEssenceFile );
+static void peaks_reduce( aafiPeaks *peaks, unsigned int level );
+static int16_t peaks_quantizeMin( float value );
+static int16_t peaks_quantizeMax( float value );
+static void peaks_release( aafiPeaks *peaks );
+
+
+
+int aafi_buildPeaks( AAF_Iface *aafi, aafiAudioEssenceFile *audioEssenceFile )
+{
+	if ( !aafi ) {
+		return -1;
+	}
+
+	if ( audioEssenceFile ) {
+
+		aafiPeaks *peaks = peaks_build( aafi, audioEssenceFile );
+
+		if ( !peaks ) {
+			return -1;
+		}
+
+		aafi_freePeaks( audioEssenceFile );
+
+		audioEssenceFile->peaks = peaks;
+
+		return 0;
+	}
+
+	int rc = 0;
+
+	AAFI_foreachAudioEssenceFile( aafi, audioEssenceFile ) {
+
+		if ( audioEssenceFile->peaks ) {
+			continue;
+		}
+
+		if ( aafi_buildPeaks( aafi, audioEssenceFile ) < 0 ) {
+			rc = -1;
+		}
+	}
+
+	return rc;
+}
+
+
+
+int aafi_writePeaks( AAF_Iface *aafi, const char *filepath )
+{
+	int rc = 0;
+
+	FILE *fp = NULL;
+	char *tmppath = NULL;
+
+	struct peakFileHeader header;
+	struct peakFileEntry entry;
+
+	static const unsigned char padding[8] = { 0 };
+
+
+	if ( !aafi || !filepath ) {
+		return -1;
+	}
+
+	memset( &header, 0x00, sizeof(header) );
+
+	memcpy( header.magic, PEAKS_FILE_MAGIC, sizeof(header.magic) );
+	header.version    = PEAKS_FILE_VERSION;
+	header.levelCount = AAFI_PEAK_LEVELS;
+
+	for ( unsigned int l = 0; l < AAFI_PEAK_LEVELS; l++ ) {
+		header.samplesPerBin[l] = peaksSamplesPerBin[l];
+	}
+
+	aafiAudioEssenceFile *audioEssenceFile = NULL;
+
+	AAFI_foreachAudioEssenceFile( aafi, audioEssenceFile ) {
+		if ( audioEssenceFile->peaks ) {
+			header.entryCount++;
+		}
+	}
+
+
+	/*
+	 * File is written aside, then moved to filepath : the sidecar being replaced
+	 * may still be mapped by peaks loaded from it.
+	 */
+
+	size_t len = strlen( filepath );
+
+	tmppath = malloc( len + sizeof(".tmp") );
+
+	if ( !tmppath ) {
+		error( "Out of memory" );
+		goto err;
+	}
+
+	memcpy( tmppath, filepath, len );
+	memcpy( tmppath + len, ".tmp", sizeof(".tmp") );
+
+	fp = laaf_util_fopen_utf8( tmppath, "wb" );
+
+	if ( !fp ) {
+		error( "Could not open peaks file for writing : %s : %s", tmppath, strerror(errno) );
+		goto err;
+	}
+
+	int ok = ( fwrite( &header, sizeof(header), 1, fp ) == 1 );
+
+	uint64_t dataOffset = sizeof(struct peakFileHeader) + (uint64_t)header.entryCount * sizeof(struct peakFileEntry);
+
+	AAFI_foreachAudioEssenceFile( aafi, audioEssenceFile ) {
+
+		aafiPeaks *peaks = audioEssenceFile->peaks;
+
+		if ( !peaks || !ok ) {
+			continue;
+		}
+
+		memset( &entry, 0x00, sizeof(entry) );
+
+		if ( audioEssenceFile->sourceMobID ) {
+			memcpy( &entry.mobID, audioEssenceFile->sourceMobID, sizeof(aafMobID_t) );
+		}
+
+		entry.slotID     = audioEssenceFile->sourceMobSlotID;
+		entry.channels   = peaks->channels;
+		entry.frameCount = peaks->frameCount;
+		entry.dataOffset = dataOffset;
+		entry.dataSize   = peaks_dataSize( peaks->channels, peaks->frameCount );
+
+		ok = ( fwrite( &entry, sizeof(entry), 1, fp ) == 1 );
+
+		dataOffset += ( entry.dataSize + 7 ) & ~(uint64_t)7;
+	}
+
+	AAFI_foreachAudioEssenceFile( aafi, audioEssenceFile ) {
+
+		aafiPeaks *peaks = audioEssenceFile->peaks;
+
+		if ( !peaks || !ok ) {
+			continue;
+		}
+
+		size_t size = (size_t)peaks_dataSize( peaks->channels, peaks->frameCount );
+
+		/* levels are contiguous, whether peaks were built or loaded */
+
+		ok = ( fwrite( peaks->levels[0].peaks, 1, size, fp ) == size );
+
+		if ( ok && size % 8 ) {
+			ok = ( fwrite( padding, 1, 8 - size % 8, fp ) == 8 - size % 8 );
+		}
+	}
+
+	if ( fclose( fp ) != 0 ) {
+		ok = 0;
+	}
+
+	fp = NULL;
+
+	if ( !ok ) {
+		error( "Could not write peaks file : %s : %s", tmppath, strerror(errno) );
+		remove( tmppath );
+		goto err;
+	}
+
+#ifdef _WIN32
+	remove( filepath );
+#endif
+
+	if ( rename( tmppath, filepath ) != 0 ) {
+		error( "Could not replace peaks file : %s : %s", filepath, strerror(errno) );
+		remove( tmppath );
+		goto err;
+	}
+
+	debug( "Wrote peaks of %u essences to %s", header.entryCount, filepath );
+
+	goto end;
+
+err:
+	rc = -1;
+
+end:
+	free( tmppath );
+
+	return rc;
+}
+
+
+
+int aafi_loadPeaks( AAF_Iface *aafi, const char *filepath )
+{
+	struct peakFileHeader header;
+	struct peakFileEntry entry;
+
+
+	if ( !aafi || !filepath ) {
+		return -1;
+	}
+
+	struct aafiPeakMap *map = calloc( 1, sizeof(struct aafiPeakMap) );
+
+	if ( !map ) {
+		error( "Out of memory" );
+		return -1;
+	}
+
+	map->data = laaf_util_map_file( filepath, &map->size );
+
+	if ( !map->data ) {
+		error( "Could not map peaks file : %s", filepath );
+		free( map );
+		return -1;
+	}
+
+	if ( map->size < sizeof(header) ) {
+		goto invalid;
+	}
+
+	memcpy( &header, map->data, sizeof(header) );
+
+	if ( memcmp( header.magic, PEAKS_FILE_MAGIC, sizeof(header.magic) ) != 0 ||
+	     header.version != PEAKS_FILE_VERSION ||
+	     header.levelCount != AAFI_PEAK_LEVELS ||
+	     header.entryCount > ( map->size - sizeof(header) ) / sizeof(struct peakFileEntry) )
+	{
+		goto invalid;
+	}
+
+	for ( unsigned int l = 0; l < AAFI_PEAK_LEVELS; l++ ) {
+		if ( header.samplesPerBin[l] != peaksSamplesPerBin[l] ) {
+			goto invalid;
+		}
+	}
+
+	int loaded = 0;
+
+	for ( uint32_t i = 0; i < header.entryCount; i++ ) {
+
+		memcpy( &entry, map->data + sizeof(header) + i * sizeof(struct peakFileEntry), sizeof(entry) );
+
+		aafiAudioEssenceFile *audioEssenceFile = aafi_getAudioEssence( aafi, &entry.mobID, entry.slotID );
+
+		if ( !audioEssenceFile ) {
+			continue;
+		}
+
+		if ( entry.channels == 0 || entry.channels > UINT16_MAX ||
+		     entry.frameCount > ((uint64_t)1 << 48) ||
+		     entry.dataOffset % 8 ||
+		     entry.dataOffset > map->size ||
+		     entry.dataSize > map->size - entry.dataOffset ||
+		     entry.dataSize != peaks_dataSize( entry.channels, entry.frameCount ) )
+		{
+			warning( "Invalid peaks of essence \"%s\" in %s", audioEssenceFile->unique_name, filepath );
+			continue;
+		}
+
+		aafiPeaks *peaks = calloc( 1, sizeof(aafiPeaks) );
+
+		if ( !peaks ) {
+			error( "Out of memory" );
+			break;
+		}
+
+		peaks->channels   = entry.channels;
+		peaks->frameCount = entry.frameCount;
+		peaks->map        = map;
+
+		peaks_setLevels( peaks, (const int16_t*)(const void*)(map->data + entry.dataOffset) );
+
+		map->refs++;
+
+		aafi_freePeaks( audioEssenceFile );
+
+		audioEssenceFile->peaks = peaks;
+
+		loaded++;
+	}
+
+	debug( "Loaded peaks of %i essences from %s", loaded, filepath );
+
+	if ( map->refs == 0 ) {
+		laaf_util_unmap_file( map->data, map->size );
+		free( map );
+	}
+
+	return loaded;
+
+invalid:
+	error( "Not a valid peaks file : %s", filepath );
+
+	laaf_util_unmap_file( map->data, map->size );
+	free( map );
+
+	return -1;
+}
+
+
+
+const aafiPeakLevel * aafi_getPeakLevel( aafiPeaks *peaks, uint64_t samplesPerPixel )
+{
+	if ( !peaks ) {
+		return NULL;
+	}
+
+	for ( unsigned int l = AAFI_PEAK_LEVELS; l > 1; l-- ) {
+		if ( peaks->levels[l-1].samplesPerBin <= samplesPerPixel ) {
+			return &peaks->levels[l-1];
+		}
+	}
+
+	return &peaks->levels[0];
+}
+
+
+
+void aafi_freePeaks( aafiAudioEssenceFile *audioEssenceFile )
+{
+	if ( !audioEssenceFile ) {
+		return;
+	}
+
+	peaks_release( audioEssenceFile->peaks );
+
+	audioEssenceFile->peaks = NULL;
+}
+
+
+
+/*
+ * Size in bytes of all levels of an essence peaks.
+ */
+
+static uint64_t peaks_dataSize( uint32_t channels, uint64_t frameCount )
+{
+	uint64_t size = 0;
+
+	for ( unsigned int l = 0; l < AAFI_PEAK_LEVELS; l++ ) {
+		uint64_t binCount = ( frameCount + peaksSamplesPerBin[l] - 1 ) / peaksSamplesPerBin[l];
+		size += binCount * channels * 2 * sizeof(int16_t);
+	}
+
+	return size;
+}
+
+
+
+static void peaks_setLevels( aafiPeaks *peaks, const int16_t *data )
+{
+	for ( unsigned int l = 0; l < AAFI_PEAK_LEVELS; l++ ) {
+
+		aafiPeakLevel *level = &peaks->levels[l];
+
+		level->samplesPerBin = peaksSamplesPerBin[l];
+		level->binCount      = ( peaks->frameCount + level->samplesPerBin - 1 ) / level->samplesPerBin;
+		level->peaks         = data;
+
+		data += level->binCount * peaks->channels * 2;
+	}
+}
+
+
+
+static aafiPeaks * peaks_build( AAF_Iface *aafi, aafiAudioEssenceFile *audioEssenceFile )
+{
+	aafiPeaks *peaks = NULL;
+
+	unsigned char *raw = NULL;
+	float *samples = NULL;
+	float *planeData = NULL;
+	unsigned char **planes = NULL;
+
+	uint16_t channels = 0;
+	uint16_t samplesize = 0;
+	uint64_t frameCount = 0;
+
+	enum laafSampleFormat format;
+
+
+	if ( aafi_getAudioSampleInfo( aafi, audioEssenceFile, &channels, &samplesize, &frameCount ) < 0 ) {
+		error( "Can't compute peaks of essence \"%s\" : audio data can't be read", audioEssenceFile->unique_name );
+		return NULL;
+	}
+
+	if ( aafi_getAudioSampleFormat( aafi, audioEssenceFile, &format ) < 0 ) {
+		error( "Can't compute peaks of %u bits samples of essence \"%s\"", samplesize, audioEssenceFile->unique_name );
+		return NULL;
+	}
+
+	if ( frameCount == 0 ) {
+		error( "Can't compute peaks of essence \"%s\" : no audio data", audioEssenceFile->unique_name );
+		return NULL;
+	}
+
+	peaks     = calloc( 1, sizeof(aafiPeaks) );
+	raw       = malloc( (size_t)PEAKS_CHUNK_FRAMES * channels * (samplesize/8) );
+	samples   = malloc( (size_t)PEAKS_CHUNK_FRAMES * channels * sizeof(float) );
+	planeData = malloc( (size_t)PEAKS_CHUNK_FRAMES * channels * sizeof(float) );
+	planes    = malloc( channels * sizeof(unsigned char*) );
+
+	if ( !peaks || !raw || !samples || !planeData || !planes ) {
+		error( "Out of memory" );
+		goto err;
+	}
+
+	peaks->channels   = channels;
+	peaks->frameCount = frameCount;
+	peaks->data       = malloc( (size_t)peaks_dataSize( channels, frameCount ) );
+
+	if ( !peaks->data ) {
+		error( "Out of memory" );
+		goto err;
+	}
+
+	peaks_setLevels( peaks, peaks->data );
+
+	for ( unsigned int c = 0; c < channels; c++ ) {
+		planes[c] = (unsigned char*)( planeData + (size_t)c * PEAKS_CHUNK_FRAMES );
+	}
+
+
+	/* finest level, from audio data */
+
+	uint32_t binSize = peaksSamplesPerBin[0];
+
+	for ( uint64_t pos = 0; pos < frameCount; pos += PEAKS_CHUNK_FRAMES ) {
+
+		size_t frames = ( frameCount - pos < PEAKS_CHUNK_FRAMES ) ? (size_t)(frameCount - pos) : PEAKS_CHUNK_FRAMES;
+
+		if ( aafi_readAudioSamples( aafi, audioEssenceFile, pos, frames, 0, raw ) != frames ) {
+			error( "Could not read essence \"%s\" at sample %"PRIu64, audioEssenceFile->unique_name, pos );
+			goto err;
+		}
+
+		laaf_sample_convert( (unsigned char*)samples, LAAF_SAMPLE_F32, raw, format, frames * channels, NULL );
+
+		if ( channels > 1 ) {
+			laaf_sample_deinterleave( planes, (unsigned char*)samples, frames, channels, sizeof(float) );
+		}
+
+		for ( unsigned int c = 0; c < channels; c++ ) {
+
+			const float *plane = ( channels > 1 ) ? planeData + (size_t)c * PEAKS_CHUNK_FRAMES : samples;
+
+			for ( size_t i = 0; i < frames; i += binSize ) {
+
+				uint64_t bin = ( pos + i ) / binSize;
+
+				float min = 0.0f;
+				float max = 0.0f;
+
+				laaf_sample_minmax( plane + i, ( frames - i < binSize ) ? frames - i : binSize, &min, &max );
+
+				peaks->data[(bin * channels + c) * 2]     = peaks_quantizeMin( min );
+				peaks->data[(bin * channels + c) * 2 + 1] = peaks_quantizeMax( max );
+			}
+		}
+	}
+
+
+	/* coarser levels, from the previous one */
+
+	for ( unsigned int l = 1; l < AAFI_PEAK_LEVELS; l++ ) {
+		peaks_reduce( peaks, l );
+	}
+
+	debug( "Computed peaks of essence \"%s\" : %"PRIu64" samples, %u channels", audioEssenceFile->unique_name, frameCount, channels );
+
+	goto end;
+
+err:
+	peaks_release( peaks );
+	peaks = NULL;
+
+end:
+	free( raw );
+	free( samples );
+	free( planeData );
+	free( planes );
+
+	return peaks;
+}
+
+
+
+/*
+ * Computes a level of built peaks from the previous one.
+ */
+
+static void peaks_reduce( aafiPeaks *peaks, unsigned int level )
+{
+	const aafiPeakLevel *src = &peaks->levels[level-1];
+	const aafiPeakLevel *dst = &peaks->levels[level];
+
+	int16_t *out = peaks->data + ( dst->peaks - peaks->data );
+
+	uint32_t channels = peaks->channels;
+
+	for ( uint64_t bin = 0; bin < dst->binCount; bin++ ) {
+
+		uint64_t first = bin * PEAKS_LEVEL_RATIO;
+		uint64_t last  = ( first + PEAKS_LEVEL_RATIO < src->binCount ) ? first + PEAKS_LEVEL_RATIO : src->binCount;
+
+		for ( uint32_t c = 0; c < channels; c++ ) {
+
+			int16_t min = src->peaks[(first * channels + c) * 2];
+			int16_t max = src->peaks[(first * channels + c) * 2 + 1];
+
+			for ( uint64_t b = first + 1; b < last; b++ ) {
+				int16_t lo = src->peaks[(b * channels + c) * 2];
+				int16_t hi = src->peaks[(b * channels + c) * 2 + 1];
+				min = ( lo < min ) ? lo : min;
+				max = ( hi > max ) ? hi : max;
+			}
+
+			out[(bin * channels + c) * 2]     = min;
+			out[(bin * channels + c) * 2 + 1] = max;
+		}
+	}
+}
+
+
+
+static int16_t peaks_quantizeMin( float value )
+{
+	float v = floorf( value * 32767.0f );
+
+	return ( v < -32768.0f ) ? -32768 : ( v > 32767.0f ) ? 32767 : (int16_t)v;
+}
+
+
+
+static int16_t peaks_quantizeMax( float value )
+{
+	float v = ceilf( value * 32767.0f );
+
+	return ( v < -32768.0f ) ? -32768 : ( v > 32767.0f ) ? 32767 : (int16_t)v;
+}
+
+
+
+static void peaks_release( aafiPeaks *peaks )
+{
+	if ( !peaks ) {
+		return;
+	}
+
+	if ( peaks->map && --peaks->map->refs == 0 ) {
+		laaf_util_unmap_file( peaks->map->data, peaks->map->size );
+		free( peaks->map );
+	}
+
+	free( peaks->data );
+	free( peaks );
+}
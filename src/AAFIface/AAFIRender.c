@@ -0,0 +1,2032 @@
+/*
+ * Copyright (C) 2017-2024 Adrien Gesta-Fline
+ *
+ * This file is part of libAAF.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <libaaf/AAFIface.h>
+#include <libaaf/AAFIRender.h>
+#include <libaaf/AAFIEnvelope.h>
+#include <libaaf/log.h>
+
+#include <libaaf/utils.h>
+#include <libaaf/sample.h>
+
+#include "RIFFParser.h"
+
+#ifdef LIBAAF_THREADS
+#include <pthread.h>
+#include <time.h>
+#endif
+
+
+#define debug( ... ) \
+	AAF_LOG( aafi->log, aafi, LOG_SRC_ID_AAF_IFACE, VERB_DEBUG, __VA_ARGS__ )
+
+#define success( ... ) \
+	AAF_LOG( aafi->log, aafi, LOG_SRC_ID_AAF_IFACE, VERB_SUCCESS, __VA_ARGS__ )
+
+#define warning( ... ) \
+	AAF_LOG( aafi->log, aafi, LOG_SRC_ID_AAF_IFACE, VERB_WARNING, __VA_ARGS__ )
+
+#define error( ... ) \
+	AAF_LOG( aafi->log, aafi, LOG_SRC_ID_AAF_IFACE, VERB_ERROR, __VA_ARGS__ )
+
+
+
+/*
+ * Tracks are rendered by blocks of this many samples per channel. Every render
+ * buffer is sized on it, so memory use does not depend on timeline length.
+ */
+#define RENDER_BLOCK_FRAMES 4096
+
+#define RENDER_HALF_PI 1.57079632679489661923
+
+/*
+ * After a seek, the read-ahead thread can't render before the reader skipped
+ * the samples rendered before it. It checks for it this often.
+ */
+#define PLAYBACK_SEEK_POLL_NS 1000000
+
+/*
+ * Playback ring positions are shared between the read-ahead thread and the audio
+ * callback without lock. A position is published once the samples before it
+ * were written (or read), and loaded before those samples are accessed.
+ */
+#ifdef LIBAAF_THREADS
+#define PLAYBACK_LOAD( ptr ) \
+	__atomic_load_n( ptr, __ATOMIC_ACQUIRE )
+
+#define PLAYBACK_STORE( ptr, value ) \
+	__atomic_store_n( ptr, value, __ATOMIC_RELEASE )
+#else
+#define PLAYBACK_LOAD( ptr ) \
+	(*(ptr))
+
+#define PLAYBACK_STORE( ptr, value ) \
+	(*(ptr) = (value))
+#endif
+
+
+/*
+ * An essence file read by a track. Embedded essences are read from their CFB
+ * stream, external ones from a read only mapping of the located file.
+ */
+struct renderSource {
+
+	aafiAudioEssenceFile  *audioEssenceFile;
+
+	cfbStreamReader        reader;
+
+	unsigned char         *map;
+	uint64_t               mapSize;
+
+	uint64_t               dataOffset;   // first byte of audio data
+	uint64_t               frameCount;   // audio data length, in samples per channel
+
+	enum laafSampleFormat  format;
+	unsigned int           samplesize;   // in bytes
+	unsigned int           channels;
+	int                    swap;         // samples are big endian
+
+	int                    rc;           // -1 if essence can't be read, clips are rendered silent
+
+	int                    resample;     // essence sample rate differs from the render one
+	struct laafResampler   resampler;
+
+	struct renderSource   *next;
+};
+
+/*
+ * Render state of a track. Planes hold the track channels of the current block.
+ */
+struct renderTrack {
+
+	AAF_Iface             *aafi;
+	aafiAudioTrack        *audioTrack;
+	aafRational_t         *samplerate;
+
+	unsigned int           channels;
+	unsigned int           busChannels;  // set when track is mixed, to pan mono tracks
+
+	aafPosition_t          end;          // end of last clip, in samples
+	aafPosition_t          length;       // time base of track gain and pan, in samples
+
+	float                 *data;
+	float                **planes;
+
+	float                 *env;          // clip envelope
+	float                 *curve;        // envelope scratch
+	float                 *trackEnv;     // track gain, if variable
+	float                 *panL;
+	float                 *panR;
+	float                 *resampled;    // a source channel, at render sample rate
+
+	float                  trackGain;    // track gain, if constant
+	int                    trackGainVariable;
+	int                    panVariable;
+	float                  panGainL;
+	float                  panGainR;
+
+	aafPosition_t          blockStart;
+	size_t                 blockFrames;
+
+	/* essence reading, grown as needed */
+	unsigned char         *raw;
+	size_t                 rawSize;
+	float                 *decoded;
+	size_t                 decodedSize;
+	float                 *srcData;
+	float                **srcPlanes;
+	unsigned char        **srcDst;
+	unsigned int           srcPlaneCount;
+
+	struct renderSource   *sources;
+};
+
+/*
+ * Tracks of a mix, rendered block after block. Each block, tracks are shared
+ * between the calling thread and the pool workers.
+ */
+struct renderPool {
+
+	struct renderTrack    *tracks;
+	size_t                 count;
+
+	aafPosition_t          blockStart;
+	size_t                 blockFrames;
+
+	size_t                 started;      // worker threads
+
+#ifdef LIBAAF_THREADS
+	pthread_mutex_t        mutex;
+	pthread_cond_t         work;
+	pthread_cond_t         finished;
+
+	uint64_t               generation;   // incremented with every block
+	size_t                 next;
+	size_t                 done;
+	int                    quit;
+#endif
+};
+
+/*
+ * Ring buffer of a played track. Positions count samples per channel since
+ * playback start and only grow, ring index being position & ringMask. writePos
+ * and renderPos are only modified by the read-ahead thread, readPos and seeking
+ * by the reader. Samples before flushPos were rendered before the last seek, and
+ * are skipped by the reader.
+ */
+struct aafiPlaybackTrack {
+
+	aafiPlayback              *playback;
+
+	struct renderTrack         rt;
+
+	float                     *ring;         // interleaved, ringFrames * rt.channels values
+
+	aafPosition_t              renderPos;    // timeline position of sample at writePos
+	uint64_t                   writePos;
+	uint64_t                   flushPos;
+	uint64_t                   readPos;
+	uint64_t                   underruns;
+	int                        seeking;      // reader skipped samples, and waits for new ones
+
+	struct aafiPlaybackTrack  *next;
+};
+
+struct aafiPlayback {
+
+	AAF_Iface                 *aafi;
+	aafRational_t             *samplerate;
+
+	uint64_t                   ringFrames;
+	uint64_t                   ringMask;
+
+	struct aafiPlaybackTrack  *tracks;
+	struct aafiPlaybackTrack  *lastTrack;
+
+	uint64_t                   periodNs;     // read-ahead thread wakes up every quarter of ring
+
+	int                        started;
+
+#ifdef LIBAAF_THREADS
+	pthread_t                  thread;
+	pthread_mutex_t            mutex;
+	pthread_cond_t             wake;
+	pthread_cond_t             seeked;
+
+	aafPosition_t              seekPos;
+	int                        seek;
+	int                        quit;
+#endif
+};
+
+
+static aafRational_t * render_samplerate( AAF_Iface *aafi );
+static unsigned int render_trackChannels( aafiAudioTrack *audioTrack );
+static int render_initTrack( AAF_Iface *aafi, struct renderTrack *rt, aafiAudioTrack *audioTrack, aafRational_t *samplerate, unsigned int channels, unsigned int busChannels );
+static void render_releaseTrack( struct renderTrack *rt );
+static void render_trackBlock( struct renderTrack *rt, aafPosition_t blockStart, size_t frames );
+static int render_clipCallback( void *item, void *user );
+static void render_clip( struct renderTrack *rt, aafiAudioClip *audioClip );
+static void render_clipEnvelope( struct renderTrack *rt, aafiAudioClip *audioClip, aafPosition_t clipStart, aafPosition_t clipEnd, aafPosition_t from, size_t frames );
+static int render_prepareGain( struct renderTrack *rt, aafiAudioGain *gain );
+static void render_applyFade( struct renderTrack *rt, aafiTransition *trans, aafPosition_t fadeStart, aafPosition_t fadeLen, aafPosition_t from, size_t frames, int mirror );
+static void render_applyGain( struct renderTrack *rt, aafiAudioGain *gain, aafPosition_t length, aafPosition_t start, size_t frames );
+static struct renderSource * render_getSource( struct renderTrack *rt, aafiAudioEssenceFile *audioEssenceFile );
+static int render_openSource( AAF_Iface *aafi, struct renderSource *src );
+static size_t render_readSource( struct renderTrack *rt, struct renderSource *src, uint32_t essenceChannel, unsigned int clipChannel, uint64_t frameOffset, size_t frames );
+static void render_clipResampled( struct renderTrack *rt, struct renderSource *src, uint32_t essenceChannel, unsigned int clipChannel, uint64_t position, size_t offset, size_t frames );
+static int render_reserve( struct renderTrack *rt, size_t rawSize, size_t decodedSize, unsigned int planeCount );
+static size_t mappedDataReaderCallback( unsigned char *buf, size_t offset, size_t reqlen, void *user1, void *user2, void *user3 );
+static void render_mixTrack( struct renderTrack *rt, float **bus, unsigned int busChannels, size_t frames );
+static void render_interleave( float *dst, float **planes, unsigned int channels, size_t frames );
+static void render_block( struct renderPool *pool, aafPosition_t blockStart, size_t frames );
+
+#ifdef LIBAAF_THREADS
+static void render_poolTracks( struct renderPool *pool );
+static void * renderWorker( void *arg );
+static int playback_fill( aafiPlayback *playback, int *flushing );
+static void * playbackWorker( void *arg );
+#endif
+
+
+
+int aafi_renderTrack( AAF_Iface *aafi, aafiAudioTrack *audioTrack, aafPosition_t start, aafPosition_t length, aafRational_t *editRate, aafiRenderCallback callback, void *user )
+{
+	int rc = 0;
+
+	struct renderTrack rt;
+	float *interleaved = NULL;
+
+	memset( &rt, 0x00, sizeof(struct renderTrack) );
+
+
+	if ( !aafi || !audioTrack || !callback ) {
+		return -1;
+	}
+
+	aafRational_t *samplerate = render_samplerate( aafi );
+
+	if ( !samplerate ) {
+		goto err;
+	}
+
+	if ( render_initTrack( aafi, &rt, audioTrack, samplerate, 0, 0 ) < 0 ) {
+		goto err;
+	}
+
+	interleaved = malloc( (size_t)rt.channels * RENDER_BLOCK_FRAMES * sizeof(float) );
+
+	if ( !interleaved ) {
+		error( "Out of memory" );
+		goto err;
+	}
+
+	aafPosition_t from = aafi_convertUnit( start, editRate, samplerate );
+	aafPosition_t to   = ( length > 0 ) ? from + aafi_convertUnit( length, editRate, samplerate ) : rt.end;
+
+	for ( aafPosition_t pos = from; pos < to; pos += RENDER_BLOCK_FRAMES ) {
+
+		size_t frames = ( to - pos < RENDER_BLOCK_FRAMES ) ? (size_t)(to - pos) : RENDER_BLOCK_FRAMES;
+
+		render_trackBlock( &rt, pos, frames );
+		render_interleave( interleaved, rt.planes, rt.channels, frames );
+
+		if ( callback( interleaved, frames, rt.channels, user ) ) {
+			debug( "Rendering stopped by callback" );
+			goto err;
+		}
+	}
+
+	goto end;
+
+err:
+	rc = -1;
+
+end:
+	render_releaseTrack( &rt );
+	free( interleaved );
+
+	return rc;
+}
+
+
+
+int aafi_renderClip( AAF_Iface *aafi, aafiAudioClip *audioClip, aafiRenderCallback callback, void *user )
+{
+	int rc = 0;
+
+	struct renderTrack rt;
+	float *interleaved = NULL;
+
+	memset( &rt, 0x00, sizeof(struct renderTrack) );
+
+
+	if ( !aafi || !audioClip || !callback ) {
+		return -1;
+	}
+
+	if ( !audioClip->track || !audioClip->timelineItem || !audioClip->essencePointerList ) {
+		error( "Can't render a clip that has no track or no essence" );
+		return -1;
+	}
+
+	aafRational_t *samplerate = render_samplerate( aafi );
+
+	if ( !samplerate ) {
+		goto err;
+	}
+
+	int channels = aafi_getAudioEssencePointerChannelCount( audioClip->essencePointerList );
+
+	if ( channels <= 0 ) {
+		error( "Can't render a clip that has no audio channel" );
+		goto err;
+	}
+
+	if ( render_initTrack( aafi, &rt, audioClip->track, samplerate, (unsigned int)channels, 0 ) < 0 ) {
+		goto err;
+	}
+
+	interleaved = malloc( (size_t)rt.channels * RENDER_BLOCK_FRAMES * sizeof(float) );
+
+	if ( !interleaved ) {
+		error( "Out of memory" );
+		goto err;
+	}
+
+	aafRational_t *editRate = audioClip->track->edit_rate;
+
+	aafPosition_t from = aafi_convertUnit( audioClip->pos, editRate, samplerate );
+	aafPosition_t to   = aafi_convertUnit( audioClip->pos + audioClip->len, editRate, samplerate );
+
+
+	/* track gain stays at unity, so only the clip envelope applies */
+
+	rt.trackGain = 1.0f;
+	rt.trackGainVariable = 0;
+
+	for ( aafPosition_t pos = from; pos < to; pos += RENDER_BLOCK_FRAMES ) {
+
+		size_t frames = ( to - pos < RENDER_BLOCK_FRAMES ) ? (size_t)(to - pos) : RENDER_BLOCK_FRAMES;
+
+		for ( unsigned int c = 0; c < rt.channels; c++ ) {
+			memset( rt.planes[c], 0x00, frames * sizeof(float) );
+		}
+
+		rt.blockStart  = pos;
+		rt.blockFrames = frames;
+
+		render_clip( &rt, audioClip );
+		render_interleave( interleaved, rt.planes, rt.channels, frames );
+
+		if ( callback( interleaved, frames, rt.channels, user ) ) {
+			debug( "Rendering stopped by callback" );
+			goto err;
+		}
+	}
+
+	goto end;
+
+err:
+	rc = -1;
+
+end:
+	render_releaseTrack( &rt );
+	free( interleaved );
+
+	return rc;
+}
+
+
+
+int aafi_renderMix( AAF_Iface *aafi, unsigned int channels, aafPosition_t start, aafPosition_t length, aafRational_t *editRate, aafiRenderCallback callback, void *user )
+{
+	int rc = 0;
+
+	struct renderPool pool;
+
+	float  *busData = NULL;
+	float **bus = NULL;
+	float  *interleaved = NULL;
+
+	memset( &pool, 0x00, sizeof(struct renderPool) );
+
+
+	if ( !aafi || !channels || !callback ) {
+		return -1;
+	}
+
+	aafRational_t *samplerate = render_samplerate( aafi );
+
+	if ( !samplerate ) {
+		goto err;
+	}
+
+
+	/* once a track is soloed, only soloed tracks are heard */
+
+	int solo = 0;
+	aafiAudioTrack *audioTrack = NULL;
+
+	AAFI_foreachAudioTrack( aafi, audioTrack ) {
+		if ( audioTrack->solo ) {
+			solo = 1;
+		}
+		pool.count++;
+	}
+
+	if ( pool.count ) {
+
+		pool.tracks = calloc( pool.count, sizeof(struct renderTrack) );
+
+		if ( !pool.tracks ) {
+			error( "Out of memory" );
+			goto err;
+		}
+	}
+
+	pool.count = 0;
+
+	aafPosition_t end = 0;
+
+	AAFI_foreachAudioTrack( aafi, audioTrack ) {
+
+		if ( audioTrack->mute || ( solo && !audioTrack->solo ) ) {
+			continue;
+		}
+
+		struct renderTrack *rt = &pool.tracks[pool.count++];
+
+		if ( render_initTrack( aafi, rt, audioTrack, samplerate, 0, channels ) < 0 ) {
+			goto err;
+		}
+
+		if ( rt->end > end ) {
+			end = rt->end;
+		}
+	}
+
+
+	busData     = calloc( (size_t)channels * RENDER_BLOCK_FRAMES, sizeof(float) );
+	bus         = calloc( channels, sizeof(float*) );
+	interleaved = malloc( (size_t)channels * RENDER_BLOCK_FRAMES * sizeof(float) );
+
+	if ( !busData || !bus || !interleaved ) {
+		error( "Out of memory" );
+		goto err;
+	}
+
+	for ( unsigned int c = 0; c < channels; c++ ) {
+		bus[c] = busData + (size_t)c * RENDER_BLOCK_FRAMES;
+	}
+
+
+#ifdef LIBAAF_THREADS
+
+	size_t threadCount = ( aafi->ctx.options.threads > 1 ) ? (size_t)aafi->ctx.options.threads : 1;
+
+	if ( threadCount > pool.count ) {
+		threadCount = pool.count;
+	}
+
+	pthread_t *threads = NULL;
+
+	if ( threadCount > 1 ) {
+
+		threads = calloc( threadCount - 1, sizeof(pthread_t) );
+
+		if ( !threads ) {
+			warning( "Out of memory. Rendering with a single thread." );
+			threadCount = 1;
+		}
+	}
+
+	pthread_mutex_init( &pool.mutex, NULL );
+	pthread_cond_init( &pool.work, NULL );
+	pthread_cond_init( &pool.finished, NULL );
+
+	for ( pool.started = 0; pool.started + 1 < threadCount; pool.started++ ) {
+
+		int err = pthread_create( &threads[pool.started], NULL, renderWorker, &pool );
+
+		if ( err != 0 ) {
+			warning( "Could not start thread : %s. Continuing with %"PRIu64" threads.", strerror(err), (uint64_t)(pool.started+1) );
+			break;
+		}
+	}
+
+#endif
+
+
+	aafPosition_t from = aafi_convertUnit( start, editRate, samplerate );
+	aafPosition_t to   = ( length > 0 ) ? from + aafi_convertUnit( length, editRate, samplerate ) : end;
+
+	for ( aafPosition_t pos = from; pos < to; pos += RENDER_BLOCK_FRAMES ) {
+
+		size_t frames = ( to - pos < RENDER_BLOCK_FRAMES ) ? (size_t)(to - pos) : RENDER_BLOCK_FRAMES;
+
+		render_block( &pool, pos, frames );
+
+		/* tracks are summed in track order, so output does not depend on threads */
+
+		for ( unsigned int c = 0; c < channels; c++ ) {
+			memset( bus[c], 0x00, frames * sizeof(float) );
+		}
+
+		for ( size_t i = 0; i < pool.count; i++ ) {
+			render_mixTrack( &pool.tracks[i], bus, channels, frames );
+		}
+
+		render_interleave( interleaved, bus, channels, frames );
+
+		if ( callback( interleaved, frames, channels, user ) ) {
+			debug( "Rendering stopped by callback" );
+			rc = -1;
+			break;
+		}
+	}
+
+
+#ifdef LIBAAF_THREADS
+
+	pthread_mutex_lock( &pool.mutex );
+	pool.quit = 1;
+	pthread_cond_broadcast( &pool.work );
+	pthread_mutex_unlock( &pool.mutex );
+
+	for ( size_t i = 0; i < pool.started; i++ ) {
+		pthread_join( threads[i], NULL );
+	}
+
+	pthread_cond_destroy( &pool.finished );
+	pthread_cond_destroy( &pool.work );
+	pthread_mutex_destroy( &pool.mutex );
+
+	free( threads );
+
+#endif
+
+	goto end;
+
+err:
+	rc = -1;
+
+end:
+	for ( size_t i = 0; i < pool.count; i++ ) {
+		render_releaseTrack( &pool.tracks[i] );
+	}
+
+	free( pool.tracks );
+	free( busData );
+	free( bus );
+	free( interleaved );
+
+	return rc;
+}
+
+
+
+aafiPlayback * aafi_newPlayback( AAF_Iface *aafi, uint64_t ringFrames )
+{
+	if ( !aafi ) {
+		return NULL;
+	}
+
+#ifndef LIBAAF_THREADS
+
+	(void)ringFrames;
+
+	error( "Playback requires libAAF to be built with LIBAAF_THREADS" );
+
+	return NULL;
+
+#else
+
+	aafRational_t *samplerate = render_samplerate( aafi );
+
+	if ( !samplerate ) {
+		return NULL;
+	}
+
+	aafiPlayback *playback = calloc( 1, sizeof(aafiPlayback) );
+
+	if ( !playback ) {
+		error( "Out of memory" );
+		return NULL;
+	}
+
+	/*
+	 * Ring is a power of two number of blocks, and only whole blocks are written,
+	 * so a block never wraps around the ring.
+	 */
+
+	playback->ringFrames = RENDER_BLOCK_FRAMES * 2;
+
+	while ( playback->ringFrames < ringFrames ) {
+		playback->ringFrames <<= 1;
+	}
+
+	playback->aafi       = aafi;
+	playback->samplerate = samplerate;
+	playback->ringMask   = playback->ringFrames - 1;
+	playback->periodNs   = (uint64_t)( (double)(playback->ringFrames / 4) * 1e9 * samplerate->denominator / samplerate->numerator );
+
+	pthread_mutex_init( &playback->mutex, NULL );
+	pthread_cond_init( &playback->wake, NULL );
+	pthread_cond_init( &playback->seeked, NULL );
+
+	return playback;
+
+#endif
+}
+
+
+
+aafiPlaybackTrack * aafi_addPlaybackTrack( aafiPlayback *playback, aafiAudioTrack *audioTrack, unsigned int *channels )
+{
+	if ( !playback || !audioTrack ) {
+		return NULL;
+	}
+
+	AAF_Iface *aafi = playback->aafi;
+
+	if ( playback->started ) {
+		error( "Tracks can't be added to a started playback" );
+		return NULL;
+	}
+
+	aafiPlaybackTrack *track = calloc( 1, sizeof(aafiPlaybackTrack) );
+
+	if ( !track ) {
+		error( "Out of memory" );
+		return NULL;
+	}
+
+	track->playback = playback;
+
+	if ( render_initTrack( aafi, &track->rt, audioTrack, playback->samplerate, 0, 0 ) < 0 ) {
+		goto err;
+	}
+
+	track->ring = calloc( playback->ringFrames * track->rt.channels, sizeof(float) );
+
+	if ( !track->ring ) {
+		error( "Out of memory" );
+		goto err;
+	}
+
+	if ( playback->lastTrack ) {
+		playback->lastTrack->next = track;
+	}
+	else {
+		playback->tracks = track;
+	}
+
+	playback->lastTrack = track;
+
+	if ( channels ) {
+		*channels = track->rt.channels;
+	}
+
+	return track;
+
+err:
+	render_releaseTrack( &track->rt );
+	free( track );
+
+	return NULL;
+}
+
+
+
+int aafi_startPlayback( aafiPlayback *playback, aafPosition_t position, aafRational_t *editRate )
+{
+	if ( !playback ) {
+		return -1;
+	}
+
+	AAF_Iface *aafi = playback->aafi;
+
+	if ( playback->started ) {
+		error( "Playback is already started" );
+		return -1;
+	}
+
+	if ( aafi_seekPlayback( playback, position, editRate ) < 0 ) {
+		return -1;
+	}
+
+#ifdef LIBAAF_THREADS
+
+	int err = pthread_create( &playback->thread, NULL, playbackWorker, playback );
+
+	if ( err != 0 ) {
+		error( "Could not start playback thread : %s", strerror(err) );
+		return -1;
+	}
+
+	playback->started = 1;
+
+#endif
+
+	return 0;
+}
+
+
+
+int aafi_seekPlayback( aafiPlayback *playback, aafPosition_t position, aafRational_t *editRate )
+{
+	if ( !playback ) {
+		return -1;
+	}
+
+#ifdef LIBAAF_THREADS
+
+	/* applied by read-ahead thread, which is the only one to modify writePos */
+
+	pthread_mutex_lock( &playback->mutex );
+
+	playback->seekPos = aafi_convertUnit( position, editRate, playback->samplerate );
+	playback->seek = 1;
+
+	pthread_cond_signal( &playback->wake );
+
+	while ( playback->started && playback->seek ) {
+		pthread_cond_wait( &playback->seeked, &playback->mutex );
+	}
+
+	pthread_mutex_unlock( &playback->mutex );
+
+#else
+
+	(void)position;
+	(void)editRate;
+
+#endif
+
+	return 0;
+}
+
+
+
+uint64_t aafi_readPlayback( aafiPlaybackTrack *track, float *samples, uint64_t frameCount )
+{
+	if ( !track || !samples ) {
+		return 0;
+	}
+
+	aafiPlayback *playback = track->playback;
+
+	unsigned int channels = track->rt.channels;
+
+	/*
+	 * writePos is loaded first : once read-ahead thread wrote samples after a
+	 * seek, the flushPos it set before is visible too.
+	 */
+
+	uint64_t writePos = PLAYBACK_LOAD( &track->writePos );
+	uint64_t flushPos = PLAYBACK_LOAD( &track->flushPos );
+	uint64_t readPos  = track->readPos;
+
+	if ( readPos < flushPos ) {
+		readPos = flushPos;
+		track->seeking = 1;
+	}
+
+	uint64_t frames = ( writePos > readPos ) ? writePos - readPos : 0;
+
+	if ( frames > frameCount ) {
+		frames = frameCount;
+	}
+
+	uint64_t offset = readPos & playback->ringMask;
+	uint64_t first  = playback->ringFrames - offset;
+
+	if ( first > frames ) {
+		first = frames;
+	}
+
+	memcpy( samples, track->ring + offset * channels, (size_t)(first * channels) * sizeof(float) );
+	memcpy( samples + first * channels, track->ring, (size_t)((frames - first) * channels) * sizeof(float) );
+
+	PLAYBACK_STORE( &track->readPos, readPos + frames );
+
+	if ( frames < frameCount ) {
+
+		memset( samples + frames * channels, 0x00, (size_t)((frameCount - frames) * channels) * sizeof(float) );
+
+		/* silence right after a seek is not an underrun */
+
+		if ( !track->seeking ) {
+			PLAYBACK_STORE( &track->underruns, track->underruns + 1 );
+		}
+	}
+	else {
+		track->seeking = 0;
+	}
+
+	return frames;
+}
+
+
+
+uint64_t aafi_getPlaybackBuffered( aafiPlaybackTrack *track )
+{
+	if ( !track ) {
+		return 0;
+	}
+
+	uint64_t writePos = PLAYBACK_LOAD( &track->writePos );
+	uint64_t flushPos = PLAYBACK_LOAD( &track->flushPos );
+	uint64_t readPos  = PLAYBACK_LOAD( &track->readPos );
+
+	if ( readPos < flushPos ) {
+		readPos = flushPos;
+	}
+
+	return ( writePos > readPos ) ? writePos - readPos : 0;
+}
+
+
+
+uint64_t aafi_getPlaybackUnderruns( aafiPlaybackTrack *track )
+{
+	if ( !track ) {
+		return 0;
+	}
+
+	return PLAYBACK_LOAD( &track->underruns );
+}
+
+
+
+void aafi_releasePlayback( aafiPlayback **playback )
+{
+	if ( !playback || !(*playback) ) {
+		return;
+	}
+
+	aafiPlayback *pb = *playback;
+
+#ifdef LIBAAF_THREADS
+
+	if ( pb->started ) {
+
+		pthread_mutex_lock( &pb->mutex );
+		pb->quit = 1;
+		pthread_cond_signal( &pb->wake );
+		pthread_mutex_unlock( &pb->mutex );
+
+		pthread_join( pb->thread, NULL );
+	}
+
+	pthread_cond_destroy( &pb->seeked );
+	pthread_cond_destroy( &pb->wake );
+	pthread_mutex_destroy( &pb->mutex );
+
+#endif
+
+	aafiPlaybackTrack *track = pb->tracks;
+
+	while ( track ) {
+
+		aafiPlaybackTrack *next = track->next;
+
+		render_releaseTrack( &track->rt );
+		free( track->ring );
+		free( track );
+
+		track = next;
+	}
+
+	free( pb );
+
+	*playback = NULL;
+}
+
+
+
+static aafRational_t * render_samplerate( AAF_Iface *aafi )
+{
+	aafRational_t *samplerate = aafi->Audio->samplerateRational;
+
+	if ( !samplerate || samplerate->numerator <= 0 || samplerate->denominator <= 0 ) {
+		error( "Unknown composition sample rate : can't render audio" );
+		return NULL;
+	}
+
+	return samplerate;
+}
+
+
+
+/*
+ * Track channel count is the track format when set, else the channel count of
+ * the widest clip.
+ */
+
+static unsigned int render_trackChannels( aafiAudioTrack *audioTrack )
+{
+	if ( audioTrack->format >= AAFI_TRACK_FORMAT_MONO &&
+	     audioTrack->format <= AAFI_TRACK_FORMAT_7_1 )
+	{
+		return audioTrack->format;
+	}
+
+	unsigned int channels = 1;
+
+	aafiTimelineItem *timelineItem = NULL;
+
+	AAFI_foreachTrackItem( audioTrack, timelineItem ) {
+
+		if ( timelineItem->type != AAFI_AUDIO_CLIP ) {
+			continue;
+		}
+
+		aafiAudioClip *audioClip = timelineItem->data;
+
+		if ( !audioClip->essencePointerList ) {
+			continue;
+		}
+
+		int clipChannels = aafi_getAudioEssencePointerChannelCount( audioClip->essencePointerList );
+
+		if ( clipChannels > 0 && (unsigned int)clipChannels > channels ) {
+			channels = (unsigned int)clipChannels;
+		}
+	}
+
+	return channels;
+}
+
+
+
+/*
+ * Track is rendered with its own channel count, unless channels is not 0.
+ */
+
+static int render_initTrack( AAF_Iface *aafi, struct renderTrack *rt, aafiAudioTrack *audioTrack, aafRational_t *samplerate, unsigned int channels, unsigned int busChannels )
+{
+	rt->aafi        = aafi;
+	rt->audioTrack  = audioTrack;
+	rt->samplerate  = samplerate;
+	rt->channels    = ( channels ) ? channels : render_trackChannels( audioTrack );
+	rt->busChannels = busChannels;
+
+	aafiTimelineItem *timelineItem = NULL;
+
+	AAFI_foreachTrackItem( audioTrack, timelineItem ) {
+
+		if ( timelineItem->type != AAFI_AUDIO_CLIP ) {
+			continue;
+		}
+
+		aafiAudioClip *audioClip = timelineItem->data;
+		aafPosition_t clipEnd = aafi_convertUnit( audioClip->pos + audioClip->len, audioTrack->edit_rate, samplerate );
+
+		if ( clipEnd > rt->end ) {
+			rt->end = clipEnd;
+		}
+	}
+
+	rt->length = aafi_convertUnit( audioTrack->current_pos, audioTrack->edit_rate, samplerate );
+
+	if ( rt->length <= 0 ) {
+		rt->length = ( rt->end > 0 ) ? rt->end : 1;
+	}
+
+	rt->data   = calloc( (size_t)rt->channels * RENDER_BLOCK_FRAMES, sizeof(float) );
+	rt->planes = calloc( rt->channels, sizeof(float*) );
+	rt->env    = calloc( 6 * RENDER_BLOCK_FRAMES, sizeof(float) );
+
+	if ( !rt->data || !rt->planes || !rt->env ) {
+		error( "Out of memory" );
+		return -1;
+	}
+
+	for ( unsigned int c = 0; c < rt->channels; c++ ) {
+		rt->planes[c] = rt->data + (size_t)c * RENDER_BLOCK_FRAMES;
+	}
+
+	rt->curve    = rt->env + 1 * RENDER_BLOCK_FRAMES;
+	rt->trackEnv = rt->env + 2 * RENDER_BLOCK_FRAMES;
+	rt->panL     = rt->env + 3 * RENDER_BLOCK_FRAMES;
+	rt->panR     = rt->env + 4 * RENDER_BLOCK_FRAMES;
+
+	rt->resampled = rt->env + 5 * RENDER_BLOCK_FRAMES;
+
+
+	/* envelopes are compiled now, as blocks of a mix may be rendered by any thread */
+
+	if ( render_prepareGain( rt, audioTrack->gain ) < 0 ||
+	     render_prepareGain( rt, audioTrack->pan ) < 0 )
+	{
+		return -1;
+	}
+
+	AAFI_foreachTrackItem( audioTrack, timelineItem ) {
+
+		if ( timelineItem->type != AAFI_AUDIO_CLIP ) {
+			continue;
+		}
+
+		aafiAudioClip *audioClip = timelineItem->data;
+
+		if ( render_prepareGain( rt, audioClip->gain ) < 0 ||
+		     render_prepareGain( rt, audioClip->automation ) < 0 )
+		{
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+
+
+static void render_releaseTrack( struct renderTrack *rt )
+{
+	struct renderSource *src = rt->sources;
+
+	while ( src ) {
+
+		struct renderSource *next = src->next;
+
+		laaf_util_unmap_file( src->map, src->mapSize );
+		laaf_resampler_free( &src->resampler );
+		free( src );
+
+		src = next;
+	}
+
+	free( rt->data );
+	free( rt->planes );
+	free( rt->env );
+	free( rt->raw );
+	free( rt->decoded );
+	free( rt->srcData );
+	free( rt->srcPlanes );
+	free( rt->srcDst );
+
+	memset( rt, 0x00, sizeof(struct renderTrack) );
+}
+
+
+
+static void render_trackBlock( struct renderTrack *rt, aafPosition_t blockStart, size_t frames )
+{
+	aafiAudioTrack *audioTrack = rt->audioTrack;
+
+	for ( unsigned int c = 0; c < rt->channels; c++ ) {
+		memset( rt->planes[c], 0x00, frames * sizeof(float) );
+	}
+
+	rt->blockStart  = blockStart;
+	rt->blockFrames = frames;
+
+
+	/* track gain is applied to every clip envelope */
+
+	aafiAudioGain *gain = audioTrack->gain;
+
+	rt->trackGain = 1.0f;
+	rt->trackGainVariable = 0;
+
+	if ( gain && gain->value && gain->pts_cnt > 1 && gain->time && ( gain->flags & AAFI_AUDIO_GAIN_VARIABLE ) ) {
+		aafi_evalEnvelope( rt->aafi, gain, rt->length, NULL, NULL, blockStart, frames, rt->trackEnv );
+		rt->trackGainVariable = 1;
+	}
+	else if ( gain && gain->value && gain->pts_cnt > 0 ) {
+		rt->trackGain = (float)aafRationalToDouble( gain->value[0] );
+	}
+
+
+	/* mono tracks are panned to the two first bus channels */
+
+	aafiAudioPan *pan = audioTrack->pan;
+
+	rt->panVariable = 0;
+
+	if ( rt->channels == 1 && rt->busChannels > 1 ) {
+
+		if ( pan && pan->value && pan->pts_cnt > 1 && pan->time && ( pan->flags & AAFI_AUDIO_GAIN_VARIABLE ) ) {
+
+			aafi_evalEnvelope( rt->aafi, pan, rt->length, NULL, NULL, blockStart, frames, rt->panL );
+
+			for ( size_t i = 0; i < frames; i++ ) {
+				double p = ( rt->panL[i] < 0.0f ) ? 0.0 : ( rt->panL[i] > 1.0f ) ? 1.0 : (double)rt->panL[i];
+				rt->panL[i] = (float)cos( p * RENDER_HALF_PI );
+				rt->panR[i] = (float)sin( p * RENDER_HALF_PI );
+			}
+
+			rt->panVariable = 1;
+		}
+		else {
+			double p = ( pan && pan->value && pan->pts_cnt > 0 ) ? aafRationalToDouble( pan->value[0] ) : 0.5;
+
+			p = ( p < 0.0 ) ? 0.0 : ( p > 1.0 ) ? 1.0 : p;
+
+			rt->panGainL = (float)cos( p * RENDER_HALF_PI );
+			rt->panGainR = (float)sin( p * RENDER_HALF_PI );
+		}
+	}
+
+
+	aafi_queryRange( &audioTrack->rangeIndex, blockStart, blockStart + (aafPosition_t)frames, rt->samplerate, render_clipCallback, rt );
+}
+
+
+
+static int render_clipCallback( void *item, void *user )
+{
+	aafiTimelineItem *timelineItem = item;
+
+	if ( timelineItem->type != AAFI_AUDIO_CLIP ) {
+		return 0;
+	}
+
+	aafiAudioClip *audioClip = timelineItem->data;
+
+	if ( !audioClip->mute ) {
+		render_clip( user, audioClip );
+	}
+
+	return 0;
+}
+
+
+
+static void render_clip( struct renderTrack *rt, aafiAudioClip *audioClip )
+{
+	aafRational_t *editRate = rt->audioTrack->edit_rate;
+
+	aafPosition_t clipStart = aafi_convertUnit( audioClip->pos, editRate, rt->samplerate );
+	aafPosition_t clipEnd   = aafi_convertUnit( audioClip->pos + audioClip->len, editRate, rt->samplerate );
+
+	aafPosition_t blockEnd = rt->blockStart + (aafPosition_t)rt->blockFrames;
+
+	aafPosition_t from = ( clipStart > rt->blockStart ) ? clipStart : rt->blockStart;
+	aafPosition_t to   = ( clipEnd < blockEnd ) ? clipEnd : blockEnd;
+
+	if ( to <= from ) {
+		return;
+	}
+
+	size_t offset = (size_t)(from - rt->blockStart);
+	size_t frames = (size_t)(to - from);
+
+	render_clipEnvelope( rt, audioClip, clipStart, clipEnd, from, frames );
+
+
+	/* clip channels come in essence pointer order, and go to the same track channel */
+
+	unsigned int clipChannel = 0;
+
+	aafiAudioEssencePointer *essencePointer = NULL;
+
+	AAFI_foreachEssencePointer( audioClip->essencePointerList, essencePointer ) {
+
+		if ( clipChannel >= rt->channels ) {
+			break;
+		}
+
+		aafiAudioEssenceFile *audioEssenceFile = essencePointer->essenceFile;
+
+		struct renderSource *src = render_getSource( rt, audioEssenceFile );
+
+		if ( !src || src->rc < 0 ) {
+			clipChannel += ( essencePointer->essenceChannel ) ? 1 : audioEssenceFile->channels;
+			continue;
+		}
+
+		unsigned int channels = ( essencePointer->essenceChannel ) ? 1 : src->channels;
+
+		if ( src->resample ) {
+
+			/* essence offset is converted to render samples, the grid resampled samples are on */
+
+			uint64_t position = aafi_convertUnitUint64( audioClip->essence_offset, editRate, rt->samplerate ) + (uint64_t)(from - clipStart);
+
+			render_clipResampled( rt, src, essencePointer->essenceChannel, clipChannel, position, offset, frames );
+
+			clipChannel += channels;
+			continue;
+		}
+
+		uint64_t frameOffset = aafi_convertUnitUint64( audioClip->essence_offset, editRate, audioEssenceFile->samplerateRational ) + (uint64_t)(from - clipStart);
+
+		size_t read = render_readSource( rt, src, essencePointer->essenceChannel, clipChannel, frameOffset, frames );
+
+		for ( unsigned int e = 0; e < src->channels && read; e++ ) {
+
+			if ( rt->srcDst[e] == NULL ) {
+				continue;
+			}
+
+			unsigned int trackChannel = ( essencePointer->essenceChannel ) ? clipChannel : clipChannel + e;
+
+			laaf_sample_mix( rt->planes[trackChannel] + offset, rt->srcPlanes[e], rt->env, read );
+		}
+
+		clipChannel += channels;
+	}
+}
+
+
+
+/*
+ * Mixes frames resampled samples of an essence, from render sample position of
+ * the essence, to track planes at offset in the block. Samples are resampled by
+ * parts whose input fits the source planes, input being zero outside of audio
+ * data.
+ */
+
+static void render_clipResampled( struct renderTrack *rt, struct renderSource *src, uint32_t essenceChannel, unsigned int clipChannel, uint64_t position, size_t offset, size_t frames )
+{
+	const struct laafResampler *rs = &src->resampler;
+
+	size_t maxFrames = (size_t)( (uint64_t)( RENDER_BLOCK_FRAMES - rs->taps - 2 ) * rs->upsample / rs->downsample );
+
+	if ( maxFrames == 0 ) {
+		maxFrames = 1;
+	}
+
+	for ( size_t done = 0; done < frames; ) {
+
+		size_t count = ( frames - done < maxFrames ) ? frames - done : maxFrames;
+
+		uint64_t pos = ( position + done ) * rs->downsample;
+
+		int64_t first = 0;
+		size_t  span  = 0;
+
+		laaf_resampler_span( rs, pos, count, &first, &span );
+
+		uint64_t readFirst = ( first > 0 ) ? (uint64_t)first : 0;
+		size_t   lead      = (size_t)( (int64_t)readFirst - first );
+
+		size_t read = ( span > lead ) ? render_readSource( rt, src, essenceChannel, clipChannel, readFirst, span - lead ) : 0;
+
+		if ( read == 0 ) {
+			/* range is out of audio data */
+			done += count;
+			continue;
+		}
+
+		for ( unsigned int e = 0; e < src->channels; e++ ) {
+
+			if ( rt->srcDst[e] == NULL ) {
+				continue;
+			}
+
+			float *plane = rt->srcPlanes[e];
+
+			memmove( plane + lead, plane, read * sizeof(float) );
+			memset( plane, 0x00, lead * sizeof(float) );
+			memset( plane + lead + read, 0x00, ( span - lead - read ) * sizeof(float) );
+
+			laaf_resampler_process( rs, rt->resampled, 1, plane, pos, count );
+
+			unsigned int trackChannel = ( essenceChannel ) ? clipChannel : clipChannel + e;
+
+			laaf_sample_mix( rt->planes[trackChannel] + offset + done, rt->resampled, rt->env + done, count );
+		}
+
+		done += count;
+	}
+}
+
+
+
+/*
+ * Computes clip envelope over [from, from+frames) : clip gain, clip automation,
+ * fades and track gain.
+ */
+
+static void render_clipEnvelope( struct renderTrack *rt, aafiAudioClip *audioClip, aafPosition_t clipStart, aafPosition_t clipEnd, aafPosition_t from, size_t frames )
+{
+	aafRational_t *editRate = rt->audioTrack->edit_rate;
+
+	float *env = rt->env;
+
+	for ( size_t i = 0; i < frames; i++ ) {
+		env[i] = 1.0f;
+	}
+
+	render_applyGain( rt, audioClip->gain,       clipEnd - clipStart, from - clipStart, frames );
+	render_applyGain( rt, audioClip->automation, clipEnd - clipStart, from - clipStart, frames );
+
+
+	/*
+	 * A transition overlaps the clips around it : a fade in or a cross-fade
+	 * starts with the next clip, a fade out or a cross-fade ends with the
+	 * previous one.
+	 */
+
+	aafiTimelineItem *prev = audioClip->timelineItem->prev;
+	aafiTimelineItem *next = audioClip->timelineItem->next;
+
+	if ( prev && prev->type == AAFI_TRANS ) {
+
+		aafiTransition *trans = prev->data;
+
+		if ( trans->flags & ( AAFI_TRANS_FADE_IN | AAFI_TRANS_XFADE ) ) {
+			aafPosition_t fadeLen = aafi_convertUnit( trans->len, editRate, rt->samplerate );
+			render_applyFade( rt, trans, clipStart, fadeLen, from, frames, 0 );
+		}
+	}
+
+	if ( next && next->type == AAFI_TRANS ) {
+
+		aafiTransition *trans = next->data;
+
+		if ( trans->flags & ( AAFI_TRANS_FADE_OUT | AAFI_TRANS_XFADE ) ) {
+			/* cross-fade curve is the fade in one, mirrored for the fade out */
+			aafPosition_t fadeLen = aafi_convertUnit( trans->len, editRate, rt->samplerate );
+			render_applyFade( rt, trans, clipEnd - fadeLen, fadeLen, from, frames, ( trans->flags & AAFI_TRANS_XFADE ) );
+		}
+	}
+
+
+	if ( rt->trackGainVariable ) {
+
+		const float *trackEnv = rt->trackEnv + (from - rt->blockStart);
+
+		for ( size_t i = 0; i < frames; i++ ) {
+			env[i] *= trackEnv[i];
+		}
+	}
+	else if ( rt->trackGain != 1.0f ) {
+
+		for ( size_t i = 0; i < frames; i++ ) {
+			env[i] *= rt->trackGain;
+		}
+	}
+}
+
+
+
+static int render_prepareGain( struct renderTrack *rt, aafiAudioGain *gain )
+{
+	if ( !gain ) {
+		return 0;
+	}
+
+	/* evaluating no sample only compiles the envelope */
+
+	return aafi_evalEnvelope( rt->aafi, gain, 1, NULL, NULL, 0, 0, rt->curve );
+}
+
+
+
+/*
+ * Multiplies clip envelope by a transition curve, over the part of the
+ * transition within [from, from+frames). A mirrored curve is read backward.
+ */
+
+static void render_applyFade( struct renderTrack *rt, aafiTransition *trans, aafPosition_t fadeStart, aafPosition_t fadeLen, aafPosition_t from, size_t frames, int mirror )
+{
+	if ( fadeLen <= 0 || !trans->value_a ) {
+		return;
+	}
+
+	aafPosition_t a = ( from > fadeStart ) ? from : fadeStart;
+	aafPosition_t b = ( from + (aafPosition_t)frames < fadeStart + fadeLen ) ? from + (aafPosition_t)frames : fadeStart + fadeLen;
+
+	if ( b <= a ) {
+		return;
+	}
+
+	size_t count = (size_t)(b - a);
+
+	float *env   = rt->env + (a - from);
+	float *curve = rt->curve;
+
+	if ( mirror ) {
+
+		aafi_evalTransition( rt->aafi, trans, rt->audioTrack->edit_rate, rt->samplerate, fadeLen - (a - fadeStart) - (aafPosition_t)(count - 1), count, curve );
+
+		for ( size_t i = 0; i < count; i++ ) {
+			env[i] *= curve[count - 1 - i];
+		}
+	}
+	else {
+
+		aafi_evalTransition( rt->aafi, trans, rt->audioTrack->edit_rate, rt->samplerate, a - fadeStart, count, curve );
+
+		for ( size_t i = 0; i < count; i++ ) {
+			env[i] *= curve[i];
+		}
+	}
+}
+
+
+
+/*
+ * Multiplies clip envelope by gain, from sample start of a component of length
+ * samples.
+ */
+
+static void render_applyGain( struct renderTrack *rt, aafiAudioGain *gain, aafPosition_t length, aafPosition_t start, size_t frames )
+{
+	if ( !gain || !gain->value || gain->pts_cnt == 0 ) {
+		return;
+	}
+
+	float *env   = rt->env;
+	float *curve = rt->curve;
+
+	aafi_evalEnvelope( rt->aafi, gain, length, NULL, NULL, start, frames, curve );
+
+	for ( size_t i = 0; i < frames; i++ ) {
+		env[i] *= curve[i];
+	}
+}
+
+
+
+static struct renderSource * render_getSource( struct renderTrack *rt, aafiAudioEssenceFile *audioEssenceFile )
+{
+	AAF_Iface *aafi = rt->aafi;
+
+	struct renderSource *src = rt->sources;
+
+	for (; src != NULL; src = src->next ) {
+		if ( src->audioEssenceFile == audioEssenceFile ) {
+			return src;
+		}
+	}
+
+	src = calloc( 1, sizeof(struct renderSource) );
+
+	if ( !src ) {
+		error( "Out of memory" );
+		return NULL;
+	}
+
+	src->audioEssenceFile = audioEssenceFile;
+	src->next = rt->sources;
+	rt->sources = src;
+
+	src->rc = render_openSource( aafi, src );
+
+	aafRational_t *rate = audioEssenceFile->samplerateRational;
+
+	if ( src->rc == 0 && ( rate->numerator != rt->samplerate->numerator || rate->denominator != rt->samplerate->denominator ) ) {
+
+		if ( rate->numerator <= 0 || rate->denominator <= 0 ||
+		     laaf_resampler_init( &src->resampler, (uint64_t)rate->numerator, (uint64_t)rate->denominator, (uint64_t)rt->samplerate->numerator, (uint64_t)rt->samplerate->denominator ) < 0 )
+		{
+			warning( "Can't resample essence \"%s\" from %i/%i to %i/%i : rendering silence",
+				audioEssenceFile->unique_name,
+				rate->numerator,
+				rate->denominator,
+				rt->samplerate->numerator,
+				rt->samplerate->denominator );
+			src->rc = -1;
+		}
+		else {
+			debug( "Resampling essence \"%s\" from %i/%i to %i/%i",
+				audioEssenceFile->unique_name,
+				rate->numerator,
+				rate->denominator,
+				rt->samplerate->numerator,
+				rt->samplerate->denominator );
+			src->resample = 1;
+		}
+	}
+
+	return src;
+}
+
+
+
+static int render_openSource( AAF_Iface *aafi, struct renderSource *src )
+{
+	aafiAudioEssenceFile *audioEssenceFile = src->audioEssenceFile;
+
+	if ( audioEssenceFile->type == AAFI_ESSENCE_TYPE_UNK ) {
+		warning( "Essence \"%s\" is not PCM : rendering silence", audioEssenceFile->unique_name );
+		return -1;
+	}
+
+	uint64_t dataLength = 0;
+
+	uint16_t samplesize = audioEssenceFile->samplesize;
+	uint16_t channels   = audioEssenceFile->channels;
+	uint16_t formatTag  = audioEssenceFile->formatTag;
+
+	if ( audioEssenceFile->is_embedded ) {
+
+		if ( cfb_openStream( aafi->aafd->cfbd, audioEssenceFile->node, &src->reader ) < 0 ) {
+			error( "Could not open stream of essence \"%s\"", audioEssenceFile->unique_name );
+			return -1;
+		}
+
+		src->dataOffset = ( audioEssenceFile->type != AAFI_ESSENCE_TYPE_PCM ) ? audioEssenceFile->pcm_audio_start_offset : 0;
+		src->swap = ( audioEssenceFile->type == AAFI_ESSENCE_TYPE_AIFC );
+
+		dataLength = ( src->reader.stream_len > src->dataOffset ) ? src->reader.stream_len - src->dataOffset : 0;
+	}
+	else {
+
+		if ( !audioEssenceFile->usable_file_path ) {
+			warning( "External essence \"%s\" was not located : rendering silence", audioEssenceFile->unique_name );
+			return -1;
+		}
+
+		src->map = laaf_util_map_file( audioEssenceFile->usable_file_path, &src->mapSize );
+
+		if ( !src->map ) {
+			error( "Could not map external essence file : %s", audioEssenceFile->usable_file_path );
+			return -1;
+		}
+
+		/*
+		 * Header is parsed again, since essence properties might come from the
+		 * AAF summary, which does not locate audio data in file.
+		 */
+
+		struct RIFFAudioFile RIFFAudioFile;
+
+		if ( laaf_riff_parseAudioFile( &RIFFAudioFile, RIFF_PARSE_AAF_SUMMARY, &mappedDataReaderCallback, src->map, &src->mapSize, aafi, aafi->log ) < 0 ||
+		     RIFFAudioFile.pcm_audio_start_offset == 0 )
+		{
+			error( "Could not parse external essence file : %s", audioEssenceFile->usable_file_path );
+			return -1;
+		}
+
+		samplesize = RIFFAudioFile.sampleSize;
+		channels   = RIFFAudioFile.channels;
+		formatTag  = RIFFAudioFile.formatTag;
+
+		src->dataOffset = RIFFAudioFile.pcm_audio_start_offset;
+		src->swap = ( memcmp( src->map, "FORM", 4 ) == 0 );
+
+		dataLength = ( src->mapSize > src->dataOffset ) ? src->mapSize - src->dataOffset : 0;
+
+		if ( RIFFAudioFile.sampleCount * channels * (samplesize/8) < dataLength ) {
+			dataLength = RIFFAudioFile.sampleCount * channels * (samplesize/8);
+		}
+	}
+
+	if ( laaf_riff_sampleFormat( formatTag, samplesize, &src->format ) < 0 ) {
+		warning( "Can't render %u bits samples of format 0x%04x of essence \"%s\" : rendering silence", samplesize, formatTag, audioEssenceFile->unique_name );
+		return -1;
+	}
+
+	if ( channels == 0 ) {
+		warning( "Essence \"%s\" has no channel : rendering silence", audioEssenceFile->unique_name );
+		return -1;
+	}
+
+	src->samplesize = samplesize / 8;
+	src->channels   = channels;
+	src->frameCount = dataLength / (src->samplesize * src->channels);
+
+	return 0;
+}
+
+
+
+/*
+ * Reads frames from source, starting at frameOffset, into rt->srcPlanes. Only
+ * essence channels used by the clip are decoded, the others have a NULL
+ * rt->srcDst. Returns the number of frames read, which is less than requested
+ * past the end of audio data.
+ */
+
+static size_t render_readSource( struct renderTrack *rt, struct renderSource *src, uint32_t essenceChannel, unsigned int clipChannel, uint64_t frameOffset, size_t frames )
+{
+	AAF_Iface *aafi = rt->aafi;
+
+	if ( frameOffset >= src->frameCount ) {
+		return 0;
+	}
+
+	if ( frames > src->frameCount - frameOffset ) {
+		frames = (size_t)(src->frameCount - frameOffset);
+	}
+
+	size_t frameSize = (size_t)src->samplesize * src->channels;
+	size_t bytes = frames * frameSize;
+
+	if ( render_reserve( rt, ( src->map && !src->swap ) ? 0 : bytes, frames * src->channels, src->channels ) < 0 ) {
+		return 0;
+	}
+
+	uint64_t offset = src->dataOffset + frameOffset * frameSize;
+
+	const unsigned char *samples = NULL;
+
+	if ( src->map ) {
+
+		if ( src->swap ) {
+			memcpy( rt->raw, src->map + offset, bytes );
+			samples = rt->raw;
+		}
+		else {
+			samples = src->map + offset;
+		}
+	}
+	else {
+
+		if ( src->reader.pos != offset && cfb_seekStream( &src->reader, offset ) < 0 ) {
+			error( "Could not seek to %"PRIu64" in stream of essence \"%s\"", offset, src->audioEssenceFile->unique_name );
+			return 0;
+		}
+
+		bytes = (size_t)cfb_readStream( &src->reader, rt->raw, bytes );
+		frames = bytes / frameSize;
+		bytes = frames * frameSize;
+
+		samples = rt->raw;
+	}
+
+	if ( src->swap ) {
+		laaf_sample_swap_bytes( rt->raw, bytes, src->samplesize );
+	}
+
+
+	for ( unsigned int e = 0; e < src->channels; e++ ) {
+
+		int used = ( essenceChannel ) ? ( e + 1 == essenceChannel ) : ( clipChannel + e < rt->channels );
+
+		rt->srcDst[e] = ( used ) ? (unsigned char*)rt->srcPlanes[e] : NULL;
+	}
+
+	if ( src->channels == 1 ) {
+		laaf_sample_convert( (unsigned char*)rt->srcPlanes[0], LAAF_SAMPLE_F32, samples, src->format, frames, NULL );
+	}
+	else {
+		laaf_sample_convert( (unsigned char*)rt->decoded, LAAF_SAMPLE_F32, samples, src->format, frames * src->channels, NULL );
+		laaf_sample_deinterleave( rt->srcDst, (const unsigned char*)rt->decoded, frames, src->channels, sizeof(float) );
+	}
+
+	return frames;
+}
+
+
+
+static int render_reserve( struct renderTrack *rt, size_t rawSize, size_t decodedSize, unsigned int planeCount )
+{
+	AAF_Iface *aafi = rt->aafi;
+
+	if ( rawSize > rt->rawSize ) {
+
+		unsigned char *raw = realloc( rt->raw, rawSize );
+
+		if ( !raw ) {
+			error( "Out of memory" );
+			return -1;
+		}
+
+		rt->raw = raw;
+		rt->rawSize = rawSize;
+	}
+
+	if ( decodedSize > rt->decodedSize ) {
+
+		float *decoded = realloc( rt->decoded, decodedSize * sizeof(float) );
+
+		if ( !decoded ) {
+			error( "Out of memory" );
+			return -1;
+		}
+
+		rt->decoded = decoded;
+		rt->decodedSize = decodedSize;
+	}
+
+	if ( planeCount > rt->srcPlaneCount ) {
+
+		float *srcData = realloc( rt->srcData, (size_t)planeCount * RENDER_BLOCK_FRAMES * sizeof(float) );
+
+		if ( srcData ) {
+			rt->srcData = srcData;
+		}
+
+		float **srcPlanes = realloc( rt->srcPlanes, planeCount * sizeof(float*) );
+
+		if ( srcPlanes ) {
+			rt->srcPlanes = srcPlanes;
+		}
+
+		unsigned char **srcDst = realloc( rt->srcDst, planeCount * sizeof(unsigned char*) );
+
+		if ( srcDst ) {
+			rt->srcDst = srcDst;
+		}
+
+		if ( !srcData || !srcPlanes || !srcDst ) {
+			error( "Out of memory" );
+			return -1;
+		}
+
+		for ( unsigned int e = 0; e < planeCount; e++ ) {
+			rt->srcPlanes[e] = rt->srcData + (size_t)e * RENDER_BLOCK_FRAMES;
+		}
+
+		rt->srcPlaneCount = planeCount;
+	}
+
+	return 0;
+}
+
+
+
+static size_t mappedDataReaderCallback( unsigned char *buf, size_t offset, size_t reqlen, void *user1, void *user2, void *user3 )
+{
+	const unsigned char *data = user1;
+	uint64_t datasz = *(uint64_t*)user2;
+	AAF_Iface *aafi = (AAF_Iface*)user3;
+
+	if ( offset > datasz ) {
+		error( "Requested data starts beyond data length" );
+		return RIFF_READER_ERROR;
+	}
+
+	if ( reqlen > datasz - offset ) {
+		reqlen = (size_t)(datasz - offset);
+	}
+
+	memcpy( buf, data+offset, reqlen );
+
+	return reqlen;
+}
+
+
+
+/*
+ * Adds the current block of a track to bus.
+ */
+
+static void render_mixTrack( struct renderTrack *rt, float **bus, unsigned int busChannels, size_t frames )
+{
+	if ( busChannels == 1 ) {
+
+		for ( unsigned int c = 0; c < rt->channels; c++ ) {
+			laaf_sample_mix_gain( bus[0], rt->planes[c], 1.0f / (float)rt->channels, frames );
+		}
+
+		return;
+	}
+
+	if ( rt->channels == 1 ) {
+
+		if ( rt->panVariable ) {
+			laaf_sample_mix( bus[0], rt->planes[0], rt->panL, frames );
+			laaf_sample_mix( bus[1], rt->planes[0], rt->panR, frames );
+		}
+		else {
+			laaf_sample_mix_gain( bus[0], rt->planes[0], rt->panGainL, frames );
+			laaf_sample_mix_gain( bus[1], rt->planes[0], rt->panGainR, frames );
+		}
+
+		return;
+	}
+
+	for ( unsigned int c = 0; c < rt->channels && c < busChannels; c++ ) {
+		laaf_sample_mix_gain( bus[c], rt->planes[c], 1.0f, frames );
+	}
+}
+
+
+
+static void render_interleave( float *dst, float **planes, unsigned int channels, size_t frames )
+{
+	if ( channels == 1 ) {
+		memcpy( dst, planes[0], frames * sizeof(float) );
+		return;
+	}
+
+	for ( unsigned int c = 0; c < channels; c++ ) {
+
+		const float *plane = planes[c];
+		float *out = dst + c;
+
+		for ( size_t i = 0; i < frames; i++ ) {
+			out[i * channels] = plane[i];
+		}
+	}
+}
+
+
+
+/*
+ * Renders the current block of every track of pool.
+ */
+
+static void render_block( struct renderPool *pool, aafPosition_t blockStart, size_t frames )
+{
+#ifdef LIBAAF_THREADS
+
+	if ( pool->started ) {
+
+		pthread_mutex_lock( &pool->mutex );
+
+		pool->blockStart  = blockStart;
+		pool->blockFrames = frames;
+		pool->next = 0;
+		pool->done = 0;
+		pool->generation++;
+
+		pthread_cond_broadcast( &pool->work );
+
+		render_poolTracks( pool );
+
+		while ( pool->done < pool->count ) {
+			pthread_cond_wait( &pool->finished, &pool->mutex );
+		}
+
+		pthread_mutex_unlock( &pool->mutex );
+
+		return;
+	}
+
+#endif
+
+	for ( size_t i = 0; i < pool->count; i++ ) {
+		render_trackBlock( &pool->tracks[i], blockStart, frames );
+	}
+}
+
+
+
+#ifdef LIBAAF_THREADS
+
+/*
+ * Renders tracks of the current block until none is left. Called with pool
+ * mutex locked.
+ */
+
+static void render_poolTracks( struct renderPool *pool )
+{
+	while ( pool->next < pool->count ) {
+
+		size_t index = pool->next++;
+
+		aafPosition_t blockStart = pool->blockStart;
+		size_t frames = pool->blockFrames;
+
+		pthread_mutex_unlock( &pool->mutex );
+
+		render_trackBlock( &pool->tracks[index], blockStart, frames );
+
+		pthread_mutex_lock( &pool->mutex );
+
+		if ( ++pool->done == pool->count ) {
+			pthread_cond_signal( &pool->finished );
+		}
+	}
+}
+
+
+
+static void * renderWorker( void *arg )
+{
+	struct renderPool *pool = arg;
+
+	uint64_t generation = 0;
+
+	pthread_mutex_lock( &pool->mutex );
+
+	while ( 1 ) {
+
+		while ( !pool->quit && pool->generation == generation ) {
+			pthread_cond_wait( &pool->work, &pool->mutex );
+		}
+
+		if ( pool->quit ) {
+			break;
+		}
+
+		generation = pool->generation;
+
+		render_poolTracks( pool );
+	}
+
+	pthread_mutex_unlock( &pool->mutex );
+
+	return NULL;
+}
+
+
+
+
+/*
+ * Renders one block ahead on every track that has room for it. Called by the
+ * read-ahead thread, without playback mutex. flushing is set if any track ring
+ * is full of samples rendered before a seek, not skipped by the reader yet.
+ *
+ * @return 1 if any block was rendered, 0 if all rings are full.
+ */
+
+static int playback_fill( aafiPlayback *playback, int *flushing )
+{
+	int progress = 0;
+
+	*flushing = 0;
+
+	for ( aafiPlaybackTrack *track = playback->tracks; track; track = track->next ) {
+
+		uint64_t readPos = PLAYBACK_LOAD( &track->readPos );
+
+		if ( readPos < track->flushPos ) {
+			*flushing = 1;
+		}
+
+		if ( playback->ringFrames - (track->writePos - readPos) < RENDER_BLOCK_FRAMES ) {
+			continue;
+		}
+
+		render_trackBlock( &track->rt, track->renderPos, RENDER_BLOCK_FRAMES );
+
+		uint64_t offset = track->writePos & playback->ringMask;
+
+		render_interleave( track->ring + offset * track->rt.channels, track->rt.planes, track->rt.channels, RENDER_BLOCK_FRAMES );
+
+		track->renderPos += RENDER_BLOCK_FRAMES;
+
+		PLAYBACK_STORE( &track->writePos, track->writePos + RENDER_BLOCK_FRAMES );
+
+		progress = 1;
+	}
+
+	return progress;
+}
+
+
+
+static void * playbackWorker( void *arg )
+{
+	aafiPlayback *playback = arg;
+
+	pthread_mutex_lock( &playback->mutex );
+
+	while ( !playback->quit ) {
+
+		if ( playback->seek ) {
+
+			for ( aafiPlaybackTrack *track = playback->tracks; track; track = track->next ) {
+				track->renderPos = playback->seekPos;
+				PLAYBACK_STORE( &track->flushPos, track->writePos );
+			}
+
+			playback->seek = 0;
+
+			pthread_cond_broadcast( &playback->seeked );
+		}
+
+		pthread_mutex_unlock( &playback->mutex );
+
+		int flushing = 0;
+		int progress = playback_fill( playback, &flushing );
+
+		pthread_mutex_lock( &playback->mutex );
+
+		if ( !progress && !playback->quit && !playback->seek ) {
+
+			/* rings are full : wait for the reader to drain a quarter of them */
+
+			struct timespec ts;
+
+			clock_gettime( CLOCK_REALTIME, &ts );
+
+			uint64_t ns = (uint64_t)ts.tv_nsec + ( ( flushing ) ? PLAYBACK_SEEK_POLL_NS : playback->periodNs );
+
+			ts.tv_sec  += (time_t)(ns / 1000000000);
+			ts.tv_nsec  = (long)(ns % 1000000000);
+
+			pthread_cond_timedwait( &playback->wake, &playback->mutex, &ts );
+		}
+	}
+
+	pthread_mutex_unlock( &playback->mutex );
+
+	return NULL;
+}
+
+#endif
@@ -50,6 +50,9 @@
 #include <libaaf/log.h>
 #include <libaaf/AAFIface.h>
 #include <libaaf/AAFIParser.h>
+#include <libaaf/AAFIEssenceFile.h>
+#include <libaaf/AAFIPeaks.h>
+#include <libaaf/AAFILoudness.h>
 
 
 #define debug( ... ) \
@@ -62,6 +65,116 @@
 	AAF_LOG( aafi->log, aafi, LOG_SRC_ID_AAF_IFACE, VERB_ERROR, __VA_ARGS__ )
 
 
+/*
+ * Initial bucket count of the essence indexes. Indexes are doubled whenever
+ * they hold more essences than buckets.
+ */
+#define ESSENCE_INDEX_MIN_SIZE 64
+
+
+/**
+ * Computes the essence index bucket of a (sourceMobID, sourceMobSlotID) pair.
+ */
+
+static uint32_t essence_index_hash( const aafMobID_t *sourceMobID, uint32_t sourceMobSlotID, uint32_t indexSize );
+
+/**
+ * Grows #aafiAudio.essenceIndex if needed, so it can hold one more essence.
+ */
+
+static int audio_essence_index_reserve( AAF_Iface *aafi );
+
+/**
+ * Grows #aafiVideo.essenceIndex if needed, so it can hold one more essence.
+ */
+
+static int video_essence_index_reserve( AAF_Iface *aafi );
+
+/**
+ * Adds an audio essence to the aafi essence list and index.
+ */
+
+static int audio_essence_add( AAF_Iface *aafi, aafiAudioEssenceFile *audioEssenceFile );
+
+/**
+ * Adds a video essence to the aafi essence list and index.
+ */
+
+static int video_essence_add( AAF_Iface *aafi, aafiVideoEssence *videoEssenceFile );
+
+/**
+ * Allocates the AAF_Iface of a composition other than the main one.
+ */
+
+static AAF_Iface * composition_alloc( AAF_Iface *aafi );
+
+/**
+ * Releases an AAF_Iface allocated by composition_alloc(). Essences and
+ * essence pointers are left to the main AAF_Iface.
+ */
+
+static void composition_release( AAF_Iface **compositionAafi );
+
+/**
+ * Computes the hash of an essence pointer list (essenceFile, essenceChannel) sequence.
+ */
+
+static uint32_t essence_pointer_list_hash( aafiAudioEssencePointer *essencePointerList );
+
+/**
+ * Returns 1 if both essence pointer lists hold the same (essenceFile, essenceChannel) sequence.
+ */
+
+static int essence_pointer_list_equal( aafiAudioEssencePointer *list1, aafiAudioEssencePointer *list2 );
+
+/**
+ * Grows #aafiAudio.essencePointerIndex if needed, so it can hold one more list.
+ */
+
+static int essence_pointer_index_reserve( AAF_Iface *aafi );
+
+/**
+ * Retrieves the position and length of a timeline item, in track edit unit.
+ * Returns -1 if item position can not be guessed.
+ */
+
+static int timeline_item_range( aafiTimelineItem *timelineItem, aafPosition_t *pos, aafPosition_t *len );
+
+/**
+ * Builds rangeIndex upon a track timeline item list.
+ */
+
+static int track_range_index_build( AAF_Iface *aafi, aafiRangeIndex *rangeIndex, aafiTimelineItem *timelineItems, aafRational_t *editRate );
+
+/**
+ * Builds aafi->markersRangeIndex upon aafi->Markers.
+ */
+
+static int markers_range_index_build( AAF_Iface *aafi );
+
+/**
+ * Sorts entries and sets them to rangeIndex, which takes ownership of entries.
+ */
+
+static void range_index_set( aafiRangeIndex *rangeIndex, aafiRangeEntry *entries, uint32_t count, aafRational_t *editRate );
+
+static int range_entry_cmp( const void *a, const void *b );
+
+/**
+ * Sets aafiRangeEntry.maxEnd of the implicit tree holding entries [lo, hi),
+ * and returns the tree greatest end.
+ */
+
+static aafPosition_t range_index_set_max_end( aafiRangeEntry *entries, size_t lo, size_t hi );
+
+/**
+ * Calls callback for each entry of the implicit tree [lo, hi) intersecting
+ * [start, end). Returns 1 if callback asked to stop, 0 otherwise.
+ */
+
+static int range_index_query( aafiRangeEntry *entries, size_t lo, size_t hi, aafPosition_t start, aafPosition_t end, int (*callback)(void *item, void *user), void *user, int *count );
+
+
 
 AAF_Iface * aafi_alloc( AAF_Data *aafd )
 {
@@ -164,6 +277,27 @@ int aafi_set_option_int( AAF_Iface *aafi, const char *optname, int val ) {
 		aafi->ctx.options.mobid_essence_filename = val;
 		return 0;
 	}
+	else if ( strcmp( optname, "threads" ) == 0 ) {
+		aafi->ctx.options.threads = val;
+		aafi->aafd->threads = val;
+		return 0;
+	}
+	else if ( strcmp( optname, "extract_sample_format" ) == 0 ) {
+		aafi->ctx.options.extract_sample_format = val;
+		return 0;
+	}
+	else if ( strcmp( optname, "extract_dither" ) == 0 ) {
+		aafi->ctx.options.extract_dither = val;
+		return 0;
+	}
+	else if ( strcmp( optname, "extract_split_channels" ) == 0 ) {
+		aafi->ctx.options.extract_split_channels = val;
+		return 0;
+	}
+	else if ( strcmp( optname, "extract_samplerate" ) == 0 ) {
+		aafi->ctx.options.extract_samplerate = val;
+		return 0;
+	}
 
 	return 1;
 }
@@ -223,18 +357,37 @@ int aafi_load_file( AAF_Iface *aafi, const char *file )
 
 
 
+int aafi_probe( AAF_Iface *aafi, const char *file )
+{
+	if ( !aafi || !file || aaf_probe( aafi->aafd, file ) ) {
+		return 1;
+	}
+
+	if ( aafi_retrieveProbeData( aafi ) < 0 ) {
+		return 1;
+	}
+
+	return 0;
+}
+
+
+
 void aafi_release( AAF_Iface **aafi )
 {
 	if ( !aafi || !(*aafi) ) {
 		return;
 	}
 
+	aafi_freeCompositions( *aafi );
+
 	aaf_release( &(*aafi)->aafd );
 
 	if ( (*aafi)->Audio != NULL ) {
 
 		aafi_freeAudioTracks( &(*aafi)->Audio->Tracks );
 		aafi_freeAudioEssences( &(*aafi)->Audio->essenceFiles );
+		free( (*aafi)->Audio->essenceIndex );
+		free( (*aafi)->Audio->essencePointerIndex );
 
 		aafiAudioEssencePointer *essencePointer = (*aafi)->Audio->essencePointerList;
 
@@ -250,11 +403,13 @@ void aafi_release( AAF_Iface **aafi )
 
 		aafi_freeVideoTracks( &(*aafi)->Video->Tracks );
 		aafi_freeVideoEssences( &(*aafi)->Video->essenceFiles );
+		free( (*aafi)->Video->essenceIndex );
 
 		free( (*aafi)->Video );
 	}
 
 	aafi_freeMarkers( &(*aafi)->Markers );
+	aafi_freeRangeIndex( &(*aafi)->markersRangeIndex );
 	aafi_freeMetadata( &((*aafi)->metadata) );
 
 	free( (*aafi)->compositionName );
@@ -358,20 +513,11 @@ int aafi_get_clipIndex( aafiAudioClip *audioClip )
 		return 0;
 	}
 
-	int index = 0;
-	struct aafiTimelineItem *timelineItem = NULL;
-	struct aafiAudioTrack *track = audioClip->track;
-
-	AAFI_foreachTrackItem( track, timelineItem ) {
-		if ( timelineItem->type == AAFI_AUDIO_CLIP ) {
-			index++;
-		}
-		if ( timelineItem->data == audioClip ) {
-			return index;
-		}
+	if ( !audioClip->timelineItem || !audioClip->timelineItem->track ) {
+		return 0;
 	}
 
-	return 0;
+	return audioClip->timelineItem->clipIndex;
 }
 
 
@@ -518,6 +664,25 @@ int aafi_removeTimelineItem( AAF_Iface *aafi, aafiTimelineItem *timelineItem ) {
 		return 0;
 	}
 
+	aafi_unlinkTimelineItem( timelineItem );
+
+	if ( timelineItem->track && timelineItem->next ) {
+		aafi_updateTimelineItemIndexes( timelineItem->next );
+	}
+
+
+	aafi_freeTimelineItem( timelineItem );
+
+	/* avoids -Wunused-parameter */
+	(void)aafi;
+
+	return 0;
+}
+
+
+
+void aafi_unlinkTimelineItem( aafiTimelineItem *timelineItem )
+{
 	if ( timelineItem->prev != NULL ) {
 		timelineItem->prev->next = timelineItem->next;
 	}
@@ -527,167 +692,504 @@ int aafi_removeTimelineItem( AAF_Iface *aafi, aafiTimelineItem *timelineItem ) {
 	}
 
 
-	aafiAudioTrack *audioTrack = NULL;
+	if ( timelineItem->type == AAFI_VIDEO_CLIP ) {
 
-	AAFI_foreachAudioTrack( aafi, audioTrack ) {
-		if ( audioTrack->timelineItems == timelineItem ) {
+		aafiVideoTrack *videoTrack = timelineItem->track;
+
+		if ( videoTrack && videoTrack->timelineItems == timelineItem ) {
+			videoTrack->timelineItems = timelineItem->next;
+		}
+
+		if ( videoTrack && videoTrack->lastTimelineItem == timelineItem ) {
+			videoTrack->lastTimelineItem = timelineItem->prev;
+		}
+	}
+	else {
+
+		aafiAudioTrack *audioTrack = timelineItem->track;
+
+		if ( audioTrack && audioTrack->timelineItems == timelineItem ) {
 			audioTrack->timelineItems = timelineItem->next;
 		}
+
+		if ( audioTrack && audioTrack->lastTimelineItem == timelineItem ) {
+			audioTrack->lastTimelineItem = timelineItem->prev;
+		}
 	}
+}
 
 
-	aafi_freeTimelineItem( timelineItem );
 
-	return 0;
+void aafi_updateTimelineItemIndexes( aafiTimelineItem *timelineItem )
+{
+	int clipIndex = ( timelineItem && timelineItem->prev ) ? timelineItem->prev->clipIndex : 0;
+
+	for (; timelineItem != NULL; timelineItem = timelineItem->next ) {
+
+		if ( timelineItem->type == AAFI_AUDIO_CLIP || timelineItem->type == AAFI_VIDEO_CLIP ) {
+			clipIndex++;
+		}
+
+		timelineItem->clipIndex = clipIndex;
+	}
 }
 
 
 
-int aafi_getAudioEssencePointerChannelCount( aafiAudioEssencePointer *essencePointerList )
+int aafi_buildRangeIndexes( AAF_Iface *aafi )
 {
-	/*
-	 * If essencePointerList holds a single multichannel essence file and if
-	 * essencePointer->essenceChannel is set, then clip is mono and audio comes
-	 * from essencePointer->essenceChannel of essencePointer.essenceFile.
-	 *
-	 * If essencePointerList holds a single multichannel essence file and if
-	 * essencePointer->essenceChannel is null, then clip is multichannel and
-	 * clip channel count equals essence->channels.
-	 *
-	 * If essencePointerList holds multiple pointers to multiple essence files,
-	 * then each file should be mono and describe a clip channel. Thus, clip
-	 * channel count equals pointers count.
-	 */
+	int rc = 0;
 
-	// if ( !essencePointerList ) {
-	// 	return 0;
-	// }
+	aafiAudioTrack *audioTrack = NULL;
+	aafiVideoTrack *videoTrack = NULL;
 
-	int essencePointerCount = 0;
-	aafiAudioEssencePointer *essencePointer = NULL;
+	AAFI_foreachAudioTrack( aafi, audioTrack ) {
+		if ( track_range_index_build( aafi, &audioTrack->rangeIndex, audioTrack->timelineItems, audioTrack->edit_rate ) < 0 ) {
+			rc = -1;
+		}
+	}
 
-	AAFI_foreachEssencePointer( essencePointerList, essencePointer ) {
-		essencePointerCount++;
+	AAFI_foreachVideoTrack( aafi, videoTrack ) {
+		if ( track_range_index_build( aafi, &videoTrack->rangeIndex, videoTrack->timelineItems, videoTrack->edit_rate ) < 0 ) {
+			rc = -1;
+		}
 	}
 
-	return ( essencePointerCount > 1 ) ? essencePointerCount : ( essencePointerList->essenceChannel ) ? 1 : essencePointerList->essenceFile->channels;
+	if ( markers_range_index_build( aafi ) < 0 ) {
+		rc = -1;
+	}
+
+	return rc;
 }
 
 
 
-int aafi_applyGainOffset( AAF_Iface *aafi, aafiAudioGain **gain, aafiAudioGain *offset )
+int aafi_queryRange( aafiRangeIndex *rangeIndex, aafPosition_t start, aafPosition_t end, aafRational_t *editRate, int (*callback)(void *item, void *user), void *user )
 {
-	if ( (offset->flags & AAFI_AUDIO_GAIN_MASK) & AAFI_AUDIO_GAIN_VARIABLE ) {
-		debug( "Variable gain offset is not supported" );
+	if ( !rangeIndex || !callback ) {
 		return -1;
 	}
 
-	if ( *gain == NULL ) {
-
-		/*
-		 * apply offset as new gain
-		 */
+	/* an empty range is a point query */
+	if ( end <= start ) {
+		end = start + 1;
+	}
 
-		debug( "Applying gain to clip as a new gain" );
+	if ( editRate && rangeIndex->editRate &&
+	     editRate->numerator != 0 && rangeIndex->editRate->denominator != 0 &&
+	    ( editRate->numerator   != rangeIndex->editRate->numerator ||
+	      editRate->denominator != rangeIndex->editRate->denominator ) )
+	{
+		double ratio = ( (double)rangeIndex->editRate->numerator * editRate->denominator ) /
+		               ( (double)rangeIndex->editRate->denominator * editRate->numerator );
 
-		(*gain) = aafi_newAudioGain( aafi, offset->flags & AAFI_AUDIO_GAIN_MASK, offset->flags & AAFI_INTERPOL_MASK, NULL );
+		/* range is rounded outward, so that no intersecting item is missed */
+		start = (aafPosition_t)floor( (double)start * ratio );
+		end   = (aafPosition_t)ceil(  (double)end   * ratio );
+	}
 
-		(*gain)->time  = calloc( (uint64_t)offset->pts_cnt, sizeof(aafRational_t) );
-		(*gain)->value = calloc( (uint64_t)offset->pts_cnt, sizeof(aafRational_t) );
+	int count = 0;
 
-		if ( !(*gain)->time || !(*gain)->value ) {
-			error( "Out of memory" );
-			aafi_freeAudioGain( *gain );
-			return -1;
-		}
+	range_index_query( rangeIndex->entries, 0, rangeIndex->count, start, end, callback, user, &count );
 
-		for ( unsigned int i = 0; i < (*gain)->pts_cnt; i++ ) {
-			(*gain)->value[i].numerator   = offset->value[0].numerator;
-			(*gain)->value[i].denominator = offset->value[0].denominator;
-			// debug( "Setting (*gain)->value[%i] = %i/%i",
-			// 	i,
-			// 	(*gain)->value[i].numerator,
-			// 	(*gain)->value[i].denominator );
-		}
-	}
-	else {
+	return count;
+}
 
-		/*
-		 * update existing constant or variable gain
-		 */
 
-		debug( "Applying gain to clip: %i/%i (%+05.1lf dB) ",
-			(*gain)->value[0].numerator,
-			(*gain)->value[0].denominator,
-			20 * log10( aafRationalToDouble( (*gain)->value[0] ) ) );
 
-		for ( unsigned int i = 0; i < (*gain)->pts_cnt; i++ ) {
-			/*
-			 * most of the time, gain values are made of very high numbers and denominator
-			 * is the same accross all gains in file. Thus, we devide both gain numbers
-			 * by offset denominator, so we fit inside uint32_t.
-			 */
-			(*gain)->value[i].numerator   = (int32_t)(((int64_t)(*gain)->value[i].numerator * (int64_t)offset->value[0].numerator)/(int64_t)offset->value[0].denominator);
-			(*gain)->value[i].denominator = (int32_t)(((int64_t)(*gain)->value[i].denominator * (int64_t)offset->value[0].denominator)/(int64_t)offset->value[0].denominator);
-			// debug( "Setting (*gain)->value[%i] = %i/%i * %i/%i",
-			// 	i,
-			// 	(*gain)->value[i].numerator,
-			// 	(*gain)->value[i].denominator,
-			// 	offset->value[0].numerator,
-			// 	offset->value[0].denominator );
-		}
+void aafi_freeRangeIndex( aafiRangeIndex *rangeIndex )
+{
+	if ( !rangeIndex ) {
+		return;
 	}
 
-	return 0;
+	free( rangeIndex->entries );
+
+	rangeIndex->entries = NULL;
+	rangeIndex->count = 0;
+	rangeIndex->editRate = NULL;
 }
 
 
 
-aafiAudioTrack * aafi_newAudioTrack( AAF_Iface *aafi )
+static int timeline_item_range( aafiTimelineItem *timelineItem, aafPosition_t *pos, aafPosition_t *len )
 {
-	aafiAudioTrack *track = calloc( 1, sizeof(aafiAudioTrack) );
-
-	if ( !track ) {
-		error( "Out of memory" );
-		return NULL;
+	if ( timelineItem->type == AAFI_AUDIO_CLIP ) {
+		aafiAudioClip *audioClip = timelineItem->data;
+		*pos = audioClip->pos;
+		*len = audioClip->len;
+		return 0;
 	}
 
-	track->Audio  = aafi->Audio;
-	track->format = AAFI_TRACK_FORMAT_NOT_SET;
-	track->next   = NULL;
+	if ( timelineItem->type == AAFI_VIDEO_CLIP ) {
+		aafiVideoClip *videoClip = timelineItem->data;
+		*pos = videoClip->pos;
+		*len = videoClip->len;
+		return 0;
+	}
 
-	/* Add to track list */
+	if ( timelineItem->type == AAFI_TRANS ) {
 
-	if ( aafi->Audio->Tracks != NULL ) {
+		/*
+		 * Transitions have no position of their own. A fade out ends with the
+		 * previous clip, fade in and cross-fade start with the next clip.
+		 */
 
-		aafiAudioTrack *tmp = aafi->Audio->Tracks;
+		aafiTransition *trans = timelineItem->data;
 
-		for (; tmp != NULL; tmp = tmp->next )
-			if ( tmp->next == NULL )
-				break;
+		*len = trans->len;
 
-		tmp->next = track;
-	}
-	else {
-		aafi->Audio->Tracks = track;
+		if ( trans->flags & AAFI_TRANS_FADE_OUT ) {
+			if ( timelineItem->prev && timelineItem->prev->type == AAFI_AUDIO_CLIP ) {
+				aafiAudioClip *prevClip = timelineItem->prev->data;
+				*pos = prevClip->pos + prevClip->len - trans->len;
+				return 0;
+			}
+		}
+		else if ( timelineItem->next && timelineItem->next->type == AAFI_AUDIO_CLIP ) {
+			aafiAudioClip *nextClip = timelineItem->next->data;
+			*pos = nextClip->pos;
+			return 0;
+		}
 	}
 
-	return track;
+	return -1;
 }
 
 
 
-aafiVideoTrack * aafi_newVideoTrack( AAF_Iface *aafi )
+static int track_range_index_build( AAF_Iface *aafi, aafiRangeIndex *rangeIndex, aafiTimelineItem *timelineItems, aafRational_t *editRate )
 {
-	aafiVideoTrack *track = calloc( 1, sizeof(aafiVideoTrack) );
+	aafi_freeRangeIndex( rangeIndex );
 
-	if ( !track ) {
-		error( "Out of memory" );
-		return NULL;
-	}
+	uint32_t itemCount = 0;
 
-	track->Video = aafi->Video;
-	track->next  = NULL;
+	for ( aafiTimelineItem *timelineItem = timelineItems; timelineItem != NULL; timelineItem = timelineItem->next ) {
+		itemCount++;
+	}
+
+	if ( itemCount == 0 ) {
+		rangeIndex->editRate = editRate;
+		return 0;
+	}
+
+	aafiRangeEntry *entries = malloc( itemCount * sizeof(aafiRangeEntry) );
+
+	if ( !entries ) {
+		error( "Out of memory" );
+		return -1;
+	}
+
+	uint32_t count = 0;
+
+	for ( aafiTimelineItem *timelineItem = timelineItems; timelineItem != NULL; timelineItem = timelineItem->next ) {
+
+		aafPosition_t pos = 0;
+		aafPosition_t len = 0;
+
+		if ( timeline_item_range( timelineItem, &pos, &len ) < 0 ) {
+			debug( "Could not guess timeline item position, item is not indexed" );
+			continue;
+		}
+
+		entries[count].start  = pos;
+		entries[count].end    = ( len > 0 ) ? pos + len : pos + 1;
+		entries[count].maxEnd = count; /* keeps timeline order of entries starting together */
+		entries[count].item   = timelineItem;
+
+		count++;
+	}
+
+	range_index_set( rangeIndex, entries, count, editRate );
+
+	return 0;
+}
+
+
+
+static int markers_range_index_build( AAF_Iface *aafi )
+{
+	aafi_freeRangeIndex( &aafi->markersRangeIndex );
+
+	uint32_t markerCount = 0;
+
+	for ( aafiMarker *marker = aafi->Markers; marker != NULL; marker = marker->next ) {
+		markerCount++;
+	}
+
+	if ( markerCount == 0 ) {
+		return 0;
+	}
+
+	aafiRangeEntry *entries = malloc( markerCount * sizeof(aafiRangeEntry) );
+
+	if ( !entries ) {
+		error( "Out of memory" );
+		return -1;
+	}
+
+	aafRational_t *editRate = aafi->Markers->edit_rate;
+
+	uint32_t count = 0;
+
+	for ( aafiMarker *marker = aafi->Markers; marker != NULL; marker = marker->next ) {
+
+		aafPosition_t pos = aafi_convertUnit( marker->start,  marker->edit_rate, editRate );
+		aafPosition_t len = aafi_convertUnit( marker->length, marker->edit_rate, editRate );
+
+		entries[count].start  = pos;
+		entries[count].end    = ( len > 0 ) ? pos + len : pos + 1;
+		entries[count].maxEnd = count; /* keeps list order of markers starting together */
+		entries[count].item   = marker;
+
+		count++;
+	}
+
+	range_index_set( &aafi->markersRangeIndex, entries, count, editRate );
+
+	return 0;
+}
+
+
+
+static void range_index_set( aafiRangeIndex *rangeIndex, aafiRangeEntry *entries, uint32_t count, aafRational_t *editRate )
+{
+	qsort( entries, count, sizeof(aafiRangeEntry), range_entry_cmp );
+
+	range_index_set_max_end( entries, 0, count );
+
+	rangeIndex->entries  = entries;
+	rangeIndex->count    = count;
+	rangeIndex->editRate = editRate;
+}
+
+
+
+static int range_entry_cmp( const void *a, const void *b )
+{
+	const aafiRangeEntry *entryA = a;
+	const aafiRangeEntry *entryB = b;
+
+	if ( entryA->start != entryB->start ) {
+		return ( entryA->start < entryB->start ) ? -1 : 1;
+	}
+
+	/* maxEnd holds list order until range_index_set_max_end() */
+	return ( entryA->maxEnd < entryB->maxEnd ) ? -1 : ( entryA->maxEnd > entryB->maxEnd );
+}
+
+
+
+static aafPosition_t range_index_set_max_end( aafiRangeEntry *entries, size_t lo, size_t hi )
+{
+	if ( lo >= hi ) {
+		return INT64_MIN;
+	}
+
+	size_t mid = lo + (hi - lo) / 2;
+
+	aafPosition_t maxEnd = entries[mid].end;
+
+	aafPosition_t leftMaxEnd  = range_index_set_max_end( entries, lo, mid );
+	aafPosition_t rightMaxEnd = range_index_set_max_end( entries, mid+1, hi );
+
+	if ( leftMaxEnd > maxEnd ) {
+		maxEnd = leftMaxEnd;
+	}
+
+	if ( rightMaxEnd > maxEnd ) {
+		maxEnd = rightMaxEnd;
+	}
+
+	entries[mid].maxEnd = maxEnd;
+
+	return maxEnd;
+}
+
+
+
+static int range_index_query( aafiRangeEntry *entries, size_t lo, size_t hi, aafPosition_t start, aafPosition_t end, int (*callback)(void *item, void *user), void *user, int *count )
+{
+	while ( lo < hi ) {
+
+		size_t mid = lo + (hi - lo) / 2;
+
+		if ( entries[mid].maxEnd <= start ) {
+			/* every entry of this tree ends before range */
+			return 0;
+		}
+
+		if ( range_index_query( entries, lo, mid, start, end, callback, user, count ) ) {
+			return 1;
+		}
+
+		if ( entries[mid].start >= end ) {
+			/* this entry and the right tree start after range */
+			return 0;
+		}
+
+		if ( entries[mid].end > start ) {
+
+			(*count)++;
+
+			if ( callback( entries[mid].item, user ) ) {
+				return 1;
+			}
+		}
+
+		lo = mid + 1;
+	}
+
+	return 0;
+}
+
+
+
+int aafi_getAudioEssencePointerChannelCount( aafiAudioEssencePointer *essencePointerList )
+{
+	/*
+	 * If essencePointerList holds a single multichannel essence file and if
+	 * essencePointer->essenceChannel is set, then clip is mono and audio comes
+	 * from essencePointer->essenceChannel of essencePointer.essenceFile.
+	 *
+	 * If essencePointerList holds a single multichannel essence file and if
+	 * essencePointer->essenceChannel is null, then clip is multichannel and
+	 * clip channel count equals essence->channels.
+	 *
+	 * If essencePointerList holds multiple pointers to multiple essence files,
+	 * then each file should be mono and describe a clip channel. Thus, clip
+	 * channel count equals pointers count.
+	 */
+
+	// if ( !essencePointerList ) {
+	// 	return 0;
+	// }
+
+	int essencePointerCount = 0;
+	aafiAudioEssencePointer *essencePointer = NULL;
+
+	AAFI_foreachEssencePointer( essencePointerList, essencePointer ) {
+		essencePointerCount++;
+	}
+
+	return ( essencePointerCount > 1 ) ? essencePointerCount : ( essencePointerList->essenceChannel ) ? 1 : essencePointerList->essenceFile->channels;
+}
+
+
+
+int aafi_applyGainOffset( AAF_Iface *aafi, aafiAudioGain **gain, aafiAudioGain *offset )
+{
+	if ( (offset->flags & AAFI_AUDIO_GAIN_MASK) & AAFI_AUDIO_GAIN_VARIABLE ) {
+		debug( "Variable gain offset is not supported" );
+		return -1;
+	}
+
+	if ( *gain == NULL ) {
+
+		/*
+		 * apply offset as new gain
+		 */
+
+		debug( "Applying gain to clip as a new gain" );
+
+		(*gain) = aafi_newAudioGain( aafi, offset->flags & AAFI_AUDIO_GAIN_MASK, offset->flags & AAFI_INTERPOL_MASK, NULL );
+
+		(*gain)->time  = calloc( (uint64_t)offset->pts_cnt, sizeof(aafRational_t) );
+		(*gain)->value = calloc( (uint64_t)offset->pts_cnt, sizeof(aafRational_t) );
+
+		if ( !(*gain)->time || !(*gain)->value ) {
+			error( "Out of memory" );
+			aafi_freeAudioGain( *gain );
+			return -1;
+		}
+
+		for ( unsigned int i = 0; i < (*gain)->pts_cnt; i++ ) {
+			(*gain)->value[i].numerator   = offset->value[0].numerator;
+			(*gain)->value[i].denominator = offset->value[0].denominator;
+			// debug( "Setting (*gain)->value[%i] = %i/%i",
+			// 	i,
+			// 	(*gain)->value[i].numerator,
+			// 	(*gain)->value[i].denominator );
+		}
+	}
+	else {
+
+		/*
+		 * update existing constant or variable gain
+		 */
+
+		debug( "Applying gain to clip: %i/%i (%+05.1lf dB) ",
+			(*gain)->value[0].numerator,
+			(*gain)->value[0].denominator,
+			20 * log10( aafRationalToDouble( (*gain)->value[0] ) ) );
+
+		for ( unsigned int i = 0; i < (*gain)->pts_cnt; i++ ) {
+			/*
+			 * most of the time, gain values are made of very high numbers and denominator
+			 * is the same accross all gains in file. Thus, we devide both gain numbers
+			 * by offset denominator, so we fit inside uint32_t.
+			 */
+			(*gain)->value[i].numerator   = (int32_t)(((int64_t)(*gain)->value[i].numerator * (int64_t)offset->value[0].numerator)/(int64_t)offset->value[0].denominator);
+			(*gain)->value[i].denominator = (int32_t)(((int64_t)(*gain)->value[i].denominator * (int64_t)offset->value[0].denominator)/(int64_t)offset->value[0].denominator);
+			// debug( "Setting (*gain)->value[%i] = %i/%i * %i/%i",
+			// 	i,
+			// 	(*gain)->value[i].numerator,
+			// 	(*gain)->value[i].denominator,
+			// 	offset->value[0].numerator,
+			// 	offset->value[0].denominator );
+		}
+	}
+
+	return 0;
+}
+
+
+
+aafiAudioTrack * aafi_newAudioTrack( AAF_Iface *aafi )
+{
+	aafiAudioTrack *track = calloc( 1, sizeof(aafiAudioTrack) );
+
+	if ( !track ) {
+		error( "Out of memory" );
+		return NULL;
+	}
+
+	track->Audio  = aafi->Audio;
+	track->format = AAFI_TRACK_FORMAT_NOT_SET;
+	track->next   = NULL;
+
+	/* Add to track list */
+
+	if ( aafi->Audio->Tracks != NULL ) {
+
+		aafiAudioTrack *tmp = aafi->Audio->Tracks;
+
+		for (; tmp != NULL; tmp = tmp->next )
+			if ( tmp->next == NULL )
+				break;
+
+		tmp->next = track;
+	}
+	else {
+		aafi->Audio->Tracks = track;
+	}
+
+	return track;
+}
+
+
+
+aafiVideoTrack * aafi_newVideoTrack( AAF_Iface *aafi )
+{
+	aafiVideoTrack *track = calloc( 1, sizeof(aafiVideoTrack) );
+
+	if ( !track ) {
+		error( "Out of memory" );
+		return NULL;
+	}
+
+	track->Video = aafi->Video;
+	track->next  = NULL;
 
 	/* Add to track list */
 
@@ -710,307 +1212,832 @@ aafiVideoTrack * aafi_newVideoTrack( AAF_Iface *aafi )
 
 
 
-aafiTimelineItem * aafi_newTimelineItem( AAF_Iface *aafi, void *track, int itemType, void *data )
+aafiTimelineItem * aafi_newTimelineItem( AAF_Iface *aafi, void *track, int itemType, void *data )
+{
+	aafiTimelineItem *timelineItem = calloc( 1, sizeof(aafiTimelineItem) );
+
+	if ( !timelineItem ) {
+		error( "Out of memory" );
+		return NULL;
+	}
+
+	timelineItem->type = itemType;
+	timelineItem->data = data;
+
+
+	if ( track == NULL ) {
+		return timelineItem;
+	}
+
+	aafiTimelineItem **first = NULL;
+	aafiTimelineItem **last  = NULL;
+
+	if ( itemType == AAFI_AUDIO_CLIP || itemType == AAFI_TRANS ) {
+		first = &((aafiAudioTrack*)track)->timelineItems;
+		last  = &((aafiAudioTrack*)track)->lastTimelineItem;
+	}
+	else if ( itemType == AAFI_VIDEO_CLIP ) {
+		first = &((aafiVideoTrack*)track)->timelineItems;
+		last  = &((aafiVideoTrack*)track)->lastTimelineItem;
+	}
+	else {
+		return timelineItem;
+	}
+
+
+	/* Add to track's timelineItem list */
+
+	timelineItem->track = track;
+	timelineItem->prev = *last;
+
+	if ( *last != NULL ) {
+		(*last)->next = timelineItem;
+	}
+	else {
+		*first = timelineItem;
+	}
+
+	*last = timelineItem;
+
+	timelineItem->clipIndex = ( timelineItem->prev ) ? timelineItem->prev->clipIndex : 0;
+
+	if ( itemType == AAFI_AUDIO_CLIP || itemType == AAFI_VIDEO_CLIP ) {
+		timelineItem->clipIndex++;
+	}
+
+
+	return timelineItem;
+}
+
+
+
+aafiAudioClip * aafi_newAudioClip( AAF_Iface *aafi, aafiAudioTrack *track ) {
+
+	aafiAudioClip *audioClip = calloc( 1, sizeof(aafiAudioClip) );
+
+	if ( !audioClip ) {
+		error( "Out of memory" );
+		return NULL;
+	}
+
+	audioClip->track = track;
+	audioClip->timelineItem = aafi_newTimelineItem( aafi, track, AAFI_AUDIO_CLIP, audioClip );
+
+	if ( !audioClip->timelineItem ) {
+		error( "Could not create new timelineItem" );
+		free( audioClip );
+		return NULL;
+	}
+
+	return audioClip;
+}
+
+
+
+aafiVideoClip * aafi_newVideoClip( AAF_Iface *aafi, aafiVideoTrack *track ) {
+
+	aafiVideoClip *videoClip = calloc( 1, sizeof(aafiVideoClip) );
+
+	if ( !videoClip ) {
+		error( "Out of memory" );
+		return NULL;
+	}
+
+	videoClip->track = track;
+	videoClip->timelineItem = aafi_newTimelineItem( aafi, track, AAFI_VIDEO_CLIP, videoClip );
+
+	if ( !videoClip->timelineItem ) {
+		error( "Could not create new timelineItem" );
+		free( videoClip );
+		return NULL;
+	}
+
+	return videoClip;
+}
+
+
+
+aafiTransition * aafi_newTransition( AAF_Iface *aafi, aafiAudioTrack *track ) {
+
+	aafiTransition *trans = calloc( 1, sizeof(aafiTransition) );
+
+	if ( !trans ) {
+		error( "Out of memory" );
+		return NULL;
+	}
+
+	trans->timelineItem = aafi_newTimelineItem( aafi, track, AAFI_TRANS, trans );
+
+	if ( !trans->timelineItem ) {
+		error( "Could not create new timelineItem" );
+		free(trans);
+		return NULL;
+	}
+
+	trans->time_a  = calloc( 2, sizeof(aafRational_t) );
+	trans->value_a = calloc( 2, sizeof(aafRational_t) );
+
+	if ( !trans->time_a || !trans->value_a ) {
+		error( "Out of memory" );
+		aafi_removeTimelineItem( aafi, trans->timelineItem );
+		return NULL;
+	}
+
+	return trans;
+}
+
+
+
+aafiMarker * aafi_newMarker( AAF_Iface *aafi, aafRational_t *editRate, aafPosition_t start, aafPosition_t length, char *name, char *comment, uint16_t *(RGBColor[]) )
+{
+	aafiMarker *marker = calloc( sizeof(aafiMarker), 1 );
+
+	if ( !marker ) {
+		error( "Out of memory" );
+		return NULL;
+	}
+
+	marker->edit_rate = editRate;
+	marker->start = start;
+	marker->length = length;
+
+	marker->name = name;
+	marker->comment = comment;
+
+	marker->prev = NULL;
+	marker->next = NULL;
+
+	if ( RGBColor && *RGBColor ) {
+		marker->RGBColor[0] = (*RGBColor)[0];
+		marker->RGBColor[1] = (*RGBColor)[1];
+		marker->RGBColor[2] = (*RGBColor)[2];
+	}
+
+	if ( aafi->Markers != NULL ) {
+
+		aafiMarker *tmp = aafi->Markers;
+
+		for (; tmp != NULL; tmp = tmp->next )
+			if ( tmp->next == NULL )
+				break;
+
+		tmp->next = marker;
+		marker->prev = marker;
+	}
+	else {
+		aafi->Markers = marker;
+		marker->prev = NULL;
+	}
+
+	return marker;
+}
+
+
+
+aafiMetaData * aafi_newMetadata( AAF_Iface *aafi, aafiMetaData **CommentList )
+{
+	if ( !CommentList ) {
+		return NULL;
+	}
+
+	aafiMetaData *UserComment = calloc( 1, sizeof(aafiMetaData) );
+
+	if ( !UserComment ) {
+		error( "Out of memory" );
+		return NULL;
+	}
+
+
+	if ( *CommentList != NULL ) {
+		UserComment->next = *CommentList;
+		*CommentList = UserComment;
+	}
+	else {
+		*CommentList = UserComment;
+	}
+
+
+	return UserComment;
+}
+
+
+
+aafiComposition * aafi_newComposition( AAF_Iface *aafi, aafObject *CompositionMob )
+{
+	aafiComposition *composition = calloc( 1, sizeof(aafiComposition) );
+
+	if ( !composition ) {
+		error( "Out of memory" );
+		return NULL;
+	}
+
+	composition->Mob = CompositionMob;
+
+	if ( aafi->Compositions == NULL ) {
+		/* first composition is held by the main AAF_Iface */
+		composition->aafi = aafi;
+	}
+	else {
+		composition->aafi = composition_alloc( aafi );
+
+		if ( !composition->aafi ) {
+			error( "Out of memory" );
+			free( composition );
+			return NULL;
+		}
+	}
+
+
+	if ( aafi->Compositions != NULL ) {
+		aafiComposition *last = aafi->Compositions;
+		while ( last->next != NULL ) {
+			last = last->next;
+		}
+		last->next = composition;
+	}
+	else {
+		aafi->Compositions = composition;
+	}
+
+	aafi->compositionCount++;
+
+	return composition;
+}
+
+
+
+static AAF_Iface * composition_alloc( AAF_Iface *aafi )
+{
+	AAF_Iface *compositionAafi = calloc( 1, sizeof(AAF_Iface) );
+
+	if ( !compositionAafi ) {
+		return NULL;
+	}
+
+	compositionAafi->Audio = calloc( 1, sizeof(aafiAudio) );
+	compositionAafi->Video = calloc( 1, sizeof(aafiVideo) );
+
+	/*
+	 * Private copy of AAF_Data, so text buffers used by aaf_get_ObjectPath() and
+	 * other helpers are not shared with other composition parsing threads.
+	 */
+	compositionAafi->aafd = malloc( sizeof(AAF_Data) );
+
+	if ( !compositionAafi->Audio || !compositionAafi->Video || !compositionAafi->aafd ) {
+		composition_release( &compositionAafi );
+		return NULL;
+	}
+
+	memcpy( compositionAafi->aafd, aafi->aafd, sizeof(AAF_Data) );
+
+	/* log and options strings are owned by the main AAF_Iface */
+	compositionAafi->log = aafi->log;
+	compositionAafi->ctx.options = aafi->ctx.options;
+	compositionAafi->parent = aafi;
+
+	return compositionAafi;
+}
+
+
+
+aafiAudioEssencePointer * aafi_newAudioEssencePointer( AAF_Iface *aafi, aafiAudioEssencePointer **list, aafiAudioEssenceFile *audioEssenceFile, uint32_t *essenceChannelNum )
+{
+	aafiAudioEssencePointer * essencePointer = calloc( 1, sizeof(aafiAudioEssencePointer) );
+
+	if ( !essencePointer ) {
+		error( "Out of memory" );
+		return NULL;
+	}
+
+	essencePointer->aafi = aafi;
+	essencePointer->essenceFile = audioEssenceFile;
+	essencePointer->essenceChannel = ( essenceChannelNum ) ? *essenceChannelNum : 0;
+
+
+	if ( *list ) {
+		aafiAudioEssencePointer *last = *list;
+		while ( last->next != NULL ) {
+			last = last->next;
+		}
+		last->next = essencePointer;
+	}
+	else {
+		*list = essencePointer;
+	}
+
+	essencePointer->aafiNext = aafi->Audio->essencePointerList;
+	aafi->Audio->essencePointerList = essencePointer;
+
+	return *list;
+}
+
+
+
+aafiAudioEssencePointer * aafi_internAudioEssencePointer( AAF_Iface *aafi, aafiAudioEssencePointer *essencePointerList )
+{
+	/*
+	 * Lists are interned once complete, not in aafi_newAudioEssencePointer(),
+	 * since parse_SourceClip() can still append or alter pointers of a list
+	 * until the whole clip is parsed (AAFOperationDef_AudioChannelCombiner).
+	 */
+
+	if ( !aafi || !essencePointerList ) {
+		return NULL;
+	}
+
+	uint32_t hash = essence_pointer_list_hash( essencePointerList );
+
+	if ( aafi->Audio->essencePointerIndex ) {
+
+		aafiAudioEssencePointer *interned = aafi->Audio->essencePointerIndex[hash & (aafi->Audio->essencePointerIndexSize-1)];
+
+		for (; interned != NULL; interned = interned->indexNext ) {
+			if ( interned->indexHash == hash && essence_pointer_list_equal( interned, essencePointerList ) ) {
+				return interned;
+			}
+		}
+	}
+
+	if ( essence_pointer_index_reserve( aafi ) < 0 ) {
+		return NULL;
+	}
+
+	uint32_t bucket = hash & (aafi->Audio->essencePointerIndexSize-1);
+
+	essencePointerList->indexHash = hash;
+	essencePointerList->indexNext = aafi->Audio->essencePointerIndex[bucket];
+
+	aafi->Audio->essencePointerIndex[bucket] = essencePointerList;
+	aafi->Audio->essencePointerIndexCount++;
+
+	return essencePointerList;
+}
+
+
+
+aafiAudioEssenceFile * aafi_newAudioEssence( AAF_Iface *aafi, aafMobID_t *sourceMobID, uint32_t sourceMobSlotID )
+{
+	aafiAudioEssenceFile * audioEssenceFile = calloc( 1, sizeof(aafiAudioEssenceFile) );
+
+	if ( !audioEssenceFile ) {
+		error( "Out of memory" );
+		goto err;
+	}
+
+	audioEssenceFile->samplerateRational = malloc( sizeof(aafRational_t) );
+
+	if ( !audioEssenceFile->samplerateRational ) {
+		error( "Out of memory" );
+		goto err;
+	}
+
+	audioEssenceFile->samplerateRational->numerator = 1;
+	audioEssenceFile->samplerateRational->denominator = 1;
+
+	audioEssenceFile->sourceMobID = sourceMobID;
+	audioEssenceFile->sourceMobSlotID = sourceMobSlotID;
+
+	if ( audio_essence_add( aafi, audioEssenceFile ) < 0 ) {
+		goto err;
+	}
+
+	return audioEssenceFile;
+
+err:
+	if ( audioEssenceFile ) {
+		free( audioEssenceFile->samplerateRational );
+		free( audioEssenceFile );
+	}
+
+	return NULL;
+}
+
+
+
+aafiVideoEssence * aafi_newVideoEssence( AAF_Iface *aafi, aafMobID_t *sourceMobID, uint32_t sourceMobSlotID )
+{
+	aafiVideoEssence * videoEssenceFile = calloc( 1, sizeof(aafiVideoEssence) );
+
+	if ( !videoEssenceFile ) {
+		error( "Out of memory" );
+		return NULL;
+	}
+
+	videoEssenceFile->sourceMobID = sourceMobID;
+	videoEssenceFile->sourceMobSlotID = sourceMobSlotID;
+
+	if ( video_essence_add( aafi, videoEssenceFile ) < 0 ) {
+		free( videoEssenceFile );
+		return NULL;
+	}
+
+	return videoEssenceFile;
+}
+
+
+
+aafiAudioEssenceFile * aafi_getAudioEssence( AAF_Iface *aafi, aafMobID_t *sourceMobID, uint32_t sourceMobSlotID )
+{
+	if ( !aafi || !sourceMobID ) {
+		return NULL;
+	}
+
+	if ( aafi->Audio->essenceIndex ) {
+
+		uint32_t bucket = essence_index_hash( sourceMobID, sourceMobSlotID, aafi->Audio->essenceIndexSize );
+
+		aafiAudioEssenceFile *audioEssenceFile = aafi->Audio->essenceIndex[bucket];
+
+		for (; audioEssenceFile != NULL; audioEssenceFile = audioEssenceFile->indexNext ) {
+			if ( aafMobIDCmp( audioEssenceFile->sourceMobID, sourceMobID ) && audioEssenceFile->sourceMobSlotID == sourceMobSlotID ) {
+				return audioEssenceFile;
+			}
+		}
+	}
+
+	/*
+	 * Main AAF_Iface index is never modified while compositions are parsed, so
+	 * it can be shared by every composition parsing thread.
+	 */
+	return aafi_getAudioEssence( aafi->parent, sourceMobID, sourceMobSlotID );
+}
+
+
+
+aafiVideoEssence * aafi_getVideoEssence( AAF_Iface *aafi, aafMobID_t *sourceMobID, uint32_t sourceMobSlotID )
 {
-	aafiTimelineItem *timelineItem = calloc( 1, sizeof(aafiTimelineItem) );
-
-	if ( !timelineItem ) {
-		error( "Out of memory" );
+	if ( !aafi || !sourceMobID ) {
 		return NULL;
 	}
 
-	timelineItem->type = itemType;
-	timelineItem->data = data;
+	if ( aafi->Video->essenceIndex ) {
 
+		uint32_t bucket = essence_index_hash( sourceMobID, sourceMobSlotID, aafi->Video->essenceIndexSize );
 
-	if ( itemType == AAFI_AUDIO_CLIP || itemType == AAFI_TRANS ) {
+		aafiVideoEssence *videoEssenceFile = aafi->Video->essenceIndex[bucket];
+
+		for (; videoEssenceFile != NULL; videoEssenceFile = videoEssenceFile->indexNext ) {
+			if ( aafMobIDCmp( videoEssenceFile->sourceMobID, sourceMobID ) && videoEssenceFile->sourceMobSlotID == sourceMobSlotID ) {
+				return videoEssenceFile;
+			}
+		}
+	}
+
+	return aafi_getVideoEssence( aafi->parent, sourceMobID, sourceMobSlotID );
+}
 
-		if ( track != NULL ) {
 
-			/* Add to track's timelineItem list */
 
-			if ( ((aafiAudioTrack*)track)->timelineItems != NULL ) {
+int aafi_mergeCompositionEssences( AAF_Iface *aafi, AAF_Iface *compositionAafi )
+{
+	/*
+	 * Essences created while parsing the composition are moved to the main
+	 * AAF_Iface in creation order, as if they were created by a sequential
+	 * parsing. Essences created by a previous composition too are replaced
+	 * with the main AAF_Iface ones.
+	 */
 
-				aafiTimelineItem *tmp = ((aafiAudioTrack*)track)->timelineItems;
+	int rc = 0;
 
-				for (; tmp != NULL; tmp = tmp->next )
-					if ( tmp->next == NULL )
-						break;
+	aafiAudioEssenceFile *audioEssenceFile = NULL;
+	aafiAudioEssenceFile *nextAudioEssence = NULL;
+	aafiAudioEssenceFile *createdAudioEssences = NULL;
+	aafiAudioEssenceFile *duplicateAudioEssences = NULL;
 
-				tmp->next  = timelineItem;
-				timelineItem->prev = tmp;
-			}
-			else {
-				((aafiAudioTrack*)track)->timelineItems = timelineItem;
-				timelineItem->prev = NULL;
-			}
-		}
+	/* reverse list, so it is in creation order */
+	for ( audioEssenceFile = compositionAafi->Audio->essenceFiles; audioEssenceFile != NULL; audioEssenceFile = nextAudioEssence ) {
+		nextAudioEssence = audioEssenceFile->next;
+		audioEssenceFile->next = createdAudioEssences;
+		createdAudioEssences = audioEssenceFile;
 	}
-	else if ( itemType == AAFI_VIDEO_CLIP ) {
 
-		if ( track != NULL ) {
+	compositionAafi->Audio->essenceFiles = NULL;
+	compositionAafi->Audio->essenceCount = 0;
 
-			/* Add to track's timelineItem list */
+	free( compositionAafi->Audio->essenceIndex );
+	compositionAafi->Audio->essenceIndex = NULL;
+	compositionAafi->Audio->essenceIndexSize = 0;
 
-			if ( ((aafiVideoTrack*)track)->timelineItems != NULL ) {
+	for ( audioEssenceFile = createdAudioEssences; audioEssenceFile != NULL; audioEssenceFile = nextAudioEssence ) {
 
-				aafiTimelineItem *tmp = ((aafiVideoTrack*)track)->timelineItems;
+		nextAudioEssence = audioEssenceFile->next;
 
-				for (; tmp != NULL; tmp = tmp->next )
-					if ( tmp->next == NULL )
-						break;
+		if ( aafi_getAudioEssence( aafi, audioEssenceFile->sourceMobID, audioEssenceFile->sourceMobSlotID ) ) {
+			audioEssenceFile->next = duplicateAudioEssences;
+			duplicateAudioEssences = audioEssenceFile;
+			continue;
+		}
 
-				tmp->next  = timelineItem;
-				timelineItem->prev = tmp;
-			}
-			else {
-				((aafiVideoTrack*)track)->timelineItems = timelineItem;
-				timelineItem->prev = NULL;
-			}
+		if ( audio_essence_add( aafi, audioEssenceFile ) < 0 ) {
+			audioEssenceFile->next = duplicateAudioEssences;
+			duplicateAudioEssences = audioEssenceFile;
+			rc = -1;
+			continue;
 		}
+
+		/* name must be unique accross all compositions */
+		free( audioEssenceFile->unique_name );
+		audioEssenceFile->unique_name = NULL;
+
+		aafi_build_unique_audio_essence_name( aafi, audioEssenceFile );
 	}
 
 
-	return timelineItem;
-}
+	aafiAudioEssencePointer *essencePointer = compositionAafi->Audio->essencePointerList;
+	aafiAudioEssencePointer *lastEssencePointer = NULL;
 
+	for (; essencePointer != NULL; essencePointer = essencePointer->aafiNext ) {
 
+		aafiAudioEssenceFile *mainAudioEssence = aafi_getAudioEssence( aafi, essencePointer->essenceFile->sourceMobID, essencePointer->essenceFile->sourceMobSlotID );
 
-aafiAudioClip * aafi_newAudioClip( AAF_Iface *aafi, aafiAudioTrack *track ) {
+		if ( mainAudioEssence ) {
+			essencePointer->essenceFile = mainAudioEssence;
+		}
 
-	aafiAudioClip *audioClip = calloc( 1, sizeof(aafiAudioClip) );
+		essencePointer->aafi = aafi;
+		lastEssencePointer = essencePointer;
+	}
 
-	if ( !audioClip ) {
-		error( "Out of memory" );
-		return NULL;
+	if ( lastEssencePointer ) {
+		lastEssencePointer->aafiNext = aafi->Audio->essencePointerList;
+		aafi->Audio->essencePointerList = compositionAafi->Audio->essencePointerList;
+		compositionAafi->Audio->essencePointerList = NULL;
 	}
 
-	audioClip->track = track;
-	audioClip->timelineItem = aafi_newTimelineItem( aafi, track, AAFI_AUDIO_CLIP, audioClip );
+	aafi_freeAudioEssences( &duplicateAudioEssences );
 
-	if ( !audioClip->timelineItem ) {
-		error( "Could not create new timelineItem" );
-		free( audioClip );
-		return NULL;
-	}
 
-	return audioClip;
-}
 
+	aafiVideoEssence *videoEssenceFile = NULL;
+	aafiVideoEssence *nextVideoEssence = NULL;
+	aafiVideoEssence *createdVideoEssences = NULL;
+	aafiVideoEssence *duplicateVideoEssences = NULL;
 
+	for ( videoEssenceFile = compositionAafi->Video->essenceFiles; videoEssenceFile != NULL; videoEssenceFile = nextVideoEssence ) {
+		nextVideoEssence = videoEssenceFile->next;
+		videoEssenceFile->next = createdVideoEssences;
+		createdVideoEssences = videoEssenceFile;
+	}
 
-aafiVideoClip * aafi_newVideoClip( AAF_Iface *aafi, aafiVideoTrack *track ) {
+	compositionAafi->Video->essenceFiles = NULL;
+	compositionAafi->Video->essenceCount = 0;
 
-	aafiVideoClip *videoClip = calloc( 1, sizeof(aafiVideoClip) );
+	free( compositionAafi->Video->essenceIndex );
+	compositionAafi->Video->essenceIndex = NULL;
+	compositionAafi->Video->essenceIndexSize = 0;
 
-	if ( !videoClip ) {
-		error( "Out of memory" );
-		return NULL;
-	}
+	for ( videoEssenceFile = createdVideoEssences; videoEssenceFile != NULL; videoEssenceFile = nextVideoEssence ) {
 
-	videoClip->track = track;
-	videoClip->timelineItem = aafi_newTimelineItem( aafi, track, AAFI_VIDEO_CLIP, videoClip );
+		nextVideoEssence = videoEssenceFile->next;
 
-	if ( !videoClip->timelineItem ) {
-		error( "Could not create new timelineItem" );
-		free( videoClip );
-		return NULL;
+		if ( aafi_getVideoEssence( aafi, videoEssenceFile->sourceMobID, videoEssenceFile->sourceMobSlotID ) ||
+		     video_essence_add( aafi, videoEssenceFile ) < 0 )
+		{
+			videoEssenceFile->next = duplicateVideoEssences;
+			duplicateVideoEssences = videoEssenceFile;
+		}
 	}
 
-	return videoClip;
-}
+	aafiVideoTrack *videoTrack = NULL;
+	aafiTimelineItem *videoItem = NULL;
 
+	AAFI_foreachVideoTrack( compositionAafi, videoTrack ) {
+		AAFI_foreachTrackItem( videoTrack, videoItem ) {
 
+			aafiVideoClip *videoClip = videoItem->data;
 
-aafiTransition * aafi_newTransition( AAF_Iface *aafi, aafiAudioTrack *track ) {
+			if ( videoItem->type != AAFI_VIDEO_CLIP || !videoClip->Essence ) {
+				continue;
+			}
 
-	aafiTransition *trans = calloc( 1, sizeof(aafiTransition) );
+			aafiVideoEssence *mainVideoEssence = aafi_getVideoEssence( aafi, videoClip->Essence->sourceMobID, videoClip->Essence->sourceMobSlotID );
 
-	if ( !trans ) {
-		error( "Out of memory" );
-		return NULL;
+			if ( mainVideoEssence ) {
+				videoClip->Essence = mainVideoEssence;
+			}
+		}
 	}
 
-	trans->timelineItem = aafi_newTimelineItem( aafi, track, AAFI_TRANS, trans );
+	aafi_freeVideoEssences( &duplicateVideoEssences );
 
-	if ( !trans->timelineItem ) {
-		error( "Could not create new timelineItem" );
-		free(trans);
-		return NULL;
-	}
+	return rc;
+}
 
-	trans->time_a  = calloc( 2, sizeof(aafRational_t) );
-	trans->value_a = calloc( 2, sizeof(aafRational_t) );
 
-	if ( !trans->time_a || !trans->value_a ) {
-		error( "Out of memory" );
-		aafi_freeTimelineItem( trans->timelineItem );
-		return NULL;
+
+static uint32_t essence_index_hash( const aafMobID_t *sourceMobID, uint32_t sourceMobSlotID, uint32_t indexSize )
+{
+	/* FNV-1a */
+	uint32_t hash = 2166136261u;
+
+	if ( sourceMobID ) {
+
+		const unsigned char *p = (const unsigned char*)sourceMobID;
+
+		for ( size_t i = 0; i < sizeof(aafMobID_t); i++ ) {
+			hash ^= p[i];
+			hash *= 16777619u;
+		}
 	}
 
-	return trans;
+	for ( int i = 0; i < 4; i++ ) {
+		hash ^= (sourceMobSlotID >> (i*8)) & 0xff;
+		hash *= 16777619u;
+	}
+
+	/* indexSize is a power of two */
+	return hash & (indexSize-1);
 }
 
 
 
-aafiMarker * aafi_newMarker( AAF_Iface *aafi, aafRational_t *editRate, aafPosition_t start, aafPosition_t length, char *name, char *comment, uint16_t *(RGBColor[]) )
+static uint32_t essence_pointer_list_hash( aafiAudioEssencePointer *essencePointerList )
 {
-	aafiMarker *marker = calloc( sizeof(aafiMarker), 1 );
+	/* FNV-1a */
+	uint32_t hash = 2166136261u;
 
-	if ( !marker ) {
-		error( "Out of memory" );
-		return NULL;
-	}
+	aafiAudioEssencePointer *essencePointer = NULL;
 
-	marker->edit_rate = editRate;
-	marker->start = start;
-	marker->length = length;
+	AAFI_foreachEssencePointer( essencePointerList, essencePointer ) {
 
-	marker->name = name;
-	marker->comment = comment;
+		uintptr_t file = (uintptr_t)essencePointer->essenceFile;
 
-	marker->prev = NULL;
-	marker->next = NULL;
+		for ( size_t i = 0; i < sizeof(uintptr_t); i++ ) {
+			hash ^= (uint32_t)(file >> (i*8)) & 0xff;
+			hash *= 16777619u;
+		}
 
-	if ( RGBColor && *RGBColor ) {
-		marker->RGBColor[0] = (*RGBColor)[0];
-		marker->RGBColor[1] = (*RGBColor)[1];
-		marker->RGBColor[2] = (*RGBColor)[2];
+		for ( int i = 0; i < 4; i++ ) {
+			hash ^= (essencePointer->essenceChannel >> (i*8)) & 0xff;
+			hash *= 16777619u;
+		}
 	}
 
-	if ( aafi->Markers != NULL ) {
+	return hash;
+}
 
-		aafiMarker *tmp = aafi->Markers;
 
-		for (; tmp != NULL; tmp = tmp->next )
-			if ( tmp->next == NULL )
-				break;
 
-		tmp->next = marker;
-		marker->prev = marker;
-	}
-	else {
-		aafi->Markers = marker;
-		marker->prev = NULL;
+static int essence_pointer_list_equal( aafiAudioEssencePointer *list1, aafiAudioEssencePointer *list2 )
+{
+	for (; list1 != NULL && list2 != NULL; list1 = list1->next, list2 = list2->next ) {
+		if ( list1->essenceFile != list2->essenceFile || list1->essenceChannel != list2->essenceChannel ) {
+			return 0;
+		}
 	}
 
-	return marker;
+	return ( list1 == NULL && list2 == NULL );
 }
 
 
 
-aafiMetaData * aafi_newMetadata( AAF_Iface *aafi, aafiMetaData **CommentList )
+static int essence_pointer_index_reserve( AAF_Iface *aafi )
 {
-	if ( !CommentList ) {
-		return NULL;
+	aafiAudio *audio = aafi->Audio;
+
+	if ( audio->essencePointerIndex && audio->essencePointerIndexCount < audio->essencePointerIndexSize ) {
+		return 0;
 	}
 
-	aafiMetaData *UserComment = calloc( 1, sizeof(aafiMetaData) );
+	uint32_t indexSize = ( audio->essencePointerIndexSize ) ? audio->essencePointerIndexSize * 2 : ESSENCE_INDEX_MIN_SIZE;
 
-	if ( !UserComment ) {
+	aafiAudioEssencePointer **essencePointerIndex = calloc( indexSize, sizeof(aafiAudioEssencePointer*) );
+
+	if ( !essencePointerIndex ) {
 		error( "Out of memory" );
-		return NULL;
+		return -1;
 	}
 
+	for ( uint32_t i = 0; i < audio->essencePointerIndexSize; i++ ) {
 
-	if ( *CommentList != NULL ) {
-		UserComment->next = *CommentList;
-		*CommentList = UserComment;
-	}
-	else {
-		*CommentList = UserComment;
+		aafiAudioEssencePointer *interned = audio->essencePointerIndex[i];
+		aafiAudioEssencePointer *next = NULL;
+
+		for (; interned != NULL; interned = next ) {
+			next = interned->indexNext;
+			interned->indexNext = essencePointerIndex[interned->indexHash & (indexSize-1)];
+			essencePointerIndex[interned->indexHash & (indexSize-1)] = interned;
+		}
 	}
 
+	free( audio->essencePointerIndex );
 
-	return UserComment;
+	audio->essencePointerIndex = essencePointerIndex;
+	audio->essencePointerIndexSize = indexSize;
+
+	return 0;
 }
 
 
 
-aafiAudioEssencePointer * aafi_newAudioEssencePointer( AAF_Iface *aafi, aafiAudioEssencePointer **list, aafiAudioEssenceFile *audioEssenceFile, uint32_t *essenceChannelNum )
+static int audio_essence_index_reserve( AAF_Iface *aafi )
 {
-	aafiAudioEssencePointer * essencePointer = calloc( 1, sizeof(aafiAudioEssencePointer) );
+	aafiAudio *audio = aafi->Audio;
 
-	if ( !essencePointer ) {
-		error( "Out of memory" );
-		return NULL;
+	if ( audio->essenceIndex && (uint32_t)audio->essenceCount < audio->essenceIndexSize ) {
+		return 0;
 	}
 
-	essencePointer->aafi = aafi;
-	essencePointer->essenceFile = audioEssenceFile;
-	essencePointer->essenceChannel = ( essenceChannelNum ) ? *essenceChannelNum : 0;
+	uint32_t indexSize = ( audio->essenceIndexSize ) ? audio->essenceIndexSize * 2 : ESSENCE_INDEX_MIN_SIZE;
 
+	aafiAudioEssenceFile **essenceIndex = calloc( indexSize, sizeof(aafiAudioEssenceFile*) );
 
-	if ( *list ) {
-		aafiAudioEssencePointer *last = *list;
-		while ( last->next != NULL ) {
-			last = last->next;
-		}
-		last->next = essencePointer;
+	if ( !essenceIndex ) {
+		error( "Out of memory" );
+		return -1;
 	}
-	else {
-		*list = essencePointer;
+
+	aafiAudioEssenceFile *audioEssenceFile = NULL;
+
+	AAFI_foreachAudioEssenceFile( aafi, audioEssenceFile ) {
+		uint32_t bucket = essence_index_hash( audioEssenceFile->sourceMobID, audioEssenceFile->sourceMobSlotID, indexSize );
+		audioEssenceFile->indexNext = essenceIndex[bucket];
+		essenceIndex[bucket] = audioEssenceFile;
 	}
 
-	essencePointer->aafiNext = aafi->Audio->essencePointerList;
-	aafi->Audio->essencePointerList = essencePointer;
+	free( audio->essenceIndex );
 
-	return *list;
+	audio->essenceIndex = essenceIndex;
+	audio->essenceIndexSize = indexSize;
+
+	return 0;
 }
 
 
 
-aafiAudioEssenceFile * aafi_newAudioEssence( AAF_Iface *aafi )
+static int video_essence_index_reserve( AAF_Iface *aafi )
 {
-	aafiAudioEssenceFile * audioEssenceFile = calloc( 1, sizeof(aafiAudioEssenceFile) );
+	aafiVideo *video = aafi->Video;
 
-	if ( !audioEssenceFile ) {
-		error( "Out of memory" );
-		goto err;
+	if ( video->essenceIndex && (uint32_t)video->essenceCount < video->essenceIndexSize ) {
+		return 0;
 	}
 
-	audioEssenceFile->samplerateRational = malloc( sizeof(aafRational_t) );
+	uint32_t indexSize = ( video->essenceIndexSize ) ? video->essenceIndexSize * 2 : ESSENCE_INDEX_MIN_SIZE;
 
-	if ( !audioEssenceFile->samplerateRational ) {
+	aafiVideoEssence **essenceIndex = calloc( indexSize, sizeof(aafiVideoEssence*) );
+
+	if ( !essenceIndex ) {
 		error( "Out of memory" );
-		goto err;
+		return -1;
 	}
 
-	audioEssenceFile->samplerateRational->numerator = 1;
-	audioEssenceFile->samplerateRational->denominator = 1;
+	aafiVideoEssence *videoEssenceFile = NULL;
+
+	AAFI_foreachVideoEssence( aafi, videoEssenceFile ) {
+		uint32_t bucket = essence_index_hash( videoEssenceFile->sourceMobID, videoEssenceFile->sourceMobSlotID, indexSize );
+		videoEssenceFile->indexNext = essenceIndex[bucket];
+		essenceIndex[bucket] = videoEssenceFile;
+	}
+
+	free( video->essenceIndex );
+
+	video->essenceIndex = essenceIndex;
+	video->essenceIndexSize = indexSize;
+
+	return 0;
+}
+
+
+
+static int audio_essence_add( AAF_Iface *aafi, aafiAudioEssenceFile *audioEssenceFile )
+{
+	if ( audio_essence_index_reserve( aafi ) < 0 ) {
+		return -1;
+	}
 
 	audioEssenceFile->next = aafi->Audio->essenceFiles;
 
 	aafi->Audio->essenceFiles = audioEssenceFile;
 	aafi->Audio->essenceCount++;
 
-	return audioEssenceFile;
+	uint32_t bucket = essence_index_hash( audioEssenceFile->sourceMobID, audioEssenceFile->sourceMobSlotID, aafi->Audio->essenceIndexSize );
 
-err:
-	if ( audioEssenceFile ) {
-		free( audioEssenceFile->samplerateRational );
-		free( audioEssenceFile );
-	}
+	audioEssenceFile->indexNext = aafi->Audio->essenceIndex[bucket];
+	aafi->Audio->essenceIndex[bucket] = audioEssenceFile;
 
-	return NULL;
+	return 0;
 }
 
 
 
-aafiVideoEssence * aafi_newVideoEssence( AAF_Iface *aafi )
+static int video_essence_add( AAF_Iface *aafi, aafiVideoEssence *videoEssenceFile )
 {
-	aafiVideoEssence * videoEssenceFile = calloc( 1, sizeof(aafiVideoEssence) );
-
-	if ( !videoEssenceFile ) {
-		error( "Out of memory" );
-		return NULL;
+	if ( video_essence_index_reserve( aafi ) < 0 ) {
+		return -1;
 	}
 
 	videoEssenceFile->next = aafi->Video->essenceFiles;
 
 	aafi->Video->essenceFiles = videoEssenceFile;
+	aafi->Video->essenceCount++;
 
-	return videoEssenceFile;
+	uint32_t bucket = essence_index_hash( videoEssenceFile->sourceMobID, videoEssenceFile->sourceMobSlotID, aafi->Video->essenceIndexSize );
+
+	videoEssenceFile->indexNext = aafi->Video->essenceIndex[bucket];
+	aafi->Video->essenceIndex[bucket] = videoEssenceFile;
+
+	return 0;
 }
 
 
@@ -1069,6 +2096,7 @@ void aafi_freeAudioTracks( aafiAudioTrack **tracks )
 		aafi_freeAudioGain( track->gain );
 		aafi_freeAudioPan( track->pan );
 		aafi_freeTimelineItems( &track->timelineItems );
+		aafi_freeRangeIndex( &track->rangeIndex );
 
 		free( track );
 	}
@@ -1093,6 +2121,7 @@ void aafi_freeVideoTracks( aafiVideoTrack **tracks )
 
 		free( track->name );
 		aafi_freeTimelineItems( &track->timelineItems );
+		aafi_freeRangeIndex( &track->rangeIndex );
 
 		free( track );
 	}
@@ -1190,6 +2219,77 @@ void aafi_freeMarkers( aafiMarker **Markers )
 
 
 
+
+void aafi_freeCompositions( AAF_Iface *aafi )
+{
+	aafiComposition *composition = NULL;
+	aafiComposition *nextComposition = NULL;
+
+	for ( composition = aafi->Compositions; composition != NULL; composition = nextComposition ) {
+
+		nextComposition = composition->next;
+
+		if ( composition->aafi != aafi ) {
+			composition_release( &composition->aafi );
+		}
+
+		free( composition );
+	}
+
+	aafi->Compositions = NULL;
+	aafi->compositionCount = 0;
+}
+
+
+
+static void composition_release( AAF_Iface **compositionAafi )
+{
+	if ( !compositionAafi || !(*compositionAafi) ) {
+		return;
+	}
+
+	if ( (*compositionAafi)->Audio != NULL ) {
+
+		aafi_freeAudioTracks( &(*compositionAafi)->Audio->Tracks );
+		aafi_freeAudioEssences( &(*compositionAafi)->Audio->essenceFiles );
+		free( (*compositionAafi)->Audio->essenceIndex );
+		free( (*compositionAafi)->Audio->essencePointerIndex );
+
+		aafiAudioEssencePointer *essencePointer = (*compositionAafi)->Audio->essencePointerList;
+
+		while ( essencePointer ) {
+			essencePointer = aafi_freeAudioEssencePointer( essencePointer );
+		}
+
+		free( (*compositionAafi)->Audio );
+	}
+
+	if ( (*compositionAafi)->Video != NULL ) {
+
+		aafi_freeVideoTracks( &(*compositionAafi)->Video->Tracks );
+		aafi_freeVideoEssences( &(*compositionAafi)->Video->essenceFiles );
+		free( (*compositionAafi)->Video->essenceIndex );
+
+		free( (*compositionAafi)->Video );
+	}
+
+	aafi_freeMarkers( &(*compositionAafi)->Markers );
+	aafi_freeRangeIndex( &(*compositionAafi)->markersRangeIndex );
+	aafi_freeMetadata( &((*compositionAafi)->metadata) );
+
+	free( (*compositionAafi)->compositionName );
+	free( (*compositionAafi)->Timecode );
+
+	/* shallow copy of main AAF_Data, see composition_alloc() */
+	free( (*compositionAafi)->aafd );
+
+	free( *compositionAafi );
+
+	*compositionAafi = NULL;
+}
+
+
+
 void aafi_freeMetadata( aafiMetaData **CommentList )
 {
 	aafiMetaData *UserComment = *CommentList;
@@ -1241,6 +2341,9 @@ void aafi_freeAudioEssences( aafiAudioEssenceFile **audioEssenceFile )
 		free( (*audioEssenceFile)->samplerateRational );
 
 		aafi_freeMetadata( &((*audioEssenceFile)->metadata) );
+		aafi_freeSampleReader( *audioEssenceFile );
+		aafi_freePeaks( *audioEssenceFile );
+		aafi_freeLoudness( *audioEssenceFile );
 
 		free( *audioEssenceFile );
 	}
@@ -1283,6 +2386,7 @@ void aafi_freeAudioGain( aafiAudioGain *gain )
 
 	free( gain->time );
 	free( gain->value );
+	free( gain->envelope );
 
 	free( gain );
 }
@@ -19,6 +19,8 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
 
 #include <libaaf/AAFIface.h>
 #include <libaaf/ProTools.h>
@@ -68,10 +70,51 @@ static const char PROTOOLS_CLIP_NAME_SAMPLE_ACCURATE_EDIT_ZH_TW[] = "\xe7\xb2\xb
 
 
 
+/*
+ * After replace_clipFade() or remove_sampleAccurateEditClip() changed a track,
+ * post-processing resumes that many items before the processed one : changes
+ * never reach further than two items away, and a clip only depends on its two
+ * closest neighbours on each side.
+ */
+#define PROTOOLS_RESUME_DISTANCE 4
+
+
+enum protools_clip_type {
+	PROTOOLS_CLIP_REGULAR = 0,
+	PROTOOLS_CLIP_RENDERED_FADE,
+	PROTOOLS_CLIP_SAMPLE_ACCURATE_EDIT,
+};
+
+struct protools_clip_class {
+	aafiAudioEssenceFile *essenceFile;
+	enum protools_clip_type type;
+};
+
+struct protools_clip_classes {
+	struct protools_clip_class *entries;
+	size_t count;
+};
+
+
+
 static int is_rendered_fade( const char *clipName );
 static int is_sample_accurate_edit( const char *clipName );
+
+/**
+ * Classifies each audio essence file name once, and keeps rendered fades and
+ * sample accurate edits sorted by essence file address.
+ */
+static int build_clipClasses( AAF_Iface *aafi, struct protools_clip_classes *classes );
+static int cmp_clipClass( const void *a, const void *b );
+
+/**
+ * Retrieves the type of a clip, as classified by build_clipClasses().
+ */
+static enum protools_clip_type get_clipType( struct protools_clip_classes *classes, aafiAudioClip *audioClip );
+
 static int remove_sampleAccurateEditClip( AAF_Iface *aafi, aafiAudioTrack *audioTrack, aafiTimelineItem *saeItem );
-static int replace_clipFade( AAF_Iface *aafi, aafiAudioTrack *audioTrack, aafiTimelineItem *fadeItem );
+static int replace_clipFade( AAF_Iface *aafi, aafiAudioTrack *audioTrack, aafiTimelineItem *fadeItem, struct protools_clip_classes *classes );
+static void remove_timelineItem( aafiAudioTrack *audioTrack, aafiTimelineItem *timelineItem );
 
 
 
@@ -127,6 +170,87 @@ static int is_sample_accurate_edit( const char *clipName ) {
 
 
 
+static int build_clipClasses( AAF_Iface *aafi, struct protools_clip_classes *classes ) {
+
+	aafiAudioEssenceFile *audioEssenceFile = NULL;
+
+	size_t essenceCount = 0;
+
+	classes->entries = NULL;
+	classes->count = 0;
+
+	AAFI_foreachAudioEssenceFile( aafi, audioEssenceFile ) {
+		essenceCount++;
+	}
+
+	if ( essenceCount == 0 ) {
+		return 0;
+	}
+
+	classes->entries = malloc( essenceCount * sizeof(struct protools_clip_class) );
+
+	if ( !classes->entries ) {
+		error( "Out of memory" );
+		return -1;
+	}
+
+	AAFI_foreachAudioEssenceFile( aafi, audioEssenceFile ) {
+
+		if ( !audioEssenceFile->name ) {
+			continue;
+		}
+
+		enum protools_clip_type type = PROTOOLS_CLIP_REGULAR;
+
+		if ( is_rendered_fade( audioEssenceFile->name ) ) {
+			type = PROTOOLS_CLIP_RENDERED_FADE;
+		}
+		else if ( is_sample_accurate_edit( audioEssenceFile->name ) ) {
+			type = PROTOOLS_CLIP_SAMPLE_ACCURATE_EDIT;
+		}
+		else {
+			continue;
+		}
+
+		classes->entries[classes->count].essenceFile = audioEssenceFile;
+		classes->entries[classes->count].type = type;
+		classes->count++;
+	}
+
+	qsort( classes->entries, classes->count, sizeof(struct protools_clip_class), cmp_clipClass );
+
+	return 0;
+}
+
+
+
+static int cmp_clipClass( const void *a, const void *b ) {
+
+	uintptr_t essenceA = (uintptr_t)((const struct protools_clip_class *)a)->essenceFile;
+	uintptr_t essenceB = (uintptr_t)((const struct protools_clip_class *)b)->essenceFile;
+
+	return ( essenceA > essenceB ) - ( essenceA < essenceB );
+}
+
+
+
+static enum protools_clip_type get_clipType( struct protools_clip_classes *classes, aafiAudioClip *audioClip ) {
+
+	if ( classes->count == 0 ) {
+		return PROTOOLS_CLIP_REGULAR;
+	}
+
+	struct protools_clip_class key;
+
+	key.essenceFile = audioClip->essencePointerList->essenceFile;
+
+	struct protools_clip_class *class = bsearch( &key, classes->entries, classes->count, sizeof(struct protools_clip_class), cmp_clipClass );
+
+	return ( class ) ? class->type : PROTOOLS_CLIP_REGULAR;
+}
+
+
+
 static int remove_sampleAccurateEditClip( AAF_Iface *aafi, aafiAudioTrack *audioTrack, aafiTimelineItem *saeItem ) {
 
 	/*
@@ -155,9 +279,7 @@ static int remove_sampleAccurateEditClip( AAF_Iface *aafi, aafiAudioTrack *audio
 
 					leftClip->len += saeClip->len;
 
-					aafi_removeTimelineItem( aafi, saeItem );
-
-					audioTrack->clipCount--;
+					remove_timelineItem( audioTrack, saeItem );
 					return 1;
 				}
 				// else {
@@ -194,9 +316,7 @@ static int remove_sampleAccurateEditClip( AAF_Iface *aafi, aafiAudioTrack *audio
 					rightClip->len += saeClip->len;
 					rightClip->essence_offset -= saeClip->len;
 
-					aafi_removeTimelineItem( aafi, saeItem );
-
-					audioTrack->clipCount--;
+					remove_timelineItem( audioTrack, saeItem );
 					return 1;
 				}
 				// else {
@@ -215,7 +335,7 @@ static int remove_sampleAccurateEditClip( AAF_Iface *aafi, aafiAudioTrack *audio
 
 
 
-static int replace_clipFade( AAF_Iface *aafi, aafiAudioTrack *audioTrack, aafiTimelineItem *fadeItem ) {
+static int replace_clipFade( AAF_Iface *aafi, aafiAudioTrack *audioTrack, aafiTimelineItem *fadeItem, struct protools_clip_classes *classes ) {
 
 	aafiAudioClip    *fadeClip  = fadeItem->data;
 
@@ -237,7 +357,7 @@ static int replace_clipFade( AAF_Iface *aafi, aafiAudioTrack *audioTrack, aafiTi
 
 			/* a previous clip is touching this fadeClip on the left */
 
-			if ( is_sample_accurate_edit( prevClip->essencePointerList->essenceFile->name ) ) {
+			if ( get_clipType( classes, prevClip ) == PROTOOLS_CLIP_SAMPLE_ACCURATE_EDIT ) {
 
 				remove_sampleAccurateEditClip( aafi, audioTrack, prevItem1 );
 
@@ -274,7 +394,7 @@ static int replace_clipFade( AAF_Iface *aafi, aafiAudioTrack *audioTrack, aafiTi
 
 			/* a following clip is touching this fadeClip on the right */
 
-			if ( is_sample_accurate_edit( nextClip->essencePointerList->essenceFile->name ) ) {
+			if ( get_clipType( classes, nextClip ) == PROTOOLS_CLIP_SAMPLE_ACCURATE_EDIT ) {
 
 				remove_sampleAccurateEditClip( aafi, audioTrack, nextItem1 );
 
@@ -356,8 +476,7 @@ static int replace_clipFade( AAF_Iface *aafi, aafiAudioTrack *audioTrack, aafiTi
 
 	if ( !fadeItem->data ) {
 		error( "Out of memory" );
-		aafi_removeTimelineItem( aafi, fadeItem );
-		audioTrack->clipCount--;
+		remove_timelineItem( audioTrack, fadeItem );
 		return 1; /* important ! */
 	}
 
@@ -371,8 +490,7 @@ static int replace_clipFade( AAF_Iface *aafi, aafiAudioTrack *audioTrack, aafiTi
 
 	if ( !trans->time_a || !trans->value_a ) {
 		error( "Out of memory" );
-		aafi_removeTimelineItem( aafi, fadeItem );
-		audioTrack->clipCount--;
+		remove_timelineItem( audioTrack, fadeItem );
 		return 1; /* important ! */
 	}
 
@@ -426,54 +544,82 @@ static int replace_clipFade( AAF_Iface *aafi, aafiAudioTrack *audioTrack, aafiTi
 
 
 
+static void remove_timelineItem( aafiAudioTrack *audioTrack, aafiTimelineItem *timelineItem ) {
+
+	/*
+	 * Clip indexes are updated once the whole track was processed, by
+	 * protools_post_processing().
+	 */
+
+	aafi_unlinkTimelineItem( timelineItem );
+	aafi_freeTimelineItem( timelineItem );
+
+	audioTrack->clipCount--;
+}
+
+
+
 int protools_post_processing( AAF_Iface *aafi ) {
 
 	aafiAudioTrack *audioTrack = NULL;
 
+	struct protools_clip_classes classes;
+
+	if ( build_clipClasses( aafi, &classes ) < 0 ) {
+		return -1;
+	}
+
 	AAFI_foreachAudioTrack( aafi, audioTrack ) {
 
 		aafiTimelineItem *audioItem = audioTrack->timelineItems;
 
 		while ( audioItem != NULL ) {
 
-			aafiTimelineItem *audioItemNext = audioItem->next;
-
 			if ( audioItem->type != AAFI_AUDIO_CLIP ) {
-				audioItem = audioItemNext;
+				audioItem = audioItem->next;
 				continue;
 			}
 
-			aafiAudioClip *audioClip = (aafiAudioClip*)audioItem->data;
+			enum protools_clip_type clipType = get_clipType( &classes, audioItem->data );
 
-			char *clipName = audioClip->essencePointerList->essenceFile->name;
+			if ( !( clipType == PROTOOLS_CLIP_RENDERED_FADE         && (aafi->ctx.options.protools & AAFI_PROTOOLS_OPT_REPLACE_CLIP_FADES) ) &&
+			     !( clipType == PROTOOLS_CLIP_SAMPLE_ACCURATE_EDIT && (aafi->ctx.options.protools & AAFI_PROTOOLS_OPT_REMOVE_SAMPLE_ACCURATE_EDIT) ) )
+			{
+				audioItem = audioItem->next;
+				continue;
+			}
 
-			int previousClipCount = audioTrack->clipCount;
+			/*
+			 * Item to resume from if track changes. Neither replace_clipFade() nor
+			 * remove_sampleAccurateEditClip() can remove it. NULL means track head.
+			 */
+			aafiTimelineItem *resumeItem = audioItem;
 
-			if ( (aafi->ctx.options.protools & AAFI_PROTOOLS_OPT_REPLACE_CLIP_FADES) &&
-			      is_rendered_fade( clipName ) )
-			{
-				replace_clipFade( aafi, audioTrack, audioItem );
+			for ( int i = 0; i < PROTOOLS_RESUME_DISTANCE && resumeItem; i++ ) {
+				resumeItem = resumeItem->prev;
+			}
 
-				if ( previousClipCount != audioTrack->clipCount ) {
-					audioItem = audioTrack->timelineItems;
-					continue;
-				}
+			int previousClipCount = audioTrack->clipCount;
+
+			if ( clipType == PROTOOLS_CLIP_RENDERED_FADE ) {
+				replace_clipFade( aafi, audioTrack, audioItem, &classes );
 			}
-			else
-			if ( (aafi->ctx.options.protools & AAFI_PROTOOLS_OPT_REMOVE_SAMPLE_ACCURATE_EDIT) &&
-			      is_sample_accurate_edit( clipName ) )
-			{
+			else {
 				remove_sampleAccurateEditClip( aafi, audioTrack, audioItem );
-				
-				if ( previousClipCount != audioTrack->clipCount ) {
-					audioItem = audioTrack->timelineItems;
-					continue;
-				}
 			}
 
-			audioItem = audioItemNext;
+			if ( previousClipCount != audioTrack->clipCount ) {
+				audioItem = ( resumeItem ) ? resumeItem : audioTrack->timelineItems;
+				continue;
+			}
+
+			audioItem = audioItem->next;
 		}
+
+		aafi_updateTimelineItemIndexes( audioTrack->timelineItems );
 	}
 
+	free( classes.entries );
+
 	return 0;
 }
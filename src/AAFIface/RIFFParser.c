@@ -46,18 +46,30 @@ static uint32_t beExtended2leUint32( const unsigned char numx[10] );
 
 
 
-int laaf_riff_writeWavFileHeader( FILE *fp, struct wavFmtChunk *wavFmt, struct wavBextChunk *wavBext, uint32_t audioDataSize, struct aafLog *log ) {
+int laaf_riff_writeWavFileHeader( FILE *fp, struct wavFmtChunk *wavFmt, struct wavBextChunk *wavBext, uint64_t audioDataSize, int rf64, struct aafLog *log ) {
 
 	(void)log;
-	size_t filesize = (4 /* WAVE */) + sizeof(struct wavFmtChunk) + ((wavBext) ? sizeof(struct wavBextChunk) : 0) + (8 /*data chunk header*/) + audioDataSize;
+	int fact = ( wavFmt->format_tag != RIFF_WAVE_FORMAT_PCM );
+	uint64_t filesize = (4 /* WAVE */) + sizeof(struct wavFmtChunk) + ((fact) ? sizeof(struct wavFactChunk) : 0) + ((wavBext) ? sizeof(struct wavBextChunk) : 0) + (8 /*data chunk header*/) + audioDataSize;
 
-	size_t writtenBytes = fwrite( "RIFF", sizeof(unsigned char), 4, fp );
+	if ( filesize > UINT32_MAX ) {
+		rf64 = 1;
+	}
+
+	if ( rf64 ) {
+		filesize += sizeof(struct wavDs64Chunk);
+	}
+
+	uint32_t riffSize = ( rf64 ) ? UINT32_MAX : (uint32_t)filesize;
+	uint32_t dataSize = ( rf64 ) ? UINT32_MAX : (uint32_t)audioDataSize;
+
+	size_t writtenBytes = fwrite( (rf64) ? "RF64" : "RIFF", sizeof(unsigned char), 4, fp );
 
 	if ( writtenBytes < 4 ) {
 		return -1;
 	}
 
-	writtenBytes = fwrite( &filesize, sizeof(uint32_t), 1, fp );
+	writtenBytes = fwrite( &riffSize, sizeof(uint32_t), 1, fp );
 
 	if ( writtenBytes < 1 ) {
 		return -1;
@@ -74,16 +86,54 @@ int laaf_riff_writeWavFileHeader( FILE *fp, struct wavFmtChunk *wavFmt, struct w
 	wavFmt->ckid[2] = 't';
 	wavFmt->ckid[3] = ' ';
 	wavFmt->cksz = sizeof(struct wavFmtChunk) - sizeof(struct riffChunk);
-	wavFmt->format_tag = 1; /* PCM */
 	wavFmt->avg_bytes_per_sec = wavFmt->samples_per_sec * wavFmt->channels * wavFmt->bits_per_sample/8;
 	wavFmt->block_align = wavFmt->channels * (wavFmt->bits_per_sample>>3);
 
+	if ( rf64 ) {
+		/* ds64 has to be the first chunk of RF64 files */
+		struct wavDs64Chunk ds64;
+
+		ds64.ckid[0] = 'd';
+		ds64.ckid[1] = 's';
+		ds64.ckid[2] = '6';
+		ds64.ckid[3] = '4';
+		ds64.cksz = sizeof(struct wavDs64Chunk) - sizeof(struct riffChunk);
+		ds64.riff_size = filesize;
+		ds64.data_size = audioDataSize;
+		ds64.sample_count = ( wavFmt->block_align ) ? audioDataSize / wavFmt->block_align : 0;
+		ds64.table_length = 0;
+
+		writtenBytes = fwrite( (unsigned char*)&ds64, sizeof(unsigned char), sizeof(struct wavDs64Chunk), fp );
+
+		if ( writtenBytes < sizeof(struct wavDs64Chunk) ) {
+			return -1;
+		}
+	}
+
 	writtenBytes = fwrite( (unsigned char*)wavFmt, sizeof(unsigned char), sizeof(struct wavFmtChunk), fp );
 
 	if ( writtenBytes < sizeof(struct wavFmtChunk) ) {
 		return -1;
 	}
 
+	if ( fact ) {
+		struct wavFactChunk wavFact;
+		uint64_t sampleCount = ( wavFmt->block_align ) ? audioDataSize / wavFmt->block_align : 0;
+
+		wavFact.ckid[0] = 'f';
+		wavFact.ckid[1] = 'a';
+		wavFact.ckid[2] = 'c';
+		wavFact.ckid[3] = 't';
+		wavFact.cksz = sizeof(struct wavFactChunk) - sizeof(struct riffChunk);
+		wavFact.sample_length = ( sampleCount > UINT32_MAX ) ? UINT32_MAX : (uint32_t)sampleCount; /* ds64 holds the real count */
+
+		writtenBytes = fwrite( (unsigned char*)&wavFact, sizeof(unsigned char), sizeof(struct wavFactChunk), fp );
+
+		if ( writtenBytes < sizeof(struct wavFactChunk) ) {
+			return -1;
+		}
+	}
+
 	if ( wavBext ) {
 		wavBext->ckid[0] = 'b';
 		wavBext->ckid[1] = 'e';
@@ -105,7 +155,7 @@ int laaf_riff_writeWavFileHeader( FILE *fp, struct wavFmtChunk *wavFmt, struct w
 		return -1;
 	}
 
-	writtenBytes = fwrite( &audioDataSize, sizeof(uint32_t), 1, fp );
+	writtenBytes = fwrite( &dataSize, sizeof(uint32_t), 1, fp );
 
 	if ( writtenBytes < 1 ) {
 		return -1;
@@ -116,6 +166,35 @@ int laaf_riff_writeWavFileHeader( FILE *fp, struct wavFmtChunk *wavFmt, struct w
 
 
 
+int laaf_riff_sampleFormat( uint16_t formatTag, uint16_t sampleSize, enum laafSampleFormat *format ) {
+
+	if ( formatTag == RIFF_WAVE_FORMAT_IEEE_FLOAT ) {
+
+		if ( sampleSize != 32 ) {
+			return -1;
+		}
+
+		*format = LAAF_SAMPLE_F32;
+		return 0;
+	}
+
+	if ( formatTag != RIFF_WAVE_FORMAT_PCM ) {
+		return -1;
+	}
+
+	switch ( sampleSize ) {
+		case 16: *format = LAAF_SAMPLE_S16; break;
+		case 24: *format = LAAF_SAMPLE_S24; break;
+		case 32: *format = LAAF_SAMPLE_S32; break;
+		default:
+			return -1;
+	}
+
+	return 0;
+}
+
+
+
 int laaf_riff_parseAudioFile( struct RIFFAudioFile *RIFFAudioFile, enum RIFF_PARSER_FLAGS flags, size_t (*readerCallback)(unsigned char *, size_t, size_t, void*, void*, void*), void *user1, void *user2, void *user3, struct aafLog *log ) {
 
 	struct riffChunk chunk;
@@ -210,6 +289,23 @@ int laaf_riff_parseAudioFile( struct RIFFAudioFile *RIFFAudioFile, enum RIFF_PAR
 				RIFFAudioFile->channels   = wavFmtChunk.channels;
 				RIFFAudioFile->sampleSize = wavFmtChunk.bits_per_sample;
 				RIFFAudioFile->sampleRate = wavFmtChunk.samples_per_sec;
+				RIFFAudioFile->formatTag  = wavFmtChunk.format_tag;
+
+				if ( wavFmtChunk.format_tag == RIFF_WAVE_FORMAT_EXTENSIBLE ) {
+
+					uint16_t subFormat = 0;
+
+					RIFFAudioFile->formatTag = 0;
+
+					if ( chunk.cksz + sizeof(chunk) >= RIFF_WAVE_FORMAT_EXTENSIBLE_SUBFORMAT + sizeof(subFormat) ) {
+
+						bytesRead = readerCallback( (unsigned char*)&subFormat, pos + RIFF_WAVE_FORMAT_EXTENSIBLE_SUBFORMAT, sizeof(subFormat), user1, user2, user3 );
+
+						if ( bytesRead != RIFF_READER_ERROR && bytesRead == sizeof(subFormat) ) {
+							RIFFAudioFile->formatTag = subFormat;
+						}
+					}
+				}
 
 				if ( flags & RIFF_PARSE_ONLY_HEADER ) {
 					return 0;
@@ -254,6 +350,25 @@ int laaf_riff_parseAudioFile( struct RIFFAudioFile *RIFFAudioFile, enum RIFF_PAR
 				RIFFAudioFile->sampleSize  = BE2LE16(aiffCOMMChunk.sampleSize);
 				RIFFAudioFile->sampleRate  = beExtended2leUint32(aiffCOMMChunk.sampleRate);
 				RIFFAudioFile->sampleCount = BE2LE32(aiffCOMMChunk.numSampleFrames);
+				RIFFAudioFile->formatTag   = RIFF_WAVE_FORMAT_PCM;
+
+				if ( riff.format[3] == 'C' && chunk.cksz + sizeof(chunk) >= AIFC_COMM_COMPRESSION_TYPE_OFFSET + 4 ) {
+
+					char compressionType[4] = { 0 };
+
+					bytesRead = readerCallback( (unsigned char*)compressionType, pos + AIFC_COMM_COMPRESSION_TYPE_OFFSET, sizeof(compressionType), user1, user2, user3 );
+
+					if ( bytesRead == RIFF_READER_ERROR || bytesRead < sizeof(compressionType) ) {
+						RIFFAudioFile->formatTag = 0;
+					}
+					else if ( memcmp( compressionType, "fl32", 4 ) == 0 || memcmp( compressionType, "FL32", 4 ) == 0 ) {
+						RIFFAudioFile->formatTag = RIFF_WAVE_FORMAT_IEEE_FLOAT;
+					}
+					else if ( memcmp( compressionType, "NONE", 4 ) != 0 && memcmp( compressionType, "twos", 4 ) != 0 ) {
+						/* compressed, or little endian 'sowt' samples */
+						RIFFAudioFile->formatTag = 0;
+					}
+				}
 
 				if ( flags & RIFF_PARSE_ONLY_HEADER ) {
 					return 0;
@@ -22,6 +22,7 @@
 #define __RIFFParser__
 
 #include <libaaf/log.h>
+#include <libaaf/sample.h>
 
 #if defined(__linux__)
 	#include <limits.h>
@@ -61,6 +62,7 @@ struct RIFFAudioFile {
   uint16_t channels;
   uint64_t sampleCount; /* total samples for 1 channel (no matter channel count). (sampleCount / sampleRate) = duration in seconds */
 	size_t   pcm_audio_start_offset;
+	uint16_t formatTag; /* RIFF_WAVE_FORMAT_*. AIFF and AIFC are mapped to PCM or IEEE_FLOAT, 0 if compressed */
 };
 
 
@@ -84,6 +86,32 @@ PACK(struct riffChunk {
 
 
 
+/* wavFmtChunk.format_tag */
+#define RIFF_WAVE_FORMAT_PCM        0x0001
+#define RIFF_WAVE_FORMAT_IEEE_FLOAT 0x0003
+#define RIFF_WAVE_FORMAT_EXTENSIBLE 0xfffe /* actual format tag is in the first two bytes of the SubFormat GUID */
+
+/* byte offset of WAVE_FORMAT_EXTENSIBLE SubFormat, from 'fmt ' chunk start */
+#define RIFF_WAVE_FORMAT_EXTENSIBLE_SUBFORMAT 32
+
+
+
+/*
+ * EBU Tech 3306 RF64 'ds64' chunk, holding 64 bits sizes when the 32 bits
+ * RIFF and data chunk sizes are set to 0xffffffff.
+ */
+PACK(struct wavDs64Chunk {
+	char ckid[4]; /* 'ds64' */
+	uint32_t cksz;
+
+	uint64_t riff_size;
+	uint64_t data_size;
+	uint64_t sample_count;
+	uint32_t table_length;
+});
+
+
+
 PACK(struct wavFmtChunk {
 	char ckid[4]; /* 'fmt ' */
 	uint32_t cksz;
@@ -98,6 +126,18 @@ PACK(struct wavFmtChunk {
 
 
 
+/*
+ * Required by non-PCM formats, holding the sample count of a single channel.
+ */
+PACK(struct wavFactChunk {
+	char ckid[4]; /* 'fact' */
+	uint32_t cksz;
+
+	uint32_t sample_length;
+});
+
+
+
 PACK(struct wavBextChunk {
 	char     ckid[4]; /* 'bext' */
 	uint32_t cksz;
@@ -152,6 +192,9 @@ PACK(struct aiffCOMMChunk {
   unsigned char sampleRate[10]; // 80 bit IEEE Standard 754 floating point number
 });
 
+/* AIFC COMM chunk extends AIFF COMM chunk with compression type and name */
+#define AIFC_COMM_COMPRESSION_TYPE_OFFSET 26
+
 
 PACK(struct aiffSSNDChunk {
   char ckid[4]; /* 'SSND' */
@@ -163,9 +206,21 @@ PACK(struct aiffSSNDChunk {
 
 
 
+/*
+ * Gets the sample format of audio data with formatTag and sampleSize (in bits).
+ * Returns -1 for compressed data and unsupported sample sizes.
+ */
+int laaf_riff_sampleFormat( uint16_t formatTag, uint16_t sampleSize, enum laafSampleFormat *format );
+
 int laaf_riff_parseAudioFile( struct RIFFAudioFile *RIFFAudioFile, enum RIFF_PARSER_FLAGS flags, size_t (*readerCallback)(unsigned char *, size_t, size_t, void*, void*, void*), void *user1, void *user2, void *user3, struct aafLog *log );
 
-int laaf_riff_writeWavFileHeader( FILE *fp, struct wavFmtChunk *wavFmt, struct wavBextChunk *wavBext, uint32_t audioDataSize, struct aafLog *log );
+/*
+ * Writes a WAVE file header, up to the data chunk size. If rf64 is set, or if
+ * the file would exceed 4 GB, an RF64 header with a ds64 chunk is written.
+ * Caller sets wavFmt format_tag, channels, samples_per_sec and bits_per_sample.
+ * A fact chunk is added to non-PCM files.
+ */
+int laaf_riff_writeWavFileHeader( FILE *fp, struct wavFmtChunk *wavFmt, struct wavBextChunk *wavBext, uint64_t audioDataSize, int rf64, struct aafLog *log );
 
 
 #endif // ! __RIFFParser__
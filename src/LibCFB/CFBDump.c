@@ -74,8 +74,10 @@ void cfb_dump_node( CFB_Data *cfbd, cfbNode *node, int print_stream, const char
 	if ( node->_mse == STGTY_STORAGE ||
 			 node->_mse == STGTY_ROOT )
 	{
+		char clsid[CFB_CLSID_TEXT_SZ];
+
 		LOG_BUFFER_WRITE( log, "%s_sidChild    : %s0x%08x%s\n", padding, ANSI_COLOR_DARKGREY(log), node->_sidChild, ANSI_COLOR_RESET(log) );
-		LOG_BUFFER_WRITE( log, "%s_clsid       : %s%s%s\n", padding, ANSI_COLOR_DARKGREY(log), cfb_CLSIDToText( &(node->_clsId) ), ANSI_COLOR_RESET(log) );
+		LOG_BUFFER_WRITE( log, "%s_clsid       : %s%s%s\n", padding, ANSI_COLOR_DARKGREY(log), cfb_CLSIDToText( &(node->_clsId), clsid, sizeof(clsid) ), ANSI_COLOR_RESET(log) );
 		LOG_BUFFER_WRITE( log, "%s_dwUserFlags : %s0x%08x (%d)%s\n", padding, ANSI_COLOR_DARKGREY(log), node->_dwUserFlags, node->_dwUserFlags, ANSI_COLOR_RESET(log) );
 	}
 
@@ -259,8 +261,10 @@ void cfb_dump_header( CFB_Data *cfbd, const char *padding )
 
 	cfbHeader *cfbh = cfbd->hdr;
 
+	char clsid[CFB_CLSID_TEXT_SZ];
+
 	LOG_BUFFER_WRITE( log, "%s_abSig              : %s0x%08"PRIx64"%s\n", padding, ANSI_COLOR_DARKGREY(log), cfbh->_abSig, ANSI_COLOR_RESET(log) );
-	LOG_BUFFER_WRITE( log, "%s_clsId              : %s%s%s\n", padding, ANSI_COLOR_DARKGREY(log), cfb_CLSIDToText( &(cfbh->_clsid) ), ANSI_COLOR_RESET(log) );
+	LOG_BUFFER_WRITE( log, "%s_clsId              : %s%s%s\n", padding, ANSI_COLOR_DARKGREY(log), cfb_CLSIDToText( &(cfbh->_clsid), clsid, sizeof(clsid) ), ANSI_COLOR_RESET(log) );
 	LOG_BUFFER_WRITE( log, "%s_version            : %s%u.%u ( 0x%04x 0x%04x )%s\n",
 		padding,
 		ANSI_COLOR_DARKGREY(log),
@@ -103,6 +103,10 @@
 #include <wchar.h>
 #include <limits.h>
 
+#ifdef LIBAAF_THREADS
+#include <unistd.h>	// pread()
+#endif
+
 #include <libaaf/CFBDump.h>
 #include <libaaf/LibCFB.h>
 #include <libaaf/log.h>
@@ -146,23 +150,20 @@ static cfbSID_t getNodeCount( CFB_Data *cfbd );
 
 static cfbSID_t cfb_getIDByNode( CFB_Data *cfbd, cfbNode *node );
 
+static cfbSectorID_t cfb_getNextStreamSector( cfbStreamReader *reader, cfbSectorID_t id );
 
 
 
 
 
-const char * cfb_CLSIDToText( const cfbCLSID_t *clsid )
-{
-	static char str[96];
 
+const char * cfb_CLSIDToText( const cfbCLSID_t *clsid, char *buf, size_t bufsz )
+{
 	if ( clsid == NULL ) {
-		str[0] = 'n';
-		str[1] = '/';
-		str[2] = 'a';
-		str[3] = '\0';
+		return "n/a";
 	}
 	else {
-		int rc = snprintf( str, sizeof(str), "{ 0x%08x 0x%04x 0x%04x { 0x%02x 0x%02x 0x%02x 0x%02x 0x%02x 0x%02x 0x%02x 0x%02x } }",
+		int rc = snprintf( buf, bufsz, "{ 0x%08x 0x%04x 0x%04x { 0x%02x 0x%02x 0x%02x 0x%02x 0x%02x 0x%02x 0x%02x 0x%02x } }",
 			clsid->Data1,
 			clsid->Data2,
 			clsid->Data3,
@@ -175,13 +176,13 @@ const char * cfb_CLSIDToText( const cfbCLSID_t *clsid )
 			clsid->Data4[6],
 			clsid->Data4[7] );
 
-		if ( rc < 0 || (size_t)rc >= sizeof(str) ) {
+		if ( rc < 0 || (size_t)rc >= bufsz ) {
 			// TODO error
 			return NULL;
 		}
 	}
 
-	return str;
+	return buf;
 }
 
 
@@ -486,6 +487,9 @@ static int cfb_openFile( CFB_Data *cfbd )
  * called by cfb_getSector() and cfb_getMiniSector()
  * that will do the sector index to file offset conversion.
  *
+ * When built with LIBAAF_THREADS, the file is read with pread() so that
+ * concurrent reads do not share the FILE position.
+ *
  * @param cfbd   Pointer to the CFB_Data structure.
  * @param buf    Pointer to the buffer that will hold the len bytes read.
  * @param offset Position in the file the read should start.
@@ -508,7 +512,38 @@ static uint64_t cfb_readFile( CFB_Data *cfbd, unsigned char *buf, size_t offset,
 		return 0;
 	}
 
+#ifdef LIBAAF_THREADS
+
+	size_t byteRead = 0;
+
+	while ( byteRead < reqlen ) {
+
+		ssize_t rc = pread( fileno(fp), buf + byteRead, reqlen - byteRead, (off_t)(offset + byteRead) );
+
+		if ( rc < 0 ) {
+			if ( errno == EINTR )
+				continue;
+			error( "pread() error of CFB : %s.", strerror(errno) );
+			break;
+		}
+
+		if ( rc == 0 ) {
+			error( "Incomplete pread() of CFB due to EOF : %"PRIu64" bytes read out of %"PRIu64" requested", byteRead, reqlen );
+			break;
+		}
+
+		byteRead += (size_t)rc;
+	}
+
+	return byteRead;
+
+#else
+
+#ifdef _WIN32
+	int rc = _fseeki64( fp, (__int64)offset, SEEK_SET );
+#else
 	int rc = fseek( fp, (long)offset, SEEK_SET );
+#endif
 
 	if ( rc < 0 ) {
 		error( "%s.", strerror(errno) );
@@ -534,6 +569,8 @@ static uint64_t cfb_readFile( CFB_Data *cfbd, unsigned char *buf, size_t offset,
 	}
 
 	return byteRead;
+
+#endif
 }
 
 
@@ -584,7 +621,7 @@ unsigned char * cfb_getSector( CFB_Data *cfbd, cfbSectorID_t id )
 
 
 	uint64_t sectorSize = (1 << cfbd->hdr->_uSectorShift);
-	uint64_t fileOffset = (id + 1) << cfbd->hdr->_uSectorShift;
+	uint64_t fileOffset = ((uint64_t)id + 1) << cfbd->hdr->_uSectorShift;
 
 
 	unsigned char *buf = calloc( 1, sectorSize );
@@ -679,7 +716,7 @@ unsigned char * cfb_getMiniSector( CFB_Data *cfbd, cfbSectorID_t id )
 		fatId = cfbd->fat[fatId];
 	}
 
-	offset  = ((fatId + 1) << cfbd->hdr->_uSectorShift);
+	offset  = (((uint64_t)fatId + 1) << cfbd->hdr->_uSectorShift);
 	offset += ((id % fatDiv ) << cfbd->hdr->_uMiniSectorShift);
 
 
@@ -837,6 +874,363 @@ int cfb__foreachSectorInStream( CFB_Data *cfbd, cfbNode *node, unsigned char **b
 
 
 
+/**
+ * Initializes a cfbStreamReader, to read a stream by chunks with cfb_readStream().
+ * Unlike cfb_getStream(), the stream is never loaded as a whole in memory.
+ *
+ * @param  cfbd   Pointer to the CFB_Data structure.
+ * @param  node   Pointer to the Node that hold the stream.
+ * @param  reader Pointer to the cfbStreamReader to initialize.
+ * @return        0 on success\n
+ *               -1 on failure
+ */
+
+int cfb_openStream( CFB_Data *cfbd, cfbNode *node, cfbStreamReader *reader )
+{
+	if ( !cfbd || !node || !reader ) {
+		return -1;
+	}
+
+	memset( reader, 0x00, sizeof(cfbStreamReader) );
+
+	reader->cfbd = cfbd;
+	reader->node = node;
+
+	reader->stream_len = CFB_getNodeStreamLen( cfbd, node );
+	reader->isMini = ( reader->stream_len < cfbd->hdr->_ulMiniSectorCutoff );
+
+	reader->pos = 0;
+	reader->sectID = node->_sectStart;
+
+	return 0;
+}
+
+
+
+/**
+ * Moves the cfbStreamReader position. Only the FAT (or MiniFAT) chain is
+ * walked, no data is read. Seeking backward starts again from the beginning
+ * of the chain. If the reader has an extent index, the (mini-)sector is found
+ * by a binary search over extents instead.
+ *
+ * @param  reader Pointer to the cfbStreamReader structure.
+ * @param  offset Position in the stream the next read should start.
+ * @return        0 on success\n
+ *               -1 on failure
+ */
+
+int cfb_seekStream( cfbStreamReader *reader, uint64_t offset )
+{
+	CFB_Data *cfbd = reader->cfbd;
+
+	if ( offset > reader->stream_len ) {
+		error( "Requested stream offset %"PRIu64" is beyond stream length %"PRIu64, offset, reader->stream_len );
+		return -1;
+	}
+
+	uint16_t shift = ( reader->isMini ) ? cfbd->hdr->_uMiniSectorShift : cfbd->hdr->_uSectorShift;
+
+	if ( reader->index ) {
+
+		const cfbStreamIndex *index = reader->index;
+
+		uint32_t lo = 0;
+		uint32_t hi = index->count;
+
+		/* last extent starting at or before offset */
+
+		while ( hi - lo > 1 ) {
+
+			uint32_t mid = lo + (hi - lo) / 2;
+
+			if ( index->extents[mid].offset <= offset ) {
+				lo = mid;
+			} else {
+				hi = mid;
+			}
+		}
+
+		reader->pos = offset;
+		reader->sectID = CFB_END_OF_CHAIN;
+
+		if ( index->count > 0 ) {
+
+			const cfbStreamExtent *extent = &index->extents[lo];
+
+			uint64_t sector = (offset - extent->offset) >> shift;
+
+			if ( sector < extent->count ) {
+				reader->sectID = (cfbSectorID_t)(extent->sectID + sector);
+			}
+		}
+
+		return 0;
+	}
+
+	uint64_t target  = offset >> shift;
+	uint64_t current = reader->pos >> shift;
+
+	cfbSectorID_t id = reader->sectID;
+
+	if ( offset < reader->pos ) {
+		current = 0;
+		id = reader->node->_sectStart;
+	}
+
+	for (; current < target; current++ ) {
+
+		if ( id >= CFB_MAX_REG_SID ) {
+			error( "Stream chain ends before offset %"PRIu64, offset );
+			return -1;
+		}
+
+		id = cfb_getNextStreamSector( reader, id );
+	}
+
+	reader->pos = offset;
+	reader->sectID = id;
+
+	return 0;
+}
+
+
+
+/**
+ * Reads up to len bytes from the cfbStreamReader position, and moves the
+ * position forward. Contiguous sectors are read from file at once.
+ *
+ * @param  reader Pointer to the cfbStreamReader structure.
+ * @param  buf    Pointer to a buffer of at least len bytes.
+ * @param  len    Number of bytes to read.
+ * @return        The number of bytes read, which is less than len if the
+ *                stream end was reached or on failure.
+ */
+
+uint64_t cfb_readStream( cfbStreamReader *reader, unsigned char *buf, uint64_t len )
+{
+	CFB_Data *cfbd = reader->cfbd;
+
+	uint16_t shift = ( reader->isMini ) ? cfbd->hdr->_uMiniSectorShift : cfbd->hdr->_uSectorShift;
+	uint64_t sectorSize = (1 << shift);
+
+	uint64_t done = 0;
+
+	if ( len > reader->stream_len - reader->pos ) {
+		len = reader->stream_len - reader->pos;
+	}
+
+	while ( done < len ) {
+
+		if ( reader->sectID >= CFB_MAX_REG_SID ) {
+			error( "Stream chain ends before stream length (%"PRIu64" bytes)", reader->stream_len );
+			break;
+		}
+
+		uint64_t sectorOffset = reader->pos & (sectorSize-1);
+		uint64_t n = 0;
+
+		if ( reader->isMini ) {
+
+			unsigned char *sector = cfb_getMiniSector( cfbd, reader->sectID );
+
+			if ( !sector ) {
+				break;
+			}
+
+			n = ( sectorSize - sectorOffset < len - done ) ? sectorSize - sectorOffset : len - done;
+
+			memcpy( buf + done, sector + sectorOffset, n );
+
+			free( sector );
+
+			reader->pos += n;
+			done += n;
+
+			if ( (reader->pos & (sectorSize-1)) == 0 ) {
+				reader->sectID = cfb_getNextStreamSector( reader, reader->sectID );
+			}
+
+			continue;
+		}
+
+
+		if ( reader->sectID >= cfbd->fat_sz ) {
+			error( "Asking for an out of range FAT sector @ index %u (max FAT index is %u)", reader->sectID, cfbd->fat_sz );
+			break;
+		}
+
+		/* gathers contiguous sectors, so they are read in a single call */
+		cfbSectorID_t last = reader->sectID;
+		uint64_t available = sectorSize - sectorOffset;
+
+		while ( available < len - done &&
+		        last + 1 < cfbd->fat_sz &&
+		        cfbd->fat[last] == last + 1 )
+		{
+			last++;
+			available += sectorSize;
+		}
+
+		n = ( available < len - done ) ? available : len - done;
+
+		uint64_t fileOffset = ((uint64_t)(reader->sectID + 1) << shift) + sectorOffset;
+
+		if ( cfb_readFile( cfbd, buf + done, fileOffset, n ) != n ) {
+			break;
+		}
+
+		uint64_t sectorsRead = (sectorOffset + n) >> shift;
+
+		if ( reader->sectID + sectorsRead <= last ) {
+			reader->sectID = (cfbSectorID_t)(reader->sectID + sectorsRead);
+		}
+		else {
+			reader->sectID = cfb_getNextStreamSector( reader, last );
+		}
+
+		reader->pos += n;
+		done += n;
+	}
+
+	return done;
+}
+
+
+
+/**
+ * Builds the extent index of a stream, by walking its (mini-)sector chain once.
+ * Contiguous sectors are merged into a single extent. The index is given to
+ * readers through cfbStreamReader.index, and can be shared by several readers
+ * of the same stream.
+ *
+ * @param  cfbd Pointer to the CFB_Data structure.
+ * @param  node Pointer to the Node that hold the stream.
+ * @return      Pointer to the index, to be released with cfb_freeStreamIndex()\n
+ *              NULL on failure
+ */
+
+cfbStreamIndex * cfb_indexStream( CFB_Data *cfbd, cfbNode *node )
+{
+	cfbStreamReader reader;
+
+	if ( cfb_openStream( cfbd, node, &reader ) < 0 ) {
+		return NULL;
+	}
+
+	uint16_t shift = ( reader.isMini ) ? cfbd->hdr->_uMiniSectorShift : cfbd->hdr->_uSectorShift;
+	uint64_t sectors = (reader.stream_len + (1u << shift) - 1) >> shift;
+
+	uint32_t capacity = 0;
+
+	cfbStreamIndex *index = calloc( 1, sizeof(cfbStreamIndex) );
+
+	if ( !index ) {
+		error( "Out of memory" );
+		return NULL;
+	}
+
+	cfbSectorID_t id = node->_sectStart;
+	uint64_t offset = 0;
+	uint64_t n = 0;
+
+	while ( n < sectors ) {
+
+		if ( id >= CFB_MAX_REG_SID ) {
+			error( "Stream chain ends before stream length (%"PRIu64" bytes)", reader.stream_len );
+			goto err;
+		}
+
+		if ( index->count == capacity ) {
+
+			capacity = ( capacity ) ? capacity * 2 : 16;
+
+			cfbStreamExtent *extents = realloc( index->extents, capacity * sizeof(cfbStreamExtent) );
+
+			if ( !extents ) {
+				error( "Out of memory" );
+				goto err;
+			}
+
+			index->extents = extents;
+		}
+
+		cfbStreamExtent *extent = &index->extents[index->count++];
+
+		extent->offset = offset;
+		extent->sectID = id;
+		extent->count  = 1;
+
+		cfbSectorID_t next = cfb_getNextStreamSector( &reader, id );
+
+		n++;
+
+		while ( n < sectors && next == id + 1 && extent->count < UINT32_MAX ) {
+			id = next;
+			next = cfb_getNextStreamSector( &reader, id );
+			extent->count++;
+			n++;
+		}
+
+		offset += (uint64_t)extent->count << shift;
+		id = next;
+	}
+
+	debug( "Stream of %"PRIu64" bytes indexed in %u extents", reader.stream_len, index->count );
+
+	return index;
+
+err:
+	cfb_freeStreamIndex( index );
+
+	return NULL;
+}
+
+
+
+void cfb_freeStreamIndex( cfbStreamIndex *index )
+{
+	if ( !index ) {
+		return;
+	}
+
+	free( index->extents );
+	free( index );
+}
+
+
+
+/**
+ * Retrieves the sector following id in the chain of a cfbStreamReader stream.
+ *
+ * @param  reader Pointer to the cfbStreamReader structure.
+ * @param  id     Index of the current (mini-)sector.
+ * @return        Index of the next (mini-)sector, #CFB_END_OF_CHAIN on failure.
+ */
+
+static cfbSectorID_t cfb_getNextStreamSector( cfbStreamReader *reader, cfbSectorID_t id )
+{
+	CFB_Data *cfbd = reader->cfbd;
+
+	if ( reader->isMini ) {
+
+		if ( id >= cfbd->miniFat_sz ) {
+			error( "Asking for an out of range MiniFAT sector @ index %u (Maximum MiniFAT index is %u)", id, cfbd->miniFat_sz );
+			return CFB_END_OF_CHAIN;
+		}
+
+		return cfbd->miniFat[id];
+	}
+
+	if ( id >= cfbd->fat_sz ) {
+		error( "Asking for an out of range FAT sector @ index %u (max FAT index is %u)", id, cfbd->fat_sz );
+		return CFB_END_OF_CHAIN;
+	}
+
+	return cfbd->fat[id];
+}
+
+
+
 /**
  * Retrieves the Header of the Compound File Binary.
  * The Header begins at offset 0 and is 512 bytes long,
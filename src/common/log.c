@@ -20,6 +20,10 @@
 
 #include <stdio.h>
 
+#ifdef LIBAAF_THREADS
+	#include <pthread.h>
+#endif
+
 #ifdef _WIN32
 	#include <windows.h>
 	#include <io.h>
@@ -47,6 +51,32 @@
 #endif
 
 
+void laaf_lock_log( struct aafLog *log )
+{
+#ifdef LIBAAF_THREADS
+	if ( log && log->_lock ) {
+		pthread_mutex_lock( log->_lock );
+	}
+#else
+	(void)log;
+#endif
+}
+
+
+
+void laaf_unlock_log( struct aafLog *log )
+{
+#ifdef LIBAAF_THREADS
+	if ( log && log->_lock ) {
+		pthread_mutex_unlock( log->_lock );
+	}
+#else
+	(void)log;
+#endif
+}
+
+
+
 struct aafLog * laaf_new_log( void )
 {
 	struct aafLog *log = calloc( 1, sizeof(struct aafLog) );
@@ -59,6 +89,27 @@ struct aafLog * laaf_new_log( void )
 	log->fp = stdout;
 	log->ansicolor = 0;
 
+#ifdef LIBAAF_THREADS
+	/*
+	 * Serializes writes to this log, since its message buffers are shared by
+	 * every thread using it. Mutex is recursive, so AAF_LOG() can hold it
+	 * while message arguments are built.
+	 */
+	pthread_mutexattr_t attr;
+
+	log->_lock = malloc( sizeof(pthread_mutex_t) );
+
+	if ( !log->_lock ) {
+		free( log );
+		return NULL;
+	}
+
+	pthread_mutexattr_init( &attr );
+	pthread_mutexattr_settype( &attr, PTHREAD_MUTEX_RECURSIVE );
+	pthread_mutex_init( log->_lock, &attr );
+	pthread_mutexattr_destroy( &attr );
+#endif
+
 	return log;
 }
 
@@ -70,7 +121,15 @@ void laaf_free_log( struct aafLog *log )
 		return;
 	}
 
+#ifdef LIBAAF_THREADS
+	if ( log->_lock ) {
+		pthread_mutex_destroy( log->_lock );
+	}
+#endif
+
+	free( log->_lock );
 	free( log->_msg );
+	free( log->_write_msg );
 	free( log );
 }
 
@@ -162,6 +221,19 @@ void laaf_log_callback( struct aafLog *log, void *ctxdata, int libid, int type,
 
 
 void laaf_write_log( struct aafLog *log, void *ctxdata, enum log_source_id lib, enum verbosityLevel_e type, const char *srcfile, const char *srcfunc, int srcline, const char *format, ... )
+{
+	va_list ap;
+
+	va_start( ap, format );
+
+	laaf_vwrite_log( log, ctxdata, lib, type, srcfile, srcfunc, srcline, format, ap );
+
+	va_end( ap );
+}
+
+
+
+void laaf_vwrite_log( struct aafLog *log, void *ctxdata, enum log_source_id lib, enum verbosityLevel_e type, const char *srcfile, const char *srcfunc, int srcline, const char *format, va_list args )
 {
 	if ( !log ) {
 		return;
@@ -176,96 +248,93 @@ void laaf_write_log( struct aafLog *log, void *ctxdata, enum log_source_id lib,
 	}
 
 
-	va_list ap;
-
-	int rc = 0;
-	size_t msgsize = 0;
+	laaf_lock_log( log );
 
-	va_start( ap, format );
+	va_list ap;
 
-#ifdef _WIN32
-	/* https://stackoverflow.com/a/4116308 */
-	FILE *dummy = fopen( "NUL", "wb" );
+	size_t msgpos = 0;
 
-	if ( !dummy ) {
-		// fprintf( stderr, "Could not fopen() dummy null file\n" );
-		return;
-	}
+	va_copy( ap, args );
 
-	rc = vfprintf( dummy, format, ap );
+	/*
+	 * Message is formatted once into a buffer kept across calls. It is only
+	 * formatted again when the buffer had to grow.
+	 */
+	int rc = vsnprintf( log->_write_msg, log->_write_msg_size, format, ap );
 
-	fclose( dummy );
+	va_end( ap );
 
-	if ( rc < 0 ) {
-		// fprintf( stderr, "vfwprintf() error : %s\n", strerror(errno) );
-		va_end( ap );
-		return;
-	}
+#ifdef _WIN32
+	/*
+	 * Windows vsnprintf() returns -1 instead of the message length when the
+	 * buffer is too small. Length is then retrieved by printing to NUL.
+	 * https://stackoverflow.com/a/4116308
+	 */
+	if ( rc < 0 || (size_t)rc >= log->_write_msg_size ) {
+
+		FILE *dummy = fopen( "NUL", "wb" );
+
+		if ( !dummy ) {
+			// fprintf( stderr, "Could not fopen() dummy null file\n" );
+			goto end;
+		}
 
-	rc++;
-	rc *= (int)sizeof(wchar_t);
+		va_copy( ap, args );
 
-#else
-	rc = vsnprintf( NULL, 0, format, ap );
+		rc = vfprintf( dummy, format, ap );
 
-	if ( rc < 0 ) {
-		// fprintf( stderr, "vsnprintf() error : %s\n", strerror(errno) );
 		va_end( ap );
-		return;
-	}
-
-	rc++;
-#endif
-
-	va_end( ap );
-
-	msgsize = (size_t)rc;
 
+		fclose( dummy );
 
-	if ( log->_msg_pos ) {
-		log->_previous_pos = log->_msg_pos;
-		log->_previous_msg = laaf_util_c99strdup( log->_msg );
-		if ( !log->_previous_msg ) {
-			// fprintf( stderr, "Out of memory\n" );
-			return;
+		if ( rc >= 0 ) {
+			rc *= (int)sizeof(wchar_t);
 		}
 	}
+#endif
 
+	if ( rc < 0 ) {
+		// fprintf( stderr, "vsnprintf() error\n" );
+		goto end;
+	}
 
-	va_start( ap, format );
+	if ( (size_t)rc >= log->_write_msg_size ) {
 
-	if ( msgsize >= log->_msg_size ) {
+		size_t msgsize = ( (size_t)rc < 1024 ) ? 1024 : (size_t)rc + 1;
 
-		char *msgtmp = realloc( log->_msg, (msgsize*sizeof(char)) );
+		char *msgtmp = realloc( log->_write_msg, msgsize );
 
 		if ( !msgtmp ) {
 			// fprintf( stderr, "Out of memory\n" );
-			va_end( ap );
-			return;
+			goto end;
 		}
 
-		log->_msg = msgtmp;
-		log->_msg_size = msgsize;
-	}
+		log->_write_msg = msgtmp;
+		log->_write_msg_size = msgsize;
 
-	rc = vsnprintf( log->_msg, log->_msg_size, format, ap );
+		va_copy( ap, args );
+
+		rc = vsnprintf( log->_write_msg, log->_write_msg_size, format, ap );
 
-	if ( rc < 0 || (size_t)rc >= log->_msg_size ) {
-		// fprintf( stderr, "vsnprintf() error\n" );
 		va_end( ap );
-		return;
+
+		if ( rc < 0 || (size_t)rc >= log->_write_msg_size ) {
+			// fprintf( stderr, "vsnprintf() error\n" );
+			goto end;
+		}
 	}
 
-	log->log_callback( log, (void*)ctxdata, lib, type, srcfile, srcfunc, srcline, log->_msg, log->user );
+	/*
+	 * Callback resets the LOG_BUFFER_WRITE() position, although the caller
+	 * might still be building a message into log->_msg.
+	 */
+	msgpos = log->_msg_pos;
 
-	va_end( ap );
+	log->log_callback( log, (void*)ctxdata, lib, type, srcfile, srcfunc, srcline, log->_write_msg, log->user );
 
+	log->_msg_pos = msgpos;
 
-	if ( log->_previous_pos ) {
-		log->_msg_pos = log->_previous_pos;
-		strcpy( log->_msg, log->_previous_msg );
-		free( log->_previous_msg );
-		log->_previous_msg = NULL;
-		log->_previous_pos = 0;
-	}
+end:
+	laaf_unlock_log( log );
+	return;
 }
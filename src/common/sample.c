@@ -0,0 +1,1159 @@
+/*
+ * Copyright (C) 2017-2024 Adrien Gesta-Fline
+ *
+ * This file is part of libAAF.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <math.h>
+
+#if defined(__AVX2__) || defined(__SSSE3__)
+	#include <immintrin.h>
+#elif defined(__SSE2__)
+	#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+	#include <arm_neon.h>
+#endif
+
+#include <libaaf/sample.h>
+
+
+/*
+ * Samples are converted by blocks through a float buffer on the stack. Block
+ * size is a multiple of the vector lane count, so every block starts on dither
+ * lane 0, whichever path is used.
+ */
+#define CONVERT_BLOCK 256
+
+/*
+ * Resampler filter : input samples per output sample, multiplied by the
+ * decimation factor when downsampling so the transition band keeps its width
+ * relative to the output rate. Ratios beyond RESAMPLER_MAX_RATIO are rejected,
+ * so positions can't overflow.
+ */
+#define RESAMPLER_TAPS        64
+#define RESAMPLER_MAX_TAPS    256
+#define RESAMPLER_MAX_PHASES  1024
+#define RESAMPLER_MAX_RATIO   (1 << 24)
+#define RESAMPLER_KAISER_BETA 8.0
+
+#define RESAMPLER_PI 3.14159265358979323846
+
+
+
+static void swap_bytes16( unsigned char *buf, size_t count );
+static void swap_bytes24( unsigned char *buf, size_t count );
+static void swap_bytes32( unsigned char *buf, size_t count );
+static uint32_t dither_next( uint32_t *state );
+static float dither_noise( uint32_t *state );
+static void convert( unsigned char *dst, enum laafSampleFormat dstFormat, const unsigned char *src, enum laafSampleFormat srcFormat, size_t count, struct laafSampleDither *dither, int scalar );
+static void to_float( float *dst, const unsigned char *src, size_t count, enum laafSampleFormat format, int scalar );
+static void from_float( unsigned char *dst, const float *src, size_t count, enum laafSampleFormat format, struct laafSampleDither *dither, int scalar );
+static size_t deinterleave_vector( unsigned char **dst, const unsigned char *src, size_t frames, unsigned int channels, unsigned int samplesize );
+static void deinterleave_scalar( unsigned char **dst, const unsigned char *src, size_t start, size_t frames, unsigned int channels, unsigned int samplesize );
+static uint64_t resampler_gcd( uint64_t a, uint64_t b );
+static double resampler_kernel( const struct laafResampler *rs, double cutoff, uint32_t phase, uint32_t tap );
+static void resample( const struct laafResampler *rs, float *dst, size_t dstStride, const float *src, uint64_t pos, size_t count, int scalar );
+static float resample_dot( const float *src, const float *coefs, uint32_t taps, int scalar );
+
+
+
+void laaf_sample_swap_bytes( unsigned char *buf, size_t len, unsigned int samplesize )
+{
+	if ( samplesize < 2 || samplesize > 4 ) {
+		return;
+	}
+
+	size_t count = len / samplesize;
+
+	if      ( samplesize == 2 ) swap_bytes16( buf, count );
+	else if ( samplesize == 3 ) swap_bytes24( buf, count );
+	else                        swap_bytes32( buf, count );
+}
+
+
+
+void laaf_sample_swap_bytes_scalar( unsigned char *buf, size_t len, unsigned int samplesize )
+{
+	unsigned char tmp = 0;
+
+	if ( samplesize < 2 || samplesize > 4 ) {
+		return;
+	}
+
+	for ( size_t i = 0; i + samplesize <= len; i += samplesize ) {
+
+		tmp = buf[i];
+		buf[i] = buf[i+samplesize-1];
+		buf[i+samplesize-1] = tmp;
+
+		if ( samplesize == 4 ) {
+			tmp = buf[i+1];
+			buf[i+1] = buf[i+2];
+			buf[i+2] = tmp;
+		}
+	}
+}
+
+
+
+/*
+ * Each kernel processes as many samples as possible with the widest vector
+ * path available, then hands the remaining samples to the scalar path.
+ */
+
+static void swap_bytes16( unsigned char *buf, size_t count )
+{
+	size_t i = 0;
+	size_t len = count * 2;
+
+#if defined(__AVX2__)
+	const __m256i mask = _mm256_setr_epi8(
+		1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14,
+		1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14 );
+
+	for ( ; i + 32 <= len; i += 32 ) {
+		__m256i v = _mm256_loadu_si256( (void*)(buf+i) );
+		_mm256_storeu_si256( (void*)(buf+i), _mm256_shuffle_epi8( v, mask ) );
+	}
+#elif defined(__SSE2__)
+	for ( ; i + 16 <= len; i += 16 ) {
+		__m128i v = _mm_loadu_si128( (void*)(buf+i) );
+		v = _mm_or_si128( _mm_slli_epi16( v, 8 ), _mm_srli_epi16( v, 8 ) );
+		_mm_storeu_si128( (void*)(buf+i), v );
+	}
+#elif defined(__ARM_NEON)
+	for ( ; i + 16 <= len; i += 16 ) {
+		vst1q_u8( buf+i, vrev16q_u8( vld1q_u8( buf+i ) ) );
+	}
+#endif
+
+	laaf_sample_swap_bytes_scalar( buf+i, len-i, 2 );
+}
+
+
+
+static void swap_bytes24( unsigned char *buf, size_t count )
+{
+	size_t i = 0;
+	size_t len = count * 3;
+
+#if defined(__SSSE3__)
+	/*
+	 * 16 samples per round, over three 16 bytes vectors. Samples 5 and 10 cross
+	 * vector boundaries : their bytes are picked from the neighbour vectors with
+	 * a second shuffle (-1 mask entries zero the destination byte).
+	 */
+	const __m128i m0a = _mm_setr_epi8(  2,  1,  0,  5,  4,  3,  8,  7,  6, 11, 10,  9, 14, 13, 12, -1 );
+	const __m128i m0b = _mm_setr_epi8( -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,  1 );
+	const __m128i m1x = _mm_setr_epi8(  1,  0,  5,  4,  3,  8,  7,  6, 11, 10,  9, 14, 13, 12, -1, -1 );
+	const __m128i m1y = _mm_setr_epi8( -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 15, 14 );
+	const __m128i m2b = _mm_setr_epi8( 14, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 );
+	const __m128i m2c = _mm_setr_epi8( -1,  3,  2,  1,  6,  5,  4,  9,  8,  7, 12, 11, 10, 15, 14, 13 );
+
+	for ( ; i + 48 <= len; i += 48 ) {
+		__m128i a = _mm_loadu_si128( (void*)(buf+i) );
+		__m128i b = _mm_loadu_si128( (void*)(buf+i+16) );
+		__m128i c = _mm_loadu_si128( (void*)(buf+i+32) );
+
+		/* bytes 15 to 30, and 17 to 32 of the block */
+		__m128i x = _mm_alignr_epi8( b, a, 15 );
+		__m128i y = _mm_alignr_epi8( c, b, 1 );
+
+		_mm_storeu_si128( (void*)(buf+i),    _mm_or_si128( _mm_shuffle_epi8( a, m0a ), _mm_shuffle_epi8( b, m0b ) ) );
+		_mm_storeu_si128( (void*)(buf+i+16), _mm_or_si128( _mm_shuffle_epi8( x, m1x ), _mm_shuffle_epi8( y, m1y ) ) );
+		_mm_storeu_si128( (void*)(buf+i+32), _mm_or_si128( _mm_shuffle_epi8( b, m2b ), _mm_shuffle_epi8( c, m2c ) ) );
+	}
+#elif defined(__ARM_NEON)
+	/* 16 samples per round, deinterleaved into low, middle and high bytes */
+	for ( ; i + 48 <= len; i += 48 ) {
+		uint8x16x3_t v = vld3q_u8( buf+i );
+		uint8x16_t tmp = v.val[0];
+		v.val[0] = v.val[2];
+		v.val[2] = tmp;
+		vst3q_u8( buf+i, v );
+	}
+#endif
+
+	laaf_sample_swap_bytes_scalar( buf+i, len-i, 3 );
+}
+
+
+
+static void swap_bytes32( unsigned char *buf, size_t count )
+{
+	size_t i = 0;
+	size_t len = count * 4;
+
+#if defined(__AVX2__)
+	const __m256i mask = _mm256_setr_epi8(
+		3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+		3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12 );
+
+	for ( ; i + 32 <= len; i += 32 ) {
+		__m256i v = _mm256_loadu_si256( (void*)(buf+i) );
+		_mm256_storeu_si256( (void*)(buf+i), _mm256_shuffle_epi8( v, mask ) );
+	}
+#elif defined(__SSSE3__)
+	const __m128i mask = _mm_setr_epi8( 3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12 );
+
+	for ( ; i + 16 <= len; i += 16 ) {
+		__m128i v = _mm_loadu_si128( (void*)(buf+i) );
+		_mm_storeu_si128( (void*)(buf+i), _mm_shuffle_epi8( v, mask ) );
+	}
+#elif defined(__SSE2__)
+	for ( ; i + 16 <= len; i += 16 ) {
+		__m128i v = _mm_loadu_si128( (void*)(buf+i) );
+		/* swap 16 bits words, then bytes inside words */
+		v = _mm_shufflehi_epi16( _mm_shufflelo_epi16( v, _MM_SHUFFLE(2,3,0,1) ), _MM_SHUFFLE(2,3,0,1) );
+		v = _mm_or_si128( _mm_slli_epi16( v, 8 ), _mm_srli_epi16( v, 8 ) );
+		_mm_storeu_si128( (void*)(buf+i), v );
+	}
+#elif defined(__ARM_NEON)
+	for ( ; i + 16 <= len; i += 16 ) {
+		vst1q_u8( buf+i, vrev32q_u8( vld1q_u8( buf+i ) ) );
+	}
+#endif
+
+	laaf_sample_swap_bytes_scalar( buf+i, len-i, 4 );
+}
+
+
+
+unsigned int laaf_sample_format_size( enum laafSampleFormat format )
+{
+	switch ( format ) {
+		case LAAF_SAMPLE_S16: return 2;
+		case LAAF_SAMPLE_S24: return 3;
+		case LAAF_SAMPLE_S32: return 4;
+		case LAAF_SAMPLE_F32: return 4;
+	}
+
+	return 0;
+}
+
+
+
+void laaf_sample_dither_init( struct laafSampleDither *dither, uint32_t seed )
+{
+	for ( uint32_t i = 0; i < 4; i++ ) {
+
+		/* xorshift32 state must never be zero */
+		uint32_t state = (seed + i) * 0x9e3779b9u;
+
+		state ^= state >> 16;
+
+		dither->state[i] = ( state ) ? state : 0x6d2b79f5u;
+	}
+}
+
+
+
+void laaf_sample_convert( unsigned char *dst, enum laafSampleFormat dstFormat, const unsigned char *src, enum laafSampleFormat srcFormat, size_t count, struct laafSampleDither *dither )
+{
+	convert( dst, dstFormat, src, srcFormat, count, dither, 0 );
+}
+
+
+
+void laaf_sample_convert_scalar( unsigned char *dst, enum laafSampleFormat dstFormat, const unsigned char *src, enum laafSampleFormat srcFormat, size_t count, struct laafSampleDither *dither )
+{
+	convert( dst, dstFormat, src, srcFormat, count, dither, 1 );
+}
+
+
+
+static uint32_t dither_next( uint32_t *state )
+{
+	uint32_t x = *state;
+
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+
+	*state = x;
+
+	return x;
+}
+
+
+
+/*
+ * Triangular noise in the ]-1.0, 1.0[ range, as the sum of two uniform 23 bits
+ * values. The sum is computed on integers so it is exact in float.
+ */
+
+static float dither_noise( uint32_t *state )
+{
+	uint32_t a = dither_next( state ) >> 9;
+	uint32_t b = dither_next( state ) >> 9;
+
+	return (float)(a + b) * (1.0f / 8388608.0f) - 1.0f;
+}
+
+
+
+static void convert( unsigned char *dst, enum laafSampleFormat dstFormat, const unsigned char *src, enum laafSampleFormat srcFormat, size_t count, struct laafSampleDither *dither, int scalar )
+{
+	float tmp[CONVERT_BLOCK];
+
+	unsigned int srcsize = laaf_sample_format_size( srcFormat );
+	unsigned int dstsize = laaf_sample_format_size( dstFormat );
+
+	if ( srcFormat == dstFormat ) {
+		memcpy( dst, src, count * srcsize );
+		return;
+	}
+
+	if ( dstFormat == LAAF_SAMPLE_F32 ||
+	    (srcFormat != LAAF_SAMPLE_F32 && dstsize > srcsize) )
+	{
+		/* no quantization */
+		dither = NULL;
+	}
+
+	for ( size_t i = 0; i < count; i += CONVERT_BLOCK ) {
+
+		size_t n = ( count - i < CONVERT_BLOCK ) ? count - i : CONVERT_BLOCK;
+
+		to_float( tmp, src + i*srcsize, n, srcFormat, scalar );
+		from_float( dst + i*dstsize, tmp, n, dstFormat, dither, scalar );
+	}
+}
+
+
+
+/*
+ * Integer samples are left justified to 32 bits before being converted, so
+ * every integer format is scaled by 2^-31 and 24 bits samples go through the
+ * same path as 32 bits ones.
+ */
+
+static void to_float( float *dst, const unsigned char *src, size_t count, enum laafSampleFormat format, int scalar )
+{
+	size_t i = 0;
+
+	const float scale = 1.0f / 2147483648.0f;
+
+	if ( format == LAAF_SAMPLE_F32 ) {
+		memcpy( dst, src, count * sizeof(float) );
+		return;
+	}
+
+	if ( !scalar ) {
+#if defined(__SSE2__)
+		const __m128 vscale = _mm_set1_ps( scale );
+
+		if ( format == LAAF_SAMPLE_S16 ) {
+			for ( ; i + 8 <= count; i += 8 ) {
+				__m128i v = _mm_loadu_si128( (const void*)(src + i*2) );
+				__m128i lo = _mm_unpacklo_epi16( _mm_setzero_si128(), v );
+				__m128i hi = _mm_unpackhi_epi16( _mm_setzero_si128(), v );
+				_mm_storeu_ps( dst+i,   _mm_mul_ps( _mm_cvtepi32_ps( lo ), vscale ) );
+				_mm_storeu_ps( dst+i+4, _mm_mul_ps( _mm_cvtepi32_ps( hi ), vscale ) );
+			}
+		}
+#if defined(__SSSE3__)
+		else if ( format == LAAF_SAMPLE_S24 ) {
+			/* 4 samples (12 bytes) per 16 bytes load */
+			const __m128i mask = _mm_setr_epi8( -1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11 );
+
+			for ( ; i*3 + 16 <= count*3; i += 4 ) {
+				__m128i v = _mm_shuffle_epi8( _mm_loadu_si128( (const void*)(src + i*3) ), mask );
+				_mm_storeu_ps( dst+i, _mm_mul_ps( _mm_cvtepi32_ps( v ), vscale ) );
+			}
+		}
+#endif
+		else if ( format == LAAF_SAMPLE_S32 ) {
+			for ( ; i + 4 <= count; i += 4 ) {
+				__m128i v = _mm_loadu_si128( (const void*)(src + i*4) );
+				_mm_storeu_ps( dst+i, _mm_mul_ps( _mm_cvtepi32_ps( v ), vscale ) );
+			}
+		}
+#elif defined(__ARM_NEON)
+		if ( format == LAAF_SAMPLE_S16 ) {
+			for ( ; i + 8 <= count; i += 8 ) {
+				int16x8_t v = vreinterpretq_s16_u8( vld1q_u8( src + i*2 ) );
+				int32x4_t lo = vshlq_n_s32( vmovl_s16( vget_low_s16( v ) ), 16 );
+				int32x4_t hi = vshlq_n_s32( vmovl_s16( vget_high_s16( v ) ), 16 );
+				vst1q_f32( dst+i,   vmulq_n_f32( vcvtq_f32_s32( lo ), scale ) );
+				vst1q_f32( dst+i+4, vmulq_n_f32( vcvtq_f32_s32( hi ), scale ) );
+			}
+		}
+		else if ( format == LAAF_SAMPLE_S32 ) {
+			for ( ; i + 4 <= count; i += 4 ) {
+				int32x4_t v = vreinterpretq_s32_u8( vld1q_u8( src + i*4 ) );
+				vst1q_f32( dst+i, vmulq_n_f32( vcvtq_f32_s32( v ), scale ) );
+			}
+		}
+#endif
+	}
+
+	for ( ; i < count; i++ ) {
+
+		uint32_t v = 0;
+
+		if ( format == LAAF_SAMPLE_S16 ) {
+			v = (uint32_t)src[i*2] << 16 | (uint32_t)src[i*2+1] << 24;
+		}
+		else if ( format == LAAF_SAMPLE_S24 ) {
+			v = (uint32_t)src[i*3] << 8 | (uint32_t)src[i*3+1] << 16 | (uint32_t)src[i*3+2] << 24;
+		}
+		else {
+			v = (uint32_t)src[i*4] | (uint32_t)src[i*4+1] << 8 | (uint32_t)src[i*4+2] << 16 | (uint32_t)src[i*4+3] << 24;
+		}
+
+		dst[i] = (float)(int32_t)v * scale;
+	}
+}
+
+
+
+/*
+ * Samples are scaled, dithered, clipped then rounded half away from zero. The
+ * vector paths take the same steps in the same order, so both paths give the
+ * same result. Largest 32 bits value is the largest float below 2^31.
+ */
+
+static void from_float( unsigned char *dst, const float *src, size_t count, enum laafSampleFormat format, struct laafSampleDither *dither, int scalar )
+{
+	size_t i = 0;
+
+	unsigned int size = laaf_sample_format_size( format );
+
+	float scale = 0;
+	float max = 0;
+
+	if ( format == LAAF_SAMPLE_F32 ) {
+		memcpy( dst, src, count * sizeof(float) );
+		return;
+	}
+
+	if ( format == LAAF_SAMPLE_S16 ) {
+		scale = 32768.0f;
+		max = 32767.0f;
+	}
+	else if ( format == LAAF_SAMPLE_S24 ) {
+		scale = 8388608.0f;
+		max = 8388607.0f;
+	}
+	else {
+		scale = 2147483648.0f;
+		max = 2147483520.0f;
+	}
+
+	const float min = -scale;
+
+	if ( !scalar ) {
+#if defined(__SSE2__)
+		const __m128 vscale = _mm_set1_ps( scale );
+		const __m128 vmax   = _mm_set1_ps( max );
+		const __m128 vmin   = _mm_set1_ps( min );
+		const __m128 half   = _mm_set1_ps( 0.5f );
+		const __m128 sign   = _mm_set1_ps( -0.0f );
+		const __m128 noiseScale = _mm_set1_ps( 1.0f / 8388608.0f );
+		const __m128 one    = _mm_set1_ps( 1.0f );
+
+		__m128i state = ( dither ) ? _mm_loadu_si128( (void*)dither->state ) : _mm_setzero_si128();
+
+		size_t lanes = ( format == LAAF_SAMPLE_S16 ) ? 8 : 4;
+
+		/* 24 bits vector store requires SSSE3 */
+		int vector = ( format != LAAF_SAMPLE_S24 );
+#if defined(__SSSE3__)
+		vector = 1;
+#endif
+
+		/* a 24 bits store writes 16 bytes, the 4 last ones being rewritten next */
+		for ( ; vector && i + lanes <= count && ( format != LAAF_SAMPLE_S24 || i*3 + 16 <= count*3 ); i += lanes ) {
+
+			__m128i s[2];
+
+			for ( size_t l = 0; l < lanes/4; l++ ) {
+
+				__m128 v = _mm_mul_ps( _mm_loadu_ps( src + i + l*4 ), vscale );
+
+				if ( dither ) {
+					__m128i r[2];
+
+					for ( int n = 0; n < 2; n++ ) {
+						state = _mm_xor_si128( state, _mm_slli_epi32( state, 13 ) );
+						state = _mm_xor_si128( state, _mm_srli_epi32( state, 17 ) );
+						state = _mm_xor_si128( state, _mm_slli_epi32( state, 5 ) );
+						r[n] = _mm_srli_epi32( state, 9 );
+					}
+
+					__m128 noise = _mm_sub_ps( _mm_mul_ps( _mm_cvtepi32_ps( _mm_add_epi32( r[0], r[1] ) ), noiseScale ), one );
+
+					v = _mm_add_ps( v, noise );
+				}
+
+				v = _mm_max_ps( _mm_min_ps( v, vmax ), vmin );
+				v = _mm_add_ps( v, _mm_or_ps( half, _mm_and_ps( v, sign ) ) );
+
+				s[l] = _mm_cvttps_epi32( v );
+			}
+
+			if ( format == LAAF_SAMPLE_S16 ) {
+				_mm_storeu_si128( (void*)(dst + i*2), _mm_packs_epi32( s[0], s[1] ) );
+			}
+			else if ( format == LAAF_SAMPLE_S32 ) {
+				_mm_storeu_si128( (void*)(dst + i*4), s[0] );
+			}
+#if defined(__SSSE3__)
+			else {
+				const __m128i mask = _mm_setr_epi8( 0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1 );
+				_mm_storeu_si128( (void*)(dst + i*3), _mm_shuffle_epi8( s[0], mask ) );
+			}
+#endif
+		}
+
+		if ( dither ) {
+			_mm_storeu_si128( (void*)dither->state, state );
+		}
+#elif defined(__ARM_NEON)
+		const float32x4_t vmax  = vdupq_n_f32( max );
+		const float32x4_t vmin  = vdupq_n_f32( min );
+		const uint32x4_t  half  = vreinterpretq_u32_f32( vdupq_n_f32( 0.5f ) );
+		const uint32x4_t  sign  = vdupq_n_u32( 0x80000000 );
+
+		uint32x4_t state = ( dither ) ? vld1q_u32( dither->state ) : vdupq_n_u32( 0 );
+
+		if ( format != LAAF_SAMPLE_S24 ) {
+
+			for ( ; i + 4 <= count; i += 4 ) {
+
+				float32x4_t v = vmulq_n_f32( vld1q_f32( src + i ), scale );
+
+				if ( dither ) {
+					uint32x4_t r[2];
+
+					for ( int n = 0; n < 2; n++ ) {
+						state = veorq_u32( state, vshlq_n_u32( state, 13 ) );
+						state = veorq_u32( state, vshrq_n_u32( state, 17 ) );
+						state = veorq_u32( state, vshlq_n_u32( state, 5 ) );
+						r[n] = vshrq_n_u32( state, 9 );
+					}
+
+					float32x4_t noise = vsubq_f32( vmulq_n_f32( vcvtq_f32_u32( vaddq_u32( r[0], r[1] ) ), 1.0f / 8388608.0f ), vdupq_n_f32( 1.0f ) );
+
+					v = vaddq_f32( v, noise );
+				}
+
+				/* compare and select, so NaN are clipped as the scalar path does */
+				v = vbslq_f32( vcltq_f32( v, vmax ), v, vmax );
+				v = vbslq_f32( vcgtq_f32( v, vmin ), v, vmin );
+				v = vaddq_f32( v, vreinterpretq_f32_u32( vorrq_u32( half, vandq_u32( vreinterpretq_u32_f32( v ), sign ) ) ) );
+
+				int32x4_t s = vcvtq_s32_f32( v );
+
+				if ( format == LAAF_SAMPLE_S16 ) {
+					vst1_u8( dst + i*2, vreinterpret_u8_s16( vmovn_s32( s ) ) );
+				}
+				else {
+					vst1q_u8( dst + i*4, vreinterpretq_u8_s32( s ) );
+				}
+			}
+		}
+
+		if ( dither ) {
+			vst1q_u32( dither->state, state );
+		}
+#endif
+	}
+
+	for ( ; i < count; i++ ) {
+
+		float v = src[i] * scale;
+
+		if ( dither ) {
+			v += dither_noise( &dither->state[i & 3] );
+		}
+
+		v = ( v < max ) ? v : max;
+		v = ( v > min ) ? v : min;
+		v += ( v < 0.0f ) ? -0.5f : 0.5f;
+
+		uint32_t sample = (uint32_t)(int32_t)v;
+
+		for ( unsigned int b = 0; b < size; b++ ) {
+			dst[i*size+b] = (unsigned char)(sample >> (b*8));
+		}
+	}
+}
+
+
+
+void laaf_sample_deinterleave( unsigned char **dst, const unsigned char *src, size_t frames, unsigned int channels, unsigned int samplesize )
+{
+	if ( samplesize < 1 || samplesize > 4 || channels == 0 ) {
+		return;
+	}
+
+	size_t i = deinterleave_vector( dst, src, frames, channels, samplesize );
+
+	deinterleave_scalar( dst, src, i, frames, channels, samplesize );
+}
+
+
+
+void laaf_sample_deinterleave_scalar( unsigned char **dst, const unsigned char *src, size_t frames, unsigned int channels, unsigned int samplesize )
+{
+	if ( samplesize < 1 || samplesize > 4 || channels == 0 ) {
+		return;
+	}
+
+	deinterleave_scalar( dst, src, 0, frames, channels, samplesize );
+}
+
+
+
+/*
+ * Vector paths cover stereo, and the layouts where a whole frame fits a
+ * vector (4 channels of 32 bits, 8 channels of 16 bits) with a transpose.
+ * Returns the number of frames processed, remaining ones being left to the
+ * scalar path.
+ */
+
+static size_t deinterleave_vector( unsigned char **dst, const unsigned char *src, size_t frames, unsigned int channels, unsigned int samplesize )
+{
+	size_t i = 0;
+
+#if defined(__SSE2__)
+	if ( channels == 2 && samplesize == 2 ) {
+		for ( ; i + 8 <= frames; i += 8 ) {
+			__m128i a = _mm_loadu_si128( (const void*)(src + i*4) );
+			__m128i b = _mm_loadu_si128( (const void*)(src + i*4 + 16) );
+			__m128i l = _mm_packs_epi32( _mm_srai_epi32( _mm_slli_epi32( a, 16 ), 16 ), _mm_srai_epi32( _mm_slli_epi32( b, 16 ), 16 ) );
+			__m128i r = _mm_packs_epi32( _mm_srai_epi32( a, 16 ), _mm_srai_epi32( b, 16 ) );
+			if ( dst[0] ) _mm_storeu_si128( (void*)(dst[0] + i*2), l );
+			if ( dst[1] ) _mm_storeu_si128( (void*)(dst[1] + i*2), r );
+		}
+	}
+#if defined(__SSSE3__)
+	else if ( channels == 2 && samplesize == 3 ) {
+		/*
+		 * 4 frames (24 bytes) from two overlapping loads. A store writes 16 bytes,
+		 * the 4 last ones being rewritten next.
+		 */
+		const __m128i l0 = _mm_setr_epi8(  0,  1,  2,  6,  7,  8, 12, 13, 14, -1, -1, -1, -1, -1, -1, -1 );
+		const __m128i l1 = _mm_setr_epi8( -1, -1, -1, -1, -1, -1, -1, -1, -1, 10, 11, 12, -1, -1, -1, -1 );
+		const __m128i r0 = _mm_setr_epi8(  3,  4,  5,  9, 10, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 );
+		const __m128i r1 = _mm_setr_epi8( -1, -1, -1, -1, -1, -1,  7,  8,  9, 13, 14, 15, -1, -1, -1, -1 );
+
+		for ( ; i + 4 <= frames && i*3 + 16 <= frames*3; i += 4 ) {
+			__m128i a = _mm_loadu_si128( (const void*)(src + i*6) );
+			__m128i b = _mm_loadu_si128( (const void*)(src + i*6 + 8) );
+			if ( dst[0] ) _mm_storeu_si128( (void*)(dst[0] + i*3), _mm_or_si128( _mm_shuffle_epi8( a, l0 ), _mm_shuffle_epi8( b, l1 ) ) );
+			if ( dst[1] ) _mm_storeu_si128( (void*)(dst[1] + i*3), _mm_or_si128( _mm_shuffle_epi8( a, r0 ), _mm_shuffle_epi8( b, r1 ) ) );
+		}
+	}
+#endif
+	else if ( channels == 2 && samplesize == 4 ) {
+		for ( ; i + 4 <= frames; i += 4 ) {
+			__m128 a = _mm_castsi128_ps( _mm_loadu_si128( (const void*)(src + i*8) ) );
+			__m128 b = _mm_castsi128_ps( _mm_loadu_si128( (const void*)(src + i*8 + 16) ) );
+			if ( dst[0] ) _mm_storeu_si128( (void*)(dst[0] + i*4), _mm_castps_si128( _mm_shuffle_ps( a, b, _MM_SHUFFLE(2,0,2,0) ) ) );
+			if ( dst[1] ) _mm_storeu_si128( (void*)(dst[1] + i*4), _mm_castps_si128( _mm_shuffle_ps( a, b, _MM_SHUFFLE(3,1,3,1) ) ) );
+		}
+	}
+	else if ( channels == 4 && samplesize == 4 ) {
+		for ( ; i + 4 <= frames; i += 4 ) {
+			__m128 v0 = _mm_castsi128_ps( _mm_loadu_si128( (const void*)(src + i*16) ) );
+			__m128 v1 = _mm_castsi128_ps( _mm_loadu_si128( (const void*)(src + i*16 + 16) ) );
+			__m128 v2 = _mm_castsi128_ps( _mm_loadu_si128( (const void*)(src + i*16 + 32) ) );
+			__m128 v3 = _mm_castsi128_ps( _mm_loadu_si128( (const void*)(src + i*16 + 48) ) );
+
+			_MM_TRANSPOSE4_PS( v0, v1, v2, v3 );
+
+			if ( dst[0] ) _mm_storeu_si128( (void*)(dst[0] + i*4), _mm_castps_si128( v0 ) );
+			if ( dst[1] ) _mm_storeu_si128( (void*)(dst[1] + i*4), _mm_castps_si128( v1 ) );
+			if ( dst[2] ) _mm_storeu_si128( (void*)(dst[2] + i*4), _mm_castps_si128( v2 ) );
+			if ( dst[3] ) _mm_storeu_si128( (void*)(dst[3] + i*4), _mm_castps_si128( v3 ) );
+		}
+	}
+	else if ( channels == 8 && samplesize == 2 ) {
+		/* 8x8 transpose of 16 bits samples, through 16, 32 then 64 bits unpacks */
+		for ( ; i + 8 <= frames; i += 8 ) {
+			__m128i r[8], a[8], b[8], c[8];
+
+			for ( int f = 0; f < 8; f++ ) {
+				r[f] = _mm_loadu_si128( (const void*)(src + (i+(size_t)f)*16) );
+			}
+
+			for ( int f = 0; f < 4; f++ ) {
+				a[f*2]   = _mm_unpacklo_epi16( r[f*2], r[f*2+1] );
+				a[f*2+1] = _mm_unpackhi_epi16( r[f*2], r[f*2+1] );
+			}
+
+			for ( int f = 0; f < 2; f++ ) {
+				b[f*4]   = _mm_unpacklo_epi32( a[f*4],   a[f*4+2] );
+				b[f*4+1] = _mm_unpackhi_epi32( a[f*4],   a[f*4+2] );
+				b[f*4+2] = _mm_unpacklo_epi32( a[f*4+1], a[f*4+3] );
+				b[f*4+3] = _mm_unpackhi_epi32( a[f*4+1], a[f*4+3] );
+			}
+
+			for ( int f = 0; f < 4; f++ ) {
+				c[f*2]   = _mm_unpacklo_epi64( b[f], b[f+4] );
+				c[f*2+1] = _mm_unpackhi_epi64( b[f], b[f+4] );
+			}
+
+			for ( unsigned int ch = 0; ch < 8; ch++ ) {
+				if ( dst[ch] ) _mm_storeu_si128( (void*)(dst[ch] + i*2), c[ch] );
+			}
+		}
+	}
+#elif defined(__ARM_NEON)
+	if ( samplesize == 2 && channels == 2 ) {
+		for ( ; i + 8 <= frames; i += 8 ) {
+			uint16x8x2_t v = vld2q_u16( (const void*)(src + i*4) );
+			if ( dst[0] ) vst1q_u16( (void*)(dst[0] + i*2), v.val[0] );
+			if ( dst[1] ) vst1q_u16( (void*)(dst[1] + i*2), v.val[1] );
+		}
+	}
+	else if ( samplesize == 2 && channels == 4 ) {
+		for ( ; i + 8 <= frames; i += 8 ) {
+			uint16x8x4_t v = vld4q_u16( (const void*)(src + i*8) );
+			for ( unsigned int ch = 0; ch < 4; ch++ ) {
+				if ( dst[ch] ) vst1q_u16( (void*)(dst[ch] + i*2), v.val[ch] );
+			}
+		}
+	}
+	else if ( samplesize == 4 && channels == 2 ) {
+		for ( ; i + 4 <= frames; i += 4 ) {
+			uint32x4x2_t v = vld2q_u32( (const void*)(src + i*8) );
+			if ( dst[0] ) vst1q_u32( (void*)(dst[0] + i*4), v.val[0] );
+			if ( dst[1] ) vst1q_u32( (void*)(dst[1] + i*4), v.val[1] );
+		}
+	}
+	else if ( samplesize == 4 && channels == 4 ) {
+		for ( ; i + 4 <= frames; i += 4 ) {
+			uint32x4x4_t v = vld4q_u32( (const void*)(src + i*16) );
+			for ( unsigned int ch = 0; ch < 4; ch++ ) {
+				if ( dst[ch] ) vst1q_u32( (void*)(dst[ch] + i*4), v.val[ch] );
+			}
+		}
+	}
+#else
+	(void)dst;
+	(void)src;
+	(void)frames;
+	(void)channels;
+	(void)samplesize;
+#endif
+
+	return i;
+}
+
+
+
+#define DEINTERLEAVE_CHANNEL( size )                                  \
+	for ( size_t i = start; i < frames; i++ ) {                         \
+		memcpy( dst[c] + i*(size), src + i*frameSize + c*(size), (size) ); \
+	}
+
+static void deinterleave_scalar( unsigned char **dst, const unsigned char *src, size_t start, size_t frames, unsigned int channels, unsigned int samplesize )
+{
+	size_t frameSize = (size_t)channels * samplesize;
+
+	for ( unsigned int c = 0; c < channels; c++ ) {
+
+		if ( !dst[c] ) {
+			continue;
+		}
+
+		/* constant sizes, so every copy is a plain load and store */
+		switch ( samplesize ) {
+			case 1:  DEINTERLEAVE_CHANNEL( 1 ); break;
+			case 2:  DEINTERLEAVE_CHANNEL( 2 ); break;
+			case 3:  DEINTERLEAVE_CHANNEL( 3 ); break;
+			default: DEINTERLEAVE_CHANNEL( 4 ); break;
+		}
+	}
+}
+
+
+
+void laaf_sample_mix( float *dst, const float *src, const float *gain, size_t count )
+{
+	size_t i = 0;
+
+#if defined(__SSE2__)
+	for ( ; i + 4 <= count; i += 4 ) {
+		__m128 v = _mm_mul_ps( _mm_loadu_ps( src + i ), _mm_loadu_ps( gain + i ) );
+		_mm_storeu_ps( dst + i, _mm_add_ps( _mm_loadu_ps( dst + i ), v ) );
+	}
+#elif defined(__ARM_NEON)
+	for ( ; i + 4 <= count; i += 4 ) {
+		float32x4_t v = vmulq_f32( vld1q_f32( src + i ), vld1q_f32( gain + i ) );
+		vst1q_f32( dst + i, vaddq_f32( vld1q_f32( dst + i ), v ) );
+	}
+#endif
+
+	for ( ; i < count; i++ ) {
+		dst[i] += src[i] * gain[i];
+	}
+}
+
+
+
+void laaf_sample_mix_gain( float *dst, const float *src, float gain, size_t count )
+{
+	size_t i = 0;
+
+#if defined(__SSE2__)
+	__m128 g = _mm_set1_ps( gain );
+
+	for ( ; i + 4 <= count; i += 4 ) {
+		__m128 v = _mm_mul_ps( _mm_loadu_ps( src + i ), g );
+		_mm_storeu_ps( dst + i, _mm_add_ps( _mm_loadu_ps( dst + i ), v ) );
+	}
+#elif defined(__ARM_NEON)
+	float32x4_t g = vdupq_n_f32( gain );
+
+	for ( ; i + 4 <= count; i += 4 ) {
+		float32x4_t v = vmulq_f32( vld1q_f32( src + i ), g );
+		vst1q_f32( dst + i, vaddq_f32( vld1q_f32( dst + i ), v ) );
+	}
+#endif
+
+	for ( ; i < count; i++ ) {
+		dst[i] += src[i] * gain;
+	}
+}
+
+
+
+void laaf_sample_minmax( const float *src, size_t count, float *min, float *max )
+{
+	size_t i = 0;
+
+	float lo = ( count ) ? src[0] : 0.0f;
+	float hi = lo;
+
+#if defined(__SSE2__)
+	if ( count >= 8 ) {
+
+		__m128 lo0 = _mm_loadu_ps( src );
+		__m128 lo1 = _mm_loadu_ps( src + 4 );
+		__m128 hi0 = lo0;
+		__m128 hi1 = lo1;
+
+		for ( i = 8; i + 8 <= count; i += 8 ) {
+			__m128 v0 = _mm_loadu_ps( src + i );
+			__m128 v1 = _mm_loadu_ps( src + i + 4 );
+			lo0 = _mm_min_ps( lo0, v0 );
+			lo1 = _mm_min_ps( lo1, v1 );
+			hi0 = _mm_max_ps( hi0, v0 );
+			hi1 = _mm_max_ps( hi1, v1 );
+		}
+
+		float l[4], h[4];
+
+		_mm_storeu_ps( l, _mm_min_ps( lo0, lo1 ) );
+		_mm_storeu_ps( h, _mm_max_ps( hi0, hi1 ) );
+
+		for ( int j = 0; j < 4; j++ ) {
+			lo = ( l[j] < lo ) ? l[j] : lo;
+			hi = ( h[j] > hi ) ? h[j] : hi;
+		}
+	}
+#elif defined(__ARM_NEON)
+	if ( count >= 8 ) {
+
+		float32x4_t lo0 = vld1q_f32( src );
+		float32x4_t lo1 = vld1q_f32( src + 4 );
+		float32x4_t hi0 = lo0;
+		float32x4_t hi1 = lo1;
+
+		for ( i = 8; i + 8 <= count; i += 8 ) {
+			float32x4_t v0 = vld1q_f32( src + i );
+			float32x4_t v1 = vld1q_f32( src + i + 4 );
+			lo0 = vminq_f32( lo0, v0 );
+			lo1 = vminq_f32( lo1, v1 );
+			hi0 = vmaxq_f32( hi0, v0 );
+			hi1 = vmaxq_f32( hi1, v1 );
+		}
+
+		float l[4], h[4];
+
+		vst1q_f32( l, vminq_f32( lo0, lo1 ) );
+		vst1q_f32( h, vmaxq_f32( hi0, hi1 ) );
+
+		for ( int j = 0; j < 4; j++ ) {
+			lo = ( l[j] < lo ) ? l[j] : lo;
+			hi = ( h[j] > hi ) ? h[j] : hi;
+		}
+	}
+#endif
+
+	for ( ; i < count; i++ ) {
+		lo = ( src[i] < lo ) ? src[i] : lo;
+		hi = ( src[i] > hi ) ? src[i] : hi;
+	}
+
+	*min = lo;
+	*max = hi;
+}
+
+
+
+int laaf_resampler_init( struct laafResampler *rs, uint64_t srcRateNum, uint64_t srcRateDen, uint64_t dstRateNum, uint64_t dstRateDen )
+{
+	memset( rs, 0x00, sizeof(struct laafResampler) );
+
+	if ( srcRateNum == 0 || srcRateDen == 0 || dstRateNum == 0 || dstRateDen == 0 ||
+	     srcRateNum > UINT32_MAX || srcRateDen > UINT32_MAX || dstRateNum > UINT32_MAX || dstRateDen > UINT32_MAX )
+	{
+		return -1;
+	}
+
+	uint64_t up   = dstRateNum * srcRateDen;
+	uint64_t down = dstRateDen * srcRateNum;
+	uint64_t gcd  = resampler_gcd( up, down );
+
+	up   /= gcd;
+	down /= gcd;
+
+	if ( up > RESAMPLER_MAX_RATIO || down > RESAMPLER_MAX_RATIO ) {
+		return -1;
+	}
+
+	uint64_t factor = ( down + up - 1 ) / up;
+
+	rs->upsample   = up;
+	rs->downsample = down;
+	rs->phases     = ( up < RESAMPLER_MAX_PHASES ) ? (uint32_t)up : RESAMPLER_MAX_PHASES;
+	rs->taps       = ( factor < RESAMPLER_MAX_TAPS / RESAMPLER_TAPS ) ? (uint32_t)factor * RESAMPLER_TAPS : RESAMPLER_MAX_TAPS;
+
+	rs->coefs = malloc( (size_t)rs->phases * rs->taps * sizeof(float) );
+
+	if ( !rs->coefs ) {
+		return -1;
+	}
+
+
+	/*
+	 * Cut below the lowest Nyquist frequency, relative to input rate : the
+	 * sinc cutoff is the middle of the transition band, so it is lowered by
+	 * half the transition width of the Kaiser window (Kaiser's formula for
+	 * the window attenuation and length), and the stop band starts at Nyquist.
+	 * Past RESAMPLER_MAX_TAPS the band is not narrowed by more than half.
+	 */
+
+	double nyquist     = ( up < down ) ? 0.5 * (double)up / (double)down : 0.5;
+	double attenuation = RESAMPLER_KAISER_BETA / 0.1102 + 8.7;
+	double transition  = ( attenuation - 7.95 ) / ( 14.36 * rs->taps );
+	double scale       = 1.0 - transition / ( 2.0 * nyquist );
+
+	double cutoff = nyquist * (( scale > 0.5 ) ? scale : 0.5);
+
+	for ( uint32_t p = 0; p < rs->phases; p++ ) {
+
+		double sum = 0;
+
+		for ( uint32_t j = 0; j < rs->taps; j++ ) {
+			sum += resampler_kernel( rs, cutoff, p, j );
+		}
+
+		/* every phase has a unity gain at DC */
+
+		for ( uint32_t j = 0; j < rs->taps; j++ ) {
+			rs->coefs[(size_t)p * rs->taps + j] = (float)( resampler_kernel( rs, cutoff, p, j ) / sum );
+		}
+	}
+
+	return 0;
+}
+
+
+
+void laaf_resampler_free( struct laafResampler *rs )
+{
+	free( rs->coefs );
+
+	memset( rs, 0x00, sizeof(struct laafResampler) );
+}
+
+
+
+void laaf_resampler_span( const struct laafResampler *rs, uint64_t pos, size_t count, int64_t *first, size_t *frames )
+{
+	int64_t half = rs->taps / 2;
+
+	*first  = (int64_t)( pos / rs->upsample ) - half + 1;
+	*frames = 0;
+
+	if ( count == 0 ) {
+		return;
+	}
+
+	/* last position might be rounded up to the next input sample */
+
+	int64_t last = (int64_t)( ( pos + (count-1) * rs->downsample ) / rs->upsample ) + 1 + half;
+
+	*frames = (size_t)( last - *first + 1 );
+}
+
+
+
+void laaf_resampler_process( const struct laafResampler *rs, float *dst, size_t dstStride, const float *src, uint64_t pos, size_t count )
+{
+	resample( rs, dst, dstStride, src, pos, count, 0 );
+}
+
+
+
+void laaf_resampler_process_scalar( const struct laafResampler *rs, float *dst, size_t dstStride, const float *src, uint64_t pos, size_t count )
+{
+	resample( rs, dst, dstStride, src, pos, count, 1 );
+}
+
+
+
+static uint64_t resampler_gcd( uint64_t a, uint64_t b )
+{
+	while ( b ) {
+		uint64_t r = a % b;
+		a = b;
+		b = r;
+	}
+
+	return a;
+}
+
+
+
+/*
+ * Kaiser windowed sinc, for input sample tap of a phase. Input samples of a
+ * phase go from taps/2 - 1 samples before the output position, to taps/2 after.
+ */
+
+static double resampler_kernel( const struct laafResampler *rs, double cutoff, uint32_t phase, uint32_t tap )
+{
+	double half = rs->taps / 2;
+	double t = (double)tap - half + 1.0 - (double)phase / rs->phases;
+	double x = 2.0 * cutoff * t;
+	double r = t / half;
+
+	if ( r <= -1.0 || r >= 1.0 ) {
+		return 0;
+	}
+
+	double sinc = ( x == 0 ) ? 1.0 : sin( RESAMPLER_PI * x ) / ( RESAMPLER_PI * x );
+
+	/* modified Bessel function of the first kind, order 0 */
+
+	double arg[2] = { RESAMPLER_KAISER_BETA * sqrt( 1.0 - r * r ), RESAMPLER_KAISER_BETA };
+	double i0[2];
+
+	for ( int k = 0; k < 2; k++ ) {
+
+		double term = 1.0;
+
+		i0[k] = 1.0;
+
+		for ( int n = 1; n < 50 && term > 1e-12 * i0[k]; n++ ) {
+			term *= ( arg[k] / ( 2.0 * n ) ) * ( arg[k] / ( 2.0 * n ) );
+			i0[k] += term;
+		}
+	}
+
+	return sinc * i0[0] / i0[1];
+}
+
+
+
+static void resample( const struct laafResampler *rs, float *dst, size_t dstStride, const float *src, uint64_t pos, size_t count, int scalar )
+{
+	uint64_t first = pos / rs->upsample;
+
+	for ( size_t k = 0; k < count; k++ ) {
+
+		uint64_t p = pos + k * rs->downsample;
+		uint64_t i = p / rs->upsample;
+		uint64_t phase = p % rs->upsample;
+
+		if ( rs->phases != rs->upsample ) {
+
+			phase = ( phase * rs->phases + rs->upsample / 2 ) / rs->upsample;
+
+			if ( phase == rs->phases ) {
+				phase = 0;
+				i++;
+			}
+		}
+
+		dst[k * dstStride] = resample_dot( src + ( i - first ), rs->coefs + phase * rs->taps, rs->taps, scalar );
+	}
+}
+
+
+
+static float resample_dot( const float *src, const float *coefs, uint32_t taps, int scalar )
+{
+	uint32_t j = 0;
+
+	float sum = 0.0f;
+
+#if defined(__SSE2__)
+	if ( !scalar ) {
+
+		__m128 acc0 = _mm_setzero_ps();
+		__m128 acc1 = _mm_setzero_ps();
+
+		for ( ; j + 8 <= taps; j += 8 ) {
+			acc0 = _mm_add_ps( acc0, _mm_mul_ps( _mm_loadu_ps( src + j ),     _mm_loadu_ps( coefs + j ) ) );
+			acc1 = _mm_add_ps( acc1, _mm_mul_ps( _mm_loadu_ps( src + j + 4 ), _mm_loadu_ps( coefs + j + 4 ) ) );
+		}
+
+		float s[4];
+
+		_mm_storeu_ps( s, _mm_add_ps( acc0, acc1 ) );
+
+		sum = ( s[0] + s[1] ) + ( s[2] + s[3] );
+	}
+#elif defined(__ARM_NEON)
+	if ( !scalar ) {
+
+		float32x4_t acc0 = vdupq_n_f32( 0.0f );
+		float32x4_t acc1 = vdupq_n_f32( 0.0f );
+
+		for ( ; j + 8 <= taps; j += 8 ) {
+			acc0 = vmlaq_f32( acc0, vld1q_f32( src + j ),     vld1q_f32( coefs + j ) );
+			acc1 = vmlaq_f32( acc1, vld1q_f32( src + j + 4 ), vld1q_f32( coefs + j + 4 ) );
+		}
+
+		float s[4];
+
+		vst1q_f32( s, vaddq_f32( acc0, acc1 ) );
+
+		sum = ( s[0] + s[1] ) + ( s[2] + s[3] );
+	}
+#else
+	(void)scalar;
+#endif
+
+	for ( ; j < taps; j++ ) {
+		sum += src[j] * coefs[j];
+	}
+
+	return sum;
+}
@@ -45,6 +45,13 @@
 	#endif
 #endif
 
+#ifndef _WIN32
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <unistd.h>
+#endif
+
 #include <libaaf/utils.h>
 
 
@@ -569,6 +576,90 @@ FILE * laaf_util_fopen_utf8( const char *filepath, const char *mode )
 
 
 
+void * laaf_util_map_file( const char *filepath, uint64_t *size )
+{
+	void *data = NULL;
+
+	if ( !filepath || !size ) {
+		return NULL;
+	}
+
+#ifdef _WIN32
+	wchar_t *wfile = laaf_util_windows_utf8toutf16( filepath );
+
+	if ( !wfile ) {
+		return NULL;
+	}
+
+	HANDLE file = CreateFileW( wfile, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL );
+
+	free( wfile );
+
+	if ( file == INVALID_HANDLE_VALUE ) {
+		return NULL;
+	}
+
+	LARGE_INTEGER filesize;
+
+	if ( GetFileSizeEx( file, &filesize ) && filesize.QuadPart > 0 && (uint64_t)filesize.QuadPart <= SIZE_MAX ) {
+
+		HANDLE mapping = CreateFileMappingW( file, NULL, PAGE_READONLY, 0, 0, NULL );
+
+		if ( mapping ) {
+			/* view stays valid once handles are closed */
+			data = MapViewOfFile( mapping, FILE_MAP_READ, 0, 0, 0 );
+			CloseHandle( mapping );
+		}
+
+		*size = (uint64_t)filesize.QuadPart;
+	}
+
+	CloseHandle( file );
+#else
+	struct stat st;
+
+	int fd = open( filepath, O_RDONLY );
+
+	if ( fd < 0 ) {
+		return NULL;
+	}
+
+	if ( fstat( fd, &st ) == 0 && st.st_size > 0 && (uint64_t)st.st_size <= SIZE_MAX ) {
+
+		data = mmap( NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+
+		if ( data == MAP_FAILED ) {
+			data = NULL;
+		}
+
+		*size = (uint64_t)st.st_size;
+	}
+
+	/* mapping stays valid once file is closed */
+	close( fd );
+#endif
+
+	return data;
+}
+
+
+
+void laaf_util_unmap_file( void *data, uint64_t size )
+{
+	if ( !data ) {
+		return;
+	}
+
+#ifdef _WIN32
+	(void)size;
+	UnmapViewOfFile( data );
+#else
+	munmap( data, (size_t)size );
+#endif
+}
+
+
+
 static int utf8CodeLen( const uint16_t *u16Code )
 {
 	if ( u16Code[0] < 0x80 ) {
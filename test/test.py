@@ -7,6 +7,9 @@ import subprocess
 import difflib
 import argparse
 import hashlib
+import shutil
+import struct
+import math
 
 errorCounts = 0
 
@@ -325,6 +328,173 @@ def extract( aafFileName, aaftoolAddCmd, fileArray ):
 
 
 
+def extract_verify( label, aafFile, aaftoolAddCmd, verify ):
+
+	"""
+	Extracts aafFile into its own directory, then calls verify( outputDir ),
+	which returns a list of error strings.
+	"""
+
+	if args.update:
+		return
+
+	global errorCounts
+	global VALGRIND_CMD
+
+	if BIN_VALGRIND != "":
+		print( " [....] [....] ", end="" )
+	else:
+		print( " [....] ", end="" )
+
+	print( ANSI_COLOR_CYAN + label + ANSI_COLOR_END, end="" )
+	sys.stdout.flush()
+
+	outputDir = TEST_OUTPUT_PATH + DIR_SEP + label
+	valgrindOutputFile = TEST_OUTPUT_PATH + DIR_SEP + label + ".valgrind"
+
+	if os.path.exists(valgrindOutputFile):
+		os.remove(valgrindOutputFile)
+
+	shutil.rmtree( outputDir, ignore_errors=True )
+	os.makedirs( outputDir )
+
+	valgrindError = False
+	errors = []
+
+	valgrindCmd = VALGRIND_CMD
+
+	if valgrindCmd != "":
+		valgrindCmd += " --quiet --log-file=\""+valgrindOutputFile+"\" "
+
+	testCmd = valgrindCmd + AAFTOOL_CMD + " " + aaftoolAddCmd + " --extract-path \"" + outputDir + "\" \"" + aafFile + "\""
+
+	proc = subprocess.run( testCmd, capture_output=True, shell=True, text=True )
+
+	if proc.returncode != 0:
+		if valgrindCmd != "":
+			valgrindError = True
+
+	try:
+		errors = verify( outputDir )
+	except Exception as e:
+		errors = [ "verification failed : " + repr(e) ]
+
+
+	print( "\r ", end="" )
+
+	if len(errors):
+		print( "[" + ANSI_COLOR_RED + "data" + ANSI_COLOR_END + "] ", end="" )
+	else:
+		print( "[" + ANSI_COLOR_GREEN + "data" + ANSI_COLOR_END + "] ", end="" )
+
+
+	if BIN_VALGRIND != "":
+		if valgrindError:
+			print( "[" + ANSI_COLOR_RED + "leak" + ANSI_COLOR_END + "] ", end="" )
+		else:
+			print( "[" + ANSI_COLOR_GREEN + "leak" + ANSI_COLOR_END + "] ", end="" )
+
+
+	print( ANSI_COLOR_CYAN + label + ANSI_COLOR_END )
+
+
+	if valgrindError or len(errors):
+		print( "   :: Test command : " + testCmd )
+		errorCounts+=1
+
+	for error in errors:
+		print( "   :: " + ANSI_COLOR_RED + error + ANSI_COLOR_END )
+
+	if valgrindError:
+		print( "   :: valgrind log : " + valgrindOutputFile )
+
+
+
+def read_wav( filepath ):
+
+	"""
+	Returns format tag, channels, sample rate, bits per sample and audio data
+	of a RIFF/WAVE file.
+	"""
+
+	with open(filepath, "rb") as f:
+		data = f.read()
+
+	if data[0:4] != b"RIFF" or data[8:12] != b"WAVE":
+		raise ValueError( filepath + " is not a RIFF/WAVE file" )
+
+	wav = {}
+	pos = 12
+
+	while pos + 8 <= len(data):
+		ckid = data[pos:pos+4]
+		cksz = struct.unpack( "<I", data[pos+4:pos+8] )[0]
+
+		if ckid == b"fmt ":
+			wav["formatTag"], wav["channels"], wav["samplerate"], _, _, wav["bits"] = struct.unpack( "<HHIIHH", data[pos+8:pos+24] )
+		elif ckid == b"data":
+			wav["data"] = data[pos+8:pos+8+cksz]
+
+		pos += 8 + cksz + (cksz & 1)
+
+	return wav
+
+
+
+def read_wav_samples( wav ):
+
+	"""
+	Returns interleaved samples of integer PCM or 32 bits float audio data.
+	"""
+
+	data = wav["data"]
+
+	if wav["formatTag"] == 3:
+		return list( struct.unpack( "<%if" % (len(data)//4), data ) )
+
+	size = wav["bits"] // 8
+
+	return [ int.from_bytes( data[i:i+size], "little", signed=True ) for i in range( 0, len(data) - size + 1, size ) ]
+
+
+
+def aaf_patch_wav_essence( srcFileName, dstFile, formatTag, bits, samples, channels=None, samplerate=None ):
+
+	"""
+	Writes a copy of an AAF with a single embedded WAVE essence, with format tag,
+	sample size and, if set, channel count and sample rate changed in both the
+	essence descriptor summary and the essence data stream. Audio data of the essence stream, stored
+	in contiguous sectors, is replaced with interleaved samples if set, packed as
+	formatTag and bits.
+	"""
+
+	with open(TEST_AAF_DIR + DIR_SEP + srcFileName, "rb") as f:
+		data = bytearray( f.read() )
+
+	pos = data.find( b"WAVE" )
+
+	while pos >= 0:
+		fmt = data.find( b"fmt ", pos )
+		chans = channels if channels is not None else struct.unpack( "<H", data[fmt+10:fmt+12] )[0]
+		rate = samplerate if samplerate is not None else struct.unpack( "<I", data[fmt+12:fmt+16] )[0]
+
+		blockAlign = chans * bits // 8
+		struct.pack_into( "<HHIIHH", data, fmt+8, formatTag, chans, rate, rate * blockAlign, blockAlign, bits )
+
+		# essence data stream starts on a sector boundary, summary does not
+		if samples is not None and (pos - 8) % 512 == 0:
+			chunk = data.find( b"data", fmt )
+			length = struct.unpack( "<I", data[chunk+4:chunk+8] )[0]
+			packed = struct.pack( "<%if" % len(samples), *samples ) if formatTag == 3 else b"".join( int(v).to_bytes( bits//8, "little", signed=True ) for v in samples )
+			data[chunk+8:chunk+8+min(length,len(packed))] = packed[:length]
+
+		pos = data.find( b"WAVE", pos+4 )
+
+	with open(dstFile, "wb") as f:
+		f.write( data )
+
+
+
 def update( aafFileName, aaftoolAddCmd ):
 
 	print( " [....] " + ANSI_COLOR_ORANGE + aafFileName + ANSI_COLOR_END, end="" )
@@ -441,7 +611,7 @@ extract("PR_WAV_Internal.aaf",  "--extract-essences", [
 ])
 
 extract("PR_AIFF_Internal.aaf", "--extract-clips --extract-format wav", [
-	[ "44b9acf682cb12fa9c692f4e3c591079", "1_1_1000hz-18dbs16b44.1k.wav" ]
+	[ "3089dbaa3d9e03b820695504d5334d7c", "1_1_1000hz-18dbs16b44.1k.wav" ]
 ])
 extract("PR_AIFF_Internal.aaf", "--extract-essences", [
 	[ "694634f1af77e1c23e76b0b41d2b223f", "1000hz-18dbs16b44.1k.wav.aif" ]
@@ -454,6 +624,139 @@ extract("PT_PCM_Internal.aaf",  "--extract-essences --extract-format wav", [
 	[ "2a8f46cf946e44973a4a73f84504a4c5", "1000hz-18dbs16b44.1k-01.wav" ]
 ])
 
+
+# extraction with several threads must write the same files as a single thread
+
+def verify_not_empty( outputDir ):
+	return [] if len(os.listdir( outputDir )) else [ "nothing extracted" ]
+
+def verify_same_as( refDir ):
+	def verify( outputDir ):
+		refFiles = sorted( os.listdir( refDir ) )
+		outFiles = sorted( os.listdir( outputDir ) )
+		if outFiles != refFiles:
+			return [ "extracted %s, expected %s" % (outFiles, refFiles) ]
+		errors = []
+		for name in refFiles:
+			with open(refDir + DIR_SEP + name, "rb") as a, open(outputDir + DIR_SEP + name, "rb") as b:
+				if a.read() != b.read():
+					errors.append( name + " differs from single thread extraction" )
+		return errors
+	return verify
+
+for aafFile in [ "PR_WAV_Internal.aaf", "PR_AIFF_Internal.aaf", "PT_PCM_Internal.aaf" ]:
+	for mode in [ "essences", "clips" ]:
+		label = aafFile[:-4] + "_" + mode + "_j"
+		aafPath = TEST_AAF_DIR + DIR_SEP + aafFile
+		extract_verify( label + "1", aafPath, "--extract-" + mode + " -j 1", verify_not_empty )
+		extract_verify( label + "4", aafPath, "--extract-" + mode + " -j 4", verify_same_as( TEST_OUTPUT_PATH + DIR_SEP + label + "1" ) )
+
+
+# stereo essence, out of PR_WAV_Internal.aaf : each channel of the essence and of
+# its clip is extracted to its own mono file. Sample rate is halved, so that the
+# clip (24024 samples from 800) fits in the 25626 frames of the essence.
+
+STEREO_SAMPLES = []
+for i in range(102504 // 4):
+	STEREO_SAMPLES += [ (i % 2000) - 1000, 3 * ((i % 700) - 350) ]
+STEREO_AAF_FILE = TEST_OUTPUT_PATH + DIR_SEP + "PR_WAV_Internal_stereo.aaf"
+
+aaf_patch_wav_essence( "PR_WAV_Internal.aaf", STEREO_AAF_FILE, 1, 16, STEREO_SAMPLES, 2, 24000 )
+
+def verify_split_channels( prefix, offset, length ):
+	def verify( outputDir ):
+		expected = [ prefix + "1000hz-18dbs16b44.1k.wav_1.wav", prefix + "1000hz-18dbs16b44.1k.wav_2.wav" ]
+		files = sorted( os.listdir( outputDir ) )
+		if files != expected:
+			return [ "extracted %s, expected %s" % (files, expected) ]
+		errors = []
+		for channel, name in enumerate( expected ):
+			wav = read_wav( outputDir + DIR_SEP + name )
+			if (wav["formatTag"], wav["channels"], wav["samplerate"], wav["bits"]) != (1, 1, 24000, 16):
+				errors.append( "%s : format tag %i, %i channels, %i Hz, %i bits" % (name, wav["formatTag"], wav["channels"], wav["samplerate"], wav["bits"]) )
+			elif len(wav["data"]) != length * 2:
+				errors.append( "%s : %i bytes of audio data, expected %i" % (name, len(wav["data"]), length * 2) )
+			elif read_wav_samples( wav ) != STEREO_SAMPLES[channel::2][offset:offset+length]:
+				errors.append( "%s : samples are not the ones of channel %i" % (name, channel+1) )
+		return errors
+	return verify
+
+extract_verify( "PR_WAV_Internal_split_essence", STEREO_AAF_FILE, "--extract-essences --extract-split-channels", verify_split_channels( "", 0, 102504 // 4 ) )
+extract_verify( "PR_WAV_Internal_split_clip", STEREO_AAF_FILE, "--extract-clips --extract-split-channels", verify_split_channels( "1_1_", 800, 24024 ) )
+
+
+# 44.1 kHz essence, out of PR_WAV_Internal.aaf, resampled to 48 kHz : length is
+# scaled by 48000/44100 and the level of a 1 kHz sine is kept
+
+SINE_SAMPLES = [ round( 16384 * math.sin( 2 * math.pi * 1000 * i / 44100 ) ) for i in range(102504 // 2) ]
+SINE_AAF_FILE = TEST_OUTPUT_PATH + DIR_SEP + "PR_WAV_Internal_44100.aaf"
+
+aaf_patch_wav_essence( "PR_WAV_Internal.aaf", SINE_AAF_FILE, 1, 16, SINE_SAMPLES, 1, 44100 )
+
+def rms( samples ):
+	return math.sqrt( sum( v * v for v in samples ) / len(samples) )
+
+def verify_resampled( outputDir ):
+	wav = read_wav( outputDir + DIR_SEP + "1000hz-18dbs16b44.1k.wav" )
+	if wav["samplerate"] != 48000 or wav["channels"] != 1 or wav["bits"] != 16:
+		return [ "resampled to %i Hz, %i channels, %i bits" % (wav["samplerate"], wav["channels"], wav["bits"]) ]
+	samples = read_wav_samples( wav )
+	expected = len(SINE_SAMPLES) * 48000 / 44100
+	if abs( len(samples) - expected ) > 1:
+		return [ "%i samples resampled, expected %.1f" % (len(samples), expected) ]
+	# filter settling at both ends is left out of the level measure
+	gain = 20 * math.log10( rms( samples[1000:-1000] ) / rms( SINE_SAMPLES[1000:-1000] ) )
+	if abs( gain ) > 0.1:
+		return [ "resampled level is off by %.2f dB" % gain ]
+	return []
+
+extract_verify( "PR_WAV_Internal_samplerate", SINE_AAF_FILE, "--extract-essences --extract-samplerate 48000", verify_resampled )
+
+
+# 32 bits float essence, out of PR_WAV_Internal.aaf (16 bits, 102504 bytes of audio data)
+
+FLOAT_SAMPLES = [ 0.5 * math.sin( 2 * math.pi * 1000 * i / 48000 ) for i in range(102504 // 4) ]
+FLOAT_AAF_FILE = TEST_OUTPUT_PATH + DIR_SEP + "PR_WAV_Internal_float.aaf"
+
+aaf_patch_wav_essence( "PR_WAV_Internal.aaf", FLOAT_AAF_FILE, 3, 32, FLOAT_SAMPLES )
+
+def verify_float_essence( outputDir ):
+	wav = read_wav( outputDir + DIR_SEP + "1000hz-18dbs16b44.1k.wav" )
+	if wav["formatTag"] != 3 or wav["bits"] != 32:
+		return [ "float essence extracted with format tag %i, %i bits" % (wav["formatTag"], wav["bits"]) ]
+	if wav["data"] != struct.pack( "<%if" % len(FLOAT_SAMPLES), *FLOAT_SAMPLES ):
+		return [ "float essence samples were altered" ]
+	return []
+
+def verify_float_to_s16( outputDir ):
+	wav = read_wav( outputDir + DIR_SEP + "1000hz-18dbs16b44.1k.wav" )
+	if wav["formatTag"] != 1 or wav["bits"] != 16:
+		return [ "float essence converted with format tag %i, %i bits" % (wav["formatTag"], wav["bits"]) ]
+	samples = read_wav_samples( wav )
+	if len(samples) != len(FLOAT_SAMPLES):
+		return [ "%i samples converted, expected %i" % (len(samples), len(FLOAT_SAMPLES)) ]
+	worst = max( abs( s - f * 32768 ) for s, f in zip( samples, FLOAT_SAMPLES ) )
+	if worst > 1.5:
+		return [ "float samples converted to s16 are off by %.1f" % worst ]
+	return []
+
+extract_verify( "PR_WAV_Internal_float", FLOAT_AAF_FILE, "--extract-essences", verify_float_essence )
+extract_verify( "PR_WAV_Internal_float_s16", FLOAT_AAF_FILE, "--extract-essences --extract-sample-format s16", verify_float_to_s16 )
+
+# unknown format tag (ADPCM) : samples are extracted as they are stored, not converted
+
+ADPCM_AAF_FILE = TEST_OUTPUT_PATH + DIR_SEP + "PR_WAV_Internal_adpcm.aaf"
+
+aaf_patch_wav_essence( "PR_WAV_Internal.aaf", ADPCM_AAF_FILE, 2, 16, None )
+
+def verify_unknown_format( outputDir ):
+	wav = read_wav( outputDir + DIR_SEP + "1000hz-18dbs16b44.1k.wav" )
+	if wav["bits"] != 16 or len(wav["data"]) != 102504:
+		return [ "unknown format essence was converted to %i bits (%i bytes)" % (wav["bits"], len(wav["data"])) ]
+	return []
+
+extract_verify( "PR_WAV_Internal_adpcm_s24", ADPCM_AAF_FILE, "--extract-essences --extract-sample-format s24", verify_unknown_format )
+
 print("")
 
 sys.exit(errorCounts)
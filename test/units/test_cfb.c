@@ -0,0 +1,318 @@
+/*
+ * Copyright (C) 2017-2024 Adrien Gesta-Fline
+ *
+ * This file is part of libAAF.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Reads every stream of a few test/aaf files with cfb_readStream(), by chunks
+ * of various sizes and after seeks, and checks the result is identical to the
+ * one of cfb_getStream().
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include <libaaf.h>
+
+#include "common.h"
+
+
+static const char *test_files[] = {
+	"PR_AIFF_Internal.aaf",
+	"PR_WAV_Internal.aaf",
+	"PT_PCM_Internal.aaf",
+	"MC_Audio_Levels.aaf",
+	NULL
+};
+
+static const uint64_t chunk_sizes[] = { 1, 63, 512, 4093, 65536 };
+
+
+static int test_stream( CFB_Data *cfbd, cfbNode *node, unsigned char *buf );
+static int test_file( int line, const char *filename );
+static int test_samples( int line, const char *filename );
+
+
+
+static int test_stream( CFB_Data *cfbd, cfbNode *node, unsigned char *buf ) {
+
+	unsigned char *ref = NULL;
+	uint64_t refsz = 0;
+
+	cfbStreamReader reader;
+	cfbStreamIndex *index = NULL;
+
+	int rc = 1;
+
+	cfb_getStream( cfbd, node, &ref, &refsz );
+
+	if ( !ref ) {
+		return 0;
+	}
+
+	if ( cfb_openStream( cfbd, node, &reader ) < 0 || reader.stream_len != refsz ) {
+		goto end;
+	}
+
+	/* sequential reads */
+	uint64_t pos = 0;
+
+	for ( int i = 0; pos < refsz; i++ ) {
+
+		uint64_t len = chunk_sizes[ i % (int)(sizeof(chunk_sizes)/sizeof(chunk_sizes[0])) ];
+		uint64_t expected = ( refsz - pos < len ) ? refsz - pos : len;
+
+		if ( cfb_readStream( &reader, buf, len ) != expected || memcmp( buf, ref + pos, expected ) != 0 ) {
+			goto end;
+		}
+
+		pos += expected;
+	}
+
+	if ( cfb_readStream( &reader, buf, 1 ) != 0 ) {
+		goto end;
+	}
+
+	/* backward and forward seeks */
+	uint64_t offsets[] = { refsz/2, 3, refsz - refsz/3, refsz, 0 };
+
+	for ( size_t i = 0; i < sizeof(offsets)/sizeof(offsets[0]); i++ ) {
+
+		uint64_t len = ( refsz - offsets[i] < 4096 ) ? refsz - offsets[i] : 4096;
+
+		if ( offsets[i] > refsz ) {
+			continue;
+		}
+
+		if ( cfb_seekStream( &reader, offsets[i] ) < 0 ||
+		     cfb_readStream( &reader, buf, 4096 ) != len ||
+		     memcmp( buf, ref + offsets[i], len ) != 0 )
+		{
+			goto end;
+		}
+	}
+
+	if ( cfb_seekStream( &reader, refsz + 1 ) == 0 ) {
+		goto end;
+	}
+
+	/* same seeks, and scattered ones, through the extent index */
+	index = cfb_indexStream( cfbd, node );
+
+	if ( !index ) {
+		goto end;
+	}
+
+	reader.index = index;
+
+	for ( uint64_t i = 0; i < 64 + sizeof(offsets)/sizeof(offsets[0]); i++ ) {
+
+		uint64_t offset = ( i < sizeof(offsets)/sizeof(offsets[0]) ) ? offsets[i] : (i * 7919 * 4093) % (refsz + 1);
+		uint64_t len = ( refsz - offset < 4096 ) ? refsz - offset : 4096;
+
+		if ( cfb_seekStream( &reader, offset ) < 0 ||
+		     cfb_readStream( &reader, buf, 4096 ) != len ||
+		     memcmp( buf, ref + offset, len ) != 0 )
+		{
+			goto end;
+		}
+	}
+
+	rc = 0;
+
+end:
+	cfb_freeStreamIndex( index );
+	free( ref );
+
+	return rc;
+}
+
+
+
+static int test_file( int line, const char *filename ) {
+
+	char *path = laaf_util_build_path( "/", LIBAAF_TEST_AAF_PATH, filename, NULL );
+
+	struct aafLog *log = laaf_new_log();
+	CFB_Data *cfbd = cfb_alloc( log );
+
+	unsigned char *buf = malloc( 65536 );
+
+	int errors = 0;
+	int streams = 0;
+
+	if ( !path || !cfbd || !buf || cfb_load_file( &cfbd, path ) < 0 ) {
+		TEST_LOG( TEST_ERROR_STR "could not load %s\n", line, filename );
+		errors++;
+		goto end;
+	}
+
+	for ( uint32_t i = 0; i < cfbd->nodes_cnt; i++ ) {
+
+		cfbNode *node = &cfbd->nodes[i];
+
+		if ( node->_mse != STGTY_STREAM ) {
+			continue;
+		}
+
+		streams++;
+
+		if ( test_stream( cfbd, node, buf ) ) {
+			TEST_LOG( TEST_ERROR_STR "%s: cfb_readStream() does not match cfb_getStream() on stream %u\n", line, filename, i );
+			errors++;
+			break;
+		}
+	}
+
+	if ( !errors ) {
+		TEST_LOG( TEST_PASSED_STR "%s: %i streams read by chunks\n", line, filename, streams );
+	}
+
+end:
+	free( buf );
+	free( path );
+	cfb_release( &cfbd );
+	laaf_free_log( log );
+
+	return errors;
+}
+
+
+
+/*
+ * Reads samples of every embedded essence at scattered offsets, and compares
+ * them with the essence stream read as a whole.
+ */
+
+static int test_samples( int line, const char *filename ) {
+
+	char *path = laaf_util_build_path( "/", LIBAAF_TEST_AAF_PATH, filename, NULL );
+
+	AAF_Iface *aafi = aafi_alloc( NULL );
+
+	unsigned char *buf = malloc( 65536 );
+	unsigned char *ref = NULL;
+	uint64_t refsz = 0;
+
+	int errors = 0;
+	int essences = 0;
+
+	if ( aafi ) {
+		aafi_set_debug( aafi, VERB_QUIET, 0, NULL, NULL, NULL );
+	}
+
+	if ( !path || !aafi || !buf || aafi_load_file( aafi, path ) ) {
+		TEST_LOG( TEST_ERROR_STR "could not load %s\n", line, filename );
+		errors++;
+		goto end;
+	}
+
+	aafiAudioEssenceFile *audioEssenceFile = NULL;
+
+	AAFI_foreachAudioEssenceFile( aafi, audioEssenceFile ) {
+
+		if ( !audioEssenceFile->is_embedded || audioEssenceFile->samplesize != 16 || audioEssenceFile->channels != 1 ) {
+			continue;
+		}
+
+		free( ref );
+		ref = NULL;
+
+		cfb_getStream( aafi->aafd->cfbd, audioEssenceFile->node, &ref, &refsz );
+
+		uint64_t dataOffset = ( audioEssenceFile->type != AAFI_ESSENCE_TYPE_PCM ) ? audioEssenceFile->pcm_audio_start_offset : 0;
+		uint64_t frames = ( ref && refsz > dataOffset ) ? (refsz - dataOffset) / 2 : 0;
+
+		if ( frames < 2 ) {
+			continue;
+		}
+
+		essences++;
+
+		for ( uint64_t i = 0; i < 32 && !errors; i++ ) {
+
+			uint64_t offset = (i * 7919 * 4093) % frames;
+			uint64_t count = ( frames - offset < 1000 ) ? frames - offset : 1000;
+
+			if ( aafi_readAudioSamples( aafi, audioEssenceFile, offset, 1000, ( i % 2 ) ? 1 : 0, buf ) != count ) {
+				TEST_LOG( TEST_ERROR_STR "%s: aafi_readAudioSamples() did not read %"PRIu64" samples at %"PRIu64"\n", line, filename, count, offset );
+				errors++;
+				break;
+			}
+
+			for ( uint64_t j = 0; j < count; j++ ) {
+
+				const unsigned char *sample = ref + dataOffset + (offset + j) * 2;
+
+				int16_t expected = ( audioEssenceFile->type == AAFI_ESSENCE_TYPE_AIFC ) ?
+					(int16_t)(sample[0] << 8 | sample[1]) :
+					(int16_t)(sample[1] << 8 | sample[0]);
+
+				if ( (int16_t)(buf[j*2+1] << 8 | buf[j*2]) != expected ) {
+					TEST_LOG( TEST_ERROR_STR "%s: sample %"PRIu64" does not match essence stream\n", line, filename, offset + j );
+					errors++;
+					break;
+				}
+			}
+		}
+	}
+
+	if ( !errors ) {
+		TEST_LOG( TEST_PASSED_STR "%s: samples of %i essences read at random offsets\n", line, filename, essences );
+	}
+
+end:
+	free( ref );
+	free( buf );
+	free( path );
+	aafi_release( &aafi );
+
+	return errors;
+}
+
+
+
+int main( int argc, char *argv[] ) {
+
+	(void)argc;
+	(void)argv;
+
+#ifdef _WIN32
+	INIT_WINDOWS_CONSOLE()
+#endif
+
+	SET_LOCALE()
+
+
+	int errors = 0;
+
+	TEST_LOG("\n");
+
+	for ( int i = 0; test_files[i] != NULL; i++ ) {
+		errors += test_file( __LINE__, test_files[i] );
+	}
+
+	for ( int i = 0; test_files[i] != NULL; i++ ) {
+		errors += test_samples( __LINE__, test_files[i] );
+	}
+
+	TEST_LOG("\n");
+
+	return errors;
+}
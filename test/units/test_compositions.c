@@ -0,0 +1,523 @@
+/*
+ * Copyright (C) 2017-2024 Adrien Gesta-Fline
+ *
+ * This file is part of libAAF.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Multiple top-level compositions. Compositions sharing essences are built by
+ * hand and merged, then a file of the test/aaf corpus is turned into a three
+ * compositions file, by tagging its sub-clip and adjusted-clip CompositionMobs
+ * as top-level, and loaded with one and several threads.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include <libaaf.h>
+#include <libaaf/AAFDefs/AAFExtEnum.h>
+
+#include "common.h"
+
+
+#define TEST_SOURCE_FILE  "MC_Audio_Levels.aaf"
+#define TEST_MULTI_FILE   "test_compositions.aaf"
+
+
+struct loadResult {
+	uint32_t  compositions;
+	uint32_t  essences;
+	uint32_t  pointers;
+	uint32_t  clips;
+	uint64_t  namehash;
+};
+
+static aafiAudioClip * new_clip( AAF_Iface *aafi, aafiAudioTrack *audioTrack, aafiAudioEssenceFile **essences, size_t count );
+static int is_main_essence( AAF_Iface *aafi, aafiAudioEssenceFile *audioEssenceFile );
+static int is_main_pointer( AAF_Iface *aafi, aafiAudioEssencePointer *essencePointer );
+static int check_pointers( int line, AAF_Iface *aafi, uint32_t *pointerCount );
+static int test_merge( int line );
+static int is_usage_code( const unsigned char *p );
+static int write_multi_file( const char *src, const char *dst );
+static int load_multi_file( int line, const char *file, int threads, struct loadResult *res );
+static int test_load( int line, const char *aafPath );
+
+
+
+static aafiAudioClip * new_clip( AAF_Iface *aafi, aafiAudioTrack *audioTrack, aafiAudioEssenceFile **essences, size_t count ) {
+
+	aafiAudioClip *audioClip = aafi_newAudioClip( aafi, audioTrack );
+
+	if ( !audioClip ) {
+		return NULL;
+	}
+
+	audioClip->len = 1000;
+
+	for ( size_t i = 0; i < count; i++ ) {
+
+		uint32_t channel = (uint32_t)i+1;
+
+		if ( !aafi_newAudioEssencePointer( aafi, &audioClip->essencePointerList, essences[i], &channel ) ) {
+			return NULL;
+		}
+	}
+
+	return audioClip;
+}
+
+
+
+static int is_main_essence( AAF_Iface *aafi, aafiAudioEssenceFile *audioEssenceFile ) {
+
+	aafiAudioEssenceFile *ae = NULL;
+
+	AAFI_foreachAudioEssenceFile( aafi, ae ) {
+		if ( ae == audioEssenceFile ) {
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+
+
+static int is_main_pointer( AAF_Iface *aafi, aafiAudioEssencePointer *essencePointer ) {
+
+	aafiAudioEssencePointer *ep = NULL;
+
+	for ( ep = aafi->Audio->essencePointerList; ep != NULL; ep = ep->aafiNext ) {
+		if ( ep == essencePointer ) {
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+
+
+/*
+ * Every essence pointer of every composition clip must point to an essence of
+ * the main AAF_Iface, be owned by it, and essences must be unique.
+ */
+
+static int check_pointers( int line, AAF_Iface *aafi, uint32_t *pointerCount ) {
+
+	aafiAudioEssenceFile *ae1 = NULL;
+	aafiAudioEssenceFile *ae2 = NULL;
+
+	AAFI_foreachAudioEssenceFile( aafi, ae1 ) {
+		AAFI_foreachEssence( ae1->next, ae2 ) {
+			if ( aafMobIDCmp( ae1->sourceMobID, ae2->sourceMobID ) && ae1->sourceMobSlotID == ae2->sourceMobSlotID ) {
+				TEST_LOG( TEST_ERROR_STR "essence \"%s\" was not merged once\n", line, ae1->unique_name );
+				return 1;
+			}
+		}
+	}
+
+	uint32_t count = 0;
+	aafiAudioEssencePointer *essencePointer = NULL;
+	aafiComposition *composition = NULL;
+
+	AAFI_foreachComposition( aafi, composition ) {
+
+		if ( composition->aafi != aafi && ( composition->aafi->Audio->essenceFiles || composition->aafi->Audio->essencePointerList ) ) {
+			TEST_LOG( TEST_ERROR_STR "composition AAF_Iface still holds essences after merge\n", line );
+			return 1;
+		}
+
+		aafiAudioTrack *audioTrack = NULL;
+
+		AAFI_foreachAudioTrack( composition->aafi, audioTrack ) {
+
+			aafiTimelineItem *audioItem = NULL;
+
+			AAFI_foreachTrackItem( audioTrack, audioItem ) {
+
+				if ( audioItem->type != AAFI_AUDIO_CLIP ) {
+					continue;
+				}
+
+				aafiAudioClip *audioClip = audioItem->data;
+
+				AAFI_foreachEssencePointer( audioClip->essencePointerList, essencePointer ) {
+
+					if ( essencePointer->aafi != aafi || !is_main_pointer( aafi, essencePointer ) ) {
+						TEST_LOG( TEST_ERROR_STR "essence pointer is not owned by the main AAF_Iface\n", line );
+						return 1;
+					}
+
+					if ( !is_main_essence( aafi, essencePointer->essenceFile ) ) {
+						TEST_LOG( TEST_ERROR_STR "essence pointer targets an essence out of the main AAF_Iface\n", line );
+						return 1;
+					}
+
+					count++;
+				}
+			}
+		}
+	}
+
+	if ( pointerCount ) {
+		*pointerCount = count;
+	}
+
+	return 0;
+}
+
+
+
+/*
+ * Main composition uses essence A. The second one uses A, and B it creates.
+ * The third one creates its own B, and C, as when both are parsed concurrently.
+ */
+
+static int test_merge( int line ) {
+
+	static aafMobID_t mobIDs[3] = {
+		{ .material = { .Data1 = 1 } },
+		{ .material = { .Data1 = 2 } },
+		{ .material = { .Data1 = 3 } }
+	};
+
+	int errors = 0;
+
+	AAF_Iface *aafi = aafi_alloc( NULL );
+
+	if ( !aafi ) {
+		TEST_LOG( TEST_ERROR_STR "aafi_alloc() failed\n", line );
+		return 1;
+	}
+
+	aafi_set_debug( aafi, VERB_QUIET, 0, NULL, NULL, NULL );
+
+	aafiComposition *composition1 = aafi_newComposition( aafi, NULL );
+	aafiComposition *composition2 = aafi_newComposition( aafi, NULL );
+	aafiComposition *composition3 = aafi_newComposition( aafi, NULL );
+
+	if ( !composition1 || !composition2 || !composition3 ||
+	     composition1->aafi != aafi || composition2->aafi == aafi || composition3->aafi == aafi ||
+	     composition2->aafi->parent != aafi || aafi->compositionCount != 3 )
+	{
+		TEST_LOG( TEST_ERROR_STR "aafi_newComposition() did not set compositions\n", line );
+		errors++;
+		goto end;
+	}
+
+	AAF_Iface *aafi2 = composition2->aafi;
+	AAF_Iface *aafi3 = composition3->aafi;
+
+	aafiAudioEssenceFile *a  = aafi_newAudioEssence( aafi,  &mobIDs[0], 1 );
+	aafiAudioEssenceFile *b2 = aafi_newAudioEssence( aafi2, &mobIDs[1], 1 );
+	aafiAudioEssenceFile *b3 = aafi_newAudioEssence( aafi3, &mobIDs[1], 1 );
+	aafiAudioEssenceFile *c  = aafi_newAudioEssence( aafi3, &mobIDs[2], 1 );
+
+	aafiAudioTrack *track1 = aafi_newAudioTrack( aafi );
+	aafiAudioTrack *track2 = aafi_newAudioTrack( aafi2 );
+	aafiAudioTrack *track3 = aafi_newAudioTrack( aafi3 );
+
+	if ( !a || !b2 || !b3 || !c || !track1 || !track2 || !track3 ) {
+		TEST_LOG( TEST_ERROR_STR "could not build compositions\n", line );
+		errors++;
+		goto end;
+	}
+
+	if ( aafi_getAudioEssence( aafi2, &mobIDs[0], 1 ) != a ||
+	     aafi_getAudioEssence( aafi3, &mobIDs[1], 1 ) != b3 )
+	{
+		TEST_LOG( TEST_ERROR_STR "composition essence lookup does not fall back to the main AAF_Iface\n", line );
+		errors++;
+		goto end;
+	}
+
+	aafiAudioEssenceFile *clip1Essences[1] = { a };
+	aafiAudioEssenceFile *clip2Essences[2] = { a, b2 };
+	aafiAudioEssenceFile *clip3Essences[3] = { a, b3, c };
+
+	aafiAudioClip *clip1 = new_clip( aafi,  track1, clip1Essences, 1 );
+	aafiAudioClip *clip2 = new_clip( aafi2, track2, clip2Essences, 2 );
+	aafiAudioClip *clip3 = new_clip( aafi3, track3, clip3Essences, 3 );
+
+	if ( !clip1 || !clip2 || !clip3 ) {
+		TEST_LOG( TEST_ERROR_STR "could not build clips\n", line );
+		errors++;
+		goto end;
+	}
+
+	if ( aafi_mergeCompositionEssences( aafi, aafi2 ) < 0 ||
+	     aafi_mergeCompositionEssences( aafi, aafi3 ) < 0 )
+	{
+		TEST_LOG( TEST_ERROR_STR "aafi_mergeCompositionEssences() failed\n", line );
+		errors++;
+		goto end;
+	}
+
+	if ( aafi->Audio->essenceCount != 3 ) {
+		TEST_LOG( TEST_ERROR_STR "%i essences after merge, expected 3\n", line, aafi->Audio->essenceCount );
+		errors++;
+		goto end;
+	}
+
+	if ( clip3->essencePointerList->next->essenceFile != b2 ||
+	     clip3->essencePointerList->next->next->essenceFile != c ||
+	     clip2->essencePointerList->next->essenceFile != b2 )
+	{
+		TEST_LOG( TEST_ERROR_STR "duplicate essence was not replaced by the merged one\n", line );
+		errors++;
+		goto end;
+	}
+
+	uint32_t pointers = 0;
+
+	if ( check_pointers( line, aafi, &pointers ) ) {
+		errors++;
+		goto end;
+	}
+
+	if ( pointers != 6 ) {
+		TEST_LOG( TEST_ERROR_STR "%u clip essence pointers after merge, expected 6\n", line, pointers );
+		errors++;
+		goto end;
+	}
+
+	TEST_LOG( TEST_PASSED_STR "shared essences merged once across 3 compositions\n", line );
+
+end:
+	aafi_release( &aafi );
+
+	return errors;
+}
+
+
+
+static int is_usage_code( const unsigned char *p ) {
+
+	return ( memcmp( p, &AAFUsage_SubClip,      sizeof(aafUID_t) ) == 0 ||
+	         memcmp( p, &AAFUsage_AdjustedClip, sizeof(aafUID_t) ) == 0 ||
+	         memcmp( p, &AAFUsage_TopLevel,     sizeof(aafUID_t) ) == 0 ||
+	         memcmp( p, &AAFUsage_LowerLevel,   sizeof(aafUID_t) ) == 0 ||
+	         memcmp( p, &AAFUsage_Template,     sizeof(aafUID_t) ) == 0 );
+}
+
+
+
+/*
+ * Sets UsageCode of every sub-clip and adjusted-clip CompositionMob to TopLevel.
+ * UsageType definitions of the MetaDictionary are left untouched : they are
+ * stored next to each other. Returns the number of patched mobs.
+ */
+
+static int write_multi_file( const char *src, const char *dst ) {
+
+	FILE *fp = fopen( src, "rb" );
+
+	if ( !fp ) {
+		return -1;
+	}
+
+	fseek( fp, 0, SEEK_END );
+	long size = ftell( fp );
+	fseek( fp, 0, SEEK_SET );
+
+	unsigned char *buf = ( size > 0 ) ? malloc( (size_t)size ) : NULL;
+
+	if ( !buf || fread( buf, 1, (size_t)size, fp ) != (size_t)size ) {
+		fclose( fp );
+		free( buf );
+		return -1;
+	}
+
+	fclose( fp );
+
+	int patched = 0;
+	size_t uidSize = sizeof(aafUID_t);
+
+	for ( size_t i = uidSize; i + 2*uidSize <= (size_t)size; i++ ) {
+
+		if ( memcmp( buf+i, &AAFUsage_SubClip, uidSize ) != 0 &&
+		     memcmp( buf+i, &AAFUsage_AdjustedClip, uidSize ) != 0 )
+		{
+			continue;
+		}
+
+		if ( is_usage_code( buf+i-uidSize ) || is_usage_code( buf+i+uidSize ) ) {
+			continue;
+		}
+
+		memcpy( buf+i, &AAFUsage_TopLevel, uidSize );
+		patched++;
+	}
+
+	fp = fopen( dst, "wb" );
+
+	if ( !fp ) {
+		free( buf );
+		return -1;
+	}
+
+	if ( fwrite( buf, 1, (size_t)size, fp ) != (size_t)size ) {
+		patched = -1;
+	}
+
+	fclose( fp );
+	free( buf );
+
+	return patched;
+}
+
+
+
+static int load_multi_file( int line, const char *file, int threads, struct loadResult *res ) {
+
+	int errors = 0;
+
+	memset( res, 0x00, sizeof(struct loadResult) );
+
+	AAF_Iface *aafi = aafi_alloc( NULL );
+
+	if ( !aafi ) {
+		TEST_LOG( TEST_ERROR_STR "aafi_alloc() failed\n", line );
+		return 1;
+	}
+
+	aafi_set_debug( aafi, VERB_QUIET, 0, NULL, NULL, NULL );
+	aafi_set_option_int( aafi, "threads", threads );
+
+	if ( aafi_load_file( aafi, file ) < 0 ) {
+		TEST_LOG( TEST_ERROR_STR "could not load %s with %i threads\n", line, file, threads );
+		errors++;
+		goto end;
+	}
+
+	if ( check_pointers( line, aafi, &res->pointers ) ) {
+		errors++;
+		goto end;
+	}
+
+	res->namehash = 0xcbf29ce484222325ULL;
+
+	aafiAudioEssenceFile *audioEssenceFile = NULL;
+
+	AAFI_foreachAudioEssenceFile( aafi, audioEssenceFile ) {
+
+		res->essences++;
+
+		/* FNV-1a over unique names, in essence list order */
+		for ( const char *p = audioEssenceFile->unique_name; p && *p; p++ ) {
+			res->namehash ^= (unsigned char)*p;
+			res->namehash *= 0x100000001b3ULL;
+		}
+	}
+
+	aafiComposition *composition = NULL;
+
+	AAFI_foreachComposition( aafi, composition ) {
+
+		res->compositions++;
+
+		aafiAudioTrack *audioTrack = NULL;
+
+		AAFI_foreachAudioTrack( composition->aafi, audioTrack ) {
+			res->clips += (uint32_t)audioTrack->clipCount;
+		}
+	}
+
+end:
+	aafi_release( &aafi );
+
+	return errors;
+}
+
+
+
+static int test_load( int line, const char *aafPath ) {
+
+	char *src = laaf_util_build_path( "/", aafPath, TEST_SOURCE_FILE, NULL );
+
+	int patched = ( src ) ? write_multi_file( src, TEST_MULTI_FILE ) : -1;
+
+	free( src );
+
+	if ( patched != 2 ) {
+		TEST_LOG( TEST_ERROR_STR "could not write three compositions file (%i mobs patched)\n", line, patched );
+		remove( TEST_MULTI_FILE );
+		return 1;
+	}
+
+	int errors = 0;
+
+	struct loadResult ref;
+	struct loadResult res;
+
+	errors += load_multi_file( line, TEST_MULTI_FILE, 1, &ref );
+
+	if ( errors == 0 && ref.compositions != 3 ) {
+		TEST_LOG( TEST_ERROR_STR "%u compositions loaded, expected 3\n", line, ref.compositions );
+		errors++;
+	}
+
+	if ( errors == 0 ) {
+		TEST_LOG( TEST_PASSED_STR "3 compositions loaded sequentially : %u essences, %u clips, %u essence pointers\n", line, ref.essences, ref.clips, ref.pointers );
+	}
+
+	for ( int threads = 2; threads <= 4 && errors == 0; threads += 2 ) {
+
+		errors += load_multi_file( line, TEST_MULTI_FILE, threads, &res );
+
+		if ( errors == 0 && memcmp( &ref, &res, sizeof(struct loadResult) ) != 0 ) {
+			TEST_LOG( TEST_ERROR_STR "loading with %i threads differs from sequential loading\n", line, threads );
+			errors++;
+		}
+
+		if ( errors == 0 ) {
+			TEST_LOG( TEST_PASSED_STR "3 compositions loaded with %i threads, same essences and clips\n", line, threads );
+		}
+	}
+
+	remove( TEST_MULTI_FILE );
+
+	return errors;
+}
+
+
+
+int main( int argc, char *argv[] ) {
+
+	const char *path = ( argc > 1 ) ? argv[1] : LIBAAF_TEST_AAF_PATH;
+
+#ifdef _WIN32
+	INIT_WINDOWS_CONSOLE()
+#endif
+
+	SET_LOCALE()
+
+
+	int errors = 0;
+
+	TEST_LOG("\n");
+
+	errors += test_merge( __LINE__ );
+	errors += test_load( __LINE__, path );
+
+	TEST_LOG("\n");
+
+	return errors;
+}
@@ -0,0 +1,407 @@
+/*
+ * Copyright (C) 2017-2024 Adrien Gesta-Fline
+ *
+ * This file is part of libAAF.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Evaluates gain and transition curves of every interpolation, and checks every
+ * sample against a double precision evaluation of the same curve.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include <libaaf.h>
+
+#include "common.h"
+
+
+#define TEST_LENGTH  10007
+#define TOLERANCE    1e-5
+
+#define HALF_PI      1.57079632679489661923
+
+
+static double interpolate( uint32_t interpol, double v0, double v1, double u );
+static double expected_value( aafiAudioGain *gain, double pos );
+static aafiAudioGain * new_gain( AAF_Iface *aafi, uint32_t interpol, const int *times, const int *values, unsigned int count );
+static int check_curve( int line, const char *name, const float *out, aafiAudioGain *gain, double length, aafPosition_t start, uint64_t count );
+static int test_interpolations( int line, AAF_Iface *aafi );
+static int test_long_segment( int line, AAF_Iface *aafi );
+static int test_constant_gain( int line, AAF_Iface *aafi );
+static int test_transition( int line, AAF_Iface *aafi );
+
+
+
+static double interpolate( uint32_t interpol, double v0, double v1, double u ) {
+
+	switch ( interpol ) {
+		case AAFI_INTERPOL_NONE:
+		case AAFI_INTERPOL_CONSTANT:
+			return v0;
+		case AAFI_INTERPOL_POWER:
+			return v0 + (v1 - v0) * (( v1 >= v0 ) ? sin( u * HALF_PI ) : 1.0 - cos( u * HALF_PI ));
+		case AAFI_INTERPOL_LOG:
+			return v0 + (v1 - v0) * (( v1 >= v0 ) ? (pow( 1000.0, u ) - 1.0) / 999.0 : 1.0 - (pow( 1000.0, 1.0 - u ) - 1.0) / 999.0);
+		case AAFI_INTERPOL_BSPLINE:
+			return v0 + (v1 - v0) * u * u * (3.0 - 2.0 * u);
+		default:
+			return v0 + (v1 - v0) * u;
+	}
+}
+
+
+
+static double expected_value( aafiAudioGain *gain, double pos ) {
+
+	unsigned int last = gain->pts_cnt - 1;
+
+	if ( pos < aafRationalToDouble( gain->time[0] ) ) {
+		return aafRationalToDouble( gain->value[0] );
+	}
+
+	if ( pos >= aafRationalToDouble( gain->time[last] ) ) {
+		return aafRationalToDouble( gain->value[last] );
+	}
+
+	unsigned int k = 0;
+
+	while ( aafRationalToDouble( gain->time[k+1] ) <= pos ) {
+		k++;
+	}
+
+	double t0 = aafRationalToDouble( gain->time[k] );
+	double t1 = aafRationalToDouble( gain->time[k+1] );
+
+	return interpolate( gain->flags & AAFI_INTERPOL_MASK, aafRationalToDouble( gain->value[k] ), aafRationalToDouble( gain->value[k+1] ), (pos - t0) / (t1 - t0) );
+}
+
+
+
+static aafiAudioGain * new_gain( AAF_Iface *aafi, uint32_t interpol, const int *times, const int *values, unsigned int count ) {
+
+	aafiAudioGain *gain = aafi_newAudioGain( aafi, AAFI_AUDIO_GAIN_VARIABLE, interpol, NULL );
+
+	if ( !gain ) {
+		return NULL;
+	}
+
+	gain->time  = calloc( count, sizeof(aafRational_t) );
+	gain->value = calloc( count, sizeof(aafRational_t) );
+
+	if ( !gain->time || !gain->value ) {
+		aafi_freeAudioGain( gain );
+		return NULL;
+	}
+
+	gain->pts_cnt = count;
+
+	for ( unsigned int i = 0; i < count; i++ ) {
+		gain->time[i].numerator    = times[i];
+		gain->time[i].denominator  = 1000;
+		gain->value[i].numerator   = values[i];
+		gain->value[i].denominator = 1000;
+	}
+
+	return gain;
+}
+
+
+
+static int check_curve( int line, const char *name, const float *out, aafiAudioGain *gain, double length, aafPosition_t start, uint64_t count ) {
+
+	for ( uint64_t i = 0; i < count; i++ ) {
+
+		double expected = expected_value( gain, (double)(start + (aafPosition_t)i) / length );
+
+		if ( fabs( (double)out[i] - expected ) > TOLERANCE ) {
+			TEST_LOG( TEST_ERROR_STR "%s : sample %"PRIu64" is %f, expected %f\n", line, name, (uint64_t)start + i, (double)out[i], expected );
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+
+
+/*
+ * Every interpolation, on a curve rising, falling, then stepping between two
+ * points sharing time. The curve starts after component start and ends before
+ * its end, so held values are checked too. Evaluation is done at once, then by
+ * unaligned chunks.
+ */
+
+static int test_interpolations( int line, AAF_Iface *aafi ) {
+
+	static const int times[]  = {  100, 400, 700, 700, 900 };
+	static const int values[] = {  250, 1000, 100, 700, 500 };
+
+	static const struct {
+		uint32_t    interpol;
+		const char *name;
+	} curves[] = {
+		{ AAFI_INTERPOL_LINEAR,   "linear" },
+		{ AAFI_INTERPOL_LOG,      "log" },
+		{ AAFI_INTERPOL_POWER,    "power" },
+		{ AAFI_INTERPOL_BSPLINE,  "bspline" },
+		{ AAFI_INTERPOL_CONSTANT, "constant" },
+	};
+
+	float *out = malloc( TEST_LENGTH * sizeof(float) );
+
+	if ( !out ) {
+		TEST_LOG( TEST_ERROR_STR "out of memory\n", line );
+		return 1;
+	}
+
+	int errors = 0;
+
+	for ( size_t c = 0; c < sizeof(curves) / sizeof(curves[0]); c++ ) {
+
+		aafiAudioGain *gain = new_gain( aafi, curves[c].interpol, times, values, 5 );
+
+		if ( !gain ) {
+			TEST_LOG( TEST_ERROR_STR "could not build %s gain\n", line, curves[c].name );
+			errors++;
+			continue;
+		}
+
+		if ( aafi_evalEnvelope( aafi, gain, TEST_LENGTH, NULL, NULL, 0, TEST_LENGTH, out ) < 0 ||
+		     check_curve( line, curves[c].name, out, gain, TEST_LENGTH, 0, TEST_LENGTH ) )
+		{
+			errors++;
+		}
+
+		memset( out, 0x00, TEST_LENGTH * sizeof(float) );
+
+		for ( aafPosition_t start = 0; start < TEST_LENGTH; start += 997 ) {
+
+			uint64_t count = ( TEST_LENGTH - start < 997 ) ? (uint64_t)(TEST_LENGTH - start) : 997;
+
+			if ( aafi_evalEnvelope( aafi, gain, TEST_LENGTH, NULL, NULL, start, count, out + start ) < 0 ) {
+				errors++;
+			}
+		}
+
+		if ( check_curve( line, curves[c].name, out, gain, TEST_LENGTH, 0, TEST_LENGTH ) ) {
+			errors++;
+		}
+
+		aafi_freeAudioGain( gain );
+	}
+
+	free( out );
+
+	if ( errors == 0 ) {
+		TEST_LOG( TEST_PASSED_STR "linear, log, power, bspline and constant curves evaluated\n", line );
+	}
+
+	return errors;
+}
+
+
+
+/*
+ * Automation of a 1 hour component at 48 kHz, given in edit units, evaluated
+ * near its end : positions must not drift over the segment.
+ */
+
+static int test_long_segment( int line, AAF_Iface *aafi ) {
+
+	static const int times[]  = { 0, 1000 };
+	static const int values[] = { 0, 1000 };
+
+	static aafRational_t editRate   = { 25, 1 };
+	static aafRational_t sampleRate = { 48000, 1 };
+
+	aafPosition_t length = 3600 * 25;
+	aafPosition_t start  = 3600 * 48000 - 5000;
+
+	float out[4096];
+
+	aafiAudioGain *gain = new_gain( aafi, AAFI_INTERPOL_LINEAR, times, values, 2 );
+
+	if ( !gain ) {
+		TEST_LOG( TEST_ERROR_STR "could not build gain\n", line );
+		return 1;
+	}
+
+	int errors = 0;
+
+	if ( aafi_evalEnvelope( aafi, gain, length, &editRate, &sampleRate, start, 4096, out ) < 0 ||
+	     check_curve( line, "long segment", out, gain, 3600.0 * 48000.0, start, 4096 ) )
+	{
+		errors++;
+	}
+
+	aafi_freeAudioGain( gain );
+
+	if ( errors == 0 ) {
+		TEST_LOG( TEST_PASSED_STR "one hour automation evaluated without drift\n", line );
+	}
+
+	return errors;
+}
+
+
+
+static int test_constant_gain( int line, AAF_Iface *aafi ) {
+
+	aafRational_t value = { 1, 2 };
+
+	float out[11];
+
+	int errors = 0;
+
+	aafiAudioGain *gain = aafi_newAudioGain( aafi, AAFI_AUDIO_GAIN_CONSTANT, 0, &value );
+	aafiAudioGain *unset = aafi_newAudioGain( aafi, AAFI_AUDIO_GAIN_CONSTANT, 0, NULL );
+
+	if ( !gain || !unset ) {
+		TEST_LOG( TEST_ERROR_STR "aafi_newAudioGain() failed\n", line );
+		errors++;
+		goto end;
+	}
+
+	if ( aafi_evalEnvelope( aafi, gain, 100, NULL, NULL, 20, 11, out ) < 0 ) {
+		errors++;
+	}
+
+	for ( int i = 0; i < 11; i++ ) {
+		if ( out[i] != 0.5f ) {
+			TEST_LOG( TEST_ERROR_STR "constant gain : sample %i is %f, expected 0.5\n", line, i, (double)out[i] );
+			errors++;
+			break;
+		}
+	}
+
+	if ( aafi_evalEnvelope( aafi, unset, 100, NULL, NULL, 20, 11, out ) < 0 ) {
+		errors++;
+	}
+
+	for ( int i = 0; i < 11; i++ ) {
+		if ( out[i] != 1.0f ) {
+			TEST_LOG( TEST_ERROR_STR "gain without value : sample %i is %f, expected 1\n", line, i, (double)out[i] );
+			errors++;
+			break;
+		}
+	}
+
+	if ( errors == 0 ) {
+		TEST_LOG( TEST_PASSED_STR "constant gain and gain without value evaluated\n", line );
+	}
+
+end:
+	aafi_freeAudioGain( gain );
+	aafi_freeAudioGain( unset );
+
+	return errors;
+}
+
+
+
+/*
+ * Power fade in from 0/0 (zero) to 1, over 10 edit units at 25 fps : 19200
+ * samples at 48 kHz.
+ */
+
+static int test_transition( int line, AAF_Iface *aafi ) {
+
+	static aafRational_t editRate   = { 25, 1 };
+	static aafRational_t sampleRate = { 48000, 1 };
+
+	aafRational_t values[2] = { { 0, 0 }, { 1, 1 } };
+
+	aafiTransition trans;
+
+	memset( &trans, 0x00, sizeof(aafiTransition) );
+
+	trans.flags   = AAFI_TRANS_FADE_IN | AAFI_INTERPOL_POWER;
+	trans.len     = 10;
+	trans.value_a = values;
+
+	float *out = malloc( 20000 * sizeof(float) );
+
+	if ( !out ) {
+		TEST_LOG( TEST_ERROR_STR "out of memory\n", line );
+		return 1;
+	}
+
+	int errors = 0;
+
+	if ( aafi_evalTransition( aafi, &trans, &editRate, &sampleRate, 0, 20000, out ) < 0 ) {
+		errors++;
+	}
+
+	for ( int i = 0; i < 20000 && !errors; i++ ) {
+
+		double expected = ( i < 19200 ) ? sin( (double)i / 19200.0 * HALF_PI ) : 1.0;
+
+		if ( fabs( (double)out[i] - expected ) > TOLERANCE ) {
+			TEST_LOG( TEST_ERROR_STR "fade in : sample %i is %f, expected %f\n", line, i, (double)out[i], expected );
+			errors++;
+		}
+	}
+
+	free( out );
+
+	if ( errors == 0 ) {
+		TEST_LOG( TEST_PASSED_STR "power fade in evaluated\n", line );
+	}
+
+	return errors;
+}
+
+
+
+int main( int argc, char *argv[] ) {
+
+	(void)argc;
+	(void)argv;
+
+#ifdef _WIN32
+	INIT_WINDOWS_CONSOLE()
+#endif
+
+	SET_LOCALE()
+
+
+	int errors = 0;
+
+	TEST_LOG("\n");
+
+	AAF_Iface *aafi = aafi_alloc( NULL );
+
+	if ( !aafi ) {
+		TEST_LOG( TEST_ERROR_STR "aafi_alloc() failed\n", __LINE__ );
+		return 1;
+	}
+
+	errors += test_interpolations( __LINE__, aafi );
+	errors += test_long_segment( __LINE__, aafi );
+	errors += test_constant_gain( __LINE__, aafi );
+	errors += test_transition( __LINE__, aafi );
+
+	aafi_release( &aafi );
+
+	TEST_LOG("\n");
+
+	return errors;
+}
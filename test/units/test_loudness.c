@@ -0,0 +1,467 @@
+/*
+ * Copyright (C) 2017-2024 Adrien Gesta-Fline
+ *
+ * This file is part of libAAF.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Measures 24 bits WAVE files of sine waves, whose loudness and levels are known
+ * (EBU Tech 3341) : a stereo 997 Hz tone at -40 dBFS then -20 dBFS, a 5.1 tone
+ * and a mono fs/4 tone sampled off its peaks. Essences are measured at once,
+ * on several threads, then sample ranges and clips are measured from the same
+ * analysis. Clips with gain or fades are rendered and measured.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include <libaaf.h>
+
+#include "common.h"
+#include "test_util.h"
+
+
+#define TEST_STEREO_FILE  "test_loudness_stereo.wav"
+#define TEST_SURR_FILE    "test_loudness_surround.wav"
+#define TEST_TP_FILE      "test_loudness_truepeak.wav"
+
+#define TEST_PI           3.14159265358979323846
+
+#define TEST_RATE         48000
+
+/* stereo tone is quiet for 5 seconds, then loud for 15 */
+#define TEST_QUIET_FRAMES ( 5 * TEST_RATE )
+#define TEST_LOUD_FRAMES  ( 15 * TEST_RATE )
+#define TEST_QUIET_LEVEL  -40.0
+#define TEST_LOUD_LEVEL   -20.0
+
+
+/* signal written to a test file, in [-1;1] */
+struct signal {
+	double (*at)( uint64_t frame, unsigned int channel );
+};
+
+static double stereo_at( uint64_t frame, unsigned int channel );
+static double surround_at( uint64_t frame, unsigned int channel );
+static double truepeak_at( uint64_t frame, unsigned int channel );
+static int32_t signal_at( uint64_t frame, unsigned int channel, void *user );
+static aafiAudioEssenceFile * add_essence( AAF_Iface *aafi, aafMobID_t *mobID, const char *path, unsigned int channels, uint32_t frames );
+static int check_value( int line, const char *what, double value, double expected, double tolerance );
+static int test_essence( int line, AAF_Iface *aafi, aafiAudioEssenceFile *audioEssenceFile );
+static int test_range( int line, AAF_Iface *aafi, aafiAudioEssenceFile *audioEssenceFile );
+static int test_surround( int line, AAF_Iface *aafi, aafiAudioEssenceFile *audioEssenceFile );
+static int test_truepeak( int line, AAF_Iface *aafi, aafiAudioEssenceFile *audioEssenceFile );
+static int test_clip( int line, AAF_Iface *aafi, aafiAudioEssenceFile *audioEssenceFile );
+static int test_clip_envelope( int line, AAF_Iface *aafi, aafiAudioEssenceFile *audioEssenceFile );
+
+
+
+static double stereo_at( uint64_t frame, unsigned int channel ) {
+
+	(void)channel;
+
+	double level = ( frame < TEST_QUIET_FRAMES ) ? TEST_QUIET_LEVEL : TEST_LOUD_LEVEL;
+
+	return pow( 10.0, level / 20.0 ) * sin( 2.0 * TEST_PI * 997.0 * (double)frame / TEST_RATE );
+}
+
+
+
+static double surround_at( uint64_t frame, unsigned int channel ) {
+
+	(void)channel;
+
+	return pow( 10.0, TEST_LOUD_LEVEL / 20.0 ) * sin( 2.0 * TEST_PI * 997.0 * (double)frame / TEST_RATE );
+}
+
+
+
+/*
+ * Samples of a 12 kHz tone at 45 degrees are all at 0.707 of its peak.
+ */
+
+static double truepeak_at( uint64_t frame, unsigned int channel ) {
+
+	(void)channel;
+
+	return 0.5 * sin( 2.0 * TEST_PI * 12000.0 * (double)frame / TEST_RATE + TEST_PI / 4.0 );
+}
+
+
+
+static int32_t signal_at( uint64_t frame, unsigned int channel, void *user ) {
+
+	struct signal *signal = user;
+
+	return (int32_t)lround( signal->at( frame, channel ) * 8388607.0 );
+}
+
+
+
+/*
+ * 24 bits essence of the signal matching its channel count.
+ */
+
+static aafiAudioEssenceFile * add_essence( AAF_Iface *aafi, aafMobID_t *mobID, const char *path, unsigned int channels, uint32_t frames ) {
+
+	struct signal signal;
+
+	signal.at = ( channels == 1 ) ? truepeak_at : ( channels == 2 ) ? stereo_at : surround_at;
+
+	if ( test_write_wav_file( path, TEST_RATE, (uint16_t)channels, 24, frames, signal_at, &signal ) < 0 ) {
+		return NULL;
+	}
+
+	return test_new_essence( aafi, mobID, path, AAFI_ESSENCE_TYPE_WAVE, TEST_RATE, (uint16_t)channels, 24, frames );
+}
+
+
+
+static int check_value( int line, const char *what, double value, double expected, double tolerance ) {
+
+	if ( fabs( value - expected ) > tolerance ) {
+		TEST_LOG( TEST_ERROR_STR "%s is %.3f, expected %.3f\n", line, what, value, expected );
+		return 1;
+	}
+
+	return 0;
+}
+
+
+
+static int test_essence( int line, AAF_Iface *aafi, aafiAudioEssenceFile *audioEssenceFile ) {
+
+	aafiLoudness loudness;
+
+	int errors = 0;
+
+	if ( aafi_getEssenceLoudness( aafi, audioEssenceFile, 0, 0, &loudness ) < 0 || loudness.channels != 2 ) {
+		TEST_LOG( TEST_ERROR_STR "aafi_getEssenceLoudness() failed\n", line );
+		return 1;
+	}
+
+	/* quiet part is left out by the relative gate */
+
+	double quiet = pow( 10.0, TEST_QUIET_LEVEL / 10.0 ) / 2;
+	double loud  = pow( 10.0, TEST_LOUD_LEVEL / 10.0 ) / 2;
+	double rms   = 10.0 * log10( ( quiet * TEST_QUIET_FRAMES + loud * TEST_LOUD_FRAMES ) / ( TEST_QUIET_FRAMES + TEST_LOUD_FRAMES ) );
+
+	errors += check_value( line, "integrated loudness", loudness.integrated, TEST_LOUD_LEVEL, 0.1 );
+	errors += check_value( line, "short-term max", loudness.shortTermMax, TEST_LOUD_LEVEL, 0.1 );
+	errors += check_value( line, "momentary max", loudness.momentaryMax, TEST_LOUD_LEVEL, 0.1 );
+	errors += check_value( line, "sample peak", loudness.samplePeak, TEST_LOUD_LEVEL, 0.02 );
+	errors += check_value( line, "true peak", loudness.truePeak, TEST_LOUD_LEVEL, 0.1 );
+	errors += check_value( line, "left RMS", loudness.rms[0], rms, 0.01 );
+	errors += check_value( line, "right RMS", loudness.rms[1], rms, 0.01 );
+
+	if ( !errors ) {
+		TEST_LOG( TEST_PASSED_STR "stereo tone is %.2f LUFS, gated\n", line, loudness.integrated );
+	}
+
+	return errors;
+}
+
+
+
+static int test_range( int line, AAF_Iface *aafi, aafiAudioEssenceFile *audioEssenceFile ) {
+
+	aafiLoudness loudness;
+
+	int errors = 0;
+
+	if ( aafi_getEssenceLoudness( aafi, audioEssenceFile, 0, TEST_QUIET_FRAMES, &loudness ) < 0 ) {
+		TEST_LOG( TEST_ERROR_STR "aafi_getEssenceLoudness() failed\n", line );
+		return 1;
+	}
+
+	errors += check_value( line, "quiet range loudness", loudness.integrated, TEST_QUIET_LEVEL, 0.1 );
+	errors += check_value( line, "quiet range RMS", loudness.rms[0], TEST_QUIET_LEVEL - 3.0103, 0.01 );
+	errors += check_value( line, "quiet range peak", loudness.samplePeak, TEST_QUIET_LEVEL, 0.02 );
+
+	if ( aafi_getEssenceLoudness( aafi, audioEssenceFile, TEST_QUIET_FRAMES + TEST_LOUD_FRAMES, 0, &loudness ) == 0 ) {
+		TEST_LOG( TEST_ERROR_STR "range after essence end was measured\n", line );
+		errors++;
+	}
+
+	if ( !errors ) {
+		TEST_LOG( TEST_PASSED_STR "essence range is %.2f LUFS\n", line, loudness.integrated );
+	}
+
+	return errors;
+}
+
+
+
+static int test_surround( int line, AAF_Iface *aafi, aafiAudioEssenceFile *audioEssenceFile ) {
+
+	aafiLoudness loudness;
+
+	int errors = 0;
+
+	if ( aafi_getEssenceLoudness( aafi, audioEssenceFile, 0, 0, &loudness ) < 0 || loudness.channels != 6 ) {
+		TEST_LOG( TEST_ERROR_STR "aafi_getEssenceLoudness() failed\n", line );
+		return 1;
+	}
+
+	/* L R C weighted 1.0, LFE left out, Ls Rs weighted 1.41 */
+
+	double expected = TEST_LOUD_LEVEL - 3.0103 + 10.0 * log10( 3 + 2 * 1.41 );
+
+	errors += check_value( line, "5.1 loudness", loudness.integrated, expected, 0.1 );
+
+	if ( !errors ) {
+		TEST_LOG( TEST_PASSED_STR "5.1 tone is %.2f LUFS\n", line, loudness.integrated );
+	}
+
+	return errors;
+}
+
+
+
+static int test_truepeak( int line, AAF_Iface *aafi, aafiAudioEssenceFile *audioEssenceFile ) {
+
+	aafiLoudness loudness;
+
+	int errors = 0;
+
+	if ( aafi_getEssenceLoudness( aafi, audioEssenceFile, 0, 0, &loudness ) < 0 || loudness.channels != 1 ) {
+		TEST_LOG( TEST_ERROR_STR "aafi_getEssenceLoudness() failed\n", line );
+		return 1;
+	}
+
+	errors += check_value( line, "sample peak", loudness.samplePeak, -9.03, 0.02 );
+	errors += check_value( line, "true peak", loudness.truePeak, -6.02, 0.2 );
+
+	if ( !errors ) {
+		TEST_LOG( TEST_PASSED_STR "fs/4 tone peaks at %.2f dBFS, %.2f dBTP\n", line, loudness.samplePeak, loudness.truePeak );
+	}
+
+	return errors;
+}
+
+
+
+static int test_clip( int line, AAF_Iface *aafi, aafiAudioEssenceFile *audioEssenceFile ) {
+
+	static aafRational_t editRate = { 25, 1 };
+
+	aafiLoudness loudness;
+
+	int errors = 0;
+
+	aafiAudioTrack *audioTrack = aafi_newAudioTrack( aafi );
+
+	if ( !audioTrack ) {
+		TEST_LOG( TEST_ERROR_STR "aafi_newAudioTrack() failed\n", line );
+		return 1;
+	}
+
+	audioTrack->edit_rate = &editRate;
+
+	/* right channel of 4 seconds within loud part */
+
+	uint32_t essenceChannel = 2;
+
+	aafiAudioClip *audioClip = aafi_newAudioClip( aafi, audioTrack );
+
+	if ( !audioClip || !aafi_newAudioEssencePointer( aafi, &audioClip->essencePointerList, audioEssenceFile, &essenceChannel ) ) {
+		TEST_LOG( TEST_ERROR_STR "aafi_newAudioClip() failed\n", line );
+		return 1;
+	}
+
+	audioClip->pos = 0;
+	audioClip->len = 4 * 25;
+	audioClip->essence_offset = 10 * 25;
+	audioClip->channels = 1;
+
+	struct aafiLoudnessData *analysis = audioEssenceFile->loudness;
+
+	if ( aafi_getClipLoudness( aafi, audioClip, &loudness ) < 0 || loudness.channels != 1 ) {
+		TEST_LOG( TEST_ERROR_STR "aafi_getClipLoudness() failed\n", line );
+		return 1;
+	}
+
+	if ( audioEssenceFile->loudness != analysis ) {
+		TEST_LOG( TEST_ERROR_STR "essence was measured again for clip\n", line );
+		errors++;
+	}
+
+	errors += check_value( line, "mono clip loudness", loudness.integrated, TEST_LOUD_LEVEL - 3.0103, 0.1 );
+	errors += check_value( line, "mono clip RMS", loudness.rms[0], TEST_LOUD_LEVEL - 3.0103, 0.01 );
+
+	if ( !errors ) {
+		TEST_LOG( TEST_PASSED_STR "clip is %.2f LUFS, from essence analysis\n", line, loudness.integrated );
+	}
+
+	return errors;
+}
+
+
+
+/*
+ * Right channel of 4 seconds within loud part, at half gain, then again with a
+ * linear fade in over the whole clip, whose mean power is a third of the tone.
+ */
+
+static int test_clip_envelope( int line, AAF_Iface *aafi, aafiAudioEssenceFile *audioEssenceFile ) {
+
+	static aafRational_t editRate = { 25, 1 };
+	static aafRational_t clipGain = { 1, 2 };
+
+	aafiLoudness loudness;
+
+	int errors = 0;
+
+	aafiAudioTrack *audioTrack = aafi_newAudioTrack( aafi );
+
+	if ( !audioTrack ) {
+		TEST_LOG( TEST_ERROR_STR "aafi_newAudioTrack() failed\n", line );
+		return 1;
+	}
+
+	audioTrack->edit_rate = &editRate;
+
+	uint32_t essenceChannel = 2;
+
+	aafiAudioClip *gainClip = aafi_newAudioClip( aafi, audioTrack );
+
+	if ( !gainClip || !aafi_newAudioEssencePointer( aafi, &gainClip->essencePointerList, audioEssenceFile, &essenceChannel ) ) {
+		TEST_LOG( TEST_ERROR_STR "aafi_newAudioClip() failed\n", line );
+		return 1;
+	}
+
+	gainClip->pos = 0;
+	gainClip->len = 4 * 25;
+	gainClip->essence_offset = 10 * 25;
+	gainClip->channels = 1;
+	gainClip->gain = aafi_newAudioGain( aafi, AAFI_AUDIO_GAIN_CONSTANT, 0, &clipGain );
+
+	aafiTransition *fadeIn = aafi_newTransition( aafi, audioTrack );
+	aafiAudioClip *fadeClip = aafi_newAudioClip( aafi, audioTrack );
+
+	if ( !gainClip->gain || !fadeIn || !fadeClip || !aafi_newAudioEssencePointer( aafi, &fadeClip->essencePointerList, audioEssenceFile, &essenceChannel ) ) {
+		TEST_LOG( TEST_ERROR_STR "could not build track\n", line );
+		return 1;
+	}
+
+	fadeIn->flags = AAFI_TRANS_FADE_IN | AAFI_INTERPOL_LINEAR;
+	fadeIn->len = 4 * 25;
+	fadeIn->value_a[0].numerator = 0;
+	fadeIn->value_a[0].denominator = 1;
+	fadeIn->value_a[1].numerator = 1;
+	fadeIn->value_a[1].denominator = 1;
+
+	fadeClip->pos = 4 * 25;
+	fadeClip->len = 4 * 25;
+	fadeClip->essence_offset = 10 * 25;
+	fadeClip->channels = 1;
+
+	if ( aafi_getClipLoudness( aafi, gainClip, &loudness ) < 0 || loudness.channels != 1 ) {
+		TEST_LOG( TEST_ERROR_STR "aafi_getClipLoudness() failed\n", line );
+		return 1;
+	}
+
+	errors += check_value( line, "clip loudness with gain", loudness.integrated, TEST_LOUD_LEVEL - 3.0103 - 6.0206, 0.1 );
+	errors += check_value( line, "clip RMS with gain", loudness.rms[0], TEST_LOUD_LEVEL - 3.0103 - 6.0206, 0.01 );
+	errors += check_value( line, "clip peak with gain", loudness.samplePeak, TEST_LOUD_LEVEL - 6.0206, 0.02 );
+
+	if ( aafi_getClipLoudness( aafi, fadeClip, &loudness ) < 0 || loudness.channels != 1 ) {
+		TEST_LOG( TEST_ERROR_STR "aafi_getClipLoudness() failed\n", line );
+		return 1;
+	}
+
+	errors += check_value( line, "clip RMS with fade in", loudness.rms[0], TEST_LOUD_LEVEL - 3.0103 - 4.7712, 0.02 );
+	errors += check_value( line, "clip peak with fade in", loudness.samplePeak, TEST_LOUD_LEVEL, 0.02 );
+
+	if ( !errors ) {
+		TEST_LOG( TEST_PASSED_STR "clip gain and fade in are applied to clip loudness\n", line );
+	}
+
+	return errors;
+}
+
+
+
+int main( void ) {
+
+#ifdef _WIN32
+	INIT_WINDOWS_CONSOLE()
+#endif
+
+	SET_LOCALE()
+
+
+	int errors = 0;
+
+	static aafMobID_t mobIDs[3] = {
+		{ .material = { .Data1 = 1 } },
+		{ .material = { .Data1 = 2 } },
+		{ .material = { .Data1 = 3 } }
+	};
+
+	TEST_LOG("\n");
+
+	AAF_Iface *aafi = aafi_alloc( NULL );
+
+	if ( !aafi ) {
+		TEST_LOG( TEST_ERROR_STR "aafi_alloc() failed\n", __LINE__ );
+		return 1;
+	}
+
+	aafi_set_debug( aafi, VERB_QUIET, 0, NULL, NULL, NULL );
+	aafi_set_option_int( aafi, "threads", 4 );
+
+	aafiAudioEssenceFile *stereo   = add_essence( aafi, &mobIDs[0], TEST_STEREO_FILE, 2, TEST_QUIET_FRAMES + TEST_LOUD_FRAMES );
+	aafiAudioEssenceFile *surround = add_essence( aafi, &mobIDs[1], TEST_SURR_FILE, 6, 2 * TEST_RATE );
+	aafiAudioEssenceFile *mono     = add_essence( aafi, &mobIDs[2], TEST_TP_FILE, 1, 2 * TEST_RATE );
+
+	if ( !stereo || !surround || !mono ) {
+		TEST_LOG( TEST_ERROR_STR "could not create test essences\n", __LINE__ );
+		errors++;
+		goto end;
+	}
+
+	if ( aafi_analyzeLoudness( aafi, NULL ) < 0 || !stereo->loudness || !surround->loudness || !mono->loudness ) {
+		TEST_LOG( TEST_ERROR_STR "aafi_analyzeLoudness() failed\n", __LINE__ );
+		errors++;
+		goto end;
+	}
+
+	errors += test_essence( __LINE__, aafi, stereo );
+	errors += test_range( __LINE__, aafi, stereo );
+	errors += test_surround( __LINE__, aafi, surround );
+	errors += test_truepeak( __LINE__, aafi, mono );
+	errors += test_clip( __LINE__, aafi, stereo );
+
+	aafi->Audio->samplerate = TEST_RATE;
+	aafi->Audio->samplerateRational = stereo->samplerateRational;
+
+	errors += test_clip_envelope( __LINE__, aafi, stereo );
+
+end:
+	aafi_release( &aafi );
+
+	remove( TEST_STEREO_FILE );
+	remove( TEST_SURR_FILE );
+	remove( TEST_TP_FILE );
+
+	TEST_LOG("\n");
+
+	return errors;
+}
@@ -0,0 +1,311 @@
+/*
+ * Copyright (C) 2017-2024 Adrien Gesta-Fline
+ *
+ * This file is part of libAAF.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Computes peaks of a stereo 24 bits WAVE file and checks every bin of every
+ * level against a per-sample search. Peaks are then written to a sidecar, and
+ * loaded back by another AAF_Iface holding the same essence, which must get the
+ * exact same peaks, read from the mapped sidecar.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include <libaaf.h>
+
+#include "common.h"
+#include "test_util.h"
+
+
+#define TEST_WAV_FILE     "test_peaks.wav"
+#define TEST_PEAKS_FILE   "test_peaks.peaks"
+#define TEST_BAD_FILE     "test_peaks.bad"
+
+/* last bin of every level is partial */
+#define TEST_FRAMES       200003
+#define TEST_CHANNELS     2
+
+
+static int32_t sample_at( uint64_t frame, unsigned int channel, void *user );
+static int test_build( int line, AAF_Iface *aafi, aafiAudioEssenceFile *audioEssenceFile );
+static int test_sidecar( int line, AAF_Iface *aafi, aafiAudioEssenceFile *audioEssenceFile, aafMobID_t *mobID );
+
+
+
+/*
+ * Noise, louder on second channel, with a full scale sample once per second.
+ */
+
+static int32_t sample_at( uint64_t frame, unsigned int channel, void *user ) {
+
+	(void)user;
+
+	if ( frame % 48000 == 1000 + channel ) {
+		return ( channel ) ? 0x7fffff : -0x800000;
+	}
+
+	uint32_t x = (uint32_t)(frame * 2654435761u) ^ (channel * 0x9e3779b9u);
+
+	x ^= x >> 15;
+	x *= 0x2c1b3c6du;
+	x ^= x >> 12;
+
+	int32_t v = (int32_t)(x >> 8) - 0x800000;
+
+	return ( channel ) ? v : v / 4;
+}
+
+
+
+static int test_build( int line, AAF_Iface *aafi, aafiAudioEssenceFile *audioEssenceFile ) {
+
+	if ( aafi_buildPeaks( aafi, audioEssenceFile ) < 0 || !audioEssenceFile->peaks ) {
+		TEST_LOG( TEST_ERROR_STR "aafi_buildPeaks() failed\n", line );
+		return 1;
+	}
+
+	aafiPeaks *peaks = audioEssenceFile->peaks;
+
+	if ( peaks->channels != TEST_CHANNELS || peaks->frameCount != TEST_FRAMES ) {
+		TEST_LOG( TEST_ERROR_STR "peaks have %u channels and %"PRIu64" samples\n", line, peaks->channels, peaks->frameCount );
+		return 1;
+	}
+
+	for ( unsigned int l = 0; l < AAFI_PEAK_LEVELS; l++ ) {
+
+		const aafiPeakLevel *level = &peaks->levels[l];
+
+		if ( level->binCount != ( TEST_FRAMES + level->samplesPerBin - 1 ) / level->samplesPerBin ) {
+			TEST_LOG( TEST_ERROR_STR "level %u has %"PRIu64" bins\n", line, l, level->binCount );
+			return 1;
+		}
+
+		for ( uint64_t b = 0; b < level->binCount; b++ ) {
+			for ( unsigned int c = 0; c < TEST_CHANNELS; c++ ) {
+
+				float lo = 1.0f;
+				float hi = -1.0f;
+
+				for ( uint64_t i = b * level->samplesPerBin; i < (b + 1) * level->samplesPerBin && i < TEST_FRAMES; i++ ) {
+					float v = (float)sample_at( i, c, NULL ) / 8388608.0f;
+					lo = ( v < lo ) ? v : lo;
+					hi = ( v > hi ) ? v : hi;
+				}
+
+				int16_t min = (int16_t)fmaxf( floorf( lo * 32767.0f ), -32768.0f );
+				int16_t max = (int16_t)fminf( ceilf( hi * 32767.0f ), 32767.0f );
+
+				if ( level->peaks[(b * TEST_CHANNELS + c) * 2] != min || level->peaks[(b * TEST_CHANNELS + c) * 2 + 1] != max ) {
+					TEST_LOG( TEST_ERROR_STR "level %u bin %"PRIu64" channel %u is [%i, %i], expected [%i, %i]\n", line, l, b, c, level->peaks[(b * TEST_CHANNELS + c) * 2], level->peaks[(b * TEST_CHANNELS + c) * 2 + 1], min, max );
+					return 1;
+				}
+			}
+		}
+	}
+
+	if ( aafi_getPeakLevel( peaks, 100 ) != &peaks->levels[0] ||
+	     aafi_getPeakLevel( peaks, 4096 ) != &peaks->levels[1] ||
+	     aafi_getPeakLevel( peaks, 1000000 ) != &peaks->levels[2] )
+	{
+		TEST_LOG( TEST_ERROR_STR "aafi_getPeakLevel() returned wrong levels\n", line );
+		return 1;
+	}
+
+	TEST_LOG( TEST_PASSED_STR "peaks of every level match per-sample search\n", line );
+
+	return 0;
+}
+
+
+
+static int test_sidecar( int line, AAF_Iface *aafi, aafiAudioEssenceFile *audioEssenceFile, aafMobID_t *mobID ) {
+
+	int errors = 0;
+
+	aafiPeaks *built = audioEssenceFile->peaks;
+
+	if ( aafi_writePeaks( aafi, TEST_PEAKS_FILE ) < 0 ) {
+		TEST_LOG( TEST_ERROR_STR "aafi_writePeaks() failed\n", line );
+		return 1;
+	}
+
+
+	/* another session of the same file */
+
+	AAF_Iface *session = aafi_alloc( NULL );
+
+	if ( !session ) {
+		TEST_LOG( TEST_ERROR_STR "aafi_alloc() failed\n", line );
+		return 1;
+	}
+
+	aafi_set_debug( session, VERB_QUIET, 0, NULL, NULL, NULL );
+
+	static aafMobID_t otherMobID = { .material = { .Data1 = 2 } };
+
+	aafiAudioEssenceFile *loaded = test_new_essence( session, mobID, TEST_WAV_FILE, AAFI_ESSENCE_TYPE_WAVE, 48000, TEST_CHANNELS, 24, TEST_FRAMES );
+	aafiAudioEssenceFile *other  = test_new_essence( session, &otherMobID, TEST_WAV_FILE, AAFI_ESSENCE_TYPE_WAVE, 48000, TEST_CHANNELS, 24, TEST_FRAMES );
+
+	if ( !loaded || !other ) {
+		TEST_LOG( TEST_ERROR_STR "aafi_newAudioEssence() failed\n", line );
+		errors++;
+		goto end;
+	}
+
+	int count = aafi_loadPeaks( session, TEST_PEAKS_FILE );
+
+	if ( count != 1 || !loaded->peaks || other->peaks ) {
+		TEST_LOG( TEST_ERROR_STR "aafi_loadPeaks() set peaks of %i essences\n", line, count );
+		errors++;
+		goto end;
+	}
+
+	for ( unsigned int l = 0; l < AAFI_PEAK_LEVELS; l++ ) {
+
+		const aafiPeakLevel *a = &built->levels[l];
+		const aafiPeakLevel *b = &loaded->peaks->levels[l];
+
+		if ( a->binCount != b->binCount || memcmp( a->peaks, b->peaks, a->binCount * TEST_CHANNELS * 2 * sizeof(int16_t) ) != 0 ) {
+			TEST_LOG( TEST_ERROR_STR "loaded peaks of level %u differ\n", line, l );
+			errors++;
+			goto end;
+		}
+	}
+
+	if ( loaded->peaks->data ) {
+		TEST_LOG( TEST_ERROR_STR "loaded peaks were copied\n", line );
+		errors++;
+		goto end;
+	}
+
+	TEST_LOG( TEST_PASSED_STR "peaks loaded from sidecar by SourceMob MobID\n", line );
+
+
+	/* sidecar is replaced while mapped, then loaded again */
+
+	if ( aafi_buildPeaks( session, NULL ) < 0 || !other->peaks ) {
+		TEST_LOG( TEST_ERROR_STR "aafi_buildPeaks() failed on missing peaks\n", line );
+		errors++;
+		goto end;
+	}
+
+	if ( aafi_writePeaks( session, TEST_PEAKS_FILE ) < 0 ) {
+		TEST_LOG( TEST_ERROR_STR "aafi_writePeaks() failed on a mapped sidecar\n", line );
+		errors++;
+		goto end;
+	}
+
+	if ( aafi_loadPeaks( session, TEST_PEAKS_FILE ) != 2 ||
+	     memcmp( loaded->peaks->levels[0].peaks, other->peaks->levels[0].peaks, loaded->peaks->levels[0].binCount * TEST_CHANNELS * 2 * sizeof(int16_t) ) != 0 )
+	{
+		TEST_LOG( TEST_ERROR_STR "replaced sidecar could not be loaded\n", line );
+		errors++;
+		goto end;
+	}
+
+	TEST_LOG( TEST_PASSED_STR "sidecar replaced while mapped\n", line );
+
+
+	/* truncated sidecar */
+
+	FILE *fp = fopen( TEST_BAD_FILE, "wb" );
+
+	if ( fp ) {
+		fwrite( "LAAFPEAK", 1, 8, fp );
+		fclose( fp );
+	}
+
+	if ( aafi_loadPeaks( session, TEST_BAD_FILE ) != -1 || !loaded->peaks ) {
+		TEST_LOG( TEST_ERROR_STR "invalid sidecar was loaded\n", line );
+		errors++;
+		goto end;
+	}
+
+	TEST_LOG( TEST_PASSED_STR "invalid sidecar rejected\n", line );
+
+end:
+	aafi_release( &session );
+
+	remove( TEST_BAD_FILE );
+
+	return errors;
+}
+
+
+
+int main( int argc, char *argv[] ) {
+
+	(void)argc;
+	(void)argv;
+
+#ifdef _WIN32
+	INIT_WINDOWS_CONSOLE()
+#endif
+
+	SET_LOCALE()
+
+
+	int errors = 0;
+
+	static aafMobID_t mobID = { .material = { .Data1 = 1 } };
+
+	TEST_LOG("\n");
+
+	AAF_Iface *aafi = aafi_alloc( NULL );
+
+	if ( !aafi ) {
+		TEST_LOG( TEST_ERROR_STR "aafi_alloc() failed\n", __LINE__ );
+		return 1;
+	}
+
+	aafi_set_debug( aafi, VERB_QUIET, 0, NULL, NULL, NULL );
+
+	if ( test_write_wav_file( TEST_WAV_FILE, 48000, TEST_CHANNELS, 24, TEST_FRAMES, sample_at, NULL ) < 0 ) {
+		TEST_LOG( TEST_ERROR_STR "could not write test file\n", __LINE__ );
+		errors++;
+		goto end;
+	}
+
+	aafiAudioEssenceFile *audioEssenceFile = test_new_essence( aafi, &mobID, TEST_WAV_FILE, AAFI_ESSENCE_TYPE_WAVE, 48000, TEST_CHANNELS, 24, TEST_FRAMES );
+
+	if ( !audioEssenceFile ) {
+		TEST_LOG( TEST_ERROR_STR "aafi_newAudioEssence() failed\n", __LINE__ );
+		errors++;
+		goto end;
+	}
+
+	errors += test_build( __LINE__, aafi, audioEssenceFile );
+
+	if ( !errors ) {
+		errors += test_sidecar( __LINE__, aafi, audioEssenceFile, &mobID );
+	}
+
+end:
+	aafi_release( &aafi );
+
+	remove( TEST_WAV_FILE );
+	remove( TEST_PEAKS_FILE );
+
+	TEST_LOG("\n");
+
+	return errors;
+}
@@ -0,0 +1,440 @@
+/*
+ * Copyright (C) 2017-2024 Adrien Gesta-Fline
+ *
+ * This file is part of libAAF.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Plays 64 tracks at 48 kHz, each with a clip of a ramp WAVE file at its own
+ * position and essence offset. Tracks are read by blocks of 256 samples at the
+ * pace of an audio device, and every sample is checked against the ramp.
+ * Playback is then moved, and read again from the new position.
+ *
+ * Underruns and read times depend on the machine load, so they are only
+ * reported. When LIBAAF_TEST_PLAYBACK_TIMING is set in the environment, any
+ * underrun, or any read of a track lasting more than a device period, fails
+ * the test.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+
+#include <libaaf.h>
+
+#include "common.h"
+#include "test_util.h"
+
+
+#define TEST_WAV_FILE      "test_playback.wav"
+
+#define TEST_SAMPLERATE    48000
+#define TEST_FRAMES        (TEST_SAMPLERATE * 4)
+
+#define TEST_TRACKS        64
+#define TEST_RING_FRAMES   16384
+#define TEST_PERIOD        256
+#define TEST_CALLBACKS     375        // 2 seconds
+#define TEST_SEEK_POS      (TEST_SAMPLERATE * 2)
+#define TEST_SEEK_TIMEOUT  1875       // 10 seconds
+
+/* track N clip starts at N * CLIP_POS_STEP, reads essence from N * CLIP_OFFSET_STEP */
+#define CLIP_POS_STEP      997
+#define CLIP_OFFSET_STEP   37
+#define CLIP_LEN           (TEST_SAMPLERATE * 3)
+
+
+static int16_t ramp( uint64_t frame );
+static int32_t ramp_at( uint64_t frame, unsigned int channel, void *user );
+static double now_ms( void );
+static void sleep_ms( double ms );
+static float expected( unsigned int track, uint64_t pos );
+static int wait_buffered( aafiPlaybackTrack **tracks, uint64_t frames, double timeoutMs );
+static int check_block( int line, unsigned int track, const float *samples, uint64_t pos, uint64_t frames );
+static int test_playback( int line, AAF_Iface *aafi, aafiAudioTrack **audioTracks );
+
+
+
+static int16_t ramp( uint64_t frame ) {
+	return (int16_t)((frame * 7) % 65536 - 32768);
+}
+
+
+
+/*
+ * Mono 16 bits WAVE file of a ramp, so every sample tells its own position.
+ */
+
+static int32_t ramp_at( uint64_t frame, unsigned int channel, void *user ) {
+
+	(void)channel;
+	(void)user;
+
+	return ramp( frame );
+}
+
+
+
+static double now_ms( void ) {
+
+	struct timespec ts;
+
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+
+	return (double)ts.tv_sec * 1000.0 + (double)ts.tv_nsec / 1e6;
+}
+
+
+
+static void sleep_ms( double ms ) {
+
+	if ( ms <= 0 ) {
+		return;
+	}
+
+	struct timespec ts;
+
+	ts.tv_sec  = (time_t)(ms / 1000);
+	ts.tv_nsec = (long)((ms - (double)ts.tv_sec * 1000) * 1e6);
+
+	nanosleep( &ts, NULL );
+}
+
+
+
+static float expected( unsigned int track, uint64_t pos ) {
+
+	uint64_t clipPos = track * CLIP_POS_STEP;
+
+	if ( pos < clipPos || pos >= clipPos + CLIP_LEN ) {
+		return 0.0f;
+	}
+
+	return (float)ramp( pos - clipPos + track * CLIP_OFFSET_STEP ) / 32768.0f;
+}
+
+
+
+static int wait_buffered( aafiPlaybackTrack **tracks, uint64_t frames, double timeoutMs ) {
+
+	double start = now_ms();
+
+	for ( unsigned int i = 0; i < TEST_TRACKS; i++ ) {
+
+		while ( aafi_getPlaybackBuffered( tracks[i] ) < frames ) {
+
+			if ( now_ms() - start > timeoutMs ) {
+				return -1;
+			}
+
+			sleep_ms( 1 );
+		}
+	}
+
+	return 0;
+}
+
+
+
+/*
+ * First frames samples must be the ones at pos, and the rest of the block the
+ * silence an underrun is filled with.
+ */
+
+static int check_block( int line, unsigned int track, const float *samples, uint64_t pos, uint64_t frames ) {
+
+	for ( uint64_t i = 0; i < TEST_PERIOD; i++ ) {
+
+		float value = ( i < frames ) ? expected( track, pos + i ) : 0.0f;
+
+		if ( samples[i] != value ) {
+			TEST_LOG( TEST_ERROR_STR "track %u sample %"PRIu64" is %f, expected %f\n", line, track, pos + i, samples[i], value );
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+
+
+static int test_playback( int line, AAF_Iface *aafi, aafiAudioTrack **audioTracks ) {
+
+	int errors = 0;
+
+	aafiPlaybackTrack *tracks[TEST_TRACKS];
+	float samples[TEST_PERIOD];
+
+	aafiPlayback *playback = aafi_newPlayback( aafi, TEST_RING_FRAMES );
+
+	if ( !playback ) {
+		TEST_LOG( TEST_ERROR_STR "aafi_newPlayback() failed\n", line );
+		return 1;
+	}
+
+	for ( unsigned int i = 0; i < TEST_TRACKS; i++ ) {
+
+		unsigned int channels = 0;
+
+		tracks[i] = aafi_addPlaybackTrack( playback, audioTracks[i], &channels );
+
+		if ( !tracks[i] || channels != 1 ) {
+			TEST_LOG( TEST_ERROR_STR "aafi_addPlaybackTrack() failed\n", line );
+			errors++;
+			goto end;
+		}
+	}
+
+	if ( aafi_startPlayback( playback, 0, NULL ) < 0 ) {
+		TEST_LOG( TEST_ERROR_STR "aafi_startPlayback() failed\n", line );
+		errors++;
+		goto end;
+	}
+
+	if ( wait_buffered( tracks, TEST_RING_FRAMES, 10000 ) < 0 ) {
+		TEST_LOG( TEST_ERROR_STR "rings were not filled\n", line );
+		errors++;
+		goto end;
+	}
+
+
+	/*
+	 * audio device : all tracks are read once every period. A track that
+	 * underruns gets the rest of its block as silence, and carries on from the
+	 * last sample it actually read.
+	 */
+
+	int strictTiming = ( getenv( "LIBAAF_TEST_PLAYBACK_TIMING" ) != NULL );
+
+	uint64_t played[TEST_TRACKS];
+	uint64_t underruns = 0;
+	double periodMs = TEST_PERIOD * 1000.0 / TEST_SAMPLERATE;
+	double maxCallbackMs = 0;
+	double deadline = now_ms();
+
+	memset( played, 0x00, sizeof(played) );
+
+	for ( uint64_t cb = 0; cb < TEST_CALLBACKS && !errors; cb++ ) {
+
+		for ( unsigned int i = 0; i < TEST_TRACKS && !errors; i++ ) {
+
+			double start = now_ms();
+
+			uint64_t frames = aafi_readPlayback( tracks[i], samples, TEST_PERIOD );
+
+			double elapsed = now_ms() - start;
+
+			if ( elapsed > maxCallbackMs ) {
+				maxCallbackMs = elapsed;
+			}
+
+			errors += check_block( line, i, samples, played[i], frames );
+
+			played[i] += frames;
+		}
+
+		deadline += periodMs;
+
+		sleep_ms( deadline - now_ms() );
+	}
+
+	if ( errors ) {
+		goto end;
+	}
+
+	for ( unsigned int i = 0; i < TEST_TRACKS; i++ ) {
+		underruns += aafi_getPlaybackUnderruns( tracks[i] );
+	}
+
+	if ( strictTiming && underruns ) {
+		TEST_LOG( TEST_ERROR_STR "tracks counted %"PRIu64" underruns\n", line, underruns );
+		errors++;
+	}
+
+	if ( strictTiming && maxCallbackMs > periodMs ) {
+		TEST_LOG( TEST_ERROR_STR "reading a track took %.3f ms, device period is %.3f ms\n", line, maxCallbackMs, periodMs );
+		errors++;
+	}
+
+	if ( errors ) {
+		goto end;
+	}
+
+	TEST_LOG( TEST_PASSED_STR "%u tracks played for %u periods of %u samples (%"PRIu64" underruns, max read %.3f ms)\n", line, TEST_TRACKS, TEST_CALLBACKS, TEST_PERIOD, underruns, maxCallbackMs );
+
+
+	/*
+	 * seek : device keeps reading, and gets silence until samples from the new
+	 * position are ready, never samples rendered before.
+	 */
+
+	unsigned int ready = 0;
+	double seekMs = 0;
+
+	memset( played, 0x00, sizeof(played) );
+
+	double seekStart = now_ms();
+
+	if ( aafi_seekPlayback( playback, TEST_SEEK_POS, NULL ) < 0 ) {
+		TEST_LOG( TEST_ERROR_STR "aafi_seekPlayback() failed\n", line );
+		errors++;
+		goto end;
+	}
+
+	deadline = now_ms();
+
+	for ( uint64_t cb = 0; ready < TEST_TRACKS && !errors; cb++ ) {
+
+		if ( cb == TEST_SEEK_TIMEOUT ) {
+			TEST_LOG( TEST_ERROR_STR "no samples %u periods after seek\n", line, TEST_SEEK_TIMEOUT );
+			errors++;
+			goto end;
+		}
+
+		for ( unsigned int i = 0; i < TEST_TRACKS && !errors; i++ ) {
+
+			uint64_t frames = aafi_readPlayback( tracks[i], samples, TEST_PERIOD );
+
+			errors += check_block( line, i, samples, TEST_SEEK_POS + played[i], frames );
+
+			if ( frames && played[i] == 0 && ++ready == TEST_TRACKS ) {
+				seekMs = now_ms() - seekStart;
+			}
+
+			played[i] += frames;
+		}
+
+		deadline += periodMs;
+
+		sleep_ms( deadline - now_ms() );
+	}
+
+	if ( errors ) {
+		goto end;
+	}
+
+	uint64_t seekUnderruns = 0;
+
+	for ( unsigned int i = 0; i < TEST_TRACKS; i++ ) {
+		seekUnderruns += aafi_getPlaybackUnderruns( tracks[i] );
+	}
+
+	seekUnderruns -= underruns;
+
+	if ( strictTiming && seekUnderruns ) {
+		TEST_LOG( TEST_ERROR_STR "tracks counted %"PRIu64" underruns after seek\n", line, seekUnderruns );
+		errors++;
+		goto end;
+	}
+
+	TEST_LOG( TEST_PASSED_STR "playback moved, all tracks playing again after %.3f ms (%"PRIu64" underruns)\n", line, seekMs, seekUnderruns );
+
+end:
+	aafi_releasePlayback( &playback );
+
+	return errors;
+}
+
+
+
+int main( int argc, char *argv[] ) {
+
+	(void)argc;
+	(void)argv;
+
+#ifdef _WIN32
+	INIT_WINDOWS_CONSOLE()
+#endif
+
+	SET_LOCALE()
+
+
+	int errors = 0;
+
+	static aafRational_t editRate = { TEST_SAMPLERATE, 1 };
+	static aafMobID_t mobID = { .material = { .Data1 = 1 } };
+
+	aafiAudioTrack *audioTracks[TEST_TRACKS];
+
+	TEST_LOG("\n");
+
+	AAF_Iface *aafi = aafi_alloc( NULL );
+
+	if ( !aafi ) {
+		TEST_LOG( TEST_ERROR_STR "aafi_alloc() failed\n", __LINE__ );
+		return 1;
+	}
+
+	aafi_set_debug( aafi, VERB_QUIET, 0, NULL, NULL, NULL );
+
+	if ( test_write_wav_file( TEST_WAV_FILE, TEST_SAMPLERATE, 1, 16, TEST_FRAMES, ramp_at, NULL ) < 0 ) {
+		TEST_LOG( TEST_ERROR_STR "could not write test file\n", __LINE__ );
+		errors++;
+		goto end;
+	}
+
+	aafiAudioEssenceFile *audioEssenceFile = test_new_essence( aafi, &mobID, TEST_WAV_FILE, AAFI_ESSENCE_TYPE_WAVE, TEST_SAMPLERATE, 1, 16, TEST_FRAMES );
+
+	if ( !audioEssenceFile ) {
+		TEST_LOG( TEST_ERROR_STR "could not add essence\n", __LINE__ );
+		errors++;
+		goto end;
+	}
+
+	aafi->Audio->samplerate = TEST_SAMPLERATE;
+	aafi->Audio->samplerateRational = audioEssenceFile->samplerateRational;
+
+	for ( unsigned int i = 0; i < TEST_TRACKS; i++ ) {
+
+		audioTracks[i] = aafi_newAudioTrack( aafi );
+
+		aafiAudioClip *audioClip = ( audioTracks[i] ) ? aafi_newAudioClip( aafi, audioTracks[i] ) : NULL;
+
+		if ( !audioClip || !aafi_newAudioEssencePointer( aafi, &audioClip->essencePointerList, audioEssenceFile, NULL ) ) {
+			TEST_LOG( TEST_ERROR_STR "could not build track %u\n", __LINE__, i );
+			errors++;
+			goto end;
+		}
+
+		audioTracks[i]->edit_rate = &editRate;
+		audioTracks[i]->format = AAFI_TRACK_FORMAT_MONO;
+
+		audioClip->pos = i * CLIP_POS_STEP;
+		audioClip->len = CLIP_LEN;
+		audioClip->essence_offset = i * CLIP_OFFSET_STEP;
+		audioClip->channels = 1;
+	}
+
+	if ( aafi_buildRangeIndexes( aafi ) < 0 ) {
+		TEST_LOG( TEST_ERROR_STR "aafi_buildRangeIndexes() failed\n", __LINE__ );
+		errors++;
+		goto end;
+	}
+
+	errors += test_playback( __LINE__, aafi, audioTracks );
+
+end:
+	aafi_release( &aafi );
+
+	remove( TEST_WAV_FILE );
+
+	TEST_LOG("\n");
+
+	return errors;
+}
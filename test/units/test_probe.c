@@ -0,0 +1,178 @@
+/*
+ * Copyright (C) 2017-2024 Adrien Gesta-Fline
+ *
+ * This file is part of libAAF.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Probes every file of the test/aaf corpus, and checks that composition name
+ * and length are the ones set by a full aafi_load_file().
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <dirent.h>
+
+#include <libaaf.h>
+
+#include "common.h"
+
+
+struct summary {
+	char          *name;
+	aafPosition_t  length;
+	aafRational_t  editRate;
+};
+
+static int load_summary( const char *file, int probe, struct summary *sum );
+static int test_file( const char *file );
+
+
+
+static int load_summary( const char *file, int probe, struct summary *sum ) {
+
+	int rc = -1;
+
+	AAF_Iface *aafi = aafi_alloc( NULL );
+
+	if ( !aafi ) {
+		return -1;
+	}
+
+	aafi_set_debug( aafi, VERB_QUIET, 0, NULL, NULL, NULL );
+
+	if ( ( probe ) ? aafi_probe( aafi, file ) != 0 : aafi_load_file( aafi, file ) != 0 ) {
+		goto end;
+	}
+
+	sum->name = laaf_util_c99strdup( aafi->compositionName );
+	sum->length = aafi->compositionLength;
+
+	if ( aafi->compositionLength_editRate ) {
+		sum->editRate = *aafi->compositionLength_editRate;
+	}
+
+	rc = 0;
+
+end:
+	aafi_release( &aafi );
+
+	return rc;
+}
+
+
+
+static int test_file( const char *file ) {
+
+	struct summary load;
+	struct summary probe;
+
+	memset( &load,  0x00, sizeof(struct summary) );
+	memset( &probe, 0x00, sizeof(struct summary) );
+
+	int errors = 0;
+
+	if ( load_summary( file, 0, &load ) < 0 ) {
+		/* nothing to compare to */
+		goto end;
+	}
+
+	if ( load_summary( file, 1, &probe ) < 0 ) {
+		TEST_LOG( TEST_ERROR_STR "Could not probe %s\n", __LINE__, file );
+		errors++;
+		goto end;
+	}
+
+	if ( ( load.name || probe.name ) && ( !load.name || !probe.name || strcmp( load.name, probe.name ) != 0 ) ) {
+		TEST_LOG( TEST_ERROR_STR "%s : probed name \"%s\", loaded name \"%s\"\n", __LINE__, file, probe.name, load.name );
+		errors++;
+	}
+
+	/* same length, no matter the edit rate it is expressed in */
+	if ( (int64_t)probe.length * load.editRate.numerator * probe.editRate.denominator !=
+	     (int64_t)load.length  * probe.editRate.numerator * load.editRate.denominator )
+	{
+		TEST_LOG( TEST_ERROR_STR "%s : probed length %"PRIi64" (%i/%i), loaded length %"PRIi64" (%i/%i)\n", __LINE__, file,
+			probe.length, probe.editRate.numerator, probe.editRate.denominator,
+			load.length,  load.editRate.numerator,  load.editRate.denominator );
+		errors++;
+	}
+
+end:
+	free( load.name );
+	free( probe.name );
+
+	return errors;
+}
+
+
+
+int main( int argc, char *argv[] ) {
+
+	const char *path = ( argc > 1 ) ? argv[1] : LIBAAF_TEST_AAF_PATH;
+
+	SET_LOCALE()
+
+	TEST_LOG("\n");
+
+	int errors = 0;
+	int count = 0;
+
+	DIR *dir = opendir( path );
+
+	if ( !dir ) {
+		TEST_LOG( TEST_ERROR_STR "Could not open directory : %s\n", __LINE__, path );
+		return 1;
+	}
+
+	struct dirent *entry = NULL;
+
+	while ( (entry = readdir( dir )) != NULL ) {
+
+		size_t len = strlen( entry->d_name );
+
+		if ( len < 4 || strcmp( entry->d_name + len - 4, ".aaf" ) != 0 ) {
+			continue;
+		}
+
+		char *file = laaf_util_build_path( "/", path, entry->d_name, NULL );
+
+		if ( file ) {
+			errors += test_file( file );
+			count++;
+		}
+
+		free( file );
+	}
+
+	closedir( dir );
+
+	if ( count == 0 ) {
+		TEST_LOG( TEST_ERROR_STR "No AAF file found in %s\n", __LINE__, path );
+		return 1;
+	}
+
+	if ( errors == 0 ) {
+		TEST_LOG( TEST_PASSED_STR "%i files probed with the same composition name and length as loaded\n", __LINE__, count );
+	}
+
+	TEST_LOG("\n");
+
+	return errors;
+}
@@ -0,0 +1,226 @@
+/*
+ * Copyright (C) 2017-2024 Adrien Gesta-Fline
+ *
+ * This file is part of libAAF.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+/*
+ * Runs protools_post_processing() on a synthetic track made of thousands of
+ * rendered fades and sample accurate edits, checks the resulting track and
+ * reports processing time.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <libaaf.h>
+#include <libaaf/ProTools.h>
+
+#include "common.h"
+
+
+#define TEST_FADES 20000
+
+#define TEST_CLIP_LEN    1000
+#define TEST_FADE_LEN    200
+#define TEST_SAE_LEN     3
+#define TEST_HANDLE      1000
+#define TEST_GROUP_LEN   3000
+
+
+static aafiAudioClip * new_clip( AAF_Iface *aafi, aafiAudioTrack *audioTrack, const char *name, uint32_t slotID, aafPosition_t pos, aafPosition_t len, aafPosition_t essenceOffset, aafPosition_t essenceLength );
+static int test_build_track( int line, AAF_Iface *aafi, aafiAudioTrack *audioTrack );
+static int test_post_processing( int line, AAF_Iface *aafi, aafiAudioTrack *audioTrack );
+
+
+
+static aafiAudioClip * new_clip( AAF_Iface *aafi, aafiAudioTrack *audioTrack, const char *name, uint32_t slotID, aafPosition_t pos, aafPosition_t len, aafPosition_t essenceOffset, aafPosition_t essenceLength ) {
+
+	static aafMobID_t sourceMobID;
+
+	aafiAudioEssenceFile *audioEssenceFile = aafi_newAudioEssence( aafi, &sourceMobID, slotID );
+
+	if ( !audioEssenceFile ) {
+		return NULL;
+	}
+
+	audioEssenceFile->name = laaf_util_c99strdup( name );
+	audioEssenceFile->unique_name = laaf_util_c99strdup( name );
+	audioEssenceFile->length = essenceLength;
+	audioEssenceFile->samplerateRational->numerator = 48000;
+	audioEssenceFile->samplerateRational->denominator = 1;
+
+	aafiAudioClip *audioClip = aafi_newAudioClip( aafi, audioTrack );
+
+	if ( !audioClip || !audioEssenceFile->name || !audioEssenceFile->unique_name ||
+	     !aafi_newAudioEssencePointer( aafi, &audioClip->essencePointerList, audioEssenceFile, NULL ) )
+	{
+		return NULL;
+	}
+
+	audioClip->pos = pos;
+	audioClip->len = len;
+	audioClip->essence_offset = essenceOffset;
+
+	audioTrack->clipCount++;
+
+	return audioClip;
+}
+
+
+
+static int test_build_track( int line, AAF_Iface *aafi, aafiAudioTrack *audioTrack ) {
+
+	/*
+	 * Each group is a clip, a rendered fade, a sample accurate edit and another
+	 * clip, all touching each other. Both clips have enough handle for the fade
+	 * to be turned into a cross-fade once the sample accurate edit is removed.
+	 */
+	for ( int i = 0; i < TEST_FADES; i++ ) {
+
+		aafPosition_t pos = (aafPosition_t)i * TEST_GROUP_LEN;
+		uint32_t slotID = (uint32_t)i * 4;
+
+		if ( !new_clip( aafi, audioTrack, "Clip",                 slotID,   pos,                                            TEST_CLIP_LEN, TEST_HANDLE, TEST_CLIP_LEN + 2*TEST_HANDLE ) ||
+		     !new_clip( aafi, audioTrack, "Fade ",                slotID+1, pos + TEST_CLIP_LEN,                            TEST_FADE_LEN, 0,           TEST_FADE_LEN ) ||
+		     !new_clip( aafi, audioTrack, "Sample accurate edit", slotID+2, pos + TEST_CLIP_LEN + TEST_FADE_LEN,            TEST_SAE_LEN,  0,           TEST_SAE_LEN ) ||
+		     !new_clip( aafi, audioTrack, "Clip",                 slotID+3, pos + TEST_CLIP_LEN + TEST_FADE_LEN + TEST_SAE_LEN, TEST_CLIP_LEN, TEST_HANDLE, TEST_CLIP_LEN + 2*TEST_HANDLE ) )
+		{
+			TEST_LOG( TEST_ERROR_STR "could not create group %i\n", line, i );
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+
+
+static int test_post_processing( int line, AAF_Iface *aafi, aafiAudioTrack *audioTrack ) {
+
+	aafi->ctx.options.protools = PROTOOLS_ALL_OPT;
+
+	clock_t start = clock();
+
+	if ( protools_post_processing( aafi ) < 0 ) {
+		TEST_LOG( TEST_ERROR_STR "protools_post_processing() failed\n", line );
+		return 1;
+	}
+
+	double elapsed = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+	int items = 0;
+	int clips = 0;
+
+	aafiTimelineItem *timelineItem = NULL;
+	aafiTimelineItem *lastItem = NULL;
+
+	AAFI_foreachTrackItem( audioTrack, timelineItem ) {
+
+		int group = items / 3;
+		aafPosition_t pos = (aafPosition_t)group * TEST_GROUP_LEN;
+
+		if ( items % 3 == 1 ) {
+
+			aafiTransition *trans = aafi_timelineItemToCrossFade( timelineItem );
+
+			if ( !trans || trans->len != TEST_FADE_LEN ) {
+				TEST_LOG( TEST_ERROR_STR "item %i is not a cross-fade of length %i\n", line, items, TEST_FADE_LEN );
+				return 1;
+			}
+		}
+		else {
+
+			aafiAudioClip *audioClip = aafi_timelineItemToAudioClip( timelineItem );
+
+			clips++;
+
+			aafPosition_t expectedPos = ( items % 3 == 0 ) ? pos : pos + TEST_CLIP_LEN;
+			aafPosition_t expectedLen = ( items % 3 == 0 ) ? TEST_CLIP_LEN + TEST_FADE_LEN : TEST_CLIP_LEN + TEST_FADE_LEN + TEST_SAE_LEN;
+
+			if ( !audioClip || audioClip->pos != expectedPos || audioClip->len != expectedLen || aafi_get_clipIndex( audioClip ) != clips ) {
+				TEST_LOG( TEST_ERROR_STR "item %i is not the expected clip\n", line, items );
+				return 1;
+			}
+		}
+
+		lastItem = timelineItem;
+		items++;
+	}
+
+	if ( items != TEST_FADES * 3 || audioTrack->clipCount != clips || audioTrack->lastTimelineItem != lastItem ) {
+		TEST_LOG( TEST_ERROR_STR "track holds %i items and %i clips, expected %i items and %i clips\n", line, items, clips, TEST_FADES * 3, TEST_FADES * 2 );
+		return 1;
+	}
+
+	TEST_LOG( TEST_PASSED_STR "%i rendered fades and sample accurate edits replaced in %.3f s\n", line, TEST_FADES, elapsed );
+
+	return 0;
+}
+
+
+
+int main( int argc, char *argv[] ) {
+
+	(void)argc;
+	(void)argv;
+
+#ifdef _WIN32
+	INIT_WINDOWS_CONSOLE()
+#endif
+
+	SET_LOCALE()
+
+
+	int errors = 0;
+
+	TEST_LOG("\n");
+
+	AAF_Iface *aafi = aafi_alloc( NULL );
+
+	if ( !aafi ) {
+		TEST_LOG( TEST_ERROR_STR "aafi_alloc() failed\n", __LINE__ );
+		return 1;
+	}
+
+	static aafRational_t editRate = { 48000, 1 };
+
+	aafiAudioTrack *audioTrack = aafi_newAudioTrack( aafi );
+
+	if ( !audioTrack ) {
+		TEST_LOG( TEST_ERROR_STR "aafi_newAudioTrack() failed\n", __LINE__ );
+		aafi_release( &aafi );
+		return 1;
+	}
+
+	audioTrack->edit_rate = &editRate;
+
+	errors += test_build_track( __LINE__, aafi, audioTrack );
+
+	if ( errors == 0 ) {
+		errors += test_post_processing( __LINE__, aafi, audioTrack );
+	}
+
+	aafi_release( &aafi );
+
+	TEST_LOG("\n");
+
+	return errors;
+}
@@ -0,0 +1,696 @@
+/*
+ * Copyright (C) 2017-2024 Adrien Gesta-Fline
+ *
+ * This file is part of libAAF.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Builds a timeline of clips pointing to external WAVE and AIFF files, then
+ * renders tracks and mix and checks every sample against the expected gain,
+ * cross-fade, track volume and pan. A clip of a 44.1kHz file is rendered in the
+ * 48kHz session, resampled.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include <libaaf.h>
+
+#include "common.h"
+#include "test_util.h"
+
+
+#define TEST_WAV_FILE   "test_render.wav"
+#define TEST_AIFF_FILE  "test_render.aif"
+#define TEST_SINE_FILE  "test_render_44k.wav"
+
+#define TEST_FRAMES     20000
+
+/* first clip [0, 10000), cross-fade [8000, 10000), second clip [8000, 18000) */
+#define CLIP1_LEN       10000
+#define XFADE_LEN       2000
+#define CLIP2_POS       8000
+#define CLIP2_LEN       10000
+#define TRACK_LEN       (CLIP2_POS + CLIP2_LEN)
+
+#define TOLERANCE       1e-4
+
+/* 1kHz sine at 44.1kHz, rendered at 48kHz from essence offset SINE_OFFSET */
+#define SINE_RATE       44100
+#define SINE_FREQ       1000.0
+#define SINE_OFFSET     1234
+#define SINE_LEN        9000
+#define SINE_MARGIN     64
+#define SINE_TOLERANCE  1e-3
+
+#define TEST_PI         3.14159265358979323846
+
+
+struct renderResult {
+	float    *samples;
+	uint64_t  frames;
+	uint64_t  size;
+	unsigned  channels;
+	int       stopAt;
+	int       calls;
+};
+
+static int32_t half_scale_at( uint64_t frame, unsigned int channel, void *user );
+static int32_t sine_at( uint64_t frame, unsigned int channel, void *user );
+static int write_aiff_file( const char *path );
+static aafiAudioClip * new_clip( AAF_Iface *aafi, aafiAudioTrack *audioTrack, aafiAudioEssenceFile *audioEssenceFile, uint32_t essenceChannel, aafPosition_t pos, aafPosition_t len );
+static int render_callback( const float *samples, uint64_t frameCount, unsigned int channels, void *user );
+static double expected_track1( uint64_t t );
+static double expected_track1_automated( uint64_t t );
+static int check_samples( int line, const char *name, struct renderResult *result, unsigned int channel, double (*expected)(uint64_t), double gain );
+static int test_render_track( int line, AAF_Iface *aafi, aafiAudioTrack *track1, aafiAudioTrack *track2 );
+static int test_render_mix( int line, AAF_Iface *aafi, aafiAudioTrack *track1 );
+static int test_read_samples( int line, AAF_Iface *aafi, aafiAudioEssenceFile *aiffEssence );
+static int test_render_resampled( int line, AAF_Iface *aafi );
+
+
+
+/*
+ * Mono 16 bits WAVE file, every sample at 0.5
+ */
+
+static int32_t half_scale_at( uint64_t frame, unsigned int channel, void *user ) {
+
+	(void)frame;
+	(void)channel;
+	(void)user;
+
+	return 0x4000;
+}
+
+
+
+/*
+ * Stereo 24 bits AIFF file (big endian), left at 0.25 and right at -0.5
+ */
+
+static int write_aiff_file( const char *path ) {
+
+	unsigned char hdr[54];
+
+	/* 48000 as an 80 bits extended float */
+	static const unsigned char rate[10] = { 0x40, 0x0e, 0xbb, 0x80, 0, 0, 0, 0, 0, 0 };
+
+	memcpy( hdr, "FORM", 4 );
+	test_put_be32( hdr+4, 46 + TEST_FRAMES * 6 );
+	memcpy( hdr+8, "AIFFCOMM", 8 );
+	test_put_be32( hdr+16, 18 );
+	test_put_be16( hdr+20, 2 );
+	test_put_be32( hdr+22, TEST_FRAMES );
+	test_put_be16( hdr+26, 24 );
+	memcpy( hdr+28, rate, 10 );
+	memcpy( hdr+38, "SSND", 4 );
+	test_put_be32( hdr+42, 8 + TEST_FRAMES * 6 );
+	test_put_be32( hdr+46, 0 );
+	test_put_be32( hdr+50, 0 );
+
+	FILE *fp = fopen( path, "wb" );
+
+	if ( !fp ) {
+		return -1;
+	}
+
+	int rc = ( fwrite( hdr, 1, sizeof(hdr), fp ) == sizeof(hdr) ) ? 0 : -1;
+
+	for ( int i = 0; i < TEST_FRAMES && rc == 0; i++ ) {
+
+		static const unsigned char frame[6] = { 0x20, 0x00, 0x00, 0xc0, 0x00, 0x00 };
+
+		rc = ( fwrite( frame, 1, 6, fp ) == 6 ) ? 0 : -1;
+	}
+
+	fclose( fp );
+
+	return rc;
+}
+
+
+
+/*
+ * Mono 16 bits WAVE file at 44.1kHz, 1kHz sine at 0.5
+ */
+
+static int32_t sine_at( uint64_t frame, unsigned int channel, void *user ) {
+
+	(void)channel;
+	(void)user;
+
+	return (int32_t)lrint( 0.5 * 32768.0 * sin( 2.0 * TEST_PI * SINE_FREQ * (double)frame / SINE_RATE ) );
+}
+
+
+
+static aafiAudioClip * new_clip( AAF_Iface *aafi, aafiAudioTrack *audioTrack, aafiAudioEssenceFile *audioEssenceFile, uint32_t essenceChannel, aafPosition_t pos, aafPosition_t len ) {
+
+	aafiAudioClip *audioClip = aafi_newAudioClip( aafi, audioTrack );
+
+	if ( !audioClip ) {
+		return NULL;
+	}
+
+	audioClip->pos = pos;
+	audioClip->len = len;
+	audioClip->channels = 1;
+
+	if ( !aafi_newAudioEssencePointer( aafi, &audioClip->essencePointerList, audioEssenceFile, ( essenceChannel ) ? &essenceChannel : NULL ) ) {
+		return NULL;
+	}
+
+	return audioClip;
+}
+
+
+
+static int render_callback( const float *samples, uint64_t frameCount, unsigned int channels, void *user ) {
+
+	struct renderResult *result = user;
+
+	result->calls++;
+	result->channels = channels;
+
+	if ( result->stopAt && result->calls == result->stopAt ) {
+		return 1;
+	}
+
+	if ( (result->frames + frameCount) * channels > result->size ) {
+		return 1;
+	}
+
+	memcpy( result->samples + result->frames * channels, samples, frameCount * channels * sizeof(float) );
+
+	result->frames += frameCount;
+
+	return 0;
+}
+
+
+
+/*
+ * First clip at 0.5 with a 0.5 clip gain, linearly cross-faded with the second
+ * clip at 0.5.
+ */
+
+static double expected_track1( uint64_t t ) {
+
+	if ( t < CLIP2_POS ) {
+		return 0.25;
+	}
+
+	if ( t < CLIP1_LEN ) {
+		double x = (double)(t - CLIP2_POS) / XFADE_LEN;
+		return 0.25 * (1.0 - x) + 0.5 * x;
+	}
+
+	if ( t < TRACK_LEN ) {
+		return 0.5;
+	}
+
+	return 0.0;
+}
+
+
+
+static double expected_track1_automated( uint64_t t ) {
+
+	/* track volume goes linearly from 1 to 0 over track */
+	return expected_track1( t ) * (1.0 - (double)t / TRACK_LEN);
+}
+
+
+
+static int check_samples( int line, const char *name, struct renderResult *result, unsigned int channel, double (*expected)(uint64_t), double gain ) {
+
+	for ( uint64_t t = 0; t < result->frames; t++ ) {
+
+		double value = result->samples[t * result->channels + channel];
+		double wanted = expected( t ) * gain;
+
+		if ( fabs( value - wanted ) > TOLERANCE ) {
+			TEST_LOG( TEST_ERROR_STR "%s : channel %u sample %"PRIu64" is %f, expected %f\n", line, name, channel, t, value, wanted );
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+
+
+static int test_render_track( int line, AAF_Iface *aafi, aafiAudioTrack *track1, aafiAudioTrack *track2 ) {
+
+	int errors = 0;
+
+	struct renderResult result;
+
+	memset( &result, 0x00, sizeof(result) );
+
+	result.size = TEST_FRAMES * 2;
+	result.samples = calloc( result.size, sizeof(float) );
+
+	if ( !result.samples ) {
+		TEST_LOG( TEST_ERROR_STR "out of memory\n", line );
+		return 1;
+	}
+
+
+	/* length 0 renders up to track end */
+
+	if ( aafi_renderTrack( aafi, track1, 0, 0, NULL, render_callback, &result ) < 0 ||
+	     result.frames != TRACK_LEN || result.channels != 1 )
+	{
+		TEST_LOG( TEST_ERROR_STR "aafi_renderTrack() rendered %"PRIu64" frames of %u channels, expected %i frames of 1 channel\n", line, result.frames, result.channels, TRACK_LEN );
+		errors++;
+		goto end;
+	}
+
+	if ( check_samples( line, "track 1", &result, 0, expected_track1, 1.0 ) ) {
+		errors++;
+		goto end;
+	}
+
+	TEST_LOG( TEST_PASSED_STR "track rendered with clip gain and cross-fade\n", line );
+
+
+	/* second channel of stereo AIFF file */
+
+	memset( result.samples, 0x00, result.size * sizeof(float) );
+	result.frames = 0;
+	result.calls  = 0;
+
+	if ( aafi_renderTrack( aafi, track2, 100, 5000, NULL, render_callback, &result ) < 0 ||
+	     result.frames != 5000 )
+	{
+		TEST_LOG( TEST_ERROR_STR "aafi_renderTrack() rendered %"PRIu64" frames, expected 5000\n", line, result.frames );
+		errors++;
+		goto end;
+	}
+
+	for ( uint64_t t = 0; t < result.frames; t++ ) {
+		if ( fabs( result.samples[t] + 0.5 ) > TOLERANCE ) {
+			TEST_LOG( TEST_ERROR_STR "AIFF right channel sample %"PRIu64" is %f, expected -0.5\n", line, t, result.samples[t] );
+			errors++;
+			goto end;
+		}
+	}
+
+	TEST_LOG( TEST_PASSED_STR "single channel of a big endian multichannel file rendered\n", line );
+
+
+	/* callback stops rendering */
+
+	result.frames = 0;
+	result.calls  = 0;
+	result.stopAt = 2;
+
+	if ( aafi_renderTrack( aafi, track1, 0, 0, NULL, render_callback, &result ) == 0 || result.calls != 2 ) {
+		TEST_LOG( TEST_ERROR_STR "rendering did not stop once callback returned non zero\n", line );
+		errors++;
+		goto end;
+	}
+
+	TEST_LOG( TEST_PASSED_STR "rendering stopped by callback\n", line );
+
+end:
+	free( result.samples );
+
+	return errors;
+}
+
+
+
+static int test_render_mix( int line, AAF_Iface *aafi, aafiAudioTrack *track1 ) {
+
+	int errors = 0;
+
+	struct renderResult result;
+
+	memset( &result, 0x00, sizeof(result) );
+
+	result.size = TEST_FRAMES * 2;
+	result.samples = calloc( result.size, sizeof(float) );
+
+	if ( !result.samples ) {
+		TEST_LOG( TEST_ERROR_STR "out of memory\n", line );
+		return 1;
+	}
+
+
+	/* track 1 is soloed and panned hard left, track 2 is not heard */
+
+	aafRational_t panValue = { 0, 1 };
+
+	track1->solo = 1;
+	track1->pan = aafi_newAudioPan( aafi, AAFI_AUDIO_GAIN_CONSTANT, 0, &panValue );
+
+	/* track volume automation, from 1 to 0 */
+
+	track1->gain = aafi_newAudioGain( aafi, AAFI_AUDIO_GAIN_VARIABLE, AAFI_INTERPOL_LINEAR, NULL );
+
+	if ( !track1->pan || !track1->gain ) {
+		TEST_LOG( TEST_ERROR_STR "out of memory\n", line );
+		errors++;
+		goto end;
+	}
+
+	track1->gain->pts_cnt = 2;
+	track1->gain->time  = calloc( 2, sizeof(aafRational_t) );
+	track1->gain->value = calloc( 2, sizeof(aafRational_t) );
+
+	if ( !track1->gain->time || !track1->gain->value ) {
+		TEST_LOG( TEST_ERROR_STR "out of memory\n", line );
+		errors++;
+		goto end;
+	}
+
+	track1->gain->time[0].numerator  = 0; track1->gain->time[0].denominator  = 1;
+	track1->gain->time[1].numerator  = 1; track1->gain->time[1].denominator  = 1;
+	track1->gain->value[0].numerator = 1; track1->gain->value[0].denominator = 1;
+	track1->gain->value[1].numerator = 0; track1->gain->value[1].denominator = 1;
+
+	for ( int threads = 1; threads <= 4; threads += 3 ) {
+
+		aafi_set_option_int( aafi, "threads", threads );
+
+		memset( result.samples, 0x00, result.size * sizeof(float) );
+		result.frames = 0;
+		result.calls  = 0;
+
+		if ( aafi_renderMix( aafi, 2, 0, 0, NULL, render_callback, &result ) < 0 ||
+		     result.frames != TRACK_LEN || result.channels != 2 )
+		{
+			TEST_LOG( TEST_ERROR_STR "aafi_renderMix() rendered %"PRIu64" frames of %u channels, expected %i frames of 2 channels\n", line, result.frames, result.channels, TRACK_LEN );
+			errors++;
+			goto end;
+		}
+
+		if ( check_samples( line, "mix", &result, 0, expected_track1_automated, 1.0 ) ||
+		     check_samples( line, "mix", &result, 1, expected_track1_automated, 0.0 ) )
+		{
+			errors++;
+			goto end;
+		}
+	}
+
+	TEST_LOG( TEST_PASSED_STR "mix rendered with solo, pan and track volume automation\n", line );
+
+
+	/* centered mono track, equal power */
+
+	track1->pan->value[0].numerator = 1;
+	track1->pan->value[0].denominator = 2;
+
+	memset( result.samples, 0x00, result.size * sizeof(float) );
+	result.frames = 0;
+	result.calls  = 0;
+
+	if ( aafi_renderMix( aafi, 2, 0, 0, NULL, render_callback, &result ) < 0 ||
+	     check_samples( line, "mix", &result, 0, expected_track1_automated, sqrt(0.5) ) ||
+	     check_samples( line, "mix", &result, 1, expected_track1_automated, sqrt(0.5) ) )
+	{
+		errors++;
+		goto end;
+	}
+
+	TEST_LOG( TEST_PASSED_STR "centered mono track rendered at -3dB on both channels\n", line );
+
+end:
+	free( result.samples );
+
+	return errors;
+}
+
+
+
+/*
+ * Samples of an external big endian file are read little endian, either all
+ * channels interleaved or a single one, and reading stops at audio data end.
+ */
+
+static int test_read_samples( int line, AAF_Iface *aafi, aafiAudioEssenceFile *aiffEssence ) {
+
+	static const unsigned char stereo[6] = { 0x00, 0x00, 0x20, 0x00, 0x00, 0xc0 };
+
+	unsigned char buf[100 * 6];
+
+	uint64_t read = aafi_readAudioSamples( aafi, aiffEssence, TEST_FRAMES - 10, 100, 0, buf );
+
+	if ( read != 10 ) {
+		TEST_LOG( TEST_ERROR_STR "aafi_readAudioSamples() read %"PRIu64" frames, expected 10\n", line, read );
+		return 1;
+	}
+
+	for ( int i = 0; i < 10; i++ ) {
+		if ( memcmp( buf + i*6, stereo, 6 ) != 0 ) {
+			TEST_LOG( TEST_ERROR_STR "aafi_readAudioSamples() frame %i does not match\n", line, i );
+			return 1;
+		}
+	}
+
+	read = aafi_readAudioSamples( aafi, aiffEssence, 1000, 100, 0x2, buf );
+
+	if ( read != 100 ) {
+		TEST_LOG( TEST_ERROR_STR "aafi_readAudioSamples() read %"PRIu64" frames of right channel, expected 100\n", line, read );
+		return 1;
+	}
+
+	for ( int i = 0; i < 100; i++ ) {
+		if ( memcmp( buf + i*3, stereo + 3, 3 ) != 0 ) {
+			TEST_LOG( TEST_ERROR_STR "aafi_readAudioSamples() right channel sample %i does not match\n", line, i );
+			return 1;
+		}
+	}
+
+	TEST_LOG( TEST_PASSED_STR "samples of a single channel read from a big endian file\n", line );
+
+	return 0;
+}
+
+
+
+/*
+ * A clip of a 44.1kHz essence is resampled to the 48kHz session rate, its
+ * essence offset being converted from edit rate straight to session rate.
+ * Samples must follow the sine, apart from the clip edges.
+ */
+
+static int test_render_resampled( int line, AAF_Iface *aafi ) {
+
+	static aafRational_t editRate = { 48000, 1 };
+	static aafMobID_t sineMobID = { .material = { .Data1 = 3 } };
+
+	int errors = 0;
+
+	struct renderResult result;
+
+	memset( &result, 0x00, sizeof(result) );
+
+	result.size = SINE_LEN;
+	result.samples = calloc( result.size, sizeof(float) );
+
+	if ( !result.samples ) {
+		TEST_LOG( TEST_ERROR_STR "out of memory\n", line );
+		return 1;
+	}
+
+	aafiAudioEssenceFile *sineEssence = test_new_essence( aafi, &sineMobID, TEST_SINE_FILE, AAFI_ESSENCE_TYPE_WAVE, SINE_RATE, 1, 16, TEST_FRAMES );
+	aafiAudioTrack *track = aafi_newAudioTrack( aafi );
+
+	if ( !sineEssence || !track ) {
+		TEST_LOG( TEST_ERROR_STR "could not build resampled track\n", line );
+		errors++;
+		goto end;
+	}
+
+	track->edit_rate = &editRate;
+	track->format = AAFI_TRACK_FORMAT_MONO;
+	track->current_pos = SINE_LEN;
+
+	aafiAudioClip *clip = new_clip( aafi, track, sineEssence, 0, 0, SINE_LEN );
+
+	if ( !clip ) {
+		TEST_LOG( TEST_ERROR_STR "could not build resampled track\n", line );
+		errors++;
+		goto end;
+	}
+
+	clip->essence_offset = SINE_OFFSET;
+
+	if ( aafi_buildRangeIndexes( aafi ) < 0 ) {
+		TEST_LOG( TEST_ERROR_STR "aafi_buildRangeIndexes() failed\n", line );
+		errors++;
+		goto end;
+	}
+
+	if ( aafi_renderTrack( aafi, track, 0, 0, NULL, render_callback, &result ) < 0 || result.frames != SINE_LEN ) {
+		TEST_LOG( TEST_ERROR_STR "aafi_renderTrack() rendered %"PRIu64" frames of resampled track, expected %i\n", line, result.frames, SINE_LEN );
+		errors++;
+		goto end;
+	}
+
+	for ( uint64_t t = SINE_MARGIN; t < SINE_LEN - SINE_MARGIN; t++ ) {
+
+		double wanted = 0.5 * sin( 2.0 * TEST_PI * SINE_FREQ * (double)(t + SINE_OFFSET) / 48000.0 );
+
+		if ( fabs( result.samples[t] - wanted ) > SINE_TOLERANCE ) {
+			TEST_LOG( TEST_ERROR_STR "resampled track sample %"PRIu64" is %f, expected %f\n", line, t, result.samples[t], wanted );
+			errors++;
+			goto end;
+		}
+	}
+
+	TEST_LOG( TEST_PASSED_STR "44.1kHz clip rendered resampled to 48kHz\n", line );
+
+end:
+	free( result.samples );
+
+	return errors;
+}
+
+
+int main( int argc, char *argv[] ) {
+
+	(void)argc;
+	(void)argv;
+
+#ifdef _WIN32
+	INIT_WINDOWS_CONSOLE()
+#endif
+
+	SET_LOCALE()
+
+
+	int errors = 0;
+
+	static aafRational_t editRate = { 48000, 1 };
+	static aafMobID_t wavMobID  = { .material = { .Data1 = 1 } };
+	static aafMobID_t aiffMobID = { .material = { .Data1 = 2 } };
+
+	TEST_LOG("\n");
+
+	AAF_Iface *aafi = aafi_alloc( NULL );
+
+	if ( !aafi ) {
+		TEST_LOG( TEST_ERROR_STR "aafi_alloc() failed\n", __LINE__ );
+		return 1;
+	}
+
+	if ( test_write_wav_file( TEST_WAV_FILE, 48000, 1, 16, TEST_FRAMES, half_scale_at, NULL ) < 0 ||
+	     write_aiff_file( TEST_AIFF_FILE ) < 0 ||
+	     test_write_wav_file( TEST_SINE_FILE, SINE_RATE, 1, 16, TEST_FRAMES, sine_at, NULL ) < 0 )
+	{
+		TEST_LOG( TEST_ERROR_STR "could not write test files\n", __LINE__ );
+		errors++;
+		goto end;
+	}
+
+	aafiAudioEssenceFile *wavEssence  = test_new_essence( aafi, &wavMobID,  TEST_WAV_FILE,  AAFI_ESSENCE_TYPE_WAVE, 48000, 1, 16, TEST_FRAMES );
+	aafiAudioEssenceFile *aiffEssence = test_new_essence( aafi, &aiffMobID, TEST_AIFF_FILE, AAFI_ESSENCE_TYPE_AIFC, 48000, 2, 24, TEST_FRAMES );
+
+	if ( !wavEssence || !aiffEssence ) {
+		TEST_LOG( TEST_ERROR_STR "aafi_newAudioEssence() failed\n", __LINE__ );
+		errors++;
+		goto end;
+	}
+
+	aafi->Audio->samplerate = 48000;
+	aafi->Audio->samplerateRational = wavEssence->samplerateRational;
+
+
+	/* track 1 : clip, cross-fade, clip */
+
+	aafiAudioTrack *track1 = aafi_newAudioTrack( aafi );
+	aafiAudioTrack *track2 = aafi_newAudioTrack( aafi );
+
+	if ( !track1 || !track2 ) {
+		TEST_LOG( TEST_ERROR_STR "aafi_newAudioTrack() failed\n", __LINE__ );
+		errors++;
+		goto end;
+	}
+
+	track1->edit_rate = &editRate;
+	track1->format = AAFI_TRACK_FORMAT_MONO;
+	track1->current_pos = TRACK_LEN;
+
+	aafRational_t clipGain = { 1, 2 };
+
+	aafiAudioClip *clip1 = new_clip( aafi, track1, wavEssence, 0, 0, CLIP1_LEN );
+	aafiTransition *xfade = aafi_newTransition( aafi, track1 );
+	aafiAudioClip *clip2 = new_clip( aafi, track1, wavEssence, 0, CLIP2_POS, CLIP2_LEN );
+
+	if ( !clip1 || !xfade || !clip2 ) {
+		TEST_LOG( TEST_ERROR_STR "could not build track 1\n", __LINE__ );
+		errors++;
+		goto end;
+	}
+
+	clip1->gain = aafi_newAudioGain( aafi, AAFI_AUDIO_GAIN_CONSTANT, 0, &clipGain );
+	clip2->essence_offset = 500;
+
+	xfade->flags = AAFI_TRANS_XFADE | AAFI_INTERPOL_LINEAR;
+	xfade->len = XFADE_LEN;
+	xfade->value_a[0].numerator = 0;
+	xfade->value_a[0].denominator = 0;
+	xfade->value_a[1].numerator = 1;
+	xfade->value_a[1].denominator = 1;
+
+
+	/* track 2 : right channel of a stereo file */
+
+	track2->edit_rate = &editRate;
+	track2->current_pos = TEST_FRAMES;
+
+	if ( !new_clip( aafi, track2, aiffEssence, 2, 0, TEST_FRAMES ) ) {
+		TEST_LOG( TEST_ERROR_STR "could not build track 2\n", __LINE__ );
+		errors++;
+		goto end;
+	}
+
+	if ( aafi_buildRangeIndexes( aafi ) < 0 ) {
+		TEST_LOG( TEST_ERROR_STR "aafi_buildRangeIndexes() failed\n", __LINE__ );
+		errors++;
+		goto end;
+	}
+
+	errors += test_read_samples( __LINE__, aafi, aiffEssence );
+	errors += test_render_track( __LINE__, aafi, track1, track2 );
+
+	if ( errors == 0 ) {
+		errors += test_render_mix( __LINE__, aafi, track1 );
+	}
+
+	if ( errors == 0 ) {
+		errors += test_render_resampled( __LINE__, aafi );
+	}
+
+end:
+	remove( TEST_WAV_FILE );
+	remove( TEST_AIFF_FILE );
+	remove( TEST_SINE_FILE );
+
+	aafi_release( &aafi );
+
+	TEST_LOG("\n");
+
+	return errors;
+}
@@ -0,0 +1,525 @@
+/*
+ * Copyright (C) 2017-2024 Adrien Gesta-Fline
+ *
+ * This file is part of libAAF.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Builds a sparse CFB file (4kB sectors) holding a single stream larger than
+ * 4GB, then extracts it as an embedded essence and checks an RF64 file with a
+ * valid ds64 chunk was written. A short range past 4GB is also extracted, to
+ * check the plain RIFF header and the data offsets of the stream.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include <libaaf.h>
+
+#include "common.h"
+
+
+#define TEST_CFB_FILE     "test_rf64.aaf"
+
+#define SECT_SIZE         4096
+#define SECT_IDS          (SECT_SIZE / sizeof(cfbSectorID_t))
+
+/* stereo 24 bits, a bit more than 4GB */
+#define STREAM_CHANNELS   2
+#define STREAM_SAMPLESIZE 24
+#define STREAM_BLOCKALIGN (STREAM_CHANNELS * STREAM_SAMPLESIZE / 8)
+#define STREAM_SIZE       (((UINT64_C(0xffffffff) / STREAM_BLOCKALIGN) + 10000) * STREAM_BLOCKALIGN)
+
+#define STREAM_SECTS      ((STREAM_SIZE + SECT_SIZE - 1) / SECT_SIZE)
+
+/* directory, FAT sectors, a DIFAT sector, then stream data */
+#define FAT_SECTS         1026 /* enough to map every sector, DIFAT included */
+#define DIR_SECT          0
+#define FAT_FIRST_SECT    1
+#define DIFAT_SECT        (FAT_FIRST_SECT + FAT_SECTS)
+#define DATA_FIRST_SECT   (DIFAT_SECT + 1)
+
+
+static const uint64_t markers[] = {
+	0,
+	UINT64_C(0x7fffffff),
+	UINT64_C(0x100000000) + 1234,
+	STREAM_SIZE - 8
+};
+
+
+static int file_seek( FILE *fp, uint64_t offset );
+static int write_sector( FILE *fp, uint64_t sect, const void *data );
+static int build_cfb_file( const char *path );
+static uint64_t le64( const unsigned char *p );
+static int read_file( const char *path, uint64_t offset, void *buf, size_t len );
+static uint64_t file_size( const char *path );
+static int find_data_chunk( const char *path, uint64_t *dataOffset, uint32_t *dataSize );
+static int test_rf64( int line, AAF_Iface *aafi, aafiAudioEssenceFile *audioEssenceFile );
+static int test_range_past_4gb( int line, AAF_Iface *aafi, aafiAudioEssenceFile *audioEssenceFile );
+
+
+
+static int file_seek( FILE *fp, uint64_t offset ) {
+
+#ifdef _WIN32
+	return _fseeki64( fp, (__int64)offset, SEEK_SET );
+#else
+	return fseeko( fp, (off_t)offset, SEEK_SET );
+#endif
+}
+
+
+
+static int write_sector( FILE *fp, uint64_t sect, const void *data ) {
+
+	/* header takes the first sector */
+	if ( file_seek( fp, (sect + 1) * SECT_SIZE ) < 0 ) {
+		return -1;
+	}
+
+	return ( fwrite( data, SECT_SIZE, 1, fp ) == 1 ) ? 0 : -1;
+}
+
+
+
+static int build_cfb_file( const char *path ) {
+
+	unsigned char sector[SECT_SIZE];
+	cfbSectorID_t *ids = (cfbSectorID_t*)(void*)sector;
+
+	FILE *fp = fopen( path, "wb" );
+
+	if ( !fp ) {
+		return -1;
+	}
+
+	int rc = -1;
+
+	/* header */
+	cfbHeader hdr;
+	memset( &hdr, 0x00, sizeof(hdr) );
+
+	hdr._abSig               = 0xe11ab1a1e011cfd0;
+	hdr._uMinorVersion       = 0x3e;
+	hdr._uDllVersion         = 4;
+	hdr._uByteOrder          = 0xfffe;
+	hdr._uSectorShift        = 12;
+	hdr._uMiniSectorShift    = 6;
+	hdr._csectDir            = 1;
+	hdr._csectFat            = FAT_SECTS;
+	hdr._sectDirStart        = DIR_SECT;
+	hdr._ulMiniSectorCutoff  = 4096;
+	hdr._sectMiniFatStart    = CFB_END_OF_CHAIN;
+	hdr._csectMiniFat        = 0;
+	hdr._sectDifStart        = DIFAT_SECT;
+	hdr._csectDif            = 1;
+
+	for ( uint32_t i = 0; i < 109; i++ ) {
+		hdr._sectFat[i] = FAT_FIRST_SECT + i;
+	}
+
+	memset( sector, 0x00, sizeof(sector) );
+	memcpy( sector, &hdr, sizeof(hdr) );
+
+	if ( fwrite( sector, SECT_SIZE, 1, fp ) != 1 ) {
+		goto end;
+	}
+
+	/* directory : Root Entry, and a single stream */
+	cfbNode nodes[SECT_SIZE / sizeof(cfbNode)];
+	memset( nodes, 0x00, sizeof(nodes) );
+
+	for ( size_t i = 0; i < sizeof(nodes)/sizeof(nodes[0]); i++ ) {
+		nodes[i]._sidLeftSib  = CFB_NO_STREAM;
+		nodes[i]._sidRightSib = CFB_NO_STREAM;
+		nodes[i]._sidChild    = CFB_NO_STREAM;
+	}
+
+	const char *names[] = { "Root Entry", "Data-1" };
+
+	for ( int n = 0; n < 2; n++ ) {
+		size_t len = strlen( names[n] );
+		for ( size_t i = 0; i < len; i++ ) {
+			nodes[n]._ab[i] = (uint16_t)names[n][i];
+		}
+		nodes[n]._cb = (uint16_t)((len + 1) * 2);
+	}
+
+	nodes[0]._mse         = STGTY_ROOT;
+	nodes[0]._sidChild    = 1;
+	nodes[0]._sectStart   = CFB_END_OF_CHAIN;
+
+	nodes[1]._mse         = STGTY_STREAM;
+	nodes[1]._sectStart   = DATA_FIRST_SECT;
+	nodes[1]._ulSizeLow   = (uint32_t)(STREAM_SIZE & 0xffffffff);
+	nodes[1]._ulSizeHigh  = (uint32_t)(STREAM_SIZE >> 32);
+
+	if ( write_sector( fp, DIR_SECT, nodes ) < 0 ) {
+		goto end;
+	}
+
+	/* FAT */
+	for ( uint64_t f = 0; f < FAT_SECTS; f++ ) {
+
+		for ( uint64_t i = 0; i < SECT_IDS; i++ ) {
+
+			uint64_t id = f * SECT_IDS + i;
+
+			if ( id == DIR_SECT ) {
+				ids[i] = CFB_END_OF_CHAIN;
+			}
+			else if ( id >= FAT_FIRST_SECT && id < DIFAT_SECT ) {
+				ids[i] = CFB_FAT_SECT;
+			}
+			else if ( id == DIFAT_SECT ) {
+				ids[i] = CFB_DIFAT_SECT;
+			}
+			else if ( id >= DATA_FIRST_SECT && id < DATA_FIRST_SECT + STREAM_SECTS - 1 ) {
+				ids[i] = (cfbSectorID_t)(id + 1);
+			}
+			else if ( id == DATA_FIRST_SECT + STREAM_SECTS - 1 ) {
+				ids[i] = CFB_END_OF_CHAIN;
+			}
+			else {
+				ids[i] = CFB_FREE_SECT;
+			}
+		}
+
+		if ( write_sector( fp, FAT_FIRST_SECT + f, sector ) < 0 ) {
+			goto end;
+		}
+	}
+
+	/* DIFAT, holding the FAT sectors the header could not */
+	for ( uint64_t i = 0; i < SECT_IDS; i++ ) {
+		ids[i] = ( 109 + i < FAT_SECTS ) ? (cfbSectorID_t)(FAT_FIRST_SECT + 109 + i) : CFB_FREE_SECT;
+	}
+
+	ids[SECT_IDS-1] = CFB_END_OF_CHAIN;
+
+	if ( write_sector( fp, DIFAT_SECT, sector ) < 0 ) {
+		goto end;
+	}
+
+	/* sparse stream data, only holding a few markers */
+	memset( sector, 0x00, sizeof(sector) );
+
+	if ( write_sector( fp, DATA_FIRST_SECT + STREAM_SECTS - 1, sector ) < 0 ) {
+		goto end;
+	}
+
+	for ( size_t i = 0; i < sizeof(markers)/sizeof(markers[0]); i++ ) {
+
+		uint64_t marker = markers[i] ^ UINT64_C(0xa5a5a5a5a5a5a5a5);
+
+		if ( file_seek( fp, (DATA_FIRST_SECT + 1) * SECT_SIZE + markers[i] ) < 0 ||
+		     fwrite( &marker, sizeof(marker), 1, fp ) != 1 )
+		{
+			goto end;
+		}
+	}
+
+	rc = 0;
+
+end:
+	if ( fclose( fp ) != 0 ) {
+		rc = -1;
+	}
+
+	return rc;
+}
+
+
+
+static uint64_t le64( const unsigned char *p ) {
+
+	uint64_t v = 0;
+
+	for ( int i = 7; i >= 0; i-- ) {
+		v = (v << 8) | p[i];
+	}
+
+	return v;
+}
+
+
+
+static int read_file( const char *path, uint64_t offset, void *buf, size_t len ) {
+
+	FILE *fp = fopen( path, "rb" );
+
+	if ( !fp ) {
+		return -1;
+	}
+
+	int rc = ( file_seek( fp, offset ) == 0 && fread( buf, len, 1, fp ) == 1 ) ? 0 : -1;
+
+	fclose( fp );
+
+	return rc;
+}
+
+
+
+static uint64_t file_size( const char *path ) {
+
+	FILE *fp = fopen( path, "rb" );
+
+	if ( !fp ) {
+		return 0;
+	}
+
+	uint64_t size = 0;
+
+#ifdef _WIN32
+	if ( _fseeki64( fp, 0, SEEK_END ) == 0 ) {
+		__int64 pos = _ftelli64( fp );
+#else
+	if ( fseeko( fp, 0, SEEK_END ) == 0 ) {
+		off_t pos = ftello( fp );
+#endif
+		size = ( pos > 0 ) ? (uint64_t)pos : 0;
+	}
+
+	fclose( fp );
+
+	return size;
+}
+
+
+
+static int find_data_chunk( const char *path, uint64_t *dataOffset, uint32_t *dataSize ) {
+
+	unsigned char ck[8];
+	uint64_t offset = 12;
+
+	while ( read_file( path, offset, ck, sizeof(ck) ) == 0 ) {
+
+		uint32_t cksz = (uint32_t)ck[4] | (uint32_t)ck[5] << 8 | (uint32_t)ck[6] << 16 | (uint32_t)ck[7] << 24;
+
+		if ( memcmp( ck, "data", 4 ) == 0 ) {
+			*dataOffset = offset + 8;
+			*dataSize = cksz;
+			return 0;
+		}
+
+		offset += 8 + cksz + (cksz & 1);
+	}
+
+	return -1;
+}
+
+
+
+static int test_rf64( int line, AAF_Iface *aafi, aafiAudioEssenceFile *audioEssenceFile ) {
+
+	char *path = NULL;
+
+	int errors = 0;
+
+	if ( aafi_extractAudioEssenceFile( aafi, audioEssenceFile, AAFI_EXTRACT_DEFAULT, ".", 0, 0, NULL, &path ) < 0 || !path ) {
+		TEST_LOG( TEST_ERROR_STR "could not extract essence larger than 4GB\n", line );
+		return 1;
+	}
+
+	/* RIFF header, then ds64 chunk : riff size, data size, sample count, table length */
+	unsigned char hdr[12 + 8 + 28];
+
+	if ( read_file( path, 0, hdr, sizeof(hdr) ) < 0 ) {
+		TEST_LOG( TEST_ERROR_STR "could not read %s\n", line, path );
+		errors++;
+		goto end;
+	}
+
+	uint64_t filesize = file_size( path );
+	uint64_t dataOffset = 0;
+	uint32_t dataSize = 0;
+
+	if ( memcmp( hdr, "RF64\xff\xff\xff\xffWAVE", 12 ) != 0 ||
+	     memcmp( hdr + 12, "ds64\x1c\x00\x00\x00", 8 ) != 0 )
+	{
+		TEST_LOG( TEST_ERROR_STR "%s is not an RF64 file starting with a ds64 chunk\n", line, path );
+		errors++;
+		goto end;
+	}
+
+	if ( le64( hdr + 20 ) != filesize - 8 ||
+	     le64( hdr + 28 ) != STREAM_SIZE ||
+	     le64( hdr + 36 ) != STREAM_SIZE / STREAM_BLOCKALIGN )
+	{
+		TEST_LOG( TEST_ERROR_STR "wrong ds64 sizes : riff %"PRIu64", data %"PRIu64", samples %"PRIu64"\n", line, le64( hdr + 20 ), le64( hdr + 28 ), le64( hdr + 36 ) );
+		errors++;
+		goto end;
+	}
+
+	if ( find_data_chunk( path, &dataOffset, &dataSize ) < 0 ||
+	     dataSize != 0xffffffff ||
+	     dataOffset + STREAM_SIZE != filesize )
+	{
+		TEST_LOG( TEST_ERROR_STR "wrong data chunk in %s\n", line, path );
+		errors++;
+		goto end;
+	}
+
+	for ( size_t i = 0; i < sizeof(markers)/sizeof(markers[0]); i++ ) {
+
+		uint64_t marker = 0;
+
+		if ( read_file( path, dataOffset + markers[i], &marker, sizeof(marker) ) < 0 ||
+		     marker != (markers[i] ^ UINT64_C(0xa5a5a5a5a5a5a5a5)) )
+		{
+			TEST_LOG( TEST_ERROR_STR "wrong audio data at offset %"PRIu64"\n", line, markers[i] );
+			errors++;
+			goto end;
+		}
+	}
+
+	TEST_LOG( TEST_PASSED_STR "%"PRIu64" bytes essence extracted to RF64\n", line, (uint64_t)STREAM_SIZE );
+
+end:
+	remove( path );
+	free( path );
+
+	return errors;
+}
+
+
+
+static int test_range_past_4gb( int line, AAF_Iface *aafi, aafiAudioEssenceFile *audioEssenceFile ) {
+
+	char *path = NULL;
+
+	int errors = 0;
+
+	uint64_t sampleOffset = markers[2] / STREAM_BLOCKALIGN;
+	uint64_t markerOffset = markers[2] - sampleOffset * STREAM_BLOCKALIGN;
+
+	if ( aafi_extractAudioEssenceFile( aafi, audioEssenceFile, AAFI_EXTRACT_WAV, ".", sampleOffset, 1000, "test_rf64_range", &path ) < 0 || !path ) {
+		TEST_LOG( TEST_ERROR_STR "could not extract essence range past 4GB\n", line );
+		return 1;
+	}
+
+	unsigned char hdr[12];
+	uint64_t dataOffset = 0;
+	uint32_t dataSize = 0;
+	uint64_t marker = 0;
+
+	if ( read_file( path, 0, hdr, sizeof(hdr) ) < 0 ||
+	     memcmp( hdr, "RIFF", 4 ) != 0 ||
+	     find_data_chunk( path, &dataOffset, &dataSize ) < 0 ||
+	     dataSize != 1000 * STREAM_BLOCKALIGN )
+	{
+		TEST_LOG( TEST_ERROR_STR "%s is not a RIFF file of 1000 samples\n", line, path );
+		errors++;
+		goto end;
+	}
+
+	if ( read_file( path, dataOffset + markerOffset, &marker, sizeof(marker) ) < 0 ||
+	     marker != (markers[2] ^ UINT64_C(0xa5a5a5a5a5a5a5a5)) )
+	{
+		TEST_LOG( TEST_ERROR_STR "wrong audio data in range past 4GB\n", line );
+		errors++;
+		goto end;
+	}
+
+	TEST_LOG( TEST_PASSED_STR "essence range past 4GB extracted to RIFF\n", line );
+
+end:
+	remove( path );
+	free( path );
+
+	return errors;
+}
+
+
+
+int main( int argc, char *argv[] ) {
+
+	(void)argc;
+	(void)argv;
+
+#ifdef _WIN32
+	INIT_WINDOWS_CONSOLE()
+#endif
+
+	SET_LOCALE()
+
+
+	int errors = 0;
+
+	static aafRational_t editRate = { 48000, 1 };
+	static aafMobID_t mobID;
+
+	TEST_LOG("\n");
+
+	AAF_Iface *aafi = aafi_alloc( NULL );
+
+	if ( !aafi ) {
+		TEST_LOG( TEST_ERROR_STR "aafi_alloc() failed\n", __LINE__ );
+		return 1;
+	}
+
+	if ( build_cfb_file( TEST_CFB_FILE ) < 0 ) {
+		TEST_LOG( TEST_ERROR_STR "could not write %s\n", __LINE__, TEST_CFB_FILE );
+		errors++;
+		goto end;
+	}
+
+	if ( cfb_load_file( &aafi->aafd->cfbd, TEST_CFB_FILE ) < 0 || aafi->aafd->cfbd->nodes_cnt < 2 ) {
+		TEST_LOG( TEST_ERROR_STR "could not load %s\n", __LINE__, TEST_CFB_FILE );
+		errors++;
+		goto end;
+	}
+
+	aafi->aafd->Identification.ProductName = laaf_util_c99strdup( "libAAF" );
+	aafi->aafd->Identification.ProductVersionString = laaf_util_c99strdup( LIBAAF_VERSION );
+	aafi->compositionName = laaf_util_c99strdup( "test_rf64" );
+
+	aafiAudioEssenceFile *audioEssenceFile = aafi_newAudioEssence( aafi, &mobID, 1 );
+
+	if ( !audioEssenceFile ) {
+		TEST_LOG( TEST_ERROR_STR "aafi_newAudioEssence() failed\n", __LINE__ );
+		errors++;
+		goto end;
+	}
+
+	audioEssenceFile->is_embedded = 1;
+	audioEssenceFile->node = &aafi->aafd->cfbd->nodes[1];
+	audioEssenceFile->type = AAFI_ESSENCE_TYPE_PCM;
+	audioEssenceFile->channels = STREAM_CHANNELS;
+	audioEssenceFile->samplesize = STREAM_SAMPLESIZE;
+	audioEssenceFile->samplerate = 48000;
+	audioEssenceFile->samplerateRational->numerator = 48000;
+	audioEssenceFile->sourceMobSlotEditRate = &editRate;
+	audioEssenceFile->length = STREAM_SIZE / STREAM_BLOCKALIGN;
+	audioEssenceFile->name = laaf_util_c99strdup( "test_rf64" );
+	audioEssenceFile->unique_name = laaf_util_c99strdup( "test_rf64" );
+
+	errors += test_range_past_4gb( __LINE__, aafi, audioEssenceFile );
+	errors += test_rf64( __LINE__, aafi, audioEssenceFile );
+
+end:
+	remove( TEST_CFB_FILE );
+
+	aafi_release( &aafi );
+
+	TEST_LOG("\n");
+
+	return errors;
+}
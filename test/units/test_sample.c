@@ -0,0 +1,836 @@
+/*
+ * Copyright (C) 2017-2024 Adrien Gesta-Fline
+ *
+ * This file is part of libAAF.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Checks laaf_sample_swap_bytes() against a plain byte reversal, for every
+ * sample size, buffer alignment and length around vector block sizes. Then
+ * compares the time it takes to convert and write AIFC samples with the
+ * former per-sample loop (one fwrite() per sample), the scalar path and the
+ * vector path, both followed by a single fwrite().
+ *
+ * Checks laaf_sample_convert() vector path gives the exact same samples as the
+ * scalar path, dithered or not, for every pair of formats, then checks a few
+ * known conversions and compares scalar and vector conversion times.
+ *
+ * Checks laaf_sample_deinterleave() against a plain per-sample copy, for every
+ * channel count up to 8, sample size and a range of lengths, with some of the
+ * channels skipped, and compares scalar and vector de-interleave times.
+ *
+ * Checks laaf_sample_minmax() finds lowest and highest values wherever they are
+ * in buffers of lengths around vector block sizes.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include <math.h>
+
+#include <libaaf.h>
+#include <libaaf/sample.h>
+
+#include "common.h"
+
+
+#define TEST_MAX_LEN    512
+#define BENCH_DATA_SIZE (16*1024*1024)
+
+#define TEST_CONVERT_MAX 600 /* more than a conversion block */
+
+#define TEST_DEINTERLEAVE_MAX_FRAMES   70
+#define TEST_DEINTERLEAVE_MAX_CHANNELS 8
+
+#define TEST_MINMAX_MAX_LEN 40
+
+#define TEST_PI 3.14159265358979323846
+
+
+static void reference_swap( unsigned char *buf, size_t len, unsigned int samplesize );
+static int test_swap( int line, unsigned int samplesize );
+static double bench_sample_loop( unsigned char *data, size_t len, unsigned int samplesize, FILE *fp );
+static double bench_block( unsigned char *data, size_t len, unsigned int samplesize, FILE *fp, int scalar );
+static int bench_swap( int line, unsigned int samplesize );
+static void fill_samples( unsigned char *buf, size_t count, enum laafSampleFormat format, uint32_t seed );
+static int test_convert_paths( int line );
+static int test_convert_values( int line );
+static int bench_convert( int line, enum laafSampleFormat srcFormat, enum laafSampleFormat dstFormat, int dithered );
+static int test_deinterleave( int line );
+static int bench_deinterleave( int line, unsigned int channels, unsigned int samplesize );
+static int test_minmax( int line );
+static int test_resampler( int line, uint64_t srcRate, uint64_t dstRate, uint64_t dstRateDen );
+static double resampled_level( struct laafResampler *rs, uint64_t srcRate, double freq, float *in, size_t inLen, float *out, size_t outLen );
+static int test_resampler_stopband( int line, uint64_t srcRate, uint64_t dstRate, uint64_t dstRateDen );
+
+
+static const char *format_names[] = { "s16", "s24", "s32", "f32" };
+
+
+
+static void reference_swap( unsigned char *buf, size_t len, unsigned int samplesize ) {
+
+	for ( size_t i = 0; i + samplesize <= len; i += samplesize ) {
+		for ( unsigned int b = 0; b < samplesize/2; b++ ) {
+			unsigned char tmp = buf[i+b];
+			buf[i+b] = buf[i+samplesize-1-b];
+			buf[i+samplesize-1-b] = tmp;
+		}
+	}
+}
+
+
+
+static int test_swap( int line, unsigned int samplesize ) {
+
+	unsigned char src[TEST_MAX_LEN+8];
+	unsigned char ref[TEST_MAX_LEN+8];
+	unsigned char buf[TEST_MAX_LEN+8];
+
+	for ( size_t i = 0; i < sizeof(src); i++ ) {
+		src[i] = (unsigned char)(i * 7 + 3);
+	}
+
+	for ( size_t align = 0; align < 4; align++ ) {
+
+		for ( size_t len = 0; len <= TEST_MAX_LEN; len++ ) {
+
+			memcpy( ref, src, sizeof(src) );
+			memcpy( buf, src, sizeof(src) );
+
+			reference_swap( ref + align, len, samplesize );
+			laaf_sample_swap_bytes( buf + align, len, samplesize );
+
+			if ( memcmp( ref, buf, sizeof(buf) ) != 0 ) {
+				TEST_LOG( TEST_ERROR_STR "%u bytes samples : swap of %zu bytes at alignment %zu differs from reference\n", line, samplesize, len, align );
+				return 1;
+			}
+
+			memcpy( buf, src, sizeof(src) );
+
+			laaf_sample_swap_bytes_scalar( buf + align, len, samplesize );
+
+			if ( memcmp( ref, buf, sizeof(buf) ) != 0 ) {
+				TEST_LOG( TEST_ERROR_STR "%u bytes samples : scalar swap of %zu bytes at alignment %zu differs from reference\n", line, samplesize, len, align );
+				return 1;
+			}
+		}
+	}
+
+	TEST_LOG( TEST_PASSED_STR "%u bytes samples swapped\n", line, samplesize );
+
+	return 0;
+}
+
+
+
+static double bench_sample_loop( unsigned char *data, size_t len, unsigned int samplesize, FILE *fp ) {
+
+	/* previous aafi_extractAudioEssenceFile() AIFC to WAVE loop */
+	unsigned char sample[4];
+
+	clock_t start = clock();
+
+	for ( size_t i = 0; i + samplesize <= len; i += samplesize ) {
+
+		for ( unsigned int b = 0; b < samplesize; b++ ) {
+			sample[b] = data[i+samplesize-1-b];
+		}
+
+		fwrite( sample, samplesize, 1, fp );
+	}
+
+	return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+
+
+static double bench_block( unsigned char *data, size_t len, unsigned int samplesize, FILE *fp, int scalar ) {
+
+	clock_t start = clock();
+
+	if ( scalar ) {
+		laaf_sample_swap_bytes_scalar( data, len, samplesize );
+	} else {
+		laaf_sample_swap_bytes( data, len, samplesize );
+	}
+
+	fwrite( data, len, 1, fp );
+
+	return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+
+
+static int bench_swap( int line, unsigned int samplesize ) {
+
+	size_t len = BENCH_DATA_SIZE - (BENCH_DATA_SIZE % samplesize);
+
+	unsigned char *data = malloc( len );
+	FILE *fp = tmpfile();
+
+	if ( !data || !fp ) {
+		TEST_LOG( TEST_ERROR_STR "could not allocate benchmark data\n", line );
+		free( data );
+		if ( fp ) fclose( fp );
+		return 1;
+	}
+
+	for ( size_t i = 0; i < len; i++ ) {
+		data[i] = (unsigned char)i;
+	}
+
+	double loop   = bench_sample_loop( data, len, samplesize, fp );
+	rewind( fp );
+	double scalar = bench_block( data, len, samplesize, fp, 1 );
+	rewind( fp );
+	double vector = bench_block( data, len, samplesize, fp, 0 );
+
+	double mb = (double)len / (1024*1024);
+
+	TEST_LOG( TEST_PASSED_STR "%u bytes samples, %.0f MB : per sample fwrite %.3fs | scalar block %.3fs | vector block %.3fs\n", line, samplesize, mb, loop, scalar, vector );
+
+	free( data );
+	fclose( fp );
+
+	return 0;
+}
+
+
+
+static void fill_samples( unsigned char *buf, size_t count, enum laafSampleFormat format, uint32_t seed ) {
+
+	uint32_t x = seed | 1;
+
+	for ( size_t i = 0; i < count; i++ ) {
+
+		x ^= x << 13;
+		x ^= x >> 17;
+		x ^= x << 5;
+
+		if ( format == LAAF_SAMPLE_F32 ) {
+			/* a bit out of range, to check clipping */
+			float f = (float)((double)(int32_t)x / 1717986918.0);
+
+			if ( i % 97 == 3 ) {
+				f = ( i & 1 ) ? 1.0f : -1.0f;
+			}
+
+			memcpy( buf + i*4, &f, 4 );
+		}
+		else {
+			unsigned int size = laaf_sample_format_size( format );
+
+			for ( unsigned int b = 0; b < size; b++ ) {
+				buf[i*size+b] = (unsigned char)(x >> (b*8));
+			}
+		}
+	}
+}
+
+
+
+static int test_convert_paths( int line ) {
+
+	unsigned char src[TEST_CONVERT_MAX*4 + 4];
+	unsigned char ref[TEST_CONVERT_MAX*4 + 4];
+	unsigned char buf[TEST_CONVERT_MAX*4 + 4];
+
+	struct laafSampleDither refDither;
+	struct laafSampleDither bufDither;
+
+	int pairs = 0;
+
+	for ( int sf = LAAF_SAMPLE_S16; sf <= LAAF_SAMPLE_F32; sf++ ) {
+		for ( int df = LAAF_SAMPLE_S16; df <= LAAF_SAMPLE_F32; df++ ) {
+			for ( int dithered = 0; dithered < 2; dithered++ ) {
+
+				enum laafSampleFormat srcFormat = (enum laafSampleFormat)sf;
+				enum laafSampleFormat dstFormat = (enum laafSampleFormat)df;
+
+				for ( size_t count = 0; count <= TEST_CONVERT_MAX; count += ( count < 40 ) ? 1 : 37 ) {
+
+					size_t align = count % 4;
+
+					fill_samples( src + align, count, srcFormat, (uint32_t)count );
+
+					memset( ref, 0xaa, sizeof(ref) );
+					memset( buf, 0xaa, sizeof(buf) );
+
+					laaf_sample_dither_init( &refDither, (uint32_t)count );
+					laaf_sample_dither_init( &bufDither, (uint32_t)count );
+
+					laaf_sample_convert_scalar( ref + align, dstFormat, src + align, srcFormat, count, ( dithered ) ? &refDither : NULL );
+					laaf_sample_convert( buf + align, dstFormat, src + align, srcFormat, count, ( dithered ) ? &bufDither : NULL );
+
+					if ( memcmp( ref, buf, sizeof(buf) ) != 0 || memcmp( &refDither, &bufDither, sizeof(refDither) ) != 0 ) {
+						TEST_LOG( TEST_ERROR_STR "%s to %s%s : conversion of %"PRIu64" samples differs from scalar path\n", line, format_names[sf], format_names[df], ( dithered ) ? " dithered" : "", (uint64_t)count );
+						return 1;
+					}
+				}
+
+				pairs++;
+			}
+		}
+	}
+
+	TEST_LOG( TEST_PASSED_STR "%i conversions match the scalar path\n", line, pairs );
+
+	return 0;
+}
+
+
+
+static int test_convert_values( int line ) {
+
+	unsigned char src[65536*4];
+	unsigned char dst[65536*4];
+	unsigned char back[65536*2];
+
+	/* every 16 bits value survives a round trip to float */
+	for ( uint32_t i = 0; i < 65536; i++ ) {
+		src[i*2]   = (unsigned char)(i);
+		src[i*2+1] = (unsigned char)(i >> 8);
+	}
+
+	laaf_sample_convert( dst, LAAF_SAMPLE_F32, src, LAAF_SAMPLE_S16, 65536, NULL );
+	laaf_sample_convert( back, LAAF_SAMPLE_S16, dst, LAAF_SAMPLE_F32, 65536, NULL );
+
+	if ( memcmp( src, back, 65536*2 ) != 0 ) {
+		TEST_LOG( TEST_ERROR_STR "s16 to f32 to s16 round trip is not lossless\n", line );
+		return 1;
+	}
+
+	/* 24 bits to 32 bits is a plain shift */
+	laaf_sample_convert( dst, LAAF_SAMPLE_S32, src, LAAF_SAMPLE_S24, 65536*2/3, NULL );
+
+	for ( size_t i = 0; i < 65536*2/3; i++ ) {
+		if ( dst[i*4] != 0 || memcmp( dst + i*4 + 1, src + i*3, 3 ) != 0 ) {
+			TEST_LOG( TEST_ERROR_STR "s24 to s32 is not lossless\n", line );
+			return 1;
+		}
+	}
+
+	/* float clipping, NaN included */
+	float f[6] = { 1.5f, -1.5f, 1.0f, -1.0f, 0.5f, 0.0f };
+	int16_t expected[6] = { 32767, -32768, 32767, -32768, 16384, 0 };
+	int16_t s16[6];
+
+	f[5] = f[5] / f[5];
+	expected[5] = 32767;
+
+	laaf_sample_convert( (unsigned char*)s16, LAAF_SAMPLE_S16, (unsigned char*)f, LAAF_SAMPLE_F32, 6, NULL );
+
+	if ( memcmp( s16, expected, sizeof(s16) ) != 0 ) {
+		TEST_LOG( TEST_ERROR_STR "f32 to s16 is not properly clipped\n", line );
+		return 1;
+	}
+
+	/* dithered 24 bits to 16 bits stays within 1.5 LSB (noise and rounding), with no DC offset */
+	struct laafSampleDither dither;
+	laaf_sample_dither_init( &dither, 1 );
+
+	size_t count = sizeof(src) / 3;
+	double sum = 0;
+
+	fill_samples( src, count, LAAF_SAMPLE_S24, 7 );
+	laaf_sample_convert( dst, LAAF_SAMPLE_S16, src, LAAF_SAMPLE_S24, count, &dither );
+
+	for ( size_t i = 0; i < count; i++ ) {
+
+		int32_t s24 = (int32_t)((uint32_t)src[i*3] << 8 | (uint32_t)src[i*3+1] << 16 | (uint32_t)src[i*3+2] << 24) / 256;
+		int16_t d16 = (int16_t)((uint16_t)dst[i*2] | (uint16_t)dst[i*2+1] << 8);
+
+		double err = (double)d16 - (double)s24 / 256.0;
+
+		if ( (err > 1.5 || err < -1.5) && d16 != 32767 && d16 != -32768 ) {
+			TEST_LOG( TEST_ERROR_STR "dithered s24 to s16 error of %f LSB\n", line, err );
+			return 1;
+		}
+
+		sum += err;
+	}
+
+	if ( sum / (double)count > 0.01 || sum / (double)count < -0.01 ) {
+		TEST_LOG( TEST_ERROR_STR "dithered s24 to s16 has a DC offset of %f LSB\n", line, sum / (double)count );
+		return 1;
+	}
+
+	TEST_LOG( TEST_PASSED_STR "known conversions, clipping and dither\n", line );
+
+	return 0;
+}
+
+
+
+static int bench_convert( int line, enum laafSampleFormat srcFormat, enum laafSampleFormat dstFormat, int dithered ) {
+
+	size_t count = BENCH_DATA_SIZE / 4;
+
+	unsigned char *src = malloc( count * laaf_sample_format_size( srcFormat ) );
+	unsigned char *dst = malloc( count * laaf_sample_format_size( dstFormat ) );
+
+	struct laafSampleDither dither;
+
+	if ( !src || !dst ) {
+		TEST_LOG( TEST_ERROR_STR "could not allocate benchmark data\n", line );
+		free( src );
+		free( dst );
+		return 1;
+	}
+
+	fill_samples( src, count, srcFormat, 1 );
+	memset( dst, 0x00, count * laaf_sample_format_size( dstFormat ) );
+
+	laaf_sample_dither_init( &dither, 1 );
+
+	clock_t start = clock();
+	laaf_sample_convert_scalar( dst, dstFormat, src, srcFormat, count, ( dithered ) ? &dither : NULL );
+	double scalar = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+	start = clock();
+	laaf_sample_convert( dst, dstFormat, src, srcFormat, count, ( dithered ) ? &dither : NULL );
+	double vector = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+	TEST_LOG( TEST_PASSED_STR "%s to %s%s, %"PRIu64" samples : scalar %.3fs | vector %.3fs\n", line, format_names[srcFormat], format_names[dstFormat], ( dithered ) ? " dithered" : "", (uint64_t)count, scalar, vector );
+
+	free( src );
+	free( dst );
+
+	return 0;
+}
+
+
+
+static int test_deinterleave( int line ) {
+
+	unsigned char src[TEST_DEINTERLEAVE_MAX_FRAMES * TEST_DEINTERLEAVE_MAX_CHANNELS * 4 + 4];
+	unsigned char ref[TEST_DEINTERLEAVE_MAX_CHANNELS][TEST_DEINTERLEAVE_MAX_FRAMES * 4 + 4];
+	unsigned char buf[TEST_DEINTERLEAVE_MAX_CHANNELS][TEST_DEINTERLEAVE_MAX_FRAMES * 4 + 4];
+	unsigned char sca[TEST_DEINTERLEAVE_MAX_CHANNELS][TEST_DEINTERLEAVE_MAX_FRAMES * 4 + 4];
+
+	unsigned char *bufPlanes[TEST_DEINTERLEAVE_MAX_CHANNELS];
+	unsigned char *scaPlanes[TEST_DEINTERLEAVE_MAX_CHANNELS];
+
+	int layouts = 0;
+
+	for ( unsigned int channels = 1; channels <= TEST_DEINTERLEAVE_MAX_CHANNELS; channels++ ) {
+		for ( unsigned int samplesize = 1; samplesize <= 4; samplesize++ ) {
+			for ( size_t frames = 0; frames <= TEST_DEINTERLEAVE_MAX_FRAMES; frames++ ) {
+				for ( unsigned int skip = 0; skip < 2; skip++ ) {
+
+					size_t align = frames % 4;
+
+					for ( size_t i = 0; i < sizeof(src); i++ ) {
+						src[i] = (unsigned char)( i * 7 + frames );
+					}
+
+					memset( ref, 0xaa, sizeof(ref) );
+					memset( buf, 0xaa, sizeof(buf) );
+					memset( sca, 0xaa, sizeof(sca) );
+
+					for ( unsigned int c = 0; c < channels; c++ ) {
+
+						/* skips every other channel, so first one is always kept */
+						int skipped = ( skip && c % 2 );
+
+						bufPlanes[c] = ( skipped ) ? NULL : buf[c] + align;
+						scaPlanes[c] = ( skipped ) ? NULL : sca[c] + align;
+
+						if ( skipped ) {
+							continue;
+						}
+
+						for ( size_t i = 0; i < frames; i++ ) {
+							memcpy( ref[c] + align + i*samplesize, src + align + (i*channels + c)*samplesize, samplesize );
+						}
+					}
+
+					laaf_sample_deinterleave( bufPlanes, src + align, frames, channels, samplesize );
+					laaf_sample_deinterleave_scalar( scaPlanes, src + align, frames, channels, samplesize );
+
+					if ( memcmp( ref, buf, sizeof(ref) ) != 0 || memcmp( ref, sca, sizeof(ref) ) != 0 ) {
+						TEST_LOG( TEST_ERROR_STR "laaf_sample_deinterleave() mismatch : %u channels, %u bytes, %"PRIu64" frames%s\n", line, channels, samplesize, (uint64_t)frames, ( skip ) ? ", skipping channels" : "" );
+						return 1;
+					}
+				}
+			}
+
+			layouts++;
+		}
+	}
+
+	TEST_LOG( TEST_PASSED_STR "laaf_sample_deinterleave() matches per-sample copy : %i layouts\n", line, layouts );
+
+	return 0;
+}
+
+
+
+static int bench_deinterleave( int line, unsigned int channels, unsigned int samplesize ) {
+
+	size_t frames = BENCH_DATA_SIZE / ( channels * samplesize );
+
+	unsigned char *src = malloc( BENCH_DATA_SIZE );
+	unsigned char *dst = malloc( BENCH_DATA_SIZE );
+
+	unsigned char *planes[TEST_DEINTERLEAVE_MAX_CHANNELS];
+
+	if ( !src || !dst ) {
+		TEST_LOG( TEST_ERROR_STR "could not allocate benchmark data\n", line );
+		free( src );
+		free( dst );
+		return 1;
+	}
+
+	for ( size_t i = 0; i < BENCH_DATA_SIZE; i++ ) {
+		src[i] = (unsigned char)i;
+	}
+
+	memset( dst, 0x00, BENCH_DATA_SIZE );
+
+	for ( unsigned int c = 0; c < channels; c++ ) {
+		planes[c] = dst + c * frames * samplesize;
+	}
+
+	clock_t start = clock();
+	laaf_sample_deinterleave_scalar( planes, src, frames, channels, samplesize );
+	double scalar = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+	start = clock();
+	laaf_sample_deinterleave( planes, src, frames, channels, samplesize );
+	double vector = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+	TEST_LOG( TEST_PASSED_STR "de-interleave %u channels of %u bits, %"PRIu64" frames : scalar %.3fs | vector %.3fs\n", line, channels, samplesize*8, (uint64_t)frames, scalar, vector );
+
+	free( src );
+	free( dst );
+
+	return 0;
+}
+
+
+
+static int test_minmax( int line ) {
+
+	float buf[TEST_MINMAX_MAX_LEN];
+
+	int checks = 0;
+
+	for ( size_t len = 0; len <= TEST_MINMAX_MAX_LEN; len++ ) {
+		for ( size_t lo = 0; lo < len || ( len == 0 && lo == 0 ); lo++ ) {
+
+			size_t hi = ( len ) ? ( lo * 7 + 3 ) % len : 0;
+
+			for ( size_t i = 0; i < len; i++ ) {
+				buf[i] = (float)( (int)(i * 13 % 17) - 8 ) / 16.0f;
+			}
+
+			if ( len ) {
+				buf[lo] = -1.0f;
+				buf[hi] = ( hi == lo ) ? -1.0f : 0.75f;
+			}
+
+			float refMin = ( len ) ? buf[0] : 0.0f;
+			float refMax = refMin;
+
+			for ( size_t i = 0; i < len; i++ ) {
+				refMin = ( buf[i] < refMin ) ? buf[i] : refMin;
+				refMax = ( buf[i] > refMax ) ? buf[i] : refMax;
+			}
+
+			float min = 2.0f;
+			float max = -2.0f;
+
+			laaf_sample_minmax( buf, len, &min, &max );
+
+			if ( min != refMin || max != refMax ) {
+				TEST_LOG( TEST_ERROR_STR "laaf_sample_minmax() found [%f, %f], expected [%f, %f] : %"PRIu64" samples\n", line, min, max, refMin, refMax, (uint64_t)len );
+				return 1;
+			}
+
+			checks++;
+		}
+	}
+
+	TEST_LOG( TEST_PASSED_STR "laaf_sample_minmax() matches per-sample search : %i buffers\n", line, checks );
+
+	return 0;
+}
+
+
+
+/*
+ * A 1kHz sine is resampled at once and by blocks, through both paths. Blocks
+ * must join exactly, both paths must agree, and every output sample must be on
+ * the sine at its own time.
+ */
+
+static int test_resampler( int line, uint64_t srcRate, uint64_t dstRate, uint64_t dstRateDen ) {
+
+	struct laafResampler rs;
+
+	const size_t inLen  = 16384;
+	const size_t outLen = 4096;
+	const uint64_t start = 100;
+
+	float *in      = malloc( inLen * sizeof(float) );
+	float *whole   = malloc( outLen * sizeof(float) );
+	float *blocks  = malloc( outLen * sizeof(float) );
+	float *scalar  = malloc( outLen * sizeof(float) );
+
+	int rc = 1;
+
+	memset( &rs, 0x00, sizeof(rs) );
+
+	if ( !in || !whole || !blocks || !scalar || laaf_resampler_init( &rs, srcRate, 1, dstRate, dstRateDen ) < 0 ) {
+		TEST_LOG( TEST_ERROR_STR "could not set resampler from %"PRIu64" Hz to %"PRIu64"/%"PRIu64" Hz\n", line, srcRate, dstRate, dstRateDen );
+		goto end;
+	}
+
+	for ( size_t i = 0; i < inLen; i++ ) {
+		in[i] = (float)( 0.5 * sin( 2 * TEST_PI * 1000.0 * (double)i / (double)srcRate ) );
+	}
+
+	int64_t first  = 0;
+	size_t  frames = 0;
+
+	laaf_resampler_span( &rs, start * rs.downsample, outLen, &first, &frames );
+
+	if ( first < 0 || (size_t)first + frames > inLen ) {
+		TEST_LOG( TEST_ERROR_STR "laaf_resampler_span() is out of test input : [%"PRIi64", +%"PRIu64")\n", line, first, (uint64_t)frames );
+		goto end;
+	}
+
+	laaf_resampler_process( &rs, whole, 1, in + first, start * rs.downsample, outLen );
+	laaf_resampler_process_scalar( &rs, scalar, 1, in + first, start * rs.downsample, outLen );
+
+	for ( size_t done = 0; done < outLen; ) {
+
+		size_t count = ( outLen - done < 97 ) ? outLen - done : 97;
+		uint64_t pos = (start + done) * rs.downsample;
+
+		laaf_resampler_span( &rs, pos, count, &first, &frames );
+		laaf_resampler_process( &rs, blocks + done, 1, in + first, pos, count );
+
+		done += count;
+	}
+
+	for ( size_t n = 0; n < outLen; n++ ) {
+
+		double t = (double)((start + n) * rs.downsample) / (double)rs.upsample / (double)srcRate;
+		double wanted = 0.5 * sin( 2 * TEST_PI * 1000.0 * t );
+
+		if ( blocks[n] != whole[n] ) {
+			TEST_LOG( TEST_ERROR_STR "resampled block join mismatch at sample %"PRIu64" : %f, expected %f\n", line, (uint64_t)n, blocks[n], whole[n] );
+			goto end;
+		}
+
+		if ( fabsf( scalar[n] - whole[n] ) > 1e-5f ) {
+			TEST_LOG( TEST_ERROR_STR "laaf_resampler_process() and scalar path differ at sample %"PRIu64" : %f, %f\n", line, (uint64_t)n, whole[n], scalar[n] );
+			goto end;
+		}
+
+		if ( fabs( whole[n] - wanted ) > 1e-3 ) {
+			TEST_LOG( TEST_ERROR_STR "resampled sample %"PRIu64" is %f, expected %f\n", line, (uint64_t)n, whole[n], wanted );
+			goto end;
+		}
+	}
+
+	TEST_LOG( TEST_PASSED_STR "%"PRIu64" Hz sine resampled to %.3f Hz : %u phases of %u taps\n", line, srcRate, (double)dstRate / (double)dstRateDen, rs.phases, rs.taps );
+
+	rc = 0;
+
+end:
+	laaf_resampler_free( &rs );
+
+	free( in );
+	free( whole );
+	free( blocks );
+	free( scalar );
+
+	return rc;
+}
+
+
+
+/*
+ * Level in dB of a full scale sine of freq Hz, once resampled.
+ */
+
+static double resampled_level( struct laafResampler *rs, uint64_t srcRate, double freq, float *in, size_t inLen, float *out, size_t outLen ) {
+
+	const uint64_t start = 100;
+
+	for ( size_t i = 0; i < inLen; i++ ) {
+		in[i] = (float)sin( 2 * TEST_PI * freq * (double)i / (double)srcRate );
+	}
+
+	int64_t first  = 0;
+	size_t  frames = 0;
+
+	laaf_resampler_span( rs, start * rs->downsample, outLen, &first, &frames );
+
+	if ( first < 0 || (size_t)first + frames > inLen ) {
+		return 0;
+	}
+
+	laaf_resampler_process( rs, out, 1, in + first, start * rs->downsample, outLen );
+
+	double sum = 0;
+
+	for ( size_t n = 0; n < outLen; n++ ) {
+		sum += (double)out[n] * (double)out[n];
+	}
+
+	/* full scale sine RMS is 1/sqrt(2) */
+
+	return 10 * log10( 2 * sum / (double)outLen + 1e-30 );
+}
+
+
+
+/*
+ * Sines between the output Nyquist frequency and the input one must not fold
+ * back into the output, and a sine well below the output Nyquist frequency
+ * must be kept.
+ */
+
+static int test_resampler_stopband( int line, uint64_t srcRate, uint64_t dstRate, uint64_t dstRateDen ) {
+
+	struct laafResampler rs;
+
+	const size_t inLen  = 32768;
+	const size_t outLen = 8192;
+
+	double dstNyquist = 0.5 * (double)dstRate / (double)dstRateDen;
+	double srcNyquist = 0.5 * (double)srcRate;
+
+	const double stopband[] = { 1.002, 1.01, 1.02, 1.05, 1.2 };
+
+	float *in  = malloc( inLen * sizeof(float) );
+	float *out = malloc( outLen * sizeof(float) );
+
+	double worst = -1000;
+	int rc = 1;
+
+	memset( &rs, 0x00, sizeof(rs) );
+
+	if ( !in || !out || laaf_resampler_init( &rs, srcRate, 1, dstRate, dstRateDen ) < 0 ) {
+		TEST_LOG( TEST_ERROR_STR "could not set resampler from %"PRIu64" Hz to %"PRIu64"/%"PRIu64" Hz\n", line, srcRate, dstRate, dstRateDen );
+		goto end;
+	}
+
+	for ( size_t i = 0; i < sizeof(stopband)/sizeof(stopband[0]); i++ ) {
+
+		double freq = dstNyquist * stopband[i];
+
+		if ( freq >= srcNyquist ) {
+			continue;
+		}
+
+		double level = resampled_level( &rs, srcRate, freq, in, inLen, out, outLen );
+
+		if ( level > -60 ) {
+			TEST_LOG( TEST_ERROR_STR "%.0f Hz sine resampled from %"PRIu64" Hz to %.3f Hz comes back at %.1f dB\n", line, freq, srcRate, 2 * dstNyquist, level );
+			goto end;
+		}
+
+		worst = ( level > worst ) ? level : worst;
+	}
+
+	double freq  = dstNyquist * 0.8;
+	double level = resampled_level( &rs, srcRate, freq, in, inLen, out, outLen );
+
+	if ( fabs( level ) > 0.1 ) {
+		TEST_LOG( TEST_ERROR_STR "%.0f Hz sine resampled from %"PRIu64" Hz to %.3f Hz is at %.2f dB\n", line, freq, srcRate, 2 * dstNyquist, level );
+		goto end;
+	}
+
+	TEST_LOG( TEST_PASSED_STR "%"PRIu64" Hz resampled to %.3f Hz : stop band below %.1f dB, %.0f Hz at %.2f dB\n", line, srcRate, 2 * dstNyquist, worst, freq, level );
+
+	rc = 0;
+
+end:
+	laaf_resampler_free( &rs );
+
+	free( in );
+	free( out );
+
+	return rc;
+}
+
+
+
+int main( int argc, char *argv[] ) {
+
+	(void)argc;
+	(void)argv;
+
+#ifdef _WIN32
+	INIT_WINDOWS_CONSOLE()
+#endif
+
+	SET_LOCALE()
+
+
+	int errors = 0;
+
+	TEST_LOG("\n");
+
+	errors += test_swap( __LINE__, 2 );
+	errors += test_swap( __LINE__, 3 );
+	errors += test_swap( __LINE__, 4 );
+
+	errors += bench_swap( __LINE__, 2 );
+	errors += bench_swap( __LINE__, 3 );
+	errors += bench_swap( __LINE__, 4 );
+
+	errors += test_convert_paths( __LINE__ );
+	errors += test_convert_values( __LINE__ );
+
+	errors += bench_convert( __LINE__, LAAF_SAMPLE_S16, LAAF_SAMPLE_F32, 0 );
+	errors += bench_convert( __LINE__, LAAF_SAMPLE_S24, LAAF_SAMPLE_F32, 0 );
+	errors += bench_convert( __LINE__, LAAF_SAMPLE_F32, LAAF_SAMPLE_S24, 1 );
+	errors += bench_convert( __LINE__, LAAF_SAMPLE_S24, LAAF_SAMPLE_S16, 1 );
+
+	errors += test_deinterleave( __LINE__ );
+
+	errors += bench_deinterleave( __LINE__, 2, 2 );
+	errors += bench_deinterleave( __LINE__, 2, 3 );
+	errors += bench_deinterleave( __LINE__, 2, 4 );
+	errors += bench_deinterleave( __LINE__, 8, 2 );
+
+	errors += test_minmax( __LINE__ );
+
+	errors += test_resampler( __LINE__, 44100, 48000, 1 );
+	errors += test_resampler( __LINE__, 48000, 44100, 1 );
+	errors += test_resampler( __LINE__, 48000, 96000, 1 );
+	errors += test_resampler( __LINE__, 96000, 44100, 1 );
+	errors += test_resampler( __LINE__, 48000, 48000000, 1001 );
+	errors += test_resampler( __LINE__, 44100, 48000000, 1001 );
+
+	errors += test_resampler_stopband( __LINE__, 48000, 44100, 1 );
+	errors += test_resampler_stopband( __LINE__, 96000, 44100, 1 );
+	errors += test_resampler_stopband( __LINE__, 96000, 48000, 1 );
+	errors += test_resampler_stopband( __LINE__, 88200, 48000, 1 );
+
+	TEST_LOG("\n");
+
+	return errors;
+}
@@ -0,0 +1,547 @@
+/*
+ * Copyright (C) 2017-2024 Adrien Gesta-Fline
+ *
+ * This file is part of libAAF.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Parses every file of the test/aaf corpus from several threads at once, and
+ * checks that each result is identical to the one of a sequential parsing.
+ * Parsing is traced and logged at debug level, so that the aaft_*ToText()
+ * and aaf_get_ObjectPath() buffers are heavily used by each thread.
+ *
+ * An embedded essence is then extracted with several threads, listed more than
+ * once, and must be written once, identical to a single thread extraction.
+ *
+ * A gain envelope is finally evaluated for the first time by several threads at
+ * once, which must all get the values of a single thread evaluation.
+ *
+ * Configure with -DBUILD_TSAN=ON to run it under ThreadSanitizer.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <dirent.h>
+#include <pthread.h>
+
+#include <libaaf.h>
+
+#include "common.h"
+#include <libaaf/AAFIEnvelope.h>
+
+
+#define TEST_THREADS 4
+#define TEST_LOOPS   2
+
+#define TEST_EXTRACT_FILE "PR_WAV_Internal.aaf"
+
+#define TEST_ENVELOPE_POINTS 64
+#define TEST_ENVELOPE_LENGTH 48000
+#define TEST_ENVELOPE_LOOPS  200
+
+
+struct result {
+	char     *file;
+	uint64_t  loghash;
+	uint32_t  audioTracks;
+	uint32_t  audioItems;
+	uint32_t  videoTracks;
+	uint32_t  videoItems;
+	uint32_t  markers;
+	uint64_t  namehash;
+	int       loaded;
+};
+
+struct worker {
+	pthread_t      thread;
+	int            index;
+	struct result *ref;
+	size_t         count;
+	int            errors;
+};
+
+struct envelopeWorker {
+	pthread_t       thread;
+	AAF_Iface      *aafi;
+	aafiAudioGain  *gain;
+	float          *out;
+	int             rc;
+};
+
+static uint64_t hash_str( uint64_t hash, const char *str );
+static void hash_log_callback( struct aafLog *log, void *ctxdata, int lib, int type, const char *srcfile, const char *srcfunc, int lineno, const char *msg, void *user );
+static int parse_file( const char *file, int loaderThreads, struct result *res );
+static void * worker_run( void *arg );
+static int cmp_str( const void *a, const void *b );
+static unsigned char * read_file( const char *file, size_t *size );
+static int extract_essence( const char *file, int threads, size_t listed, unsigned char **data, size_t *size );
+static int test_extract( const char *path );
+static void * envelope_run( void *arg );
+static int test_envelope( void );
+
+
+
+static uint64_t hash_str( uint64_t hash, const char *str ) {
+
+	/* FNV-1a */
+	while ( str && *str ) {
+		hash ^= (unsigned char)*str++;
+		hash *= 0x100000001b3ULL;
+	}
+
+	return hash;
+}
+
+
+
+static void hash_log_callback( struct aafLog *log, void *ctxdata, int lib, int type, const char *srcfile, const char *srcfunc, int lineno, const char *msg, void *user ) {
+
+	(void)ctxdata;
+	(void)lib;
+	(void)type;
+	(void)srcfile;
+	(void)lineno;
+
+	uint64_t *hash = user;
+
+	*hash = hash_str( *hash, srcfunc );
+	*hash = hash_str( *hash, msg );
+
+	LOG_BUFFER_RESET( log );
+}
+
+
+
+static int parse_file( const char *file, int loaderThreads, struct result *res ) {
+
+	uint64_t loghash = 0xcbf29ce484222325ULL;
+
+	AAF_Iface *aafi = aafi_alloc( NULL );
+
+	if ( !aafi ) {
+		return -1;
+	}
+
+	aafi_set_debug( aafi, VERB_DEBUG, 0, NULL, &hash_log_callback, &loghash );
+
+	aafi_set_option_int( aafi, "trace", 1 );
+	aafi_set_option_int( aafi, "threads", loaderThreads );
+
+	memset( res, 0x00, sizeof(struct result) );
+
+	res->loaded = ( aafi_load_file( aafi, file ) == 0 );
+
+	aafiAudioTrack *audioTrack = NULL;
+	aafiVideoTrack *videoTrack = NULL;
+	aafiTimelineItem *item = NULL;
+	aafiMarker *marker = NULL;
+
+	for ( audioTrack = aafi->Audio->Tracks; audioTrack != NULL; audioTrack = audioTrack->next ) {
+		res->audioTracks++;
+		for ( item = audioTrack->timelineItems; item != NULL; item = item->next )
+			res->audioItems++;
+	}
+
+	for ( videoTrack = aafi->Video->Tracks; videoTrack != NULL; videoTrack = videoTrack->next ) {
+		res->videoTracks++;
+		for ( item = videoTrack->timelineItems; item != NULL; item = item->next )
+			res->videoItems++;
+	}
+
+	for ( marker = aafi->Markers; marker != NULL; marker = marker->next )
+		res->markers++;
+
+	res->namehash = hash_str( 0xcbf29ce484222325ULL, aafi->compositionName );
+	res->loghash  = loghash;
+
+	aafi_release( &aafi );
+
+	return 0;
+}
+
+
+
+static void * worker_run( void *arg ) {
+
+	struct worker *w = arg;
+
+	for ( int loop = 0; loop < TEST_LOOPS; loop++ ) {
+
+		for ( size_t n = 0; n < w->count; n++ ) {
+
+			/* each worker goes through the corpus in a different order */
+			struct result *ref = &w->ref[(n + (size_t)w->index * 7) % w->count];
+			struct result res;
+
+			/*
+			 * second loop also retrieves the Object Tree with worker threads. Log
+			 * order is then unpredictable, so only the first loop checks the log.
+			 */
+			int loaderThreads = ( loop == 0 ) ? 0 : 2;
+
+			if ( parse_file( ref->file, loaderThreads, &res ) < 0 ||
+			     res.loaded      != ref->loaded      ||
+			     res.audioTracks != ref->audioTracks ||
+			     res.audioItems  != ref->audioItems  ||
+			     res.videoTracks != ref->videoTracks ||
+			     res.videoItems  != ref->videoItems  ||
+			     res.markers     != ref->markers     ||
+			     res.namehash    != ref->namehash    ||
+			     ( loaderThreads == 0 && res.loghash != ref->loghash ) )
+			{
+				TEST_LOG( TEST_ERROR_STR "thread %i, loop %i : %s\n", __LINE__, w->index, loop, ref->file );
+				w->errors++;
+			}
+		}
+	}
+
+	return NULL;
+}
+
+
+
+static int cmp_str( const void *a, const void *b ) {
+	return strcmp( *(char * const *)a, *(char * const *)b );
+}
+
+
+
+static unsigned char * read_file( const char *file, size_t *size ) {
+
+	FILE *fp = fopen( file, "rb" );
+
+	if ( !fp ) {
+		return NULL;
+	}
+
+	unsigned char *data = NULL;
+
+	if ( fseek( fp, 0, SEEK_END ) == 0 ) {
+
+		long len = ftell( fp );
+
+		if ( len > 0 && fseek( fp, 0, SEEK_SET ) == 0 && (data = malloc( (size_t)len )) != NULL ) {
+
+			*size = fread( data, 1, (size_t)len, fp );
+
+			if ( *size != (size_t)len ) {
+				free( data );
+				data = NULL;
+			}
+		}
+	}
+
+	fclose( fp );
+
+	return data;
+}
+
+
+
+static int extract_essence( const char *file, int threads, size_t listed, unsigned char **data, size_t *size ) {
+
+	int rc = -1;
+
+	AAF_Iface *aafi = aafi_alloc( NULL );
+
+	if ( !aafi ) {
+		return -1;
+	}
+
+	aafi_set_debug( aafi, VERB_QUIET, 0, NULL, NULL, NULL );
+	aafi_set_option_int( aafi, "threads", threads );
+
+	if ( aafi_load_file( aafi, file ) < 0 || !aafi->Audio->essenceFiles ) {
+		goto end;
+	}
+
+	aafiAudioEssenceFile *essences[TEST_THREADS];
+
+	for ( size_t i = 0; i < listed && i < TEST_THREADS; i++ ) {
+		essences[i] = aafi->Audio->essenceFiles;
+	}
+
+	if ( aafi_extractAudioEssenceFiles( aafi, essences, listed, AAFI_EXTRACT_WAV, "." ) < 0 ||
+	     !aafi->Audio->essenceFiles->usable_file_path )
+	{
+		goto end;
+	}
+
+	*data = read_file( aafi->Audio->essenceFiles->usable_file_path, size );
+
+	remove( aafi->Audio->essenceFiles->usable_file_path );
+
+	rc = ( *data ) ? 0 : -1;
+
+end:
+	aafi_release( &aafi );
+
+	return rc;
+}
+
+
+
+static int test_extract( const char *path ) {
+
+	char *file = laaf_util_build_path( "/", path, TEST_EXTRACT_FILE, NULL );
+
+	unsigned char *ref = NULL;
+	unsigned char *data = NULL;
+	size_t refSize = 0;
+	size_t size = 0;
+
+	int errors = 0;
+
+	if ( extract_essence( file, 1, 1, &ref, &refSize ) < 0 ) {
+		TEST_LOG( TEST_ERROR_STR "Could not extract essence of %s\n", __LINE__, file );
+		errors++;
+	}
+	else if ( extract_essence( file, TEST_THREADS, TEST_THREADS, &data, &size ) < 0 ) {
+		TEST_LOG( TEST_ERROR_STR "Could not extract essence listed %i times with %i threads\n", __LINE__, TEST_THREADS, TEST_THREADS );
+		errors++;
+	}
+	else if ( size != refSize || memcmp( data, ref, size ) != 0 ) {
+		TEST_LOG( TEST_ERROR_STR "Essence extracted with %i threads differs from a single thread extraction\n", __LINE__, TEST_THREADS );
+		errors++;
+	}
+	else {
+		TEST_LOG( TEST_PASSED_STR "Essence listed %i times extracted once with %i threads\n", __LINE__, TEST_THREADS, TEST_THREADS );
+	}
+
+	free( ref );
+	free( data );
+	free( file );
+
+	return errors;
+}
+
+
+
+static void * envelope_run( void *arg ) {
+
+	struct envelopeWorker *w = arg;
+
+	w->rc = aafi_evalEnvelope( w->aafi, w->gain, TEST_ENVELOPE_LENGTH, NULL, NULL, 0, TEST_ENVELOPE_LENGTH, w->out );
+
+	return NULL;
+}
+
+
+
+static int test_envelope( void ) {
+
+	struct envelopeWorker workers[TEST_THREADS];
+
+	float *ref = malloc( TEST_ENVELOPE_LENGTH * sizeof(float) );
+	float *out = malloc( TEST_THREADS * TEST_ENVELOPE_LENGTH * sizeof(float) );
+
+	AAF_Iface *aafi = aafi_alloc( NULL );
+	aafiAudioGain *gain = ( aafi ) ? aafi_newAudioGain( aafi, AAFI_AUDIO_GAIN_VARIABLE, AAFI_INTERPOL_POWER, NULL ) : NULL;
+
+	int errors = 0;
+
+	if ( !ref || !out || !gain ) {
+		TEST_LOG( TEST_ERROR_STR "Could not set gain envelope\n", __LINE__ );
+		errors++;
+		goto end;
+	}
+
+	aafi_set_debug( aafi, VERB_QUIET, 0, NULL, NULL, NULL );
+
+	gain->time  = calloc( TEST_ENVELOPE_POINTS, sizeof(aafRational_t) );
+	gain->value = calloc( TEST_ENVELOPE_POINTS, sizeof(aafRational_t) );
+
+	if ( !gain->time || !gain->value ) {
+		TEST_LOG( TEST_ERROR_STR "Could not set gain envelope\n", __LINE__ );
+		errors++;
+		goto end;
+	}
+
+	gain->pts_cnt = TEST_ENVELOPE_POINTS;
+
+	for ( int i = 0; i < TEST_ENVELOPE_POINTS; i++ ) {
+		gain->time[i].numerator    = i;
+		gain->time[i].denominator  = TEST_ENVELOPE_POINTS - 1;
+		gain->value[i].numerator   = ( i * 37 ) % 101;
+		gain->value[i].denominator = 100;
+	}
+
+	if ( aafi_evalEnvelope( aafi, gain, TEST_ENVELOPE_LENGTH, NULL, NULL, 0, TEST_ENVELOPE_LENGTH, ref ) < 0 ) {
+		TEST_LOG( TEST_ERROR_STR "aafi_evalEnvelope() failed\n", __LINE__ );
+		errors++;
+		goto end;
+	}
+
+	for ( int loop = 0; loop < TEST_ENVELOPE_LOOPS && !errors; loop++ ) {
+
+		/* envelope is compiled again, by the first thread getting there */
+
+		free( gain->envelope );
+		gain->envelope = NULL;
+
+		memset( out, 0x00, TEST_THREADS * TEST_ENVELOPE_LENGTH * sizeof(float) );
+
+		int started = 0;
+
+		for ( ; started < TEST_THREADS; started++ ) {
+
+			workers[started].aafi = aafi;
+			workers[started].gain = gain;
+			workers[started].out  = out + started * TEST_ENVELOPE_LENGTH;
+			workers[started].rc   = -1;
+
+			if ( pthread_create( &workers[started].thread, NULL, envelope_run, &workers[started] ) != 0 ) {
+				TEST_LOG( TEST_ERROR_STR "Could not start thread %i\n", __LINE__, started );
+				errors++;
+				break;
+			}
+		}
+
+		for ( int i = 0; i < started; i++ ) {
+
+			pthread_join( workers[i].thread, NULL );
+
+			if ( errors ) {
+				continue;
+			}
+
+			if ( workers[i].rc < 0 || memcmp( workers[i].out, ref, TEST_ENVELOPE_LENGTH * sizeof(float) ) != 0 ) {
+				TEST_LOG( TEST_ERROR_STR "Envelope evaluated by thread %i differs from a single thread evaluation\n", __LINE__, i );
+				errors++;
+			}
+		}
+	}
+
+	if ( errors == 0 ) {
+		TEST_LOG( TEST_PASSED_STR "Envelope first evaluated by %i threads at once, %i times\n", __LINE__, TEST_THREADS, TEST_ENVELOPE_LOOPS );
+	}
+
+end:
+	aafi_freeAudioGain( gain );
+	aafi_release( &aafi );
+
+	free( ref );
+	free( out );
+
+	return errors;
+}
+
+
+
+int main( int argc, char *argv[] ) {
+
+	const char *path = ( argc > 1 ) ? argv[1] : LIBAAF_TEST_AAF_PATH;
+
+	SET_LOCALE()
+
+	TEST_LOG("\n");
+
+	int errors = 0;
+
+	char **files = NULL;
+	size_t count = 0;
+
+	DIR *dir = opendir( path );
+
+	if ( !dir ) {
+		TEST_LOG( TEST_ERROR_STR "Could not open directory : %s\n", __LINE__, path );
+		return 1;
+	}
+
+	struct dirent *entry = NULL;
+
+	while ( (entry = readdir( dir )) != NULL ) {
+
+		size_t len = strlen( entry->d_name );
+
+		if ( len < 4 || strcmp( entry->d_name + len - 4, ".aaf" ) != 0 ) {
+			continue;
+		}
+
+		char **tmp = realloc( files, (count+1) * sizeof(char*) );
+
+		if ( !tmp ) {
+			break;
+		}
+
+		files = tmp;
+		files[count++] = laaf_util_build_path( "/", path, entry->d_name, NULL );
+	}
+
+	closedir( dir );
+
+	if ( count == 0 ) {
+		TEST_LOG( TEST_ERROR_STR "No AAF file found in %s\n", __LINE__, path );
+		free( files );
+		return 1;
+	}
+
+	qsort( files, count, sizeof(char*), cmp_str );
+
+
+	struct result *ref = calloc( count, sizeof(struct result) );
+
+	if ( !ref ) {
+		return 1;
+	}
+
+	for ( size_t n = 0; n < count; n++ ) {
+		parse_file( files[n], 0, &ref[n] );
+		ref[n].file = files[n];
+	}
+
+
+	struct worker workers[TEST_THREADS];
+
+	for ( int i = 0; i < TEST_THREADS; i++ ) {
+
+		workers[i].index  = i;
+		workers[i].ref    = ref;
+		workers[i].count  = count;
+		workers[i].errors = 0;
+
+		if ( pthread_create( &workers[i].thread, NULL, worker_run, &workers[i] ) != 0 ) {
+			TEST_LOG( TEST_ERROR_STR "Could not start thread %i\n", __LINE__, i );
+			return 1;
+		}
+	}
+
+	for ( int i = 0; i < TEST_THREADS; i++ ) {
+		pthread_join( workers[i].thread, NULL );
+		errors += workers[i].errors;
+	}
+
+	if ( errors == 0 ) {
+		TEST_LOG( TEST_PASSED_STR "%zu files parsed concurrently by %i threads, %i times\n", __LINE__, count, TEST_THREADS, TEST_LOOPS );
+	}
+
+	errors += test_extract( path );
+	errors += test_envelope();
+
+	for ( size_t n = 0; n < count; n++ ) {
+		free( files[n] );
+	}
+
+	free( files );
+	free( ref );
+
+	TEST_LOG("\n");
+
+	return errors;
+}
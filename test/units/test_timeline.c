@@ -0,0 +1,386 @@
+/*
+ * Copyright (C) 2017-2024 Adrien Gesta-Fline
+ *
+ * This file is part of libAAF.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include <libaaf.h>
+
+#include "common.h"
+
+
+#define TEST_TRACK_ITEMS 10000
+
+
+struct range_query {
+	aafPosition_t start;
+	aafPosition_t end;
+	int           count;
+	int           stopAt;
+};
+
+static int check_track( int line, aafiAudioTrack *audioTrack, int expectedItems, int expectedClips );
+static int test_build_track( int line, AAF_Iface *aafi, aafiAudioTrack *audioTrack );
+static int test_remove_items( int line, AAF_Iface *aafi, aafiAudioTrack *audioTrack );
+static int item_intersects( aafiTimelineItem *timelineItem, aafPosition_t start, aafPosition_t end );
+static int range_item_callback( void *item, void *user );
+static int test_query_range( int line, AAF_Iface *aafi, aafiAudioTrack *audioTrack );
+static int range_marker_callback( void *item, void *user );
+static int test_query_markers( int line, AAF_Iface *aafi );
+
+
+
+static int check_track( int line, aafiAudioTrack *audioTrack, int expectedItems, int expectedClips ) {
+
+	int items = 0;
+	int clips = 0;
+
+	aafiTimelineItem *timelineItem = NULL;
+	aafiTimelineItem *prev = NULL;
+
+	AAFI_foreachTrackItem( audioTrack, timelineItem ) {
+
+		items++;
+
+		if ( timelineItem->prev != prev || timelineItem->track != audioTrack ) {
+			TEST_LOG( TEST_ERROR_STR "item %i is not properly linked\n", line, items );
+			return 1;
+		}
+
+		if ( timelineItem->type == AAFI_AUDIO_CLIP ) {
+
+			clips++;
+
+			if ( aafi_get_clipIndex( timelineItem->data ) != clips ) {
+				TEST_LOG( TEST_ERROR_STR "aafi_get_clipIndex() of clip %i returned %i\n", line, clips, aafi_get_clipIndex( timelineItem->data ) );
+				return 1;
+			}
+		}
+
+		prev = timelineItem;
+	}
+
+	if ( audioTrack->lastTimelineItem != prev ) {
+		TEST_LOG( TEST_ERROR_STR "track last item does not match the list tail\n", line );
+		return 1;
+	}
+
+	if ( items != expectedItems || clips != expectedClips ) {
+		TEST_LOG( TEST_ERROR_STR "track holds %i items and %i clips, expected %i items and %i clips\n", line, items, clips, expectedItems, expectedClips );
+		return 1;
+	}
+
+	return 0;
+}
+
+
+
+static int test_build_track( int line, AAF_Iface *aafi, aafiAudioTrack *audioTrack ) {
+
+	/* every third item is a transition */
+	for ( int i = 0; i < TEST_TRACK_ITEMS; i++ ) {
+
+		void *item = ( i % 3 == 2 ) ?
+			(void*)aafi_newTransition( aafi, audioTrack ) :
+			(void*)aafi_newAudioClip( aafi, audioTrack );
+
+		if ( !item ) {
+			TEST_LOG( TEST_ERROR_STR "could not create item %i\n", line, i );
+			return 1;
+		}
+	}
+
+	int clips = TEST_TRACK_ITEMS - (TEST_TRACK_ITEMS / 3);
+
+	if ( check_track( line, audioTrack, TEST_TRACK_ITEMS, clips ) ) {
+		return 1;
+	}
+
+	TEST_LOG( TEST_PASSED_STR "track of %i items built, %i clips indexed\n", line, TEST_TRACK_ITEMS, clips );
+
+	return 0;
+}
+
+
+
+static int test_remove_items( int line, AAF_Iface *aafi, aafiAudioTrack *audioTrack ) {
+
+	int items = TEST_TRACK_ITEMS;
+	int clips = TEST_TRACK_ITEMS - (TEST_TRACK_ITEMS / 3);
+
+	/* first item, a clip */
+	aafi_removeTimelineItem( aafi, audioTrack->timelineItems );
+	items--; clips--;
+
+	/* last item, a clip */
+	aafi_removeTimelineItem( aafi, audioTrack->lastTimelineItem );
+	items--; clips--;
+
+	/* a transition, then a clip in the middle of the track */
+	aafiTimelineItem *timelineItem = audioTrack->timelineItems;
+
+	for ( int i = 0; i < items / 2; i++ ) {
+		timelineItem = timelineItem->next;
+	}
+
+	while ( timelineItem->type != AAFI_TRANS ) {
+		timelineItem = timelineItem->next;
+	}
+
+	aafiTimelineItem *next = timelineItem->next;
+
+	aafi_removeTimelineItem( aafi, timelineItem );
+	items--;
+
+	aafi_removeTimelineItem( aafi, next );
+	items--; clips--;
+
+	if ( check_track( line, audioTrack, items, clips ) ) {
+		return 1;
+	}
+
+	TEST_LOG( TEST_PASSED_STR "aafi_removeTimelineItem() kept %i clips indexed\n", line, clips );
+
+	return 0;
+}
+
+
+
+static int item_intersects( aafiTimelineItem *timelineItem, aafPosition_t start, aafPosition_t end ) {
+
+	aafPosition_t pos = 0;
+	aafPosition_t len = 0;
+
+	if ( timelineItem->type == AAFI_AUDIO_CLIP ) {
+		aafiAudioClip *audioClip = timelineItem->data;
+		pos = audioClip->pos;
+		len = audioClip->len;
+	}
+	else if ( timelineItem->next && timelineItem->next->type == AAFI_AUDIO_CLIP ) {
+		/* cross-fade starts with next clip */
+		aafiTransition *trans = timelineItem->data;
+		pos = ((aafiAudioClip*)timelineItem->next->data)->pos;
+		len = trans->len;
+	}
+	else {
+		return 0;
+	}
+
+	return ( pos < end && pos + len > start );
+}
+
+
+
+static int range_item_callback( void *item, void *user ) {
+
+	struct range_query *query = user;
+
+	if ( !item_intersects( item, query->start, query->end ) ) {
+		query->count = -1;
+		return 1;
+	}
+
+	query->count++;
+
+	return ( query->stopAt && query->count == query->stopAt );
+}
+
+
+
+static int test_query_range( int line, AAF_Iface *aafi, aafiAudioTrack *audioTrack ) {
+
+	static aafRational_t trackEditRate = { 48000, 1 };
+	static aafRational_t queryEditRate = { 24, 1 };
+
+	audioTrack->edit_rate = &trackEditRate;
+
+	/* overlapping clips of various length one every 1000 samples, and cross-fades */
+	aafiTimelineItem *timelineItem = NULL;
+	aafPosition_t pos = 0;
+
+	AAFI_foreachTrackItem( audioTrack, timelineItem ) {
+		if ( timelineItem->type == AAFI_AUDIO_CLIP ) {
+			aafiAudioClip *audioClip = timelineItem->data;
+			audioClip->pos = pos;
+			audioClip->len = 500 + (pos * 7) % 20000;
+			pos += 1000;
+		}
+		else {
+			aafiTransition *trans = timelineItem->data;
+			trans->flags = AAFI_TRANS_XFADE;
+			trans->len = 250;
+		}
+	}
+
+	if ( aafi_buildRangeIndexes( aafi ) < 0 ) {
+		TEST_LOG( TEST_ERROR_STR "aafi_buildRangeIndexes() failed\n", line );
+		return 1;
+	}
+
+	for ( aafPosition_t start = -5000; start < pos + 5000; start += 3331 ) {
+
+		struct range_query query = { start, start + 7919, 0, 0 };
+
+		int expected = 0;
+
+		AAFI_foreachTrackItem( audioTrack, timelineItem ) {
+			expected += item_intersects( timelineItem, query.start, query.end );
+		}
+
+		int rc = aafi_queryRange( &audioTrack->rangeIndex, query.start, query.end, &trackEditRate, range_item_callback, &query );
+
+		if ( rc != expected || query.count != expected ) {
+			TEST_LOG( TEST_ERROR_STR "aafi_queryRange( %"PRIi64", %"PRIi64" ) returned %i, expected %i\n", line, query.start, query.end, rc, expected );
+			return 1;
+		}
+	}
+
+	/* 1 second at 24 fps, starting at 10 seconds : [480000, 528000) at 48kHz */
+	struct range_query query = { 480000, 528000, 0, 0 };
+
+	int rc = aafi_queryRange( &audioTrack->rangeIndex, 240, 264, &queryEditRate, range_item_callback, &query );
+
+	if ( rc <= 0 || query.count != rc ) {
+		TEST_LOG( TEST_ERROR_STR "aafi_queryRange() with a different edit rate returned %i\n", line, rc );
+		return 1;
+	}
+
+	struct range_query stop = { 0, pos, 0, 3 };
+
+	rc = aafi_queryRange( &audioTrack->rangeIndex, 0, pos, NULL, range_item_callback, &stop );
+
+	if ( rc != 3 ) {
+		TEST_LOG( TEST_ERROR_STR "aafi_queryRange() did not stop at callback request\n", line );
+		return 1;
+	}
+
+	TEST_LOG( TEST_PASSED_STR "aafi_queryRange() matches a linear scan of the track\n", line );
+
+	return 0;
+}
+
+
+
+static int range_marker_callback( void *item, void *user ) {
+
+	(void)item;
+	(void)user;
+
+	return 0;
+}
+
+
+
+static int test_query_markers( int line, AAF_Iface *aafi ) {
+
+	static aafRational_t editRate = { 25, 1 };
+
+	for ( int i = 0; i < 100; i++ ) {
+		/* point markers every 10 frames, range markers of 20 frames every 5 frames */
+		if ( !aafi_newMarker( aafi, &editRate, i*10, 0, NULL, NULL, NULL ) ||
+		     !aafi_newMarker( aafi, &editRate, i*5, 20, NULL, NULL, NULL ) )
+		{
+			TEST_LOG( TEST_ERROR_STR "aafi_newMarker() failed\n", line );
+			return 1;
+		}
+	}
+
+	if ( aafi_buildRangeIndexes( aafi ) < 0 ) {
+		TEST_LOG( TEST_ERROR_STR "aafi_buildRangeIndexes() failed\n", line );
+		return 1;
+	}
+
+	struct range_query query = { 0, 0, 0, 0 };
+
+	/*
+	 * [100, 110) holds point marker 100, and range markers starting from 85 to 105
+	 */
+	int rc = aafi_queryRange( &aafi->markersRangeIndex, 100, 110, &editRate, range_marker_callback, &query );
+
+	if ( rc != 6 ) {
+		TEST_LOG( TEST_ERROR_STR "aafi_queryRange() on markers returned %i, expected 6\n", line, rc );
+		return 1;
+	}
+
+	/* point query, holds range markers starting from 90 to 105 */
+	rc = aafi_queryRange( &aafi->markersRangeIndex, 105, 105, &editRate, range_marker_callback, &query );
+
+	if ( rc != 4 ) {
+		TEST_LOG( TEST_ERROR_STR "point aafi_queryRange() on markers returned %i, expected 4\n", line, rc );
+		return 1;
+	}
+
+	TEST_LOG( TEST_PASSED_STR "aafi_queryRange() on markers\n", line );
+
+	return 0;
+}
+
+
+
+int main( int argc, char *argv[] ) {
+
+	(void)argc;
+	(void)argv;
+
+#ifdef _WIN32
+	INIT_WINDOWS_CONSOLE()
+#endif
+
+	SET_LOCALE()
+
+
+	int errors = 0;
+
+	TEST_LOG("\n");
+
+	AAF_Iface *aafi = aafi_alloc( NULL );
+
+	if ( !aafi ) {
+		TEST_LOG( TEST_ERROR_STR "aafi_alloc() failed\n", __LINE__ );
+		return 1;
+	}
+
+	aafiAudioTrack *audioTrack = aafi_newAudioTrack( aafi );
+
+	if ( !audioTrack ) {
+		TEST_LOG( TEST_ERROR_STR "aafi_newAudioTrack() failed\n", __LINE__ );
+		aafi_release( &aafi );
+		return 1;
+	}
+
+	errors += test_build_track( __LINE__, aafi, audioTrack );
+
+	if ( errors == 0 ) {
+		errors += test_remove_items( __LINE__, aafi, audioTrack );
+	}
+
+	if ( errors == 0 ) {
+		errors += test_query_range( __LINE__, aafi, audioTrack );
+	}
+
+	errors += test_query_markers( __LINE__, aafi );
+
+	aafi_release( &aafi );
+
+	TEST_LOG("\n");
+
+	return errors;
+}
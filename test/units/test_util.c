@@ -0,0 +1,144 @@
+/*
+ * Copyright (C) 2017-2024 Adrien Gesta-Fline
+ *
+ * This file is part of libAAF.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include <libaaf/utils.h>
+
+#include "test_util.h"
+
+
+
+void test_put_le16( unsigned char *p, uint16_t v ) {
+	p[0] = (unsigned char)(v);
+	p[1] = (unsigned char)(v >> 8);
+}
+
+
+
+void test_put_le32( unsigned char *p, uint32_t v ) {
+	p[0] = (unsigned char)(v);
+	p[1] = (unsigned char)(v >> 8);
+	p[2] = (unsigned char)(v >> 16);
+	p[3] = (unsigned char)(v >> 24);
+}
+
+
+
+void test_put_be16( unsigned char *p, uint16_t v ) {
+	p[0] = (unsigned char)(v >> 8);
+	p[1] = (unsigned char)(v);
+}
+
+
+
+void test_put_be32( unsigned char *p, uint32_t v ) {
+	p[0] = (unsigned char)(v >> 24);
+	p[1] = (unsigned char)(v >> 16);
+	p[2] = (unsigned char)(v >> 8);
+	p[3] = (unsigned char)(v);
+}
+
+
+
+int test_write_wav_file( const char *path, uint32_t samplerate, uint16_t channels, uint16_t samplesize, uint64_t frames, int32_t (*sampleAt)( uint64_t frame, unsigned int channel, void *user ), void *user ) {
+
+	unsigned char hdr[44];
+
+	uint16_t blockAlign = (uint16_t)(channels * (samplesize/8));
+	uint64_t dataSize = frames * blockAlign;
+
+	if ( dataSize > UINT32_MAX - 36 ) {
+		return -1;
+	}
+
+	memcpy( hdr, "RIFF", 4 );
+	test_put_le32( hdr+4, (uint32_t)(36 + dataSize) );
+	memcpy( hdr+8, "WAVEfmt ", 8 );
+	test_put_le32( hdr+16, 16 );
+	test_put_le16( hdr+20, 1 );
+	test_put_le16( hdr+22, channels );
+	test_put_le32( hdr+24, samplerate );
+	test_put_le32( hdr+28, samplerate * blockAlign );
+	test_put_le16( hdr+32, blockAlign );
+	test_put_le16( hdr+34, samplesize );
+	memcpy( hdr+36, "data", 4 );
+	test_put_le32( hdr+40, (uint32_t)dataSize );
+
+	unsigned char *data = malloc( (size_t)dataSize + 1 );
+
+	if ( !data ) {
+		return -1;
+	}
+
+	for ( uint64_t i = 0; i < frames; i++ ) {
+		for ( unsigned int c = 0; c < channels; c++ ) {
+
+			uint32_t v = (uint32_t)sampleAt( i, c, user );
+			unsigned char *p = data + i * blockAlign + c * (samplesize/8U);
+
+			for ( unsigned int b = 0; b < samplesize/8U; b++ ) {
+				p[b] = (unsigned char)(v >> (b*8));
+			}
+		}
+	}
+
+	FILE *fp = fopen( path, "wb" );
+
+	if ( !fp ) {
+		free( data );
+		return -1;
+	}
+
+	int rc = ( fwrite( hdr, 1, sizeof(hdr), fp ) == sizeof(hdr) &&
+	           fwrite( data, 1, (size_t)dataSize, fp ) == (size_t)dataSize ) ? 0 : -1;
+
+	fclose( fp );
+	free( data );
+
+	return rc;
+}
+
+
+
+aafiAudioEssenceFile * test_new_essence( AAF_Iface *aafi, aafMobID_t *mobID, const char *path, enum aafiEssenceType type, uint32_t samplerate, uint16_t channels, uint16_t samplesize, aafPosition_t length ) {
+
+	aafiAudioEssenceFile *audioEssenceFile = aafi_newAudioEssence( aafi, mobID, 1 );
+
+	if ( !audioEssenceFile ) {
+		return NULL;
+	}
+
+	audioEssenceFile->is_embedded = 0;
+	audioEssenceFile->type = type;
+	audioEssenceFile->formatTag = 0x0001; /* integer PCM */
+	audioEssenceFile->channels = channels;
+	audioEssenceFile->samplesize = samplesize;
+	audioEssenceFile->samplerate = samplerate;
+	audioEssenceFile->samplerateRational->numerator = (int32_t)samplerate;
+	audioEssenceFile->length = length;
+	audioEssenceFile->name = laaf_util_c99strdup( path );
+	audioEssenceFile->unique_name = laaf_util_c99strdup( path );
+	audioEssenceFile->usable_file_path = laaf_util_c99strdup( path );
+
+	return audioEssenceFile;
+}
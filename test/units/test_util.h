@@ -0,0 +1,50 @@
+/*
+ * Copyright (C) 2017-2024 Adrien Gesta-Fline
+ *
+ * This file is part of libAAF.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __test_util_h__
+#define __test_util_h__
+
+/*
+ * Helpers shared by unit tests working on audio files : WAVE files writing and
+ * external essences set up without any AAF file.
+ */
+
+#include <stdint.h>
+
+#include <libaaf.h>
+
+
+void test_put_le16( unsigned char *p, uint16_t v );
+void test_put_le32( unsigned char *p, uint32_t v );
+void test_put_be16( unsigned char *p, uint16_t v );
+void test_put_be32( unsigned char *p, uint32_t v );
+
+/*
+ * Writes a PCM WAVE file with a 44 bytes header. Samples are given by sampleAt(),
+ * in samplesize bits integer scale, and stored little endian.
+ */
+int test_write_wav_file( const char *path, uint32_t samplerate, uint16_t channels, uint16_t samplesize, uint64_t frames, int32_t (*sampleAt)( uint64_t frame, unsigned int channel, void *user ), void *user );
+
+/*
+ * Adds an external PCM essence located at path, with the given layout.
+ */
+aafiAudioEssenceFile * test_new_essence( AAF_Iface *aafi, aafMobID_t *mobID, const char *path, enum aafiEssenceType type, uint32_t samplerate, uint16_t channels, uint16_t samplesize, aafPosition_t length );
+
+#endif // ! __test_util_h__
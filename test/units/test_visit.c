@@ -0,0 +1,392 @@
+/*
+ * Copyright (C) 2017-2024 Adrien Gesta-Fline
+ *
+ * This file is part of libAAF.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Walks files of the test/aaf corpus with aaf_visit_file(). Objects must be
+ * visited depth first, each one right after the strong reference property of
+ * its parent, and must be the Objects of the Root::Header branch retrieved by
+ * aaf_load_file(). Callbacks returning a negative value must stop the walk,
+ * and on_object_begin() returning a positive value must skip the Object.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include <libaaf.h>
+#include <libaaf/AAFDefs/AAFClassDefUIDs.h>
+
+#include "common.h"
+
+
+#define TEST_MAX_DEPTH 64
+
+
+struct walk {
+	aafObject    *stack[TEST_MAX_DEPTH];
+	uint32_t      count;      /* Objects begun */
+	uint32_t      ended;      /* Objects ended */
+	uint32_t      properties;
+	aafProperty  *lastRef[TEST_MAX_DEPTH]; /* last strong reference property read at each depth */
+	uint32_t      errors;
+	char        **paths;
+	uint32_t      pathsSize;
+	uint32_t      stopAt;     /* on_object_begin() returns -1 for this Object, if not 0 */
+	uint32_t      callsAfterStop;
+	int           stopped;
+	const aafUID_t *skipClass; /* on_object_begin() returns 1 for Objects of that class */
+	uint32_t      skipped;
+	uint32_t      insideSkipped;
+};
+
+static int on_object_begin( aafVisitor *visitor, aafObject *Obj );
+static int on_property( aafVisitor *visitor, aafObject *Obj, aafProperty *Prop );
+static int on_object_end( aafVisitor *visitor, aafObject *Obj );
+static int is_strong_ref( aafProperty *Prop );
+static int visit( const char *file, struct walk *w );
+static char ** loaded_paths( const char *file, uint32_t *count );
+static int cmp_str( const void *a, const void *b );
+static void free_paths( char **paths, uint32_t count );
+static int test_file( const char *filename );
+
+
+
+static int is_strong_ref( aafProperty *Prop ) {
+	return ( Prop->sf == SF_STRONG_OBJECT_REFERENCE ||
+	         Prop->sf == SF_STRONG_OBJECT_REFERENCE_SET ||
+	         Prop->sf == SF_STRONG_OBJECT_REFERENCE_VECTOR );
+}
+
+
+
+static int on_object_begin( aafVisitor *visitor, aafObject *Obj ) {
+
+	struct walk *w = visitor->user;
+
+	if ( w->stopped ) {
+		w->callsAfterStop++;
+		return -1;
+	}
+
+	if ( w->count == 0 ) {
+		/* Root comes first, at depth 0 */
+		if ( visitor->depth != 0 || Obj->Parent != NULL ) {
+			w->errors++;
+		}
+	}
+	else if ( visitor->depth == 0 || visitor->depth > TEST_MAX_DEPTH ||
+	          Obj->Parent != w->stack[visitor->depth-1] ||
+	          w->lastRef[visitor->depth-1] == NULL )
+	{
+		/* any other Object comes right after the strong reference of its parent */
+		w->errors++;
+	}
+
+	for ( uint32_t d = 0; d < visitor->depth && d < TEST_MAX_DEPTH; d++ ) {
+		if ( w->skipClass && aafUIDCmp( w->stack[d]->Class->ID, w->skipClass ) ) {
+			w->insideSkipped++;
+		}
+	}
+
+	w->count++;
+
+	if ( w->stopAt && w->count == w->stopAt ) {
+		w->stopped = 1;
+		return -1;
+	}
+
+	if ( w->skipClass && aafUIDCmp( Obj->Class->ID, w->skipClass ) ) {
+		w->skipped++;
+		return 1;
+	}
+
+	if ( w->paths && w->count <= w->pathsSize ) {
+		w->paths[w->count-1] = laaf_util_c99strdup( aaf_get_ObjectPath( Obj ) );
+	}
+
+	if ( visitor->depth < TEST_MAX_DEPTH ) {
+		w->stack[visitor->depth] = Obj;
+		w->lastRef[visitor->depth] = NULL;
+	}
+
+	return 0;
+}
+
+
+
+static int on_property( aafVisitor *visitor, aafObject *Obj, aafProperty *Prop ) {
+
+	struct walk *w = visitor->user;
+
+	if ( w->stopped ) {
+		w->callsAfterStop++;
+		return -1;
+	}
+
+	/* properties of the Object on top of stack, one level deeper */
+	if ( visitor->depth == 0 || visitor->depth > TEST_MAX_DEPTH || Obj != w->stack[visitor->depth-1] ) {
+		w->errors++;
+	}
+
+	w->properties++;
+
+	if ( visitor->depth > 0 && visitor->depth <= TEST_MAX_DEPTH ) {
+		w->lastRef[visitor->depth-1] = ( is_strong_ref( Prop ) ) ? Prop : NULL;
+	}
+
+	return 0;
+}
+
+
+
+static int on_object_end( aafVisitor *visitor, aafObject *Obj ) {
+
+	struct walk *w = visitor->user;
+
+	if ( w->stopped ) {
+		w->callsAfterStop++;
+		return -1;
+	}
+
+	if ( visitor->depth >= TEST_MAX_DEPTH || Obj != w->stack[visitor->depth] ) {
+		w->errors++;
+	}
+
+	if ( w->skipClass && aafUIDCmp( Obj->Class->ID, w->skipClass ) ) {
+		/* skipped Objects are not ended */
+		w->errors++;
+	}
+
+	w->ended++;
+
+	return 0;
+}
+
+
+
+static int visit( const char *file, struct walk *w ) {
+
+	struct aafLog *log = laaf_new_log();
+	AAF_Data *aafd = aaf_alloc( log );
+
+	aafVisitor visitor;
+
+	memset( &visitor, 0x00, sizeof(aafVisitor) );
+
+	visitor.on_object_begin = on_object_begin;
+	visitor.on_property     = on_property;
+	visitor.on_object_end   = on_object_end;
+	visitor.user            = w;
+
+	int rc = ( aafd ) ? aaf_visit_file( aafd, file, &visitor ) : 1;
+
+	if ( rc == 0 && visitor.depth != 0 ) {
+		w->errors++;
+	}
+
+	aaf_release( &aafd );
+	laaf_free_log( log );
+
+	return rc;
+}
+
+
+
+static char ** loaded_paths( const char *file, uint32_t *count ) {
+
+	struct aafLog *log = laaf_new_log();
+	AAF_Data *aafd = aaf_alloc( log );
+
+	char **paths = NULL;
+
+	*count = 0;
+
+	if ( !aafd || aaf_load_file( aafd, file ) != 0 ) {
+		goto end;
+	}
+
+	aafObject *Obj = NULL;
+	uint32_t total = 0;
+
+	for ( Obj = aafd->Objects; Obj != NULL; Obj = Obj->nextObj ) {
+		total++;
+	}
+
+	paths = calloc( total, sizeof(char*) );
+
+	if ( !paths ) {
+		goto end;
+	}
+
+	/* Root and its Header branch, which is all aaf_visit_file() walks */
+	for ( Obj = aafd->Objects; Obj != NULL; Obj = Obj->nextObj ) {
+
+		aafObject *Top = Obj;
+
+		while ( Top->Parent && Top->Parent->Parent ) {
+			Top = Top->Parent;
+		}
+
+		if ( Top == Obj && Obj->Parent == NULL ) {
+			paths[(*count)++] = laaf_util_c99strdup( aaf_get_ObjectPath( Obj ) );
+		}
+		else if ( Top->Parent && aafUIDCmp( Top->Class->ID, &AAFClassID_Header ) ) {
+			paths[(*count)++] = laaf_util_c99strdup( aaf_get_ObjectPath( Obj ) );
+		}
+	}
+
+end:
+	aaf_release( &aafd );
+	laaf_free_log( log );
+
+	return paths;
+}
+
+
+
+static int cmp_str( const void *a, const void *b ) {
+	return strcmp( *(char * const *)a, *(char * const *)b );
+}
+
+
+
+static void free_paths( char **paths, uint32_t count ) {
+
+	if ( !paths ) {
+		return;
+	}
+
+	for ( uint32_t i = 0; i < count; i++ ) {
+		free( paths[i] );
+	}
+
+	free( paths );
+}
+
+
+
+static int test_file( const char *filename ) {
+
+	char *file = laaf_util_build_path( "/", LIBAAF_TEST_AAF_PATH, filename, NULL );
+
+	struct walk w;
+
+	uint32_t loadedCount = 0;
+	char **loaded = loaded_paths( file, &loadedCount );
+
+	int errors = 0;
+
+	if ( !loaded || loadedCount == 0 ) {
+		TEST_LOG( TEST_ERROR_STR "Could not load %s\n", __LINE__, filename );
+		errors++;
+		goto end;
+	}
+
+
+	/* full walk : same Objects as a full load, in depth first order */
+
+	memset( &w, 0x00, sizeof(struct walk) );
+
+	w.paths = calloc( loadedCount, sizeof(char*) );
+	w.pathsSize = loadedCount;
+
+	int rc = visit( file, &w );
+
+	if ( rc != 0 || w.errors || w.count != w.ended || w.count != loadedCount ) {
+		TEST_LOG( TEST_ERROR_STR "%s : visit returned %i, %u order errors, %u Objects begun, %u ended, %u loaded\n", __LINE__, filename, rc, w.errors, w.count, w.ended, loadedCount );
+		errors++;
+	}
+	else {
+
+		qsort( loaded, loadedCount, sizeof(char*), cmp_str );
+		qsort( w.paths, w.count, sizeof(char*), cmp_str );
+
+		for ( uint32_t i = 0; i < loadedCount; i++ ) {
+			if ( !w.paths[i] || strcmp( w.paths[i], loaded[i] ) != 0 ) {
+				TEST_LOG( TEST_ERROR_STR "%s : visited %s, loaded %s\n", __LINE__, filename, w.paths[i], loaded[i] );
+				errors++;
+				break;
+			}
+		}
+	}
+
+	free_paths( w.paths, w.pathsSize );
+
+	uint32_t total = w.count;
+
+
+	/* early stop : a negative return value stops the walk and is returned */
+
+	memset( &w, 0x00, sizeof(struct walk) );
+
+	w.stopAt = total / 2;
+
+	rc = visit( file, &w );
+
+	if ( rc != -1 || w.count != total / 2 || w.callsAfterStop ) {
+		TEST_LOG( TEST_ERROR_STR "%s : stopping at Object %u returned %i, after %u Objects and %u more callbacks\n", __LINE__, filename, total / 2, rc, w.count, w.callsAfterStop );
+		errors++;
+	}
+
+
+	/* positive return value skips the Object and its whole branch */
+
+	memset( &w, 0x00, sizeof(struct walk) );
+
+	w.skipClass = &AAFClassID_ContentStorage;
+
+	rc = visit( file, &w );
+
+	if ( rc != 0 || w.errors || w.skipped != 1 || w.insideSkipped || w.count >= total || w.count != w.ended + 1 ) {
+		TEST_LOG( TEST_ERROR_STR "%s : skipping ContentStorage returned %i, %u errors, %u skipped, %u visited inside\n", __LINE__, filename, rc, w.errors, w.skipped, w.insideSkipped );
+		errors++;
+	}
+
+
+	if ( errors == 0 ) {
+		TEST_LOG( TEST_PASSED_STR "%s : %u Objects visited in order, stopped and skipped\n", __LINE__, filename, total );
+	}
+
+end:
+	free_paths( loaded, loadedCount );
+	free( file );
+
+	return errors;
+}
+
+
+
+int main( void ) {
+
+	SET_LOCALE()
+
+	TEST_LOG("\n");
+
+	int errors = 0;
+
+	errors += test_file( "PR_WAV_Internal.aaf" );
+	errors += test_file( "MC_Fades.aaf" );
+	errors += test_file( "PT_Fades.aaf" );
+
+	TEST_LOG("\n");
+
+	return errors;
+}
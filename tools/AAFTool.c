@@ -271,6 +271,8 @@ static void showHelp( void ) {
 		"   --aaf-classes                      Display classes contained in AAF file.\n"
 		"   --aaf-meta                         Display classes and properties from the MetaDictionary.\n"
 		"   --aaf-properties                   Display properties of all objects in file.\n"
+		"   --aaf-probe                        Only display header, identification and composition name and length,\n"
+		"                                      without parsing the whole file. Ignores any other option.\n"
 		"\n"
 		"   --trace                            Display AAF class/object structure while parsing.\n"
 		"   --dump-meta                        Display MetaProperties details for each parsed class containing meta properties.\n"
@@ -278,16 +280,28 @@ static void showHelp( void ) {
 		"   --dump-class         <AAFClassID>  Display aaf properties of a specific AAFClass when it is parsed.\n"
 		"   --dump-class-raw     <AAFClassID>  Display raw properties of a specific AAFClass when it is parsed.\n"
 		"\n"
-		"\n"
+		"\n", BIN_NAME
+	);
+
+	/* split, as C99 compilers are only required to support 4095 bytes strings */
+	fprintf( stderr,
 		" Embedded Media Extraction:\n"
 		"\n"
 		"   --extract-essences                 Extract all embedded audio essences as they are stored (wav or aiff),\n"
 		"                                      unless --extract-format is set. Raw PCM is extracted as wav file.\n"
 		"   --extract-clips                    Extract all embedded audio clips (trimed essences) as wav files.\n"
 		"   --extract-path             <path>  Location where embedded files are extracted.\n"
-		"   --extract-format       <bwav|wav>  Force extract format to wav or broadcast wav.\n"
+		"   --extract-format  <bwav|wav|rf64>  Force extract format to wav, broadcast wav or broadcast rf64.\n"
+		"                                      Files bigger than 4 GB are always extracted as rf64.\n"
+		"   --extract-sample-format <s16|s24|s32|f32>\n"
+		"                                      Convert extracted samples to 16, 24 or 32 bits integer, or 32 bits float.\n"
+		"   --extract-dither                   Apply TPDF dither when samples are converted to a lower resolution.\n"
+		"   --extract-split-channels           Extract each channel of multichannel essences and clips as a mono wav file.\n"
+		"   --extract-samplerate <rate|session>\n"
+		"                                      Resample extracted essences and clips to rate, or to the composition rate.\n"
 		"   --extract-mobid                    Name extracted files with their MobID. This also prevents any non-latin\n"
 		"                                      character in filename.\n"
+		"   -j, --jobs                  <num>  Number of threads used to load the file and extract embedded media.\n"
 		"\n"
 		"\n"
 		" Software Specific Options:\n"
@@ -314,7 +328,7 @@ static void showHelp( void ) {
 		"   --log-file                 <file>  Save output to file instead of stdout.\n"
 		"\n"
 		"   --verb                      <num>  0=quiet 1=error 2=warning 3=debug.\n"
-		"\n\n", BIN_NAME
+		"\n\n"
 	);
 }
 
@@ -361,12 +375,18 @@ int main( int argc, char *argv[] ) {
 	int aaf_classes        = 0;
 	int aaf_meta           = 0;
 	int aaf_properties     = 0;
+	int aaf_probe          = 0;
 
 	int extract_essences   = 0;
 	int extract_clips      = 0;
 	const char *extract_path = NULL;
 	int extract_format     = AAFI_EXTRACT_DEFAULT;
 	int extract_mobid_filename = 0;
+	int extract_sample_format  = AAFI_SAMPLE_FORMAT_DEFAULT;
+	int extract_dither         = 0;
+	int extract_split_channels = 0;
+	int extract_samplerate     = 0;
+	int jobs               = 0;
 
 	int protools_options   = 0;
 
@@ -416,6 +436,7 @@ int main( int argc, char *argv[] ) {
 		{ "aaf-classes",       no_argument,        0,  0x13 },
 		{ "aaf-meta",          no_argument,        0,  0x14 },
 		{ "aaf-properties",    no_argument,        0,  0x15 },
+		{ "aaf-probe",         no_argument,        0,  0x16 },
 
 		{ "trace",             no_argument,        0,  0x20 },
 		{ "dump-meta",         no_argument,        0,  0x21 },
@@ -428,6 +449,11 @@ int main( int argc, char *argv[] ) {
 		{ "extract-path",      required_argument,  0,  0x32 },
 		{ "extract-format",    required_argument,  0,  0x33 },
 		{ "extract-mobid",     no_argument,        0,  0x34 },
+		{ "extract-sample-format", required_argument, 0, 0x35 },
+		{ "extract-dither",    no_argument,        0,  0x36 },
+		{ "extract-split-channels", no_argument,   0,  0x37 },
+		{ "extract-samplerate", required_argument, 0,  0x38 },
+		{ "jobs",              required_argument,  0,   'j' },
 
 		{ "pt-true-fades",     no_argument,        0,  0x40 },
 		{ "pt-remove-sae",     no_argument,        0,  0x41 },
@@ -455,7 +481,7 @@ int main( int argc, char *argv[] ) {
 	{
 		int option_index = 0;
 
-		c = getopt_long ( argc, argv, "h", long_options, &option_index );
+		c = getopt_long ( argc, argv, "hj:", long_options, &option_index );
 
 		if ( c == -1 )
 			break;
@@ -479,6 +505,7 @@ int main( int argc, char *argv[] ) {
 			case 0x13:  aaf_classes    = 1;         cmd++;          break;
 			case 0x14:  aaf_meta       = 1;         cmd++;          break;
 			case 0x15:  aaf_properties = 1;         cmd++;          break;
+			case 0x16:  aaf_probe      = 1;         cmd++;          break;
 
 			case 0x20:  trace = 1;                  cmd++;          break;
 			case 0x21:  dump_meta = 1;                              break;
@@ -492,6 +519,7 @@ int main( int argc, char *argv[] ) {
 			case 0x33:
 				if      ( strcmp( optarg, "wav"  ) == 0 ) extract_format = AAFI_EXTRACT_WAV;
 				else if ( strcmp( optarg, "bwav" ) == 0 ) extract_format = AAFI_EXTRACT_BWAV;
+				else if ( strcmp( optarg, "rf64" ) == 0 ) extract_format = AAFI_EXTRACT_RF64;
 				else {
 					fprintf( stderr,
 						"Command line error: wrong --extract-format <value>\n"
@@ -500,6 +528,31 @@ int main( int argc, char *argv[] ) {
 				}
 				break;
 			case 0x34:  extract_mobid_filename = 1; cmd++;          break;
+			case 0x35:
+				if      ( strcmp( optarg, "s16" ) == 0 ) extract_sample_format = AAFI_SAMPLE_FORMAT_S16;
+				else if ( strcmp( optarg, "s24" ) == 0 ) extract_sample_format = AAFI_SAMPLE_FORMAT_S24;
+				else if ( strcmp( optarg, "s32" ) == 0 ) extract_sample_format = AAFI_SAMPLE_FORMAT_S32;
+				else if ( strcmp( optarg, "f32" ) == 0 ) extract_sample_format = AAFI_SAMPLE_FORMAT_F32;
+				else {
+					fprintf( stderr,
+						"Command line error: wrong --extract-sample-format <value>\n"
+						"Try '%s --help' for more informations.\n", BIN_NAME );
+					goto err;
+				}
+				break;
+			case 0x36:  extract_dither = 1;                         break;
+			case 0x37:  extract_split_channels = 1;                 break;
+			case 0x38:
+				extract_samplerate = ( strcmp( optarg, "session" ) == 0 ) ? -1 : atoi(optarg);
+
+				if ( extract_samplerate == 0 || extract_samplerate < -1 ) {
+					fprintf( stderr,
+						"Command line error: wrong --extract-samplerate <value>\n"
+						"Try '%s --help' for more informations.\n", BIN_NAME );
+					goto err;
+				}
+				break;
+			case 'j':   jobs = atoi(optarg);                        break;
 
 			case 0x40:  protools_options |= AAFI_PROTOOLS_OPT_REPLACE_CLIP_FADES;          break;
 			case 0x41:  protools_options |= AAFI_PROTOOLS_OPT_REMOVE_SAMPLE_ACCURATE_EDIT; break;
@@ -627,12 +680,46 @@ int main( int argc, char *argv[] ) {
 	aafi_set_option_int( aafi, "dump_tagged_value",         dump_tagged_value         );
 	aafi_set_option_int( aafi, "protools",                  protools_options          );
 	aafi_set_option_int( aafi, "mobid_essence_filename",    extract_mobid_filename    );
+	aafi_set_option_int( aafi, "extract_sample_format",     extract_sample_format     );
+	aafi_set_option_int( aafi, "extract_dither",            extract_dither            );
+	aafi_set_option_int( aafi, "extract_split_channels",    extract_split_channels    );
+	aafi_set_option_int( aafi, "extract_samplerate",        extract_samplerate        );
+
+	if ( jobs > 0 ) {
+		aafi_set_option_int( aafi, "threads",                 jobs                      );
+	}
 
 	aafi_set_option_str( aafi, "media_location",            media_location            );
 	aafi_set_option_str( aafi, "dump_class_aaf_properties", dump_class_aaf_properties );
 	aafi_set_option_str( aafi, "dump_class_raw_properties", dump_class_raw_properties );
 
 
+	if ( aaf_probe ) {
+
+		if ( aafi_probe( aafi, argv[argc-1] ) ) {
+			fprintf( stderr, "Failed to probe %s\n", argv[argc-1] );
+			goto err;
+		}
+
+		log( aafi->log, "\n" );
+
+		aaf_dump_Header( aafd, " " );
+
+		log( aafd->log, "\n" );
+
+		aaf_dump_Identification( aafd, " " );
+
+		log( aafd->log, "\n" );
+
+		log( aafd->log, " Composition Name            : %s%s%s\n", ANSI_COLOR_DARKGREY(aafi->log), aafi->compositionName, ANSI_COLOR_RESET(aafi->log) );
+		log( aafd->log, " Composition Length (EU)     : %s%"PRIi64" (EditRate: %i/%i)%s\n", ANSI_COLOR_DARKGREY(aafi->log), aafi->compositionLength, (aafi->compositionLength_editRate) ? aafi->compositionLength_editRate->numerator : 0, (aafi->compositionLength_editRate) ? aafi->compositionLength_editRate->denominator : 0, ANSI_COLOR_RESET(aafi->log) );
+
+		log( aafd->log, "\n\n" );
+
+		goto end;
+	}
+
+
 	if ( aafi_load_file( aafi, argv[argc-1] ) ) {
 		fprintf( stderr, "Failed to open %s\n", argv[argc-1] );
 		goto err;
@@ -752,6 +839,26 @@ int main( int argc, char *argv[] ) {
 
 		log( aafd->log, " Composition Name            : %s%s%s\n", ANSI_COLOR_DARKGREY(aafi->log), aafi->compositionName, ANSI_COLOR_RESET(aafi->log) );
 
+		if ( aafi->compositionCount > 1 ) {
+
+			aafiComposition *composition = NULL;
+
+			AAFI_foreachComposition( aafi, composition ) {
+
+				if ( composition->aafi == aafi ) {
+					continue;
+				}
+
+				log( aafd->log, " Other Composition           : %s%s (Length: %"PRIi64" EditRate: %i/%i)%s\n",
+					ANSI_COLOR_DARKGREY(aafi->log),
+					composition->aafi->compositionName,
+					composition->aafi->compositionLength,
+					(composition->aafi->compositionLength_editRate) ? composition->aafi->compositionLength_editRate->numerator : 0,
+					(composition->aafi->compositionLength_editRate) ? composition->aafi->compositionLength_editRate->denominator : 0,
+					ANSI_COLOR_RESET(aafi->log) );
+			}
+		}
+
 		log( aafd->log, "\n" );
 
 		log( aafd->log, " TC EditRrate                : %s%i/%i%s\n", ANSI_COLOR_DARKGREY(aafi->log), aafi->Timecode->edit_rate->numerator, aafi->Timecode->edit_rate->denominator, ANSI_COLOR_RESET(aafi->log) );
@@ -1439,23 +1546,37 @@ int main( int argc, char *argv[] ) {
 
 	if ( extract_essences ) {
 
-		int hasEmbeddedEssences = 0;
-		aafiAudioEssenceFile *audioEssenceFile = NULL;
+		aafiAudioEssenceFile  *audioEssenceFile  = NULL;
+		aafiAudioEssenceFile **audioEssenceFiles = NULL;
+		size_t                 essenceCount      = 0;
 
 		AAFI_foreachAudioEssenceFile( aafi, audioEssenceFile ) {
+			essenceCount += ( audioEssenceFile->is_embedded != 0 );
+		}
+
+		if ( !essenceCount ) {
+			log( aafi->log, "[%s error %s] File has no embedded essence to extract.\n", ANSI_COLOR_RED(aafi->log), ANSI_COLOR_RESET(aafi->log) );
+		}
+		else {
+
+			audioEssenceFiles = malloc( essenceCount * sizeof(aafiAudioEssenceFile*) );
+
+			if ( !audioEssenceFiles ) {
+				log( aafi->log, "[%s error %s] Out of memory\n", ANSI_COLOR_RED(aafi->log), ANSI_COLOR_RESET(aafi->log) );
+				goto err;
+			}
+
+			essenceCount = 0;
 
-			if ( audioEssenceFile->is_embedded ) {
-				if ( aafi_extractAudioEssenceFile( aafi, audioEssenceFile, extract_format, extract_path, 0, 0, NULL, NULL ) == 0 ) {
-					log( aafi->log, "[%ssuccess%s] Audio essence file extracted to %s\"%s\"%s\n", ANSI_COLOR_GREEN(aafi->log), ANSI_COLOR_RESET(aafi->log), ANSI_COLOR_DARKGREY(aafi->log), audioEssenceFile->usable_file_path, ANSI_COLOR_RESET(aafi->log) );
-				} else {
-					log( aafi->log, "[%s error %s] Audio essence file extraction failed : %s\"%s\"%s\n", ANSI_COLOR_RED(aafi->log), ANSI_COLOR_RESET(aafi->log), ANSI_COLOR_DARKGREY(aafi->log), audioEssenceFile->unique_name, ANSI_COLOR_RESET(aafi->log) );
+			AAFI_foreachAudioEssenceFile( aafi, audioEssenceFile ) {
+				if ( audioEssenceFile->is_embedded ) {
+					audioEssenceFiles[essenceCount++] = audioEssenceFile;
 				}
-				hasEmbeddedEssences = 1;
 			}
-		}
 
-		if ( !hasEmbeddedEssences ) {
-			log( aafi->log, "[%s error %s] File has no embedded essence to extract.\n", ANSI_COLOR_RED(aafi->log), ANSI_COLOR_RESET(aafi->log) );
+			aafi_extractAudioEssenceFiles( aafi, audioEssenceFiles, essenceCount, extract_format, extract_path );
+
+			free( audioEssenceFiles );
 		}
 	}
 
@@ -1464,8 +1585,29 @@ int main( int argc, char *argv[] ) {
 
 		aafiAudioTrack   *audioTrack = NULL;
 		aafiTimelineItem *audioItem  = NULL;
-		aafiAudioClip    *audioClip  = NULL;
+
+		aafiAudioClip   **audioClips = NULL;
+		size_t            clipCount  = 0;
 
+		AAFI_foreachAudioTrack( aafi, audioTrack ) {
+			AAFI_foreachTrackItem( audioTrack, audioItem ) {
+				clipCount += ( audioItem->type == AAFI_AUDIO_CLIP );
+			}
+		}
+
+		audioClips = malloc( ((clipCount) ? clipCount : 1) * sizeof(aafiAudioClip*) );
+
+		if ( !audioClips ) {
+			log( aafi->log, "[%s error %s] Out of memory\n", ANSI_COLOR_RED(aafi->log), ANSI_COLOR_RESET(aafi->log) );
+			goto err;
+		}
+
+		clipCount = 0;
+
+		/*
+		 * All clips are extracted at once, so every essence stream is read
+		 * only once no matter how many clips are cut from it.
+		 */
 		AAFI_foreachAudioTrack( aafi, audioTrack ) {
 
 			AAFI_foreachTrackItem( audioTrack, audioItem ) {
@@ -1474,11 +1616,13 @@ int main( int argc, char *argv[] ) {
 					continue;
 				}
 
-				audioClip = audioItem->data;
-
-				aafi_extractAudioClip( aafi, audioClip, extract_format, extract_path );
+				audioClips[clipCount++] = audioItem->data;
 			}
 		}
+
+		aafi_extractAudioClips( aafi, audioClips, clipCount, extract_format, extract_path );
+
+		free( audioClips );
 	}
 
 	goto end;